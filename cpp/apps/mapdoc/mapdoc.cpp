@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/app/AppFactory.h"
+#include "monarch/data/json/JsonReader.h"
+#include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/mapped/MappedDocument.h"
+#include "monarch/data/mapped/MappedDocumentWriter.h"
+#include "monarch/io/FileInputStream.h"
+#include "monarch/io/FileOutputStream.h"
+
+#include <cstdio>
+
+using namespace std;
+using namespace monarch::app;
+using namespace monarch::config;
+using namespace monarch::data::json;
+using namespace monarch::data::mapped;
+using namespace monarch::io;
+using namespace monarch::modest;
+using namespace monarch::rt;
+
+#define APP_NAME "monarch.apps.mapdoc.MapDoc"
+
+namespace monarch
+{
+namespace apps
+{
+namespace mapdoc
+{
+
+/**
+ * Converts a JSON file, or standard input, to a mapped document.
+ *
+ * @param inFile the JSON file, NULL for standard input.
+ * @param outFile the mapped document file to write.
+ *
+ * @return true if successful, false if an exception occurred.
+ */
+static bool _convert(const char* inFile, const char* outFile)
+{
+   bool rval;
+
+   // read the JSON
+   File file((FileImpl*)NULL);
+   FileInputStream* fis;
+   if(inFile == NULL)
+   {
+      fis = new FileInputStream(FileInputStream::StdIn);
+   }
+   else
+   {
+      file = inFile;
+      fis = new FileInputStream(file);
+   }
+   DynamicObject dyno;
+   JsonReader jr;
+   rval = jr.start(dyno) && jr.read(fis) && jr.finish();
+   fis->close();
+   delete fis;
+
+   // write the document
+   if(rval)
+   {
+      File out(outFile);
+      FileOutputStream fos(out);
+      MappedDocumentWriter writer;
+      rval = writer.write(dyno, &fos);
+      fos.close();
+      if(rval)
+      {
+         printf("Wrote %s (%" PRIi64 " bytes).\n",
+            out->getAbsolutePath(), out->getLength());
+      }
+   }
+
+   return rval;
+}
+
+/**
+ * Writes a mapped document to standard output as JSON.
+ *
+ * @param inFile the mapped document file.
+ * @param compact true for compact JSON, false for indented JSON.
+ *
+ * @return true if successful, false if an exception occurred.
+ */
+static bool _dump(const char* inFile, bool compact)
+{
+   bool rval;
+
+   File file(inFile);
+   MappedDocument doc;
+   rval = doc.open(file);
+   if(rval)
+   {
+      DynamicObject dyno = doc.getRoot().toDynamicObject();
+      rval = JsonWriter::writeToStdOut(dyno, compact, false);
+      doc.close();
+   }
+
+   return rval;
+}
+
+class MapDocApp : public App
+{
+public:
+   MapDocApp() {};
+   virtual ~MapDocApp() {};
+   virtual DynamicObject getCommandLineSpec(Config& cfg)
+   {
+      // initialize config
+      Config& c = cfg[ConfigManager::MERGE][APP_NAME];
+      c["output"] = "";
+      c["dump"] = false;
+      c["compact"] = false;
+
+      DynamicObject spec;
+      spec["help"] =
+"MapDoc Options\n"
+"  -o, --output FILE   Convert a JSON file, or standard input, to a mapped\n"
+"                      document in FILE.\n"
+"      --dump          Write mapped document files as JSON.\n"
+"      --[no-]compact  Dump in compact format. (default: false)\n"
+"\n";
+
+      DynamicObject opt(NULL);
+
+      // output option
+      opt = spec["options"]->append();
+      opt["short"] = "-o";
+      opt["long"] = "--output";
+      opt["argError"] = "Output requires a filename.";
+      opt["arg"]["root"] = c;
+      opt["arg"]["path"] = "output";
+
+      // dump option
+      opt = spec["options"]->append();
+      opt["long"] = "--dump";
+      opt["setTrue"]["root"] = c;
+      opt["setTrue"]["path"] = "dump";
+
+      // compact options
+      opt = spec["options"]->append();
+      opt["long"] = "--compact";
+      opt["setTrue"]["root"] = c;
+      opt["setTrue"]["path"] = "compact";
+      opt = spec["options"]->append();
+      opt["long"] = "--no-compact";
+      opt["setFalse"]["root"] = c;
+      opt["setFalse"]["path"] = "compact";
+
+      // use extra options as files to process
+      opt = spec["options"]->append();
+      opt["extra"]["root"] = c;
+      opt["extra"]["path"] = "files";
+
+      return spec;
+   };
+
+   /**
+    * Runs the app.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool run()
+   {
+      Config cfg = getConfig()[APP_NAME];
+      DynamicObject& files = cfg["files"];
+
+      if(cfg["dump"]->getBoolean())
+      {
+         // dump each document
+         bool compact = cfg["compact"]->getBoolean();
+         DynamicObjectIterator i = files.getIterator();
+         while(i->hasNext() && _dump(i->next()->getString(), compact));
+      }
+      else if(cfg["output"]->length() == 0 || files->length() > 1)
+      {
+         ExceptionRef e = new Exception(
+            "Converting requires an output file and at most one JSON file.",
+            APP_NAME ".InvalidArguments");
+         Exception::set(e);
+      }
+      else
+      {
+         _convert(
+            (files->length() == 0) ? NULL : files[0]->getString(),
+            cfg["output"]->getString());
+      }
+
+      return !Exception::isSet();
+   };
+};
+
+class MapDocAppFactory : public AppFactory
+{
+public:
+   MapDocAppFactory() : AppFactory(APP_NAME, "1.0") {}
+   virtual ~MapDocAppFactory() {}
+   virtual App* createApp()
+   {
+      return new MapDocApp();
+   }
+};
+
+} // end namespace mapdoc
+} // end namespace apps
+} // end namespace monarch
+
+Module* createModestModule()
+{
+   return new monarch::apps::mapdoc::MapDocAppFactory();
+}
+
+void freeModestModule(Module* m)
+{
+   delete m;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/compress/ContentEncoder.h"
+
+#include "monarch/compress/deflate/Deflater.h"
+#include "monarch/compress/gzip/Gzipper.h"
+#include "monarch/io/ByteArrayOutputStream.h"
+#include "monarch/io/MutatorOutputStream.h"
+
+using namespace monarch::compress;
+using namespace monarch::compress::deflate;
+using namespace monarch::compress::gzip;
+using namespace monarch::io;
+
+bool ContentEncoder::encode(
+   const char* data, int length, bool gzip, ByteBuffer* out)
+{
+   bool rval;
+
+   Gzipper gzipper;
+   Deflater deflater;
+   MutationAlgorithm* algorithm;
+   if(gzip)
+   {
+      rval = gzipper.startCompressing();
+      algorithm = &gzipper;
+   }
+   else
+   {
+      // zlib+DEFLATE as the HTTP spec calls for
+      rval = deflater.startDeflating(-1, false);
+      algorithm = &deflater;
+   }
+
+   if(rval)
+   {
+      ByteArrayOutputStream baos(out, true);
+      MutatorOutputStream mos(&baos, false, algorithm, false);
+      rval = mos.write(data, length) && mos.finish();
+      mos.close();
+   }
+
+   return rval;
+}
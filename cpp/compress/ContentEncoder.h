@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_compress_ContentEncoder_H
+#define monarch_compress_ContentEncoder_H
+
+#include "monarch/io/ByteBuffer.h"
+
+namespace monarch
+{
+namespace compress
+{
+
+/**
+ * A ContentEncoder compresses data with the gzip or deflate content-codings
+ * that HTTP uses, such as for caching the encoded variants of a response.
+ *
+ * @author Dave Longley
+ */
+class ContentEncoder
+{
+public:
+   /**
+    * Compresses data with the gzip or deflate content-coding. The deflate
+    * content-coding is a zlib stream, not raw DEFLATE.
+    *
+    * @param data the data to compress.
+    * @param length the number of bytes of data.
+    * @param gzip true to gzip, false to deflate.
+    * @param out the buffer to append the compressed data to, which is
+    *           resized as necessary.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   static bool encode(
+      const char* data, int length, bool gzip, monarch::io::ByteBuffer* out);
+};
+
+} // end namespace compress
+} // end namespace monarch
+#endif
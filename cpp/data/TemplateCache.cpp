@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -10,132 +10,628 @@
 
 #include "monarch/data/TemplateCache.h"
 
+#include "monarch/compress/ContentEncoder.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/io/FileInputStream.h"
+#include "monarch/rt/System.h"
+
+#include <cstring>
 
 using namespace std;
+using namespace monarch::compress;
 using namespace monarch::data;
 using namespace monarch::io;
 using namespace monarch::rt;
 
-// Note: Future implementations may malloc a block of memory and store all
-// templates together there -- with byte array input streams reading the
-// appropriate sections for each template.
+/**
+ * The most parsed copies of one template to keep.
+ */
+#define MAX_PARSED_COPIES 16
 
-TemplateCache::TemplateCache(int capacity) :
+TemplateCache::TemplateCache(int capacity, uint32_t checkInterval) :
    mCapacity(capacity),
-   mUsed(0)
+   mUsed(0),
+   mCheckInterval(checkInterval),
+   mHits(0),
+   mMisses(0),
+   mParsedHits(0),
+   mParsedMisses(0),
+   mEvictions(0),
+   mInvalidations(0)
 {
 }
 
 TemplateCache::~TemplateCache()
 {
-   // clean up cache
-   for(Cache::iterator i = mCache.begin(); i != mCache.end(); ++i)
+   TemplateCache::clear();
+}
+
+/**
+ * Reads a file into a new buffer.
+ *
+ * @param file the file to read.
+ * @param length the length of the file.
+ *
+ * @return the buffer, NULL if an exception occurred.
+ */
+static ByteBuffer* _readFile(File& file, int length)
+{
+   ByteBuffer* rval = new ByteBuffer(length);
+   if(length > 0 && !file.readBytes(rval))
    {
-      // clean up filename
-      free((char*)i->first);
+      delete rval;
+      rval = NULL;
+   }
+   return rval;
+}
+
+/**
+ * Gets the modification time of a file.
+ *
+ * @param path the path to the file.
+ *
+ * @return the modification time in seconds, -1 if the file does not exist.
+ */
+static int64_t _getModified(const char* path)
+{
+   File file(path);
+   return file->exists() ? (int64_t)file->getModifiedDate().getSeconds() : -1;
+}
+
+/**
+ * Checks whether a ".gz" sibling of a file should be used for its gzip
+ * encoding: it must be at least as new as the file.
+ *
+ * @param filename the filename of the file.
+ * @param gzName to be set to the filename of the sibling.
+ *
+ * @return true if the sibling should be used, false if not.
+ */
+static bool _useSibling(const char* filename, string& gzName)
+{
+   gzName = filename;
+   gzName.append(".gz");
+   File gzFile(gzName.c_str());
+   int64_t modified = _getModified(filename);
+   return
+      gzFile->isReadable() &&
+      (modified == -1 || gzFile->getModifiedDate().getSeconds() >= modified);
+}
 
-      // clean up entry data
-      free(i->second.data);
+/**
+ * Checks that cached data is still up-to-date. A file that no longer exists
+ * keeps its cached data.
+ *
+ * @param filename the filename of the file.
+ * @param modified the modification time of the file the data is from.
+ * @param sibling true if the data is from a ".gz" sibling of the file.
+ *
+ * @return true if the data is up-to-date, false if not.
+ */
+static bool _isUpToDate(const char* filename, int64_t modified, bool sibling)
+{
+   bool rval;
+
+   int64_t current = _getModified(filename);
+   if(sibling)
+   {
+      // the sibling must be unchanged and still at least as new as the file
+      string gzName = filename;
+      gzName.append(".gz");
+      int64_t gz = _getModified(gzName.c_str());
+      rval = (gz == -1 || gz == modified) && current <= modified;
    }
+   else
+   {
+      rval = (current == -1 || current == modified);
+   }
+
+   return rval;
+}
+
+/**
+ * Creates a stream to read shared data.
+ *
+ * @param data the data to read.
+ * @param length to be set to the length of the data.
+ *
+ * @return the stream.
+ */
+static InputStream* _createStream(ByteBufferRef& data, off_t* length)
+{
+   if(length != NULL)
+   {
+      *length = data->length();
+   }
+   return new ByteArrayInputStream(data);
 }
 
 InputStream* TemplateCache::createStream(const char* filename, off_t* length)
 {
-   // get stream from cache
-   InputStream* rval = getCacheStream(filename, length);
-   if(rval == NULL)
+   InputStream* rval = NULL;
+
+   ByteBufferRef data;
+   if(getData(filename, data))
+   {
+      rval = _createStream(data, length);
+   }
+   else
    {
-      // check file
+      // data will NOT fit in cache, read it from disk
       File file(filename);
-      if(file->isReadable())
+      if(file->isReadable() && !fits(file->getLength()))
       {
-         // data will NOT fit in cache
-         off_t len = file->getLength();
-         if(len > INT32_MAX || (mCapacity != -1 && len > (mCapacity - mUsed)))
+         if(length != NULL)
+         {
+            *length = file->getLength();
+         }
+         rval = new FileInputStream(file);
+      }
+   }
+
+   return rval;
+}
+
+InputStream* TemplateCache::createEncodedStream(
+   const char* filename, Encoding encoding, off_t* length)
+{
+   InputStream* rval = NULL;
+
+   ByteBufferRef data;
+   if(encoding == Identity)
+   {
+      rval = createStream(filename, length);
+   }
+   else if(getData(filename, data, encoding))
+   {
+      rval = _createStream(data, length);
+   }
+   else
+   {
+      // a gzip sibling that will NOT fit in cache is read from disk
+      string gzName;
+      if(encoding == Gzip && _useSibling(filename, gzName))
+      {
+         File gzFile(gzName.c_str());
+         off_t len = gzFile->getLength();
+         if(!fits(len))
          {
             if(length != NULL)
             {
                *length = len;
             }
-            rval = new FileInputStream(file);
+            rval = new FileInputStream(gzFile);
          }
-         // data will fit in cache
-         else
+      }
+   }
+
+   return rval;
+}
+
+bool TemplateCache::getData(
+   const char* filename, ByteBufferRef& data, Encoding encoding)
+{
+   return
+      getCachedData(filename, encoding, data) ||
+      loadData(filename, encoding, data);
+}
+
+void* TemplateCache::takeParsed(const char* filename, int64_t modified)
+{
+   void* rval = NULL;
+
+   // stale copies are freed outside of the lock
+   FreeList stale;
+
+   mLock.lock();
+   {
+      ParsedCache::iterator i = mParsed.find(filename);
+      if(i != mParsed.end())
+      {
+         ParsedEntry& e = i->second;
+         if(e.modified != modified)
+         {
+            // file has changed
+            removeParsed(i, stale);
+            ++mInvalidations;
+         }
+         else if(!e.parsed.empty())
+         {
+            rval = e.parsed.back();
+            e.parsed.pop_back();
+            mUsed -= e.size;
+            mLru.splice(mLru.begin(), mLru, e.lru);
+         }
+      }
+
+      if(rval == NULL)
+      {
+         ++mParsedMisses;
+      }
+      else
+      {
+         ++mParsedHits;
+      }
+   }
+   mLock.unlock();
+
+   freeStale(stale);
+
+   return rval;
+}
+
+void TemplateCache::putParsed(
+   const char* filename, int64_t modified, int size, void* parsed,
+   FreeParsedFunction freeParsed)
+{
+   bool kept = false;
+   FreeList stale;
+
+   if(fits(size))
+   {
+      mLock.lock();
+      {
+         ParsedCache::iterator i = mParsed.find(filename);
+         if(i != mParsed.end())
          {
-            // read bytes from disk
-            int ilen = (int)len;
-            char* data = (char*)malloc(ilen);
-            ByteBuffer b(data, 0, 0, ilen, false);
-            if(file.readBytes(&b))
+            if(i->second.modified < modified)
             {
-               // cache data
-               rval = cache(filename, data, ilen, length);
+               // a newer version was parsed, drop the old copies
+               removeParsed(i, stale);
             }
             else
             {
-               free(data);
+               // keep the entry while making room
+               mLru.splice(mLru.begin(), mLru, i->second.lru);
+            }
+         }
+
+         if(makeRoom(size, stale))
+         {
+            // the entry is created if it is new or was evicted
+            i = mParsed.find(filename);
+            if(i == mParsed.end())
+            {
+               ParsedEntry e;
+               e.modified = modified;
+               e.size = size;
+               e.freeParsed = freeParsed;
+               const char* key = strdup(filename);
+               mLru.push_front(make_pair(key, (int)EncodingCount));
+               e.lru = mLru.begin();
+               i = mParsed.insert(make_pair(key, e)).first;
+            }
+            ParsedEntry& e = i->second;
+            if(e.modified == modified && e.size == size &&
+               e.parsed.size() < MAX_PARSED_COPIES)
+            {
+               e.parsed.push_back(parsed);
+               mUsed += size;
+               kept = true;
             }
          }
       }
+      mLock.unlock();
    }
 
-   return rval;
+   freeStale(stale);
+   if(!kept)
+   {
+      freeParsed(parsed);
+   }
 }
 
-InputStream* TemplateCache::getCacheStream(const char* filename, off_t* length)
+void TemplateCache::invalidate(const char* filename)
 {
-   InputStream* rval = NULL;
+   FreeList stale;
 
-   mLock.lockShared();
+   mLock.lock();
    {
-      Cache::iterator i = mCache.find(filename);
-      if(i != mCache.end())
+      for(int n = 0; n < EncodingCount; ++n)
       {
-         if(length != NULL)
+         Cache::iterator i = mCaches[n].find(filename);
+         if(i != mCaches[n].end())
          {
-            *length = i->second.length;
+            removeEntry((Encoding)n, i);
+            ++mInvalidations;
          }
-         rval = new ByteArrayInputStream(i->second.data, i->second.length);
+      }
+      ParsedCache::iterator i = mParsed.find(filename);
+      if(i != mParsed.end())
+      {
+         removeParsed(i, stale);
+         ++mInvalidations;
       }
    }
-   mLock.unlockShared();
+   mLock.unlock();
+
+   freeStale(stale);
+}
+
+void TemplateCache::clear()
+{
+   FreeList stale;
+
+   mLock.lock();
+   {
+      mInvalidations += mLru.size();
+      while(!mLru.empty())
+      {
+         removeLast(stale);
+      }
+   }
+   mLock.unlock();
+
+   freeStale(stale);
+}
+
+DynamicObject TemplateCache::getStats()
+{
+   DynamicObject rval;
+
+   mLock.lock();
+   {
+      uint32_t entries = 0;
+      for(int n = 0; n < EncodingCount; ++n)
+      {
+         entries += mCaches[n].size();
+      }
+      uint32_t parsed = 0;
+      for(ParsedCache::iterator i = mParsed.begin(); i != mParsed.end(); ++i)
+      {
+         parsed += i->second.parsed.size();
+      }
+
+      rval["capacity"] = mCapacity;
+      rval["used"] = mUsed;
+      rval["entries"] = entries;
+      rval["parsed"] = parsed;
+      rval["hits"] = mHits;
+      rval["misses"] = mMisses;
+      rval["parsedHits"] = mParsedHits;
+      rval["parsedMisses"] = mParsedMisses;
+      rval["evictions"] = mEvictions;
+      rval["invalidations"] = mInvalidations;
+   }
+   mLock.unlock();
 
    return rval;
 }
 
-InputStream* TemplateCache::cache(
-   const char* filename, char* data, int length, off_t* outLength)
+bool TemplateCache::getCachedData(
+   const char* filename, Encoding encoding, ByteBufferRef& data)
 {
-   InputStream* rval = NULL;
+   bool rval = false;
 
-   mLock.lockExclusive();
+   // find the entry, checking it against its file if it is time to
+   bool check = false;
+   int64_t modified = 0;
+   bool sibling = false;
+   uint64_t now = System::getCurrentMilliseconds();
+   mLock.lock();
+   {
+      Cache& c = mCaches[encoding];
+      Cache::iterator i = c.find(filename);
+      if(i == c.end())
+      {
+         ++mMisses;
+      }
+      else
+      {
+         // mark entry as most recently used
+         CacheEntry& e = i->second;
+         data = e.data;
+         mLru.splice(mLru.begin(), mLru, e.lru);
+         check = (now < e.checked || now - e.checked >= mCheckInterval);
+         if(check)
+         {
+            modified = e.modified;
+            sibling = e.sibling;
+         }
+         else
+         {
+            ++mHits;
+            rval = true;
+         }
+      }
+   }
+   mLock.unlock();
 
-   Cache::iterator i = mCache.find(filename);
-   if(i != mCache.end())
+   if(check)
    {
-      // already in cache, clean up data, get cache stream
-      mLock.unlockExclusive();
-      free(data);
-      rval = getCacheStream(filename, outLength);
+      // check the file without holding the lock
+      rval = _isUpToDate(filename, modified, sibling);
+
+      mLock.lock();
+      {
+         // the entry may have been replaced in the meantime
+         Cache& c = mCaches[encoding];
+         Cache::iterator i = c.find(filename);
+         if(i != c.end() && i->second.data == data)
+         {
+            if(rval)
+            {
+               i->second.checked = now;
+            }
+            else
+            {
+               removeEntry(encoding, i);
+               ++mInvalidations;
+            }
+         }
+
+         if(rval)
+         {
+            ++mHits;
+         }
+         else
+         {
+            ++mMisses;
+         }
+      }
+      mLock.unlock();
    }
-   else
+
+   if(!rval)
    {
-      // insert into cache
-      CacheEntry e;
-      e.length = length;
-      e.data = data;
-      mCache[strdup(filename)] = e;
-      mLock.unlockExclusive();
+      data.setNull();
+   }
 
-      // get cache stream
-      if(outLength != NULL)
+   return rval;
+}
+
+bool TemplateCache::loadData(
+   const char* filename, Encoding encoding, ByteBufferRef& data)
+{
+   bool rval = false;
+
+   File file(filename);
+   string gzName;
+   bool sibling = (encoding == Gzip && _useSibling(filename, gzName));
+   if(encoding == Identity || sibling)
+   {
+      // read the file, or its gzip sibling, from disk
+      File f = sibling ? File(gzName.c_str()) : file;
+      if(f->isReadable())
       {
-         *outLength = length;
+         int64_t modified = f->getModifiedDate().getSeconds();
+         off_t len = f->getLength();
+         if(fits(len))
+         {
+            ByteBuffer* b = _readFile(f, (int)len);
+            if(b != NULL)
+            {
+               data = b;
+               cache(filename, encoding, data, modified, sibling);
+               rval = true;
+            }
+         }
+      }
+   }
+   // encode the file if its encoding is likely to fit in the cache
+   else if(file->isReadable() && fits(file->getLength()))
+   {
+      int64_t modified = file->getModifiedDate().getSeconds();
+      ByteBufferRef identity;
+      if(getData(filename, identity))
+      {
+         ByteBuffer b(4096);
+         if(ContentEncoder::encode(
+            identity->data(), identity->length(), encoding == Gzip, &b))
+         {
+            // copy the encoding into a buffer of its size
+            ByteBuffer* encoded = new ByteBuffer(b.length());
+            encoded->put(b.data(), b.length(), false);
+            data = encoded;
+            cache(filename, encoding, data, modified, false);
+            rval = true;
+         }
       }
-      rval = new ByteArrayInputStream(data, length);
    }
 
    return rval;
 }
+
+void TemplateCache::cache(
+   const char* filename, Encoding encoding,
+   ByteBufferRef& data, int64_t modified, bool sibling)
+{
+   FreeList stale;
+
+   mLock.lock();
+   {
+      // replace any existing entry
+      Cache& c = mCaches[encoding];
+      Cache::iterator i = c.find(filename);
+      if(i != c.end())
+      {
+         removeEntry(encoding, i);
+      }
+
+      if(makeRoom(data->length(), stale))
+      {
+         CacheEntry e;
+         e.data = data;
+         e.modified = modified;
+         e.sibling = sibling;
+         e.checked = System::getCurrentMilliseconds();
+         const char* key = strdup(filename);
+         mLru.push_front(make_pair(key, (int)encoding));
+         e.lru = mLru.begin();
+         c.insert(make_pair(key, e));
+         mUsed += data->length();
+      }
+   }
+   mLock.unlock();
+
+   freeStale(stale);
+}
+
+bool TemplateCache::makeRoom(int length, FreeList& stale)
+{
+   if(mCapacity != -1)
+   {
+      // evict least recently used entries
+      while(mUsed + length > mCapacity && !mLru.empty())
+      {
+         removeLast(stale);
+         ++mEvictions;
+      }
+   }
+
+   return mCapacity == -1 || mUsed + length <= mCapacity;
+}
+
+void TemplateCache::removeEntry(Encoding encoding, Cache::iterator i)
+{
+   const char* key = i->first;
+   CacheEntry& e = i->second;
+   mUsed -= e.data->length();
+   mLru.erase(e.lru);
+   mCaches[encoding].erase(i);
+   free((char*)key);
+}
+
+void TemplateCache::removeParsed(ParsedCache::iterator i, FreeList& stale)
+{
+   const char* key = i->first;
+   ParsedEntry& e = i->second;
+   for(vector<void*>::iterator pi = e.parsed.begin();
+       pi != e.parsed.end(); ++pi)
+   {
+      stale.push_back(make_pair(*pi, e.freeParsed));
+   }
+   mUsed -= e.size * (int)e.parsed.size();
+   mLru.erase(e.lru);
+   mParsed.erase(i);
+   free((char*)key);
+}
+
+void TemplateCache::removeLast(FreeList& stale)
+{
+   pair<const char*, int> last = mLru.back();
+   if(last.second == EncodingCount)
+   {
+      removeParsed(mParsed.find(last.first), stale);
+   }
+   else
+   {
+      Encoding encoding = (Encoding)last.second;
+      removeEntry(encoding, mCaches[encoding].find(last.first));
+   }
+}
+
+void TemplateCache::freeStale(FreeList& stale)
+{
+   for(FreeList::iterator i = stale.begin(); i != stale.end(); ++i)
+   {
+      i->second(i->first);
+   }
+}
+
+bool TemplateCache::fits(off_t length)
+{
+   return
+      length <= INT32_MAX &&
+      (mCapacity == -1 || length <= mCapacity);
+}
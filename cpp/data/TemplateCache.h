@@ -1,14 +1,18 @@
 /*
- * Copyright (c) 2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_data_TemplateCache_H
 #define monarch_data_TemplateCache_H
 
+#include "monarch/io/ByteBuffer.h"
 #include "monarch/io/InputStream.h"
-#include "monarch/rt/SharedLock.h"
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/ExclusiveLock.h"
 #include "monarch/util/StringTools.h"
 
+#include <list>
 #include <map>
+#include <vector>
 
 namespace monarch
 {
@@ -20,23 +24,71 @@ namespace data
  * file names. The input stream may reads the template from disk or from
  * a cache.
  *
+ * Cached files are kept in shared, immutable ByteBuffers. A cache hit only
+ * takes a reference to the buffer, so any number of streams can read a
+ * cached file at once without copying it, and a file that is evicted or
+ * invalidated while it is being read stays valid until its readers are
+ * done.
+ *
+ * A TemplateCache can also provide gzip and deflate encodings of a file so
+ * that they can be sent as-is to clients that accept them. An encoding is
+ * created once and cached alongside the original. For gzip, a ".gz" sibling
+ * of the file is used instead if it is at least as new as the file.
+ *
+ * Templates parsed by a TemplateInputStream are also kept, by filename and
+ * modification time, so that rendering a template again only has to
+ * evaluate its variables. A parsed template is used by one stream at a
+ * time: it is taken out of the cache for a render and put back afterwards,
+ * so a template rendered by several threads at once is parsed once per
+ * concurrent render and the copies are kept for reuse.
+ *
+ * When the capacity of the cache would be exceeded, the least recently used
+ * files, encodings and parsed templates are evicted to make room. Parsed
+ * templates are charged the size of their file.
+ *
+ * A cached file is checked against the modification time of the file on
+ * disk when it is used, at most once per check interval, and is read again
+ * if the file has changed. A file that no longer exists keeps its cached
+ * data until it is invalidated or evicted.
+ *
  * Note: Future implementations could extend a more generalized FileCache
  * class. Consider integration with memcached if not overkill.
  *
- * Note: Might need the ability to flush the cache in the future.
- *
  * @author Dave Longley
  */
 class TemplateCache
 {
+public:
+   /**
+    * The content-encodings of a cached file.
+    */
+   enum Encoding
+   {
+      Identity = 0, Gzip, Deflate, EncodingCount
+   };
+
+   /**
+    * A function that frees a parsed template.
+    */
+   typedef void (*FreeParsedFunction)(void* parsed);
+
 protected:
+   /**
+    * A list of cached filenames and the cache they are in (an Encoding, or
+    * EncodingCount for parsed templates), most recently used first.
+    */
+   typedef std::list<std::pair<const char*, int> > KeyList;
+
    /**
     * A cache entry.
     */
    struct CacheEntry
    {
-      int length;
-      char* data;
+      monarch::io::ByteBufferRef data;
+      int64_t modified;
+      bool sibling;
+      uint64_t checked;
+      KeyList::iterator lru;
    };
 
    /**
@@ -44,12 +96,45 @@ protected:
     */
    typedef std::map<const char*, CacheEntry, monarch::util::StringComparator>
       Cache;
-   Cache mCache;
+
+   /**
+    * The caches for each encoding, the first is for the original files.
+    */
+   Cache mCaches[EncodingCount];
+
+   /**
+    * The parsed copies of a template that are not in use.
+    */
+   struct ParsedEntry
+   {
+      int64_t modified;
+      int size;
+      std::vector<void*> parsed;
+      FreeParsedFunction freeParsed;
+      KeyList::iterator lru;
+   };
+
+   /**
+    * A map of template filename to parsed templates.
+    */
+   typedef std::map<
+      const char*, ParsedEntry, monarch::util::StringComparator> ParsedCache;
+   ParsedCache mParsed;
+
+   /**
+    * The cached filenames in least recently used order.
+    */
+   KeyList mLru;
+
+   /**
+    * A list of parsed templates to free once the cache is unlocked.
+    */
+   typedef std::vector<std::pair<void*, FreeParsedFunction> > FreeList;
 
    /**
     * A lock for manipulating the cache.
     */
-   monarch::rt::SharedLock mLock;
+   monarch::rt::ExclusiveLock mLock;
 
    /**
     * The maximum size for the cache.
@@ -61,14 +146,31 @@ protected:
     */
    int mUsed;
 
+   /**
+    * The time between checks of a cached file for changes, in milliseconds.
+    */
+   uint32_t mCheckInterval;
+
+   /**
+    * Counters for the stats of this cache.
+    */
+   uint64_t mHits;
+   uint64_t mMisses;
+   uint64_t mParsedHits;
+   uint64_t mParsedMisses;
+   uint64_t mEvictions;
+   uint64_t mInvalidations;
+
 public:
    /**
     * Creates a new TemplateCache.
     *
     * @param capacity the maximum size to use for the cache, in bytes, -1 for
     *                 no max.
+    * @param checkInterval the time between checks of a cached file for
+    *           changes, in milliseconds, 0 to check every time it is used.
     */
-   TemplateCache(int capacity = -1);
+   TemplateCache(int capacity = -1, uint32_t checkInterval = 1000);
 
    /**
     * Destructs this TemplateCache.
@@ -87,30 +189,194 @@ public:
    virtual monarch::io::InputStream* createStream(
       const char* filename, off_t* length = NULL);
 
+   /**
+    * Creates an input stream for reading an encoding of a file. The caller
+    * must delete the returned stream when finished.
+    *
+    * A gzip encoding is read from an up-to-date ".gz" sibling of the file if
+    * there is one. Otherwise the encoding is created from the file and
+    * cached, unless the file is too large for the cache, in which case NULL
+    * is returned so that the caller can encode the file as it is read
+    * instead.
+    *
+    * @param filename the filename of the file.
+    * @param encoding the encoding to read.
+    * @param length to be set to the length of the encoded file.
+    *
+    * @return a stream for reading the encoded file, NULL on error or if the
+    *         file is too large to encode in the cache.
+    */
+   virtual monarch::io::InputStream* createEncodedStream(
+      const char* filename, Encoding encoding, off_t* length = NULL);
+
+   /**
+    * Gets the cached data for an encoding of a file, reading and caching it
+    * first if necessary. The data is shared and must not be modified. It
+    * stays valid for as long as the reference is held, even if it is
+    * evicted from the cache.
+    *
+    * @param filename the filename of the file.
+    * @param data to be set to the data.
+    * @param encoding the encoding to get.
+    *
+    * @return true if the data was set, false if the file could not be read
+    *         or is too large for the cache.
+    */
+   virtual bool getData(
+      const char* filename, monarch::io::ByteBufferRef& data,
+      Encoding encoding = Identity);
+
+   /**
+    * Takes a parsed copy of a template out of the cache. The caller has sole
+    * use of it until it is put back with putParsed(). Parsed copies of an
+    * older version of the file are freed.
+    *
+    * @param filename the filename of the template.
+    * @param modified the modification time of the file, in seconds.
+    *
+    * @return the parsed template or NULL if none is available.
+    */
+   virtual void* takeParsed(const char* filename, int64_t modified);
+
+   /**
+    * Puts a parsed template into the cache for reuse. It is freed instead if
+    * it is out of date, if there are enough copies of it or if it does not
+    * fit in this cache.
+    *
+    * @param filename the filename of the template.
+    * @param modified the modification time of the file it was parsed from,
+    *           in seconds.
+    * @param size the size of the file it was parsed from, which is charged
+    *           against the capacity of the cache.
+    * @param parsed the parsed template.
+    * @param freeParsed the function to free the parsed template with.
+    */
+   virtual void putParsed(
+      const char* filename, int64_t modified, int size, void* parsed,
+      FreeParsedFunction freeParsed);
+
+   /**
+    * Removes a file, its encodings and its parsed templates from the cache.
+    *
+    * @param filename the filename of the file.
+    */
+   virtual void invalidate(const char* filename);
+
+   /**
+    * Removes everything from the cache.
+    */
+   virtual void clear();
+
+   /**
+    * Gets the stats for this cache:
+    *
+    * capacity: the maximum size of the cache, -1 for no max.
+    * used: the space used by cached files and parsed templates.
+    * entries: the number of cached files and encodings.
+    * parsed: the number of parsed templates that are not in use.
+    * hits: the number of times a cached file or encoding was used.
+    * misses: the number of times a file or encoding was not cached.
+    * parsedHits: the number of times a parsed template was reused.
+    * parsedMisses: the number of times a template had to be parsed.
+    * evictions: the number of entries evicted to make room.
+    * invalidations: the number of entries dropped because their file
+    *    changed or they were invalidated.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
 protected:
    /**
-    * Creates an input stream to read from the cache.
+    * Gets cached data if it is still up-to-date.
     *
     * @param filename the filename for the template.
-    * @param length to be set to the length of the template.
+    * @param encoding the encoding to get.
+    * @param data to be set to the data.
     *
-    * @return the stream to read from, NULL if no such entry.
+    * @return true if the data was set, false if no such entry.
     */
-   virtual monarch::io::InputStream* getCacheStream(
-      const char* filename, off_t* length);
+   virtual bool getCachedData(
+      const char* filename, Encoding encoding,
+      monarch::io::ByteBufferRef& data);
 
    /**
-    * Caches a template and returns a stream to it.
+    * Reads or creates the data for an encoding of a file and caches it.
     *
     * @param filename the filename for the template.
-    * @param data the data for the template.
-    * @param length the length of the data in bytes.
-    * @param outLength to be set to the length of the template.
+    * @param encoding the encoding to load.
+    * @param data to be set to the data.
+    *
+    * @return true if the data was set, false if it could not be loaded or
+    *         does not fit in the cache.
+    */
+   virtual bool loadData(
+      const char* filename, Encoding encoding,
+      monarch::io::ByteBufferRef& data);
+
+   /**
+    * Caches the data of a file, replacing any existing entry. The data is
+    * not cached if it does not fit.
+    *
+    * @param filename the filename for the template.
+    * @param encoding the encoding of the data.
+    * @param data the data.
+    * @param modified the modification time of the file the data is from.
+    * @param sibling true if the data is from a ".gz" sibling of the file.
+    */
+   virtual void cache(
+      const char* filename, Encoding encoding,
+      monarch::io::ByteBufferRef& data, int64_t modified, bool sibling);
+
+   /**
+    * Evicts the least recently used entries until there is room for the
+    * given length. The cache must be locked.
+    *
+    * @param length the length to make room for.
+    * @param stale to be appended to with the parsed templates to free.
+    *
+    * @return true if there is room, false if not.
+    */
+   virtual bool makeRoom(int length, FreeList& stale);
+
+   /**
+    * Removes a cached file. The cache must be locked.
+    *
+    * @param encoding the encoding of the entry.
+    * @param i the entry to remove.
+    */
+   virtual void removeEntry(Encoding encoding, Cache::iterator i);
+
+   /**
+    * Removes the parsed templates of a file. The cache must be locked.
+    *
+    * @param i the entry to remove.
+    * @param stale to be appended to with the parsed templates to free.
+    */
+   virtual void removeParsed(ParsedCache::iterator i, FreeList& stale);
+
+   /**
+    * Removes the least recently used entry. The cache must be locked.
+    *
+    * @param stale to be appended to with the parsed templates to free.
+    */
+   virtual void removeLast(FreeList& stale);
+
+   /**
+    * Frees parsed templates. The cache must not be locked.
+    *
+    * @param stale the parsed templates to free.
+    */
+   virtual void freeStale(FreeList& stale);
+
+   /**
+    * Returns true if data of the given length will fit in the cache.
+    *
+    * @param length the length of the data.
     *
-    * @return an InputStream to read the template from the cache.
+    * @return true if the data will fit, false if not.
     */
-   virtual monarch::io::InputStream* cache(
-      const char* filename, char* data, int length, off_t* outLength);
+   virtual bool fits(off_t length);
 };
 
 } // end namespace data
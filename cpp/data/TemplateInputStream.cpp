@@ -15,9 +15,12 @@
 #include "monarch/io/ByteArrayOutputStream.h"
 #include "monarch/io/FileInputStream.h"
 #include "monarch/rt/Exception.h"
+#include "monarch/rt/ThreadLocal.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/util/Url.h"
 
+#include <pthread.h>
+
 using namespace std;
 using namespace monarch::crypto;
 using namespace monarch::data;
@@ -45,7 +48,9 @@ using namespace monarch::util;
 #define START_PIPE     "|"
 
 #define BUFFER_SIZE   2048
-#define MAX_BUFFER    0xFFFFFFFF
+
+// the largest output buffer to keep for a thread
+#define MAX_THREAD_BUFFER_SIZE   (1024 * 1024)
 
 #define EXCEPTION_TIS       "monarch.data.TemplateInputStream"
 #define EXCEPTION_STATE     EXCEPTION_TIS ".InvalidState"
@@ -80,9 +85,14 @@ TemplateInputStream::TemplateInputStream(
    FilterInputStream(is, cleanup),
    mTemplate(BUFFER_SIZE),
    mParsed(BUFFER_SIZE),
+   mOutput(&mParsed),
+   mOutputStream(NULL),
+   mFlushSize(0),
    mVars(vars),
    mStrict(strict),
-   mTemplateCache(NULL)
+   mTemplateCache(NULL),
+   mModified(0),
+   mFileSize(0)
 {
    resetState();
    mVars->setType(Map);
@@ -101,8 +111,13 @@ TemplateInputStream::TemplateInputStream(InputStream* is, bool cleanup) :
    FilterInputStream(is, cleanup),
    mTemplate(BUFFER_SIZE),
    mParsed(BUFFER_SIZE),
+   mOutput(&mParsed),
+   mOutputStream(NULL),
+   mFlushSize(0),
    mStrict(false),
-   mTemplateCache(NULL)
+   mTemplateCache(NULL),
+   mModified(0),
+   mFileSize(0)
 {
    resetState();
    mVars->setType(Map);
@@ -144,10 +159,193 @@ void TemplateInputStream::setCache(TemplateCache* cache)
    mTemplateCache = cache;
 }
 
+bool TemplateInputStream::setTemplateFile(const char* filename)
+{
+   bool rval = true;
+
+   File file(filename);
+   if(!file->exists())
+   {
+      ExceptionRef e = new Exception(
+         "Could not open file.",
+         "monarch.io.File.NotFound");
+      e->getDetails()["path"] = filename;
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      // use a syntax tree parsed from this version of the file if there is
+      // one, otherwise parse the file
+      int64_t modified = 0;
+      Construct* root = NULL;
+      if(mTemplateCache != NULL)
+      {
+         modified = file->getModifiedDate().getSeconds();
+         root = static_cast<Construct*>(
+            mTemplateCache->takeParsed(filename, modified));
+      }
+      if(root == NULL)
+      {
+         setInputStream(new FileInputStream(file), true);
+      }
+      else
+      {
+         // no input needed, only create output
+         FilterInputStream::setInputStream(NULL, false);
+         resetState(false);
+         mConstructs.push_back(root);
+         mBlocked = false;
+         mEndOfStream = true;
+         mState = CreateOutput;
+      }
+
+      // the syntax tree is put in the cache when this stream is reset
+      if(mTemplateCache != NULL)
+      {
+         mFilename = filename;
+         mModified = modified;
+         mFileSize = (int)file->getLength();
+      }
+   }
+
+   return rval;
+}
+
 int TemplateInputStream::read(char* b, int length)
 {
    int rval = -1;
 
+   if(parseTemplate() && generateOutput())
+   {
+      // get parsed data
+      rval = mParsed.get(b, length);
+   }
+
+   return rval;
+}
+
+void TemplateInputStream::close()
+{
+   if(mInputStream != NULL)
+   {
+      mInputStream->close();
+   }
+}
+
+bool TemplateInputStream::parse(OutputStream* os)
+{
+   return render(os);
+}
+
+/**
+ * The output buffer of each thread.
+ */
+static ThreadLocal* sThreadBuffer;
+static pthread_once_t sThreadBufferOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Frees the output buffer of a thread when it exits.
+ *
+ * @param buffer the buffer.
+ */
+static void _freeThreadBuffer(void* buffer)
+{
+   delete static_cast<ByteBuffer*>(buffer);
+}
+
+/**
+ * Creates the output buffer holder for each thread.
+ */
+static void _createThreadBuffer()
+{
+   sThreadBuffer = new ThreadLocal(&_freeThreadBuffer);
+}
+
+/**
+ * Takes the output buffer of the current thread, creating it if the thread
+ * has none. The buffer must be put back with _putThreadBuffer().
+ *
+ * @return the buffer.
+ */
+static ByteBuffer* _takeThreadBuffer()
+{
+   pthread_once(&sThreadBufferOnce, &_createThreadBuffer);
+   ByteBuffer* rval = static_cast<ByteBuffer*>(sThreadBuffer->get());
+   if(rval == NULL)
+   {
+      rval = new ByteBuffer(BUFFER_SIZE);
+   }
+   else
+   {
+      sThreadBuffer->set(NULL);
+   }
+   return rval;
+}
+
+/**
+ * Puts back the output buffer of the current thread.
+ *
+ * @param buffer the buffer.
+ */
+static void _putThreadBuffer(ByteBuffer* buffer)
+{
+   // do not keep the memory of an unusually large render
+   buffer->clear();
+   if(buffer->capacity() > MAX_THREAD_BUFFER_SIZE)
+   {
+      buffer->resize(BUFFER_SIZE);
+   }
+
+   if(sThreadBuffer->get() == NULL)
+   {
+      sThreadBuffer->set(buffer);
+   }
+   else
+   {
+      delete buffer;
+   }
+}
+
+bool TemplateInputStream::render(OutputStream* os, int flushSize)
+{
+   bool rval = parseTemplate();
+
+   if(rval && mState == CreateOutput)
+   {
+      // gather output in the buffer of this thread unless rendering into a
+      // buffer lent by an including template
+      ByteBuffer* buffer = NULL;
+      if(mOutput == &mParsed)
+      {
+         buffer = _takeThreadBuffer();
+         mOutput = buffer;
+      }
+      mOutputStream = os;
+      mFlushSize = (flushSize > 0) ? flushSize : 1;
+
+      rval = generateOutput() && flushOutput();
+
+      mOutputStream = NULL;
+      if(buffer != NULL)
+      {
+         _putThreadBuffer(buffer);
+         mOutput = &mParsed;
+      }
+   }
+
+   if(rval && !mParsed.isEmpty())
+   {
+      // write output that was generated before but not read
+      rval = os->write(mParsed.data(), mParsed.length()) && os->flush();
+      mParsed.clear();
+   }
+
+   return rval;
+}
+
+bool TemplateInputStream::parseTemplate()
+{
    // keep reading until error or state is done
    bool error = false;
    while(!error && mState < CreateOutput)
@@ -178,7 +376,15 @@ int TemplateInputStream::read(char* b, int length)
       e->getDetails()["vars"] = mVars;
       e->getDetails()["localVars"] = mLocalVars;
    }
-   else if(mState == CreateOutput)
+
+   return !error;
+}
+
+bool TemplateInputStream::generateOutput()
+{
+   bool rval = true;
+
+   if(mState == CreateOutput)
    {
       // generate output
       if(writeConstruct(mConstructs.back()))
@@ -189,7 +395,7 @@ int TemplateInputStream::read(char* b, int length)
       else
       {
          // error
-         rval = -1;
+         rval = false;
          ExceptionRef e = new Exception(
             "Could not generate template output.",
             EXCEPTION_TIS ".OutputError");
@@ -199,30 +405,43 @@ int TemplateInputStream::read(char* b, int length)
       }
    }
 
-   if(mState == Done)
-   {
-      // get parsed data
-      rval = mParsed.get(b, length);
-   }
-
    return rval;
 }
 
-
-bool TemplateInputStream::parse(OutputStream* os)
+bool TemplateInputStream::writeOutput(const char* b, int length)
 {
    bool rval = true;
 
-   char tmp[BUFFER_SIZE];
-   int numBytes;
-   while(rval && (numBytes = read(tmp, BUFFER_SIZE)) > 0)
+   if(mOutputStream != NULL && length >= mFlushSize)
+   {
+      // write large output, such as long literal text, directly
+      rval =
+         flushOutput() &&
+         mOutputStream->write(b, length) &&
+         mOutputStream->flush();
+   }
+   else
    {
-      rval = os->write(tmp, numBytes);
+      mOutput->put(b, length, true);
+      if(mOutputStream != NULL && mOutput->length() >= mFlushSize)
+      {
+         rval = flushOutput();
+      }
    }
 
-   if(numBytes < 0)
+   return rval;
+}
+
+bool TemplateInputStream::flushOutput()
+{
+   bool rval = true;
+
+   if(mOutputStream != NULL && !mOutput->isEmpty())
    {
-      rval = false;
+      rval =
+         mOutputStream->write(mOutput->data(), mOutput->length()) &&
+         mOutputStream->flush();
+      mOutput->clear();
    }
 
    return rval;
@@ -265,6 +484,13 @@ static bool _isArrayAccessor(DynamicObject& exp)
    return exp->hasMember("op") && exp["op"] == "[";
 }
 
+static bool _isExpression(DynamicObject& exp)
+{
+   return
+      exp->getType() == Map && exp->hasMember("expression") &&
+      exp["expression"]->getBoolean();
+}
+
 static bool _isArrayEnd(DynamicObject& exp, int arrayId = -1)
 {
    // arrayId of -1 means "any array end"
@@ -2055,6 +2281,7 @@ bool TemplateInputStream::parseExpression(
       describing an expression:
 
       Expression {
+         "expression": true (marks the map as an Expression),
          "lhs": Variable,
          "op": optional operator character,
          "rhs": present if "op" is, an Expression
@@ -2069,6 +2296,7 @@ bool TemplateInputStream::parseExpression(
    // init expression
    expression->setType(Map);
    expression->clear();
+   expression["expression"] = true;
    expression["local"] = false;
    expression["parent"].setNull();
    expression["arrayEnd"] = 0;
@@ -2198,6 +2426,7 @@ bool TemplateInputStream::parseExpression(
                   }
 
                   exp["op"] = string(1, del).c_str();
+                  exp["rhs"]["expression"] = true;
                   exp["rhs"]["local"] = false;
                   exp["rhs"]["parent"].setNull();
                   exp["rhs"]["lhs"] = params;
@@ -2770,10 +2999,10 @@ bool TemplateInputStream::writeConstruct(Construct* c)
 {
    bool rval = true;
 
-   // grow parsed buffer if full
-   if(mParsed.isFull())
+   // grow output buffer if full
+   if(mOutput->isFull())
    {
-      mParsed.resize(mParsed.capacity() * 2);
+      mOutput->resize(mOutput->capacity() * 2);
    }
 
    switch(c->type)
@@ -2803,7 +3032,7 @@ bool TemplateInputStream::writeConstruct(Construct* c)
       {
          // write literal text out
          Literal* data = static_cast<Literal*>(c->data);
-         mParsed.put(data->text.c_str(), data->text.length(), true);
+         rval = writeOutput(data->text.c_str(), data->text.length());
          break;
       }
       case Construct::Command:
@@ -2862,52 +3091,45 @@ bool TemplateInputStream::writeCommand(Construct* c, Command* cmd)
 
          if(rval)
          {
-            // fill parsed buffer with include data
-            InputStream* is = NULL;
-            off_t length = 0;
-            if(mTemplateCache != NULL)
-            {
-               is = mTemplateCache->createStream(path.c_str(), &length);
-               rval = (is != NULL);
-            }
-            else
+            // fill parsed buffer with include data, using the cached syntax
+            // tree of the included file if there is one
+            TemplateInputStream* tis = new TemplateInputStream(
+               mVars, mStrict, NULL, false, &mIncludeDirs);
+            tis->setCache(mTemplateCache);
+            rval = tis->setTemplateFile(path.c_str());
+            tis->mLocalVars = mLocalVars;
+
+            if(rval && mOutputStream != NULL && !params->hasMember("as"))
             {
-               File file(path.c_str());
-               length = file->getLength();
-               is = new FileInputStream(file);
+               // render into the same stream, lending the output buffer
+               rval = flushOutput();
+               tis->mOutput = mOutput;
+               rval = rval && tis->render(mOutputStream, mFlushSize);
             }
-
-            if(rval)
+            else if(rval)
             {
-               TemplateInputStream* tis = new TemplateInputStream(
-                  mVars, mStrict, is, true, &mIncludeDirs);
-               tis->mLocalVars = mLocalVars;
-               tis->setCache(mTemplateCache);
-
-               // write to parse buffer, keep track of old length
-               int len = mParsed.length();
-               mParsed.allocateSpace(length & MAX_BUFFER, true);
+               // write to output buffer, keep track of old length
+               int len = mOutput->length();
+               mOutput->allocateSpace(BUFFER_SIZE, true);
                int num;
                do
                {
-                  num = mParsed.fill(tis);
-                  if(num != 0 && mParsed.isFull())
+                  num = mOutput->fill(tis);
+                  if(num != 0 && mOutput->isFull())
                   {
-                     // grow parsed buffer
-                     mParsed.resize(mParsed.capacity() * 2);
+                     // grow output buffer
+                     mOutput->resize(mOutput->capacity() * 2);
                   }
                }
                while(num > 0);
-               tis->close();
-               delete tis;
                rval = (num != -1);
                if(rval && params->hasMember("as"))
                {
                   // copy data into a variable
-                  int size = mParsed.length() - len;
+                  int size = mOutput->length() - len;
                   string value;
-                  value.append(mParsed.end() - size, size);
-                  mParsed.trim(size);
+                  value.append(mOutput->end() - size, size);
+                  mOutput->trim(size);
 
                   // set local variable
                   rval = evalExpression(params["as"], false, true);
@@ -2918,6 +3140,8 @@ bool TemplateInputStream::writeCommand(Construct* c, Command* cmd)
                   }
                }
             }
+            tis->close();
+            delete tis;
 
             if(!rval)
             {
@@ -2950,13 +3174,13 @@ bool TemplateInputStream::writeCommand(Construct* c, Command* cmd)
       case Command::cmd_ldelim:
       {
          // write start of construct
-         mParsed.put(START_CONSTRUCT, 1, true);
+         rval = writeOutput(START_CONSTRUCT, 1);
          break;
       }
       case Command::cmd_rdelim:
       {
          // write end of construct
-         mParsed.put(END_CONSTRUCT, 1, true);
+         rval = writeOutput(END_CONSTRUCT, 1);
          break;
       }
       case Command::cmd_each:
@@ -3283,8 +3507,13 @@ bool TemplateInputStream::writeCommand(Construct* c, Command* cmd)
             // dump variable (non-strict json)
             JsonWriter writer(false);
             writer.setCompact(false);
-            ByteArrayOutputStream baos(&mParsed, true);
+            ByteArrayOutputStream baos(mOutput, true);
             rval = writer.write(var, &baos);
+            if(rval && mOutputStream != NULL &&
+               mOutput->length() >= mFlushSize)
+            {
+               rval = flushOutput();
+            }
          }
          break;
       }
@@ -3350,7 +3579,7 @@ bool TemplateInputStream::writeVariable(Construct* c, Variable* v)
       // write out variable value
       if(rval)
       {
-         mParsed.put(value.c_str(), value.length(), true);
+         rval = writeOutput(value.c_str(), value.length());
       }
    }
 
@@ -3990,8 +4219,135 @@ void TemplateInputStream::freeConstruct(Construct* c)
    delete c;
 }
 
+void TemplateInputStream::freeParsed(void* parsed)
+{
+   freeParsedConstruct(static_cast<Construct*>(parsed));
+}
+
+void TemplateInputStream::freeParsedConstruct(Construct* c)
+{
+   if(c->data != NULL)
+   {
+      switch(c->type)
+      {
+         case Construct::Literal:
+            delete static_cast<Literal*>(c->data);
+            break;
+         case Construct::Command:
+         {
+            Command* cmd = static_cast<Command*>(c->data);
+            delete cmd->params;
+            delete cmd;
+            break;
+         }
+         case Construct::Variable:
+            delete static_cast<Variable*>(c->data);
+            break;
+         case Construct::Pipe:
+         {
+            Pipe* p = static_cast<Pipe*>(c->data);
+            delete p->params;
+            delete p;
+            break;
+         }
+         default:
+            // should not happen, data is NULL for other types
+            break;
+      }
+   }
+
+   for(ConstructStack::iterator i = c->children.begin();
+       i != c->children.end(); ++i)
+   {
+      freeParsedConstruct(*i);
+   }
+
+   delete c;
+}
+
+/**
+ * Clears the values stored in expressions while they are evaluated. An
+ * expression is marked by its "expression" member (see parseExpression()),
+ * its "var", "value" and "parent" members refer to template variables.
+ *
+ * @param params the parameters to clear the expressions in.
+ */
+static void _clearExpressions(DynamicObject& params)
+{
+   if(!params.isNull())
+   {
+      if(_isExpression(params))
+      {
+         params->removeMember("var");
+         params->removeMember("value");
+         params["parent"].setNull();
+         params["local"] = false;
+      }
+      if(params->getType() == Map || params->getType() == Array)
+      {
+         DynamicObjectIterator i = params.getIterator();
+         while(i->hasNext())
+         {
+            _clearExpressions(i->next());
+         }
+      }
+   }
+}
+
+void TemplateInputStream::clearConstruct(Construct* c)
+{
+   if(c->data != NULL)
+   {
+      switch(c->type)
+      {
+         case Construct::Command:
+         {
+            Command* cmd = static_cast<Command*>(c->data);
+            if(cmd->params != NULL)
+            {
+               _clearExpressions(*cmd->params);
+            }
+            break;
+         }
+         case Construct::Variable:
+            _clearExpressions(static_cast<Variable*>(c->data)->params);
+            break;
+         case Construct::Pipe:
+         {
+            Pipe* p = static_cast<Pipe*>(c->data);
+            if(p->params != NULL)
+            {
+               _clearExpressions(*p->params);
+            }
+            break;
+         }
+         default:
+            // no expressions
+            break;
+      }
+   }
+
+   for(ConstructStack::iterator i = c->children.begin();
+       i != c->children.end(); ++i)
+   {
+      clearConstruct(*i);
+   }
+}
+
 void TemplateInputStream::resetState(bool createRoot)
 {
+   // put a complete syntax tree of a template file in the cache for reuse
+   if(!mFilename.empty() && mTemplateCache != NULL &&
+      mState >= CreateOutput && mConstructs.size() == 1)
+   {
+      Construct* root = mConstructs.back();
+      mConstructs.pop_back();
+      clearConstruct(root);
+      mTemplateCache->putParsed(
+         mFilename.c_str(), mModified, mFileSize, root, &freeParsed);
+   }
+   mFilename.clear();
+
    mState = FindConstruct;
    mStateStack.clear();
    mTemplate.clear();
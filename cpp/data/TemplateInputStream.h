@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_data_TemplateInputStream_H
 #define monarch_data_TemplateInputStream_H
@@ -50,6 +50,19 @@ namespace data
  * list of key-value pairs. If the value is an array, then the variable name
  * will be replaced with a comma-delimited list of values.
  *
+ * A template read with setTemplateFile() is parsed once: with a TemplateCache
+ * set, its syntax tree is kept in the cache by filename and modification
+ * time and later streams for the same file only evaluate its variables.
+ * Included templates are read the same way.
+ *
+ * A template can be read in pieces or rendered into an OutputStream with
+ * render(). Rendering writes output as it is generated instead of
+ * collecting it all first: it is gathered in a buffer that is reused by
+ * each thread and written and flushed whenever the buffer reaches a
+ * threshold, literal text at least that large is written straight from the
+ * syntax tree and included templates render into the same stream. A large
+ * page written to a chunked HTTP body therefore starts streaming at once.
+ *
  * Note: The current implementation assumes an ASCII character encoding. The
  * implementation, however, may not need to change if the text is in UTF-8.
  *
@@ -252,6 +265,22 @@ protected:
     */
    monarch::io::ByteBuffer mParsed;
 
+   /**
+    * The buffer that output is written to: mParsed, or a per-thread buffer
+    * while rendering into an OutputStream.
+    */
+   monarch::io::ByteBuffer* mOutput;
+
+   /**
+    * The OutputStream being rendered into, NULL if none.
+    */
+   monarch::io::OutputStream* mOutputStream;
+
+   /**
+    * The amount of buffered output to write to mOutputStream at once.
+    */
+   int mFlushSize;
+
    /**
     * Set to true when the parser is blocked and requires more input from
     * the underlying stream to proceed.
@@ -292,6 +321,22 @@ protected:
     */
    TemplateCache* mTemplateCache;
 
+   /**
+    * The filename of the template to put the syntax tree of in the cache,
+    * empty if the syntax tree is not to be cached.
+    */
+   std::string mFilename;
+
+   /**
+    * The modification time of the template file, in seconds.
+    */
+   int64_t mModified;
+
+   /**
+    * The size of the template file, in bytes.
+    */
+   int mFileSize;
+
 public:
    /**
     * Creates a new TemplateInputStream that reads a template from the
@@ -373,6 +418,19 @@ public:
     */
    virtual void setCache(TemplateCache* cache);
 
+   /**
+    * Sets up this stream to read a template file and resets the template
+    * parsing state. If a cache is set, a syntax tree parsed from the same
+    * version of the file is used instead of reading the file, and the syntax
+    * tree parsed by this stream is put into the cache when this stream is
+    * reset or destructed. Any cache must be set before calling this.
+    *
+    * @param filename the filename of the template.
+    *
+    * @return true if successful, false if the file could not be read.
+    */
+   virtual bool setTemplateFile(const char* filename);
+
    /**
     * Reads some bytes from the stream. This method will block until at least
     * one byte can be read or until the end of the stream is reached. A
@@ -388,9 +446,15 @@ public:
     */
    virtual int read(char* b, int length);
 
+   /**
+    * Closes the underlying stream, if there is one.
+    */
+   virtual void close();
+
    /**
     * Parses the entire input stream and writes the output to the passed
-    * OutputStream.
+    * OutputStream. This is the same as render() with the default flush
+    * size.
     *
     * @param os the OutputStream to write the output to.
     *
@@ -398,6 +462,18 @@ public:
     */
    virtual bool parse(monarch::io::OutputStream* os);
 
+   /**
+    * Renders the template into the passed OutputStream, writing and flushing
+    * the output each time the given amount is ready. Any output that was
+    * already generated but not read is written first.
+    *
+    * @param os the OutputStream to write the output to.
+    * @param flushSize the amount of output to write to the stream at once.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool render(monarch::io::OutputStream* os, int flushSize = 16384);
+
    /**
     * Find a template path given an absolute or relative path and potential
     * directories for relative paths.
@@ -413,6 +489,42 @@ public:
       const char* tpl, monarch::rt::DynamicObject& dirs, std::string& path);
 
 protected:
+   /**
+    * Parses the whole template into the internal syntax tree, unless it has
+    * already been parsed.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool parseTemplate();
+
+   /**
+    * Applies the variables to the internal syntax tree and writes the
+    * output, unless that has already been done.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool generateOutput();
+
+   /**
+    * Writes output to the output buffer. While rendering into an
+    * OutputStream, the buffer is flushed to it once it is large enough and
+    * large output is written to it directly.
+    *
+    * @param b the output to write.
+    * @param length the length of the output.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool writeOutput(const char* b, int length);
+
+   /**
+    * Writes the output buffer to the OutputStream being rendered into and
+    * flushes it, if there is such a stream.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool flushOutput();
+
    /**
     * Fills the template buffer using the underlying stream when more data
     * is needed.
@@ -626,6 +738,32 @@ protected:
     */
    virtual void freeConstruct(Construct* c);
 
+   /**
+    * Frees a syntax tree kept in a TemplateCache. The tree may outlive the
+    * TemplateInputStream that parsed it, so it is freed without the virtual
+    * free methods.
+    *
+    * @param parsed the root construct of the syntax tree.
+    */
+   static void freeParsed(void* parsed);
+
+   /**
+    * Frees a construct of a syntax tree kept in a TemplateCache and all of
+    * its children.
+    *
+    * @param c the construct to free.
+    */
+   static void freeParsedConstruct(Construct* c);
+
+   /**
+    * Clears the values stored in the expressions of a construct and all of
+    * its children while producing output, so the syntax tree can be used
+    * again with other variables.
+    *
+    * @param c the construct to clear.
+    */
+   static void clearConstruct(Construct* c);
+
    /**
     * Resets the parsing state, freeing any existing syntax tree.
     *
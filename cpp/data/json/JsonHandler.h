@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_json_JsonHandler_H
+#define monarch_data_json_JsonHandler_H
+
+#include "monarch/rt/DynamicObject.h"
+
+namespace monarch
+{
+namespace data
+{
+namespace json
+{
+
+/**
+ * A JsonHandler receives the structure of a JSON document as a series of
+ * events while a JsonReader parses it, instead of a DynamicObject tree.
+ * This allows documents of any size to be checked, filtered or forwarded
+ * using only as much memory as the handler keeps.
+ *
+ * For example, {"a":[1,true]} produces: startObject(), key("a"),
+ * startArray(), value(1), value(true), endArray(), endObject().
+ *
+ * Any event may return false with an exception set to stop parsing.
+ *
+ * @author Dave Longley
+ */
+class JsonHandler
+{
+public:
+   /**
+    * Creates a new JsonHandler.
+    */
+   JsonHandler() {};
+
+   /**
+    * Destructs this JsonHandler.
+    */
+   virtual ~JsonHandler() {};
+
+   /**
+    * Called when an object starts.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool startObject() = 0;
+
+   /**
+    * Called when an object ends.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool endObject() = 0;
+
+   /**
+    * Called when an array starts.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool startArray() = 0;
+
+   /**
+    * Called when an array ends.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool endArray() = 0;
+
+   /**
+    * Called with the key of the next member of an object.
+    *
+    * @param key the key, only valid during the call.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool key(const char* key) = 0;
+
+   /**
+    * Called with a string, number, boolean or null value.
+    *
+    * @param value the value.
+    *
+    * @return true to continue, false with an exception set to stop.
+    */
+   virtual bool value(monarch::rt::DynamicObject& value) = 0;
+};
+
+} // end namespace json
+} // end namespace data
+} // end namespace monarch
+#endif
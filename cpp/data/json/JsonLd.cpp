@@ -4,11 +4,15 @@
 #include "monarch/data/json/JsonLd.h"
 
 #include "monarch/crypto/MessageDigest.h"
+#include "monarch/data/json/JsonLdContextCache.h"
 #include "monarch/rt/DynamicObjectIterator.h"
 #include "monarch/rt/Exception.h"
 #include "monarch/util/StringTools.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <map>
+#include <vector>
 
 using namespace std;
 using namespace monarch::crypto;
@@ -30,6 +34,10 @@ using namespace monarch::util;
 
 #define EXCEPTION_TYPE    "monarch.data.json.JsonLd"
 
+// the default maximum number of permutations tried per blank node during
+// normalization
+#define MAX_PERMUTATIONS  100000
+
 // local helpers
 namespace {
 
@@ -41,8 +49,10 @@ class Processor
 public:
    /**
     * Creates a new Processor.
+    *
+    * @param cache the cache for processed contexts, NULL for none.
     */
-   Processor() {};
+   Processor(JsonLdContextCache* cache = NULL) : mCache(cache) {};
 
    /**
     * Destructs this Processor.
@@ -151,59 +161,246 @@ public:
    bool processContext(
       DynamicObject activeCtx, DynamicObject localCtx,
       DynamicObject options, DynamicObject& output);
+
+protected:
+   /**
+    * Merges a local context into an active context, without the cache.
+    *
+    * @param activeCtx the current active context.
+    * @param localCtx the local context to process.
+    * @param options the context processing options.
+    * @param output the new active context.
+    *
+    * @return true on success, false on failure with exception set.
+    */
+   bool mergeContext(
+      DynamicObject activeCtx, DynamicObject localCtx,
+      DynamicObject options, DynamicObject& output);
+
+   /**
+    * The cache for processed contexts, NULL for none.
+    */
+   JsonLdContextCache* mCache;
 };
 
 /**
- * A Permutator iterates over all possible permutations of the given array
- * of elements.
+ * An IdentifierIssuer issues sequential blank node identifiers
+ * ('<prefix><counter>'), remembering the identifier issued for each old
+ * identifier and the order they were issued in. It is used instead of a
+ * UniqueNamer during normalization because it is copied for every
+ * permutation that is tried.
+ */
+class IdentifierIssuer
+{
+public:
+   /**
+    * The prefix for issued identifiers.
+    */
+   string mPrefix;
+
+   /**
+    * The counter for the next identifier.
+    */
+   uint64_t mCounter;
+
+   /**
+    * A map of old identifier to issued identifier.
+    */
+   map<string, string> mExisting;
+
+   /**
+    * The old identifiers in the order identifiers were issued for them.
+    */
+   vector<string> mOrder;
+
+   /**
+    * Creates a new IdentifierIssuer.
+    *
+    * @param prefix the prefix for issued identifiers.
+    */
+   IdentifierIssuer(const char* prefix);
+
+   /**
+    * Destructs this IdentifierIssuer.
+    */
+   virtual ~IdentifierIssuer() {};
+
+   /**
+    * Gets the identifier issued for an old identifier, issuing a new one
+    * if none has been issued yet.
+    *
+    * @param oldId the old identifier.
+    *
+    * @return the issued identifier.
+    */
+   const string& getId(const string& oldId);
+
+   /**
+    * Returns true if an identifier has been issued for an old identifier.
+    *
+    * @param oldId the old identifier.
+    *
+    * @return true if an identifier has been issued, false if not.
+    */
+   bool hasId(const string& oldId) const;
+};
+
+/**
+ * A Canonicalizer assigns canonical names to the blank nodes in a set of RDF
+ * statements using the URDNA2015 algorithm.
  *
- * @param list the array of elements to iterate over.
+ * Each blank node is first hashed using only the statements it appears in
+ * (its first-degree hash). Blank nodes with unique first-degree hashes are
+ * named in hash order. Only the blank nodes that share a hash are then
+ * distinguished by hashing the paths to the blank nodes around them
+ * (their n-degree hash), which tries the permutations of each group of
+ * related blank nodes that share a hash. Those groups are small in
+ * practice, but a highly symmetric graph can still produce a great many
+ * permutations, so the number tried for each blank node is limited.
  */
-class Permutator
+class Canonicalizer
 {
 protected:
    /**
-    * The list/next permutation.
+    * The result of hashing the n-degree quads of a blank node.
+    */
+   struct HashResult
+   {
+      string hash;
+      IdentifierIssuer issuer;
+      HashResult() : issuer("") {};
+   };
+
+   /**
+    * Information about a blank node.
+    */
+   struct BlankNodeInfo
+   {
+      /**
+       * The indexes of the statements the blank node appears in.
+       */
+      vector<int> statements;
+
+      /**
+       * The first-degree hash, empty until it has been calculated.
+       */
+      string hash;
+   };
+   typedef map<string, BlankNodeInfo> BlankNodeMap;
+
+   /**
+    * The parts of a statement used to hash related blank nodes.
     */
-   DynamicObject mList;
+   struct StatementInfo
+   {
+      /**
+       * The property.
+       */
+      string property;
+
+      /**
+       * The subject, object and graph blank nodes, empty for other nodes.
+       */
+      string blankNodes[3];
+   };
 
    /**
-    * Whether or not the permutations are complete.
+    * The RDF statements.
     */
-   bool mDone;
+   DynamicObject mStatements;
 
    /**
-    * A directional map.
+    * The parts of each statement used to hash related blank nodes.
     */
-   DynamicObject mLeft;
+   vector<StatementInfo> mStatementInfo;
+
+   /**
+    * The blank nodes in the statements.
+    */
+   BlankNodeMap mBlankNodes;
+
+   /**
+    * The issuer of canonical identifiers.
+    */
+   IdentifierIssuer mCanonicalIssuer;
+
+   /**
+    * The number of permutations tried for the current blank node.
+    */
+   uint64_t mPermutations;
+
+   /**
+    * The maximum number of permutations to try per blank node.
+    */
+   uint64_t mMaxPermutations;
 
 public:
    /**
-    * Creates a Permutator that iterates over the given list.
+    * Creates a new Canonicalizer.
     *
-    * @param list the array of elements to iterate over.
+    * @param statements the RDF statements with the blank nodes to name.
+    * @param maxPermutations the maximum number of permutations to try when
+    *           distinguishing each blank node that shares a hash.
     */
-   Permutator(DynamicObject list);
+   Canonicalizer(DynamicObject statements, uint64_t maxPermutations);
 
    /**
-    * Destructs this Permutator.
+    * Destructs this Canonicalizer.
     */
-   virtual ~Permutator() {};
+   virtual ~Canonicalizer() {};
 
    /**
-    * Returns true if there is another permutation.
+    * Assigns canonical names to all of the blank nodes in the statements and
+    * renames them in the statements.
     *
-    * @return true if there is another permutation, false if not.
+    * @return true on success, false on failure with exception set.
     */
-   bool hasNext();
+   bool canonicalize();
 
+protected:
    /**
-    * Gets the next permutation. Call hasNext() to ensure there is another one
-    * first.
+    * Gets the first-degree hash of a blank node: the hash of the sorted
+    * N-Quads of the statements it appears in, with itself named '_:a' and
+    * other blank nodes named '_:z'.
     *
-    * @return the next permutation.
+    * @param id the blank node.
+    * @param hash set to the hash.
+    *
+    * @return true on success, false on failure with exception set.
     */
-   DynamicObject next();
+   bool hashFirstDegreeQuads(const string& id, string& hash);
+
+   /**
+    * Hashes a blank node that is related to another one by a statement,
+    * using the position it appears in, the property, and its canonical
+    * name, its name from the issuer or its first-degree hash.
+    *
+    * @param related the related blank node.
+    * @param property the property of the statement they appear in.
+    * @param issuer the issuer of temporary names.
+    * @param position "s", "o" or "g" for the position of the related node.
+    * @param hash set to the hash.
+    *
+    * @return true on success, false on failure with exception set.
+    */
+   bool hashRelatedBlankNode(
+      const string& related, const string& property,
+      IdentifierIssuer& issuer, const char* position, string& hash);
+
+   /**
+    * Gets the n-degree hash of a blank node by recursively choosing the
+    * permutations of related blank nodes that produce the
+    * lexicographically-least paths.
+    *
+    * @param id the blank node.
+    * @param issuer the issuer of temporary names.
+    * @param result set to the hash and the issuer used for the chosen
+    *           paths.
+    *
+    * @return true on success, false on failure with exception set.
+    */
+   bool hashNDegreeQuads(
+      const string& id, IdentifierIssuer& issuer, HashResult& result);
 };
 
 typedef DynamicObject UniqueNamer;
@@ -212,13 +409,7 @@ DynamicObject _expandValue(
    const char* base);
 DynamicObject _rdfToObject(DynamicObject& o);
 DynamicObject _makeLinkedList(DynamicObject value);
-bool _hashStatements(
-   const char* id, DynamicObject& bnodes, UniqueNamer& namer,
-   string& hash);
-bool _hashPaths(
-   const char* id, DynamicObject& bnodes,
-   UniqueNamer& namer, UniqueNamer pathNamer, DynamicObject& result);
-const char* _getAdjacentBlankNodeName(DynamicObject value, const char* id);
+bool _hash(const string& data, string& hash);
 void _flatten(
    DynamicObject input, DynamicObject graphs, const char* graph,
    UniqueNamer namer, const char* name, DynamicObject* list);
@@ -243,6 +434,7 @@ DynamicObject _removePreserve(DynamicObject& ctx, DynamicObject input);
 int _rankTerm(DynamicObject& ctx, const char* term, DynamicObject* value);
 DynamicObject _compactIri(
    DynamicObject& ctx, const char* iri, DynamicObject* value = NULL);
+void _createInverseContext(DynamicObject& ctx);
 bool _defineContextMapping(
    DynamicObject& activeCtx,
    DynamicObject& ctx, const char* key, const char* base,
@@ -274,7 +466,6 @@ bool _parseNQuads(const char* input, DynamicObject& statements);
 string _toNQuad(DynamicObject& statement, const char* bnode = NULL);
 UniqueNamer _createUniqueNamer(const char* prefix);
 const char* _getName(UniqueNamer& namer, const char* oldName = NULL);
-bool _isNamed(UniqueNamer& namer, const char* oldName);
 }
 
 JsonLd::JsonLd()
@@ -287,7 +478,7 @@ JsonLd::~JsonLd()
 
 bool JsonLd::compact(
    DynamicObject input, DynamicObject ctx, DynamicObject options,
-   DynamicObject& output)
+   DynamicObject& output, JsonLdContextCache* cache)
 {
    // nothing to compact with NULL
    if(input.isNull())
@@ -316,7 +507,7 @@ bool JsonLd::compact(
 
       // expand input
       DynamicObject expanded;
-      if(!JsonLd::expand(input, options, expanded))
+      if(!JsonLd::expand(input, options, expanded, cache))
       {
          ExceptionRef e = new Exception(
             "Could not expand input before compaction.",
@@ -327,7 +518,7 @@ bool JsonLd::compact(
 
       // process context
       DynamicObject activeCtx = _getInitialContext();
-      if(!JsonLd::processContext(activeCtx, ctx, options, activeCtx))
+      if(!JsonLd::processContext(activeCtx, ctx, options, activeCtx, cache))
       {
          ExceptionRef e = new Exception(
             "Could not process context before compaction.",
@@ -343,7 +534,7 @@ bool JsonLd::compact(
       }
 
       // do compaction
-      Processor p;
+      Processor p(cache);
       if(!p.compact(activeCtx, NULL, expanded, options, output))
       {
          return false;
@@ -422,7 +613,8 @@ bool JsonLd::compact(
 }
 
 bool JsonLd::expand(
-   DynamicObject input, DynamicObject options, DynamicObject& output)
+   DynamicObject input, DynamicObject options, DynamicObject& output,
+   JsonLdContextCache* cache)
 {
    bool rval = true;
 
@@ -441,7 +633,7 @@ bool JsonLd::expand(
       // do expansion
       DynamicObject ctx = _getInitialContext();
       DynamicObject expanded;
-      Processor p;
+      Processor p(cache);
       rval = p.expand(ctx, NULL, input, options, false, expanded);
       if(rval)
       {
@@ -461,7 +653,7 @@ bool JsonLd::expand(
 
 bool JsonLd::frame(
    DynamicObject input, DynamicObject frame,
-   DynamicObject options, DynamicObject& output)
+   DynamicObject options, DynamicObject& output, JsonLdContextCache* cache)
 {
    // set default options
    if(!options->hasMember("base"))
@@ -491,7 +683,7 @@ bool JsonLd::frame(
 
    // expand input
    DynamicObject _input;
-   if(!JsonLd::expand(input, options, _input))
+   if(!JsonLd::expand(input, options, _input, cache))
    {
       ExceptionRef e = new Exception(
          "Could not expand input before framing.",
@@ -502,7 +694,7 @@ bool JsonLd::frame(
 
    // expand frame
    DynamicObject _frame;
-   if(!JsonLd::expand(frame, options, _frame))
+   if(!JsonLd::expand(frame, options, _frame, cache))
    {
       ExceptionRef e = new Exception(
          "Could not expand frame before framing.",
@@ -521,7 +713,7 @@ bool JsonLd::frame(
 
    // compact result (force @graph option to true)
    options["graph"] = true;
-   if(!JsonLd::compact(framed, ctx, options, output))
+   if(!JsonLd::compact(framed, ctx, options, output, cache))
    {
       ExceptionRef e = new Exception(
          "Could not compact framed output.",
@@ -532,7 +724,7 @@ bool JsonLd::frame(
 
    // reprocess context
    DynamicObject activeCtx = _getInitialContext();
-   if(!JsonLd::processContext(activeCtx, ctx, options, activeCtx))
+   if(!JsonLd::processContext(activeCtx, ctx, options, activeCtx, cache))
    {
       ExceptionRef e = new Exception(
          "Could not process context before framing clean up.",
@@ -678,7 +870,7 @@ bool JsonLd::toRdf(
 
 bool JsonLd::processContext(
    DynamicObject activeCtx, DynamicObject localCtx,
-   DynamicObject options, DynamicObject& output)
+   DynamicObject options, DynamicObject& output, JsonLdContextCache* cache)
 {
    bool rval = true;
 
@@ -695,8 +887,12 @@ bool JsonLd::processContext(
       options["base"] = "";
    }
 
-   // resolve URLs in localCtx
-   localCtx = localCtx.clone();
+   // resolve URLs in a copy of localCtx since processing rewrites it (a
+   // cache processes its own copy)
+   if(cache == NULL)
+   {
+      localCtx = localCtx.clone();
+   }
    if(_isObject(localCtx) && !localCtx->hasMember("@context"))
    {
       DynamicObject tmp = localCtx;
@@ -709,7 +905,7 @@ bool JsonLd::processContext(
    if(rval)
    {
       // process context
-      Processor p;
+      Processor p(cache);
       rval = p.processContext(activeCtx, localCtx, options, output);
    }
 
@@ -1454,240 +1650,350 @@ bool Processor::frame(
    return _frame(state, state["subjects"].keys(), frame, output, NULL);
 }
 
-Permutator::Permutator(DynamicObject list) :
-   mList(list.sort()),
-   mDone(false),
-   mLeft(Map)
+IdentifierIssuer::IdentifierIssuer(const char* prefix) :
+   mPrefix(prefix),
+   mCounter(0)
 {
-   // initialize directional info for permutation algorithm
-   DynamicObjectIterator i = mList.getIterator();
-   while(i->hasNext())
+}
+
+const string& IdentifierIssuer::getId(const string& oldId)
+{
+   map<string, string>::iterator i = mExisting.find(oldId);
+   if(i == mExisting.end())
    {
-      mLeft[i->next()->getString()] = true;
+      // issue next identifier
+      char counter[21];
+      snprintf(counter, 21, "%" PRIu64, mCounter++);
+      i = mExisting.insert(make_pair(oldId, mPrefix + counter)).first;
+      mOrder.push_back(oldId);
    }
+   return i->second;
 }
 
-bool Permutator::hasNext()
+bool IdentifierIssuer::hasId(const string& oldId) const
 {
-   return !mDone;
+   return mExisting.find(oldId) != mExisting.end();
 }
 
-DynamicObject Permutator::next()
+Canonicalizer::Canonicalizer(
+   DynamicObject statements, uint64_t maxPermutations) :
+   mStatements(statements),
+   mCanonicalIssuer("_:c14n"),
+   mPermutations(0),
+   mMaxPermutations(maxPermutations)
 {
-   // copy current permutation
-   DynamicObject rval = mList.clone();
-
-   /* Calculate the next permutation using the Steinhaus-Johnson-Trotter
-    permutation algorithm. */
+}
 
-   // get largest mobile element k
-   // (mobile: element is greater than the one it is looking at)
-   DynamicObject k(NULL);
-   int pos = 0;
-   int length = mList->length();
+bool Canonicalizer::canonicalize()
+{
+   // map bnodes to the statements they appear in
+   const char* positions[] = {"subject", "object", "name"};
+   int length = mStatements->length();
+   mStatementInfo.resize(length);
    for(int i = 0; i < length; ++i)
    {
-      DynamicObject& element = mList[i];
-      bool left = mLeft[element->getString()];
-      if((k.isNull() || element > k) &&
-         ((left && i > 0 && element > mList[i - 1]) ||
-            (!left && i < (length - 1) && element > mList[i + 1])))
+      DynamicObject& statement = mStatements[i];
+      StatementInfo& info = mStatementInfo[i];
+      info.property = statement["property"]["nominalValue"]->getString();
+      for(int n = 0; n < 3; ++n)
+      {
+         if(statement->hasMember(positions[n]) &&
+            statement[positions[n]]["interfaceName"] == "BlankNode")
+         {
+            info.blankNodes[n] =
+               statement[positions[n]]["nominalValue"]->getString();
+            vector<int>& list = mBlankNodes[info.blankNodes[n]].statements;
+            // a statement with the same bnode twice is only listed once
+            if(list.empty() || list.back() != i)
+            {
+               list.push_back(i);
+            }
+         }
+      }
+   }
+
+   // group bnodes by first-degree hash
+   map<string, vector<string> > hashToBlankNodes;
+   for(BlankNodeMap::iterator i = mBlankNodes.begin();
+       i != mBlankNodes.end(); ++i)
+   {
+      string hash;
+      if(!hashFirstDegreeQuads(i->first, hash))
       {
-         k = element;
-         pos = i;
+         return false;
       }
+      hashToBlankNodes[hash].push_back(i->first);
    }
 
-   // no more permutations
-   if(k.isNull())
+   // name bnodes with unique hashes in hash order
+   map<string, vector<string> >::iterator hi;
+   for(hi = hashToBlankNodes.begin(); hi != hashToBlankNodes.end(); ++hi)
    {
-      mDone = true;
+      if(hi->second.size() == 1)
+      {
+         mCanonicalIssuer.getId(hi->second[0]);
+      }
    }
-   else
+
+   // name bnodes that share a hash by their n-degree hashes, in hash order
+   for(hi = hashToBlankNodes.begin(); hi != hashToBlankNodes.end(); ++hi)
    {
-      // swap k and the element it is looking at
-      int swap = mLeft[k->getString()] ? pos - 1 : pos + 1;
-      mList[pos] = mList[swap];
-      mList[swap] = k;
+      vector<string>& group = hi->second;
+      if(group.size() == 1)
+      {
+         continue;
+      }
 
-      // reverse the direction of all elements larger than k
-      for(int i = 0; i < length; ++i)
+      multimap<string, IdentifierIssuer> results;
+      for(vector<string>::iterator i = group.begin(); i != group.end(); ++i)
       {
-         if(mList[i] > k)
+         // skip bnodes named while naming another one in the group
+         if(mCanonicalIssuer.hasId(*i))
          {
-            mLeft[mList[i]->getString()] = !mLeft[mList[i]->getString()];
+            continue;
+         }
+
+         // hash with a temporary issuer that names the bnode first
+         IdentifierIssuer issuer("_:b");
+         issuer.getId(*i);
+         HashResult result;
+         mPermutations = 0;
+         if(!hashNDegreeQuads(*i, issuer, result))
+         {
+            return false;
+         }
+         results.insert(make_pair(result.hash, result.issuer));
+      }
+
+      // name bnodes in the order each result's issuer named them
+      for(multimap<string, IdentifierIssuer>::iterator ri = results.begin();
+          ri != results.end(); ++ri)
+      {
+         vector<string>& order = ri->second.mOrder;
+         for(vector<string>::iterator i = order.begin(); i != order.end(); ++i)
+         {
+            mCanonicalIssuer.getId(*i);
          }
       }
    }
 
-   return rval;
+   // rename bnodes in the statements
+   for(int i = 0; i < length; ++i)
+   {
+      for(int n = 0; n < 3; ++n)
+      {
+         const string& id = mStatementInfo[i].blankNodes[n];
+         if(!id.empty())
+         {
+            mStatements[i][positions[n]]["nominalValue"] =
+               mCanonicalIssuer.getId(id).c_str();
+         }
+      }
+   }
+
+   return true;
 }
 
-/**
- * Compares two hash paths results by hash.
- *
- * @param a the first result.
- * @param b the second result.
- *
- * @return true if the first result's hash is less than the second's.
- */
-bool _compareResults(DynamicObject a, DynamicObject b)
+bool Canonicalizer::hashFirstDegreeQuads(const string& id, string& hash)
 {
-   return a["hash"] < b["hash"];
+   BlankNodeInfo& info = mBlankNodes[id];
+   if(info.hash.empty())
+   {
+      // serialize and sort the bnode's statements
+      vector<string> nquads;
+      for(vector<int>::iterator i = info.statements.begin();
+          i != info.statements.end(); ++i)
+      {
+         nquads.push_back(_toNQuad(mStatements[*i], id.c_str()));
+      }
+      sort(nquads.begin(), nquads.end());
+
+      // cache hash of the joined quads
+      string joined;
+      for(vector<string>::iterator i = nquads.begin(); i != nquads.end(); ++i)
+      {
+         joined.append(*i);
+      }
+      if(!_hash(joined, info.hash))
+      {
+         return false;
+      }
+   }
+   hash = info.hash;
+   return true;
 }
 
-bool Processor::normalize(
-   DynamicObject input, DynamicObject options, DynamicObject& output)
+bool Canonicalizer::hashRelatedBlankNode(
+   const string& related, const string& property,
+   IdentifierIssuer& issuer, const char* position, string& hash)
 {
-   // map bnodes to RDF statements
-   DynamicObject statements(Array);
-   DynamicObject bnodes(Map);
-   UniqueNamer namer = _createUniqueNamer("_:t");
-   DynamicObject dNull(NULL);
-   Processor p;
-   p.toRdf(input, namer, dNull, dNull, dNull, statements);
-   DynamicObjectIterator i = statements.getIterator();
-   while(i->hasNext())
+   // use the canonical name, the issued name, or the first-degree hash
+   string id;
+   if(mCanonicalIssuer.hasId(related))
    {
-      DynamicObject& statement = i->next();
-      DynamicObject nodes(Array);
-      nodes.push("subject");
-      nodes.push("object");
-      DynamicObjectIterator ni = nodes.getIterator();
-      while(ni->hasNext())
-      {
-         const char* node = ni->next();
-         const char* id = statement[node]["nominalValue"];
-         if(statement[node]["interfaceName"] == "BlankNode")
+      id = mCanonicalIssuer.getId(related);
+   }
+   else if(issuer.hasId(related))
+   {
+      id = issuer.getId(related);
+   }
+   else if(!hashFirstDegreeQuads(related, id))
+   {
+      return false;
+   }
+
+   // hash position, property (unless a graph name) and the name or hash
+   string data = position;
+   if(position[0] != 'g')
+   {
+      data.push_back('<');
+      data.append(property);
+      data.push_back('>');
+   }
+   data.append(id);
+   return _hash(data, hash);
+}
+
+bool Canonicalizer::hashNDegreeQuads(
+   const string& id, IdentifierIssuer& issuer, HashResult& result)
+{
+   // group related bnodes by their hashes
+   map<string, vector<string> > hashToRelated;
+   const char* positions[] = {"s", "o", "g"};
+   vector<int>& statements = mBlankNodes[id].statements;
+   for(vector<int>::iterator i = statements.begin();
+       i != statements.end(); ++i)
+   {
+      StatementInfo& info = mStatementInfo[*i];
+      for(int n = 0; n < 3; ++n)
+      {
+         const string& related = info.blankNodes[n];
+         if(!related.empty() && related != id)
          {
-            bnodes[id]["statements"].push(statement);
+            string hash;
+            if(!hashRelatedBlankNode(
+               related, info.property, issuer, positions[n], hash))
+            {
+               return false;
+            }
+            hashToRelated[hash].push_back(related);
          }
       }
    }
 
-   // create canonical namer
-   namer = _createUniqueNamer("_:c14n");
-
-   // continue to hash bnode statements while bnodes are assigned names
-   DynamicObject unnamed(NULL);
-   DynamicObject nextUnnamed = bnodes.keys();
-   DynamicObject duplicates(NULL);
-   do
+   // build the data to hash from each group in hash order
+   string data;
+   map<string, vector<string> >::iterator hi;
+   for(hi = hashToRelated.begin(); hi != hashToRelated.end(); ++hi)
    {
-      unnamed = nextUnnamed;
-      nextUnnamed = DynamicObject(Array);
-      duplicates = DynamicObject(Map);
-      DynamicObject unique(Map);
-      i = unnamed.getIterator();
-      while(i->hasNext())
+      data.append(hi->first);
+
+      // choose the permutation of the group with the least path
+      string chosenPath;
+      IdentifierIssuer chosenIssuer("");
+      vector<string>& permutation = hi->second;
+      sort(permutation.begin(), permutation.end());
+      do
       {
-         // hash statements for each unnamed bnode
-         const char* bnode = i->next();
-         string hashStr;
-         if(!_hashStatements(bnode, bnodes, namer, hashStr))
+         // stop when too many permutations have been tried
+         if(++mPermutations > mMaxPermutations)
          {
+            ExceptionRef e = new Exception(
+               "Too many blank node permutations tried during "
+               "normalization.",
+               EXCEPTION_TYPE ".NormalizeLimitExceeded");
+            e->getDetails()["maxPermutations"] = mMaxPermutations;
+            Exception::set(e);
             return false;
          }
 
-         // store hash as unique or a duplicate
-         const char* hash = hashStr.c_str();
-         if(duplicates->hasMember(hash))
+         IdentifierIssuer issuerCopy = issuer;
+         string path;
+         vector<string> recursionList;
+         bool skipped = false;
+         for(vector<string>::iterator i = permutation.begin();
+             !skipped && i != permutation.end(); ++i)
          {
-            duplicates[hash].push(bnode);
-            nextUnnamed.push(bnode);
+            if(mCanonicalIssuer.hasId(*i))
+            {
+               path.append(mCanonicalIssuer.getId(*i));
+            }
+            else
+            {
+               // recurse if the bnode isn't named in the path yet
+               if(!issuerCopy.hasId(*i))
+               {
+                  recursionList.push_back(*i);
+               }
+               path.append(issuerCopy.getId(*i));
+            }
+
+            // skip permutation if path is already >= chosen path
+            skipped = !chosenPath.empty() &&
+               path.length() >= chosenPath.length() && path > chosenPath;
          }
-         else if(unique->hasMember(hash))
+
+         for(vector<string>::iterator i = recursionList.begin();
+             !skipped && i != recursionList.end(); ++i)
          {
-            duplicates[hash].push(unique[hash]);
-            duplicates[hash].push(bnode);
-            nextUnnamed.push(unique[hash]);
-            nextUnnamed.push(bnode);
-            unique->removeMember(hash);
+            HashResult res;
+            if(!hashNDegreeQuads(*i, issuerCopy, res))
+            {
+               return false;
+            }
+            path.append(issuerCopy.getId(*i));
+            path.push_back('<');
+            path.append(res.hash);
+            path.push_back('>');
+            issuerCopy = res.issuer;
+
+            // skip permutation if path is already >= chosen path
+            skipped = !chosenPath.empty() &&
+               path.length() >= chosenPath.length() && path > chosenPath;
          }
-         else
+
+         if(!skipped && (chosenPath.empty() || path < chosenPath))
          {
-            unique[hash] = bnode;
+            chosenPath = path;
+            chosenIssuer = issuerCopy;
          }
       }
+      while(next_permutation(permutation.begin(), permutation.end()));
 
-      // name unique bnodes in sorted hash order
-      i = unique.keys().sort().getIterator();
-      while(i->hasNext())
-      {
-         const char* bnode = unique[i->next()->getString()];
-         _getName(namer, bnode);
-      }
+      // add chosen path and keep its issuer
+      data.append(chosenPath);
+      issuer = chosenIssuer;
    }
-   while(unnamed->length() > nextUnnamed->length());
 
-   // enumerate duplicate hash groups in sorted order
-   i = duplicates.keys().sort().getIterator();
-   while(i->hasNext())
-   {
-      // process group
-      const char* hash = i->next();
-      DynamicObject& group = duplicates[hash];
-      DynamicObject results(Array);
-      DynamicObjectIterator gi = group.getIterator();
-      while(gi->hasNext())
-      {
-         // skip already-named bnodes
-         const char* bnode = gi->next();
-         if(_isNamed(namer, bnode))
-         {
-            continue;
-         }
+   result.issuer = issuer;
+   return _hash(data, result.hash);
+}
 
-         // hash bnode paths
-         UniqueNamer pathNamer = _createUniqueNamer("_:t");
-         _getName(pathNamer, bnode);
-         DynamicObject result;
-         if(!_hashPaths(bnode, bnodes, namer, pathNamer, result))
-         {
-            return false;
-         }
-         results.push(result);
-      }
+bool Processor::normalize(
+   DynamicObject input, DynamicObject options, DynamicObject& output)
+{
+   // get RDF statements
+   DynamicObject statements(Array);
+   UniqueNamer namer = _createUniqueNamer("_:t");
+   DynamicObject dNull(NULL);
+   Processor p;
+   p.toRdf(input, namer, dNull, dNull, dNull, statements);
 
-      // name bnodes in hash order
-      results.sort(&_compareResults);
-      DynamicObjectIterator ri = results.getIterator();
-      while(ri->hasNext())
-      {
-         // name all bnodes in path namer in key-entry order
-         DynamicObject& result = ri->next();
-         DynamicObjectIterator ni =
-            result["pathNamer"]["order"].getIterator();
-         while(ni->hasNext())
-         {
-            DynamicObject& tmp = ni->next();
-            _getName(namer, tmp);
-         }
-      }
+   // name bnodes canonically
+   uint64_t maxPermutations = options->hasMember("maxPermutations") ?
+      options["maxPermutations"]->getUInt64() : MAX_PERMUTATIONS;
+   Canonicalizer canonicalizer(statements, maxPermutations);
+   if(!canonicalizer.canonicalize())
+   {
+      return false;
    }
 
    // create normalized array
    output = DynamicObject(Array);
-
-   // update bnode names in each statement and serialize
-   i = statements.getIterator();
+   DynamicObjectIterator i = statements.getIterator();
    while(i->hasNext())
    {
-      DynamicObject& statement = i->next();
-      DynamicObject nodes(Array);
-      nodes.push("subject");
-      nodes.push("object");
-      DynamicObjectIterator ni = nodes.getIterator();
-      while(ni->hasNext())
-      {
-         const char* node = ni->next();
-         if(statement[node]["interfaceName"] == "BlankNode")
-         {
-            statement[node]["nominalValue"] = _getName(
-               namer, statement[node]["nominalValue"]);
-         }
-      }
-      output.push(_toNQuad(statement).c_str());
+      output.push(_toNQuad(i->next()).c_str());
    }
 
    // sort normalized output
@@ -2040,8 +2346,40 @@ bool Processor::processContext(
    DynamicObject activeCtx, DynamicObject localCtx,
    DynamicObject options, DynamicObject& output)
 {
-   // initialize the resulting context
+   bool rval = true;
+
+   // use a cached context if there is one
+   const char* base = options["base"];
+   if(mCache == NULL ||
+      !mCache->getContext(activeCtx, localCtx, base, output))
+   {
+      // merging rewrites values in the local context, so merge a copy when
+      // the local context is still needed to cache the result
+      DynamicObject ctx;
+      rval = mergeContext(
+         activeCtx, (mCache == NULL) ? localCtx : localCtx.clone(),
+         options, ctx);
+      if(rval && mCache != NULL)
+      {
+         // cached contexts are shared, so build the inverse context now
+         // instead of when it is first used
+         _createInverseContext(ctx);
+         mCache->putContext(activeCtx, localCtx, base, ctx);
+      }
+      output = ctx;
+   }
+
+   return rval;
+}
+
+bool Processor::mergeContext(
+   DynamicObject activeCtx, DynamicObject localCtx,
+   DynamicObject options, DynamicObject& output)
+{
+   // initialize the resulting context, its inverse will be out of date
    output = activeCtx.clone();
+   output->removeMember("inverse");
+   output->removeMember("prefixes");
 
    // normalize local context to an array
    if(_isObject(localCtx) && localCtx->hasMember("@context") &&
@@ -2252,261 +2590,23 @@ DynamicObject _makeLinkedList(DynamicObject value)
 }
 
 /**
- * Hashes all of the statements about the given blank node.
+ * Hashes data for normalization.
  *
- * @param id the ID of the bnode to hash statements for.
- * @param bnodes the mapping of bnodes to statements.
- * @param namer the canonical bnode namer.
- * @param hash the resulting hash.
+ * @param data the data to hash.
+ * @param hash set to the hexadecimal SHA-256 hash.
  *
  * @return true on success, false on failure.
  */
-bool _hashStatements(
-   const char* id, DynamicObject& bnodes, UniqueNamer& namer,
-   string& hash)
-{
-   // return cached hash
-   if(bnodes[id]->hasMember("hash"))
-   {
-      hash = bnodes[id]["hash"]->getString();
-      return true;
-   }
-
-   // serialize all of bnode's statements
-   DynamicObject nquads(Array);
-   DynamicObject& statements = bnodes[id]["statements"];
-   DynamicObjectIterator i = statements.getIterator();
-   while(i->hasNext())
-   {
-      nquads.push(_toNQuad(i->next(), id).c_str());
-   }
-
-   // sort serialized quads
-   nquads.sort();
-
-   // cache and return hashed quads
-   MessageDigest md;
-   if(!md.start("SHA1"))
-   {
-      return false;
-   }
-   i = nquads.getIterator();
-   while(i->hasNext())
-   {
-      if(!md.update(i->next()))
-      {
-         return false;
-      }
-   }
-   hash = md.getDigest();
-   bnodes[id]["hash"] = hash.c_str();
-   return (hash.length() > 0);
-}
-
-/**
- * Produces a hash for the paths of adjacent bnodes for a bnode,
- * incorporating all information about its subgraph of bnodes. This
- * method will recursively pick adjacent bnode permutations that produce the
- * lexicographically-least 'path' serializations.
- *
- * @param id the ID of the bnode to hash paths for.
- * @param bnodes the map of bnode statements.
- * @param namer the canonical bnode namer.
- * @param pathNamer the namer used to assign names to adjacent bnodes.
- * @param result the hash and pathNamer used.
- *
- * @return true on success, false on failure with exception set.
- */
-bool _hashPaths(
-   const char* id, DynamicObject& bnodes,
-   UniqueNamer& namer, UniqueNamer pathNamer, DynamicObject& result)
+bool _hash(const string& data, string& hash)
 {
-   // create SHA-1 digest
    MessageDigest md;
-   if(!md.start("SHA1"))
-   {
-      return false;
-   }
-
-   // group adjacent bnodes by hash, keep properties and references separate
-   DynamicObject groups(Map);
-   DynamicObjectIterator i = bnodes[id]["statements"].getIterator();
-   while(i->hasNext())
-   {
-      // get adjacent bnode
-      DynamicObject& statement = i->next();
-      const char* direction = NULL;
-      const char* bnode = _getAdjacentBlankNodeName(statement["subject"], id);
-      if(bnode != NULL)
-      {
-         direction = "p";
-      }
-      else
-      {
-         bnode = _getAdjacentBlankNodeName(statement["object"], id);
-         if(bnode != NULL)
-         {
-            direction = "r";
-         }
-      }
-
-      if(bnode != NULL)
-      {
-         // get bnode name (try canonical, path, then hash)
-         string name;
-         if(_isNamed(namer, bnode))
-         {
-            name = _getName(namer, bnode);
-         }
-         else if(_isNamed(pathNamer, bnode))
-         {
-            name = _getName(pathNamer, bnode);
-         }
-         else if(!_hashStatements(bnode, bnodes, namer, name))
-         {
-            return false;
-         }
-
-         // hash direction, property, and bnode name/hash
-         MessageDigest groupMd;
-         if(!(groupMd.start("SHA1") &&
-            groupMd.update(direction) &&
-            groupMd.update(statement["property"]["nominalValue"]) &&
-            groupMd.update(name.c_str())))
-         {
-            return false;
-         }
-         string groupHash = groupMd.getDigest();
-         if(groupHash.length() == 0)
-         {
-            return false;
-         }
-         // add bnode to hash group
-         groups[groupHash.c_str()].push(bnode);
-      }
-   }
-
-   // iterate over groups in sorted hash order
-   DynamicObject groupHashes = groups.keys().sort();
-   i = groupHashes.getIterator();
-   while(i->hasNext())
-   {
-      // digest group hash
-      const char* groupHash = i->next();
-      if(!md.update(groupHash))
-      {
-         return false;
-      }
-
-      string chosenPath;
-      UniqueNamer chosenNamer;
-      Permutator permutator(groups[groupHash]);
-      while(permutator.hasNext())
-      {
-         DynamicObject permutation = permutator.next();
-         UniqueNamer pathNamerCopy = pathNamer.clone();
-
-         // build adjacent path
-         string path;
-         bool skipped = false;
-         DynamicObject recurse(Array);
-         DynamicObjectIterator pi = permutation.getIterator();
-         while(pi->hasNext())
-         {
-            const char* bnode = pi->next();
-
-            // use canonical name if available
-            if(_isNamed(namer, bnode))
-            {
-               path.append(_getName(namer, bnode));
-            }
-            else
-            {
-               // recurse if bnode isn't named in the path yet
-               if(!_isNamed(pathNamerCopy, bnode))
-               {
-                  recurse.push(bnode);
-               }
-               path.append(_getName(pathNamerCopy, bnode));
-            }
-
-            // skip permutation if path is already >= chosen path
-            if(!chosenPath.empty() && path.length() >= chosenPath.length() &&
-               path > chosenPath)
-            {
-               skipped = true;
-               break;
-            }
-         }
-
-         // recurse
-         if(!skipped)
-         {
-            DynamicObjectIterator ri = recurse.getIterator();
-            while(ri->hasNext())
-            {
-               const char* bnode = ri->next();
-               DynamicObject res;
-               if(!_hashPaths(bnode, bnodes, namer, pathNamerCopy, res))
-               {
-                  return false;
-               }
-               path.append(_getName(pathNamerCopy, bnode));
-               path.push_back('<');
-               path.append(res["hash"]);
-               path.push_back('>');
-               pathNamerCopy = res["pathNamer"];
-
-               // skip permutation if path is already >= chosen path
-               if(!chosenPath.empty() &&
-                  path.length() >= chosenPath.length() && path > chosenPath)
-               {
-                  skipped = true;
-                  break;
-               }
-            }
-         }
-
-         if(!skipped && (chosenPath.empty() || path < chosenPath))
-         {
-            chosenPath = path;
-            chosenNamer = pathNamerCopy;
-         }
-      }
-
-      // digest chosen path
-      if(!md.update(chosenPath.c_str()))
-      {
-         return false;
-      }
-      // update namer
-      pathNamer = chosenNamer;
-   }
-
-   // return SHA-1 digest and path namer
-   result = DynamicObject(Map);
-   result["hash"] = md.getDigest().c_str();
-   result["pathNamer"] = pathNamer;
-   return true;
-}
-
-/**
- * A helper function that gets the blank node name from an RDF statement
- * node (subject or object). If the node is not a blank node or its
- * nominal value does not match the given blank node ID, it will be returned.
- *
- * @param node the RDF statement node.
- * @param id the ID of the blank node to look next to.
- *
- * @return the adjacent blank node name or null if none was found.
- */
-const char* _getAdjacentBlankNodeName(DynamicObject node, const char* id)
-{
-   if(node["interfaceName"] == "BlankNode" && node["nominalValue"] != id)
+   bool rval = md.start("SHA256") && md.update(data.c_str(), data.length());
+   if(rval)
    {
-      return node["nominalValue"];
+      hash = md.getDigest();
+      rval = (hash.length() > 0);
    }
-   return NULL;
+   return rval;
 }
 
 /**
@@ -3358,23 +3458,28 @@ DynamicObject _compactIri(
       }
    }
 
-   // find all possible term matches
+   // build the inverse context if it is not already built
+   if(!ctx->hasMember("inverse"))
+   {
+      _createInverseContext(ctx);
+   }
+
+   // find all possible term matches, only terms for the iri are candidates
+   // (the empty terms array is iterated if there are none)
+   DynamicObject& mappings = ctx["mappings"];
+   DynamicObject& inverse = ctx["inverse"];
    DynamicObject terms(Array);
    int highest = 0;
    bool listContainer = false;
    bool isList = (value != NULL && _isList(*value));
-   DynamicObjectIterator i = ctx["mappings"].getIterator();
+   DynamicObjectIterator i = inverse->hasMember(iri) ?
+      inverse[iri].getIterator() : terms.getIterator();
    while(i->hasNext())
    {
-      DynamicObject& entry = i->next();
-      const char* term = i->getName();
+      const char* term = i->next();
+      DynamicObject& entry = mappings[term];
       bool hasContainer = entry->hasMember("@container");
 
-      // skip terms with non-matching iris
-      if(entry["@id"] != iri)
-      {
-         continue;
-      }
       // skip @set containers for @lists
       if(isList && hasContainer && entry["@container"] == "@set")
       {
@@ -3427,17 +3532,13 @@ DynamicObject _compactIri(
    // no term matches, add possible CURIEs
    if(terms->length() == 0)
    {
-      i = ctx["mappings"].getIterator();
+      // only terms without colons can be prefixes
+      i = ctx["prefixes"].getIterator();
       while(i->hasNext())
       {
-         DynamicObject& entry = i->next();
-         const char* term = i->getName();
+         const char* term = i->next();
+         DynamicObject& entry = mappings[term];
 
-         // skip terms with colons, they can't be prefixes
-         if(strchr(term, ':') != NULL)
-         {
-            continue;
-         }
          // skip entries with @ids that are not partial matches
          if(entry["@id"] == iri || strstr(iri, entry["@id"]) != iri)
          {
@@ -3447,7 +3548,7 @@ DynamicObject _compactIri(
          // add CURIE as term if it has no mapping
          DynamicObject curie;
          curie->format("%s:%s", term, iri + entry["@id"]->length());
-         if(!ctx["mappings"]->hasMember(curie))
+         if(!mappings->hasMember(curie))
          {
             terms.push(curie);
          }
@@ -3984,6 +4085,35 @@ string _prependBase(const char* base, const char* iri)
    }
 }
 
+/**
+ * Builds the inverse of the mappings of an active context so that IRIs can
+ * be compacted without checking every term: "inverse" maps each IRI to the
+ * terms for it and "prefixes" lists the terms that could be CURIE prefixes.
+ * Both keep the order of the mappings.
+ *
+ * @param ctx the active context.
+ */
+void _createInverseContext(DynamicObject& ctx)
+{
+   DynamicObject inverse(Map);
+   DynamicObject prefixes(Array);
+   DynamicObjectIterator i = ctx["mappings"].getIterator();
+   while(i->hasNext())
+   {
+      DynamicObject& entry = i->next();
+      const char* term = i->getName();
+      inverse[entry["@id"]->getString()]->append(term);
+
+      // terms with colons can't be prefixes
+      if(strchr(term, ':') == NULL)
+      {
+         prefixes->append(term);
+      }
+   }
+   ctx["inverse"] = inverse;
+   ctx["prefixes"] = prefixes;
+}
+
 /**
  * Gets the initial context.
  *
@@ -4554,12 +4684,26 @@ string _toNQuad(DynamicObject& statement, const char* bnode) {
       }
    }
 
-   // graph
+   // graph is an IRI or bnode
    if(!g.isNull())
    {
-      quad.append(" <");
-      quad.append(g["nominalValue"]);
-      quad.push_back('>');
+      if(g["interfaceName"] == "IRI")
+      {
+         quad.append(" <");
+         quad.append(g["nominalValue"]);
+         quad.push_back('>');
+      }
+      // normalization mode
+      else if(bnode != NULL)
+      {
+         quad.append((g["nominalValue"] == bnode) ? " _:a" : " _:z");
+      }
+      // normal mode
+      else
+      {
+         quad.push_back(' ');
+         quad.append(g["nominalValue"]);
+      }
    }
 
    quad.append(" .\n");
@@ -4619,17 +4763,4 @@ const char* _getName(UniqueNamer& namer, const char* oldName)
    return namer["names"].last();
 }
 
-/**
- * Returns true if the given oldName has already been assigned a new name.
- *
- * @param namer the UniqueNamer to use.
- * @param oldName the oldName to check.
- *
- * @return true if the oldName has been assigned a new name, false if not.
- */
-bool _isNamed(UniqueNamer& namer, const char* oldName)
-{
-   return namer["existing"]->hasMember(oldName);
-}
-
 } // end local namespace
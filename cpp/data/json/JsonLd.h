@@ -15,6 +15,9 @@ namespace data
 namespace json
 {
 
+// forward declaration
+class JsonLdContextCache;
+
 /**
  * The JsonLd class provides APIs for working with JSON-LD objects.
  *
@@ -43,6 +46,7 @@ public:
     *           base: the base IRI to use.
     *           optimize: true to turn on optimization (default: false).
     * @param output to be set to the JSON-LD compacted output.
+    * @param cache a cache for processed contexts, NULL for none.
     *
     * @return true on success, false on failure with exception set.
     */
@@ -50,7 +54,8 @@ public:
       monarch::rt::DynamicObject input,
       monarch::rt::DynamicObject ctx,
       monarch::rt::DynamicObject options,
-      monarch::rt::DynamicObject& output);
+      monarch::rt::DynamicObject& output,
+      JsonLdContextCache* cache = NULL);
 
    /**
     * Performs JSON-LD expansion.
@@ -59,13 +64,15 @@ public:
     * @param options expansion options.
     *           base: the base IRI to use.
     * @param output to be set to the JSON-LD expanded output.
+    * @param cache a cache for processed contexts, NULL for none.
     *
     * @return true on success, false on failure with exception set.
     */
    static bool expand(
       monarch::rt::DynamicObject input,
       monarch::rt::DynamicObject options,
-      monarch::rt::DynamicObject& output);
+      monarch::rt::DynamicObject& output,
+      JsonLdContextCache* cache = NULL);
 
    /**
     * Performs JSON-LD framing.
@@ -75,6 +82,7 @@ public:
     * @param options the framing options.
     *           base: the base IRI to use.
     * @param output to be set to the JSON-LD framed output.
+    * @param cache a cache for processed contexts, NULL for none.
     *
     * @return true on success, false on failure with exception set.
     */
@@ -82,7 +90,8 @@ public:
       monarch::rt::DynamicObject input,
       monarch::rt::DynamicObject frame,
       monarch::rt::DynamicObject options,
-      monarch::rt::DynamicObject& output);
+      monarch::rt::DynamicObject& output,
+      JsonLdContextCache* cache = NULL);
 
    /**
     * Performs RDF normalization on the given JSON-LD input.
@@ -92,6 +101,10 @@ public:
     *           base: the base IRI to use.
     *           format: the format if output is a string:
     *              "application/nquads" for N-Quads (default).
+    *           maxPermutations: the maximum number of permutations of
+    *              related blank nodes to try for each blank node before
+    *              failing with a NormalizeLimitExceeded exception
+    *              (default: 100000).
     * @param output to be set to the normalized output.
     *
     * @return true on success, false on failure with exception set.
@@ -145,6 +158,8 @@ public:
     * @param localCtx the local context to process.
     * @param options processing options.
     * @param output to be set to the merged context.
+    * @param cache a cache for processed contexts, NULL for none. A context
+    *           from the cache is shared and must not be modified.
     *
     * @return true on success, false on failure with exception set.
     */
@@ -152,7 +167,8 @@ public:
       monarch::rt::DynamicObject activeCtx,
       monarch::rt::DynamicObject localCtx,
       monarch::rt::DynamicObject options,
-      monarch::rt::DynamicObject& output);
+      monarch::rt::DynamicObject& output,
+      JsonLdContextCache* cache = NULL);
 
    /**
     * Returns true if the given subject has the given property.
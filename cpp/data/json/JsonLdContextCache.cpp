@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#define __STDC_FORMAT_MACROS
+
+#include "monarch/data/json/JsonLdContextCache.h"
+
+#include "monarch/data/json/JsonWriter.h"
+
+#include <cstdio>
+
+using namespace std;
+using namespace monarch::data::json;
+using namespace monarch::rt;
+
+JsonLdContextCache::JsonLdContextCache(int capacity) :
+   mNextId(1),
+   mCapacity(capacity),
+   mHits(0),
+   mMisses(0),
+   mEvictions(0)
+{
+}
+
+JsonLdContextCache::~JsonLdContextCache()
+{
+   JsonLdContextCache::clear();
+}
+
+bool JsonLdContextCache::getContext(
+   DynamicObject& activeCtx, DynamicObject& localCtx, const char* base,
+   DynamicObject& output)
+{
+   bool rval = false;
+
+   // serialize the local context before locking
+   string key;
+   createKey(localCtx, base, key);
+
+   mLock.lock();
+   {
+      if(addParentId(activeCtx, key))
+      {
+         Cache::iterator i = mCache.find(key);
+         if(i != mCache.end())
+         {
+            output = i->second->context;
+            mLru.splice(mLru.begin(), mLru, i->second);
+            rval = true;
+         }
+      }
+
+      if(rval)
+      {
+         ++mHits;
+      }
+      else
+      {
+         ++mMisses;
+      }
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void JsonLdContextCache::putContext(
+   DynamicObject& activeCtx, DynamicObject& localCtx, const char* base,
+   DynamicObject& ctx)
+{
+   string key;
+   createKey(localCtx, base, key);
+
+   mLock.lock();
+   {
+      // keep any context cached by another thread in the meantime
+      if(mCapacity != 0 && addParentId(activeCtx, key) &&
+         mCache.find(key) == mCache.end())
+      {
+         // make room
+         while(mCapacity != -1 && mLru.size() >= (unsigned int)mCapacity)
+         {
+            removeLast();
+            ++mEvictions;
+         }
+
+         CacheEntry entry;
+         entry.key = key;
+         entry.id = mNextId++;
+         entry.context = ctx;
+         mLru.push_front(entry);
+         mCache[key] = mLru.begin();
+         mIds[&(*ctx)] = entry.id;
+      }
+   }
+   mLock.unlock();
+}
+
+void JsonLdContextCache::clear()
+{
+   mLock.lock();
+   {
+      mLru.clear();
+      mCache.clear();
+      mIds.clear();
+   }
+   mLock.unlock();
+}
+
+DynamicObject JsonLdContextCache::getStats()
+{
+   DynamicObject rval;
+
+   mLock.lock();
+   {
+      rval["capacity"] = mCapacity;
+      rval["entries"] = (uint32_t)mLru.size();
+      rval["hits"] = mHits;
+      rval["misses"] = mMisses;
+      rval["evictions"] = mEvictions;
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void JsonLdContextCache::createKey(
+   DynamicObject& localCtx, const char* base, string& key)
+{
+   key = base;
+   key.push_back('\0');
+   key.append(JsonWriter::writeToString(localCtx, true, false));
+   key.push_back('\0');
+}
+
+bool JsonLdContextCache::addParentId(DynamicObject& activeCtx, string& key)
+{
+   bool rval = true;
+
+   uint64_t id = 0;
+   ContextIds::iterator i = mIds.find(&(*activeCtx));
+   if(i != mIds.end())
+   {
+      id = i->second;
+   }
+   // anything else must be the initial context (no mappings, keyword
+   // aliases or default language)
+   else if(
+      activeCtx["mappings"]->length() != 0 ||
+      activeCtx->hasMember("@language"))
+   {
+      rval = false;
+   }
+
+   if(rval)
+   {
+      char tmp[21];
+      snprintf(tmp, 21, "%" PRIu64, id);
+      key.append(tmp);
+   }
+
+   return rval;
+}
+
+void JsonLdContextCache::removeLast()
+{
+   CacheEntry& entry = mLru.back();
+   mCache.erase(entry.key);
+   mIds.erase(&(*entry.context));
+   mLru.pop_back();
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_json_JsonLdContextCache_H
+#define monarch_data_json_JsonLdContextCache_H
+
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/ExclusiveLock.h"
+
+#include <list>
+#include <map>
+#include <string>
+
+namespace monarch
+{
+namespace data
+{
+namespace json
+{
+
+/**
+ * A JsonLdContextCache keeps the active contexts created by processing
+ * JSON-LD local contexts so that documents that use the same contexts over
+ * and over do not have to process them each time.
+ *
+ * A processed context is cached by the context it was processed against,
+ * the base IRI and the content of the local context. The parent context is
+ * identified as either the initial context or as a context that was
+ * returned by this cache, so contexts processed in several steps (such as
+ * the contexts embedded in a document) are cached at each step. A local
+ * context processed against any other active context is not cached.
+ *
+ * Cached active contexts are shared by every caller that uses them and
+ * must not be modified. They are stored with their inverse context, which
+ * maps IRIs to the terms that can be used to compact them, already built.
+ *
+ * When the capacity of the cache would be exceeded, the least recently used
+ * contexts are evicted to make room.
+ *
+ * @author Dave Longley
+ */
+class JsonLdContextCache
+{
+protected:
+   /**
+    * A cached active context.
+    */
+   struct CacheEntry
+   {
+      std::string key;
+      uint64_t id;
+      monarch::rt::DynamicObject context;
+   };
+
+   /**
+    * The cached contexts, most recently used first.
+    */
+   typedef std::list<CacheEntry> EntryList;
+   EntryList mLru;
+
+   /**
+    * A map of cache key to cached context.
+    */
+   typedef std::map<std::string, EntryList::iterator> Cache;
+   Cache mCache;
+
+   /**
+    * A map of cached active context to the id of its entry.
+    */
+   typedef std::map<monarch::rt::DynamicObjectImpl*, uint64_t> ContextIds;
+   ContextIds mIds;
+
+   /**
+    * The id for the next cached context, 0 is the initial context.
+    */
+   uint64_t mNextId;
+
+   /**
+    * A lock for manipulating the cache.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+   /**
+    * The maximum number of cached contexts.
+    */
+   int mCapacity;
+
+   /**
+    * Counters for the stats of this cache.
+    */
+   uint64_t mHits;
+   uint64_t mMisses;
+   uint64_t mEvictions;
+
+public:
+   /**
+    * Creates a new JsonLdContextCache.
+    *
+    * @param capacity the maximum number of active contexts to cache, -1 for
+    *                 no max.
+    */
+   JsonLdContextCache(int capacity = 100);
+
+   /**
+    * Destructs this JsonLdContextCache.
+    */
+   virtual ~JsonLdContextCache();
+
+   /**
+    * Gets the cached result of processing a local context.
+    *
+    * @param activeCtx the active context the local context is processed
+    *           against.
+    * @param localCtx the local context.
+    * @param base the base IRI.
+    * @param output to be set to the shared, cached active context.
+    *
+    * @return true if the context was cached, false if not.
+    */
+   virtual bool getContext(
+      monarch::rt::DynamicObject& activeCtx,
+      monarch::rt::DynamicObject& localCtx, const char* base,
+      monarch::rt::DynamicObject& output);
+
+   /**
+    * Caches the result of processing a local context. The result must not be
+    * modified afterwards. Nothing is cached if the active context is not the
+    * initial context or a context from this cache.
+    *
+    * @param activeCtx the active context the local context was processed
+    *           against.
+    * @param localCtx the local context.
+    * @param base the base IRI.
+    * @param ctx the resulting active context.
+    */
+   virtual void putContext(
+      monarch::rt::DynamicObject& activeCtx,
+      monarch::rt::DynamicObject& localCtx, const char* base,
+      monarch::rt::DynamicObject& ctx);
+
+   /**
+    * Removes everything from the cache.
+    */
+   virtual void clear();
+
+   /**
+    * Gets the stats for this cache:
+    *
+    * capacity: the maximum number of cached contexts, -1 for no max.
+    * entries: the number of cached contexts.
+    * hits: the number of times a cached context was used.
+    * misses: the number of times a context was not cached.
+    * evictions: the number of contexts evicted to make room.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
+protected:
+   /**
+    * Creates the key for a local context, without its parent context. It is
+    * the base IRI and the compact JSON of the local context, which is
+    * cheaper to compare than it would be to hash and does not collide.
+    *
+    * @param localCtx the local context.
+    * @param base the base IRI.
+    * @param key to be set to the key.
+    */
+   virtual void createKey(
+      monarch::rt::DynamicObject& localCtx, const char* base,
+      std::string& key);
+
+   /**
+    * Adds the id of the parent context to a key. The cache must be locked.
+    *
+    * @param activeCtx the parent context.
+    * @param key the key to update.
+    *
+    * @return true if the parent can be identified, false if not.
+    */
+   virtual bool addParentId(
+      monarch::rt::DynamicObject& activeCtx, std::string& key);
+
+   /**
+    * Removes the least recently used context. The cache must be locked.
+    */
+   virtual void removeLast();
+};
+
+} // end namespace json
+} // end namespace data
+} // end namespace monarch
+#endif
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/json/JsonPathExtractor.h"
+
+#include "monarch/data/json/JsonReader.h"
+#include "monarch/rt/DynamicObjectIterator.h"
+#include "monarch/rt/Exception.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace monarch::data::json;
+using namespace monarch::io;
+using namespace monarch::rt;
+
+JsonPathExtractor::JsonPathExtractor() :
+   mCapture(-1),
+   mCaptured(NULL)
+{
+   mValues->setType(Map);
+}
+
+JsonPathExtractor::~JsonPathExtractor()
+{
+}
+
+bool JsonPathExtractor::addPath(const char* path)
+{
+   bool rval = true;
+
+   // split the path into keys and indexes
+   Pattern p;
+   p.path = path;
+   const char* c = path;
+   while(rval && *c != '\0')
+   {
+      Segment s;
+      if(*c == '[')
+      {
+         const char* end = strchr(c, ']');
+         rval = (end != NULL && end > c + 1);
+         if(rval)
+         {
+            string index(c + 1, end - c - 1);
+            char* last;
+            s.isIndex = true;
+            s.index = (index == "*") ? -1 : strtol(index.c_str(), &last, 10);
+            rval = (index == "*") || (*last == '\0' && s.index >= 0);
+            c = end + 1;
+         }
+      }
+      else
+      {
+         // keys after the first are separated by dots
+         if(*c == '.' && !p.segments.empty())
+         {
+            ++c;
+         }
+         size_t length = strcspn(c, ".[");
+         rval = (length > 0);
+         s.isIndex = false;
+         s.index = 0;
+         s.key.assign(c, length);
+         c += length;
+      }
+      if(rval)
+      {
+         p.segments.push_back(s);
+      }
+   }
+
+   if(rval)
+   {
+      mPatterns.push_back(p);
+   }
+   else
+   {
+      ExceptionRef e = new Exception(
+         "Invalid JSON path.",
+         "monarch.data.json.JsonPathExtractor.InvalidPath");
+      e->getDetails()["path"] = path;
+      Exception::set(e);
+   }
+
+   return rval;
+}
+
+DynamicObject& JsonPathExtractor::getValues()
+{
+   return mValues;
+}
+
+void JsonPathExtractor::reset()
+{
+   mPath.clear();
+   mCounts.clear();
+   mKey.clear();
+   mCapture = -1;
+   mCaptured.setNull();
+   mBuild.clear();
+   mValues = DynamicObject();
+   mValues->setType(Map);
+}
+
+bool JsonPathExtractor::startObject()
+{
+   DynamicObject obj(Map);
+   beginValue(obj, true);
+   return true;
+}
+
+bool JsonPathExtractor::endObject()
+{
+   return endValue(true);
+}
+
+bool JsonPathExtractor::startArray()
+{
+   DynamicObject obj(Array);
+   beginValue(obj, true);
+   return true;
+}
+
+bool JsonPathExtractor::endArray()
+{
+   return endValue(true);
+}
+
+bool JsonPathExtractor::key(const char* key)
+{
+   mKey = key;
+   return true;
+}
+
+bool JsonPathExtractor::value(DynamicObject& value)
+{
+   beginValue(value, false);
+   return endValue(false);
+}
+
+bool JsonPathExtractor::extract(
+   InputStream* is, DynamicObject& paths, DynamicObject& values, bool strict)
+{
+   bool rval = true;
+
+   JsonPathExtractor extractor;
+   DynamicObjectIterator i = paths.getIterator();
+   while(rval && i->hasNext())
+   {
+      rval = extractor.addPath(i->next()->getString());
+   }
+   if(rval)
+   {
+      JsonReader jr(strict);
+      rval = jr.start(&extractor) && jr.read(is) && jr.finish();
+   }
+   if(rval)
+   {
+      values = extractor.getValues();
+   }
+
+   return rval;
+}
+
+bool JsonPathExtractor::valueExtracted(const char* path, DynamicObject& value)
+{
+   // keep all values for wildcard paths, else only the first
+   if(strchr(path, '*') != NULL)
+   {
+      mValues[path]->append(value);
+   }
+   else if(!mValues->hasMember(path))
+   {
+      mValues[path] = value;
+   }
+
+   return true;
+}
+
+string JsonPathExtractor::getCurrentPath()
+{
+   string rval;
+
+   for(Path::iterator i = mPath.begin(); i != mPath.end(); ++i)
+   {
+      if(i->isIndex)
+      {
+         char index[23];
+         snprintf(index, 23, "[%d]", i->index);
+         rval.append(index);
+      }
+      else
+      {
+         if(i != mPath.begin())
+         {
+            rval.push_back('.');
+         }
+         rval.append(i->key);
+      }
+   }
+
+   return rval;
+}
+
+void JsonPathExtractor::beginValue(DynamicObject& value, bool container)
+{
+   // add the key or index of the value to the path
+   if(!mCounts.empty())
+   {
+      Segment s;
+      s.isIndex = (mCounts.back() >= 0);
+      s.index = s.isIndex ? mCounts.back()++ : 0;
+      s.key = s.isIndex ? "" : mKey;
+      mPath.push_back(s);
+   }
+
+   // start extracting the value if its path matches
+   if(mCapture == -1)
+   {
+      mCapture = findPattern();
+      if(mCapture != -1)
+      {
+         mCaptured = value;
+      }
+   }
+   // add the value to the value being extracted
+   else if(!mBuild.empty())
+   {
+      DynamicObject& parent = mBuild.back();
+      if(parent->getType() == Array)
+      {
+         parent->append(value);
+      }
+      else
+      {
+         parent[mKey.c_str()] = value;
+      }
+   }
+
+   if(container)
+   {
+      mCounts.push_back((value->getType() == Array) ? 0 : -1);
+      if(mCapture != -1)
+      {
+         mBuild.push_back(value);
+      }
+   }
+}
+
+bool JsonPathExtractor::endValue(bool container)
+{
+   bool rval = true;
+
+   if(container)
+   {
+      mCounts.pop_back();
+      if(mCapture != -1)
+      {
+         mBuild.pop_back();
+      }
+   }
+
+   // the value is done when it has no more open objects or arrays
+   if(mCapture != -1 && mBuild.empty())
+   {
+      rval = valueExtracted(mPatterns[mCapture].path.c_str(), mCaptured);
+      mCapture = -1;
+      mCaptured.setNull();
+   }
+
+   // remove the key or index of the value from the path
+   if(!mCounts.empty())
+   {
+      mPath.pop_back();
+   }
+
+   return rval;
+}
+
+int JsonPathExtractor::findPattern()
+{
+   int rval = -1;
+
+   for(size_t n = 0; rval == -1 && n < mPatterns.size(); ++n)
+   {
+      Path& segments = mPatterns[n].segments;
+      bool match = (segments.size() == mPath.size());
+      for(size_t i = 0; match && i < segments.size(); ++i)
+      {
+         Segment& p = segments[i];
+         Segment& s = mPath[i];
+         match =
+            (p.isIndex == s.isIndex) &&
+            (p.isIndex ?
+               (p.index == -1 || p.index == s.index) :
+               (p.key == "*" || p.key == s.key));
+      }
+      rval = match ? (int)n : -1;
+   }
+
+   return rval;
+}
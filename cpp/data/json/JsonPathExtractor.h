@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_json_JsonPathExtractor_H
+#define monarch_data_json_JsonPathExtractor_H
+
+#include "monarch/data/json/JsonHandler.h"
+#include "monarch/io/InputStream.h"
+
+#include <string>
+#include <vector>
+
+namespace monarch
+{
+namespace data
+{
+namespace json
+{
+
+/**
+ * A JsonPathExtractor is a JsonHandler that picks the values at a set of
+ * paths out of a JSON document while it is parsed. Only the values that are
+ * extracted are built as DynamicObjects, the rest of the document is
+ * skipped, so a few fields can be taken from a large document without
+ * holding all of it in memory.
+ *
+ * Paths use the same form as validation paths: keys are separated by dots
+ * and array indexes are in brackets, ie: "user.name" or "items[2].id". A
+ * "*" matches any key and "[*]" any index, ie: "items[*].id". The empty path
+ * matches the whole document.
+ *
+ * The value for a path without wildcards is the first value found at that
+ * path. The value for a path with wildcards is an array of all of the values
+ * found. Subclasses may override valueExtracted() to do something else with
+ * each value, such as forwarding it, instead of keeping it.
+ *
+ * A value that is inside another extracted value is not extracted again.
+ *
+ * @author Dave Longley
+ */
+class JsonPathExtractor : public JsonHandler
+{
+protected:
+   /**
+    * A part of a path: an object key or an array index.
+    */
+   struct Segment
+   {
+      /**
+       * True for an array index, false for an object key.
+       */
+      bool isIndex;
+
+      /**
+       * The array index, -1 for any index.
+       */
+      int index;
+
+      /**
+       * The object key, "*" for any key.
+       */
+      std::string key;
+   };
+
+   /**
+    * A path as a list of segments.
+    */
+   typedef std::vector<Segment> Path;
+
+   /**
+    * A path to extract values from.
+    */
+   struct Pattern
+   {
+      /**
+       * The path as it was added.
+       */
+      std::string path;
+
+      /**
+       * The segments of the path.
+       */
+      Path segments;
+   };
+
+   /**
+    * The paths to extract values from.
+    */
+   std::vector<Pattern> mPatterns;
+
+   /**
+    * The path of the value being parsed.
+    */
+   Path mPath;
+
+   /**
+    * For each open object or array, -1 for an object or the number of
+    * values so far for an array.
+    */
+   std::vector<int> mCounts;
+
+   /**
+    * The last key that was parsed.
+    */
+   std::string mKey;
+
+   /**
+    * The index of the pattern of the value being extracted, -1 for none.
+    */
+   int mCapture;
+
+   /**
+    * The value being extracted.
+    */
+   monarch::rt::DynamicObject mCaptured;
+
+   /**
+    * The open objects and arrays of the value being extracted.
+    */
+   std::vector<monarch::rt::DynamicObject> mBuild;
+
+   /**
+    * The extracted values, by path.
+    */
+   monarch::rt::DynamicObject mValues;
+
+public:
+   /**
+    * Creates a new JsonPathExtractor.
+    */
+   JsonPathExtractor();
+
+   /**
+    * Destructs this JsonPathExtractor.
+    */
+   virtual ~JsonPathExtractor();
+
+   /**
+    * Adds a path to extract values from.
+    *
+    * @param path the path, ie: "items[*].id".
+    *
+    * @return true if successful, false if the path is invalid.
+    */
+   virtual bool addPath(const char* path);
+
+   /**
+    * Gets the values extracted so far, as a map of path to value. Paths
+    * without a value are not set.
+    *
+    * @return the extracted values.
+    */
+   virtual monarch::rt::DynamicObject& getValues();
+
+   /**
+    * Clears the extracted values and the parse state so that another
+    * document can be parsed. The paths are kept.
+    */
+   virtual void reset();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool startObject();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool endObject();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool startArray();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool endArray();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool key(const char* key);
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool value(monarch::rt::DynamicObject& value);
+
+   /**
+    * Extracts the values at a set of paths from JSON in an InputStream.
+    *
+    * @param is the InputStream to read the JSON from.
+    * @param paths an array of paths.
+    * @param values set to a map of path to extracted value.
+    * @param strict the JSON must start with an object or array.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   static bool extract(
+      monarch::io::InputStream* is,
+      monarch::rt::DynamicObject& paths, monarch::rt::DynamicObject& values,
+      bool strict = true);
+
+protected:
+   /**
+    * Called when the value at a path has been extracted. By default, keeps
+    * the value in the extracted values.
+    *
+    * @param path the path that was added and matched the value.
+    * @param value the value.
+    *
+    * @return true to continue, false with an exception set to stop parsing.
+    */
+   virtual bool valueExtracted(
+      const char* path, monarch::rt::DynamicObject& value);
+
+   /**
+    * Gets the path of the value being parsed, ie: "items[3].id".
+    *
+    * @return the path.
+    */
+   virtual std::string getCurrentPath();
+
+   /**
+    * Starts a value.
+    *
+    * @param value the value, an empty map or array for an object or array.
+    * @param container true for an object or array, false for other values.
+    */
+   virtual void beginValue(monarch::rt::DynamicObject& value, bool container);
+
+   /**
+    * Ends a value.
+    *
+    * @param container true for an object or array, false for other values.
+    *
+    * @return true to continue, false with an exception set to stop parsing.
+    */
+   virtual bool endValue(bool container);
+
+   /**
+    * Finds the pattern that matches the path of the value being parsed.
+    *
+    * @return the index of the pattern, -1 if none matches.
+    */
+   virtual int findPattern();
+};
+
+} // end namespace json
+} // end namespace data
+} // end namespace monarch
+#endif
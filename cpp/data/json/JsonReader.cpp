@@ -1,8 +1,9 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/data/json/JsonReader.h"
 
+#include "monarch/data/json/JsonStringScanner.h"
 #include "monarch/util/Convert.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/rt/Exception.h"
@@ -94,7 +95,8 @@ static JsonState sStateTable[S_COUNT][C_COUNT] = {
 /* EV */ {_D,_D,__,_D,__,_D,__,_D,__,__,__,EV,EV,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__,__}
 };
 
-JsonReader::JsonReader(bool strict)
+JsonReader::JsonReader(bool strict) :
+   mHandler(NULL)
 {
    mStrict = strict;
    mStarted = false;
@@ -109,8 +111,12 @@ JsonReader::~JsonReader()
 
 bool JsonReader::start(DynamicObject& dyno)
 {
+   // build objects, no events
+   mHandler = NULL;
+
    // clear stacks
    mDynoStack.clear();
+   mKeyStack.clear();
    mStateStack.clear();
 
    // set object as target and push to stack
@@ -155,7 +161,11 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
       case O_: /* start object */
          mStateStack.push_back(mState);
          mState = next;
-         if(mStateStack.size() != 1)
+         if(mHandler != NULL)
+         {
+            rval = mHandler->startObject();
+         }
+         else if(mStateStack.size() != 1)
          {
             // not dyno from start()
             DynamicObject obj(Map);
@@ -168,19 +178,15 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
          break;
       case OV: /* got key:value */
       {
-         // pop value
-         DynamicObject value(mDynoStack.back());
-         mDynoStack.pop_back();
-
-         // pop key
-         DynamicObject key(mDynoStack.back());
-         mDynoStack.pop_back();
-
-         // get object
-         DynamicObject& obj = mDynoStack.back();
-
-         // set key=value
-         obj[key->getString()] = value;
+         // set key=value on object, then pop value and key
+         if(mHandler == NULL)
+         {
+            size_t size = mDynoStack.size();
+            mDynoStack[size - 2][mKeyStack.back().c_str()] =
+               mDynoStack[size - 1];
+            mDynoStack.pop_back();
+            mKeyStack.pop_back();
+         }
 
          mState = next;
          break;
@@ -188,7 +194,11 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
       case A_: /* start array */
          mStateStack.push_back(mState);
          mState = next;
-         if(mStateStack.size() != 1)
+         if(mHandler != NULL)
+         {
+            rval = mHandler->startArray();
+         }
+         else if(mStateStack.size() != 1)
          {
             // not dyno from start()
             DynamicObject obj(Array);
@@ -201,24 +211,28 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
          break;
       case AV: /* got value */
       {
-         // pop value
-         DynamicObject value(mDynoStack.back());
-         mDynoStack.pop_back();
-
-         // append value
-         mDynoStack.back()->append(value);
+         // append value to array, then pop value
+         if(mHandler == NULL)
+         {
+            size_t size = mDynoStack.size();
+            mDynoStack[size - 2]->append(mDynoStack[size - 1]);
+            mDynoStack.pop_back();
+         }
 
          mState = next;
          break;
       }
       case VV: /* got value */
       {
-         // pop value
-         DynamicObject value(mDynoStack.back());
-         mDynoStack.pop_back();
+         if(mHandler == NULL)
+         {
+            // pop value
+            DynamicObject value(mDynoStack.back());
+            mDynoStack.pop_back();
 
-         // set object=value
-         mDynoStack.back() = value;
+            // set object=value
+            mDynoStack.back() = value;
+         }
 
          // check for top level
          if(mState == V_)
@@ -226,7 +240,10 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
             // we're done with top-level object
             mState = _J;
             mValid = true;
-            *mTarget = mDynoStack.back();
+            if(mHandler == NULL)
+            {
+               *mTarget = mDynoStack.back();
+            }
          }
          break;
       }
@@ -234,6 +251,10 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
       case _A: /* Array done */
          mState = mStateStack.back();
          mStateStack.pop_back();
+         if(mHandler != NULL)
+         {
+            rval = (next == _O) ? mHandler->endObject() : mHandler->endArray();
+         }
 
          // check for top level
          if(mState == J_ || mState == V_)
@@ -241,9 +262,12 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
             // we're done with top-level object
             mState = _J;
             mValid = true;
-            *mTarget = mDynoStack.back();
+            if(mHandler == NULL)
+            {
+               *mTarget = mDynoStack.back();
+            }
          }
-         else
+         else if(rval)
          {
             rval = processNext(C_DO);
          }
@@ -348,63 +372,74 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
          break;
       case _S: /* String done */
       {
-         // Push string on stack
-         DynamicObject obj;
-         obj = mString.c_str();
-         mDynoStack.push_back(obj);
-
+         // Push string on stack, keys are kept apart so that no object needs
+         // to be created for them
          mState = mStateStack.back();
          mStateStack.pop_back();
-         rval = processNext(C_DO);
+         if(mState != O_ && mState != O2)
+         {
+            DynamicObject obj;
+            obj = mString.c_str();
+            rval = pushValue(obj);
+         }
+         else if(mHandler != NULL)
+         {
+            rval = mHandler->key(mString.c_str());
+         }
+         else
+         {
+            mKeyStack.push_back(mString);
+         }
+         rval = rval && processNext(C_DO);
          break;
       }
       case _T: /* true done */
       {
          DynamicObject obj;
          obj = true;
-         mDynoStack.push_back(obj);
+         rval = pushValue(obj);
          mState = mStateStack.back();
          mStateStack.pop_back();
-         rval = processNext(C_DO);
+         rval = rval && processNext(C_DO);
          break;
       }
       case _F: /* false done */
       {
          DynamicObject obj;
          obj = false;
-         mDynoStack.push_back(obj);
+         rval = pushValue(obj);
          mState = mStateStack.back();
          mStateStack.pop_back();
-         rval = processNext(C_DO);
+         rval = rval && processNext(C_DO);
          break;
       }
       case _N: /* null done */
       {
          DynamicObject obj;
          obj = DynamicObject(NULL);
-         mDynoStack.push_back(obj);
+         rval = pushValue(obj);
          mState = mStateStack.back();
          mStateStack.pop_back();
-         rval = processNext(C_DO);
+         rval = rval && processNext(C_DO);
          break;
       }
       case _I: /* Integer done */
       {
+         // convert directly instead of through a string object
          DynamicObject obj;
-         obj = mString.c_str();
          if(mString[0] == '-')
          {
-            obj->setType(Int64);
+            obj = (int64_t)strtoll(mString.c_str(), NULL, 10);
          }
          else
          {
-            obj->setType(UInt64);
+            obj = (uint64_t)strtoull(mString.c_str(), NULL, 10);
          }
-         mDynoStack.push_back(obj);
+         rval = pushValue(obj);
          mState = mStateStack.back();
          mStateStack.pop_back();
          // process this input
-         if((rval = processNext(C_DO)))
+         if(rval && (rval = processNext(C_DO)))
          {
             // actually process current char
             rval = processNext(ic, c);
@@ -414,12 +449,11 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
       case _D: /* Double done */
       {
          DynamicObject obj;
-         obj = mString.c_str();
-         obj->setType(Double);
-         mDynoStack.push_back(obj);
+         obj = strtod(mString.c_str(), NULL);
+         rval = pushValue(obj);
          mState = mStateStack.back();
          mStateStack.pop_back();
-         if((rval = processNext(C_DO)))
+         if(rval && (rval = processNext(C_DO)))
          {
             // actually process current char
             rval = processNext(ic, c);
@@ -503,17 +537,89 @@ bool JsonReader::processNext(JsonInputClass ic, char c)
    return rval;
 }
 
+bool JsonReader::start(JsonHandler* handler)
+{
+   // start without a target, then send events instead of building objects
+   DynamicObject unused;
+   bool rval = start(unused);
+   mDynoStack.clear();
+   mTarget = NULL;
+   mHandler = handler;
+   return rval;
+}
+
+bool JsonReader::pushValue(DynamicObject& value)
+{
+   bool rval = true;
+
+   if(mHandler != NULL)
+   {
+      rval = mHandler->value(value);
+   }
+   else
+   {
+      mDynoStack.push_back(value);
+   }
+
+   return rval;
+}
+
+int JsonReader::skipRun(const char* buffer, int count)
+{
+   int rval = 0;
+
+   if(mState == S_ || mState == SC)
+   {
+      // string characters other than quotes, escapes and control characters
+      // are only appended, so append them all at once
+      rval = JsonStringScanner::countPlain(buffer, count);
+      if(rval > 0)
+      {
+         mString.append(buffer, rval);
+         mState = SC;
+      }
+   }
+   else if(mState < S_)
+   {
+      // whitespace between tokens is ignored, only count its lines
+      rval = JsonStringScanner::countWhitespace(buffer, count, mLineNumber);
+   }
+   else if(mState == I_ || mState == I2 || mState == F2 || mState == EV)
+   {
+      // append the digits of an integer, fraction or exponent at once
+      rval = JsonStringScanner::countDigits(buffer, count);
+      if(rval > 0)
+      {
+         mString.append(buffer, rval);
+         mState = (mState == I_) ? I2 : mState;
+      }
+   }
+
+   return rval;
+}
+
 bool JsonReader::process(const char* buffer, int count, int& position)
 {
    bool rval = true;
 
-   for(position = 0; rval && position < count; ++position)
+   position = 0;
+   while(rval && position < count)
    {
-      // FIXME: do proper unicode handling
-      char c = buffer[position];
-      int ci = (int)c;
-      JsonInputClass ic = (ci >= 0 && ci < 128) ? sAsciiToClass[ci] : C_CH;
-      rval = processNext(ic, c);
+      // skip the characters that cannot change the parse state, if any,
+      // otherwise process the next character
+      int run = skipRun(buffer + position, count - position);
+      if(run > 0)
+      {
+         position += run;
+      }
+      else
+      {
+         // FIXME: do proper unicode handling
+         char c = buffer[position++];
+         int ci = (int)c;
+         JsonInputClass ic = (ci >= 0 && ci < 128) ? sAsciiToClass[ci] : C_CH;
+         rval = processNext(ic, c);
+      }
    }
 
    return rval;
@@ -1,10 +1,11 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_data_json_JsonReader_H
 #define monarch_data_json_JsonReader_H
 
 #include "monarch/data/DynamicObjectReader.h"
+#include "monarch/data/json/JsonHandler.h"
 
 #include <vector>
 #include <string>
@@ -134,9 +135,10 @@ enum JsonState {
  * into a smaller set of classes.  Then a state transition table (sStateTable)
  * is used to determine the next state of the parser.  When starting to parse
  * new objects ("*_" states) the previous state is pushed onto a stack
- * (mStateStack).  As new objects, keys, and values are created the are often
- * pushed onto a DynamicObject stack.  When an object is complete (many of the
- * "_*" states) the stack can be used to update the result object as needed.
+ * (mStateStack).  As new objects and values are created the are often pushed
+ * onto a DynamicObject stack, keys onto a stack of strings.  When an object
+ * is complete (many of the "_*" states) the stacks can be used to update the
+ * result object as needed.
  * An input class "C_DO" is used as a marker to signal this should occur.
  * processNext() can perform actions when a state transition occurs.  This is
  * used to do all of the state and stack manipulation.  This can be called
@@ -148,6 +150,19 @@ enum JsonState {
  * parses and non-number input class.  At this point it will process the number
  * and then re-call processNext with the next non-number input.
  *
+ * Most input does not change the state of the parser: the characters of a
+ * string, the digits of a number and whitespace between tokens.  Such runs
+ * are found in bulk (see JsonStringScanner, which checks many bytes at once
+ * where the CPU supports it) and appended to the current string or skipped
+ * without going through the state table.  Only the characters that end a run
+ * are processed one at a time, so the resulting objects and the positions
+ * reported for errors are the same.
+ *
+ * Instead of building a DynamicObject, the parser can send the structure of
+ * the JSON to a JsonHandler as it is parsed (see start(JsonHandler*)).  Then
+ * only the scalar value being parsed is kept in memory, so input of any size
+ * can be processed.
+ *
  * @author David I. Lehn <dlehn@digitalbazaar.com>
  */
 class JsonReader : public DynamicObjectReader
@@ -183,11 +198,22 @@ protected:
     */
    std::vector<monarch::rt::DynamicObject> mDynoStack;
 
+   /**
+    * A stack of the keys of the objects being parsed.
+    */
+   std::vector<std::string> mKeyStack;
+
    /**
     * The final target DynamicObject set from start().
     */
    monarch::rt::DynamicObject* mTarget;
 
+   /**
+    * The JsonHandler to send events to instead of building objects, NULL
+    * for none.
+    */
+   JsonHandler* mHandler;
+
    /**
     * The read size in bytes.
     */
@@ -208,6 +234,29 @@ protected:
     */
    bool mValid;
 
+   /**
+    * Adds a parsed string, number, boolean or null value to the value stack,
+    * or sends it to the JsonHandler.
+    *
+    * @param value the value.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   bool pushValue(monarch::rt::DynamicObject& value);
+
+   /**
+    * Handles a run of characters at the start of a buffer that do not change
+    * the parse state, such as unescaped string characters, the digits of a
+    * number or whitespace between tokens.
+    *
+    * @param buffer the characters.
+    * @param count the number of characters.
+    *
+    * @return the number of characters handled, 0 if the first character
+    *         must be processed with processNext().
+    */
+   int skipRun(const char* buffer, int count);
+
    /**
     * Process a buffer of characters.
     *
@@ -263,6 +312,18 @@ public:
     */
    virtual bool start(monarch::rt::DynamicObject& dyno);
 
+   /**
+    * Starts parsing JSON into events for a JsonHandler instead of into a
+    * DynamicObject. The JSON is then passed to read() and finish() as usual.
+    * If the handler returns false from an event, read() fails with a parse
+    * error that has the handler's exception as its cause.
+    *
+    * @param handler the JsonHandler to send events to.
+    *
+    * @return true on success, false on failure.
+    */
+   virtual bool start(JsonHandler* handler);
+
    /**
     * This method reads JSON from the passed InputStream until the end of
     * the stream, blocking if necessary.
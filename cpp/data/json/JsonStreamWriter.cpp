@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/json/JsonStreamWriter.h"
+
+#include "monarch/rt/Exception.h"
+
+using namespace std;
+using namespace monarch::data::json;
+using namespace monarch::io;
+using namespace monarch::rt;
+
+JsonStreamWriter::JsonStreamWriter(
+   OutputStream* os, int bufferSize, bool strict) :
+   JsonWriter(strict),
+   mNamed(false),
+   mWritten(false),
+   mBuffer(bufferSize),
+   mStream(&mBuffer, os, false)
+{
+}
+
+JsonStreamWriter::~JsonStreamWriter()
+{
+}
+
+bool JsonStreamWriter::beginObject()
+{
+   return begin(true);
+}
+
+bool JsonStreamWriter::endObject()
+{
+   return end(true);
+}
+
+bool JsonStreamWriter::beginArray()
+{
+   return begin(false);
+}
+
+bool JsonStreamWriter::endArray()
+{
+   return end(false);
+}
+
+bool JsonStreamWriter::writeName(const char* name)
+{
+   bool rval = writePrefix(true, "member name");
+   if(rval)
+   {
+      // write the name as an escaped string
+      DynamicObject str;
+      str = name;
+      rval =
+         write(str, &mStream, 0) &&
+         (mCompact ? mStream.write(":", 1) : mStream.write(": ", 2));
+      mNamed = true;
+   }
+   return rval;
+}
+
+bool JsonStreamWriter::writeValue(DynamicObject& value)
+{
+   bool rval = writePrefix(false, "value");
+   if(rval && mStack.empty())
+   {
+      // check top-level value
+      if(mStrict &&
+         (value.isNull() ||
+          (value->getType() != Map && value->getType() != Array)))
+      {
+         ExceptionRef e = new Exception(
+            "No JSON top-level Map or Array found.",
+            "monarch.data.json.JsonWriter.InvalidJson");
+         Exception::set(e);
+         rval = false;
+      }
+      else
+      {
+         mWritten = true;
+      }
+   }
+   if(rval)
+   {
+      rval = write(value, &mStream, mIndentLevel + mStack.size());
+   }
+   return rval;
+}
+
+bool JsonStreamWriter::writeMember(const char* name, DynamicObject& value)
+{
+   return writeName(name) && writeValue(value);
+}
+
+bool JsonStreamWriter::flush()
+{
+   return mStream.flush();
+}
+
+bool JsonStreamWriter::finish()
+{
+   bool rval = true;
+
+   if(!mStack.empty() || mNamed)
+   {
+      ExceptionRef e = new Exception(
+         "Could not finish JSON, an object or array has not been ended.",
+         "monarch.data.json.JsonStreamWriter.InvalidState");
+      e->getDetails()["depth"] = (uint32_t)mStack.size();
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      // more JSON may now be written
+      mWritten = false;
+      rval = mStream.flush();
+   }
+
+   return rval;
+}
+
+bool JsonStreamWriter::writePrefix(bool member, const char* what)
+{
+   bool rval = true;
+
+   if(mStack.empty())
+   {
+      // only a single top-level value, which cannot be a member
+      rval = !member && !mWritten;
+   }
+   else
+   {
+      Container& c = mStack.back();
+      if(c.map && !member)
+      {
+         // a value in an object must follow its name
+         rval = mNamed;
+         mNamed = false;
+      }
+      else if(c.map != member || mNamed)
+      {
+         // members go in objects, array elements in arrays
+         rval = false;
+      }
+      else
+      {
+         // write delimiter and formatting
+         if(c.count++ > 0)
+         {
+            rval = mStream.write(",", 1);
+         }
+         if(rval && !mCompact)
+         {
+            rval =
+               mStream.write("\n", 1) &&
+               writeIndentation(&mStream, mIndentLevel + mStack.size());
+         }
+      }
+   }
+
+   if(!rval && !Exception::isSet())
+   {
+      setInvalidStateException(what);
+   }
+
+   return rval;
+}
+
+bool JsonStreamWriter::begin(bool map)
+{
+   bool rval = writePrefix(false, map ? "object" : "array");
+   if(rval)
+   {
+      Container c;
+      c.map = map;
+      c.count = 0;
+      mStack.push_back(c);
+      rval = mStream.write(map ? "{" : "[", 1);
+   }
+   return rval;
+}
+
+bool JsonStreamWriter::end(bool map)
+{
+   bool rval = !mStack.empty() && mStack.back().map == map && !mNamed;
+   if(!rval)
+   {
+      setInvalidStateException(map ? "end of object" : "end of array");
+   }
+   else
+   {
+      // write formatting and end container
+      int count = mStack.back().count;
+      mStack.pop_back();
+      if(count > 0 && !mCompact)
+      {
+         rval =
+            mStream.write("\n", 1) &&
+            writeIndentation(&mStream, mIndentLevel + mStack.size());
+      }
+      rval = rval && mStream.write(map ? "}" : "]", 1);
+      if(mStack.empty())
+      {
+         mWritten = true;
+      }
+   }
+   return rval;
+}
+
+void JsonStreamWriter::setInvalidStateException(const char* what)
+{
+   ExceptionRef e = new Exception(
+      "Could not write JSON, it is not valid at this point.",
+      "monarch.data.json.JsonStreamWriter.InvalidState");
+   e->getDetails()["what"] = what;
+   e->getDetails()["depth"] = (uint32_t)mStack.size();
+   Exception::set(e);
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_json_JsonStreamWriter_H
+#define monarch_data_json_JsonStreamWriter_H
+
+#include "monarch/data/json/JsonWriter.h"
+#include "monarch/io/BufferedOutputStream.h"
+
+#include <vector>
+
+namespace monarch
+{
+namespace data
+{
+namespace json
+{
+
+/**
+ * A JsonStreamWriter writes JSON incrementally. Instead of building a whole
+ * DynamicObject in memory and writing it at once, the caller begins objects
+ * and arrays, writes member names and values (which may themselves be
+ * DynamicObjects of any size) and ends them again. This allows very large
+ * results, such as the rows of a database query, to be sent as they are
+ * produced.
+ *
+ * The JSON is written into a large buffer that is only flushed to the
+ * underlying stream once it fills up, so that stream receives few, large
+ * writes. When the underlying stream is a chunked HTTP body, each flush is
+ * sent as a single chunk, and memory use stays flat regardless of the size
+ * of the result.
+ *
+ * A JsonStreamWriter can write more JSON to the same stream once finish()
+ * has been called.
+ *
+ * @author Dave Longley
+ */
+class JsonStreamWriter : public JsonWriter
+{
+protected:
+   /**
+    * An object or array that has been begun but not yet ended.
+    */
+   struct Container
+   {
+      bool map;
+      int count;
+   };
+
+   /**
+    * The open objects and arrays, innermost last.
+    */
+   std::vector<Container> mStack;
+
+   /**
+    * True if a member name has been written and its value has not.
+    */
+   bool mNamed;
+
+   /**
+    * True once a top-level value has been written.
+    */
+   bool mWritten;
+
+   /**
+    * The buffer to write JSON into.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
+   /**
+    * The stream that fills the buffer and flushes it to the output stream.
+    */
+   monarch::io::BufferedOutputStream mStream;
+
+public:
+   /**
+    * Creates a new JsonStreamWriter.
+    *
+    * @param os the OutputStream to write the JSON to.
+    * @param bufferSize the size of the buffer to fill before writing to the
+    *           output stream.
+    * @param strict true if the JSON must be an object or array.
+    */
+   JsonStreamWriter(
+      monarch::io::OutputStream* os, int bufferSize = 65536,
+      bool strict = true);
+
+   /**
+    * Destructs this JsonStreamWriter.
+    */
+   virtual ~JsonStreamWriter();
+
+   /**
+    * Begins an object. In an object, every value must be preceded by a
+    * member name.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool beginObject();
+
+   /**
+    * Ends the innermost object.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool endObject();
+
+   /**
+    * Begins an array.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool beginArray();
+
+   /**
+    * Ends the innermost array.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool endArray();
+
+   /**
+    * Writes the name of the next member of the innermost object.
+    *
+    * @param name the member name.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool writeName(const char* name);
+
+   /**
+    * Writes a value: the next element of the innermost array, the value of
+    * the member whose name was just written or, if nothing has been begun,
+    * the whole JSON.
+    *
+    * @param value the value to write.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool writeValue(monarch::rt::DynamicObject& value);
+
+   /**
+    * Writes a member of the innermost object.
+    *
+    * @param name the member name.
+    * @param value the member value.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool writeMember(
+      const char* name, monarch::rt::DynamicObject& value);
+
+   /**
+    * Flushes the buffered JSON to the output stream.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool flush();
+
+   /**
+    * Checks that every object and array has been ended and flushes the
+    * buffered JSON to the output stream. The output stream is not closed.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool finish();
+
+protected:
+   /**
+    * Writes whatever must precede the next value in the innermost container.
+    *
+    * @param member true if the value is a member name, false if not.
+    * @param what a description of the value for error messages.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool writePrefix(bool member, const char* what);
+
+   /**
+    * Begins an object or array.
+    *
+    * @param map true for an object, false for an array.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool begin(bool map);
+
+   /**
+    * Ends an object or array.
+    *
+    * @param map true for an object, false for an array.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool end(bool map);
+
+   /**
+    * Sets an exception for writing something at the wrong place.
+    *
+    * @param what what was written.
+    */
+   virtual void setInvalidStateException(const char* what);
+};
+
+} // end namespace json
+} // end namespace data
+} // end namespace monarch
+#endif
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/json/JsonStringScanner.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace monarch::data::json;
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+#if defined(__AVX2__)
+#define VECTOR_SIZE  32
+#define VECTOR_MASK  0xFFFFFFFFU
+typedef __m256i Vector;
+#define vload(p)     _mm256_loadu_si256((const __m256i*)(p))
+#define vset(c)      _mm256_set1_epi8(c)
+#define vor(a, b)    _mm256_or_si256(a, b)
+#define vsub(a, b)   _mm256_sub_epi8(a, b)
+#define veq(a, b)    _mm256_cmpeq_epi8(a, b)
+#define vmax(a, b)   _mm256_max_epu8(a, b)
+#define vmask(a)     ((unsigned int)_mm256_movemask_epi8(a))
+#else
+#define VECTOR_SIZE  16
+#define VECTOR_MASK  0xFFFFU
+typedef __m128i Vector;
+#define vload(p)     _mm_loadu_si128((const __m128i*)(p))
+#define vset(c)      _mm_set1_epi8(c)
+#define vor(a, b)    _mm_or_si128(a, b)
+#define vsub(a, b)   _mm_sub_epi8(a, b)
+#define veq(a, b)    _mm_cmpeq_epi8(a, b)
+#define vmax(a, b)   _mm_max_epu8(a, b)
+#define vmask(a)     ((unsigned int)_mm_movemask_epi8(a))
+#endif
+
+/**
+ * Counts the plain bytes at the start of some data, a vector at a time. A
+ * byte is a control character if the unsigned maximum of it and 0x1F is
+ * 0x1F.
+ *
+ * @param data the data to scan.
+ * @param length the number of bytes in the data.
+ * @param found set to true if a special byte was found, false if fewer
+ *           bytes than a vector remain to be checked.
+ *
+ * @return the number of plain bytes counted.
+ */
+static int _countPlainVectors(const char* data, int length, bool& found)
+{
+   const Vector quote = vset('"');
+   const Vector backslash = vset('\\');
+   const Vector control = vset(0x1F);
+
+   int rval = 0;
+   found = false;
+   while(!found && length - rval >= VECTOR_SIZE)
+   {
+      Vector v = vload(data + rval);
+      unsigned int mask = vmask(vor(
+         vor(veq(v, quote), veq(v, backslash)),
+         veq(vmax(v, control), control)));
+      if(mask == 0)
+      {
+         rval += VECTOR_SIZE;
+      }
+      else
+      {
+         rval += __builtin_ctz(mask);
+         found = true;
+      }
+   }
+
+   return rval;
+}
+
+/**
+ * Counts the whitespace at the start of some data, a vector at a time.
+ *
+ * @param data the data to scan.
+ * @param length the number of bytes in the data.
+ * @param found set to true if a byte other than whitespace was found, false
+ *           if fewer bytes than a vector remain to be checked.
+ * @param lines incremented by the number of newlines counted.
+ *
+ * @return the number of whitespace bytes counted.
+ */
+static int _countWhitespaceVectors(
+   const char* data, int length, bool& found, int& lines)
+{
+   const Vector space = vset(' ');
+   const Vector newline = vset('\n');
+   const Vector cr = vset('\r');
+   const Vector tab = vset('\t');
+
+   int rval = 0;
+   found = false;
+   while(!found && length - rval >= VECTOR_SIZE)
+   {
+      Vector v = vload(data + rval);
+      Vector nl = veq(v, newline);
+      unsigned int other = ~vmask(vor(
+         vor(veq(v, space), nl), vor(veq(v, cr), veq(v, tab)))) & VECTOR_MASK;
+      unsigned int nlMask = vmask(nl);
+      if(other == 0)
+      {
+         rval += VECTOR_SIZE;
+      }
+      else
+      {
+         // only count the newlines before the first other byte
+         int n = __builtin_ctz(other);
+         nlMask &= (1U << n) - 1;
+         rval += n;
+         found = true;
+      }
+      lines += __builtin_popcount(nlMask);
+   }
+
+   return rval;
+}
+
+/**
+ * Counts the decimal digits at the start of some data, a vector at a time.
+ * A byte is a digit if the unsigned maximum of it minus '0' and 9 is 9.
+ *
+ * @param data the data to scan.
+ * @param length the number of bytes in the data.
+ * @param found set to true if a byte other than a digit was found, false if
+ *           fewer bytes than a vector remain to be checked.
+ *
+ * @return the number of digits counted.
+ */
+static int _countDigitVectors(const char* data, int length, bool& found)
+{
+   const Vector zero = vset('0');
+   const Vector nine = vset(9);
+
+   int rval = 0;
+   found = false;
+   while(!found && length - rval >= VECTOR_SIZE)
+   {
+      Vector v = vsub(vload(data + rval), zero);
+      unsigned int other = ~vmask(veq(vmax(v, nine), nine)) & VECTOR_MASK;
+      if(other == 0)
+      {
+         rval += VECTOR_SIZE;
+      }
+      else
+      {
+         rval += __builtin_ctz(other);
+         found = true;
+      }
+   }
+
+   return rval;
+}
+#endif
+
+int JsonStringScanner::countPlain(const char* data, int length)
+{
+   int rval = 0;
+   bool found = false;
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+   rval = _countPlainVectors(data, length, found);
+#endif
+
+   // check the remaining bytes one at a time
+   while(!found && rval < length)
+   {
+      found = !isPlain(data[rval]);
+      rval += found ? 0 : 1;
+   }
+
+   return rval;
+}
+
+int JsonStringScanner::countWhitespace(
+   const char* data, int length, int& lines)
+{
+   int rval = 0;
+   bool found = false;
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+   rval = _countWhitespaceVectors(data, length, found, lines);
+#endif
+
+   // check the remaining bytes one at a time
+   while(!found && rval < length)
+   {
+      char c = data[rval];
+      found = !(c == ' ' || c == '\n' || c == '\r' || c == '\t');
+      if(!found)
+      {
+         lines += (c == '\n') ? 1 : 0;
+         ++rval;
+      }
+   }
+
+   return rval;
+}
+
+int JsonStringScanner::countDigits(const char* data, int length)
+{
+   int rval = 0;
+   bool found = false;
+
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+   rval = _countDigitVectors(data, length, found);
+#endif
+
+   // check the remaining bytes one at a time
+   while(!found && rval < length)
+   {
+      found = (data[rval] < '0' || data[rval] > '9');
+      rval += found ? 0 : 1;
+   }
+
+   return rval;
+}
+
+bool JsonStringScanner::isPlain(char c)
+{
+   unsigned char uc = c;
+   return uc >= 0x20 && uc != '"' && uc != '\\';
+}
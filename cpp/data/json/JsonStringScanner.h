@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_json_JsonStringScanner_H
+#define monarch_data_json_JsonStringScanner_H
+
+namespace monarch
+{
+namespace data
+{
+namespace json
+{
+
+/**
+ * A JsonStringScanner finds the characters in a JSON string that need
+ * special treatment: double quotes, backslashes and control characters.
+ * Every other byte, including the bytes of UTF-8 encoded characters, appears
+ * in a JSON string as-is, so the runs between special characters can be
+ * copied in one go instead of a character at a time.
+ *
+ * It also finds the other runs of JSON text that do not change the state of
+ * a parser: the whitespace between tokens and the digits of numbers. The
+ * structural characters between them each change the parser's state and are
+ * left for it to process one at a time.
+ *
+ * When compiled for a CPU that supports them, SSE2 or AVX2 instructions are
+ * used to check 16 or 32 bytes at once.
+ *
+ * @author Dave Longley
+ */
+class JsonStringScanner
+{
+public:
+   /**
+    * Counts the bytes at the start of some data that can appear in a JSON
+    * string without escaping.
+    *
+    * @param data the data to scan.
+    * @param length the number of bytes in the data.
+    *
+    * @return the number of bytes before the first '"', '\' or control
+    *         character, length if there is none.
+    */
+   static int countPlain(const char* data, int length);
+
+   /**
+    * Counts the whitespace (spaces, tabs, carriage returns and newlines) at
+    * the start of some data.
+    *
+    * @param data the data to scan.
+    * @param length the number of bytes in the data.
+    * @param lines incremented by the number of newlines in the whitespace.
+    *
+    * @return the number of whitespace bytes, length if all of them are.
+    */
+   static int countWhitespace(const char* data, int length, int& lines);
+
+   /**
+    * Counts the decimal digits at the start of some data.
+    *
+    * @param data the data to scan.
+    * @param length the number of bytes in the data.
+    *
+    * @return the number of digits, length if all of them are.
+    */
+   static int countDigits(const char* data, int length);
+
+   /**
+    * Returns true if a byte can appear in a JSON string without escaping.
+    *
+    * @param c the byte to check.
+    *
+    * @return true if the byte is plain, false if not.
+    */
+   static bool isPlain(char c);
+};
+
+} // end namespace json
+} // end namespace data
+} // end namespace monarch
+#endif
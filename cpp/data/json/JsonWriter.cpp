@@ -1,8 +1,9 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/data/json/JsonWriter.h"
 
+#include "monarch/data/json/JsonStringScanner.h"
 #include "monarch/rt/DynamicObjectIterator.h"
 #include "monarch/rt/Exception.h"
 #include "monarch/io/BufferedOutputStream.h"
@@ -11,6 +12,7 @@
 #include <iostream>
 #include <sstream>
 #include <cstdio>
+#include <cstring>
 
 using namespace std;
 using namespace monarch::data;
@@ -18,7 +20,154 @@ using namespace monarch::data::json;
 using namespace monarch::io;
 using namespace monarch::rt;
 
-JsonWriter::JsonWriter(bool strict)
+/**
+ * The decimal digits for each number from 00 to 99.
+ */
+static const char _digitPairs[] =
+   "00010203040506070809"
+   "10111213141516171819"
+   "20212223242526272829"
+   "30313233343536373839"
+   "40414243444546474849"
+   "50515253545556575859"
+   "60616263646566676869"
+   "70717273747576777879"
+   "80818283848586878889"
+   "90919293949596979899";
+
+/**
+ * Lowercase hexadecimal digits.
+ */
+static const char _hexDigits[] = "0123456789abcdef";
+
+/**
+ * Formats an unsigned integer in decimal, two digits at a time.
+ *
+ * @param value the value to format.
+ * @param out the place to write at least 20 bytes to.
+ *
+ * @return the number of bytes written.
+ */
+static int _formatUInt64(uint64_t value, char* out)
+{
+   // write the digits backwards from the end of a temporary buffer
+   char tmp[20];
+   char* p = tmp + 20;
+   while(value >= 100)
+   {
+      int i = (value % 100) * 2;
+      value /= 100;
+      p -= 2;
+      p[0] = _digitPairs[i];
+      p[1] = _digitPairs[i + 1];
+   }
+   if(value >= 10)
+   {
+      p -= 2;
+      p[0] = _digitPairs[value * 2];
+      p[1] = _digitPairs[value * 2 + 1];
+   }
+   else
+   {
+      *(--p) = '0' + value;
+   }
+
+   int length = tmp + 20 - p;
+   memcpy(out, p, length);
+   return length;
+}
+
+/**
+ * Formats a signed integer in decimal.
+ *
+ * @param value the value to format.
+ * @param out the place to write at least 21 bytes to.
+ *
+ * @return the number of bytes written.
+ */
+static int _formatInt64(int64_t value, char* out)
+{
+   int rval = 0;
+
+   uint64_t magnitude = value;
+   if(value < 0)
+   {
+      out[rval++] = '-';
+      magnitude = 0 - magnitude;
+   }
+   rval += _formatUInt64(magnitude, out + rval);
+
+   return rval;
+}
+
+/**
+ * Escapes a string as a quoted JSON string.
+ *
+ * @param str the string to escape.
+ * @param length the length of the string.
+ * @param out the place to write at least (length * 6 + 2) bytes to.
+ *
+ * @return the number of bytes written.
+ */
+static int _escapeString(const char* str, int length, char* out)
+{
+   char* start = out;
+
+   *(out++) = '"';
+   int i = 0;
+   while(i < length)
+   {
+      // copy the characters that need no escaping in bulk
+      int plain = JsonStringScanner::countPlain(str + i, length - i);
+      memcpy(out, str + i, plain);
+      out += plain;
+      i += plain;
+
+      if(i < length)
+      {
+         unsigned char c = str[i++];
+         *(out++) = '\\';
+         switch(c)
+         {
+            case '"':
+            case '\\':
+               *(out++) = c;
+               break;
+            case '\b':
+               *(out++) = 'b';
+               break;
+            case '\f':
+               *(out++) = 'f';
+               break;
+            case '\n':
+               *(out++) = 'n';
+               break;
+            case '\r':
+               *(out++) = 'r';
+               break;
+            case '\t':
+               *(out++) = 't';
+               break;
+            default:
+               // produces "u01af" (4 digits of 0-filled hex)
+               out[0] = 'u';
+               out[1] = '0';
+               out[2] = '0';
+               out[3] = _hexDigits[c >> 4];
+               out[4] = _hexDigits[c & 0x0f];
+               out += 5;
+               break;
+         }
+      }
+   }
+   *(out++) = '"';
+
+   return out - start;
+}
+
+JsonWriter::JsonWriter(bool strict) :
+   mBuffered(false),
+   mBuffer(0)
 {
    mStrict = strict;
    // Initialize to compact representation
@@ -223,6 +372,156 @@ bool JsonWriter::write(DynamicObject& dyno, OutputStream* os, int level)
    return rval;
 }
 
+void JsonWriter::serialize(DynamicObject& dyno, int level)
+{
+   if(dyno.isNull())
+   {
+      memcpy(reserve(4), "null", 4);
+      mBuffer.extend(4);
+   }
+   else
+   {
+      switch(dyno->getType())
+      {
+         case String:
+         {
+            const char* str = dyno->getString();
+            int length = strlen(str);
+            mBuffer.extend(_escapeString(str, length, reserve(length * 6 + 2)));
+            break;
+         }
+         case Boolean:
+         {
+            bool b = dyno->getBoolean();
+            memcpy(reserve(5), b ? "true" : "false", b ? 4 : 5);
+            mBuffer.extend(b ? 4 : 5);
+            break;
+         }
+         case Int32:
+         case Int64:
+            mBuffer.extend(_formatInt64(dyno->getInt64(), reserve(21)));
+            break;
+         case UInt32:
+         case UInt64:
+            mBuffer.extend(_formatUInt64(dyno->getUInt64(), reserve(20)));
+            break;
+         case Double:
+         {
+            // same format as the string value of a double
+            double d = dyno->getDouble();
+            char* out = reserve(50);
+            if(d == 0)
+            {
+               *out = '0';
+               mBuffer.extend(1);
+            }
+            else
+            {
+               mBuffer.extend(snprintf(out, 50, "%e", d));
+            }
+            break;
+         }
+         case Map:
+         {
+            // start map serialization
+            bool newline = !mCompact && dyno->length() > 0;
+            memcpy(reserve(2), "{\n", newline ? 2 : 1);
+            mBuffer.extend(newline ? 2 : 1);
+
+            // serialize each map member
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               DynamicObject& next = i->next();
+               const char* name = i->getName();
+               int length = strlen(name);
+
+               // serialize indentation and member name
+               serializeIndentation(level + 1);
+               char* out = reserve(length + 4);
+               out[0] = '"';
+               memcpy(out + 1, name, length);
+               memcpy(out + length + 1, "\": ", 3);
+               mBuffer.extend(length + (mCompact ? 3 : 4));
+
+               // serialize member value, delimiter and formatting
+               serialize(next, level + 1);
+               if(i->hasNext())
+               {
+                  *reserve(1) = ',';
+                  mBuffer.extend(1);
+               }
+               if(!mCompact)
+               {
+                  *reserve(1) = '\n';
+                  mBuffer.extend(1);
+               }
+            }
+
+            // end map serialization
+            if(dyno->length() > 0)
+            {
+               serializeIndentation(level);
+            }
+            *reserve(1) = '}';
+            mBuffer.extend(1);
+            break;
+         }
+         case Array:
+         {
+            // start array serialization
+            bool newline = !mCompact && dyno->length() > 0;
+            memcpy(reserve(2), "[\n", newline ? 2 : 1);
+            mBuffer.extend(newline ? 2 : 1);
+
+            // serialize each array element
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               // serialize indentation, value, delimiter and formatting
+               serializeIndentation(level + 1);
+               serialize(i->next(), level + 1);
+               if(i->hasNext())
+               {
+                  *reserve(1) = ',';
+                  mBuffer.extend(1);
+               }
+               if(!mCompact)
+               {
+                  *reserve(1) = '\n';
+                  mBuffer.extend(1);
+               }
+            }
+
+            // end array serialization
+            if(dyno->length() > 0)
+            {
+               serializeIndentation(level);
+            }
+            *reserve(1) = ']';
+            mBuffer.extend(1);
+            break;
+         }
+      }
+   }
+}
+
+void JsonWriter::serializeIndentation(int level)
+{
+   int indent = mCompact ? 0 : (level * mIndentSpaces);
+   if(indent > 0)
+   {
+      memset(reserve(indent), ' ', indent);
+      mBuffer.extend(indent);
+   }
+}
+
+char* JsonWriter::reserve(int length)
+{
+   mBuffer.reserve(length);
+   return mBuffer.end();
+}
+
 bool JsonWriter::write(DynamicObject& dyno, OutputStream* os)
 {
    bool rval = true;
@@ -247,7 +546,15 @@ bool JsonWriter::write(DynamicObject& dyno, OutputStream* os)
       }
    }
 
-   if(rval)
+   if(rval && mBuffered)
+   {
+      // serialize all of the JSON and write it out at once
+      mBuffer.clear();
+      serialize(dyno, mIndentLevel);
+      rval = os->write(mBuffer.data(), mBuffer.length());
+      mBuffer.clear();
+   }
+   else if(rval)
    {
       ByteBuffer b(1024);
       BufferedOutputStream bos(&b, os);
@@ -262,6 +569,11 @@ void JsonWriter::setCompact(bool compact)
    mCompact = compact;
 }
 
+void JsonWriter::setBuffered(bool buffered)
+{
+   mBuffered = buffered;
+}
+
 void JsonWriter::setIndentation(int level, int spaces)
 {
    mIndentLevel = level;
@@ -274,6 +586,7 @@ bool JsonWriter::writeToOStream(
    OStreamOutputStream os(&stream);
    JsonWriter jw(strict);
    jw.setCompact(compact);
+   jw.setBuffered(true);
    if(!compact)
    {
       jw.setIndentation(0, 3);
@@ -1,10 +1,11 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_data_json_JsonWriter_H
 #define monarch_data_json_JsonWriter_H
 
 #include "monarch/data/DynamicObjectWriter.h"
+#include "monarch/io/ByteBuffer.h"
 
 #include <ostream>
 
@@ -23,6 +24,14 @@ namespace json
  * The compact setting should be used to minimize extra whitespace when not
  * needed.
  *
+ * In buffered mode, the whole JSON is serialized into a buffer owned by the
+ * writer and then written to the OutputStream at once. Strings are escaped
+ * by copying the runs of characters that need no escaping in bulk and
+ * numbers are formatted without allocating their string values. This is
+ * much faster than writing each token to the OutputStream, but the buffer
+ * grows to the size of the largest JSON written. The buffer is kept between
+ * writes.
+ *
  * @author David I. Lehn
  */
 class JsonWriter : public DynamicObjectWriter
@@ -48,6 +57,16 @@ protected:
     */
    int mIndentSpaces;
 
+   /**
+    * True to serialize into the buffer and then write it out at once.
+    */
+   bool mBuffered;
+
+   /**
+    * The buffer to serialize into in buffered mode.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
    /**
     * Writes out indentation.  None if in compact mode.
     *
@@ -71,6 +90,30 @@ protected:
       monarch::rt::DynamicObject& dyno,
       monarch::io::OutputStream* os, int level);
 
+   /**
+    * Recursively serializes an object to JSON in the buffer.
+    *
+    * @param dyno the DynamicObject to serialize.
+    * @param level the current level of indentation.
+    */
+   virtual void serialize(monarch::rt::DynamicObject& dyno, int level);
+
+   /**
+    * Serializes indentation in the buffer. None if in compact mode.
+    *
+    * @param level the indentation level.
+    */
+   virtual void serializeIndentation(int level);
+
+   /**
+    * Ensures the buffer has space for more bytes, growing it as needed.
+    *
+    * @param length the number of bytes needed.
+    *
+    * @return the end of the data in the buffer to write the bytes to.
+    */
+   virtual char* reserve(int length);
+
 public:
    /**
     * Creates a new JsonWriter.
@@ -114,6 +157,14 @@ public:
     */
    virtual void setCompact(bool compact);
 
+   /**
+    * Sets the writer to use buffered mode and serialize all of the JSON in
+    * its own buffer before writing it out.
+    *
+    * @param buffered true to use buffered mode, false not to.
+    */
+   virtual void setBuffered(bool buffered);
+
    /**
     * Writes a DynamicObject as JSON to an ostream.
     *
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/mapped/MappedDocument.h"
+
+#include "monarch/rt/Exception.h"
+#include "monarch/util/Data.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include "monarch/io/FileInputStream.h"
+#endif
+
+using namespace std;
+using namespace monarch::data::mapped;
+using namespace monarch::io;
+using namespace monarch::rt;
+
+MappedDocument::MappedDocument() :
+   mData(NULL),
+   mSize(0),
+   mMapped(false)
+{
+}
+
+MappedDocument::~MappedDocument()
+{
+   close();
+}
+
+bool MappedDocument::open(File& file)
+{
+   bool rval = true;
+
+   close();
+
+   int64_t size = file->getLength();
+   if(size < MAPPED_DOCUMENT_HEADER || size > 0xffffffffLL)
+   {
+      ExceptionRef e = new Exception(
+         "Invalid mapped document size.",
+         "monarch.data.mapped.MappedDocument.InvalidDocument");
+      e->getDetails()["path"] = file->getAbsolutePath();
+      e->getDetails()["size"] = size;
+      Exception::set(e);
+      rval = false;
+   }
+#ifndef WIN32
+   else
+   {
+      // map the file read-only and shared so processes share its pages
+      int fd = ::open(file->getAbsolutePath(), O_RDONLY);
+      void* data = (fd == -1) ? MAP_FAILED :
+         mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+      if(data == MAP_FAILED)
+      {
+         ExceptionRef e = new Exception(
+            "Could not map file.",
+            "monarch.io.File.OpenFailed");
+         e->getDetails()["path"] = file->getAbsolutePath();
+         e->getDetails()["error"] = strerror(errno);
+         Exception::set(e);
+         rval = false;
+      }
+      else
+      {
+         mData = (const char*)data;
+         mSize = size;
+         mMapped = true;
+      }
+      if(fd != -1)
+      {
+         ::close(fd);
+      }
+   }
+#else
+   else
+   {
+      // no shared mapping, read the whole file
+      char* data = (char*)malloc(size);
+      FileInputStream fis(file);
+      int64_t read = 0;
+      int numBytes = 1;
+      while(numBytes > 0 && read < size)
+      {
+         numBytes = fis.read(data + read, size - read);
+         read += (numBytes > 0) ? numBytes : 0;
+      }
+      fis.close();
+      rval = (numBytes != -1);
+      if(rval)
+      {
+         mData = data;
+         mSize = read;
+         mMapped = true;
+      }
+      else
+      {
+         free(data);
+      }
+   }
+#endif
+
+   if(rval && !checkHeader())
+   {
+      ExceptionRef e = new Exception(
+         "Could not open mapped document.",
+         "monarch.data.mapped.MappedDocument.OpenFailed");
+      e->getDetails()["path"] = file->getAbsolutePath();
+      Exception::push(e);
+      close();
+      rval = false;
+   }
+
+   return rval;
+}
+
+bool MappedDocument::open(const char* data, int length)
+{
+   close();
+   mData = data;
+   mSize = (length > 0) ? length : 0;
+   mMapped = false;
+
+   bool rval = checkHeader();
+   if(!rval)
+   {
+      close();
+   }
+
+   return rval;
+}
+
+void MappedDocument::close()
+{
+   if(mMapped)
+   {
+#ifndef WIN32
+      munmap((void*)mData, mSize);
+#else
+      free((void*)mData);
+#endif
+   }
+   mData = NULL;
+   mSize = 0;
+   mMapped = false;
+}
+
+MappedValue MappedDocument::getRoot()
+{
+   return (mData == NULL) ?
+      MappedValue() :
+      MappedValue(this, getUInt32((const unsigned char*)mData, 1));
+}
+
+uint32_t MappedDocument::getSize()
+{
+   return mSize;
+}
+
+const unsigned char* MappedDocument::getNode(uint32_t offset, uint32_t length)
+{
+   // values are after the header, aligned, and must fit
+   return
+      (offset < MAPPED_DOCUMENT_HEADER || (offset & 3) != 0 ||
+       length > mSize || offset > mSize - length) ?
+      NULL : (const unsigned char*)mData + offset;
+}
+
+const char* MappedDocument::getString(uint32_t offset, uint32_t& length)
+{
+   const char* rval = NULL;
+
+   const unsigned char* node = getNode(offset, 8);
+   if(node != NULL && node[0] == StringNode)
+   {
+      // the string and its NUL must fit
+      length = getUInt32(node, 0);
+      if(length < mSize && getNode(offset, length + 9) != NULL &&
+         node[length + 8] == '\0')
+      {
+         rval = (const char*)node + 8;
+      }
+   }
+
+   return rval;
+}
+
+uint32_t MappedDocument::getUInt32(const unsigned char* node, uint32_t index)
+{
+   uint32_t value;
+   memcpy(&value, node + 4 + index * 4, 4);
+   return MO_UINT32_FROM_LE(value);
+}
+
+bool MappedDocument::checkHeader()
+{
+   bool rval =
+      mSize >= MAPPED_DOCUMENT_HEADER &&
+      memcmp(mData, MAPPED_DOCUMENT_MAGIC, 4) == 0;
+   if(!rval)
+   {
+      ExceptionRef e = new Exception(
+         "Data is not a mapped document.",
+         "monarch.data.mapped.MappedDocument.InvalidDocument");
+      Exception::set(e);
+   }
+   else
+   {
+      const unsigned char* header = (const unsigned char*)mData;
+      uint32_t version = getUInt32(header, 0);
+      uint32_t size = getUInt32(header, 2);
+      if(version != MAPPED_DOCUMENT_VERSION)
+      {
+         ExceptionRef e = new Exception(
+            "Unsupported mapped document version.",
+            "monarch.data.mapped.MappedDocument.UnsupportedVersion");
+         e->getDetails()["version"] = version;
+         Exception::set(e);
+         rval = false;
+      }
+      else if(size != mSize)
+      {
+         ExceptionRef e = new Exception(
+            "Mapped document size does not match its data.",
+            "monarch.data.mapped.MappedDocument.InvalidDocument");
+         e->getDetails()["expected"] = size;
+         e->getDetails()["actual"] = mSize;
+         Exception::set(e);
+         rval = false;
+      }
+   }
+
+   return rval;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_mapped_MappedDocument_H
+#define monarch_data_mapped_MappedDocument_H
+
+#include "monarch/data/mapped/MappedValue.h"
+#include "monarch/io/File.h"
+#include "monarch/rt/Collectable.h"
+
+namespace monarch
+{
+namespace data
+{
+namespace mapped
+{
+
+/**
+ * The bytes that start a mapped document.
+ */
+#define MAPPED_DOCUMENT_MAGIC     "MOMD"
+
+/**
+ * The version of the mapped document format.
+ */
+#define MAPPED_DOCUMENT_VERSION   1
+
+/**
+ * The size of the header of a mapped document.
+ */
+#define MAPPED_DOCUMENT_HEADER    16
+
+/**
+ * A MappedDocument is an immutable DynamicObject stored in a binary format
+ * that is used in place: a file is memory-mapped and its values are only
+ * decoded when they are accessed through a MappedValue. Opening a document
+ * parses nothing, and processes that map the same file share its pages, so
+ * large, mostly-read data such as configuration bundles, JSON-LD contexts or
+ * lookup tables costs neither startup time nor per-process memory.
+ *
+ * Documents are written with a MappedDocumentWriter. The format is:
+ *
+ * header: "MOMD", version, root offset and document size (uint32 each).
+ * value: a type byte (see NodeType) and 3 zero bytes, followed by:
+ *    Int32, UInt32: 4 bytes.
+ *    Int64, UInt64, Double: 8 bytes.
+ *    String: a uint32 length, the bytes and a NUL.
+ *    Map: a uint32 count, then a key offset and a value offset (uint32
+ *       each) per member, sorted by key.
+ *    Array: a uint32 count, then a value offset per element.
+ *    null, true, false: nothing.
+ *
+ * Numbers are little-endian and values start on 4-byte boundaries. Offsets
+ * are from the start of the document. Keys are strings, found by binary
+ * search, and equal strings and scalar values are stored once.
+ *
+ * Every offset is checked against the size of the document when it is used,
+ * so a damaged document gives null values instead of reading outside of it.
+ * Keys and values are written before the map or array that holds them, so
+ * an offset that is not below its container's is also read as null, which
+ * keeps a damaged document from looping back into itself.
+ *
+ * @author Dave Longley
+ */
+class MappedDocument
+{
+public:
+   /**
+    * The types of stored values.
+    */
+   enum NodeType
+   {
+      NullNode, FalseNode, TrueNode, Int32Node, UInt32Node, Int64Node,
+      UInt64Node, DoubleNode, StringNode, MapNode, ArrayNode
+   };
+
+protected:
+   /**
+    * The document data.
+    */
+   const char* mData;
+
+   /**
+    * The size of the document data.
+    */
+   uint32_t mSize;
+
+   /**
+    * True if the data is memory-mapped, false if it is not owned.
+    */
+   bool mMapped;
+
+public:
+   /**
+    * Creates a new, empty MappedDocument.
+    */
+   MappedDocument();
+
+   /**
+    * Destructs this MappedDocument, unmapping any file.
+    */
+   virtual ~MappedDocument();
+
+   /**
+    * Memory-maps a document file.
+    *
+    * @param file the file to map.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool open(monarch::io::File& file);
+
+   /**
+    * Uses a document in memory. The memory is not copied and must stay
+    * valid until this document is closed.
+    *
+    * @param data the document data.
+    * @param length the length of the data.
+    *
+    * @return true if successful, false if the data is not a document.
+    */
+   virtual bool open(const char* data, int length);
+
+   /**
+    * Closes this document, unmapping any file. Values from it must no
+    * longer be used.
+    */
+   virtual void close();
+
+   /**
+    * Gets the top-level value of this document.
+    *
+    * @return the root value, null if no document is open.
+    */
+   virtual MappedValue getRoot();
+
+   /**
+    * Gets the size of this document.
+    *
+    * @return the size in bytes.
+    */
+   virtual uint32_t getSize();
+
+   /**
+    * Gets a stored value, checking that it fits in this document.
+    *
+    * @param offset the offset of the value.
+    * @param length the number of bytes of the value that will be read.
+    *
+    * @return the value or NULL if it does not fit.
+    */
+   virtual const unsigned char* getNode(uint32_t offset, uint32_t length);
+
+   /**
+    * Gets a stored string.
+    *
+    * @param offset the offset of the string value.
+    * @param length set to the length of the string.
+    *
+    * @return the NUL-terminated string or NULL if the value is not a valid
+    *         string.
+    */
+   virtual const char* getString(uint32_t offset, uint32_t& length);
+
+   /**
+    * Reads a little-endian uint32 at a stored value.
+    *
+    * @param node the stored value.
+    * @param index the index of the uint32 after the type, 0 for the first.
+    *
+    * @return the uint32.
+    */
+   static uint32_t getUInt32(const unsigned char* node, uint32_t index);
+
+protected:
+   /**
+    * Checks the header of the document data.
+    *
+    * @return true if the data is a document, false with an exception set if
+    *         not.
+    */
+   virtual bool checkHeader();
+};
+
+// type definition for a reference counted MappedDocument
+typedef monarch::rt::Collectable<MappedDocument> MappedDocumentRef;
+
+} // end namespace mapped
+} // end namespace data
+} // end namespace monarch
+#endif
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/mapped/MappedDocumentWriter.h"
+
+#include "monarch/data/mapped/MappedDocument.h"
+#include "monarch/rt/DynamicObjectIterator.h"
+#include "monarch/util/Data.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace monarch::data::mapped;
+using namespace monarch::io;
+using namespace monarch::rt;
+
+/**
+ * A member of a map being written.
+ */
+struct _Member
+{
+   /**
+    * The name of the member.
+    */
+   const char* name;
+
+   /**
+    * The offset of the value of the member.
+    */
+   uint32_t value;
+};
+
+/**
+ * Orders map members by name.
+ *
+ * @param a the first member.
+ * @param b the second member.
+ *
+ * @return true if a comes before b.
+ */
+static bool _compareMembers(const _Member& a, const _Member& b)
+{
+   return strcmp(a.name, b.name) < 0;
+}
+
+/**
+ * Appends a little-endian uint32 to an encoded value.
+ *
+ * @param out the encoded value.
+ * @param value the uint32 to append.
+ */
+static void _putUInt32(string& out, uint32_t value)
+{
+   value = MO_UINT32_TO_LE(value);
+   out.append((const char*)&value, 4);
+}
+
+/**
+ * Starts an encoded value with its type.
+ *
+ * @param out the encoded value.
+ * @param type the type of the value.
+ */
+static void _putType(string& out, MappedDocument::NodeType type)
+{
+   out.push_back((char)type);
+   out.append(3, '\0');
+}
+
+/**
+ * Appends a little-endian uint64 to an encoded value.
+ *
+ * @param out the encoded value.
+ * @param value the uint64 to append.
+ */
+static void _putUInt64(string& out, uint64_t value)
+{
+   _putUInt32(out, (uint32_t)value);
+   _putUInt32(out, (uint32_t)(value >> 32));
+}
+
+MappedDocumentWriter::MappedDocumentWriter() :
+   mBuffer(0)
+{
+}
+
+MappedDocumentWriter::~MappedDocumentWriter()
+{
+}
+
+bool MappedDocumentWriter::write(DynamicObject& dyno, OutputStream* os)
+{
+   bool rval;
+
+   // build the whole document and write it out at once
+   serializeDocument(dyno);
+   rval = os->write(mBuffer.data(), mBuffer.length());
+   mBuffer.clear();
+
+   return rval;
+}
+
+void MappedDocumentWriter::setIndentation(int level, int spaces)
+{
+}
+
+void MappedDocumentWriter::setCompact(bool compact)
+{
+}
+
+string MappedDocumentWriter::writeToString(DynamicObject dyno)
+{
+   MappedDocumentWriter writer;
+   writer.serializeDocument(dyno);
+   return string(writer.mBuffer.data(), writer.mBuffer.length());
+}
+
+void MappedDocumentWriter::serializeDocument(DynamicObject& dyno)
+{
+   mBuffer.clear();
+   mShared.clear();
+
+   // reserve the header, then write the values
+   string header(MAPPED_DOCUMENT_HEADER, '\0');
+   append(header.data(), header.length());
+   uint32_t root = serialize(dyno);
+
+   header.clear();
+   header.append(MAPPED_DOCUMENT_MAGIC, 4);
+   _putUInt32(header, MAPPED_DOCUMENT_VERSION);
+   _putUInt32(header, root);
+   _putUInt32(header, mBuffer.length());
+   memcpy(mBuffer.data(), header.data(), header.length());
+
+   // the shared values are only needed while building
+   mShared.clear();
+}
+
+uint32_t MappedDocumentWriter::serialize(DynamicObject& dyno)
+{
+   uint32_t rval = 0;
+
+   string node;
+   if(dyno.isNull())
+   {
+      _putType(node, MappedDocument::NullNode);
+      rval = share(node);
+   }
+   else
+   {
+      switch(dyno->getType())
+      {
+         case String:
+         {
+            const char* str = dyno->getString();
+            rval = serializeString(str, strlen(str));
+            break;
+         }
+         case Boolean:
+            _putType(node, dyno->getBoolean() ?
+               MappedDocument::TrueNode : MappedDocument::FalseNode);
+            rval = share(node);
+            break;
+         case Int32:
+            _putType(node, MappedDocument::Int32Node);
+            _putUInt32(node, (uint32_t)dyno->getInt32());
+            rval = share(node);
+            break;
+         case UInt32:
+            _putType(node, MappedDocument::UInt32Node);
+            _putUInt32(node, dyno->getUInt32());
+            rval = share(node);
+            break;
+         case Int64:
+            _putType(node, MappedDocument::Int64Node);
+            _putUInt64(node, (uint64_t)dyno->getInt64());
+            rval = share(node);
+            break;
+         case UInt64:
+            _putType(node, MappedDocument::UInt64Node);
+            _putUInt64(node, dyno->getUInt64());
+            rval = share(node);
+            break;
+         case Double:
+         {
+            double d = dyno->getDouble();
+            uint64_t bits;
+            memcpy(&bits, &d, 8);
+            _putType(node, MappedDocument::DoubleNode);
+            _putUInt64(node, bits);
+            rval = share(node);
+            break;
+         }
+         case Map:
+         {
+            // write the values first, then the sorted keys
+            vector<_Member> members;
+            members.reserve(dyno->length());
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               DynamicObject& next = i->next();
+               _Member m;
+               m.name = i->getName();
+               m.value = serialize(next);
+               members.push_back(m);
+            }
+            sort(members.begin(), members.end(), _compareMembers);
+
+            _putType(node, MappedDocument::MapNode);
+            _putUInt32(node, members.size());
+            for(vector<_Member>::iterator mi = members.begin();
+                mi != members.end(); ++mi)
+            {
+               _putUInt32(node, serializeString(mi->name, strlen(mi->name)));
+               _putUInt32(node, mi->value);
+            }
+            rval = append(node.data(), node.length());
+            break;
+         }
+         case Array:
+         {
+            vector<uint32_t> elements;
+            elements.reserve(dyno->length());
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               elements.push_back(serialize(i->next()));
+            }
+
+            _putType(node, MappedDocument::ArrayNode);
+            _putUInt32(node, elements.size());
+            for(vector<uint32_t>::iterator ei = elements.begin();
+                ei != elements.end(); ++ei)
+            {
+               _putUInt32(node, *ei);
+            }
+            rval = append(node.data(), node.length());
+            break;
+         }
+      }
+   }
+
+   return rval;
+}
+
+uint32_t MappedDocumentWriter::serializeString(
+   const char* str, uint32_t length)
+{
+   string node;
+   node.reserve(length + 9);
+   _putType(node, MappedDocument::StringNode);
+   _putUInt32(node, length);
+   node.append(str, length);
+   node.push_back('\0');
+   return share(node);
+}
+
+uint32_t MappedDocumentWriter::share(const string& value)
+{
+   uint32_t rval;
+
+   map<string, uint32_t>::iterator i = mShared.find(value);
+   if(i != mShared.end())
+   {
+      rval = i->second;
+   }
+   else
+   {
+      rval = append(value.data(), value.length());
+      mShared.insert(make_pair(value, rval));
+   }
+
+   return rval;
+}
+
+uint32_t MappedDocumentWriter::append(const char* data, uint32_t length)
+{
+   uint32_t rval = mBuffer.length();
+
+   uint32_t padded = (length + 3) & ~3;
+   mBuffer.reserve(padded);
+   unsigned char* out = mBuffer.uend();
+   memcpy(out, data, length);
+   memset(out + length, 0, padded - length);
+   mBuffer.extend(padded);
+
+   return rval;
+}
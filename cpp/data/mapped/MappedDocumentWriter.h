@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_mapped_MappedDocumentWriter_H
+#define monarch_data_mapped_MappedDocumentWriter_H
+
+#include "monarch/data/DynamicObjectWriter.h"
+#include "monarch/io/ByteBuffer.h"
+
+#include <map>
+#include <string>
+
+namespace monarch
+{
+namespace data
+{
+namespace mapped
+{
+
+/**
+ * A MappedDocumentWriter serializes a DynamicObject to the format read by
+ * a MappedDocument.
+ *
+ * Values are written before the maps and arrays that contain them, so every
+ * offset is known when it is written. Equal strings, including map keys, and
+ * equal scalar values are written once and shared, which keeps documents
+ * with many repeated keys small. Map members are sorted by name so they can
+ * be found by binary search.
+ *
+ * The whole document is built in a buffer owned by the writer and written
+ * to the OutputStream at once. There is no whitespace, so compact and
+ * indentation settings are ignored.
+ *
+ * @author Dave Longley
+ */
+class MappedDocumentWriter : public DynamicObjectWriter
+{
+protected:
+   /**
+    * The buffer to build the document in.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
+   /**
+    * The offsets of the strings and scalar values written so far, by their
+    * encoded bytes.
+    */
+   std::map<std::string, uint32_t> mShared;
+
+public:
+   /**
+    * Creates a new MappedDocumentWriter.
+    */
+   MappedDocumentWriter();
+
+   /**
+    * Destructs this MappedDocumentWriter.
+    */
+   virtual ~MappedDocumentWriter();
+
+   /**
+    * Serializes an object to a mapped document.
+    *
+    * @param dyno the DynamicObject to serialize.
+    * @param os the OutputStream to write the document to.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool write(
+      monarch::rt::DynamicObject& dyno, monarch::io::OutputStream* os);
+
+   /**
+    * Does nothing, mapped documents have no indentation.
+    *
+    * @param level the starting indentation level.
+    * @param spaces the number of spaces per indentation level.
+    */
+   virtual void setIndentation(int level, int spaces);
+
+   /**
+    * Does nothing, mapped documents are always compact.
+    *
+    * @param compact true to minimize whitespace, false not to.
+    */
+   virtual void setCompact(bool compact);
+
+   /**
+    * Writes a DynamicObject as a mapped document to a string.
+    *
+    * @param dyno the DynamicObject to write out.
+    *
+    * @return the string with the document.
+    */
+   static std::string writeToString(monarch::rt::DynamicObject dyno);
+
+protected:
+   /**
+    * Builds the whole document for an object in the buffer.
+    *
+    * @param dyno the DynamicObject to serialize.
+    */
+   virtual void serializeDocument(monarch::rt::DynamicObject& dyno);
+
+   /**
+    * Recursively serializes an object in the buffer.
+    *
+    * @param dyno the DynamicObject to serialize.
+    *
+    * @return the offset of the value.
+    */
+   virtual uint32_t serialize(monarch::rt::DynamicObject& dyno);
+
+   /**
+    * Serializes a string in the buffer, sharing an equal string that was
+    * already written.
+    *
+    * @param str the string.
+    * @param length the length of the string.
+    *
+    * @return the offset of the string value.
+    */
+   virtual uint32_t serializeString(const char* str, uint32_t length);
+
+   /**
+    * Writes an encoded string or scalar value to the buffer, sharing an
+    * equal value that was already written.
+    *
+    * @param value the encoded value.
+    *
+    * @return the offset of the value.
+    */
+   virtual uint32_t share(const std::string& value);
+
+   /**
+    * Appends a value to the buffer, padded to a 4-byte boundary.
+    *
+    * @param data the encoded value.
+    * @param length the length of the value.
+    *
+    * @return the offset of the value.
+    */
+   virtual uint32_t append(const char* data, uint32_t length);
+};
+
+} // end namespace mapped
+} // end namespace data
+} // end namespace monarch
+#endif
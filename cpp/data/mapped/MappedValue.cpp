@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/mapped/MappedValue.h"
+
+#include "monarch/data/mapped/MappedDocument.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace monarch::data::mapped;
+using namespace monarch::rt;
+
+/**
+ * Reads an 8-byte stored number.
+ *
+ * @param node the stored value.
+ *
+ * @return the bits of the number.
+ */
+static uint64_t _getUInt64(const unsigned char* node)
+{
+   return
+      (uint64_t)MappedDocument::getUInt32(node, 0) |
+      ((uint64_t)MappedDocument::getUInt32(node, 1) << 32);
+}
+
+MappedValue::MappedValue(MappedDocument* doc, uint32_t offset) :
+   mDocument(doc),
+   mOffset(offset)
+{
+}
+
+MappedValue::~MappedValue()
+{
+}
+
+bool MappedValue::isNull() const
+{
+   return getNodeType() == MappedDocument::NullNode;
+}
+
+DynamicObjectType MappedValue::getType() const
+{
+   DynamicObjectType rval;
+
+   switch(getNodeType())
+   {
+      case MappedDocument::FalseNode:
+      case MappedDocument::TrueNode:
+         rval = Boolean;
+         break;
+      case MappedDocument::Int32Node:
+         rval = Int32;
+         break;
+      case MappedDocument::UInt32Node:
+         rval = UInt32;
+         break;
+      case MappedDocument::Int64Node:
+         rval = Int64;
+         break;
+      case MappedDocument::UInt64Node:
+         rval = UInt64;
+         break;
+      case MappedDocument::DoubleNode:
+         rval = Double;
+         break;
+      case MappedDocument::MapNode:
+         rval = Map;
+         break;
+      case MappedDocument::ArrayNode:
+         rval = Array;
+         break;
+      default:
+         rval = String;
+         break;
+   }
+
+   return rval;
+}
+
+int MappedValue::length() const
+{
+   int rval = 0;
+
+   int type = getNodeType();
+   switch(type)
+   {
+      case MappedDocument::FalseNode:
+      case MappedDocument::TrueNode:
+         rval = 1;
+         break;
+      case MappedDocument::Int32Node:
+      case MappedDocument::UInt32Node:
+         rval = 4;
+         break;
+      case MappedDocument::Int64Node:
+      case MappedDocument::UInt64Node:
+      case MappedDocument::DoubleNode:
+         rval = 8;
+         break;
+      case MappedDocument::StringNode:
+         rval = strlen(getString());
+         break;
+      case MappedDocument::MapNode:
+      case MappedDocument::ArrayNode:
+      {
+         const unsigned char* node = getContainer(
+            (type == MappedDocument::MapNode) ? 2 : 1);
+         rval = (node == NULL) ? 0 : MappedDocument::getUInt32(node, 0);
+         break;
+      }
+   }
+
+   return rval;
+}
+
+const char* MappedValue::getString() const
+{
+   uint32_t length;
+   const char* rval = (mDocument == NULL) ?
+      NULL : mDocument->getString(mOffset, length);
+   return (rval == NULL) ? "" : rval;
+}
+
+bool MappedValue::getBoolean() const
+{
+   bool rval;
+
+   switch(getNodeType())
+   {
+      case MappedDocument::TrueNode:
+         rval = true;
+         break;
+      case MappedDocument::StringNode:
+         rval = (strcmp(getString(), "true") == 0);
+         break;
+      default:
+         rval = (getDouble() != 0);
+         break;
+   }
+
+   return rval;
+}
+
+int32_t MappedValue::getInt32() const
+{
+   return (getNodeType() == MappedDocument::StringNode) ?
+      strtol(getString(), NULL, 10) : (int32_t)getInt64();
+}
+
+uint32_t MappedValue::getUInt32() const
+{
+   return (getNodeType() == MappedDocument::StringNode) ?
+      strtoul(getString(), NULL, 10) : (uint32_t)getUInt64();
+}
+
+int64_t MappedValue::getInt64() const
+{
+   int64_t rval;
+
+   switch(getNodeType())
+   {
+      case MappedDocument::TrueNode:
+         rval = 1;
+         break;
+      case MappedDocument::Int32Node:
+         rval = (int32_t)MappedDocument::getUInt32(getNode(8), 0);
+         break;
+      case MappedDocument::UInt32Node:
+         rval = MappedDocument::getUInt32(getNode(8), 0);
+         break;
+      case MappedDocument::Int64Node:
+      case MappedDocument::UInt64Node:
+         rval = (int64_t)_getUInt64(getNode(12));
+         break;
+      case MappedDocument::DoubleNode:
+         rval = (int64_t)getDouble();
+         break;
+      case MappedDocument::StringNode:
+         rval = strtoll(getString(), NULL, 10);
+         break;
+      default:
+         rval = 0;
+         break;
+   }
+
+   return rval;
+}
+
+uint64_t MappedValue::getUInt64() const
+{
+   uint64_t rval;
+
+   switch(getNodeType())
+   {
+      case MappedDocument::DoubleNode:
+         rval = (uint64_t)getDouble();
+         break;
+      case MappedDocument::StringNode:
+         rval = strtoull(getString(), NULL, 10);
+         break;
+      default:
+         rval = (uint64_t)getInt64();
+         break;
+   }
+
+   return rval;
+}
+
+double MappedValue::getDouble() const
+{
+   double rval;
+
+   switch(getNodeType())
+   {
+      case MappedDocument::DoubleNode:
+      {
+         uint64_t bits = _getUInt64(getNode(12));
+         memcpy(&rval, &bits, 8);
+         break;
+      }
+      case MappedDocument::UInt64Node:
+         rval = (double)getUInt64();
+         break;
+      case MappedDocument::StringNode:
+         rval = strtod(getString(), NULL);
+         break;
+      default:
+         rval = (double)getInt64();
+         break;
+   }
+
+   return rval;
+}
+
+bool MappedValue::hasMember(const char* name) const
+{
+   return !(*this)[name].isNull();
+}
+
+MappedValue MappedValue::operator[](const char* name) const
+{
+   MappedValue rval;
+
+   if(getNodeType() == MappedDocument::MapNode)
+   {
+      const unsigned char* node = getContainer(2);
+      if(node != NULL)
+      {
+         // binary search the sorted keys
+         int low = 0;
+         int high = (int)MappedDocument::getUInt32(node, 0) - 1;
+         while(low <= high)
+         {
+            int mid = low + (high - low) / 2;
+            const char* key =
+               getKey(MappedDocument::getUInt32(node, 1 + mid * 2));
+            int cmp = (key == NULL) ? 1 : strcmp(key, name);
+            if(cmp == 0)
+            {
+               rval = getChild(MappedDocument::getUInt32(node, 2 + mid * 2));
+               break;
+            }
+            else if(cmp < 0)
+            {
+               low = mid + 1;
+            }
+            else
+            {
+               high = mid - 1;
+            }
+         }
+      }
+   }
+
+   return rval;
+}
+
+MappedValue MappedValue::operator[](int index) const
+{
+   MappedValue rval;
+
+   int type = getNodeType();
+   if(type == MappedDocument::MapNode || type == MappedDocument::ArrayNode)
+   {
+      uint32_t entrySize = (type == MappedDocument::MapNode) ? 2 : 1;
+      const unsigned char* node = getContainer(entrySize);
+      if(node != NULL && index >= 0 &&
+         (uint32_t)index < MappedDocument::getUInt32(node, 0))
+      {
+         rval = getChild(
+            MappedDocument::getUInt32(node, index * entrySize + entrySize));
+      }
+   }
+
+   return rval;
+}
+
+const char* MappedValue::getName(int index) const
+{
+   const char* rval = NULL;
+
+   if(getNodeType() == MappedDocument::MapNode)
+   {
+      const unsigned char* node = getContainer(2);
+      if(node != NULL && index >= 0 &&
+         (uint32_t)index < MappedDocument::getUInt32(node, 0))
+      {
+         rval = getKey(MappedDocument::getUInt32(node, 1 + index * 2));
+      }
+   }
+
+   return rval;
+}
+
+DynamicObject MappedValue::toDynamicObject() const
+{
+   DynamicObject rval(NULL);
+
+   switch(getNodeType())
+   {
+      case MappedDocument::NullNode:
+         break;
+      case MappedDocument::FalseNode:
+      case MappedDocument::TrueNode:
+         rval = DynamicObject();
+         rval = getBoolean();
+         break;
+      case MappedDocument::Int32Node:
+         rval = DynamicObject();
+         rval = getInt32();
+         break;
+      case MappedDocument::UInt32Node:
+         rval = DynamicObject();
+         rval = getUInt32();
+         break;
+      case MappedDocument::Int64Node:
+         rval = DynamicObject();
+         rval = getInt64();
+         break;
+      case MappedDocument::UInt64Node:
+         rval = DynamicObject();
+         rval = getUInt64();
+         break;
+      case MappedDocument::DoubleNode:
+         rval = DynamicObject();
+         rval = getDouble();
+         break;
+      case MappedDocument::StringNode:
+         rval = DynamicObject();
+         rval = getString();
+         break;
+      case MappedDocument::MapNode:
+      {
+         rval = DynamicObject();
+         rval->setType(Map);
+         int count = length();
+         for(int i = 0; i < count; ++i)
+         {
+            const char* name = getName(i);
+            if(name != NULL)
+            {
+               rval[name] = (*this)[i].toDynamicObject();
+            }
+         }
+         break;
+      }
+      case MappedDocument::ArrayNode:
+      {
+         rval = DynamicObject();
+         rval->setType(Array);
+         int count = length();
+         for(int i = 0; i < count; ++i)
+         {
+            DynamicObject element = (*this)[i].toDynamicObject();
+            rval->append(element);
+         }
+         break;
+      }
+   }
+
+   return rval;
+}
+
+const unsigned char* MappedValue::getNode(uint32_t length) const
+{
+   return (mDocument == NULL) ? NULL : mDocument->getNode(mOffset, length);
+}
+
+int MappedValue::getNodeType() const
+{
+   const unsigned char* node = getNode(4);
+   int rval = (node == NULL) ? MappedDocument::NullNode : node[0];
+
+   // check that the payload of the type fits
+   uint32_t size = 4;
+   switch(rval)
+   {
+      case MappedDocument::Int32Node:
+      case MappedDocument::UInt32Node:
+      case MappedDocument::StringNode:
+      case MappedDocument::MapNode:
+      case MappedDocument::ArrayNode:
+         size = 8;
+         break;
+      case MappedDocument::Int64Node:
+      case MappedDocument::UInt64Node:
+      case MappedDocument::DoubleNode:
+         size = 12;
+         break;
+      case MappedDocument::NullNode:
+      case MappedDocument::FalseNode:
+      case MappedDocument::TrueNode:
+         break;
+      default:
+         // unknown type
+         size = 0;
+         break;
+   }
+   if(size == 0 || getNode(size) == NULL)
+   {
+      rval = MappedDocument::NullNode;
+   }
+
+   return rval;
+}
+
+const unsigned char* MappedValue::getContainer(uint32_t entrySize) const
+{
+   const unsigned char* rval = getNode(8);
+   if(rval != NULL)
+   {
+      // all entries must fit, checked without overflowing
+      uint32_t count = MappedDocument::getUInt32(rval, 0);
+      uint32_t max = (mDocument->getSize() - 8) / (entrySize * 4);
+      if(count > max || getNode(8 + count * entrySize * 4) == NULL)
+      {
+         rval = NULL;
+      }
+   }
+   return rval;
+}
+
+MappedValue MappedValue::getChild(uint32_t offset) const
+{
+   return (offset < mOffset) ? MappedValue(mDocument, offset) : MappedValue();
+}
+
+const char* MappedValue::getKey(uint32_t offset) const
+{
+   uint32_t length;
+   return (offset < mOffset) ? mDocument->getString(offset, length) : NULL;
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_mapped_MappedValue_H
+#define monarch_data_mapped_MappedValue_H
+
+#include "monarch/rt/DynamicObject.h"
+
+namespace monarch
+{
+namespace data
+{
+namespace mapped
+{
+
+// forward declaration
+class MappedDocument;
+
+/**
+ * A MappedValue is a read-only view of a value in a MappedDocument. It has
+ * the same getters as a DynamicObject, but reads the value from the
+ * document each time instead of holding a decoded copy. Strings are
+ * returned as pointers into the document.
+ *
+ * A MappedValue is only a document pointer and an offset, so it is meant to
+ * be passed by value. It must not be used after its document is closed.
+ *
+ * Missing members and out-of-range indexes give null values, like the
+ * const accessors of a DynamicObject. Use toDynamicObject() to get a
+ * modifiable copy of a value.
+ *
+ * @author Dave Longley
+ */
+class MappedValue
+{
+protected:
+   /**
+    * The document the value is in, NULL for a missing value.
+    */
+   MappedDocument* mDocument;
+
+   /**
+    * The offset of the value in the document.
+    */
+   uint32_t mOffset;
+
+public:
+   /**
+    * Creates a new MappedValue.
+    *
+    * @param doc the document the value is in, NULL for a missing value.
+    * @param offset the offset of the value in the document.
+    */
+   MappedValue(MappedDocument* doc = NULL, uint32_t offset = 0);
+
+   /**
+    * Destructs this MappedValue.
+    */
+   virtual ~MappedValue();
+
+   /**
+    * Returns true if this value is null or missing.
+    *
+    * @return true if null, false if not.
+    */
+   virtual bool isNull() const;
+
+   /**
+    * Gets the type of this value. Null values are Strings, as with the
+    * conversion to a DynamicObject, so check isNull() first.
+    *
+    * @return the type of this value.
+    */
+   virtual monarch::rt::DynamicObjectType getType() const;
+
+   /**
+    * Gets the length of this value: the number of bytes in a string, the
+    * number of members or elements of a map or array, the size of a number
+    * or 1 for a boolean.
+    *
+    * @return the length of this value.
+    */
+   virtual int length() const;
+
+   /**
+    * Gets this value as a string.
+    *
+    * @return the string in the document, "" if this is not a string.
+    */
+   virtual const char* getString() const;
+
+   /**
+    * Gets this value as a boolean.
+    *
+    * @return the boolean value.
+    */
+   virtual bool getBoolean() const;
+
+   /**
+    * Gets this value as a 32-bit integer.
+    *
+    * @return the integer value.
+    */
+   virtual int32_t getInt32() const;
+
+   /**
+    * Gets this value as a 32-bit unsigned integer.
+    *
+    * @return the unsigned integer value.
+    */
+   virtual uint32_t getUInt32() const;
+
+   /**
+    * Gets this value as a 64-bit integer.
+    *
+    * @return the integer value.
+    */
+   virtual int64_t getInt64() const;
+
+   /**
+    * Gets this value as a 64-bit unsigned integer.
+    *
+    * @return the unsigned integer value.
+    */
+   virtual uint64_t getUInt64() const;
+
+   /**
+    * Gets this value as a double.
+    *
+    * @return the double value.
+    */
+   virtual double getDouble() const;
+
+   /**
+    * Returns true if this is a map with a member.
+    *
+    * @param name the name of the member.
+    *
+    * @return true if the member exists, false if not.
+    */
+   virtual bool hasMember(const char* name) const;
+
+   /**
+    * Gets a member of a map.
+    *
+    * @param name the name of the member.
+    *
+    * @return the member, null if this is not a map or has no such member.
+    */
+   virtual MappedValue operator[](const char* name) const;
+
+   /**
+    * Gets the element of an array or the value of a member of a map at an
+    * index. The members of a map are sorted by name.
+    *
+    * @param index the index.
+    *
+    * @return the value, null if the index is out of range.
+    */
+   virtual MappedValue operator[](int index) const;
+
+   /**
+    * Gets the name of the member of a map at an index.
+    *
+    * @param index the index.
+    *
+    * @return the name, NULL if this is not a map or the index is out of
+    *         range.
+    */
+   virtual const char* getName(int index) const;
+
+   /**
+    * Decodes this value and everything in it into a new DynamicObject.
+    *
+    * @return the DynamicObject.
+    */
+   virtual monarch::rt::DynamicObject toDynamicObject() const;
+
+protected:
+   /**
+    * Gets the stored value.
+    *
+    * @param length the number of bytes of the value that will be read.
+    *
+    * @return the stored value or NULL if it is missing or does not fit.
+    */
+   virtual const unsigned char* getNode(uint32_t length) const;
+
+   /**
+    * Gets the stored type of this value.
+    *
+    * @return the stored type.
+    */
+   virtual int getNodeType() const;
+
+   /**
+    * Gets the stored map or array, checking that all of its entries fit.
+    *
+    * @param entrySize the number of uint32s per member or element.
+    *
+    * @return the stored map or array with all of its entries, NULL if this
+    *         is not a valid map or array.
+    */
+   virtual const unsigned char* getContainer(uint32_t entrySize) const;
+
+   /**
+    * Gets a value stored in this map or array. Children are always written
+    * before their container, so an offset that is not below the offset of
+    * this value is damaged (it could point at this value or one of its
+    * parents and never end) and gives a null value.
+    *
+    * @param offset the offset of the child.
+    *
+    * @return the child.
+    */
+   virtual MappedValue getChild(uint32_t offset) const;
+
+   /**
+    * Gets a key stored in this map, checked like a child value.
+    *
+    * @param offset the offset of the key.
+    *
+    * @return the key or NULL if it is damaged.
+    */
+   virtual const char* getKey(uint32_t offset) const;
+};
+
+} // end namespace mapped
+} // end namespace data
+} // end namespace monarch
+#endif
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/msgpack/MessagePackReader.h"
+
+#include "monarch/io/ByteArrayInputStream.h"
+#include "monarch/rt/Exception.h"
+#include "monarch/util/Base64Codec.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace monarch::data::msgpack;
+using namespace monarch::io;
+using namespace monarch::rt;
+using namespace monarch::util;
+
+unsigned int MessagePackReader::READ_SIZE = 4096;
+
+/**
+ * The largest string that fits in a read buffer.
+ */
+#define MAX_STRING_SIZE 0x7ffff000
+
+/**
+ * Gets the number of bytes of the type and fixed-size fields of a value.
+ *
+ * @param type the type byte of the value.
+ *
+ * @return the number of bytes, -1 for an unsupported type.
+ */
+static int _getHeaderSize(unsigned char type)
+{
+   int rval;
+
+   if(type <= 0xbf || type >= 0xe0)
+   {
+      // fixint, fixmap, fixarray or fixstr
+      rval = 1;
+   }
+   else
+   {
+      switch(type)
+      {
+         case 0xc0: // nil
+         case 0xc2: // false
+         case 0xc3: // true
+            rval = 1;
+            break;
+         case 0xc4: // bin 8
+         case 0xcc: // uint 8
+         case 0xd0: // int 8
+         case 0xd9: // str 8
+            rval = 2;
+            break;
+         case 0xc5: // bin 16
+         case 0xcd: // uint 16
+         case 0xd1: // int 16
+         case 0xda: // str 16
+         case 0xdc: // array 16
+         case 0xde: // map 16
+            rval = 3;
+            break;
+         case 0xc6: // bin 32
+         case 0xca: // float 32
+         case 0xce: // uint 32
+         case 0xd2: // int 32
+         case 0xdb: // str 32
+         case 0xdd: // array 32
+         case 0xdf: // map 32
+            rval = 5;
+            break;
+         case 0xcb: // float 64
+         case 0xcf: // uint 64
+         case 0xd3: // int 64
+            rval = 9;
+            break;
+         default:
+            // never used or extension types
+            rval = -1;
+            break;
+      }
+   }
+
+   return rval;
+}
+
+/**
+ * Reads an unsigned integer in big-endian byte order.
+ *
+ * @param data the bytes to read.
+ * @param bytes the number of bytes to read.
+ *
+ * @return the value.
+ */
+static uint64_t _getBigEndian(const unsigned char* data, int bytes)
+{
+   uint64_t rval = 0;
+   for(int i = 0; i < bytes; ++i)
+   {
+      rval = (rval << 8) | data[i];
+   }
+   return rval;
+}
+
+/**
+ * Returns true if a type byte is for a string.
+ *
+ * @param type the type byte.
+ *
+ * @return true for a string, false if not.
+ */
+static bool _isString(unsigned char type)
+{
+   return
+      (type >= 0xa0 && type <= 0xbf) ||
+      (type >= 0xd9 && type <= 0xdb);
+}
+
+/**
+ * Returns true if a type byte is for binary data.
+ *
+ * @param type the type byte.
+ *
+ * @return true for binary data, false if not.
+ */
+static bool _isBinary(unsigned char type)
+{
+   return type >= 0xc4 && type <= 0xc6;
+}
+
+MessagePackReader::MessagePackReader() :
+   mStarted(false),
+   mDone(false),
+   mTarget(NULL),
+   mBuffer(0),
+   mNeeded(0),
+   mPosition(0)
+{
+}
+
+MessagePackReader::~MessagePackReader()
+{
+}
+
+bool MessagePackReader::start(DynamicObject& dyno)
+{
+   mTarget = &dyno;
+   mStarted = true;
+   mDone = false;
+   mStack.clear();
+   mBuffer.clear();
+   mNeeded = 0;
+   mPosition = 0;
+   return true;
+}
+
+bool MessagePackReader::read(InputStream* is)
+{
+   bool rval = true;
+
+   if(!mStarted)
+   {
+      // reader not started
+      ExceptionRef e = new Exception(
+         "Cannot read yet, MessagePackReader not started.",
+         "monarch.data.msgpack.MessagePackReader.NotStarted");
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      int numBytes = 1;
+      while(rval && numBytes > 0)
+      {
+         // read at least the rest of a partly read value, leaving a spare
+         // byte after the data for process()
+         int size = mNeeded - mBuffer.length();
+         size = (size > (int)READ_SIZE) ? size : (int)READ_SIZE;
+         mBuffer.allocateSpace(size + 1, true);
+         numBytes = mBuffer.put(is, size);
+         if(numBytes > 0)
+         {
+            rval = process();
+         }
+      }
+      if(numBytes == -1)
+      {
+         // input stream read error
+         rval = false;
+      }
+   }
+
+   return rval;
+}
+
+bool MessagePackReader::finish()
+{
+   bool rval = mDone;
+
+   if(!rval)
+   {
+      ExceptionRef e = new Exception(
+         (mPosition == 0 && mBuffer.isEmpty()) ?
+            "No MessagePack value found." :
+            "Incomplete MessagePack value.",
+         "monarch.data.msgpack.MessagePackReader.ParseError");
+      e->getDetails()["position"] = mPosition;
+      Exception::set(e);
+   }
+
+   // no longer started
+   mStarted = false;
+   mStack.clear();
+   mBuffer.clear();
+
+   return rval;
+}
+
+bool MessagePackReader::readFromString(
+   DynamicObject& dyno, const char* data, int length)
+{
+   ByteArrayInputStream is(data, length);
+   MessagePackReader reader;
+   return reader.start(dyno) && reader.read(&is) && reader.finish();
+}
+
+bool MessagePackReader::process()
+{
+   bool rval = true;
+
+   unsigned char* data = mBuffer.udata();
+   int length = mBuffer.length();
+   int pos = 0;
+   bool more = true;
+   while(rval && more && pos < length)
+   {
+      unsigned char type = data[pos];
+      int header = _getHeaderSize(type);
+      if(mDone)
+      {
+         setParseError(
+            "Data after the end of the MessagePack value.",
+            "monarch.data.msgpack.MessagePackReader.ExtraData", type);
+         rval = false;
+      }
+      else if(header == -1)
+      {
+         setParseError(
+            "Unsupported MessagePack type.",
+            "monarch.data.msgpack.MessagePackReader.InvalidType", type);
+         rval = false;
+      }
+      else if(pos + header > length)
+      {
+         // wait for the rest of the header
+         mNeeded = header;
+         more = false;
+      }
+      else
+      {
+         // get the fixed-size field and the size of any string or binary
+         // data
+         uint64_t field = _getBigEndian(data + pos + 1, header - 1);
+         uint64_t size = 0;
+         if(_isString(type) || _isBinary(type))
+         {
+            size = (header == 1) ? (type & 0x1f) : field;
+         }
+
+         if(size > MAX_STRING_SIZE)
+         {
+            setParseError(
+               "MessagePack string too large.",
+               "monarch.data.msgpack.MessagePackReader.InvalidLength", type);
+            rval = false;
+         }
+         else if(pos + header + size > (uint64_t)length)
+         {
+            // wait for the rest of the string
+            mNeeded = header + size;
+            more = false;
+         }
+         else
+         {
+            // find where the value goes
+            Container* parent = mStack.empty() ? NULL : &mStack.back();
+            DynamicObject* slot = NULL;
+            bool key = false;
+            if(parent == NULL)
+            {
+               *mTarget = DynamicObject();
+               slot = mTarget;
+            }
+            else if(!parent->isMap)
+            {
+               slot = &parent->dyno->append();
+            }
+            else if(parent->remaining % 2 == 0)
+            {
+               key = true;
+            }
+            else
+            {
+               slot = parent->member;
+            }
+            if(parent != NULL)
+            {
+               --parent->remaining;
+            }
+
+            if(_isString(type))
+            {
+               // terminate the string in the buffer to copy it directly,
+               // there is always a byte after the data to use for this
+               char* str = (char*)data + pos + header;
+               char next = str[size];
+               str[size] = '\0';
+               if(key)
+               {
+                  parent->member = &parent->dyno[str];
+               }
+               else
+               {
+                  *slot = str;
+               }
+               str[size] = next;
+            }
+            else if(key)
+            {
+               setParseError(
+                  "MessagePack map key is not a string.",
+                  "monarch.data.msgpack.MessagePackReader.InvalidKey", type);
+               rval = false;
+            }
+            else if(_isBinary(type))
+            {
+               // binary data may contain NULs, so keep its length and its
+               // bytes in base64
+               const char* bytes = (const char*)data + pos + header;
+               (*slot)->setType(Map);
+               (*slot)["length"] = (uint32_t)size;
+               (*slot)["base64"] = Base64Codec::encode(bytes, size).c_str();
+            }
+            else if(type <= 0x7f || type >= 0xe0)
+            {
+               // positive or negative fixint
+               *slot = (int32_t)(int8_t)type;
+            }
+            else if(type <= 0x9f || type >= 0xdc)
+            {
+               // map or array
+               bool isMap = (type <= 0x8f || type >= 0xde);
+               uint64_t count = (header == 1) ? (type & 0x0f) : field;
+               (*slot)->setType(isMap ? Map : Array);
+               if(count > 0)
+               {
+                  Container c;
+                  c.dyno = *slot;
+                  c.remaining = isMap ? count * 2 : count;
+                  c.isMap = isMap;
+                  c.member = NULL;
+                  mStack.push_back(c);
+               }
+            }
+            else
+            {
+               switch(type)
+               {
+                  case 0xc0:
+                     slot->setNull();
+                     break;
+                  case 0xc2:
+                  case 0xc3:
+                     *slot = (type == 0xc3);
+                     break;
+                  case 0xca:
+                  {
+                     uint32_t bits = field;
+                     float f;
+                     memcpy(&f, &bits, 4);
+                     *slot = (double)f;
+                     break;
+                  }
+                  case 0xcb:
+                  {
+                     double d;
+                     memcpy(&d, &field, 8);
+                     *slot = d;
+                     break;
+                  }
+                  case 0xcc:
+                  case 0xcd:
+                  case 0xce:
+                     *slot = (uint32_t)field;
+                     break;
+                  case 0xcf:
+                     *slot = (uint64_t)field;
+                     break;
+                  case 0xd0:
+                     *slot = (int32_t)(int8_t)field;
+                     break;
+                  case 0xd1:
+                     *slot = (int32_t)(int16_t)field;
+                     break;
+                  case 0xd2:
+                     *slot = (int32_t)field;
+                     break;
+                  case 0xd3:
+                     *slot = (int64_t)field;
+                     break;
+               }
+            }
+
+            if(rval)
+            {
+               // close the maps and arrays that are complete
+               while(!mStack.empty() && mStack.back().remaining == 0)
+               {
+                  mStack.pop_back();
+               }
+               mDone = mStack.empty();
+               pos += header + size;
+               mPosition += header + size;
+               mNeeded = 0;
+            }
+         }
+      }
+   }
+
+   // remove the parsed values
+   mBuffer.clear(pos);
+
+   return rval;
+}
+
+void MessagePackReader::setParseError(
+   const char* msg, const char* type, unsigned char byte)
+{
+   ExceptionRef e = new Exception(msg, type);
+   e->getDetails()["position"] = mPosition;
+   e->getDetails()["type"] = (uint32_t)byte;
+   Exception::set(e);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_msgpack_MessagePackReader_H
+#define monarch_data_msgpack_MessagePackReader_H
+
+#include "monarch/data/DynamicObjectReader.h"
+#include "monarch/io/ByteBuffer.h"
+
+#include <vector>
+
+namespace monarch
+{
+namespace data
+{
+namespace msgpack
+{
+
+/**
+ * A MessagePackReader deserializes DynamicObjects from MessagePack (see
+ * MessagePackWriter).
+ *
+ * Numbers get the type their encoding has room for: fixint, int 8, int 16
+ * and int 32 are read as Int32, uint 8, uint 16 and uint 32 as UInt32,
+ * int 64 as Int64, uint 64 as UInt64 and floats as Double, so the types
+ * written by a MessagePackWriter are kept. Strings are read as Strings.
+ * Binary data may contain NULs, which a String cannot hold, so it is read as
+ * a Map with its "length" in bytes and the bytes in "base64". Map keys must
+ * be strings. Extension types are not supported.
+ *
+ * Every value starts with its type and, for strings, maps and arrays, its
+ * length, so input is parsed a whole value at a time: strings are copied
+ * straight from the read buffer into their DynamicObjects without being
+ * scanned or unescaped. Input may arrive in any number of read() calls, a
+ * value that is only partly read is kept until the rest arrives.
+ *
+ * @author Dave Longley
+ */
+class MessagePackReader : public DynamicObjectReader
+{
+protected:
+   /**
+    * A map or array being read.
+    */
+   struct Container
+   {
+      /**
+       * The map or array.
+       */
+      monarch::rt::DynamicObject dyno;
+
+      /**
+       * The number of values left to read, keys count as values.
+       */
+      uint64_t remaining;
+
+      /**
+       * True for a map, false for an array.
+       */
+      bool isMap;
+
+      /**
+       * The member for the value after the last key read.
+       */
+      monarch::rt::DynamicObject* member;
+   };
+
+   /**
+    * True if this reader has started, false if not.
+    */
+   bool mStarted;
+
+   /**
+    * True once the whole top-level value has been read.
+    */
+   bool mDone;
+
+   /**
+    * The target DynamicObject set from start().
+    */
+   monarch::rt::DynamicObject* mTarget;
+
+   /**
+    * The maps and arrays being read, innermost last.
+    */
+   std::vector<Container> mStack;
+
+   /**
+    * Input that has not been parsed yet.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
+   /**
+    * The number of bytes needed to parse the next value, 0 if unknown.
+    */
+   int mNeeded;
+
+   /**
+    * The number of bytes parsed, for errors.
+    */
+   uint64_t mPosition;
+
+   /**
+    * The read size in bytes.
+    */
+   static unsigned int READ_SIZE;
+
+public:
+   /**
+    * Creates a new MessagePackReader.
+    */
+   MessagePackReader();
+
+   /**
+    * Destructs this MessagePackReader.
+    */
+   virtual ~MessagePackReader();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool start(monarch::rt::DynamicObject& dyno);
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool read(monarch::io::InputStream* is);
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool finish();
+
+   /**
+    * Reads a DynamicObject from MessagePack in memory.
+    *
+    * @param dyno the DynamicObject to fill.
+    * @param data the MessagePack data.
+    * @param length the length of the data.
+    *
+    * @return true on success, false with exception set on failure.
+    */
+   static bool readFromString(
+      monarch::rt::DynamicObject& dyno, const char* data, int length);
+
+protected:
+   /**
+    * Parses as many whole values as there are in the buffer and removes
+    * them from it.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool process();
+
+   /**
+    * Sets a parse error.
+    *
+    * @param msg the message.
+    * @param type the exception type.
+    * @param byte the type byte of the value with the error.
+    */
+   virtual void setParseError(
+      const char* msg, const char* type, unsigned char byte);
+};
+
+} // end namespace msgpack
+} // end namespace data
+} // end namespace monarch
+#endif
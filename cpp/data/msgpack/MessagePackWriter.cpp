@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/data/msgpack/MessagePackWriter.h"
+
+#include "monarch/rt/DynamicObjectIterator.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace monarch::data::msgpack;
+using namespace monarch::io;
+using namespace monarch::rt;
+
+/**
+ * Writes an unsigned integer in big-endian byte order.
+ *
+ * @param out the place to write to.
+ * @param value the value to write.
+ * @param bytes the number of bytes to write.
+ */
+static void _putBigEndian(unsigned char* out, uint64_t value, int bytes)
+{
+   for(int i = bytes - 1; i >= 0; --i)
+   {
+      out[i] = (unsigned char)(value & 0xff);
+      value >>= 8;
+   }
+}
+
+MessagePackWriter::MessagePackWriter() :
+   mBuffer(0)
+{
+}
+
+MessagePackWriter::~MessagePackWriter()
+{
+}
+
+bool MessagePackWriter::write(DynamicObject& dyno, OutputStream* os)
+{
+   bool rval;
+
+   // serialize the whole object and write it out at once
+   mBuffer.clear();
+   serialize(dyno);
+   rval = os->write(mBuffer.data(), mBuffer.length());
+   mBuffer.clear();
+
+   return rval;
+}
+
+void MessagePackWriter::setIndentation(int level, int spaces)
+{
+}
+
+void MessagePackWriter::setCompact(bool compact)
+{
+}
+
+string MessagePackWriter::writeToString(DynamicObject dyno)
+{
+   MessagePackWriter writer;
+   writer.serialize(dyno);
+   return string(writer.mBuffer.data(), writer.mBuffer.length());
+}
+
+void MessagePackWriter::serialize(DynamicObject& dyno)
+{
+   if(dyno.isNull())
+   {
+      *reserve(1) = 0xc0;
+      mBuffer.extend(1);
+   }
+   else
+   {
+      switch(dyno->getType())
+      {
+         case String:
+         {
+            const char* str = dyno->getString();
+            serializeString(str, strlen(str));
+            break;
+         }
+         case Boolean:
+            *reserve(1) = dyno->getBoolean() ? 0xc3 : 0xc2;
+            mBuffer.extend(1);
+            break;
+         case Int32:
+         {
+            // use the smallest signed type
+            int32_t value = dyno->getInt32();
+            unsigned char* out = reserve(5);
+            if(value >= -32 && value <= 127)
+            {
+               // positive or negative fixint
+               out[0] = (unsigned char)value;
+               mBuffer.extend(1);
+            }
+            else if(value >= -128 && value <= 127)
+            {
+               out[0] = 0xd0;
+               out[1] = (unsigned char)value;
+               mBuffer.extend(2);
+            }
+            else if(value >= -32768 && value <= 32767)
+            {
+               out[0] = 0xd1;
+               _putBigEndian(out + 1, (uint16_t)value, 2);
+               mBuffer.extend(3);
+            }
+            else
+            {
+               out[0] = 0xd2;
+               _putBigEndian(out + 1, (uint32_t)value, 4);
+               mBuffer.extend(5);
+            }
+            break;
+         }
+         case UInt32:
+         {
+            // use the smallest unsigned type, never a fixint
+            uint32_t value = dyno->getUInt32();
+            unsigned char* out = reserve(5);
+            int bytes = (value <= 0xff) ? 1 : ((value <= 0xffff) ? 2 : 4);
+            out[0] = (bytes == 1) ? 0xcc : ((bytes == 2) ? 0xcd : 0xce);
+            _putBigEndian(out + 1, value, bytes);
+            mBuffer.extend(bytes + 1);
+            break;
+         }
+         case Int64:
+         {
+            unsigned char* out = reserve(9);
+            out[0] = 0xd3;
+            _putBigEndian(out + 1, (uint64_t)dyno->getInt64(), 8);
+            mBuffer.extend(9);
+            break;
+         }
+         case UInt64:
+         {
+            unsigned char* out = reserve(9);
+            out[0] = 0xcf;
+            _putBigEndian(out + 1, dyno->getUInt64(), 8);
+            mBuffer.extend(9);
+            break;
+         }
+         case Double:
+         {
+            double value = dyno->getDouble();
+            uint64_t bits;
+            memcpy(&bits, &value, 8);
+            unsigned char* out = reserve(9);
+            out[0] = 0xcb;
+            _putBigEndian(out + 1, bits, 8);
+            mBuffer.extend(9);
+            break;
+         }
+         case Map:
+         {
+            serializeLength(0x80, 0xde, dyno->length());
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               DynamicObject& next = i->next();
+               const char* name = i->getName();
+               serializeString(name, strlen(name));
+               serialize(next);
+            }
+            break;
+         }
+         case Array:
+         {
+            serializeLength(0x90, 0xdc, dyno->length());
+            DynamicObjectIterator i = dyno.getIterator();
+            while(i->hasNext())
+            {
+               serialize(i->next());
+            }
+            break;
+         }
+      }
+   }
+}
+
+void MessagePackWriter::serializeString(const char* str, uint32_t length)
+{
+   unsigned char* out = reserve(length + 5);
+   int header;
+   if(length < 32)
+   {
+      // fixstr
+      out[0] = 0xa0 | length;
+      header = 1;
+   }
+   else if(length <= 0xff)
+   {
+      out[0] = 0xd9;
+      out[1] = length;
+      header = 2;
+   }
+   else if(length <= 0xffff)
+   {
+      out[0] = 0xda;
+      _putBigEndian(out + 1, length, 2);
+      header = 3;
+   }
+   else
+   {
+      out[0] = 0xdb;
+      _putBigEndian(out + 1, length, 4);
+      header = 5;
+   }
+   memcpy(out + header, str, length);
+   mBuffer.extend(header + length);
+}
+
+void MessagePackWriter::serializeLength(
+   unsigned char fixed, unsigned char type16, uint32_t length)
+{
+   unsigned char* out = reserve(5);
+   if(length < 16)
+   {
+      out[0] = fixed | length;
+      mBuffer.extend(1);
+   }
+   else if(length <= 0xffff)
+   {
+      out[0] = type16;
+      _putBigEndian(out + 1, length, 2);
+      mBuffer.extend(3);
+   }
+   else
+   {
+      // the 32-bit type follows the 16-bit type
+      out[0] = type16 + 1;
+      _putBigEndian(out + 1, length, 4);
+      mBuffer.extend(5);
+   }
+}
+
+unsigned char* MessagePackWriter::reserve(int length)
+{
+   mBuffer.reserve(length);
+   return mBuffer.uend();
+}
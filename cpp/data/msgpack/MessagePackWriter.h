@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_data_msgpack_MessagePackWriter_H
+#define monarch_data_msgpack_MessagePackWriter_H
+
+#include "monarch/data/DynamicObjectWriter.h"
+#include "monarch/io/ByteBuffer.h"
+
+#include <string>
+
+namespace monarch
+{
+namespace data
+{
+namespace msgpack
+{
+
+/**
+ * A MessagePackWriter serializes DynamicObjects to MessagePack, a compact
+ * binary format (see http://msgpack.org).
+ *
+ * Unlike JSON, the type of each number is kept:
+ *
+ * Int32: the smallest of fixint, int 8, int 16 or int 32.
+ * UInt32: the smallest of uint 8, uint 16 or uint 32.
+ * Int64: int 64.
+ * UInt64: uint 64.
+ * Double: float 64.
+ *
+ * Strings are written with their length before them, so they can be read
+ * without scanning for their end or unescaping them. Map keys are strings.
+ *
+ * The whole object is serialized into a buffer owned by the writer and then
+ * written to the OutputStream at once. The buffer is kept between writes.
+ * There is no whitespace, so compact and indentation settings are ignored.
+ *
+ * @author Dave Longley
+ */
+class MessagePackWriter : public DynamicObjectWriter
+{
+protected:
+   /**
+    * The buffer to serialize into.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
+public:
+   /**
+    * Creates a new MessagePackWriter.
+    */
+   MessagePackWriter();
+
+   /**
+    * Destructs this MessagePackWriter.
+    */
+   virtual ~MessagePackWriter();
+
+   /**
+    * Serializes an object to MessagePack.
+    *
+    * @param dyno the DynamicObject to serialize.
+    * @param os the OutputStream to write the MessagePack to.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool write(
+      monarch::rt::DynamicObject& dyno, monarch::io::OutputStream* os);
+
+   /**
+    * Does nothing, MessagePack has no indentation.
+    *
+    * @param level the starting indentation level.
+    * @param spaces the number of spaces per indentation level.
+    */
+   virtual void setIndentation(int level, int spaces);
+
+   /**
+    * Does nothing, MessagePack is always compact.
+    *
+    * @param compact true to minimize whitespace, false not to.
+    */
+   virtual void setCompact(bool compact);
+
+   /**
+    * Writes a DynamicObject as MessagePack to a string.
+    *
+    * @param dyno the DynamicObject to write out.
+    *
+    * @return the string with MessagePack data.
+    */
+   static std::string writeToString(monarch::rt::DynamicObject dyno);
+
+protected:
+   /**
+    * Recursively serializes an object to MessagePack in the buffer.
+    *
+    * @param dyno the DynamicObject to serialize.
+    */
+   virtual void serialize(monarch::rt::DynamicObject& dyno);
+
+   /**
+    * Serializes a string in the buffer.
+    *
+    * @param str the string.
+    * @param length the length of the string.
+    */
+   virtual void serializeString(const char* str, uint32_t length);
+
+   /**
+    * Serializes the type byte and length of a map or array in the buffer.
+    *
+    * @param fixed the type byte for up to 15 entries.
+    * @param type16 the type byte for up to 65535 entries.
+    * @param length the number of entries.
+    */
+   virtual void serializeLength(
+      unsigned char fixed, unsigned char type16, uint32_t length);
+
+   /**
+    * Ensures the buffer has space for more bytes, growing it as needed.
+    *
+    * @param length the number of bytes needed.
+    *
+    * @return the end of the data in the buffer to write the bytes to.
+    */
+   virtual unsigned char* reserve(int length);
+};
+
+} // end namespace msgpack
+} // end namespace data
+} // end namespace monarch
+#endif
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HpackDecoder.h"
+
+#include "monarch/http/HpackHuffmanCodec.h"
+#include "monarch/rt/Exception.h"
+
+using namespace std;
+using namespace monarch::http;
+using namespace monarch::rt;
+
+#define EXCEPTION_COMPRESSION "monarch.http.Http2.CompressionError"
+
+// the per-field overhead used when computing the header list size
+#define FIELD_OVERHEAD   32
+
+HpackDecoder::HpackDecoder(uint32_t maxTableSize) :
+   mTable(maxTableSize),
+   mMaxTableSize(maxTableSize),
+   mMaxHeaderListSize(0)
+{
+}
+
+HpackDecoder::~HpackDecoder()
+{
+}
+
+/**
+ * Sets a compression error exception.
+ *
+ * @param msg the error message.
+ *
+ * @return false.
+ */
+static bool _setError(const char* msg)
+{
+   ExceptionRef e = new Exception(msg, EXCEPTION_COMPRESSION);
+   Exception::set(e);
+   return false;
+}
+
+bool HpackDecoder::decode(const char* data, int length, HpackHeaderList& fields)
+{
+   bool rval = true;
+
+   const unsigned char* b = (const unsigned char*)data;
+   const unsigned char* end = b + length;
+   bool fieldSeen = false;
+   uint32_t listSize = 0;
+   while(rval && b < end)
+   {
+      uint32_t index;
+      unsigned char c = *b;
+      if(c & 0x80)
+      {
+         // indexed header field
+         const string* name;
+         const string* value;
+         rval =
+            decodeInteger(b, end, 7, index) &&
+            (mTable.get(index, name, value) ||
+             _setError("Invalid HPACK header table index."));
+         if(rval)
+         {
+            fields.push_back(HpackHeaderField());
+            fields.back().name = *name;
+            fields.back().value = *value;
+         }
+         fieldSeen = true;
+      }
+      else if((c & 0xe0) == 0x20)
+      {
+         // dynamic table size update, only permitted before any fields
+         rval =
+            (!fieldSeen ||
+             _setError("HPACK table size update after header field.")) &&
+            decodeInteger(b, end, 5, index) &&
+            (index <= mMaxTableSize ||
+             _setError("HPACK table size update exceeds maximum."));
+         if(rval)
+         {
+            mTable.setMaxSize(index);
+         }
+      }
+      else
+      {
+         // literal header field: with incremental indexing (01), without
+         // indexing (0000), or never indexed (0001)
+         bool indexing = ((c & 0xc0) == 0x40);
+         rval = decodeInteger(b, end, indexing ? 6 : 4, index);
+         if(rval)
+         {
+            fields.push_back(HpackHeaderField());
+            HpackHeaderField& field = fields.back();
+            if(index == 0)
+            {
+               // new name
+               rval = decodeString(b, end, field.name);
+            }
+            else
+            {
+               // indexed name
+               const string* name;
+               const string* value;
+               rval =
+                  mTable.get(index, name, value) ||
+                  _setError("Invalid HPACK header table index.");
+               if(rval)
+               {
+                  field.name = *name;
+               }
+            }
+
+            rval = rval && decodeString(b, end, field.value);
+            if(rval && indexing)
+            {
+               mTable.add(field.name, field.value);
+            }
+         }
+         fieldSeen = true;
+      }
+
+      // enforce the header list size limit
+      if(rval && fieldSeen && mMaxHeaderListSize > 0)
+      {
+         HpackHeaderField& field = fields.back();
+         listSize +=
+            field.name.length() + field.value.length() + FIELD_OVERHEAD;
+         if(listSize > mMaxHeaderListSize)
+         {
+            ExceptionRef e = new Exception(
+               "HTTP/2 header list too large.",
+               "monarch.http.Http2.HeaderListTooLarge");
+            e->getDetails()["maxSize"] = mMaxHeaderListSize;
+            Exception::set(e);
+            rval = false;
+         }
+      }
+   }
+
+   return rval;
+}
+
+void HpackDecoder::setMaxHeaderListSize(uint32_t size)
+{
+   mMaxHeaderListSize = size;
+}
+
+HpackHeaderTable& HpackDecoder::getTable()
+{
+   return mTable;
+}
+
+bool HpackDecoder::decodeInteger(
+   const unsigned char*& b, const unsigned char* end,
+   int prefix, uint32_t& value)
+{
+   bool rval = (b < end);
+   if(rval)
+   {
+      uint32_t max = (1 << prefix) - 1;
+      value = *(b++) & max;
+      if(value == max)
+      {
+         // multi-byte integer, 7 bits per continuation byte
+         uint64_t v = value;
+         int shift = 0;
+         bool more = true;
+         while(rval && more)
+         {
+            if(b == end || shift > 28)
+            {
+               rval = false;
+            }
+            else
+            {
+               v += (uint64_t)(*b & 0x7f) << shift;
+               more = ((*(b++) & 0x80) != 0);
+               shift += 7;
+               rval = (v <= 0xffffffff);
+            }
+         }
+         value = (uint32_t)v;
+      }
+   }
+
+   if(!rval)
+   {
+      _setError("Invalid HPACK integer.");
+   }
+
+   return rval;
+}
+
+bool HpackDecoder::decodeString(
+   const unsigned char*& b, const unsigned char* end, string& str)
+{
+   bool rval = (b < end);
+   if(rval)
+   {
+      bool huffman = ((*b & 0x80) != 0);
+      uint32_t length;
+      rval =
+         decodeInteger(b, end, 7, length) &&
+         (length <= (uint32_t)(end - b) ||
+          _setError("Truncated HPACK string literal."));
+      if(rval)
+      {
+         if(huffman)
+         {
+            str.reserve(length + (length >> 1));
+            rval =
+               HpackHuffmanCodec::decode((const char*)b, length, str) ||
+               _setError("Invalid HPACK Huffman encoded string.");
+         }
+         else
+         {
+            str.assign((const char*)b, length);
+         }
+         b += length;
+      }
+   }
+   else
+   {
+      _setError("Truncated HPACK string literal.");
+   }
+
+   return rval;
+}
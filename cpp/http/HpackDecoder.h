@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HpackDecoder_H
+#define monarch_http_HpackDecoder_H
+
+#include "monarch/http/HpackHeaderTable.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HpackDecoder decompresses HTTP/2 header blocks that were compressed
+ * using HPACK (RFC 7541).
+ *
+ * An HpackDecoder holds the decoding context for one direction of one
+ * HTTP/2 connection, so header blocks must be decoded in the order they
+ * were received. It is not thread-safe.
+ *
+ * @author Dave Longley
+ */
+class HpackDecoder
+{
+protected:
+   /**
+    * The header table.
+    */
+   HpackHeaderTable mTable;
+
+   /**
+    * The maximum dynamic table size the encoder is permitted to use (the
+    * value advertised via SETTINGS_HEADER_TABLE_SIZE).
+    */
+   uint32_t mMaxTableSize;
+
+   /**
+    * The maximum size of a decoded header list, 0 for no limit.
+    */
+   uint32_t mMaxHeaderListSize;
+
+public:
+   /**
+    * Creates a new HpackDecoder.
+    *
+    * @param maxTableSize the maximum dynamic table size.
+    */
+   HpackDecoder(uint32_t maxTableSize = 4096);
+
+   /**
+    * Destructs this HpackDecoder.
+    */
+   virtual ~HpackDecoder();
+
+   /**
+    * Decodes a complete header block, appending its fields to the passed
+    * list. Any error is a connection-level COMPRESSION_ERROR because the
+    * decoding context can no longer be trusted.
+    *
+    * @param data the header block.
+    * @param length the length of the header block.
+    * @param fields the list to append the decoded fields to.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool decode(const char* data, int length, HpackHeaderList& fields);
+
+   /**
+    * Sets the maximum size of a decoded header list (the sum of the name
+    * and value lengths of all fields plus 32 octets per field).
+    *
+    * @param size the maximum header list size, 0 for no limit.
+    */
+   virtual void setMaxHeaderListSize(uint32_t size);
+
+   /**
+    * Gets the header table used by this decoder.
+    *
+    * @return the header table.
+    */
+   virtual HpackHeaderTable& getTable();
+
+   /**
+    * Decodes an HPACK integer with the given prefix size.
+    *
+    * @param b the current position in the data, updated on return.
+    * @param end the end of the data.
+    * @param prefix the number of bits in the prefix (1-8).
+    * @param value set to the decoded integer.
+    *
+    * @return true if successful, false if the data was truncated or the
+    *         integer overflowed.
+    */
+   static bool decodeInteger(
+      const unsigned char*& b, const unsigned char* end,
+      int prefix, uint32_t& value);
+
+protected:
+   /**
+    * Decodes an HPACK string literal.
+    *
+    * @param b the current position in the data, updated on return.
+    * @param end the end of the data.
+    * @param str set to the decoded string.
+    *
+    * @return true if successful, false if not.
+    */
+   virtual bool decodeString(
+      const unsigned char*& b, const unsigned char* end, std::string& str);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
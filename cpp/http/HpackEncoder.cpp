@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HpackEncoder.h"
+
+#include "monarch/http/HpackHuffmanCodec.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace monarch::http;
+
+HpackEncoder::HpackEncoder(uint32_t maxTableSizeLimit) :
+   mTable(maxTableSizeLimit),
+   mMaxTableSizeLimit(maxTableSizeLimit),
+   mTableSizeChanged(false),
+   mMinTableSize(maxTableSizeLimit)
+{
+}
+
+HpackEncoder::~HpackEncoder()
+{
+}
+
+void HpackEncoder::setMaxTableSize(uint32_t size)
+{
+   size = min(size, mMaxTableSizeLimit);
+   if(size != mTable.getMaxSize())
+   {
+      mMinTableSize = mTableSizeChanged ? min(mMinTableSize, size) : size;
+      mTable.setMaxSize(size);
+      mTableSizeChanged = true;
+   }
+}
+
+void HpackEncoder::encode(HpackHeaderList& fields, string& out)
+{
+   // signal any table size change at the start of the block
+   if(mTableSizeChanged)
+   {
+      if(mMinTableSize < mTable.getMaxSize())
+      {
+         encodeInteger(mMinTableSize, 5, 0x20, out);
+      }
+      encodeInteger(mTable.getMaxSize(), 5, 0x20, out);
+      mTableSizeChanged = false;
+   }
+
+   for(HpackHeaderList::iterator i = fields.begin(); i != fields.end(); ++i)
+   {
+      encodeField(*i, out);
+   }
+}
+
+HpackHeaderTable& HpackEncoder::getTable()
+{
+   return mTable;
+}
+
+void HpackEncoder::encodeInteger(
+   uint32_t value, int prefix, unsigned char flags, string& out)
+{
+   uint32_t max = (1 << prefix) - 1;
+   if(value < max)
+   {
+      out.push_back((char)(flags | value));
+   }
+   else
+   {
+      out.push_back((char)(flags | max));
+      value -= max;
+      while(value >= 0x80)
+      {
+         out.push_back((char)((value & 0x7f) | 0x80));
+         value >>= 7;
+      }
+      out.push_back((char)value);
+   }
+}
+
+/**
+ * Returns true if the given field should never be indexed because it
+ * carries credentials.
+ *
+ * @param name the name of the field.
+ *
+ * @return true if the field is sensitive.
+ */
+static bool _isSensitive(const string& name)
+{
+   return
+      name == "authorization" ||
+      name == "proxy-authorization" ||
+      name == "set-cookie";
+}
+
+void HpackEncoder::encodeField(HpackHeaderField& field, string& out)
+{
+   bool valueMatched;
+   uint32_t index = mTable.find(field.name, field.value, valueMatched);
+   if(valueMatched)
+   {
+      // indexed header field
+      encodeInteger(index, 7, 0x80, out);
+   }
+   else if(_isSensitive(field.name))
+   {
+      // literal header field never indexed
+      encodeInteger(index, 4, 0x10, out);
+      if(index == 0)
+      {
+         encodeString(field.name, out);
+      }
+      encodeString(field.value, out);
+   }
+   else
+   {
+      // literal header field with incremental indexing
+      encodeInteger(index, 6, 0x40, out);
+      if(index == 0)
+      {
+         encodeString(field.name, out);
+      }
+      encodeString(field.value, out);
+      mTable.add(field.name, field.value);
+   }
+}
+
+void HpackEncoder::encodeString(const string& str, string& out)
+{
+   int length = HpackHuffmanCodec::getEncodedLength(str.data(), str.length());
+   if(length < (int)str.length())
+   {
+      encodeInteger(length, 7, 0x80, out);
+      HpackHuffmanCodec::encode(str.data(), str.length(), out);
+   }
+   else
+   {
+      encodeInteger(str.length(), 7, 0x00, out);
+      out.append(str);
+   }
+}
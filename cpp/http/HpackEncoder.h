@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HpackEncoder_H
+#define monarch_http_HpackEncoder_H
+
+#include "monarch/http/HpackHeaderTable.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HpackEncoder compresses HTTP/2 header blocks using HPACK (RFC 7541).
+ *
+ * Fields are emitted as indexed fields when the header table contains an
+ * exact match and otherwise as literals with incremental indexing (reusing
+ * an indexed name where possible). Fields that carry credentials are never
+ * indexed so they cannot be probed via the compression context. String
+ * literals are Huffman encoded whenever that makes them shorter.
+ *
+ * An HpackEncoder holds the encoding context for one direction of one
+ * HTTP/2 connection, so header blocks must be sent in the order they were
+ * encoded. It is not thread-safe.
+ *
+ * @author Dave Longley
+ */
+class HpackEncoder
+{
+protected:
+   /**
+    * The header table.
+    */
+   HpackHeaderTable mTable;
+
+   /**
+    * The largest dynamic table size this encoder will use, regardless of
+    * what the decoder permits.
+    */
+   uint32_t mMaxTableSizeLimit;
+
+   /**
+    * Set to true when the table size has changed and a dynamic table size
+    * update must be sent at the start of the next header block.
+    */
+   bool mTableSizeChanged;
+
+   /**
+    * The smallest table size set since the last header block, which must
+    * be signaled before the final size if it is smaller.
+    */
+   uint32_t mMinTableSize;
+
+public:
+   /**
+    * Creates a new HpackEncoder.
+    *
+    * @param maxTableSizeLimit the largest dynamic table size to use.
+    */
+   HpackEncoder(uint32_t maxTableSizeLimit = 4096);
+
+   /**
+    * Destructs this HpackEncoder.
+    */
+   virtual ~HpackEncoder();
+
+   /**
+    * Sets the maximum dynamic table size permitted by the decoder (the
+    * peer's SETTINGS_HEADER_TABLE_SIZE). The encoder will use the smaller
+    * of this size and its own limit.
+    *
+    * @param size the maximum dynamic table size permitted by the decoder.
+    */
+   virtual void setMaxTableSize(uint32_t size);
+
+   /**
+    * Encodes a complete header block, appending it to the passed string.
+    *
+    * @param fields the fields to encode, names must be lowercase.
+    * @param out the string to append the header block to.
+    */
+   virtual void encode(HpackHeaderList& fields, std::string& out);
+
+   /**
+    * Gets the header table used by this encoder.
+    *
+    * @return the header table.
+    */
+   virtual HpackHeaderTable& getTable();
+
+   /**
+    * Encodes an HPACK integer with the given prefix size.
+    *
+    * @param value the integer to encode.
+    * @param prefix the number of bits in the prefix (1-8).
+    * @param flags the bits to set above the prefix in the first byte.
+    * @param out the string to append the encoded integer to.
+    */
+   static void encodeInteger(
+      uint32_t value, int prefix, unsigned char flags, std::string& out);
+
+protected:
+   /**
+    * Encodes a single field.
+    *
+    * @param field the field to encode.
+    * @param out the string to append the encoded field to.
+    */
+   virtual void encodeField(HpackHeaderField& field, std::string& out);
+
+   /**
+    * Encodes an HPACK string literal.
+    *
+    * @param str the string to encode.
+    * @param out the string to append the encoded string to.
+    */
+   virtual void encodeString(const std::string& str, std::string& out);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HpackHeaderTable.h"
+
+using namespace std;
+using namespace monarch::http;
+
+// the per-entry overhead used when computing the dynamic table size
+#define ENTRY_OVERHEAD   32
+
+// the HPACK static table (RFC 7541, Appendix A)
+static const HpackHeaderField sStaticTable[] =
+{
+   {":authority", ""},
+   {":method", "GET"},
+   {":method", "POST"},
+   {":path", "/"},
+   {":path", "/index.html"},
+   {":scheme", "http"},
+   {":scheme", "https"},
+   {":status", "200"},
+   {":status", "204"},
+   {":status", "206"},
+   {":status", "304"},
+   {":status", "400"},
+   {":status", "404"},
+   {":status", "500"},
+   {"accept-charset", ""},
+   {"accept-encoding", "gzip, deflate"},
+   {"accept-language", ""},
+   {"accept-ranges", ""},
+   {"accept", ""},
+   {"access-control-allow-origin", ""},
+   {"age", ""},
+   {"allow", ""},
+   {"authorization", ""},
+   {"cache-control", ""},
+   {"content-disposition", ""},
+   {"content-encoding", ""},
+   {"content-language", ""},
+   {"content-length", ""},
+   {"content-location", ""},
+   {"content-range", ""},
+   {"content-type", ""},
+   {"cookie", ""},
+   {"date", ""},
+   {"etag", ""},
+   {"expect", ""},
+   {"expires", ""},
+   {"from", ""},
+   {"host", ""},
+   {"if-match", ""},
+   {"if-modified-since", ""},
+   {"if-none-match", ""},
+   {"if-range", ""},
+   {"if-unmodified-since", ""},
+   {"last-modified", ""},
+   {"link", ""},
+   {"location", ""},
+   {"max-forwards", ""},
+   {"proxy-authenticate", ""},
+   {"proxy-authorization", ""},
+   {"range", ""},
+   {"referer", ""},
+   {"refresh", ""},
+   {"retry-after", ""},
+   {"server", ""},
+   {"set-cookie", ""},
+   {"strict-transport-security", ""},
+   {"transfer-encoding", ""},
+   {"user-agent", ""},
+   {"vary", ""},
+   {"via", ""},
+   {"www-authenticate", ""}
+};
+
+const uint32_t HpackHeaderTable::sStaticTableLength = 61;
+
+HpackHeaderTable::HpackHeaderTable(uint32_t maxSize) :
+   mSize(0),
+   mMaxSize(maxSize)
+{
+}
+
+HpackHeaderTable::~HpackHeaderTable()
+{
+}
+
+bool HpackHeaderTable::get(
+   uint32_t index, const string*& name, const string*& value)
+{
+   bool rval = true;
+
+   if(index > 0 && index <= sStaticTableLength)
+   {
+      name = &sStaticTable[index - 1].name;
+      value = &sStaticTable[index - 1].value;
+   }
+   else if(index > sStaticTableLength &&
+      index - sStaticTableLength <= mEntries.size())
+   {
+      HpackHeaderField& field = mEntries[index - sStaticTableLength - 1];
+      name = &field.name;
+      value = &field.value;
+   }
+   else
+   {
+      rval = false;
+   }
+
+   return rval;
+}
+
+void HpackHeaderTable::add(const string& name, const string& value)
+{
+   uint32_t size = name.length() + value.length() + ENTRY_OVERHEAD;
+   if(size > mMaxSize)
+   {
+      // entry too large, table is emptied
+      evict(0);
+   }
+   else
+   {
+      // make room and add the new entry at the front
+      evict(mMaxSize - size);
+      mEntries.push_front(HpackHeaderField());
+      mEntries.front().name = name;
+      mEntries.front().value = value;
+      mSize += size;
+   }
+}
+
+uint32_t HpackHeaderTable::find(
+   const string& name, const string& value, bool& valueMatched)
+{
+   uint32_t rval = 0;
+   valueMatched = false;
+
+   // search the static table
+   for(uint32_t i = 0; !valueMatched && i < sStaticTableLength; ++i)
+   {
+      if(sStaticTable[i].name == name)
+      {
+         if(sStaticTable[i].value == value)
+         {
+            rval = i + 1;
+            valueMatched = true;
+         }
+         else if(rval == 0)
+         {
+            rval = i + 1;
+         }
+      }
+   }
+
+   // search the dynamic table
+   uint32_t index = sStaticTableLength + 1;
+   for(EntryList::iterator i = mEntries.begin();
+       !valueMatched && i != mEntries.end(); ++i, ++index)
+   {
+      if(i->name == name)
+      {
+         if(i->value == value)
+         {
+            rval = index;
+            valueMatched = true;
+         }
+         else if(rval == 0)
+         {
+            rval = index;
+         }
+      }
+   }
+
+   return rval;
+}
+
+void HpackHeaderTable::setMaxSize(uint32_t size)
+{
+   mMaxSize = size;
+   evict(size);
+}
+
+uint32_t HpackHeaderTable::getMaxSize()
+{
+   return mMaxSize;
+}
+
+uint32_t HpackHeaderTable::getSize()
+{
+   return mSize;
+}
+
+uint32_t HpackHeaderTable::getLength()
+{
+   return mEntries.size();
+}
+
+void HpackHeaderTable::evict(uint32_t size)
+{
+   while(mSize > size && !mEntries.empty())
+   {
+      HpackHeaderField& field = mEntries.back();
+      mSize -= field.name.length() + field.value.length() + ENTRY_OVERHEAD;
+      mEntries.pop_back();
+   }
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HpackHeaderTable_H
+#define monarch_http_HpackHeaderTable_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HpackHeaderField is a single name/value pair in an HPACK header list.
+ */
+struct HpackHeaderField
+{
+   std::string name;
+   std::string value;
+};
+
+/**
+ * A list of HpackHeaderFields, in the order they appear in a header block.
+ */
+typedef std::vector<HpackHeaderField> HpackHeaderList;
+
+/**
+ * An HpackHeaderTable is the combined static and dynamic index table used
+ * by HPACK (RFC 7541) to compress HTTP/2 header fields.
+ *
+ * Indexes start at 1. The first 61 indexes refer to the static table and
+ * the remaining indexes refer to the dynamic table, newest entry first. The
+ * dynamic table evicts its oldest entries whenever an insertion or a size
+ * change would exceed its maximum size. The size of each entry is the
+ * length of its name and value plus 32 octets of overhead.
+ *
+ * An HpackHeaderTable is not thread-safe, each HPACK encoder and decoder
+ * owns its own table.
+ *
+ * @author Dave Longley
+ */
+class HpackHeaderTable
+{
+public:
+   /**
+    * The number of entries in the static table.
+    */
+   static const uint32_t sStaticTableLength;
+
+protected:
+   /**
+    * The dynamic table entries, newest first.
+    */
+   typedef std::deque<HpackHeaderField> EntryList;
+   EntryList mEntries;
+
+   /**
+    * The current size of the dynamic table.
+    */
+   uint32_t mSize;
+
+   /**
+    * The maximum size of the dynamic table.
+    */
+   uint32_t mMaxSize;
+
+public:
+   /**
+    * Creates a new HpackHeaderTable.
+    *
+    * @param maxSize the maximum size of the dynamic table.
+    */
+   HpackHeaderTable(uint32_t maxSize = 4096);
+
+   /**
+    * Destructs this HpackHeaderTable.
+    */
+   virtual ~HpackHeaderTable();
+
+   /**
+    * Gets the entry at the given index.
+    *
+    * @param index the index of the entry (1-based).
+    * @param name set to the name of the entry.
+    * @param value set to the value of the entry.
+    *
+    * @return true if the entry exists, false if the index is invalid.
+    */
+   virtual bool get(
+      uint32_t index, const std::string*& name, const std::string*& value);
+
+   /**
+    * Adds an entry to the dynamic table, evicting old entries as necessary.
+    * An entry that is larger than the maximum size empties the table and is
+    * not added.
+    *
+    * @param name the name of the entry.
+    * @param value the value of the entry.
+    */
+   virtual void add(const std::string& name, const std::string& value);
+
+   /**
+    * Finds the best matching entry for the given field. An entry that
+    * matches both name and value is preferred over one that only matches
+    * the name.
+    *
+    * @param name the name to find.
+    * @param value the value to find.
+    * @param valueMatched set to true if the returned entry matched the value.
+    *
+    * @return the index of the matching entry, 0 if none matched.
+    */
+   virtual uint32_t find(
+      const std::string& name, const std::string& value, bool& valueMatched);
+
+   /**
+    * Sets the maximum size of the dynamic table, evicting old entries as
+    * necessary.
+    *
+    * @param size the new maximum size.
+    */
+   virtual void setMaxSize(uint32_t size);
+
+   /**
+    * Gets the maximum size of the dynamic table.
+    *
+    * @return the maximum size of the dynamic table.
+    */
+   virtual uint32_t getMaxSize();
+
+   /**
+    * Gets the current size of the dynamic table.
+    *
+    * @return the current size of the dynamic table.
+    */
+   virtual uint32_t getSize();
+
+   /**
+    * Gets the number of entries in the dynamic table.
+    *
+    * @return the number of entries in the dynamic table.
+    */
+   virtual uint32_t getLength();
+
+protected:
+   /**
+    * Evicts the oldest entries until the table size is at most the given
+    * size.
+    *
+    * @param size the size to evict down to.
+    */
+   virtual void evict(uint32_t size);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HpackHuffmanCodec_H
+#define monarch_http_HpackHuffmanCodec_H
+
+#include <string>
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HpackHuffmanCodec encodes and decodes strings using the static Huffman
+ * code defined for HPACK (RFC 7541, Appendix B).
+ *
+ * @author Dave Longley
+ */
+class HpackHuffmanCodec
+{
+public:
+   /**
+    * Gets the number of bytes the passed data will occupy once Huffman
+    * encoded, including any padding.
+    *
+    * @param data the data to measure.
+    * @param length the length of the data.
+    *
+    * @return the encoded length in bytes.
+    */
+   static int getEncodedLength(const char* data, int length);
+
+   /**
+    * Huffman encodes the passed data and appends it to the passed string.
+    *
+    * @param data the data to encode.
+    * @param length the length of the data.
+    * @param out the string to append the encoded data to.
+    */
+   static void encode(const char* data, int length, std::string& out);
+
+   /**
+    * Decodes the passed Huffman encoded data and appends it to the passed
+    * string. The data must end with valid padding (at most 7 bits of the
+    * most significant bits of the EOS code) and must not contain EOS.
+    *
+    * @param data the data to decode.
+    * @param length the length of the data.
+    * @param out the string to append the decoded data to.
+    *
+    * @return true if successful, false if the data was not valid (with no
+    *         exception set).
+    */
+   static bool decode(const char* data, int length, std::string& out);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
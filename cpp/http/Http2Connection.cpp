@@ -0,0 +1,1134 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/Http2Connection.h"
+
+#include "monarch/http/HttpConnectionServicer.h"
+#include "monarch/logging/Logging.h"
+#include "monarch/net/SocketDefinitions.h"
+#include "monarch/rt/RunnableDelegate.h"
+#include "monarch/rt/System.h"
+
+using namespace std;
+using namespace monarch::io;
+using namespace monarch::http;
+using namespace monarch::logging;
+using namespace monarch::net;
+using namespace monarch::rt;
+
+const uint32_t Http2Connection::sDefaultStreamWindowSize = 262144;
+const uint32_t Http2Connection::sConnectionWindowSize = 1048576;
+
+// the maximum size of a header block (including CONTINUATION frames)
+#define MAX_HEADER_BLOCK_SIZE 262144
+
+Http2Connection::Http2Connection(
+   HttpConnection* hc, HttpConnectionServicer* servicer,
+   ThreadPool* pool, uint32_t maxConcurrentStreams) :
+   mConnection(hc),
+   mServicer(servicer),
+   mThreadPool(pool),
+   mLastStreamId(0),
+   mMaxConcurrentStreams(maxConcurrentStreams),
+   mStreamWindowSize(sDefaultStreamWindowSize),
+   mPeerInitialWindowSize(Http2Frame::sDefaultWindowSize),
+   mPeerMaxFrameSize(Http2Frame::sDefaultMaxFrameSize),
+   mSendWindow(Http2Frame::sDefaultWindowSize),
+   mHeaderStreamId(0),
+   mHeaderFlags(0),
+   mGoingAway(false),
+   mClosed(false)
+{
+}
+
+Http2Connection::~Http2Connection()
+{
+}
+
+void Http2Connection::service()
+{
+   uint32_t error = Http2Frame::NoError;
+
+   // read client connection preface
+   ConnectionInputStream* is = mConnection->getInputStream();
+   char preface[Http2Frame::sConnectionPrefaceLength];
+   if(is->readFully(preface, Http2Frame::sConnectionPrefaceLength) !=
+         Http2Frame::sConnectionPrefaceLength ||
+      memcmp(preface, Http2Frame::sConnectionPreface,
+         Http2Frame::sConnectionPrefaceLength) != 0)
+   {
+      MO_CAT_DEBUG(MO_HTTP_CAT, "Invalid HTTP/2 connection preface.");
+      error = Http2Frame::ProtocolError;
+   }
+   else
+   {
+      // send server settings
+      Http2Frame settings(Http2Frame::Settings);
+      settings.putUInt16(Http2Frame::MaxConcurrentStreams);
+      settings.putUInt32(mMaxConcurrentStreams);
+      settings.putUInt16(Http2Frame::InitialWindowSize);
+      settings.putUInt32(mStreamWindowSize);
+      if(writeFrame(settings))
+      {
+         // enlarge connection receive window
+         sendWindowUpdate(
+            0, sConnectionWindowSize - Http2Frame::sDefaultWindowSize);
+
+         // use HTTP/1.1 keep-alive timeout (5 minutes) between frames
+         mConnection->setReadTimeout(1000 * 60 * 5);
+
+         // handle frames until end of stream or connection error
+         Http2Frame frame;
+         int read = 0;
+         while(error == Http2Frame::NoError && !isClosed() &&
+               (read = frame.read(is, Http2Frame::sDefaultMaxFrameSize)) > 0)
+         {
+            error = handleFrame(frame);
+         }
+
+         if(error == Http2Frame::NoError && read == -1)
+         {
+            ExceptionRef e = Exception::get();
+            if(e->isType("monarch.http.Http2.FrameSizeError"))
+            {
+               error = Http2Frame::FrameSizeError;
+            }
+            else
+            {
+               MO_CAT_DEBUG(MO_HTTP_CAT,
+                  "HTTP/2 connection error: ['%s','%s']",
+                  e->getMessage(), e->getType());
+            }
+         }
+      }
+   }
+
+   if(error != Http2Frame::NoError)
+   {
+      MO_CAT_DEBUG(MO_HTTP_CAT,
+         "HTTP/2 connection error, sending GOAWAY: %u", error);
+      sendGoAway(error);
+   }
+
+   // no more frames will be processed, so wake any streams waiting on the
+   // connection and close it so any blocked writes fail
+   mLock.lock();
+   {
+      mGoingAway = true;
+      mClosed = true;
+      mLock.notifyAll();
+   }
+   mLock.unlock();
+   mConnection->close();
+
+   // wait for streams to finish being serviced
+   mLock.lock();
+   {
+      while(!mStreams.empty())
+      {
+         if(!mLock.wait())
+         {
+            // interrupted, streams will finish on their own
+            mLock.unlock();
+            Thread::yield();
+            mLock.lock();
+         }
+      }
+   }
+   mLock.unlock();
+}
+
+bool Http2Connection::hasConnectionPreface(HttpConnection* hc)
+{
+   // peek until enough bytes are available to check or the stream ends
+   ConnectionInputStream* is = hc->getInputStream();
+   char b[3];
+   int last = -1;
+   int n = 0;
+   while(n < 3 && n > last)
+   {
+      last = n;
+      n = is->peek(b, 3, true);
+   }
+
+   return n == 3 && strncmp(b, Http2Frame::sConnectionPreface, 3) == 0;
+}
+
+bool Http2Connection::sendHeaders(
+   Http2Stream* stream, HpackHeaderList& fields, bool endStream)
+{
+   bool rval = true;
+
+   mLock.lock();
+   {
+      if(stream->mReset || mClosed)
+      {
+         ExceptionRef e = new Exception(
+            "Could not send HTTP/2 header. Stream closed.",
+            "monarch.http.Http2.StreamClosed");
+         e->getDetails()["streamId"] = stream->mId;
+         Exception::set(e);
+         rval = false;
+      }
+   }
+   mLock.unlock();
+
+   if(rval)
+   {
+      // encoding and writing must be done in the same order
+      mWriteLock.lock();
+      {
+         string block;
+         mEncoder.encode(fields, block);
+
+         // split block into HEADERS and CONTINUATION frames
+         size_t offset = 0;
+         bool first = true;
+         do
+         {
+            size_t n = block.length() - offset;
+            if(n > mPeerMaxFrameSize)
+            {
+               n = mPeerMaxFrameSize;
+            }
+            uint8_t flags = 0;
+            if(first && endStream)
+            {
+               flags |= Http2Frame::FlagEndStream;
+            }
+            if(offset + n == block.length())
+            {
+               flags |= Http2Frame::FlagEndHeaders;
+            }
+            Http2Frame frame(
+               first ? Http2Frame::Headers : Http2Frame::Continuation,
+               flags, stream->mId);
+            frame.getPayload()->put(block.data() + offset, n, true);
+            rval = writeFrame(frame);
+            offset += n;
+            first = false;
+         }
+         while(rval && offset < block.length());
+      }
+      mWriteLock.unlock();
+   }
+
+   if(rval && endStream)
+   {
+      mLock.lock();
+      stream->mOutputClosed = true;
+      mLock.unlock();
+   }
+
+   return rval;
+}
+
+bool Http2Connection::sendData(
+   Http2Stream* stream, const char* b, int length, bool endStream)
+{
+   bool rval = true;
+
+   uint64_t deadline = (stream->mWriteTimeout == 0) ? 0 :
+      System::getCurrentMilliseconds() + stream->mWriteTimeout;
+   if(length > 0 || endStream)
+   {
+      do
+      {
+         uint32_t n = 0;
+         mLock.lock();
+         {
+            // wait for the flow-control windows to permit sending
+            while(rval && length > 0 && !stream->mReset && !mClosed &&
+                  (stream->mSendWindow <= 0 || mSendWindow <= 0))
+            {
+               if(deadline != 0 && System::getCurrentMilliseconds() >= deadline)
+               {
+                  ExceptionRef e = new Exception(
+                     "Could not send HTTP/2 data. Timed out waiting for "
+                     "flow-control window.",
+                     SOCKET_TIMEOUT_EXCEPTION_TYPE);
+                  e->getDetails()["streamId"] = stream->mId;
+                  Exception::set(e);
+                  rval = false;
+               }
+               else
+               {
+                  rval = waitUntil(deadline);
+               }
+            }
+
+            if(rval && (stream->mReset || mClosed))
+            {
+               ExceptionRef e = new Exception(
+                  "Could not send HTTP/2 data. Stream closed.",
+                  "monarch.http.Http2.StreamClosed");
+               e->getDetails()["streamId"] = stream->mId;
+               Exception::set(e);
+               rval = false;
+            }
+            else if(rval)
+            {
+               // take as much as the windows and frame size permit
+               int64_t max = (stream->mSendWindow < mSendWindow) ?
+                  stream->mSendWindow : mSendWindow;
+               if(max > mPeerMaxFrameSize)
+               {
+                  max = mPeerMaxFrameSize;
+               }
+               n = (length < max) ? length : max;
+               stream->mSendWindow -= n;
+               mSendWindow -= n;
+            }
+         }
+         mLock.unlock();
+
+         if(rval)
+         {
+            bool last = ((int)n == length);
+            Http2Frame frame(
+               Http2Frame::Data,
+               (last && endStream) ? Http2Frame::FlagEndStream : 0,
+               stream->mId);
+            frame.getPayload()->put(b, n, true);
+            if((rval = writeFrame(frame)))
+            {
+               b += n;
+               length -= n;
+               if(last && endStream)
+               {
+                  mLock.lock();
+                  stream->mOutputClosed = true;
+                  mLock.unlock();
+               }
+            }
+         }
+      }
+      while(rval && length > 0);
+   }
+
+   return rval;
+}
+
+int Http2Connection::receiveData(Http2Stream* stream, char* b, int length)
+{
+   int rval = 0;
+
+   uint32_t increment = 0;
+   uint64_t deadline = (stream->mReadTimeout == 0) ? 0 :
+      System::getCurrentMilliseconds() + stream->mReadTimeout;
+   mLock.lock();
+   {
+      // wait for data to arrive
+      while(rval != -1 && stream->mInput.isEmpty() &&
+            !stream->mInputClosed && !stream->mReset && !mClosed)
+      {
+         if(deadline != 0 && System::getCurrentMilliseconds() >= deadline)
+         {
+            ExceptionRef e = new Exception(
+               "Could not receive HTTP/2 data. Read timed out.",
+               SOCKET_TIMEOUT_EXCEPTION_TYPE);
+            e->getDetails()["streamId"] = stream->mId;
+            Exception::set(e);
+            rval = -1;
+         }
+         else if(!waitUntil(deadline))
+         {
+            rval = -1;
+         }
+      }
+
+      if(rval != -1)
+      {
+         if(!stream->mInput.isEmpty())
+         {
+            rval = stream->mInput.get(b, length);
+
+            // return consumed bytes to the peer's window in batches
+            stream->mReceiveConsumed += rval;
+            if(!stream->mInputClosed &&
+               stream->mReceiveConsumed >= mStreamWindowSize / 2)
+            {
+               increment = stream->mReceiveConsumed;
+               stream->mReceiveWindow += increment;
+               stream->mReceiveConsumed = 0;
+            }
+         }
+         else if(!stream->mInputClosed)
+         {
+            ExceptionRef e = new Exception(
+               "Could not receive HTTP/2 data. Stream closed.",
+               "monarch.http.Http2.StreamClosed");
+            e->getDetails()["streamId"] = stream->mId;
+            Exception::set(e);
+            rval = -1;
+         }
+      }
+   }
+   mLock.unlock();
+
+   if(increment > 0)
+   {
+      sendWindowUpdate(stream->mId, increment);
+   }
+
+   return rval;
+}
+
+void Http2Connection::resetStream(Http2Stream* stream, uint32_t error)
+{
+   bool send = false;
+
+   mLock.lock();
+   {
+      if(!stream->mReset && !mClosed &&
+         !(stream->mInputClosed && stream->mOutputClosed))
+      {
+         stream->mReset = true;
+         send = true;
+         mLock.notifyAll();
+      }
+   }
+   mLock.unlock();
+
+   if(send)
+   {
+      sendRstStream(stream->mId, error);
+   }
+}
+
+inline uint32_t Http2Connection::getPeerMaxFrameSize()
+{
+   return mPeerMaxFrameSize;
+}
+
+bool Http2Connection::isClosed()
+{
+   bool rval;
+   mLock.lock();
+   rval = mClosed;
+   mLock.unlock();
+   return rval;
+}
+
+void Http2Connection::serviceStream(Http2Stream* stream)
+{
+   // service request
+   mServicer->serviceHttp2Stream(stream);
+
+   // end the stream if the servicer did not
+   if(!stream->isClosed())
+   {
+      if(!stream->mHeadersSent)
+      {
+         resetStream(stream, Http2Frame::InternalError);
+      }
+      else if(!stream->mOutputClosed)
+      {
+         stream->writeBody(NULL, 0, true);
+      }
+   }
+
+   // if the request body was not consumed, tell the peer to stop sending it
+   resetStream(stream, Http2Frame::NoError);
+
+   // remove stream
+   mLock.lock();
+   {
+      mStreams.erase(stream->mId);
+      mLock.notifyAll();
+   }
+   mLock.unlock();
+   delete stream;
+}
+
+uint32_t Http2Connection::handleFrame(Http2Frame& frame)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   uint32_t id = frame.getStreamId();
+   ByteBuffer* payload = frame.getPayload();
+
+   // a header block may only be continued by CONTINUATION frames
+   if(mHeaderStreamId != 0 &&
+      (frame.getType() != Http2Frame::Continuation || id != mHeaderStreamId))
+   {
+      rval = Http2Frame::ProtocolError;
+   }
+   else
+   {
+      switch(frame.getType())
+      {
+         case Http2Frame::Data:
+            rval = handleData(frame);
+            break;
+         case Http2Frame::Headers:
+         case Http2Frame::Continuation:
+            rval = handleHeaders(frame);
+            break;
+         case Http2Frame::Priority:
+            // priority is advisory and is ignored
+            if(id == 0)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+            else if(payload->length() != 5)
+            {
+               sendRstStream(id, Http2Frame::FrameSizeError);
+            }
+            break;
+         case Http2Frame::RstStream:
+            if(id == 0 || id > mLastStreamId)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+            else if(payload->length() != 4)
+            {
+               rval = Http2Frame::FrameSizeError;
+            }
+            else
+            {
+               mLock.lock();
+               {
+                  StreamMap::iterator i = mStreams.find(id);
+                  if(i != mStreams.end())
+                  {
+                     i->second->mReset = true;
+                     mLock.notifyAll();
+                  }
+               }
+               mLock.unlock();
+            }
+            break;
+         case Http2Frame::Settings:
+            rval = handleSettings(frame);
+            break;
+         case Http2Frame::PushPromise:
+            // clients may not push
+            rval = Http2Frame::ProtocolError;
+            break;
+         case Http2Frame::Ping:
+            if(id != 0)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+            else if(payload->length() != 8)
+            {
+               rval = Http2Frame::FrameSizeError;
+            }
+            else if(!frame.hasFlag(Http2Frame::FlagAck))
+            {
+               // respond with same payload
+               frame.setFlags(Http2Frame::FlagAck);
+               writeFrame(frame);
+            }
+            break;
+         case Http2Frame::GoAway:
+            if(id != 0)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+            else
+            {
+               MO_CAT_DEBUG(MO_HTTP_CAT, "Received HTTP/2 GOAWAY.");
+            }
+            break;
+         case Http2Frame::WindowUpdate:
+            rval = handleWindowUpdate(frame);
+            break;
+         default:
+            // unknown frame types must be ignored
+            break;
+      }
+   }
+
+   return rval;
+}
+
+uint32_t Http2Connection::handleData(Http2Frame& frame)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   uint32_t id = frame.getStreamId();
+   ByteBuffer* payload = frame.getPayload();
+   int total = payload->length();
+   const char* data = payload->data();
+   int length = total;
+
+   if(id == 0)
+   {
+      rval = Http2Frame::ProtocolError;
+   }
+   else if(frame.hasFlag(Http2Frame::FlagPadded))
+   {
+      // strip padding
+      int padding = (length > 0) ? (unsigned char)data[0] : 0;
+      if(length == 0 || padding >= length)
+      {
+         rval = Http2Frame::ProtocolError;
+      }
+      else
+      {
+         ++data;
+         length -= padding + 1;
+      }
+   }
+
+   if(rval == Http2Frame::NoError)
+   {
+      // return the whole frame to the connection window immediately
+      if(total > 0)
+      {
+         sendWindowUpdate(0, total);
+      }
+
+      uint32_t error = Http2Frame::NoError;
+      mLock.lock();
+      {
+         StreamMap::iterator i = mStreams.find(id);
+         if(i == mStreams.end())
+         {
+            // data for an idle stream is a connection error, data for a
+            // closed stream is ignored
+            if(id > mLastStreamId)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+         }
+         else
+         {
+            Http2Stream* s = i->second;
+            if(s->mInputClosed)
+            {
+               error = Http2Frame::StreamClosed;
+            }
+            else if(total > s->mReceiveWindow)
+            {
+               error = Http2Frame::FlowControlError;
+            }
+            else if(!s->mReset)
+            {
+               // buffer data, padding counts as consumed immediately
+               s->mReceiveWindow -= total;
+               s->mReceiveConsumed += total - length;
+               s->mInput.put(data, length, true);
+               if(frame.hasFlag(Http2Frame::FlagEndStream))
+               {
+                  s->mInputClosed = true;
+               }
+            }
+
+            if(error != Http2Frame::NoError && !s->mReset)
+            {
+               s->mReset = true;
+            }
+            else
+            {
+               error = Http2Frame::NoError;
+            }
+            mLock.notifyAll();
+         }
+      }
+      mLock.unlock();
+
+      if(error != Http2Frame::NoError)
+      {
+         sendRstStream(id, error);
+      }
+   }
+
+   return rval;
+}
+
+uint32_t Http2Connection::handleHeaders(Http2Frame& frame)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   uint32_t id = frame.getStreamId();
+   ByteBuffer* payload = frame.getPayload();
+   const char* data = payload->data();
+   int length = payload->length();
+
+   if(frame.getType() == Http2Frame::Headers)
+   {
+      // client streams must be odd
+      if(id == 0 || (id % 2) == 0)
+      {
+         rval = Http2Frame::ProtocolError;
+      }
+      else
+      {
+         // strip padding and priority
+         int padding = 0;
+         if(frame.hasFlag(Http2Frame::FlagPadded) && length > 0)
+         {
+            padding = (unsigned char)data[0];
+            ++data;
+            --length;
+         }
+         if(frame.hasFlag(Http2Frame::FlagPriority))
+         {
+            data += 5;
+            length -= 5;
+         }
+         if(length < padding ||
+            (frame.hasFlag(Http2Frame::FlagPadded) && payload->length() == 0))
+         {
+            rval = Http2Frame::ProtocolError;
+         }
+         else
+         {
+            mHeaderBlock.assign(data, length - padding);
+            mHeaderFlags = frame.getFlags();
+         }
+      }
+   }
+   else if(mHeaderStreamId == 0)
+   {
+      // CONTINUATION without HEADERS
+      rval = Http2Frame::ProtocolError;
+   }
+   else
+   {
+      mHeaderBlock.append(data, length);
+   }
+
+   if(rval == Http2Frame::NoError)
+   {
+      if(mHeaderBlock.length() > MAX_HEADER_BLOCK_SIZE)
+      {
+         rval = Http2Frame::EnhanceYourCalm;
+      }
+      else if(frame.hasFlag(Http2Frame::FlagEndHeaders))
+      {
+         mHeaderStreamId = 0;
+         rval = handleHeaderBlock(
+            id, (mHeaderFlags & Http2Frame::FlagEndStream) != 0);
+      }
+      else
+      {
+         mHeaderStreamId = id;
+      }
+   }
+
+   return rval;
+}
+
+uint32_t Http2Connection::handleHeaderBlock(uint32_t streamId, bool endStream)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   // decode header block, failure leaves compression state unusable
+   HpackHeaderList fields;
+   if(!mDecoder.decode(mHeaderBlock.data(), mHeaderBlock.length(), fields))
+   {
+      rval = Http2Frame::CompressionError;
+   }
+   else
+   {
+      bool open = false;
+      uint32_t error = Http2Frame::NoError;
+      mLock.lock();
+      {
+         StreamMap::iterator i = mStreams.find(streamId);
+         if(i != mStreams.end())
+         {
+            // trailers must end the stream
+            Http2Stream* s = i->second;
+            if(s->mReset)
+            {
+               // ignore
+            }
+            else if(s->mInputClosed)
+            {
+               error = Http2Frame::StreamClosed;
+            }
+            else if(!endStream)
+            {
+               error = Http2Frame::ProtocolError;
+            }
+            else
+            {
+               s->mTrailerFields = fields;
+               s->mInputClosed = true;
+            }
+
+            if(error != Http2Frame::NoError)
+            {
+               s->mReset = true;
+            }
+            mLock.notifyAll();
+         }
+         else if(streamId <= mLastStreamId)
+         {
+            error = Http2Frame::StreamClosed;
+         }
+         else
+         {
+            mLastStreamId = streamId;
+            open = true;
+         }
+      }
+      mLock.unlock();
+
+      if(error != Http2Frame::NoError)
+      {
+         sendRstStream(streamId, error);
+      }
+      else if(open)
+      {
+         openStream(streamId, fields, endStream);
+      }
+   }
+
+   mHeaderBlock.clear();
+
+   return rval;
+}
+
+uint32_t Http2Connection::handleSettings(Http2Frame& frame)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   ByteBuffer* payload = frame.getPayload();
+   if(frame.getStreamId() != 0)
+   {
+      rval = Http2Frame::ProtocolError;
+   }
+   else if(frame.hasFlag(Http2Frame::FlagAck))
+   {
+      if(payload->length() != 0)
+      {
+         rval = Http2Frame::FrameSizeError;
+      }
+   }
+   else if(payload->length() % 6 != 0)
+   {
+      rval = Http2Frame::FrameSizeError;
+   }
+   else
+   {
+      const char* data = payload->data();
+      for(int i = 0;
+          rval == Http2Frame::NoError && i < payload->length(); i += 6)
+      {
+         uint16_t id = Http2Frame::getUInt16(data + i);
+         uint32_t value = Http2Frame::getUInt32(data + i + 2);
+         switch(id)
+         {
+            case Http2Frame::HeaderTableSize:
+               mWriteLock.lock();
+               mEncoder.setMaxTableSize(value);
+               mWriteLock.unlock();
+               break;
+            case Http2Frame::EnablePush:
+               if(value > 1)
+               {
+                  rval = Http2Frame::ProtocolError;
+               }
+               break;
+            case Http2Frame::InitialWindowSize:
+               if(value > Http2Frame::sMaxWindowSize)
+               {
+                  rval = Http2Frame::FlowControlError;
+               }
+               else
+               {
+                  // adjust all open stream windows by the difference
+                  mLock.lock();
+                  {
+                     int64_t delta = (int64_t)value - mPeerInitialWindowSize;
+                     mPeerInitialWindowSize = value;
+                     for(StreamMap::iterator si = mStreams.begin();
+                         si != mStreams.end(); ++si)
+                     {
+                        si->second->mSendWindow += delta;
+                        if(si->second->mSendWindow > Http2Frame::sMaxWindowSize)
+                        {
+                           rval = Http2Frame::FlowControlError;
+                        }
+                     }
+                     mLock.notifyAll();
+                  }
+                  mLock.unlock();
+               }
+               break;
+            case Http2Frame::MaxFrameSize:
+               if(value < Http2Frame::sDefaultMaxFrameSize || value > 16777215)
+               {
+                  rval = Http2Frame::ProtocolError;
+               }
+               else
+               {
+                  mPeerMaxFrameSize = value;
+               }
+               break;
+            default:
+               // other settings are advisory or unknown
+               break;
+         }
+      }
+
+      if(rval == Http2Frame::NoError)
+      {
+         // acknowledge settings
+         Http2Frame ack(Http2Frame::Settings, Http2Frame::FlagAck);
+         writeFrame(ack);
+      }
+   }
+
+   return rval;
+}
+
+uint32_t Http2Connection::handleWindowUpdate(Http2Frame& frame)
+{
+   uint32_t rval = Http2Frame::NoError;
+
+   uint32_t id = frame.getStreamId();
+   ByteBuffer* payload = frame.getPayload();
+   if(payload->length() != 4)
+   {
+      rval = Http2Frame::FrameSizeError;
+   }
+   else
+   {
+      uint32_t increment =
+         Http2Frame::getUInt32(payload->data()) & Http2Frame::sMaxWindowSize;
+      uint32_t error = Http2Frame::NoError;
+      mLock.lock();
+      {
+         if(id == 0)
+         {
+            mSendWindow += increment;
+            if(increment == 0)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+            else if(mSendWindow > Http2Frame::sMaxWindowSize)
+            {
+               rval = Http2Frame::FlowControlError;
+            }
+         }
+         else
+         {
+            StreamMap::iterator i = mStreams.find(id);
+            if(i != mStreams.end() && !i->second->mReset)
+            {
+               Http2Stream* s = i->second;
+               s->mSendWindow += increment;
+               if(increment == 0)
+               {
+                  error = Http2Frame::ProtocolError;
+               }
+               else if(s->mSendWindow > Http2Frame::sMaxWindowSize)
+               {
+                  error = Http2Frame::FlowControlError;
+               }
+               if(error != Http2Frame::NoError)
+               {
+                  s->mReset = true;
+               }
+            }
+            else if(id > mLastStreamId)
+            {
+               rval = Http2Frame::ProtocolError;
+            }
+         }
+         mLock.notifyAll();
+      }
+      mLock.unlock();
+
+      if(error != Http2Frame::NoError)
+      {
+         sendRstStream(id, error);
+      }
+   }
+
+   return rval;
+}
+
+/**
+ * Returns true if the given request header fields are well-formed.
+ *
+ * @param fields the header fields.
+ *
+ * @return true if the fields are valid, false if not.
+ */
+static bool _validateRequestFields(HpackHeaderList& fields)
+{
+   bool rval = true;
+
+   bool method = false;
+   bool scheme = false;
+   bool path = false;
+   bool regular = false;
+   for(HpackHeaderList::iterator i = fields.begin();
+       rval && i != fields.end(); ++i)
+   {
+      const string& name = i->name;
+      if(name.length() > 0 && name[0] == ':')
+      {
+         // pseudo-headers must come first and appear only once
+         if(regular)
+         {
+            rval = false;
+         }
+         else if(name == ":method")
+         {
+            rval = !method && i->value != "CONNECT";
+            method = true;
+         }
+         else if(name == ":scheme")
+         {
+            rval = !scheme;
+            scheme = true;
+         }
+         else if(name == ":path")
+         {
+            rval = !path && i->value.length() > 0;
+            path = true;
+         }
+         else
+         {
+            rval = (name == ":authority");
+         }
+      }
+      else
+      {
+         regular = true;
+
+         // names must be lowercase and connection-specific fields are
+         // not permitted
+         for(string::const_iterator c = name.begin();
+             rval && c != name.end(); ++c)
+         {
+            rval = !(*c >= 'A' && *c <= 'Z');
+         }
+         rval = rval &&
+            name != "connection" && name != "keep-alive" &&
+            name != "proxy-connection" && name != "transfer-encoding" &&
+            name != "upgrade" && (name != "te" || i->value == "trailers");
+      }
+   }
+
+   return rval && method && scheme && path;
+}
+
+void Http2Connection::openStream(
+   uint32_t streamId, HpackHeaderList& fields, bool endStream)
+{
+   uint32_t error = Http2Frame::NoError;
+
+   if(!_validateRequestFields(fields))
+   {
+      error = Http2Frame::ProtocolError;
+   }
+   else
+   {
+      Http2Stream* s = NULL;
+      mLock.lock();
+      {
+         if(!mGoingAway && mStreams.size() < mMaxConcurrentStreams)
+         {
+            // create stream
+            s = new Http2Stream(
+               this, mConnection, streamId,
+               mPeerInitialWindowSize, mStreamWindowSize);
+            s->mHeaderFields = fields;
+            s->mInputClosed = endStream;
+            s->mHasBody = !endStream;
+            for(HpackHeaderList::iterator i = fields.begin();
+                i != fields.end(); ++i)
+            {
+               if(i->name == ":method")
+               {
+                  s->mHeadRequest = (i->value == "HEAD");
+               }
+            }
+            mStreams[streamId] = s;
+         }
+      }
+      mLock.unlock();
+
+      if(s == NULL)
+      {
+         error = Http2Frame::RefusedStream;
+      }
+      else
+      {
+         // service stream on the thread pool
+         RunnableRef r = new RunnableDelegate<Http2Connection, Http2Stream*>(
+            this, &Http2Connection::serviceStream, s);
+         if(!mThreadPool->tryRunJob(r))
+         {
+            mLock.lock();
+            mStreams.erase(streamId);
+            mLock.unlock();
+            delete s;
+            error = Http2Frame::RefusedStream;
+         }
+      }
+   }
+
+   if(error != Http2Frame::NoError)
+   {
+      MO_CAT_DEBUG(MO_HTTP_CAT,
+         "Resetting HTTP/2 stream %u: %u", streamId, error);
+      sendRstStream(streamId, error);
+   }
+}
+
+bool Http2Connection::writeFrame(Http2Frame& frame)
+{
+   bool rval;
+
+   mWriteLock.lock();
+   {
+      ConnectionOutputStream* os = mConnection->getOutputStream();
+      rval = frame.write(os) && os->flush();
+   }
+   mWriteLock.unlock();
+
+   if(!rval)
+   {
+      // connection is unusable, wake any waiting streams
+      mLock.lock();
+      mClosed = true;
+      mLock.notifyAll();
+      mLock.unlock();
+   }
+
+   return rval;
+}
+
+void Http2Connection::sendRstStream(uint32_t streamId, uint32_t error)
+{
+   Http2Frame frame(Http2Frame::RstStream, 0, streamId);
+   frame.putUInt32(error);
+   writeFrame(frame);
+}
+
+void Http2Connection::sendWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+   Http2Frame frame(Http2Frame::WindowUpdate, 0, streamId);
+   frame.putUInt32(increment);
+   writeFrame(frame);
+}
+
+void Http2Connection::sendGoAway(uint32_t error)
+{
+   Http2Frame frame(Http2Frame::GoAway);
+   frame.putUInt32(mLastStreamId);
+   frame.putUInt32(error);
+   writeFrame(frame);
+}
+
+bool Http2Connection::waitUntil(uint64_t deadline)
+{
+   uint32_t timeout = 0;
+   if(deadline != 0)
+   {
+      uint64_t now = System::getCurrentMilliseconds();
+      timeout = (deadline > now) ? (uint32_t)(deadline - now) : 1;
+   }
+   return mLock.wait(timeout);
+}
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_Http2Connection_H
+#define monarch_http_Http2Connection_H
+
+#include "monarch/http/HpackDecoder.h"
+#include "monarch/http/HpackEncoder.h"
+#include "monarch/http/Http2Frame.h"
+#include "monarch/http/Http2Stream.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/ThreadPool.h"
+
+#include <map>
+
+namespace monarch
+{
+namespace http
+{
+
+// forward declare connection servicer
+class HttpConnectionServicer;
+
+/**
+ * An Http2Connection services the server side of an HTTP/2 connection
+ * (RFC 7540). It reads frames from the connection, maintains the HPACK
+ * header compression state and flow-control windows, and multiplexes
+ * concurrent streams over the connection.
+ *
+ * Each new stream is serviced as an Http2Stream by a job on the thread pool
+ * of the HttpConnectionServicer, which dispatches it to the appropriate
+ * HttpRequestServicer. If the thread pool has no available threads or the
+ * maximum number of concurrent streams has been reached, the stream is
+ * refused (RST_STREAM with REFUSED_STREAM) so that the client may retry it.
+ *
+ * Frames are written by stream jobs under a write lock; stream and window
+ * state is protected by a separate state lock that is never held while
+ * writing to the connection. Server push is not supported.
+ *
+ * @author Dave Longley
+ */
+class Http2Connection
+{
+public:
+   /**
+    * The default initial flow-control window advertised for each stream.
+    */
+   static const uint32_t sDefaultStreamWindowSize;
+
+   /**
+    * The flow-control window advertised for the whole connection.
+    */
+   static const uint32_t sConnectionWindowSize;
+
+protected:
+   /**
+    * The connection the HTTP/2 frames are read from and written to.
+    */
+   HttpConnection* mConnection;
+
+   /**
+    * The connection servicer that services streams.
+    */
+   HttpConnectionServicer* mServicer;
+
+   /**
+    * The thread pool used to service streams.
+    */
+   monarch::rt::ThreadPool* mThreadPool;
+
+   /**
+    * The HPACK decoder for received header blocks.
+    */
+   HpackDecoder mDecoder;
+
+   /**
+    * The HPACK encoder for sent header blocks, protected by the write lock.
+    */
+   HpackEncoder mEncoder;
+
+   /**
+    * A map of stream ID to open stream.
+    */
+   typedef std::map<uint32_t, Http2Stream*> StreamMap;
+   StreamMap mStreams;
+
+   /**
+    * A lock for stream state and flow-control windows.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+   /**
+    * A lock for writing frames.
+    */
+   monarch::rt::ExclusiveLock mWriteLock;
+
+   /**
+    * The highest stream ID opened by the peer.
+    */
+   uint32_t mLastStreamId;
+
+   /**
+    * The maximum number of concurrent streams permitted.
+    */
+   uint32_t mMaxConcurrentStreams;
+
+   /**
+    * The initial receive window advertised for each stream.
+    */
+   uint32_t mStreamWindowSize;
+
+   /**
+    * The peer's initial window size for new streams.
+    */
+   uint32_t mPeerInitialWindowSize;
+
+   /**
+    * The maximum frame payload size the peer will accept.
+    */
+   uint32_t mPeerMaxFrameSize;
+
+   /**
+    * The number of bytes that may be sent on the connection.
+    */
+   int64_t mSendWindow;
+
+   /**
+    * A header block that is being continued by CONTINUATION frames.
+    */
+   std::string mHeaderBlock;
+
+   /**
+    * The stream ID of the header block being continued, 0 for none.
+    */
+   uint32_t mHeaderStreamId;
+
+   /**
+    * The flags of the HEADERS frame that began the current header block.
+    */
+   uint8_t mHeaderFlags;
+
+   /**
+    * True once a GOAWAY frame has been sent or received.
+    */
+   bool mGoingAway;
+
+   /**
+    * True once the connection has been closed.
+    */
+   bool mClosed;
+
+public:
+   /**
+    * Creates a new Http2Connection.
+    *
+    * @param hc the HttpConnection to run HTTP/2 over.
+    * @param servicer the HttpConnectionServicer to service streams with.
+    * @param pool the thread pool to service streams on.
+    * @param maxConcurrentStreams the maximum number of concurrent streams.
+    */
+   Http2Connection(
+      HttpConnection* hc, HttpConnectionServicer* servicer,
+      monarch::rt::ThreadPool* pool, uint32_t maxConcurrentStreams);
+
+   /**
+    * Destructs this Http2Connection.
+    */
+   virtual ~Http2Connection();
+
+   /**
+    * Services this connection. The client connection preface is read and
+    * frames are processed until the connection is closed or a connection
+    * error occurs. This method will not return until all streams have
+    * finished being serviced.
+    */
+   virtual void service();
+
+   /**
+    * Checks to see if the given connection begins with the HTTP/2 client
+    * connection preface. This will block until enough bytes have been
+    * peeked to make the determination.
+    *
+    * @param hc the connection to check.
+    *
+    * @return true if the connection begins with the HTTP/2 preface, false
+    *         if not.
+    */
+   static bool hasConnectionPreface(HttpConnection* hc);
+
+   /**
+    * Sends a header block on a stream as HEADERS and any necessary
+    * CONTINUATION frames.
+    *
+    * @param stream the stream to send on.
+    * @param fields the header fields to send.
+    * @param endStream true to end this side of the stream.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool sendHeaders(
+      Http2Stream* stream, HpackHeaderList& fields, bool endStream);
+
+   /**
+    * Sends data on a stream as DATA frames. This method will block until
+    * the flow-control windows permit all of the data to be sent, the
+    * stream's write timeout expires, or the stream is reset.
+    *
+    * @param stream the stream to send on.
+    * @param b the data to send.
+    * @param length the number of bytes to send.
+    * @param endStream true to end this side of the stream.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool sendData(
+      Http2Stream* stream, const char* b, int length, bool endStream);
+
+   /**
+    * Receives data that has arrived on a stream. This method will block
+    * until data is available, the peer ends the stream, the stream's read
+    * timeout expires, or the stream is reset.
+    *
+    * @param stream the stream to receive from.
+    * @param b the buffer to read into.
+    * @param length the maximum number of bytes to read.
+    *
+    * @return the number of bytes read, 0 if the peer ended the stream, or
+    *         -1 if an Exception occurred.
+    */
+   virtual int receiveData(Http2Stream* stream, char* b, int length);
+
+   /**
+    * Resets a stream if it has not already been reset.
+    *
+    * @param stream the stream to reset.
+    * @param error the error code to send.
+    */
+   virtual void resetStream(Http2Stream* stream, uint32_t error);
+
+   /**
+    * Gets the maximum frame payload size the peer will accept.
+    *
+    * @return the peer's maximum frame size.
+    */
+   virtual uint32_t getPeerMaxFrameSize();
+
+   /**
+    * Returns true if this connection has been closed.
+    *
+    * @return true if closed, false if not.
+    */
+   virtual bool isClosed();
+
+protected:
+   /**
+    * Services a single stream. Called on a thread pool thread.
+    *
+    * @param stream the stream to service.
+    */
+   virtual void serviceStream(Http2Stream* stream);
+
+   /**
+    * Handles a received frame.
+    *
+    * @param frame the frame to handle.
+    *
+    * @return NoError to continue, otherwise the connection error code to
+    *         send in a GOAWAY frame.
+    */
+   virtual uint32_t handleFrame(Http2Frame& frame);
+
+   /**
+    * Handles a received DATA frame.
+    *
+    * @param frame the frame to handle.
+    *
+    * @return NoError or a connection error code.
+    */
+   virtual uint32_t handleData(Http2Frame& frame);
+
+   /**
+    * Handles a received HEADERS or CONTINUATION frame.
+    *
+    * @param frame the frame to handle.
+    *
+    * @return NoError or a connection error code.
+    */
+   virtual uint32_t handleHeaders(Http2Frame& frame);
+
+   /**
+    * Handles a complete received header block.
+    *
+    * @param streamId the stream the header block was received on.
+    * @param endStream true if the peer ended the stream.
+    *
+    * @return NoError or a connection error code.
+    */
+   virtual uint32_t handleHeaderBlock(uint32_t streamId, bool endStream);
+
+   /**
+    * Handles a received SETTINGS frame.
+    *
+    * @param frame the frame to handle.
+    *
+    * @return NoError or a connection error code.
+    */
+   virtual uint32_t handleSettings(Http2Frame& frame);
+
+   /**
+    * Handles a received WINDOW_UPDATE frame.
+    *
+    * @param frame the frame to handle.
+    *
+    * @return NoError or a connection error code.
+    */
+   virtual uint32_t handleWindowUpdate(Http2Frame& frame);
+
+   /**
+    * Creates a stream for a received request header block and schedules it
+    * to be serviced.
+    *
+    * @param streamId the ID of the new stream.
+    * @param fields the received header fields.
+    * @param endStream true if the peer ended the stream.
+    */
+   virtual void openStream(
+      uint32_t streamId, HpackHeaderList& fields, bool endStream);
+
+   /**
+    * Writes a frame to the connection and flushes it.
+    *
+    * @param frame the frame to write.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool writeFrame(Http2Frame& frame);
+
+   /**
+    * Sends a RST_STREAM frame.
+    *
+    * @param streamId the stream to reset.
+    * @param error the error code.
+    */
+   virtual void sendRstStream(uint32_t streamId, uint32_t error);
+
+   /**
+    * Sends a WINDOW_UPDATE frame.
+    *
+    * @param streamId the stream to update, 0 for the connection.
+    * @param increment the window size increment.
+    */
+   virtual void sendWindowUpdate(uint32_t streamId, uint32_t increment);
+
+   /**
+    * Sends a GOAWAY frame.
+    *
+    * @param error the error code.
+    */
+   virtual void sendGoAway(uint32_t error);
+
+   /**
+    * Waits on the state lock until notified or the given deadline passes.
+    * The state lock must be held. The caller must check whether the deadline
+    * has passed.
+    *
+    * @param deadline the deadline in milliseconds since the epoch, 0 for
+    *                 none.
+    *
+    * @return true if the wait ended, false if the thread was interrupted.
+    */
+   virtual bool waitUntil(uint64_t deadline);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
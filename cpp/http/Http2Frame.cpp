@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/Http2Frame.h"
+
+#include "monarch/rt/Exception.h"
+
+using namespace monarch::io;
+using namespace monarch::http;
+using namespace monarch::net;
+using namespace monarch::rt;
+
+const char* Http2Frame::sConnectionPreface =
+   "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const int Http2Frame::sConnectionPrefaceLength = 24;
+const int Http2Frame::sHeaderSize = 9;
+const uint32_t Http2Frame::sDefaultMaxFrameSize = 16384;
+const uint32_t Http2Frame::sDefaultWindowSize = 65535;
+const uint32_t Http2Frame::sMaxWindowSize = 0x7fffffff;
+
+Http2Frame::Http2Frame(uint8_t type, uint8_t flags, uint32_t streamId) :
+   mType(type),
+   mFlags(flags),
+   mStreamId(streamId),
+   mPayload(0)
+{
+}
+
+Http2Frame::~Http2Frame()
+{
+}
+
+int Http2Frame::read(ConnectionInputStream* is, uint32_t maxSize)
+{
+   int rval = 1;
+
+   char header[sHeaderSize];
+   int numBytes = is->readFully(header, sHeaderSize);
+   if(numBytes <= 0)
+   {
+      // end of stream or exception
+      rval = numBytes;
+   }
+   else if(numBytes < sHeaderSize)
+   {
+      ExceptionRef e = new Exception(
+         "Could not read HTTP/2 frame header. End of stream reached.",
+         "monarch.http.Http2.TruncatedFrame");
+      Exception::set(e);
+      rval = -1;
+   }
+   else
+   {
+      uint32_t length =
+         ((unsigned char)header[0] << 16) |
+         ((unsigned char)header[1] << 8) |
+         (unsigned char)header[2];
+      mType = header[3];
+      mFlags = header[4];
+      mStreamId = getUInt32(header + 5) & 0x7fffffff;
+
+      if(length > maxSize)
+      {
+         ExceptionRef e = new Exception(
+            "HTTP/2 frame exceeds maximum frame size.",
+            "monarch.http.Http2.FrameSizeError");
+         e->getDetails()["length"] = length;
+         e->getDetails()["maxSize"] = maxSize;
+         Exception::set(e);
+         rval = -1;
+      }
+      else
+      {
+         // read payload
+         mPayload.clear();
+         mPayload.allocateSpace(length, true);
+         if(length > 0)
+         {
+            numBytes = is->readFully(mPayload.end(), length);
+            if(numBytes >= 0)
+            {
+               mPayload.extend(numBytes);
+            }
+            if(numBytes != (int)length)
+            {
+               if(numBytes != -1)
+               {
+                  ExceptionRef e = new Exception(
+                     "Could not read HTTP/2 frame payload. "
+                     "End of stream reached.",
+                     "monarch.http.Http2.TruncatedFrame");
+                  Exception::set(e);
+               }
+               rval = -1;
+            }
+         }
+      }
+   }
+
+   return rval;
+}
+
+bool Http2Frame::write(OutputStream* os)
+{
+   uint32_t length = mPayload.length();
+   char header[sHeaderSize];
+   header[0] = (char)(length >> 16);
+   header[1] = (char)(length >> 8);
+   header[2] = (char)length;
+   header[3] = (char)mType;
+   header[4] = (char)mFlags;
+   header[5] = (char)((mStreamId >> 24) & 0x7f);
+   header[6] = (char)(mStreamId >> 16);
+   header[7] = (char)(mStreamId >> 8);
+   header[8] = (char)mStreamId;
+
+   return
+      os->write(header, sHeaderSize) &&
+      (length == 0 || os->write(mPayload.data(), length));
+}
+
+void Http2Frame::setType(uint8_t type)
+{
+   mType = type;
+}
+
+uint8_t Http2Frame::getType()
+{
+   return mType;
+}
+
+void Http2Frame::setFlags(uint8_t flags)
+{
+   mFlags = flags;
+}
+
+uint8_t Http2Frame::getFlags()
+{
+   return mFlags;
+}
+
+bool Http2Frame::hasFlag(uint8_t flag)
+{
+   return (mFlags & flag) != 0;
+}
+
+void Http2Frame::setStreamId(uint32_t id)
+{
+   mStreamId = id;
+}
+
+uint32_t Http2Frame::getStreamId()
+{
+   return mStreamId;
+}
+
+ByteBuffer* Http2Frame::getPayload()
+{
+   return &mPayload;
+}
+
+void Http2Frame::putUInt32(uint32_t value)
+{
+   char b[4];
+   b[0] = (char)(value >> 24);
+   b[1] = (char)(value >> 16);
+   b[2] = (char)(value >> 8);
+   b[3] = (char)value;
+   mPayload.put(b, 4, true);
+}
+
+void Http2Frame::putUInt16(uint16_t value)
+{
+   char b[2];
+   b[0] = (char)(value >> 8);
+   b[1] = (char)value;
+   mPayload.put(b, 2, true);
+}
+
+uint32_t Http2Frame::getUInt32(const char* b)
+{
+   const unsigned char* ub = (const unsigned char*)b;
+   return (ub[0] << 24) | (ub[1] << 16) | (ub[2] << 8) | ub[3];
+}
+
+uint16_t Http2Frame::getUInt16(const char* b)
+{
+   const unsigned char* ub = (const unsigned char*)b;
+   return (ub[0] << 8) | ub[1];
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_Http2Frame_H
+#define monarch_http_Http2Frame_H
+
+#include "monarch/io/ByteBuffer.h"
+#include "monarch/io/OutputStream.h"
+#include "monarch/net/ConnectionInputStream.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An Http2Frame is a single HTTP/2 frame (RFC 7540, Section 4). It consists
+ * of a 9 byte frame header (payload length, type, flags, and stream
+ * identifier) followed by a payload.
+ *
+ * @author Dave Longley
+ */
+class Http2Frame
+{
+public:
+   /**
+    * The frame types.
+    */
+   enum Type
+   {
+      Data = 0x0,
+      Headers = 0x1,
+      Priority = 0x2,
+      RstStream = 0x3,
+      Settings = 0x4,
+      PushPromise = 0x5,
+      Ping = 0x6,
+      GoAway = 0x7,
+      WindowUpdate = 0x8,
+      Continuation = 0x9
+   };
+
+   /**
+    * The frame flags. Not all flags are valid for all frame types.
+    */
+   enum Flag
+   {
+      FlagAck = 0x1,
+      FlagEndStream = 0x1,
+      FlagEndHeaders = 0x4,
+      FlagPadded = 0x8,
+      FlagPriority = 0x20
+   };
+
+   /**
+    * The error codes used in RST_STREAM and GOAWAY frames.
+    */
+   enum ErrorCode
+   {
+      NoError = 0x0,
+      ProtocolError = 0x1,
+      InternalError = 0x2,
+      FlowControlError = 0x3,
+      SettingsTimeout = 0x4,
+      StreamClosed = 0x5,
+      FrameSizeError = 0x6,
+      RefusedStream = 0x7,
+      Cancel = 0x8,
+      CompressionError = 0x9,
+      ConnectError = 0xa,
+      EnhanceYourCalm = 0xb,
+      InadequateSecurity = 0xc,
+      Http11Required = 0xd
+   };
+
+   /**
+    * The identifiers used in SETTINGS frames.
+    */
+   enum Setting
+   {
+      HeaderTableSize = 0x1,
+      EnablePush = 0x2,
+      MaxConcurrentStreams = 0x3,
+      InitialWindowSize = 0x4,
+      MaxFrameSize = 0x5,
+      MaxHeaderListSize = 0x6
+   };
+
+   /**
+    * The client connection preface.
+    */
+   static const char* sConnectionPreface;
+
+   /**
+    * The length of the client connection preface.
+    */
+   static const int sConnectionPrefaceLength;
+
+   /**
+    * The size of a frame header.
+    */
+   static const int sHeaderSize;
+
+   /**
+    * The default (and minimum) maximum frame payload size.
+    */
+   static const uint32_t sDefaultMaxFrameSize;
+
+   /**
+    * The default initial flow-control window size.
+    */
+   static const uint32_t sDefaultWindowSize;
+
+   /**
+    * The maximum flow-control window size.
+    */
+   static const uint32_t sMaxWindowSize;
+
+protected:
+   /**
+    * The type of frame.
+    */
+   uint8_t mType;
+
+   /**
+    * The frame flags.
+    */
+   uint8_t mFlags;
+
+   /**
+    * The stream ID for the frame.
+    */
+   uint32_t mStreamId;
+
+   /**
+    * The frame payload.
+    */
+   monarch::io::ByteBuffer mPayload;
+
+public:
+   /**
+    * Creates a new Http2Frame.
+    *
+    * @param type the type of frame.
+    * @param flags the frame flags.
+    * @param streamId the stream ID for the frame.
+    */
+   Http2Frame(uint8_t type = Data, uint8_t flags = 0, uint32_t streamId = 0);
+
+   /**
+    * Destructs this Http2Frame.
+    */
+   virtual ~Http2Frame();
+
+   /**
+    * Reads a frame from the passed stream, replacing the contents of this
+    * frame.
+    *
+    * @param is the stream to read from.
+    * @param maxSize the maximum permitted payload size.
+    *
+    * @return 1 if a frame was read, 0 if the end of the stream was reached
+    *         before any frame data, -1 if an exception occurred (including
+    *         a payload larger than maxSize).
+    */
+   virtual int read(
+      monarch::net::ConnectionInputStream* is, uint32_t maxSize);
+
+   /**
+    * Writes this frame to the passed stream. The stream is not flushed.
+    *
+    * @param os the stream to write to.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool write(monarch::io::OutputStream* os);
+
+   /**
+    * Sets the type of this frame.
+    *
+    * @param type the type of frame.
+    */
+   virtual void setType(uint8_t type);
+
+   /**
+    * Gets the type of this frame.
+    *
+    * @return the type of frame.
+    */
+   virtual uint8_t getType();
+
+   /**
+    * Sets the flags for this frame.
+    *
+    * @param flags the frame flags.
+    */
+   virtual void setFlags(uint8_t flags);
+
+   /**
+    * Gets the flags for this frame.
+    *
+    * @return the frame flags.
+    */
+   virtual uint8_t getFlags();
+
+   /**
+    * Returns true if the given flag is set on this frame.
+    *
+    * @param flag the flag to check.
+    *
+    * @return true if the flag is set, false if not.
+    */
+   virtual bool hasFlag(uint8_t flag);
+
+   /**
+    * Sets the stream ID for this frame.
+    *
+    * @param id the stream ID.
+    */
+   virtual void setStreamId(uint32_t id);
+
+   /**
+    * Gets the stream ID for this frame.
+    *
+    * @return the stream ID.
+    */
+   virtual uint32_t getStreamId();
+
+   /**
+    * Gets the payload for this frame.
+    *
+    * @return the payload.
+    */
+   virtual monarch::io::ByteBuffer* getPayload();
+
+   /**
+    * Writes a 32-bit unsigned integer to the payload in network byte order.
+    *
+    * @param value the value to write.
+    */
+   virtual void putUInt32(uint32_t value);
+
+   /**
+    * Writes a 16-bit unsigned integer to the payload in network byte order.
+    *
+    * @param value the value to write.
+    */
+   virtual void putUInt16(uint16_t value);
+
+   /**
+    * Reads a 32-bit unsigned integer in network byte order.
+    *
+    * @param b the bytes to read from.
+    *
+    * @return the value.
+    */
+   static uint32_t getUInt32(const char* b);
+
+   /**
+    * Reads a 16-bit unsigned integer in network byte order.
+    *
+    * @param b the bytes to read from.
+    *
+    * @return the value.
+    */
+   static uint16_t getUInt16(const char* b);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/Http2Stream.h"
+
+#include "monarch/http/Http2Connection.h"
+#include "monarch/http/Http2StreamInputStream.h"
+#include "monarch/http/Http2StreamOutputStream.h"
+#include "monarch/http/HttpRequestHeader.h"
+#include "monarch/http/HttpResponseHeader.h"
+#include "monarch/io/IOException.h"
+#include "monarch/rt/Exception.h"
+
+#include <cctype>
+#include <cstdio>
+
+using namespace std;
+using namespace monarch::io;
+using namespace monarch::http;
+using namespace monarch::rt;
+
+Http2Stream::Http2Stream(
+   Http2Connection* session, HttpConnection* hc, uint32_t id,
+   int64_t sendWindow, int64_t receiveWindow) :
+   HttpConnection(hc->getConnection(), false),
+   mSession(session),
+   mId(id),
+   mInput(0),
+   mSendWindow(sendWindow),
+   mReceiveWindow(receiveWindow),
+   mReceiveConsumed(0),
+   mInputClosed(false),
+   mOutputClosed(false),
+   mHeadersSent(false),
+   mReset(false),
+   mHeadRequest(false),
+   mHasBody(false),
+   mReadTimeout(30000),
+   mWriteTimeout(30000)
+{
+}
+
+Http2Stream::~Http2Stream()
+{
+}
+
+inline uint32_t Http2Stream::getId()
+{
+   return mId;
+}
+
+inline Http2Connection* Http2Stream::getSession()
+{
+   return mSession;
+}
+
+inline HpackHeaderList& Http2Stream::getHeaderFields()
+{
+   return mHeaderFields;
+}
+
+/**
+ * Returns true if the given header field is connection-specific and must
+ * not be sent over HTTP/2.
+ *
+ * @param name the field name.
+ *
+ * @return true if the field is connection-specific, false if not.
+ */
+static bool _isConnectionField(const char* name)
+{
+   return
+      strcasecmp(name, "Connection") == 0 ||
+      strcasecmp(name, "Keep-Alive") == 0 ||
+      strcasecmp(name, "Proxy-Connection") == 0 ||
+      strcasecmp(name, "Transfer-Encoding") == 0 ||
+      strcasecmp(name, "Upgrade") == 0;
+}
+
+bool Http2Stream::sendHeader(HttpHeader* header)
+{
+   bool rval = true;
+
+   HpackHeaderList fields;
+   HpackHeaderField field;
+   bool final = true;
+   bool endStream = false;
+   if(header->getType() == HttpHeader::Response)
+   {
+      // add status pseudo-header
+      HttpResponseHeader* h = static_cast<HttpResponseHeader*>(header);
+      int code = h->getStatusCode();
+      char status[12];
+      snprintf(status, 12, "%d", code);
+      field.name = ":status";
+      field.value = status;
+      fields.push_back(field);
+
+      // informational headers precede the final header
+      if(code < 200)
+      {
+         final = false;
+      }
+      else if(mHeadersSent)
+      {
+         ExceptionRef e = new Exception(
+            "Could not send HTTP/2 header. Header already sent.",
+            "monarch.http.Http2.HeaderAlreadySent");
+         Exception::set(e);
+         rval = false;
+      }
+      else
+      {
+         // mark when a response started to be sent
+         if(mRequestState != NULL)
+         {
+            mRequestState->responseStarted();
+         }
+
+         // end stream now if there can be no body
+         int64_t length = -1;
+         endStream =
+            mHeadRequest || code == 204 || code == 304 ||
+            (h->getField("Content-Length", length) && length == 0);
+      }
+   }
+   else if(header->getType() == HttpHeader::Trailer)
+   {
+      // trailers always end the stream
+      endStream = true;
+   }
+   else
+   {
+      ExceptionRef e = new Exception(
+         "Could not send HTTP/2 header. Only response headers and trailers "
+         "may be sent.",
+         "monarch.http.Http2.InvalidHeader");
+      Exception::set(e);
+      rval = false;
+   }
+
+   if(rval)
+   {
+      // add lowercase, non-connection-specific fields
+      HttpHeader::FieldMap& fm = header->getFields();
+      for(HttpHeader::FieldMap::iterator i = fm.begin(); i != fm.end(); ++i)
+      {
+         if(!_isConnectionField(i->first))
+         {
+            field.name = i->first;
+            for(string::iterator c = field.name.begin();
+                c != field.name.end(); ++c)
+            {
+               *c = tolower(*c);
+            }
+            field.value = i->second;
+            fields.push_back(field);
+         }
+      }
+
+      rval = mSession->sendHeaders(this, fields, endStream);
+      if(rval && final)
+      {
+         mHeadersSent = true;
+      }
+   }
+
+   return rval;
+}
+
+bool Http2Stream::receiveHeader(HttpHeader* header)
+{
+   bool rval = true;
+
+   if(header->getType() != HttpHeader::Request)
+   {
+      ExceptionRef e = new Exception(
+         "Could not receive HTTP/2 header. Only request headers may be "
+         "received.",
+         "monarch.http.Http2.InvalidHeader");
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      // present request as HTTP/1.1
+      HttpRequestHeader* h = static_cast<HttpRequestHeader*>(header);
+      h->setVersion("HTTP/1.1");
+
+      string authority;
+      string cookie;
+      for(HpackHeaderList::iterator i = mHeaderFields.begin();
+          i != mHeaderFields.end(); ++i)
+      {
+         if(i->name == ":method")
+         {
+            h->setMethod(i->value.c_str());
+         }
+         else if(i->name == ":path")
+         {
+            h->setPath(i->value.c_str());
+         }
+         else if(i->name == ":authority")
+         {
+            authority = i->value;
+         }
+         else if(i->name == "cookie")
+         {
+            // cookies may be split into multiple fields
+            if(cookie.length() > 0)
+            {
+               cookie.append("; ");
+            }
+            cookie.append(i->value);
+         }
+         else if(i->name[0] != ':')
+         {
+            h->addField(i->name.c_str(), i->value);
+         }
+      }
+
+      // map authority to host
+      if(authority.length() > 0 && !h->hasField("Host"))
+      {
+         h->setField("Host", authority);
+      }
+      if(cookie.length() > 0)
+      {
+         h->setField("Cookie", cookie);
+      }
+
+      // mark a body of unspecified length as chunked so that it is detected
+      if(mHasBody && !h->hasField("Content-Length"))
+      {
+         h->setField("Transfer-Encoding", "chunked");
+      }
+   }
+
+   return rval;
+}
+
+bool Http2Stream::sendBody(
+   HttpHeader* header, InputStream* is, HttpTrailer* trailer)
+{
+   bool rval = true;
+
+   Http2StreamOutputStream os(this, trailer);
+
+   // determine how much content needs to be read
+   int64_t contentRemaining = -1;
+   if(!header->getField("Content-Length", contentRemaining))
+   {
+      contentRemaining = -1;
+   }
+
+   // read in content, write out to stream
+   int length = 2048;
+   mBuffer.clear();
+   mBuffer.allocateSpace(length, true);
+   int numBytes = 0;
+   while(rval && contentRemaining != 0 &&
+         (numBytes = mBuffer.put(is, (contentRemaining > 0 &&
+            contentRemaining < length) ? contentRemaining : length)) > 0)
+   {
+      rval = os.write(mBuffer.data(), numBytes);
+      if(contentRemaining > 0)
+      {
+         contentRemaining -= numBytes;
+      }
+      mBuffer.clear();
+   }
+
+   if(rval && numBytes == -1)
+   {
+      rval = false;
+   }
+   else if(rval && contentRemaining > 0)
+   {
+      ExceptionRef e = new IOException(
+         "Could not read HTTP content bytes to send.");
+      Exception::set(e);
+      rval = false;
+   }
+
+   // finish stream
+   rval = os.finish() && rval;
+
+   return rval;
+}
+
+OutputStream* Http2Stream::getBodyOutputStream(
+   HttpHeader* header, HttpTrailer* trailer)
+{
+   return new Http2StreamOutputStream(this, trailer);
+}
+
+bool Http2Stream::receiveBody(
+   HttpHeader* header, OutputStream* os, HttpTrailer* trailer)
+{
+   bool rval = true;
+
+   Http2StreamInputStream is(this, trailer);
+
+   // read in from stream, write out content
+   // Note: keep reading even if content output stream fails
+   int length = 2048;
+   mBuffer.clear();
+   mBuffer.allocateSpace(length, true);
+   int numBytes = 0;
+   while((numBytes = mBuffer.put(&is, length)) > 0)
+   {
+      rval = rval && os->write(mBuffer.data(), numBytes);
+      mBuffer.clear();
+   }
+
+   return rval && numBytes != -1;
+}
+
+InputStream* Http2Stream::getBodyInputStream(
+   HttpHeader* header, HttpTrailer* trailer)
+{
+   return new Http2StreamInputStream(this, trailer);
+}
+
+bool Http2Stream::writeBody(const char* b, int length, bool finish)
+{
+   bool rval = true;
+
+   if(mOutputClosed)
+   {
+      // ignore any body sent after a bodiless response (ie: HEAD)
+      if(length > 0 && !mHeadRequest)
+      {
+         ExceptionRef e = new Exception(
+            "Could not send HTTP/2 data. Stream already ended.",
+            "monarch.http.Http2.StreamClosed");
+         e->getDetails()["streamId"] = mId;
+         Exception::set(e);
+         rval = false;
+      }
+   }
+   else if((rval = mSession->sendData(this, b, length, finish)) && length > 0)
+   {
+      // update content bytes written (reset as necessary)
+      if(mContentBytesWritten > (UINT64_MAX / 2))
+      {
+         mContentBytesWritten = 0;
+      }
+      mContentBytesWritten += length;
+   }
+
+   return rval;
+}
+
+int Http2Stream::readBody(char* b, int length)
+{
+   int rval = mSession->receiveData(this, b, length);
+   if(rval > 0)
+   {
+      // update content bytes read (reset as necessary)
+      if(mContentBytesRead > (UINT64_MAX / 2))
+      {
+         mContentBytesRead = 0;
+      }
+      mContentBytesRead += rval;
+   }
+
+   return rval;
+}
+
+void Http2Stream::getTrailer(HttpTrailer* trailer)
+{
+   for(HpackHeaderList::iterator i = mTrailerFields.begin();
+       i != mTrailerFields.end(); ++i)
+   {
+      if(i->name[0] != ':')
+      {
+         trailer->addField(i->name.c_str(), i->value);
+      }
+   }
+}
+
+inline void Http2Stream::setReadTimeout(uint32_t timeout)
+{
+   mReadTimeout = timeout;
+}
+
+inline uint32_t Http2Stream::getReadTimeout()
+{
+   return mReadTimeout;
+}
+
+inline void Http2Stream::setWriteTimeout(uint32_t timeout)
+{
+   mWriteTimeout = timeout;
+}
+
+inline uint32_t Http2Stream::getWriteTimeout()
+{
+   return mWriteTimeout;
+}
+
+bool Http2Stream::isClosed()
+{
+   return mReset || mSession->isClosed();
+}
+
+void Http2Stream::close()
+{
+   // cancel the stream unless the response has been sent
+   mSession->resetStream(
+      this, mOutputClosed ? Http2Frame::NoError : Http2Frame::Cancel);
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_Http2Stream_H
+#define monarch_http_Http2Stream_H
+
+#include "monarch/http/HttpConnection.h"
+#include "monarch/http/HpackHeaderTable.h"
+
+namespace monarch
+{
+namespace http
+{
+
+// forward declare HTTP/2 connection
+class Http2Connection;
+
+/**
+ * An Http2Stream is a single HTTP/2 stream that is multiplexed with other
+ * streams over an Http2Connection. It presents the stream as an
+ * HttpConnection so that it can be serviced by existing
+ * HttpRequestServicers.
+ *
+ * The request received on the stream is presented as an "HTTP/1.1" request.
+ * The :authority pseudo-header is mapped to the "Host" field, multiple
+ * "Cookie" fields are joined, and a request that has a body but no
+ * "Content-Length" is marked with "Transfer-Encoding: chunked" so that it
+ * appears to have content. Message bodies are sent and received as DATA
+ * frames regardless of any transfer-encoding and connection-specific fields
+ * (ie: "Connection", "Transfer-Encoding") are not sent.
+ *
+ * Closing an Http2Stream resets the stream, it does not close the
+ * underlying connection. Read and write timeouts apply only to this stream.
+ * The input and output streams of the underlying connection must not be
+ * used directly.
+ *
+ * @author Dave Longley
+ */
+class Http2Stream : public HttpConnection
+{
+protected:
+   /**
+    * The HTTP/2 connection this stream belongs to.
+    */
+   Http2Connection* mSession;
+
+   /**
+    * The ID of this stream.
+    */
+   uint32_t mId;
+
+   /**
+    * The received request header fields, including pseudo-header fields.
+    */
+   HpackHeaderList mHeaderFields;
+
+   /**
+    * Any received trailer fields.
+    */
+   HpackHeaderList mTrailerFields;
+
+   /**
+    * Received DATA that has not been read yet.
+    */
+   monarch::io::ByteBuffer mInput;
+
+   /**
+    * The number of bytes that may be sent on this stream.
+    */
+   int64_t mSendWindow;
+
+   /**
+    * The number of bytes the peer may send on this stream.
+    */
+   int64_t mReceiveWindow;
+
+   /**
+    * The number of bytes that have been read but not yet returned to the
+    * peer's window.
+    */
+   uint32_t mReceiveConsumed;
+
+   /**
+    * True once the peer has ended its side of the stream.
+    */
+   bool mInputClosed;
+
+   /**
+    * True once this side of the stream has been ended.
+    */
+   bool mOutputClosed;
+
+   /**
+    * True once a final (non-informational) header has been sent.
+    */
+   bool mHeadersSent;
+
+   /**
+    * True once the stream has been reset by either side.
+    */
+   bool mReset;
+
+   /**
+    * True if the request method is HEAD.
+    */
+   bool mHeadRequest;
+
+   /**
+    * True if the request has a body (it was not ended by its HEADERS frame).
+    */
+   bool mHasBody;
+
+   /**
+    * The read timeout for this stream, in milliseconds.
+    */
+   uint32_t mReadTimeout;
+
+   /**
+    * The write timeout for this stream, in milliseconds.
+    */
+   uint32_t mWriteTimeout;
+
+   /**
+    * Http2Connection manages the state of its streams.
+    */
+   friend class Http2Connection;
+
+public:
+   /**
+    * Creates a new Http2Stream.
+    *
+    * @param session the HTTP/2 connection the stream belongs to.
+    * @param hc the HttpConnection the HTTP/2 connection is running over.
+    * @param id the ID of the stream.
+    * @param sendWindow the initial send window for the stream.
+    * @param receiveWindow the initial receive window for the stream.
+    */
+   Http2Stream(
+      Http2Connection* session, HttpConnection* hc, uint32_t id,
+      int64_t sendWindow, int64_t receiveWindow);
+
+   /**
+    * Destructs this Http2Stream.
+    */
+   virtual ~Http2Stream();
+
+   /**
+    * Gets the ID of this stream.
+    *
+    * @return the ID of this stream.
+    */
+   virtual uint32_t getId();
+
+   /**
+    * Gets the HTTP/2 connection this stream belongs to.
+    *
+    * @return the HTTP/2 connection.
+    */
+   virtual Http2Connection* getSession();
+
+   /**
+    * Gets the received request header fields, including pseudo-header
+    * fields (ie: ":method", ":path").
+    *
+    * @return the received request header fields.
+    */
+   virtual HpackHeaderList& getHeaderFields();
+
+   /**
+    * Sends a response header as a HEADERS frame. An informational (1xx)
+    * header may be sent before the final header. A trailer header is sent
+    * as a HEADERS frame that ends the stream.
+    *
+    * @param header the header to send.
+    *
+    * @return true if the header was sent, false if an Exception occurred.
+    */
+   virtual bool sendHeader(HttpHeader* header);
+
+   /**
+    * Populates a request header from the fields received on this stream.
+    *
+    * @param header the header to populate.
+    *
+    * @return true if the header was populated, false if an Exception
+    *         occurred.
+    */
+   virtual bool receiveHeader(HttpHeader* header);
+
+   /**
+    * Sends the message body for the given header as DATA frames.
+    *
+    * @param header the header to send the message body for.
+    * @param is the InputStream to read the body from.
+    * @param trailer any trailer headers to send if appropriate.
+    *
+    * @return true if the body was sent, false if an Exception occurred.
+    */
+   virtual bool sendBody(
+      HttpHeader* header, monarch::io::InputStream* is,
+      HttpTrailer* trailer = NULL);
+
+   /**
+    * Gets a heap-allocated OutputStream for sending a message body as DATA
+    * frames. The stream must be closed and deleted when it is finished being
+    * used. Closing the stream ends this side of the HTTP/2 stream.
+    *
+    * @param header the header to send the message body for.
+    * @param trailer any trailer headers to send if appropriate.
+    *
+    * @return the heap-allocated OutputStream for sending a message body.
+    */
+   virtual monarch::io::OutputStream* getBodyOutputStream(
+      HttpHeader* header, HttpTrailer* trailer = NULL);
+
+   /**
+    * Receives the message body from DATA frames.
+    *
+    * @param header the header to receive the message body for.
+    * @param os the OutputStream to write the body to.
+    * @param trailer used to store any received trailer headers.
+    *
+    * @return true if the body was received, false if an Exception occurred.
+    */
+   virtual bool receiveBody(
+      HttpHeader* header, monarch::io::OutputStream* os,
+      HttpTrailer* trailer = NULL);
+
+   /**
+    * Gets a heap-allocated InputStream for receiving a message body from
+    * DATA frames. The stream must be closed and deleted when it is finished
+    * being used.
+    *
+    * @param header the header to receive the message body for.
+    * @param trailer used to store any received trailer headers.
+    *
+    * @return the heap-allocated InputStream for receiving a message body.
+    */
+   virtual monarch::io::InputStream* getBodyInputStream(
+      HttpHeader* header, HttpTrailer* trailer = NULL);
+
+   /**
+    * Writes message body bytes to this stream as DATA frames. This method
+    * will block until the peer's flow-control window permits the data to be
+    * sent.
+    *
+    * @param b the bytes to write.
+    * @param length the number of bytes to write.
+    * @param finish true to end this side of the stream.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool writeBody(const char* b, int length, bool finish);
+
+   /**
+    * Reads message body bytes from this stream. This method will block
+    * until some data is available, the peer ends the stream, or the read
+    * timeout expires.
+    *
+    * @param b the buffer to read into.
+    * @param length the maximum number of bytes to read.
+    *
+    * @return the number of bytes read, 0 if the peer ended the stream, or
+    *         -1 if an Exception occurred.
+    */
+   virtual int readBody(char* b, int length);
+
+   /**
+    * Copies any received trailer fields into the given trailer.
+    *
+    * @param trailer the trailer to populate.
+    */
+   virtual void getTrailer(HttpTrailer* trailer);
+
+   /**
+    * Sets the read timeout for this stream.
+    *
+    * @param timeout the read timeout in milliseconds (0 for no timeout).
+    */
+   virtual void setReadTimeout(uint32_t timeout);
+
+   /**
+    * Gets the read timeout for this stream.
+    *
+    * @return the read timeout in milliseconds (0 for no timeout).
+    */
+   virtual uint32_t getReadTimeout();
+
+   /**
+    * Sets the write timeout for this stream.
+    *
+    * @param timeout the write timeout in milliseconds (0 for no timeout).
+    */
+   virtual void setWriteTimeout(uint32_t timeout);
+
+   /**
+    * Gets the write timeout for this stream.
+    *
+    * @return the write timeout in milliseconds (0 for no timeout).
+    */
+   virtual uint32_t getWriteTimeout();
+
+   /**
+    * Returns true if this stream has been reset or its connection has
+    * been closed.
+    *
+    * @return true if this stream is closed, false if not.
+    */
+   virtual bool isClosed();
+
+   /**
+    * Closes this stream by resetting it if it has not already ended. The
+    * underlying connection is not closed.
+    */
+   virtual void close();
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
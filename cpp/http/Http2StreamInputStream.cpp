@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/Http2StreamInputStream.h"
+
+using namespace monarch::io;
+using namespace monarch::http;
+
+Http2StreamInputStream::Http2StreamInputStream(
+   Http2Stream* stream, HttpTrailer* trailer) :
+   mStream(stream),
+   mTrailer(trailer),
+   mBytesReceived(0)
+{
+}
+
+Http2StreamInputStream::~Http2StreamInputStream()
+{
+}
+
+int Http2StreamInputStream::read(char* b, int length)
+{
+   int rval = mStream->readBody(b, length);
+   if(rval > 0)
+   {
+      mBytesReceived += rval;
+   }
+   else if(rval == 0 && mTrailer != NULL)
+   {
+      // body finished, update trailer
+      mStream->getTrailer(mTrailer);
+      mTrailer->update(mBytesReceived);
+   }
+
+   return rval;
+}
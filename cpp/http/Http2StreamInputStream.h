@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_Http2StreamInputStream_H
+#define monarch_http_Http2StreamInputStream_H
+
+#include "monarch/io/InputStream.h"
+#include "monarch/http/Http2Stream.h"
+#include "monarch/http/HttpTrailer.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An Http2StreamInputStream is used to receive a message body from the DATA
+ * frames of an Http2Stream. The end of the stream is reached when the peer
+ * ends the HTTP/2 stream, at which point any received trailer fields are
+ * copied into the trailer.
+ *
+ * @author Dave Longley
+ */
+class Http2StreamInputStream : public monarch::io::InputStream
+{
+protected:
+   /**
+    * The stream to receive from.
+    */
+   Http2Stream* mStream;
+
+   /**
+    * The trailer to populate, if any.
+    */
+   HttpTrailer* mTrailer;
+
+   /**
+    * The number of body bytes received.
+    */
+   int64_t mBytesReceived;
+
+public:
+   /**
+    * Creates a new Http2StreamInputStream.
+    *
+    * @param stream the Http2Stream to receive from.
+    * @param trailer the trailer to populate when the body ends.
+    */
+   Http2StreamInputStream(Http2Stream* stream, HttpTrailer* trailer);
+
+   /**
+    * Destructs this Http2StreamInputStream.
+    */
+   virtual ~Http2StreamInputStream();
+
+   /**
+    * Reads some bytes from the stream. This method will block until at least
+    * one byte can be read or until the end of the stream is reached. A
+    * value of 0 will be returned if the end of the stream has been reached,
+    * a value of -1 will be returned if an IO exception occurred, otherwise
+    * the number of bytes read will be returned.
+    *
+    * @param b the array of bytes to fill.
+    * @param length the maximum number of bytes to read into the buffer.
+    *
+    * @return the number of bytes read from the stream or 0 if the end of the
+    *         stream has been reached or -1 if an IO exception occurred.
+    */
+   virtual int read(char* b, int length);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/Http2StreamOutputStream.h"
+
+#include "monarch/http/Http2Connection.h"
+
+using namespace monarch::io;
+using namespace monarch::http;
+
+Http2StreamOutputStream::Http2StreamOutputStream(
+   Http2Stream* stream, HttpTrailer* trailer) :
+   mStream(stream),
+   mTrailer(trailer),
+   mBuffer(stream->getSession()->getPeerMaxFrameSize()),
+   mBytesWritten(0),
+   mFinished(false)
+{
+}
+
+Http2StreamOutputStream::~Http2StreamOutputStream()
+{
+}
+
+bool Http2StreamOutputStream::write(const char* b, int length)
+{
+   bool rval = true;
+
+   // fill buffer, sending a DATA frame each time it is full
+   while(rval && length > 0)
+   {
+      int n = mBuffer.put(b, length, false);
+      b += n;
+      length -= n;
+      mBytesWritten += n;
+      if(mBuffer.isFull())
+      {
+         rval = flush();
+      }
+   }
+
+   return rval;
+}
+
+bool Http2StreamOutputStream::flush()
+{
+   bool rval = true;
+
+   if(!mBuffer.isEmpty())
+   {
+      rval = mStream->writeBody(mBuffer.data(), mBuffer.length(), false);
+      mBuffer.clear();
+   }
+
+   return rval;
+}
+
+bool Http2StreamOutputStream::finish()
+{
+   bool rval = true;
+
+   if(!mFinished)
+   {
+      mFinished = true;
+
+      // update trailer with content length
+      if(mTrailer != NULL)
+      {
+         mTrailer->update(mBytesWritten);
+      }
+
+      if(mTrailer != NULL && mTrailer->getFieldCount() > 0)
+      {
+         // send remaining data, then end the stream with the trailer
+         rval = flush() && mStream->sendHeader(mTrailer);
+      }
+      else
+      {
+         // send remaining data and end the stream
+         rval = mStream->writeBody(mBuffer.data(), mBuffer.length(), true);
+         mBuffer.clear();
+      }
+   }
+
+   return rval;
+}
+
+void Http2StreamOutputStream::close()
+{
+   finish();
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_Http2StreamOutputStream_H
+#define monarch_http_Http2StreamOutputStream_H
+
+#include "monarch/io/ByteBuffer.h"
+#include "monarch/io/OutputStream.h"
+#include "monarch/http/Http2Stream.h"
+#include "monarch/http/HttpTrailer.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An Http2StreamOutputStream is used to send a message body over an
+ * Http2Stream. Written bytes are buffered and sent as DATA frames of up to
+ * the peer's maximum frame size. It must be closed when finished to send
+ * any remaining data and/or trailers and end the stream.
+ *
+ * @author Dave Longley
+ */
+class Http2StreamOutputStream : public monarch::io::OutputStream
+{
+protected:
+   /**
+    * The stream to send on.
+    */
+   Http2Stream* mStream;
+
+   /**
+    * The trailer to send, if any.
+    */
+   HttpTrailer* mTrailer;
+
+   /**
+    * A buffer for a single DATA frame.
+    */
+   monarch::io::ByteBuffer mBuffer;
+
+   /**
+    * The number of body bytes written.
+    */
+   int64_t mBytesWritten;
+
+   /**
+    * True once the stream has been finished.
+    */
+   bool mFinished;
+
+public:
+   /**
+    * Creates a new Http2StreamOutputStream.
+    *
+    * @param stream the Http2Stream to send on.
+    * @param trailer any trailer to send when finished.
+    */
+   Http2StreamOutputStream(Http2Stream* stream, HttpTrailer* trailer);
+
+   /**
+    * Destructs this Http2StreamOutputStream.
+    */
+   virtual ~Http2StreamOutputStream();
+
+   /**
+    * Writes some bytes to the stream.
+    *
+    * @param b the array of bytes to write.
+    * @param length the number of bytes to write to the stream.
+    *
+    * @return true if the write was successful, false if an IO exception
+    *         occurred.
+    */
+   virtual bool write(const char* b, int length);
+
+   /**
+    * Sends any buffered bytes as a DATA frame.
+    *
+    * @return true if the write was successful, false if an IO exception
+    *         occurred.
+    */
+   virtual bool flush();
+
+   /**
+    * Sends any buffered bytes and trailer and ends the stream.
+    *
+    * @return true if the write was successful, false if an IO exception
+    *         occurred.
+    */
+   virtual bool finish();
+
+   /**
+    * Finishes this stream. The underlying connection is not closed.
+    */
+   virtual void close();
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
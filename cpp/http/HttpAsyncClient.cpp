@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HttpAsyncClient.h"
+
+#include "monarch/http/HttpClient.h"
+#include "monarch/io/ByteArrayInputStream.h"
+#include "monarch/io/ByteArrayOutputStream.h"
+#include "monarch/io/ByteBuffer.h"
+#include "monarch/rt/DynamicObjectIterator.h"
+#include "monarch/rt/System.h"
+#include "monarch/rt/ThreadPool.h"
+
+#include <cstring>
+#include <strings.h>
+
+using namespace std;
+using namespace monarch::http;
+using namespace monarch::io;
+using namespace monarch::net;
+using namespace monarch::rt;
+using namespace monarch::util;
+
+#define DEFAULT_TIMEOUT   30000
+
+void HttpAsyncClient::Job::run()
+{
+   client->send(request);
+}
+
+HttpAsyncClient::HttpAsyncClient(unsigned int threads, SslContext* sc) :
+   mDispatcher(new ThreadPool(threads), true),
+   mSslContext(sc),
+   mCleanupSslContext(sc == NULL),
+   mDefaultTimeout(DEFAULT_TIMEOUT)
+{
+   mDispatcher.startDispatching();
+}
+
+HttpAsyncClient::~HttpAsyncClient()
+{
+   // stop sending requests, queued jobs are freed and their requests will
+   // time out or may be cancelled by their owners
+   mDispatcher.stopDispatching();
+   mDispatcher.clearQueuedJobs();
+   mDispatcher.terminateAllRunningJobs();
+
+   if(mCleanupSslContext)
+   {
+      delete mSslContext;
+   }
+}
+
+void HttpAsyncClient::setDefaultTimeout(uint32_t timeout)
+{
+   mDefaultTimeout = timeout;
+}
+
+uint32_t HttpAsyncClient::getDefaultTimeout()
+{
+   return mDefaultTimeout;
+}
+
+HttpConnectionPool* HttpAsyncClient::getConnectionPool()
+{
+   return &mConnectionPool;
+}
+
+void HttpAsyncClient::submit(HttpAsyncRequestRef& request)
+{
+   if(request->getTimeout() == 0)
+   {
+      request->setTimeout(mDefaultTimeout);
+   }
+   request->submitted();
+
+   Job* job = new Job;
+   job->client = this;
+   job->request = request;
+   RunnableRef ref = job;
+   mDispatcher.queueJob(ref);
+}
+
+HttpAsyncRequestRef HttpAsyncClient::get(
+   Url* url, DynamicObject* headers, uint32_t timeout)
+{
+   HttpAsyncRequestRef rval = new HttpAsyncRequest("GET", url);
+   if(headers != NULL)
+   {
+      rval->setHeaders(*headers);
+   }
+   rval->setTimeout(timeout);
+   submit(rval);
+   return rval;
+}
+
+HttpAsyncRequestRef HttpAsyncClient::post(
+   Url* url, DynamicObject* headers, const char* body, int length,
+   uint32_t timeout)
+{
+   HttpAsyncRequestRef rval = new HttpAsyncRequest("POST", url);
+   if(headers != NULL)
+   {
+      rval->setHeaders(*headers);
+   }
+   rval->setBody(body, length);
+   rval->setTimeout(timeout);
+   submit(rval);
+   return rval;
+}
+
+bool HttpAsyncClient::waitAll(HttpAsyncRequestList& requests, uint32_t timeout)
+{
+   bool rval = true;
+
+   uint64_t end = (timeout == 0) ?
+      0 : System::getCurrentMilliseconds() + timeout;
+   bool interrupted = false;
+   for(HttpAsyncRequestList::iterator i = requests.begin();
+       i != requests.end(); ++i)
+   {
+      // wait for the request until the overall deadline
+      bool finished = false;
+      if(!interrupted)
+      {
+         uint64_t now = System::getCurrentMilliseconds();
+         if(end == 0 || now < end)
+         {
+            finished = (*i)->wait((end == 0) ? 0 : (uint32_t)(end - now));
+            interrupted = !finished && Exception::isSet();
+         }
+      }
+
+      if(!finished)
+      {
+         // time the request out
+         ExceptionRef e = new Exception(
+            "HTTP request timed out.",
+            "monarch.http.RequestTimeout");
+         e->getDetails()["url"] = (*i)->getUrl()->toString().c_str();
+         e->getDetails()["timeout"] = timeout;
+         (*i)->finish(HttpAsyncRequest::TimedOut, e);
+      }
+
+      HttpAsyncRequest::State state = (*i)->getState();
+      if(state != HttpAsyncRequest::Completed &&
+         state != HttpAsyncRequest::Failed)
+      {
+         rval = false;
+      }
+   }
+
+   if(!rval && !interrupted)
+   {
+      ExceptionRef e = new Exception(
+         "Not all HTTP requests finished in time.",
+         "monarch.http.RequestTimeout");
+      e->getDetails()["timeout"] = timeout;
+      Exception::set(e);
+   }
+
+   return rval;
+}
+
+void HttpAsyncClient::send(HttpAsyncRequestRef& request)
+{
+   if(request->start())
+   {
+      Url* url = request->getUrl();
+
+      string data;
+      bool retry = HttpConnectionPool::isRetryable(
+         request->getMethod(), request->getBody(data));
+
+      HttpResponseHeader header;
+      string body;
+      bool success = false;
+      bool done = false;
+      while(!done)
+      {
+         // get the time left before the deadline
+         uint64_t deadline = request->getDeadline();
+         uint64_t now = System::getCurrentMilliseconds();
+         uint32_t remaining = (deadline == 0) ?
+            0 : (deadline > now ? (uint32_t)(deadline - now) : 1);
+
+         // check out an idle connection or permission to make a new one,
+         // waiting no longer than the deadline
+         HttpConnectionRef conn(NULL);
+         bool reused = false;
+         if(mConnectionPool.checkoutConnection(url, conn, NULL, remaining))
+         {
+            if(!conn.isNull())
+            {
+               reused = true;
+            }
+            else
+            {
+               HttpConnection* hc = createConnection(url, remaining);
+               if(hc != NULL)
+               {
+                  conn = hc;
+               }
+               else
+               {
+                  mConnectionPool.checkinConnection(url, conn, false);
+               }
+            }
+         }
+
+         if(conn.isNull())
+         {
+            done = true;
+         }
+         else
+         {
+            conn->setReadTimeout(remaining);
+            conn->setWriteTimeout(remaining);
+
+            bool reusable = false;
+            success = exchange(&(*request), &(*conn), header, body, reusable);
+            if(success || !reused || !retry)
+            {
+               done = true;
+            }
+            else
+            {
+               // the idle connection failed, so any others to the same
+               // server are unlikely to be usable either
+               mConnectionPool.removeConnections(url);
+               Exception::clear();
+               header.clearFields();
+               body.clear();
+            }
+
+            // return connection to the pool
+            mConnectionPool.checkinConnection(url, conn, reusable);
+         }
+      }
+
+      if(success)
+      {
+         request->finish(HttpAsyncRequest::Completed, NULL, &header, &body);
+      }
+      else if(!request->isFinished())
+      {
+         // checking whether the request finished times it out if its
+         // deadline passed, which is the likely cause of a socket timeout
+         ExceptionRef e = new Exception(
+            "HTTP request failed.",
+            "monarch.http.RequestFailed");
+         e->getDetails()["url"] = url->toString().c_str();
+         if(Exception::isSet())
+         {
+            ExceptionRef cause = Exception::get();
+            e->setCause(cause);
+         }
+         request->finish(HttpAsyncRequest::Failed, e);
+         Exception::clear();
+      }
+      else
+      {
+         Exception::clear();
+      }
+   }
+}
+
+bool HttpAsyncClient::exchange(
+   HttpAsyncRequest* request, HttpConnection* conn,
+   HttpResponseHeader& header, string& body, bool& reusable)
+{
+   bool rval;
+
+   reusable = false;
+   HttpRequest* req = conn->createRequest();
+   HttpResponse* res = req->createResponse();
+
+   // set request header
+   Url* url = request->getUrl();
+   HttpRequestHeader* reqHeader = req->getHeader();
+   reqHeader->setMethod(request->getMethod());
+   reqHeader->setPath(url->getPathAndQuery().c_str());
+   reqHeader->setVersion("HTTP/1.1");
+   reqHeader->setField("Host", url->getAuthority());
+   reqHeader->setField("User-Agent", "Monarch Http Client/2.0");
+   DynamicObject& headers = request->getHeaders();
+   if(!headers.isNull())
+   {
+      DynamicObjectIterator i = headers.getIterator();
+      while(i->hasNext())
+      {
+         DynamicObject& value = i->next();
+         const char* field = i->getName();
+         if(value->getType() == Array)
+         {
+            DynamicObjectIterator ai = value.getIterator();
+            while(ai->hasNext())
+            {
+               reqHeader->addField(field, ai->next()->getString());
+            }
+         }
+         else
+         {
+            reqHeader->setField(field, value->getString());
+         }
+      }
+   }
+
+   // send request and receive response header, skipping any 100 continue
+   string data;
+   if(request->getBody(data))
+   {
+      reqHeader->setField("Content-Length", (int64_t)data.length());
+      ByteArrayInputStream bais(data.c_str(), data.length());
+      rval = req->sendHeader() && req->sendBody(&bais);
+   }
+   else
+   {
+      rval = req->sendHeader();
+   }
+   rval = rval && res->receiveHeader();
+   while(rval && res->getHeader()->getStatusCode() == 100)
+   {
+      res->getHeader()->clearFields();
+      rval = res->receiveHeader();
+   }
+
+   if(rval)
+   {
+      // receive the body, if the response has one
+      HttpResponseHeader* resHeader = res->getHeader();
+      int code = resHeader->getStatusCode();
+      bool hasBody =
+         strcmp(request->getMethod(), "HEAD") != 0 &&
+         code >= 200 && code != 204 && code != 304;
+      if(hasBody)
+      {
+         ByteBuffer b(2048);
+         ByteArrayOutputStream baos(&b, true);
+         rval = res->receiveBody(&baos);
+         if(rval)
+         {
+            body.assign(b.data(), b.length());
+         }
+      }
+
+      if(rval)
+      {
+         reusable = HttpConnectionPool::isReusable(conn, resHeader, hasBody);
+         resHeader->writeTo(&header);
+      }
+   }
+
+   delete req;
+   delete res;
+
+   return rval;
+}
+
+HttpConnection* HttpAsyncClient::createConnection(Url* url, uint32_t timeout)
+{
+   HttpConnection* rval;
+
+   // round the timeout up to whole seconds, 0 means no timeout
+   unsigned int seconds = (timeout + 999) / 1000;
+   if(strcmp(url->getScheme().c_str(), "https") == 0)
+   {
+      mLock.lock();
+      {
+         // create ssl context if necessary
+         if(mSslContext == NULL)
+         {
+            mSslContext = new SslContext(NULL, true);
+         }
+      }
+      mLock.unlock();
+
+      rval = HttpClient::createSslConnection(
+         url, *mSslContext, mSslSessionCache, seconds);
+   }
+   else
+   {
+      rval = HttpClient::createConnection(url, NULL, NULL, seconds);
+   }
+
+   return rval;
+}
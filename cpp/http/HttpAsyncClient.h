@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HttpAsyncClient_H
+#define monarch_http_HttpAsyncClient_H
+
+#include "monarch/http/HttpAsyncRequest.h"
+#include "monarch/http/HttpConnectionPool.h"
+#include "monarch/net/SslContext.h"
+#include "monarch/net/SslSessionCache.h"
+#include "monarch/rt/JobDispatcher.h"
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HttpAsyncClient sends many HTTP requests concurrently. Requests are
+ * queued and sent by a bounded number of threads over pooled connections,
+ * so fanning a request out to dozens of backends does not take a thread per
+ * backend from the caller.
+ *
+ * Each request is an HttpAsyncRequest that is returned when it is submitted
+ * and can be used to wait for it, cancel it or get its response. A batch of
+ * requests can also be waited on with an overall deadline.
+ *
+ * A request without a body that fails on a reused connection, because the
+ * server closed it, is retried once on a new connection.
+ *
+ * @author Dave Longley
+ */
+class HttpAsyncClient
+{
+protected:
+   /**
+    * A job that sends a request on one of the client's threads.
+    */
+   struct Job : public monarch::rt::Runnable
+   {
+      HttpAsyncClient* client;
+      HttpAsyncRequestRef request;
+
+      virtual ~Job() {}
+      virtual void run();
+   };
+
+   /**
+    * The dispatcher that runs requests on the client's threads.
+    */
+   monarch::rt::JobDispatcher mDispatcher;
+
+   /**
+    * The pool of connections to reuse.
+    */
+   HttpConnectionPool mConnectionPool;
+
+   /**
+    * The SSL context for https urls, NULL until needed.
+    */
+   monarch::net::SslContext* mSslContext;
+
+   /**
+    * True to free the SSL context.
+    */
+   bool mCleanupSslContext;
+
+   /**
+    * The SSL sessions to resume.
+    */
+   monarch::net::SslSessionCache mSslSessionCache;
+
+   /**
+    * The time allowed for requests without their own timeout, in
+    * milliseconds, 0 for no limit.
+    */
+   uint32_t mDefaultTimeout;
+
+   /**
+    * A lock for creating the SSL context.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+public:
+   /**
+    * Creates a new HttpAsyncClient.
+    *
+    * @param threads the maximum number of requests to send at once.
+    * @param sc the SSL context to use for https urls, NULL to create one
+    *           when needed.
+    */
+   HttpAsyncClient(
+      unsigned int threads = 8, monarch::net::SslContext* sc = NULL);
+
+   /**
+    * Destructs this HttpAsyncClient. Requests that have not been sent are
+    * cancelled and requests being sent are interrupted.
+    */
+   virtual ~HttpAsyncClient();
+
+   /**
+    * Sets the time allowed for requests that have no timeout of their own.
+    *
+    * @param timeout the timeout in milliseconds, 0 for no limit.
+    */
+   virtual void setDefaultTimeout(uint32_t timeout);
+
+   /**
+    * Gets the time allowed for requests that have no timeout of their own.
+    *
+    * @return the timeout in milliseconds, 0 for no limit.
+    */
+   virtual uint32_t getDefaultTimeout();
+
+   /**
+    * Gets the pool of connections used by this client, so that its limits
+    * can be set.
+    *
+    * @return the connection pool.
+    */
+   virtual HttpConnectionPool* getConnectionPool();
+
+   /**
+    * Submits a request to be sent. The request's deadline starts now.
+    *
+    * @param request the request to send.
+    */
+   virtual void submit(HttpAsyncRequestRef& request);
+
+   /**
+    * Creates and submits a GET request.
+    *
+    * @param url the url to get.
+    * @param headers custom request header fields, NULL for none.
+    * @param timeout the time allowed for the request in milliseconds, 0 to
+    *           use the default timeout.
+    *
+    * @return the request.
+    */
+   virtual HttpAsyncRequestRef get(
+      monarch::util::Url* url, monarch::rt::DynamicObject* headers = NULL,
+      uint32_t timeout = 0);
+
+   /**
+    * Creates and submits a POST request.
+    *
+    * @param url the url to post to.
+    * @param headers custom request header fields, NULL for none.
+    * @param body the body to post.
+    * @param length the length of the body.
+    * @param timeout the time allowed for the request in milliseconds, 0 to
+    *           use the default timeout.
+    *
+    * @return the request.
+    */
+   virtual HttpAsyncRequestRef post(
+      monarch::util::Url* url, monarch::rt::DynamicObject* headers,
+      const char* body, int length, uint32_t timeout = 0);
+
+   /**
+    * Waits for all of the given requests to finish. Any request that has
+    * not finished when the overall timeout expires times out.
+    *
+    * @param requests the requests to wait for.
+    * @param timeout the overall time to wait in milliseconds, 0 to wait
+    *           until all requests finish.
+    *
+    * @return true if every request completed or failed on its own, false if
+    *         any timed out, was cancelled or the thread was interrupted (an
+    *         exception will be set).
+    */
+   virtual bool waitAll(HttpAsyncRequestList& requests, uint32_t timeout = 0);
+
+protected:
+   /**
+    * Sends a request and receives its response. Called on one of the
+    * client's threads.
+    *
+    * @param request the request to send.
+    */
+   virtual void send(HttpAsyncRequestRef& request);
+
+   /**
+    * Sends a request over a connection and receives its response.
+    *
+    * @param request the request to send.
+    * @param conn the connection to use.
+    * @param header set to the response header.
+    * @param body set to the response body.
+    * @param reusable set to true if the connection can be reused.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool exchange(
+      HttpAsyncRequest* request, HttpConnection* conn,
+      HttpResponseHeader& header, std::string& body, bool& reusable);
+
+   /**
+    * Creates a new connection for a request.
+    *
+    * @param url the url to connect to.
+    * @param timeout the connect timeout in milliseconds, 0 for no limit.
+    *
+    * @return the connection, NULL if an exception occurred.
+    */
+   virtual HttpConnection* createConnection(
+      monarch::util::Url* url, uint32_t timeout);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
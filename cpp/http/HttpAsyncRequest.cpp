@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HttpAsyncRequest.h"
+
+#include "monarch/rt/System.h"
+
+using namespace std;
+using namespace monarch::http;
+using namespace monarch::rt;
+using namespace monarch::util;
+
+HttpAsyncRequest::HttpAsyncRequest(const char* method, Url* url) :
+   mMethod(method),
+   mUrl(new Url(*url)),
+   mHeaders(NULL),
+   mHasBody(false),
+   mTimeout(0),
+   mDeadline(0),
+   mState(Pending)
+{
+}
+
+HttpAsyncRequest::~HttpAsyncRequest()
+{
+}
+
+const char* HttpAsyncRequest::getMethod()
+{
+   return mMethod.c_str();
+}
+
+Url* HttpAsyncRequest::getUrl()
+{
+   return &(*mUrl);
+}
+
+void HttpAsyncRequest::setHeaders(DynamicObject& headers)
+{
+   mHeaders = headers;
+}
+
+DynamicObject& HttpAsyncRequest::getHeaders()
+{
+   return mHeaders;
+}
+
+void HttpAsyncRequest::setBody(const char* body, int length)
+{
+   mBody.assign(body, length);
+   mHasBody = true;
+}
+
+bool HttpAsyncRequest::getBody(string& body)
+{
+   if(mHasBody)
+   {
+      body = mBody;
+   }
+   return mHasBody;
+}
+
+void HttpAsyncRequest::setTimeout(uint32_t timeout)
+{
+   mTimeout = timeout;
+}
+
+uint32_t HttpAsyncRequest::getTimeout()
+{
+   return mTimeout;
+}
+
+uint64_t HttpAsyncRequest::getDeadline()
+{
+   return mDeadline;
+}
+
+void HttpAsyncRequest::setCallback(RunnableRef& callback)
+{
+   mCallback = callback;
+}
+
+HttpAsyncRequest::State HttpAsyncRequest::getState()
+{
+   State rval;
+
+   bool timedOut;
+   mLock.lock();
+   {
+      timedOut = checkDeadline();
+      rval = mState;
+   }
+   mLock.unlock();
+
+   if(timedOut && !mCallback.isNull())
+   {
+      mCallback->run();
+   }
+
+   return rval;
+}
+
+bool HttpAsyncRequest::isFinished()
+{
+   State state = getState();
+   return state != Pending && state != Running;
+}
+
+bool HttpAsyncRequest::wait(uint32_t timeout)
+{
+   bool rval = false;
+
+   bool timedOut = false;
+   mLock.lock();
+   {
+      // wait until finished, the wait times out or the deadline passes
+      uint64_t end = (timeout == 0) ?
+         0 : System::getCurrentMilliseconds() + timeout;
+      bool interrupted = false;
+      while(!interrupted && !rval)
+      {
+         if(mState != Pending && mState != Running)
+         {
+            rval = true;
+         }
+         else if(checkDeadline())
+         {
+            timedOut = true;
+            rval = true;
+         }
+         else
+         {
+            // wake up for the earlier of the end of the wait or the deadline
+            uint64_t now = System::getCurrentMilliseconds();
+            uint64_t wake = end;
+            if(mDeadline != 0 && (wake == 0 || mDeadline < wake))
+            {
+               wake = mDeadline;
+            }
+            if(end != 0 && now >= end)
+            {
+               break;
+            }
+            interrupted = !mLock.wait(
+               (wake == 0) ? 0 : (uint32_t)(wake - now));
+         }
+      }
+   }
+   mLock.unlock();
+
+   if(timedOut && !mCallback.isNull())
+   {
+      mCallback->run();
+   }
+
+   return rval;
+}
+
+bool HttpAsyncRequest::cancel()
+{
+   ExceptionRef e = new Exception(
+      "HTTP request cancelled.",
+      "monarch.http.RequestCancelled");
+   e->getDetails()["url"] = mUrl->toString().c_str();
+   return finish(Cancelled, e);
+}
+
+HttpResponseHeader* HttpAsyncRequest::getResponseHeader()
+{
+   return &mResponseHeader;
+}
+
+int HttpAsyncRequest::getStatusCode()
+{
+   return (getState() == Completed) ? mResponseHeader.getStatusCode() : 0;
+}
+
+string& HttpAsyncRequest::getResponseBody()
+{
+   return mResponseBody;
+}
+
+ExceptionRef& HttpAsyncRequest::getException()
+{
+   return mException;
+}
+
+void HttpAsyncRequest::submitted()
+{
+   mLock.lock();
+   {
+      mState = Pending;
+      mDeadline = (mTimeout == 0) ?
+         0 : System::getCurrentMilliseconds() + mTimeout;
+   }
+   mLock.unlock();
+}
+
+bool HttpAsyncRequest::start()
+{
+   bool rval = false;
+
+   bool timedOut = false;
+   mLock.lock();
+   {
+      timedOut = checkDeadline();
+      if(mState == Pending)
+      {
+         mState = Running;
+         rval = true;
+      }
+   }
+   mLock.unlock();
+
+   if(timedOut && !mCallback.isNull())
+   {
+      mCallback->run();
+   }
+
+   return rval;
+}
+
+bool HttpAsyncRequest::finish(
+   State state, ExceptionRef e, HttpResponseHeader* header, string* body)
+{
+   bool rval = false;
+
+   mLock.lock();
+   {
+      if(mState == Pending || mState == Running)
+      {
+         mState = state;
+         mException = e;
+         if(header != NULL)
+         {
+            header->writeTo(&mResponseHeader);
+         }
+         if(body != NULL)
+         {
+            mResponseBody.swap(*body);
+         }
+         mLock.notifyAll();
+         rval = true;
+      }
+   }
+   mLock.unlock();
+
+   if(rval && !mCallback.isNull())
+   {
+      mCallback->run();
+   }
+
+   return rval;
+}
+
+bool HttpAsyncRequest::checkDeadline()
+{
+   bool rval = false;
+
+   if((mState == Pending || mState == Running) && mDeadline != 0 &&
+      System::getCurrentMilliseconds() >= mDeadline)
+   {
+      ExceptionRef e = new Exception(
+         "HTTP request timed out.",
+         "monarch.http.RequestTimeout");
+      e->getDetails()["url"] = mUrl->toString().c_str();
+      e->getDetails()["timeout"] = mTimeout;
+      mState = TimedOut;
+      mException = e;
+      mLock.notifyAll();
+      rval = true;
+   }
+
+   return rval;
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HttpAsyncRequest_H
+#define monarch_http_HttpAsyncRequest_H
+
+#include "monarch/http/HttpResponseHeader.h"
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/Exception.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/Runnable.h"
+#include "monarch/util/Url.h"
+
+#include <string>
+#include <vector>
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HttpAsyncRequest is a request that is sent by an HttpAsyncClient on one
+ * of its threads. It is a handle that can be used to wait for the request to
+ * finish and to get its response once it has.
+ *
+ * A request may have a deadline, counted from when it is submitted. If the
+ * deadline passes before the response has been received, the request times
+ * out. A request may also have a callback that is run once when it
+ * finishes, either on the client thread that sent it or on the thread that
+ * noticed that it timed out or cancelled it.
+ *
+ * @author Dave Longley
+ */
+class HttpAsyncRequest
+{
+public:
+   /**
+    * The states of a request.
+    */
+   enum State
+   {
+      Pending, Running, Completed, Failed, TimedOut, Cancelled
+   };
+
+protected:
+   /**
+    * The request method.
+    */
+   std::string mMethod;
+
+   /**
+    * The url to request.
+    */
+   monarch::util::UrlRef mUrl;
+
+   /**
+    * Custom request header fields.
+    */
+   monarch::rt::DynamicObject mHeaders;
+
+   /**
+    * The request body, if any.
+    */
+   std::string mBody;
+
+   /**
+    * True if a body is to be sent.
+    */
+   bool mHasBody;
+
+   /**
+    * The time allowed for the request, in milliseconds, 0 for no limit.
+    */
+   uint32_t mTimeout;
+
+   /**
+    * The time at which the request times out, 0 for never.
+    */
+   uint64_t mDeadline;
+
+   /**
+    * The callback to run when the request finishes.
+    */
+   monarch::rt::RunnableRef mCallback;
+
+   /**
+    * The state of the request.
+    */
+   State mState;
+
+   /**
+    * The response header.
+    */
+   HttpResponseHeader mResponseHeader;
+
+   /**
+    * The response body.
+    */
+   std::string mResponseBody;
+
+   /**
+    * The exception if the request failed, timed out or was cancelled.
+    */
+   monarch::rt::ExceptionRef mException;
+
+   /**
+    * A lock for the state of the request.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+public:
+   /**
+    * Creates a new HttpAsyncRequest.
+    *
+    * @param method the request method, ie: "GET".
+    * @param url the url to request.
+    */
+   HttpAsyncRequest(const char* method, monarch::util::Url* url);
+
+   /**
+    * Destructs this HttpAsyncRequest.
+    */
+   virtual ~HttpAsyncRequest();
+
+   /**
+    * Gets the request method.
+    *
+    * @return the request method.
+    */
+   virtual const char* getMethod();
+
+   /**
+    * Gets the url to request.
+    *
+    * @return the url.
+    */
+   virtual monarch::util::Url* getUrl();
+
+   /**
+    * Sets custom request header fields, as a map of field names to values.
+    *
+    * @param headers the header fields.
+    */
+   virtual void setHeaders(monarch::rt::DynamicObject& headers);
+
+   /**
+    * Gets the custom request header fields.
+    *
+    * @return the header fields, NULL if there are none.
+    */
+   virtual monarch::rt::DynamicObject& getHeaders();
+
+   /**
+    * Sets the request body.
+    *
+    * @param body the body.
+    * @param length the length of the body.
+    */
+   virtual void setBody(const char* body, int length);
+
+   /**
+    * Gets the request body.
+    *
+    * @param body set to the body.
+    *
+    * @return true if there is a body, false if not.
+    */
+   virtual bool getBody(std::string& body);
+
+   /**
+    * Sets the time allowed for this request from when it is submitted until
+    * its response has been received.
+    *
+    * @param timeout the timeout in milliseconds, 0 for no limit.
+    */
+   virtual void setTimeout(uint32_t timeout);
+
+   /**
+    * Gets the time allowed for this request.
+    *
+    * @return the timeout in milliseconds, 0 for no limit.
+    */
+   virtual uint32_t getTimeout();
+
+   /**
+    * Gets the time at which this request times out. This is set when the
+    * request is submitted.
+    *
+    * @return the deadline in milliseconds, 0 for never.
+    */
+   virtual uint64_t getDeadline();
+
+   /**
+    * Sets a callback to run when this request finishes. This must be set
+    * before the request is submitted.
+    *
+    * @param callback the callback.
+    */
+   virtual void setCallback(monarch::rt::RunnableRef& callback);
+
+   /**
+    * Gets the state of this request.
+    *
+    * @return the state.
+    */
+   virtual State getState();
+
+   /**
+    * Returns true if this request has finished, whether it completed,
+    * failed, timed out or was cancelled.
+    *
+    * @return true if finished, false if not.
+    */
+   virtual bool isFinished();
+
+   /**
+    * Waits for this request to finish. If the request's deadline passes
+    * while waiting, the request times out.
+    *
+    * @param timeout the maximum time to wait in milliseconds, 0 to wait until
+    *           the request finishes.
+    *
+    * @return true if the request finished, false if the wait timed out or
+    *         the thread was interrupted (an exception will be set if
+    *         interrupted).
+    */
+   virtual bool wait(uint32_t timeout = 0);
+
+   /**
+    * Cancels this request if it has not finished. A request that is running
+    * keeps running but its response is discarded.
+    *
+    * @return true if cancelled, false if the request had already finished.
+    */
+   virtual bool cancel();
+
+   /**
+    * Gets the response header. Only valid once the request has completed.
+    *
+    * @return the response header.
+    */
+   virtual HttpResponseHeader* getResponseHeader();
+
+   /**
+    * Gets the response status code.
+    *
+    * @return the status code, 0 if the request did not complete.
+    */
+   virtual int getStatusCode();
+
+   /**
+    * Gets the response body. Only valid once the request has completed.
+    *
+    * @return the response body.
+    */
+   virtual std::string& getResponseBody();
+
+   /**
+    * Gets the exception that caused this request to fail, time out or be
+    * cancelled.
+    *
+    * @return the exception, NULL if there is none.
+    */
+   virtual monarch::rt::ExceptionRef& getException();
+
+   /**
+    * Marks this request as submitted, starting its deadline. Called by the
+    * client.
+    */
+   virtual void submitted();
+
+   /**
+    * Marks this request as running unless it has already finished. Called
+    * by the client.
+    *
+    * @return true if the request should be sent, false if it has already
+    *         finished.
+    */
+   virtual bool start();
+
+   /**
+    * Finishes this request and runs its callback unless it has already
+    * finished. Called by the client or when the request times out or is
+    * cancelled.
+    *
+    * @param state the final state.
+    * @param e the exception for a failure, timeout or cancellation.
+    * @param header the response header, if completed.
+    * @param body the response body, if completed.
+    *
+    * @return true if this call finished the request, false if it had already
+    *         finished.
+    */
+   virtual bool finish(
+      State state, monarch::rt::ExceptionRef e,
+      HttpResponseHeader* header = NULL, std::string* body = NULL);
+
+protected:
+   /**
+    * Times this request out if its deadline has passed.
+    *
+    * @return true if this call timed the request out, false if not.
+    */
+   virtual bool checkDeadline();
+};
+
+// type definitions for HttpAsyncRequests
+typedef monarch::rt::Collectable<HttpAsyncRequest> HttpAsyncRequestRef;
+typedef std::vector<HttpAsyncRequestRef> HttpAsyncRequestList;
+
+} // end namespace http
+} // end namespace monarch
+#endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpChunkedTransferOutputStream.h"
 
@@ -44,18 +44,27 @@ bool HttpChunkedTransferOutputStream::write(const char* b, int length)
    int numBytes;
    while(rval && length > 0)
    {
-      // put bytes into buffer, but only up to chunk size
-      max = mChunkSize - mBuffer->length();
-      numBytes = mBuffer->put(b, (max > length) ? length : max, false);
-
-      // update data left to be written
-      b += numBytes;
-      length -= numBytes;
-
-      // flush buffer if chunk size reached
-      if(mBuffer->length() == mChunkSize)
+      // send large writes directly
+      if(mBuffer->isEmpty() && length >= mChunkSize)
+      {
+         rval = writeChunk(b, length);
+         length = 0;
+      }
+      else
       {
-         rval = flush();
+         // put bytes into buffer, but only up to chunk size
+         max = mChunkSize - mBuffer->length();
+         numBytes = mBuffer->put(b, (max > length) ? length : max, false);
+
+         // update data left to be written
+         b += numBytes;
+         length -= numBytes;
+
+         // flush buffer if chunk size reached
+         if(mBuffer->length() == mChunkSize)
+         {
+            rval = flush();
+         }
       }
    }
 
@@ -99,6 +108,25 @@ bool HttpChunkedTransferOutputStream::flush()
    return rval;
 }
 
+bool HttpChunkedTransferOutputStream::writeChunk(const char* b, int length)
+{
+   // update data sent
+   mDataSent += length;
+
+   // get the chunk-size and add CRLF
+   string chunkSize = Convert::intToHex(length);
+   chunkSize.append(HttpHeader::CRLF, 2);
+
+   // write chunk-size + CRLF
+   // write chunk data + CRLF
+   // flush
+   return
+      mOutputStream->write(chunkSize.c_str(), chunkSize.length()) &&
+      mOutputStream->write(b, length) &&
+      mOutputStream->write(HttpHeader::CRLF, 2) &&
+      mOutputStream->flush();
+}
+
 bool HttpChunkedTransferOutputStream::finish()
 {
    bool rval = true;
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_http_HttpChunkedTransferOutputStream_H
 #define monarch_http_HttpChunkedTransferOutputStream_H
@@ -124,7 +124,9 @@ public:
    virtual ~HttpChunkedTransferOutputStream();
 
    /**
-    * Writes some bytes to the stream.
+    * Writes some bytes to the stream. Writes of at least the chunk size that
+    * find the buffer empty are sent as a single chunk without being copied
+    * into the buffer.
     *
     * @param b the array of bytes to write.
     * @param length the number of bytes to write to the stream.
@@ -156,6 +158,18 @@ public:
     * Closes the stream.
     */
    virtual void close();
+
+protected:
+   /**
+    * Sends some bytes as a single chunk. The buffer must be empty.
+    *
+    * @param b the chunk data.
+    * @param length the number of bytes in the chunk.
+    *
+    * @return true if the write was successful, false if an IO exception
+    *         occurred.
+    */
+   virtual bool writeChunk(const char* b, int length);
 };
 
 } // end namespace http
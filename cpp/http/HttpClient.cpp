@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpClient.h"
 
@@ -271,9 +271,30 @@ HttpConnection* HttpClient::createSslConnection(
       commonNames, includeHost, vHost);
    if(rval != NULL)
    {
-      // store session
-      session = static_cast<SslSocket*>(rval->getSocket())->getSession();
-      cache.storeSession(url, session, vHost);
+      // perform the handshake now so the established session can be cached
+      rval->setReadTimeout(timeout * 1000);
+      rval->setWriteTimeout(timeout * 1000);
+      SslSocket* ss = static_cast<SslSocket*>(rval->getSocket());
+      if(ss->performHandshake())
+      {
+         // record resumption and store session
+         cache.recordHandshake(ss->isSessionReused());
+         session = ss->getSession();
+         cache.storeSession(url, session, vHost);
+      }
+      else
+      {
+         ExceptionRef e = new Exception(
+            "Could not establish HTTP connection.",
+            "monarch.http.ConnectError");
+         e->getDetails()["url"] = url->toString().c_str();
+         Exception::push(e);
+
+         // close and clean up connection
+         rval->close();
+         delete rval;
+         rval = NULL;
+      }
    }
 
    return rval;
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_http_HttpClient_H
 #define monarch_http_HttpClient_H
@@ -235,7 +235,8 @@ public:
    /**
     * Creates an SSL connection to the passed url. This is the preferred
     * method for establishing an SSL connection because an SSL session cache
-    * is used.
+    * is used. The SSL handshake is performed before returning so that the
+    * established session can be stored in the cache.
     *
     * The caller of this method is responsible for deleting the returned
     * connection. If an exception occurs, it can be retrieved via
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpConnection.h"
 
@@ -10,6 +10,7 @@
 #include "monarch/http/HttpBodyOutputStream.h"
 #include "monarch/http/HttpChunkedTransferInputStream.h"
 #include "monarch/http/HttpChunkedTransferOutputStream.h"
+#include "monarch/rt/System.h"
 #include "monarch/rt/Thread.h"
 
 using namespace std;
@@ -41,6 +42,12 @@ HttpRequest* HttpConnection::createRequest()
 
 inline bool HttpConnection::sendHeader(HttpHeader* header)
 {
+   // mark when a response started to be sent
+   if(mRequestState != NULL && header->getType() == HttpHeader::Response)
+   {
+      mRequestState->responseStarted();
+   }
+
    // resize output buffer to hold header, send header
    ConnectionOutputStream* os = getOutputStream();
    os->resizeBuffer(1024);
@@ -58,12 +65,23 @@ bool HttpConnection::receiveHeader(HttpHeader* header)
    // FIXME: read a few bytes first to check for valid HTTP data to prevent
    // DOS attacks? add maximum line cap param to readCrlf() on input stream?
    int read;
+   uint64_t start = 0;
    while((read = is->readCrlf(line)) > 0 && line.length() > 0)
    {
+      if(start == 0)
+      {
+         start = System::getMonotonicMicroseconds();
+      }
       headerStr.append(line);
       headerStr.append(HttpHeader::CRLF);
    }
 
+   // keep when a request header started to arrive, 0 if none did
+   if(header->getType() == HttpHeader::Request)
+   {
+      getRequestState()->setHeaderStartTime(start);
+   }
+
    if(read == -1)
    {
       // read failed
@@ -1,12 +1,15 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpConnectionMonitor.h"
 #include "monarch/data/json/JsonWriter.h"
 #include "monarch/logging/Logging.h"
 #include "monarch/rt/Atomic.h"
+#include "monarch/rt/System.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 using namespace std;
 using namespace monarch::io;
@@ -43,12 +46,47 @@ HttpConnectionMonitor::HttpConnectionMonitor() :
    mTotalStatus5xx(0),
    mTotalStatusOther(0)
 {
+   mThreadLatency = new ThreadLocal(&threadLatencyExited);
 }
 
 HttpConnectionMonitor::~HttpConnectionMonitor()
 {
+   // deleting the thread local prevents any further cleanup by exiting
+   // threads
+   delete mThreadLatency;
+
+   // free all threads' latency histograms
+   for(vector<ThreadLatency*>::iterator i = mThreadLatencies.begin();
+       i != mThreadLatencies.end(); ++i)
+   {
+      for(RouteLatencyMap::iterator ri = (*i)->routes.begin();
+          ri != (*i)->routes.end(); ++ri)
+      {
+         delete ri->second;
+      }
+      delete *i;
+   }
+   for(RouteLatencyMap::iterator i = mRetiredLatencies.begin();
+       i != mRetiredLatencies.end(); ++i)
+   {
+      delete i->second;
+   }
 }
 
+/**
+ * The names of the latencies in stats, in the order of the Latency enum.
+ */
+static const char* sLatencyNames[HttpConnectionMonitor::LatencyCount] =
+{
+   "request", "header", "handler", "send"
+};
+
+/**
+ * The magic bytes that start a latency snapshot.
+ */
+#define SNAPSHOT_MAGIC     "MOLH"
+#define SNAPSHOT_VERSION   1
+
 DynamicObject HttpConnectionMonitor::getStats()
 {
    DynamicObject rval;
@@ -70,6 +108,178 @@ DynamicObject HttpConnectionMonitor::getStats()
    rval["totalStatus5xx"] = Atomic::load(&mTotalStatus5xx);
    rval["totalStatusOther"] = Atomic::load(&mTotalStatusOther);
 
+   // merge latencies of all threads, then sum them across all routes
+   RouteLatencyMap routes;
+   mergeLatencies(routes);
+   RouteLatency all;
+   DynamicObject& stats = rval["routes"];
+   stats->setType(Map);
+   for(RouteLatencyMap::iterator i = routes.begin(); i != routes.end(); ++i)
+   {
+      for(int n = 0; n < LatencyCount; ++n)
+      {
+         all.histograms[n].merge(i->second->histograms[n]);
+      }
+      if(i->first.length() > 0)
+      {
+         stats[i->first.c_str()] = getLatencyStats(*i->second);
+      }
+      delete i->second;
+   }
+   rval["latency"] = getLatencyStats(all);
+
+   mLatencyLock.lock();
+   rval["latencyThreads"] = (uint32_t)mThreadLatencies.size();
+   mLatencyLock.unlock();
+
+   return rval;
+}
+
+void HttpConnectionMonitor::recordLatency(
+   const char* route, Latency latency, uint64_t time)
+{
+   // get the current thread's histograms, adding them the first time
+   ThreadLatency* tl = static_cast<ThreadLatency*>(mThreadLatency->get());
+   if(tl == NULL)
+   {
+      tl = new ThreadLatency;
+      tl->monitor = this;
+      mThreadLatency->set(tl);
+      mLatencyLock.lock();
+      mThreadLatencies.push_back(tl);
+      mLatencyLock.unlock();
+   }
+
+   // only this thread adds routes, so they can be found without locking
+   string key = (route == NULL) ? "" : route;
+   RouteLatencyMap::iterator i = tl->routes.find(key);
+   RouteLatency* rl;
+   if(i != tl->routes.end())
+   {
+      rl = i->second;
+   }
+   else
+   {
+      rl = new RouteLatency;
+      tl->lock.lock();
+      tl->routes[key] = rl;
+      tl->lock.unlock();
+   }
+
+   rl->histograms[latency].record(time);
+}
+
+/**
+ * Appends a big-endian integer to a string.
+ *
+ * @param out the string to append to.
+ * @param value the value to append.
+ * @param size the number of bytes to write.
+ */
+static void _writeInt(string& out, uint32_t value, int size)
+{
+   for(int i = size - 1; i >= 0; --i)
+   {
+      out.push_back((char)((value >> (i * 8)) & 0xFF));
+   }
+}
+
+/**
+ * Reads a big-endian integer.
+ *
+ * @param data the data to read from, updated to point after the integer.
+ * @param end the end of the data.
+ * @param size the number of bytes to read.
+ * @param value set to the value read.
+ *
+ * @return true if successful, false if the data ended too early.
+ */
+static bool _readInt(
+   const char*& data, const char* end, int size, uint32_t& value)
+{
+   bool rval = (end - data >= size);
+   if(rval)
+   {
+      value = 0;
+      for(int i = 0; i < size; ++i)
+      {
+         value = (value << 8) | (unsigned char)*(data++);
+      }
+   }
+   return rval;
+}
+
+void HttpConnectionMonitor::getLatencySnapshot(string& out)
+{
+   RouteLatencyMap routes;
+   mergeLatencies(routes);
+
+   out.append(SNAPSHOT_MAGIC, 4);
+   out.push_back((char)SNAPSHOT_VERSION);
+   _writeInt(out, routes.size(), 4);
+   for(RouteLatencyMap::iterator i = routes.begin(); i != routes.end(); ++i)
+   {
+      // routes are limited to what fits in the length
+      size_t length = (i->first.length() > 0xFFFF) ?
+         0xFFFF : i->first.length();
+      _writeInt(out, length, 2);
+      out.append(i->first.c_str(), length);
+      for(int n = 0; n < LatencyCount; ++n)
+      {
+         i->second->histograms[n].serialize(out);
+      }
+      delete i->second;
+   }
+}
+
+bool HttpConnectionMonitor::readLatencySnapshot(
+   const char* data, int length, DynamicObject& stats)
+{
+   bool rval;
+
+   const char* end = data + length;
+   uint32_t count;
+   rval =
+      length >= 5 && memcmp(data, SNAPSHOT_MAGIC, 4) == 0 &&
+      data[4] == SNAPSHOT_VERSION;
+   if(rval)
+   {
+      data += 5;
+      rval = _readInt(data, end, 4, count);
+   }
+
+   stats = DynamicObject();
+   stats->setType(Map);
+   for(uint32_t i = 0; rval && i < count; ++i)
+   {
+      uint32_t size;
+      rval = _readInt(data, end, 2, size) && end - data >= (int)size;
+      if(rval)
+      {
+         string route(data, size);
+         data += size;
+         RouteLatency rl;
+         for(int n = 0; rval && n < LatencyCount; ++n)
+         {
+            int read = rl.histograms[n].deserialize(data, end - data);
+            data += read;
+            rval = (read > 0);
+         }
+         if(rval)
+         {
+            stats[route.c_str()] = getLatencyStats(rl);
+         }
+      }
+   }
+
+   if(!rval)
+   {
+      ExceptionRef e = new Exception(
+         "Invalid latency snapshot.",
+         "monarch.http.InvalidLatencySnapshot");
+      Exception::set(e);
+   }
+
    return rval;
 }
 
@@ -148,6 +358,39 @@ void HttpConnectionMonitor::afterRequest(HttpConnection* connection)
    Atomic::addAndFetch(
       &mTotalContentBytesWritten, d["contentBytesWritten"]->getUInt64());
 
+   // latencies of the request and its phases in microseconds, the header
+   // start time is unknown if the header was not read by this connection,
+   // errors without a response (ie: an idle connection that was closed) are
+   // not requests that can be measured
+   uint64_t response = state->getResponseStartTime();
+   if(response != 0 || !d->hasMember("isError") || !d["isError"]->getBoolean())
+   {
+      uint64_t now = System::getMonotonicMicroseconds();
+      uint64_t start = state->getServiceStartTime();
+      uint64_t header = state->getHeaderStartTime();
+      const char* route =
+         d->hasMember("route") ? d["route"]->getString() :
+         d->hasMember("servicer") ? d["servicer"]->getString() : NULL;
+      if(header != 0 && header <= start)
+      {
+         recordLatency(route, HeaderTime, start - header);
+      }
+      else
+      {
+         header = start;
+      }
+      recordLatency(route, RequestTime, now - header);
+      if(response != 0 && response >= start)
+      {
+         recordLatency(route, HandlerTime, response - start);
+         recordLatency(route, SendTime, now - response);
+      }
+      else
+      {
+         recordLatency(route, HandlerTime, now - start);
+      }
+   }
+
    // debug
    //d["stats"] = getStats();
    //monarch::data::json::JsonWriter::writeToStdOut(d["stats"]);
@@ -265,3 +508,80 @@ void HttpConnectionMonitor::afterRequestError(
    //monarch::data::json::JsonWriter::writeToStdOut(
    //   Exception::convertToDynamicObject(exception));
 }
+
+void HttpConnectionMonitor::mergeLatencies(RouteLatencyMap& routes)
+{
+   mLatencyLock.lock();
+   mergeRoutes(routes, mRetiredLatencies);
+   for(vector<ThreadLatency*>::iterator i = mThreadLatencies.begin();
+       i != mThreadLatencies.end(); ++i)
+   {
+      (*i)->lock.lock();
+      mergeRoutes(routes, (*i)->routes);
+      (*i)->lock.unlock();
+   }
+   mLatencyLock.unlock();
+}
+
+void HttpConnectionMonitor::retireThreadLatency(ThreadLatency* tl)
+{
+   mLatencyLock.lock();
+   {
+      mergeRoutes(mRetiredLatencies, tl->routes);
+      mThreadLatencies.erase(
+         find(mThreadLatencies.begin(), mThreadLatencies.end(), tl));
+   }
+   mLatencyLock.unlock();
+
+   for(RouteLatencyMap::iterator i = tl->routes.begin();
+       i != tl->routes.end(); ++i)
+   {
+      delete i->second;
+   }
+   delete tl;
+}
+
+void HttpConnectionMonitor::threadLatencyExited(void* tl)
+{
+   ThreadLatency* t = static_cast<ThreadLatency*>(tl);
+   t->monitor->retireThreadLatency(t);
+}
+
+void HttpConnectionMonitor::mergeRoutes(
+   RouteLatencyMap& routes, RouteLatencyMap& from)
+{
+   for(RouteLatencyMap::iterator i = from.begin(); i != from.end(); ++i)
+   {
+      RouteLatency*& rl = routes[i->first];
+      if(rl == NULL)
+      {
+         rl = new RouteLatency;
+      }
+      for(int n = 0; n < LatencyCount; ++n)
+      {
+         rl->histograms[n].merge(i->second->histograms[n]);
+      }
+   }
+}
+
+DynamicObject HttpConnectionMonitor::getLatencyStats(RouteLatency& latency)
+{
+   DynamicObject rval;
+   rval->setType(Map);
+
+   for(int n = 0; n < LatencyCount; ++n)
+   {
+      Histogram& h = latency.histograms[n];
+      DynamicObject& stats = rval[sLatencyNames[n]];
+      stats["count"] = h.getCount();
+      stats["min"] = h.getMin();
+      stats["max"] = h.getMax();
+      stats["mean"] = h.getMean();
+      stats["p50"] = h.getValueAtPercentile(50);
+      stats["p90"] = h.getValueAtPercentile(90);
+      stats["p99"] = h.getValueAtPercentile(99);
+      stats["p999"] = h.getValueAtPercentile(99.9);
+   }
+
+   return rval;
+}
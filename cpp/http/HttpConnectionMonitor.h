@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_http_HttpConnectionMonitor_h
 #define monarch_http_HttpConnectionMonitor_h
@@ -7,6 +7,13 @@
 #include "monarch/http/HttpConnection.h"
 #include "monarch/http/HttpRequest.h"
 #include "monarch/http/HttpResponse.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/ThreadLocal.h"
+#include "monarch/util/Histogram.h"
+
+#include <map>
+#include <string>
+#include <vector>
 
 namespace monarch
 {
@@ -19,10 +26,77 @@ namespace http
  * It contains a number of hooks that will be called for various servicer
  * events.
  *
+ * Besides totals, it keeps latency histograms, in microseconds, for the
+ * whole of each request and for its phases: receiving the header, handling
+ * the request until the response header is sent and sending the rest of
+ * the response. Latencies are kept per route, which is the "route" detail
+ * of the request state if a handler set one, or else the path of the
+ * HttpRequestServicer that serviced the request. Each thread records into
+ * its own histograms without locking; they are merged when the stats are
+ * read. When a thread exits, its histograms are merged into those of the
+ * threads that have already exited and freed.
+ *
+ * Responses sent over HTTP/1.x and HTTP/2 both mark when their header is
+ * sent, so the handler and send latencies are split for both.
+ *
  * @author David I. Lehn
  */
 class HttpConnectionMonitor
 {
+public:
+   /**
+    * The latencies that are measured.
+    */
+   enum Latency
+   {
+      RequestTime = 0, HeaderTime, HandlerTime, SendTime, LatencyCount
+   };
+
+protected:
+   /**
+    * The latency histograms for a route.
+    */
+   struct RouteLatency
+   {
+      monarch::util::Histogram histograms[LatencyCount];
+   };
+
+   /**
+    * A map of route to latency histograms.
+    */
+   typedef std::map<std::string, RouteLatency*> RouteLatencyMap;
+
+   /**
+    * The latency histograms recorded by one thread. Only that thread adds
+    * routes, while holding the lock.
+    */
+   struct ThreadLatency
+   {
+      HttpConnectionMonitor* monitor;
+      monarch::rt::ExclusiveLock lock;
+      RouteLatencyMap routes;
+   };
+
+   /**
+    * The latency histograms of all running threads.
+    */
+   std::vector<ThreadLatency*> mThreadLatencies;
+
+   /**
+    * The merged latency histograms of all threads that have exited.
+    */
+   RouteLatencyMap mRetiredLatencies;
+
+   /**
+    * The latency histograms of the current thread.
+    */
+   monarch::rt::ThreadLocal* mThreadLatency;
+
+   /**
+    * A lock for adding and retiring latency histograms for a thread.
+    */
+   monarch::rt::ExclusiveLock mLatencyLock;
+
 public:
    // stats
    uint64_t mTotalTime;
@@ -75,9 +149,55 @@ public:
     *    totalStatus4xx
     *    totalStatus5xx
     *    totalStatusOther
+    *    latency: the latencies of all requests
+    *    routes: the latencies of the requests for each known route
+    *    latencyThreads: the number of running threads with latencies
+    *
+    * Latencies are maps with "request", "header", "handler" and "send"
+    * members, each with the count, min, max, mean, p50, p90, p99 and p999
+    * of the measured times in microseconds.
     */
    virtual monarch::rt::DynamicObject getStats();
 
+   /**
+    * Records a latency.
+    *
+    * @param route the route of the request, NULL or "" if unknown.
+    * @param latency the latency that was measured.
+    * @param time the time in microseconds.
+    */
+   virtual void recordLatency(
+      const char* route, Latency latency, uint64_t time);
+
+   /**
+    * Appends a compact binary snapshot of the latency histograms for all
+    * routes to a string. This is much cheaper to produce and to send than
+    * the stats and can be read with readLatencySnapshot().
+    *
+    * The format is the 4 bytes "MOLH", a version byte (1) and the number of
+    * routes as a 4 byte big-endian integer. Each route follows as a 2 byte
+    * big-endian length, the route and its serialized Histograms (see
+    * Histogram::serialize()) in the order of the Latency enum. Requests for
+    * an unknown route have an empty route.
+    *
+    * @param out the string to append to.
+    */
+   virtual void getLatencySnapshot(std::string& out);
+
+   /**
+    * Reads a binary snapshot of latency histograms into latency stats in the
+    * format of the "routes" returned by getStats(), including requests for
+    * unknown routes under "".
+    *
+    * @param data the snapshot.
+    * @param length the length of the snapshot.
+    * @param stats set to the latency stats for each route.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   static bool readLatencySnapshot(
+      const char* data, int length, monarch::rt::DynamicObject& stats);
+
    /**
     * Called before a connection begins servicing requests.
     *
@@ -157,6 +277,47 @@ public:
       HttpRequest* request,
       HttpResponse* response,
       monarch::rt::ExceptionRef& exception);
+
+protected:
+   /**
+    * Merges the latency histograms of all threads.
+    *
+    * @param routes the map to merge the histograms for each route into, the
+    *           caller must free the merged histograms.
+    */
+   virtual void mergeLatencies(RouteLatencyMap& routes);
+
+   /**
+    * Merges the latency histograms of a thread that is exiting into those
+    * of the threads that have exited and frees them.
+    *
+    * @param tl the latency histograms of the thread.
+    */
+   virtual void retireThreadLatency(ThreadLatency* tl);
+
+   /**
+    * Called when a thread with latency histograms exits.
+    *
+    * @param tl the latency histograms of the thread.
+    */
+   static void threadLatencyExited(void* tl);
+
+   /**
+    * Merges the latency histograms for each route into others.
+    *
+    * @param routes the histograms to merge into, added if missing.
+    * @param from the histograms to merge.
+    */
+   static void mergeRoutes(RouteLatencyMap& routes, RouteLatencyMap& from);
+
+   /**
+    * Gets the latency stats for a set of histograms.
+    *
+    * @param latency the histograms.
+    *
+    * @return the stats.
+    */
+   static monarch::rt::DynamicObject getLatencyStats(RouteLatency& latency);
 };
 
 // type definition for a reference counted HttpConnectionMonitor
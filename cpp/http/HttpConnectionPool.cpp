@@ -1,9 +1,14 @@
 /*
- * Copyright (c) 2009-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2009-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpConnectionPool.h"
 
+#include "monarch/net/SocketTools.h"
+#include "monarch/rt/System.h"
+
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 using namespace std;
 using namespace monarch::http;
@@ -11,34 +16,87 @@ using namespace monarch::net;
 using namespace monarch::rt;
 using namespace monarch::util;
 
-HttpConnectionPool::HttpConnectionPool()
+HttpConnectionPool::HttpConnectionPool() :
+   mMaxIdleConnections(0),
+   mMaxConnections(0),
+   mIdleTimeout(0),
+   mWaitTimeout(30000),
+   mReaperThread(NULL),
+   mReaperInterval(0)
 {
 }
 
 HttpConnectionPool::~HttpConnectionPool()
 {
-   for(PoolMap::iterator i = mPools.begin(); i != mPools.end(); ++i)
-   {
-      // clean up url key
-      free((char*)i->first);
+   // stop reaper
+   stopReaper();
 
-      // close any open connections
-      HttpConnectionList* pool = i->second;
-      for(HttpConnectionList::iterator hi = pool->begin();
-          hi != pool->end(); ++hi)
+   for(unsigned int s = 0; s < sStripeCount; ++s)
+   {
+      PoolMap& pools = mStripes[s].pools;
+      for(PoolMap::iterator i = pools.begin(); i != pools.end(); ++i)
       {
-         if(!(*hi)->isClosed())
+         // clean up url key
+         free((char*)i->first);
+
+         // close any open connections
+         HttpConnectionList& idle = i->second->idle;
+         for(HttpConnectionList::iterator hi = idle.begin();
+             hi != idle.end(); ++hi)
          {
-            (*hi)->close();
-            (*hi).setNull();
+            if(!hi->connection->isClosed())
+            {
+               hi->connection->close();
+               hi->connection.setNull();
+            }
          }
-      }
 
-      // clean up pool
-      delete pool;
+         // clean up pool
+         delete i->second;
+      }
    }
 }
 
+void HttpConnectionPool::setMaxIdleConnections(uint32_t max)
+{
+   mMaxIdleConnections = max;
+}
+
+uint32_t HttpConnectionPool::getMaxIdleConnections()
+{
+   return mMaxIdleConnections;
+}
+
+void HttpConnectionPool::setMaxConnections(uint32_t max)
+{
+   mMaxConnections = max;
+}
+
+uint32_t HttpConnectionPool::getMaxConnections()
+{
+   return mMaxConnections;
+}
+
+void HttpConnectionPool::setIdleTimeout(uint32_t timeout)
+{
+   mIdleTimeout = timeout;
+}
+
+uint32_t HttpConnectionPool::getIdleTimeout()
+{
+   return mIdleTimeout;
+}
+
+void HttpConnectionPool::setWaitTimeout(uint32_t timeout)
+{
+   mWaitTimeout = timeout;
+}
+
+uint32_t HttpConnectionPool::getWaitTimeout()
+{
+   return mWaitTimeout;
+}
+
 static string _getUrlKey(Url* url, const char* vHost)
 {
    // build url key
@@ -54,67 +112,487 @@ static string _getUrlKey(Url* url, const char* vHost)
 void HttpConnectionPool::addConnection(
    Url* url, HttpConnectionRef conn, const char* vHost)
 {
-   mPoolsLock.lock();
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
    {
-      // get url key
-      string key = _getUrlKey(url, vHost);
+      // add connection and wake up any threads waiting for it
+      HostPool* pool = getHostPool(stripe, key, true);
+      addIdleConnection(pool, conn);
+      if(pool->waiters > 0)
+      {
+         stripe->lock.notifyAll();
+      }
+   }
+   stripe->lock.unlock();
+}
 
-      // find existing connection list
-      HttpConnectionList* pool = NULL;
-      PoolMap::iterator i = mPools.find(key.c_str());
-      if(i != mPools.end())
+HttpConnectionRef HttpConnectionPool::getConnection(Url* url, const char* vHost)
+{
+   HttpConnectionRef rval(NULL);
+
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
+   {
+      HostPool* pool = getHostPool(stripe, key, false);
+      if(pool != NULL)
       {
-         pool = i->second;
+         rval = takeIdleConnection(pool);
+         dropHostPoolIfUnused(stripe, key);
       }
-      else
+   }
+   stripe->lock.unlock();
+
+   return rval;
+}
+
+bool HttpConnectionPool::checkoutConnection(
+   Url* url, HttpConnectionRef& conn, const char* vHost, uint32_t timeout)
+{
+   bool rval = false;
+   conn.setNull();
+
+   // wait no longer than the caller allows
+   uint32_t wait =
+      (timeout != 0 && (mWaitTimeout == 0 || timeout < mWaitTimeout)) ?
+      timeout : mWaitTimeout;
+
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
+   {
+      HostPool* pool = getHostPool(stripe, key, true);
+
+      // calculate the time to stop waiting
+      uint64_t start = System::getCurrentMilliseconds();
+      uint64_t end = start + wait;
+      bool timedOut = false;
+      bool interrupted = false;
+      while(!rval && !timedOut && !interrupted)
       {
-         // no existing list, so create one
-         pool = new HttpConnectionList;
-         mPools.insert(make_pair(strdup(key.c_str()), pool));
+         // prefer an idle connection, then a new one if under the maximum
+         conn = takeIdleConnection(pool);
+         if(!conn.isNull() ||
+            mMaxConnections == 0 ||
+            pool->active + pool->idle.size() < mMaxConnections)
+         {
+            ++pool->active;
+            rval = true;
+         }
+         else
+         {
+            // wait for a connection to be checked in
+            uint64_t now = System::getCurrentMilliseconds();
+            if(wait != 0 && now >= end)
+            {
+               timedOut = true;
+            }
+            else
+            {
+               ++pool->waiters;
+               interrupted = !stripe->lock.wait(
+                  (wait == 0) ? 0 : (uint32_t)(end - now));
+               --pool->waiters;
+            }
+         }
       }
 
-      // add connection to pool
-      pool->push_back(conn);
+      if(timedOut)
+      {
+         ExceptionRef e = new Exception(
+            "Timed out waiting for an HTTP connection.",
+            "monarch.http.HttpConnectionPool.Timeout");
+         e->getDetails()["url"] = key.c_str();
+         e->getDetails()["maxConnections"] = mMaxConnections;
+         e->getDetails()["timeout"] = wait;
+         Exception::set(e);
+      }
+      if(!rval)
+      {
+         dropHostPoolIfUnused(stripe, key);
+      }
    }
-   mPoolsLock.unlock();
+   stripe->lock.unlock();
+
+   return rval;
 }
 
-HttpConnectionRef HttpConnectionPool::getConnection(Url* url, const char* vHost)
+void HttpConnectionPool::checkinConnection(
+   Url* url, HttpConnectionRef& conn, bool reuse, const char* vHost)
 {
-   HttpConnectionRef rval(NULL);
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
+   {
+      HostPool* pool = getHostPool(stripe, key, true);
+      if(pool->active > 0)
+      {
+         --pool->active;
+      }
+
+      // keep connection if it can be reused, otherwise close it
+      if(!conn.isNull())
+      {
+         if(reuse && !conn->isClosed())
+         {
+            addIdleConnection(pool, conn);
+         }
+         else
+         {
+            conn->close();
+         }
+      }
+
+      // wake up any threads waiting for a connection
+      if(pool->waiters > 0)
+      {
+         stripe->lock.notifyAll();
+      }
+      dropHostPoolIfUnused(stripe, key);
+   }
+   stripe->lock.unlock();
+}
+
+int HttpConnectionPool::removeConnections(Url* url, const char* vHost)
+{
+   int rval = 0;
 
-   mPoolsLock.lock();
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
    {
-      // get url key
-      string key = _getUrlKey(url, vHost);
+      // close all idle connections
+      HostPool* pool = getHostPool(stripe, key, false);
+      if(pool != NULL)
+      {
+         HttpConnectionList& idle = pool->idle;
+         for(HttpConnectionList::iterator i = idle.begin();
+             i != idle.end(); ++i, ++rval)
+         {
+            i->connection->close();
+         }
+         idle.clear();
+
+         // room for new connections, wake up waiting threads
+         if(pool->waiters > 0)
+         {
+            stripe->lock.notifyAll();
+         }
+         dropHostPoolIfUnused(stripe, key);
+      }
+   }
+   stripe->lock.unlock();
+
+   return rval;
+}
 
-      // get existing connection list
-      PoolMap::iterator i = mPools.find(key.c_str());
-      if(i != mPools.end())
+int HttpConnectionPool::removeExpiredConnections()
+{
+   int rval = 0;
+
+   uint64_t expired = getExpiredTime();
+   for(unsigned int s = 0; s < sStripeCount; ++s)
+   {
+      Stripe* stripe = &mStripes[s];
+      stripe->lock.lock();
       {
-         // keep popping connections until one that isn't closed is found
-         while(rval.isNull() && !i->second->empty())
+         PoolMap& pools = stripe->pools;
+         for(PoolMap::iterator i = pools.begin(); i != pools.end();)
          {
-            rval = i->second->front();
-            i->second->pop_front();
+            // close expired or dead connections
+            HostPool* pool = i->second;
+            HttpConnectionList& idle = pool->idle;
+            for(HttpConnectionList::iterator hi = idle.begin();
+                hi != idle.end();)
+            {
+               if(hi->idleSince < expired || !isAlive(&(*hi->connection)))
+               {
+                  hi->connection->close();
+                  hi = idle.erase(hi);
+                  ++rval;
+               }
+               else
+               {
+                  ++hi;
+               }
+            }
 
-            // drop connection if its closed
-            if(rval->isClosed())
+            // wake up waiting threads, drop unused pools
+            if(pool->waiters > 0)
+            {
+               stripe->lock.notifyAll();
+            }
+            if(idle.empty() && pool->active == 0 && pool->waiters == 0)
             {
-               rval.setNull();
+               free((char*)i->first);
+               delete pool;
+               pools.erase(i++);
+            }
+            else
+            {
+               ++i;
             }
          }
+      }
+      stripe->lock.unlock();
+   }
 
-         if(rval.isNull())
-         {
-            // no idle connection available, drop connection list
-            free((char*)i->first);
-            delete i->second;
-            mPools.erase(i);
-         }
+   return rval;
+}
+
+int HttpConnectionPool::getIdleConnectionCount(Url* url, const char* vHost)
+{
+   int rval = 0;
+
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
+   {
+      HostPool* pool = getHostPool(stripe, key, false);
+      if(pool != NULL)
+      {
+         rval = pool->idle.size();
+      }
+   }
+   stripe->lock.unlock();
+
+   return rval;
+}
+
+int HttpConnectionPool::getActiveConnectionCount(Url* url, const char* vHost)
+{
+   int rval = 0;
+
+   string key = _getUrlKey(url, vHost);
+   Stripe* stripe = getStripe(key);
+   stripe->lock.lock();
+   {
+      HostPool* pool = getHostPool(stripe, key, false);
+      if(pool != NULL)
+      {
+         rval = pool->active;
+      }
+   }
+   stripe->lock.unlock();
+
+   return rval;
+}
+
+void HttpConnectionPool::startReaper(uint32_t interval)
+{
+   mReaperLock.lock();
+   {
+      mReaperInterval = interval;
+      if(mReaperThread == NULL)
+      {
+         // create new reaper thread, start it (128k stack)
+         mReaperThread = new Thread(this, "HttpConnectionPool reaper");
+         mReaperThread->start(131072);
+      }
+   }
+   mReaperLock.unlock();
+}
+
+void HttpConnectionPool::stopReaper()
+{
+   Thread* t = NULL;
+
+   mReaperLock.lock();
+   {
+      if(mReaperThread != NULL)
+      {
+         // interrupt reaper thread
+         t = mReaperThread;
+         t->interrupt();
+         mReaperThread = NULL;
+      }
+   }
+   mReaperLock.unlock();
+
+   if(t != NULL)
+   {
+      // join and clean up old reaper thread
+      t->join();
+      delete t;
+   }
+}
+
+void HttpConnectionPool::run()
+{
+   // sleep returns false when the thread is interrupted
+   while(Thread::sleep(mReaperInterval))
+   {
+      removeExpiredConnections();
+   }
+}
+
+bool HttpConnectionPool::isBodyDelimited(HttpHeader* header)
+{
+   bool rval = header->hasField("Content-Length");
+
+   string transferEncoding;
+   if(!rval && header->getField("Transfer-Encoding", transferEncoding))
+   {
+      // only the last transfer coding (without parameters) delimits the body
+      string::size_type start = transferEncoding.rfind(',');
+      start = (start == string::npos) ? 0 : start + 1;
+      string coding = transferEncoding.substr(
+         start, transferEncoding.find(';', start) - start);
+      StringTools::trim(coding, " \t");
+      rval = (strcasecmp(coding.c_str(), "chunked") == 0);
+   }
+
+   return rval;
+}
+
+bool HttpConnectionPool::isKeepAlive(HttpHeader* header)
+{
+   string connection;
+   return header->getField("Connection", connection) ?
+      (strcasecmp(connection.c_str(), "close") != 0) :
+      (strcmp(header->getVersion(), "HTTP/1.1") == 0);
+}
+
+bool HttpConnectionPool::isReusable(
+   HttpConnection* conn, HttpHeader* header, bool hasBody)
+{
+   return
+      isKeepAlive(header) &&
+      (!hasBody || isBodyDelimited(header)) &&
+      !conn->isClosed();
+}
+
+bool HttpConnectionPool::isRetryable(const char* method, bool hasBody)
+{
+   return !hasBody && strcmp(method, "POST") != 0;
+}
+
+HttpConnectionPool::Stripe* HttpConnectionPool::getStripe(const string& key)
+{
+   // FNV-1a
+   unsigned int hash = 2166136261U;
+   for(string::const_iterator i = key.begin(); i != key.end(); ++i)
+   {
+      hash ^= (unsigned char)*i;
+      hash *= 16777619U;
+   }
+   return &mStripes[hash & (sStripeCount - 1)];
+}
+
+HttpConnectionPool::HostPool* HttpConnectionPool::getHostPool(
+   Stripe* stripe, const string& key, bool create)
+{
+   HostPool* rval = NULL;
+
+   PoolMap::iterator i = stripe->pools.find(key.c_str());
+   if(i != stripe->pools.end())
+   {
+      rval = i->second;
+   }
+   else if(create)
+   {
+      // no existing pool, so create one
+      rval = new HostPool;
+      rval->active = 0;
+      rval->waiters = 0;
+      stripe->pools.insert(make_pair(strdup(key.c_str()), rval));
+   }
+
+   return rval;
+}
+
+void HttpConnectionPool::dropHostPoolIfUnused(
+   Stripe* stripe, const string& key)
+{
+   PoolMap::iterator i = stripe->pools.find(key.c_str());
+   if(i != stripe->pools.end())
+   {
+      HostPool* pool = i->second;
+      if(pool->idle.empty() && pool->active == 0 && pool->waiters == 0)
+      {
+         free((char*)i->first);
+         delete pool;
+         stripe->pools.erase(i);
+      }
+   }
+}
+
+void HttpConnectionPool::addIdleConnection(
+   HostPool* pool, HttpConnectionRef& conn)
+{
+   // add connection to the front of the pool so it is reused first
+   IdleConnection ic;
+   ic.connection = conn;
+   ic.idleSince = System::getCurrentMilliseconds();
+   pool->idle.push_front(ic);
+
+   // close least recently used connections over the maximums
+   while(!pool->idle.empty() &&
+      ((mMaxIdleConnections > 0 && pool->idle.size() > mMaxIdleConnections) ||
+       (mMaxConnections > 0 &&
+        pool->active + pool->idle.size() > mMaxConnections)))
+   {
+      pool->idle.back().connection->close();
+      pool->idle.pop_back();
+   }
+}
+
+HttpConnectionRef HttpConnectionPool::takeIdleConnection(HostPool* pool)
+{
+   HttpConnectionRef rval(NULL);
+
+   // keep popping connections until one that is usable is found
+   uint64_t expired = getExpiredTime();
+   HttpConnectionList& idle = pool->idle;
+   while(rval.isNull() && !idle.empty())
+   {
+      IdleConnection& ic = idle.front();
+      if(ic.idleSince >= expired && isAlive(&(*ic.connection)))
+      {
+         rval = ic.connection;
+      }
+      else
+      {
+         // drop connection if it's closed or expired
+         ic.connection->close();
       }
+      idle.pop_front();
+   }
+
+   // since the list is ordered by use, if the oldest connection has not
+   // expired, none of the others have either
+   while(!idle.empty() && idle.back().idleSince < expired)
+   {
+      idle.back().connection->close();
+      idle.pop_back();
    }
-   mPoolsLock.unlock();
 
    return rval;
 }
+
+uint64_t HttpConnectionPool::getExpiredTime()
+{
+   uint64_t rval = 0;
+
+   if(mIdleTimeout > 0)
+   {
+      uint64_t now = System::getCurrentMilliseconds();
+      rval = (now < mIdleTimeout) ? 0 : now - mIdleTimeout;
+   }
+
+   return rval;
+}
+
+bool HttpConnectionPool::isAlive(HttpConnection* conn)
+{
+   bool rval = !conn->isClosed();
+   if(rval)
+   {
+      // an idle connection should have nothing to read, if the server has
+      // closed it (EOF) or sent unexpected data then it can't be reused
+      int fd = conn->getSocket()->getFileDescriptor();
+      rval = (SocketTools::peek(fd) == -1 && errno == EAGAIN);
+   }
+   return rval;
+}
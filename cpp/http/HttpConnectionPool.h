@@ -1,10 +1,12 @@
 /*
- * Copyright (c) 2009-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2009-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_http_HttpConnectionPool_H
 #define monarch_http_HttpConnectionPool_H
 
 #include "monarch/http/HttpConnection.h"
+#include "monarch/rt/Runnable.h"
+#include "monarch/rt/Thread.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/util/Url.h"
 
@@ -20,30 +22,122 @@ namespace http
  * An HttpConnectionPool pools a number of HttpConnections together so that
  * they can be reused.
  *
- * The current implementation does not handle creating connections, it simply
- * stores idle connections so that they can be reused.
+ * The current implementation does not handle creating connections, it
+ * stores idle connections so that they can be reused and keeps track of how
+ * many connections to each url (its scheme, host and port) are in use.
+ *
+ * Connections can be used in two ways. The simple way is to call
+ * getConnection() to get an idle connection, if any, and addConnection() to
+ * add an idle connection. The managed way is to call checkoutConnection()
+ * to get an idle connection or permission to create a new one, and
+ * checkinConnection() when finished with it. Only managed connections are
+ * counted against the maximum number of connections per url, a thread that
+ * tries to check out a connection when the maximum has been reached waits
+ * for one to be checked back in.
+ *
+ * The most recently used idle connection to a url is reused first. If there
+ * are more idle connections to a url than permitted, the least recently used
+ * one is closed. Before an idle connection is reused, its socket is checked
+ * to make sure the server has not closed it. Idle connections that have
+ * expired are closed when a connection to their url is requested or by a
+ * background reaper thread, if one has been started.
+ *
+ * The pool is divided into a number of stripes, each with its own lock, so
+ * that threads using connections to different urls rarely contend with one
+ * another.
  *
  * @author Dave Longley
  */
-class HttpConnectionPool
+class HttpConnectionPool : public monarch::rt::Runnable
 {
 protected:
    /**
-    * A list of http connections.
+    * An idle http connection and the time it became idle.
+    */
+   struct IdleConnection
+   {
+      HttpConnectionRef connection;
+      uint64_t idleSince;
+   };
+
+   /**
+    * A list of idle http connections, most recently used first.
     */
-   typedef std::list<HttpConnectionRef> HttpConnectionList;
+   typedef std::list<IdleConnection> HttpConnectionList;
 
    /**
-    * A map of url key to pools of idle http connections.
+    * The idle connections to a url and the number of connections to it that
+    * are checked out.
+    */
+   struct HostPool
+   {
+      HttpConnectionList idle;
+      uint32_t active;
+      uint32_t waiters;
+   };
+
+   /**
+    * A map of url key to pools of http connections.
     */
    typedef std::map<
-      const char*, HttpConnectionList*, monarch::util::StringComparator> PoolMap;
-   PoolMap mPools;
+      const char*, HostPool*, monarch::util::StringComparator> PoolMap;
+
+   /**
+    * A stripe of the pool with its own map and lock.
+    */
+   struct Stripe
+   {
+      PoolMap pools;
+      monarch::rt::ExclusiveLock lock;
+   };
+
+   /**
+    * The number of stripes, a power of 2.
+    */
+   static const unsigned int sStripeCount = 16;
+
+   /**
+    * The stripes of this pool.
+    */
+   Stripe mStripes[sStripeCount];
+
+   /**
+    * The maximum number of idle connections per url, 0 for no maximum.
+    */
+   uint32_t mMaxIdleConnections;
+
+   /**
+    * The maximum number of checked out and idle connections per url, 0 for
+    * no maximum.
+    */
+   uint32_t mMaxConnections;
+
+   /**
+    * The maximum amount of time a connection may be idle, in milliseconds,
+    * 0 for no maximum.
+    */
+   uint32_t mIdleTimeout;
+
+   /**
+    * The maximum amount of time to wait to check out a connection, in
+    * milliseconds, 0 to wait indefinitely.
+    */
+   uint32_t mWaitTimeout;
+
+   /**
+    * The reaper thread, NULL if not running.
+    */
+   monarch::rt::Thread* mReaperThread;
 
    /**
-    * A lock for manipulating the pool map.
+    * The number of milliseconds between runs of the reaper.
     */
-   monarch::rt::ExclusiveLock mPoolsLock;
+   uint32_t mReaperInterval;
+
+   /**
+    * A lock for starting and stopping the reaper thread.
+    */
+   monarch::rt::ExclusiveLock mReaperLock;
 
 public:
    /**
@@ -52,10 +146,76 @@ public:
    HttpConnectionPool();
 
    /**
-    * Destructs this HttpConnectionPool.
+    * Destructs this HttpConnectionPool, stopping its reaper and closing any
+    * idle connections.
     */
    virtual ~HttpConnectionPool();
 
+   /**
+    * Sets the maximum number of idle connections to keep per url. If adding
+    * an idle connection would exceed this maximum, the least recently used
+    * idle connection to the url is closed.
+    *
+    * @param max the maximum number of idle connections per url, 0 for no
+    *           maximum.
+    */
+   virtual void setMaxIdleConnections(uint32_t max);
+
+   /**
+    * Gets the maximum number of idle connections to keep per url.
+    *
+    * @return the maximum number of idle connections per url, 0 for no
+    *         maximum.
+    */
+   virtual uint32_t getMaxIdleConnections();
+
+   /**
+    * Sets the maximum number of connections per url, including both checked
+    * out and idle connections.
+    *
+    * @param max the maximum number of connections per url, 0 for no maximum.
+    */
+   virtual void setMaxConnections(uint32_t max);
+
+   /**
+    * Gets the maximum number of connections per url.
+    *
+    * @return the maximum number of connections per url, 0 for no maximum.
+    */
+   virtual uint32_t getMaxConnections();
+
+   /**
+    * Sets the maximum amount of time a connection may remain idle in this
+    * pool. Connections that have been idle for longer are closed instead of
+    * being reused.
+    *
+    * @param timeout the idle timeout in milliseconds, 0 for no timeout.
+    */
+   virtual void setIdleTimeout(uint32_t timeout);
+
+   /**
+    * Gets the maximum amount of time a connection may remain idle in this
+    * pool.
+    *
+    * @return the idle timeout in milliseconds, 0 for no timeout.
+    */
+   virtual uint32_t getIdleTimeout();
+
+   /**
+    * Sets the maximum amount of time to wait to check out a connection when
+    * the maximum number of connections to a url are in use.
+    *
+    * @param timeout the wait timeout in milliseconds, 0 to wait indefinitely.
+    */
+   virtual void setWaitTimeout(uint32_t timeout);
+
+   /**
+    * Gets the maximum amount of time to wait to check out a connection.
+    *
+    * @return the wait timeout in milliseconds, 0 to wait indefinitely.
+    */
+   virtual uint32_t getWaitTimeout();
+
    /**
     * Adds an idle connection to this pool.
     *
@@ -69,8 +229,9 @@ public:
       const char* vHost = NULL);
 
    /**
-    * Gets an idle connection from this pool to a particular url. If no
-    * connection is available, returns NULL.
+    * Gets an idle connection from this pool to a particular url. Any idle
+    * connections that have been closed or that have expired are dropped. If
+    * no connection is available, returns NULL.
     *
     * @param url the url to get a connection to.
     * @param vHost an optional virtual host identifier, if the URL references
@@ -80,6 +241,228 @@ public:
     */
    virtual HttpConnectionRef getConnection(
       monarch::util::Url* url, const char* vHost = NULL);
+
+   /**
+    * Checks out a connection to a particular url. If an idle connection is
+    * available, it is returned. Otherwise, if fewer than the maximum number
+    * of connections to the url exist, a NULL connection is returned and the
+    * caller may create a new one. Otherwise, this method waits until a
+    * connection is checked in or the wait timeout, or the given timeout if it
+    * is shorter, expires.
+    *
+    * Every successful call must be followed by a call to checkinConnection(),
+    * even if the caller fails to create a new connection.
+    *
+    * @param url the url to get a connection to.
+    * @param conn set to the idle connection or to NULL if a new one should
+    *           be created.
+    * @param vHost an optional virtual host identifier, if the URL references
+    *           a virtual host in some custom fashion.
+    * @param timeout the maximum time to wait in milliseconds, such as the
+    *           time left before a request's deadline, 0 to only use the wait
+    *           timeout.
+    *
+    * @return true if successful, false if the wait timed out or the thread
+    *         was interrupted (an exception will be set).
+    */
+   virtual bool checkoutConnection(
+      monarch::util::Url* url, HttpConnectionRef& conn,
+      const char* vHost = NULL, uint32_t timeout = 0);
+
+   /**
+    * Checks in a connection that was checked out. If the connection can be
+    * reused, it is added to the idle connections, otherwise it is closed.
+    *
+    * @param url the url for the connection.
+    * @param conn the connection, which may be NULL if one could not be
+    *           created.
+    * @param reuse true if the connection can be reused, false if not.
+    * @param vHost an optional virtual host identifier, if the URL references
+    *           a virtual host in some custom fashion.
+    */
+   virtual void checkinConnection(
+      monarch::util::Url* url, HttpConnectionRef& conn, bool reuse,
+      const char* vHost = NULL);
+
+   /**
+    * Closes and removes all idle connections to a particular url. This
+    * should be called when a connection to the url fails, as any other idle
+    * connections to it are likely to be unusable as well.
+    *
+    * @param url the url to remove the connections to.
+    * @param vHost an optional virtual host identifier, if the URL references
+    *           a virtual host in some custom fashion.
+    *
+    * @return the number of connections that were removed.
+    */
+   virtual int removeConnections(
+      monarch::util::Url* url, const char* vHost = NULL);
+
+   /**
+    * Closes and removes all idle connections that have expired or that have
+    * been closed by their servers.
+    *
+    * @return the number of connections that were removed.
+    */
+   virtual int removeExpiredConnections();
+
+   /**
+    * Gets the number of idle connections in this pool to a particular url.
+    *
+    * @param url the url to count the connections to.
+    * @param vHost an optional virtual host identifier, if the URL references
+    *           a virtual host in some custom fashion.
+    *
+    * @return the number of idle connections.
+    */
+   virtual int getIdleConnectionCount(
+      monarch::util::Url* url, const char* vHost = NULL);
+
+   /**
+    * Gets the number of checked out connections to a particular url.
+    *
+    * @param url the url to count the connections to.
+    * @param vHost an optional virtual host identifier, if the URL references
+    *           a virtual host in some custom fashion.
+    *
+    * @return the number of checked out connections.
+    */
+   virtual int getActiveConnectionCount(
+      monarch::util::Url* url, const char* vHost = NULL);
+
+   /**
+    * Starts a background thread that periodically removes expired idle
+    * connections. If the reaper is already running, its interval is updated.
+    *
+    * @param interval the number of milliseconds between runs, which must be
+    *           greater than 0.
+    */
+   virtual void startReaper(uint32_t interval);
+
+   /**
+    * Stops the background reaper thread, if it is running.
+    */
+   virtual void stopReaper();
+
+   /**
+    * Runs the reaper until its thread is interrupted.
+    */
+   virtual void run();
+
+   /**
+    * Returns true if the end of a message body is known from its header,
+    * that is, if it has a Content-Length or its last transfer coding is
+    * chunked. Otherwise the body ends when the connection is closed.
+    *
+    * @param header the header.
+    *
+    * @return true if the body is delimited, false if not.
+    */
+   static bool isBodyDelimited(HttpHeader* header);
+
+   /**
+    * Returns true if the sender of a header will keep its connection alive.
+    *
+    * @param header the header.
+    *
+    * @return true if the connection will be kept alive, false if not.
+    */
+   static bool isKeepAlive(HttpHeader* header);
+
+   /**
+    * Returns true if a connection may be checked in for reuse once a
+    * response has been received on it: the server keeps it alive, the end
+    * of the response body did not depend on it being closed and it is still
+    * open.
+    *
+    * @param conn the connection.
+    * @param header the response header.
+    * @param hasBody true if the response has a body, false if not.
+    *
+    * @return true if the connection can be reused, false if not.
+    */
+   static bool isReusable(
+      HttpConnection* conn, HttpHeader* header, bool hasBody);
+
+   /**
+    * Returns true if a request that failed on a reused idle connection, which
+    * the server may have closed in the meantime, can safely be sent again on
+    * a new connection. Only requests without a body that are not POSTs are.
+    *
+    * @param method the request method.
+    * @param hasBody true if the request has a body, false if not.
+    *
+    * @return true if the request can be retried, false if not.
+    */
+   static bool isRetryable(const char* method, bool hasBody);
+
+protected:
+   /**
+    * Gets the stripe for a url key.
+    *
+    * @param key the url key.
+    *
+    * @return the stripe.
+    */
+   virtual Stripe* getStripe(const std::string& key);
+
+   /**
+    * Gets the pool for a url key. The stripe must be locked.
+    *
+    * @param stripe the stripe for the key.
+    * @param key the url key.
+    * @param create true to create the pool if it does not exist.
+    *
+    * @return the pool, NULL if it does not exist and create was false.
+    */
+   virtual HostPool* getHostPool(
+      Stripe* stripe, const std::string& key, bool create);
+
+   /**
+    * Removes the pool for a url key if it has no idle connections, checked
+    * out connections or waiting threads. The stripe must be locked.
+    *
+    * @param stripe the stripe for the key.
+    * @param key the url key.
+    */
+   virtual void dropHostPoolIfUnused(Stripe* stripe, const std::string& key);
+
+   /**
+    * Adds an idle connection to a pool, closing the least recently used
+    * idle connections that exceed the maximums. The stripe must be locked.
+    *
+    * @param pool the pool.
+    * @param conn the connection.
+    */
+   virtual void addIdleConnection(HostPool* pool, HttpConnectionRef& conn);
+
+   /**
+    * Takes the most recently used usable idle connection from a pool,
+    * closing any idle connections that have expired or been closed by their
+    * servers along the way. The stripe must be locked.
+    *
+    * @param pool the pool.
+    *
+    * @return the connection, NULL if none was usable.
+    */
+   virtual HttpConnectionRef takeIdleConnection(HostPool* pool);
+
+   /**
+    * Gets the time before which idle connections have expired.
+    *
+    * @return the time in milliseconds, 0 if idle connections do not expire.
+    */
+   virtual uint64_t getExpiredTime();
+
+   /**
+    * Checks that an idle connection has not been closed by either side
+    * without blocking or consuming any data from it.
+    *
+    * @param conn the connection to check.
+    *
+    * @return true if the connection is still open, false if not.
+    */
+   virtual bool isAlive(HttpConnection* conn);
 };
 
 // typedef for a counted reference to an HttpConnectionPool
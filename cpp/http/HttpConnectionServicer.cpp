@@ -1,12 +1,14 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpConnectionServicer.h"
 
+#include "monarch/http/Http2Connection.h"
 #include "monarch/http/HttpRequest.h"
 #include "monarch/http/HttpResponse.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/logging/Logging.h"
+#include "monarch/rt/Atomic.h"
 #include "monarch/rt/DynamicObjectIterator.h"
 
 #include <cstdlib>
@@ -23,8 +25,14 @@ using namespace monarch::util;
 HttpConnectionServicer::HttpConnectionServicer(const char* serverName) :
    mServerName(strdup(serverName)),
    mConnectionMonitor(NULL),
-   mRequestModifier(NULL)
+   mRequestModifier(NULL),
+   mRouter(new HttpRequestRouter()),
+   mHttp2Enabled(false),
+   mHttp2MaxConcurrentStreams(100),
+   mHttp2ThreadPool(100)
 {
+   // expire idle HTTP/2 stream threads after 2 minutes
+   mHttp2ThreadPool.setThreadExpireTime(120000);
 }
 
 HttpConnectionServicer::~HttpConnectionServicer()
@@ -39,6 +47,14 @@ HttpConnectionServicer::~HttpConnectionServicer()
       free(sd->domain);
       delete sd;
    }
+
+   // free routers
+   delete mRouter;
+   for(vector<HttpRequestRouter*>::iterator i = mRetiredRouters.begin();
+       i != mRetiredRouters.end(); ++i)
+   {
+      delete *i;
+   }
 }
 
 void HttpConnectionServicer::setConnectionMonitor(
@@ -62,6 +78,26 @@ HttpRequestModifier* HttpConnectionServicer::getRequestModifier()
    return mRequestModifier;
 }
 
+void HttpConnectionServicer::setHttp2Enabled(bool enabled)
+{
+   mHttp2Enabled = enabled;
+}
+
+bool HttpConnectionServicer::isHttp2Enabled()
+{
+   return mHttp2Enabled;
+}
+
+void HttpConnectionServicer::setHttp2MaxConcurrentStreams(uint32_t max)
+{
+   mHttp2MaxConcurrentStreams = max;
+}
+
+ThreadPool* HttpConnectionServicer::getHttp2ThreadPool()
+{
+   return &mHttp2ThreadPool;
+}
+
 void HttpConnectionServicer::serviceConnection(Connection* c)
 {
    // wrap connection, set default timeouts to 30 seconds
@@ -75,8 +111,112 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
       mConnectionMonitor->beforeServicingConnection(&hc);
    }
 
+   // service HTTP/2 if the client sent the connection preface
+   if(mHttp2Enabled && Http2Connection::hasConnectionPreface(&hc))
+   {
+      Http2Connection h2c(
+         &hc, this, &mHttp2ThreadPool, mHttp2MaxConcurrentStreams);
+      h2c.service();
+   }
+   else
+   {
+      serviceHttp1Connection(&hc);
+   }
+
+   // monitor connection
+   if(!mConnectionMonitor.isNull())
+   {
+      mConnectionMonitor->afterServicingConnection(&hc);
+   }
+
+   // close connection
+   hc.close();
+}
+
+void HttpConnectionServicer::serviceHttp2Stream(Http2Stream* stream)
+{
    // create request
-   HttpRequest* request = hc.createRequest();
+   HttpRequest* request = stream->createRequest();
+   HttpRequestHeader* reqHeader = request->getHeader();
+
+   // create response
+   HttpResponse* response = request->createResponse();
+   HttpResponseHeader* resHeader = response->getHeader();
+
+   // set defaults
+   resHeader->setVersion("HTTP/1.1");
+   resHeader->setDate();
+   resHeader->setField("Server", mServerName);
+
+   // monitor request waiting
+   if(!mConnectionMonitor.isNull())
+   {
+      mConnectionMonitor->beforeRequest(stream);
+   }
+
+   // receive request header (already decoded from the stream)
+   request->receiveHeader();
+
+   // begin new request state
+   stream->getRequestState()->beginRequest();
+
+   // monitor received request
+   if(!mConnectionMonitor.isNull())
+   {
+      mConnectionMonitor->beforeServicingRequest(stream, request, response);
+   }
+
+   // do request modification
+   if(mRequestModifier != NULL)
+   {
+      mRequestModifier->modifyRequest(request);
+   }
+
+   // use proxy'd host field if one was used
+   // else use host field if one was used
+   string host;
+   if(reqHeader->getField("X-Forwarded-Host", host) ||
+      reqHeader->getField("Host", host))
+   {
+      resHeader->setField("Host", host);
+   }
+
+   // get request path and normalize it
+   const char* inPath = reqHeader->getPath();
+   char outPath[strlen(inPath) + 2];
+   HttpRequestServicer::normalizePath(inPath, outPath);
+
+   // find secure/non-secure servicer
+   HttpRequestServicer* hrs =
+      findRequestServicer(host, outPath, stream->isSecure());
+   if(hrs != NULL)
+   {
+      // service request, keeping the servicer as the request's route
+      stream->getRequestState()->getDetails()["servicer"] = hrs->getPath();
+      hrs->serviceRequest(request, response);
+   }
+   else
+   {
+      // no servicer, so send 404 Not Found
+      sendNotFound(response);
+   }
+
+   // monitor serviced request
+   if(!mConnectionMonitor.isNull())
+   {
+      mConnectionMonitor->afterServicingRequest(stream, request, response);
+      mConnectionMonitor->afterRequest(stream);
+   }
+
+   // clean up request and response
+   delete request;
+   delete response;
+}
+
+void HttpConnectionServicer::serviceHttp1Connection(HttpConnection* hc)
+{
+   // create request
+   HttpRequest* request = hc->createRequest();
    HttpRequestHeader* reqHeader = request->getHeader();
 
    // create response
@@ -96,20 +236,20 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
       // monitor request waiting
       if(!mConnectionMonitor.isNull())
       {
-         mConnectionMonitor->beforeRequest(&hc);
+         mConnectionMonitor->beforeRequest(hc);
       }
 
       // receive request header
       if((noerror = request->receiveHeader()))
       {
          // begin new request state
-         hc.getRequestState()->beginRequest();
+         hc->getRequestState()->beginRequest();
 
          // monitor received request
          if(!mConnectionMonitor.isNull())
          {
             mConnectionMonitor->beforeServicingRequest(
-               &hc, request, response);
+               hc, request, response);
          }
 
          // do request modification
@@ -165,10 +305,12 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
             HttpRequestServicer* hrs = NULL;
 
             // find secure/non-secure servicer
-            hrs = findRequestServicer(host, outPath, hc.isSecure());
+            hrs = findRequestServicer(host, outPath, hc->isSecure());
             if(hrs != NULL)
             {
-               // service request
+               // service request, keeping the servicer as the request's route
+               hc->getRequestState()->getDetails()["servicer"] =
+                  hrs->getPath();
                hrs->serviceRequest(request, response);
 
                // turn off keep-alive if response has close connection field
@@ -182,7 +324,7 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
                }
 
                // if servicer closed connection, turn off keep-alive
-               if(keepAlive && c->isClosed())
+               if(keepAlive && hc->isClosed())
                {
                   keepAlive = false;
                }
@@ -190,17 +332,7 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
             else
             {
                // no servicer, so send 404 Not Found
-               const char* html =
-                  "<html><body><h2>404 Not Found</h2></body></html>";
-               resHeader->setStatus(404, "Not Found");
-               resHeader->setField("Content-Type", "text/html");
-               resHeader->setField("Content-Length", 48);
-               resHeader->setField("Connection", "close");
-               if((noerror = response->sendHeader()))
-               {
-                  ByteArrayInputStream is(html, 48);
-                  noerror = response->sendBody(&is);
-               }
+               noerror = sendNotFound(response);
             }
          }
          else
@@ -225,19 +357,19 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
          if(!mConnectionMonitor.isNull())
          {
             mConnectionMonitor->afterServicingRequest(
-               &hc, request, response);
+               hc, request, response);
          }
       }
       else
       {
          // begin new request state
-         hc.getRequestState()->beginRequest();
+         hc->getRequestState()->beginRequest();
 
          // monitor request error
          if(!mConnectionMonitor.isNull())
          {
             mConnectionMonitor->beforeRequestError(
-               &hc, request, response);
+               hc, request, response);
          }
 
          // exception occurred while receiving header
@@ -331,20 +463,20 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
          if(!mConnectionMonitor.isNull())
          {
             mConnectionMonitor->afterRequestError(
-               &hc, request, response, e);
+               hc, request, response, e);
          }
       }
 
       // monitor request
       if(!mConnectionMonitor.isNull())
       {
-         mConnectionMonitor->afterRequest(&hc);
+         mConnectionMonitor->afterRequest(hc);
       }
 
       if(keepAlive && noerror)
       {
          // set keep-alive timeout (defaults to 5 minutes)
-         hc.setReadTimeout(1000 * 60 * 5);
+         hc->setReadTimeout(1000 * 60 * 5);
 
          // clear request and response header fields
          reqHeader->clearFields();
@@ -356,15 +488,26 @@ void HttpConnectionServicer::serviceConnection(Connection* c)
    // clean up request and response
    delete request;
    delete response;
+}
 
-   // monitor connection
-   if(!mConnectionMonitor.isNull())
+bool HttpConnectionServicer::sendNotFound(HttpResponse* response)
+{
+   bool rval;
+
+   const char* html =
+      "<html><body><h2>404 Not Found</h2></body></html>";
+   HttpResponseHeader* resHeader = response->getHeader();
+   resHeader->setStatus(404, "Not Found");
+   resHeader->setField("Content-Type", "text/html");
+   resHeader->setField("Content-Length", 48);
+   resHeader->setField("Connection", "close");
+   if((rval = response->sendHeader()))
    {
-      mConnectionMonitor->afterServicingConnection(&hc);
+      ByteArrayInputStream is(html, 48);
+      rval = response->sendBody(&is);
    }
 
-   // close connection
-   hc.close();
+   return rval;
 }
 
 static PatternRef _compileDomainRegex(const char* domain)
@@ -521,6 +664,12 @@ bool HttpConnectionServicer::addRequestServicer(
                rval = false;
             }
          }
+
+         // recompile routes
+         if(rval)
+         {
+            updateRouter();
+         }
       }
       mDomainLock.unlockExclusive();
    }
@@ -567,6 +716,12 @@ HttpRequestServicer* HttpConnectionServicer::removeRequestServicer(
             }
          }
       }
+
+      // recompile routes
+      if(rval != NULL)
+      {
+         updateRouter();
+      }
    }
    mDomainLock.unlockExclusive();
 
@@ -624,62 +779,62 @@ HttpRequestServicer* HttpConnectionServicer::findRequestServicer(
       }
    }
 
-   // get a copy of the path to reuse
-   int len = strlen(path);
-   char tmp[len + 1];
-   strcpy(tmp, path);
+   // protect the current router with a hazard pointer, ensuring that it
+   // wasn't swapped out before it was protected
+   HazardPtr* ptr = mRouterHazards.acquire();
+   HttpRequestRouter* router;
+   do
+   {
+      router = mRouter;
+      ptr->value = router;
+   }
+   while(router != Atomic::load(&mRouter));
+
+   // find servicer
+   rval = router->find(host.c_str(), path, secure);
+   mRouterHazards.release(ptr);
 
-   mDomainLock.lockShared();
+   return rval;
+}
+
+void HttpConnectionServicer::updateRouter()
+{
+   // compile a new router, domains are already sorted by priority
+   HttpRequestRouter* router = new HttpRequestRouter();
+   for(ServiceDomainList::iterator i = mDomains.begin();
+       i != mDomains.end(); ++i)
    {
-      // try to find regex-matching domain
-      for(ServiceDomainList::iterator i = mDomains.begin();
-          rval == NULL && i != mDomains.end(); ++i)
+      ServiceDomain* sd = *i;
+      int domain = router->addDomain(sd->domain, sd->regex);
+      for(ServicerMap::iterator si = sd->nonSecureMap.begin();
+          si != sd->nonSecureMap.end(); ++si)
       {
-         ServiceDomain* sd = *i;
-         if(sd->regex->match(host.c_str()))
-         {
-            // domain matched, look for servicer
-            ServicerMap& sm = secure ? sd->secureMap : sd->nonSecureMap;
+         router->addServicer(domain, si->first, si->second, false);
+      }
+      for(ServicerMap::iterator si = sd->secureMap.begin();
+          si != sd->secureMap.end(); ++si)
+      {
+         router->addServicer(domain, si->first, si->second, true);
+      }
+   }
 
-            // reset path
-            strcpy(path, tmp);
+   // swap in the new router and retire the old one
+   HttpRequestRouter* old = mRouter;
+   Atomic::store(&mRouter, router);
+   mRetiredRouters.push_back(old);
 
-            // try to find servicer for path
-            ServicerMap::iterator si;
-            while(rval == NULL && path != NULL)
-            {
-               si = sm.find(path);
-               if(si != sm.end())
-               {
-                  // servicer found
-                  rval = si->second;
-               }
-               else if(strlen(path) > 1)
-               {
-                  // try to find servicer at parent path
-                  char* end = strrchr(path, '/');
-                  if(end != NULL)
-                  {
-                     // if parent is root (end == path), set path to "/"
-                     // if parent is not root, clear last slash
-                     end[(end == path) ? 1 : 0] = 0;
-                  }
-                  else
-                  {
-                     // no path left to search
-                     path = NULL;
-                  }
-               }
-               else
-               {
-                  // no path left to search
-                  path = NULL;
-               }
-            }
-         }
+   // free any retired routers that are no longer in use
+   for(vector<HttpRequestRouter*>::iterator i = mRetiredRouters.begin();
+       i != mRetiredRouters.end();)
+   {
+      if(mRouterHazards.isProtected(*i))
+      {
+         ++i;
+      }
+      else
+      {
+         delete *i;
+         i = mRetiredRouters.erase(i);
       }
    }
-   mDomainLock.unlockShared();
-
-   return rval;
 }
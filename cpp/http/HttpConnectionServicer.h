@@ -4,11 +4,15 @@
 #ifndef monarch_http_HttpConnectionServicer_H
 #define monarch_http_HttpConnectionServicer_H
 
+#include "monarch/rt/HazardPtrList.h"
 #include "monarch/rt/SharedLock.h"
+#include "monarch/rt/ThreadPool.h"
 #include "monarch/net/ConnectionServicer.h"
+#include "monarch/http/Http2Stream.h"
 #include "monarch/http/HttpConnection.h"
 #include "monarch/http/HttpConnectionMonitor.h"
 #include "monarch/http/HttpRequestModifier.h"
+#include "monarch/http/HttpRequestRouter.h"
 #include "monarch/http/HttpRequestServicer.h"
 #include "monarch/util/StringTools.h"
 
@@ -33,6 +37,17 @@ namespace http
  *
  * For example: '*.mywebsite.com' will produce the regex '(.*)\.mywebsite\.com'
  *
+ * Domains and paths are compiled into an HttpRequestRouter whenever a
+ * servicer is added or removed. The current router is swapped in atomically
+ * and is protected by a hazard pointer while in use, so finding the servicer
+ * for a request does not require a lock.
+ *
+ * If HTTP/2 is enabled, connections that begin with the HTTP/2 connection
+ * preface (either cleartext "prior knowledge" connections or TLS connections
+ * that negotiated "h2" via ALPN) are serviced as HTTP/2 connections. Each
+ * HTTP/2 stream is dispatched to the same HttpRequestServicers as an
+ * HTTP/1.1 request would be, using a separate thread pool.
+ *
  * @author Dave Longley
  */
 class HttpConnectionServicer : public monarch::net::ConnectionServicer
@@ -93,6 +108,37 @@ protected:
     */
    monarch::rt::SharedLock mDomainLock;
 
+   /**
+    * The current router compiled from the service domains.
+    */
+   HttpRequestRouter* volatile mRouter;
+
+   /**
+    * Hazard pointers that protect routers while they are in use.
+    */
+   monarch::rt::HazardPtrList mRouterHazards;
+
+   /**
+    * Old routers that could not be freed yet because they were in use,
+    * protected by the domain lock.
+    */
+   std::vector<HttpRequestRouter*> mRetiredRouters;
+
+   /**
+    * True if HTTP/2 connections are serviced.
+    */
+   bool mHttp2Enabled;
+
+   /**
+    * The maximum number of concurrent streams per HTTP/2 connection.
+    */
+   uint32_t mHttp2MaxConcurrentStreams;
+
+   /**
+    * The thread pool used to service HTTP/2 streams.
+    */
+   monarch::rt::ThreadPool mHttp2ThreadPool;
+
 public:
    /**
     * Creates a new HttpConnectionServicer with the given default server
@@ -146,6 +192,40 @@ public:
     */
    virtual HttpRequestModifier* getRequestModifier();
 
+   /**
+    * Sets whether or not HTTP/2 connections will be serviced. HTTP/2 is
+    * disabled by default. To support HTTP/2 over TLS, the SslContext used
+    * by the server must also be given "h2" as an ALPN protocol.
+    *
+    * @param enabled true to service HTTP/2 connections, false not to.
+    */
+   virtual void setHttp2Enabled(bool enabled);
+
+   /**
+    * Returns true if HTTP/2 connections will be serviced.
+    *
+    * @return true if HTTP/2 is enabled, false if not.
+    */
+   virtual bool isHttp2Enabled();
+
+   /**
+    * Sets the maximum number of concurrent streams that a client may open
+    * on a single HTTP/2 connection. Defaults to 100.
+    *
+    * @param max the maximum number of concurrent streams.
+    */
+   virtual void setHttp2MaxConcurrentStreams(uint32_t max);
+
+   /**
+    * Gets the thread pool used to service HTTP/2 streams. Its size limits
+    * the number of HTTP/2 streams that may be serviced at once across all
+    * connections, additional streams are refused so that clients may retry
+    * them.
+    *
+    * @return the HTTP/2 stream thread pool.
+    */
+   virtual monarch::rt::ThreadPool* getHttp2ThreadPool();
+
    /**
     * Services the passed Connection. This method should end by closing the
     * passed Connection. After this method returns, the Connection will be
@@ -155,6 +235,14 @@ public:
     */
    virtual void serviceConnection(monarch::net::Connection* c);
 
+   /**
+    * Services a single request received on an HTTP/2 stream. Called by
+    * Http2Connection for each stream.
+    *
+    * @param stream the stream to service.
+    */
+   virtual void serviceHttp2Stream(Http2Stream* stream);
+
    /**
     * Adds an HttpRequestServicer to a domain. If a servicer with the same
     * path, at the same given domain, and with the same security status already
@@ -230,6 +318,30 @@ public:
       const char* path, bool secure, const char* domain = "*");
 
 protected:
+   /**
+    * Services HTTP/1.x requests on the passed connection until it is no
+    * longer kept alive.
+    *
+    * @param hc the HttpConnection to service.
+    */
+   virtual void serviceHttp1Connection(HttpConnection* hc);
+
+   /**
+    * Sends a 404 Not Found response.
+    *
+    * @param response the response to send.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool sendNotFound(HttpResponse* response);
+
+   /**
+    * Compiles a new router from the current service domains and swaps it in
+    * for the current router. Any old routers that are no longer in use are
+    * freed. The domain lock must be exclusively held.
+    */
+   virtual void updateRouter();
+
    /**
     * Finds an HttpRequestServicer for the given path in the given map.
     *
@@ -5,6 +5,7 @@
 
 #include "monarch/http/HttpHeader.h"
 
+#include "monarch/rt/Exception.h"
 #include "monarch/util/StringTools.h"
 
 #include <cstdlib>
@@ -14,6 +15,7 @@
 using namespace std;
 using namespace monarch::io;
 using namespace monarch::http;
+using namespace monarch::rt;
 using namespace monarch::util;
 
 // define CRLF
@@ -197,6 +199,11 @@ int HttpHeader::getFieldCount()
    return mFields.size();
 }
 
+inline HttpHeader::FieldMap& HttpHeader::getFields()
+{
+   return mFields;
+}
+
 bool HttpHeader::getField(const char* name, int64_t& value, int index)
 {
    bool rval = false;
@@ -457,9 +464,27 @@ bool HttpHeader::getDate(Date& date)
    string str;
    if(getField("Date", str))
    {
-      // get GMT time zone
-      TimeZone gmt = TimeZone::getTimeZone("GMT");
-      rval = date.parse(str.c_str(), "%a, %d %b %Y %H:%M:%S", &gmt);
+      rval = parseDate(str.c_str(), date);
+   }
+
+   return rval;
+}
+
+bool HttpHeader::parseDate(const char* str, Date& date)
+{
+   bool rval = false;
+
+   // RFC 1123, RFC 850 and asctime() formats, in order of preference
+   const char* formats[] = {
+      sDateFormat, "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y"};
+   TimeZone gmt = TimeZone::getTimeZone("GMT");
+   for(int i = 0; !rval && i < 3; ++i)
+   {
+      if(i > 0)
+      {
+         Exception::clear();
+      }
+      rval = date.parse(str, formats[i], &gmt);
    }
 
    return rval;
@@ -42,6 +42,14 @@ public:
       Header, Request, Response, Trailer
    };
 
+   /**
+    * A map of header field name to value. Field names are compared
+    * case-insensitively and a name may appear more than once.
+    */
+   typedef std::multimap<
+      const char*, std::string, monarch::util::StringCaseComparator>
+      FieldMap;
+
 protected:
    /**
     * The version (HTTP/major.minor) for the header.
@@ -52,9 +60,6 @@ protected:
     * The map containing the header fields using case-insensitive comparator to
     * compare field names.
     */
-   typedef std::multimap<
-      const char*, std::string, monarch::util::StringCaseComparator>
-      FieldMap;
    FieldMap mFields;
 
    /**
@@ -192,6 +197,14 @@ public:
     */
    virtual int getFieldCount();
 
+   /**
+    * Gets all of the fields in this header. The returned map must not be
+    * modified, use the field setters instead.
+    *
+    * @return the fields in this header.
+    */
+   virtual FieldMap& getFields();
+
    /**
     * Gets a header field value.
     *
@@ -286,7 +299,8 @@ public:
     *
     * @param date the Date to populate.
     *
-    * @return the GMT date for this header, false if no date header exists.
+    * @return the GMT date for this header, false if no date header exists
+    *         or it could not be parsed.
     */
    virtual bool getDate(monarch::util::Date& date);
 
@@ -321,6 +335,19 @@ public:
     * @param name the name of the header field to BiCapitalize.
     */
    static void biCapitalize(char* name);
+
+   /**
+    * Parses an HTTP-date in any of the formats that HTTP allows: the
+    * standard format (RFC 1123), the obsolete RFC 850 format and the ANSI C
+    * asctime() format, all of which are in GMT.
+    *
+    * @param str the date to parse.
+    * @param date the Date to populate.
+    *
+    * @return true if successful, false if the date could not be parsed (an
+    *         exception will be set).
+    */
+   static bool parseDate(const char* str, monarch::util::Date& date);
 };
 
 // typedef for a counted reference to an HttpHeader
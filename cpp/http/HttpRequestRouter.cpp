@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/http/HttpRequestRouter.h"
+
+#include <cstring>
+
+using namespace std;
+using namespace monarch::http;
+using namespace monarch::util;
+
+/**
+ * Gets the length of the first segment in a path (up to the first slash).
+ *
+ * @param path the path, without a leading slash.
+ *
+ * @return the length of the first segment.
+ */
+static inline int _segmentLength(const char* path)
+{
+   const char* end = strchr(path, '/');
+   return (end == NULL) ? strlen(path) : end - path;
+}
+
+/**
+ * Compares two path segments.
+ *
+ * @return less than, equal to, or greater than 0 if a is less than, equal to,
+ *         or greater than b.
+ */
+static inline int _compareSegments(
+   const char* a, int aLength, const char* b, int bLength)
+{
+   int rval = memcmp(a, b, (aLength < bLength) ? aLength : bLength);
+   if(rval == 0)
+   {
+      rval = aLength - bLength;
+   }
+   return rval;
+}
+
+/**
+ * Binary searches the sorted children of a path node for the child with the
+ * given first segment.
+ *
+ * @param children the children to search.
+ * @param segment the segment to look for.
+ * @param length the length of the segment.
+ * @param index set to the index of the child or where it should be inserted.
+ *
+ * @return true if the child was found, false if not.
+ */
+template<typename T>
+static bool _findChild(
+   vector<T*>& children, const char* segment, int length, int& index)
+{
+   bool rval = false;
+
+   int low = 0;
+   int high = children.size();
+   while(!rval && low < high)
+   {
+      int mid = (low + high) / 2;
+      T* child = children[mid];
+      int cmp = _compareSegments(
+         segment, length, child->label.data(), child->firstLength);
+      if(cmp == 0)
+      {
+         low = mid;
+         rval = true;
+      }
+      else if(cmp < 0)
+      {
+         high = mid;
+      }
+      else
+      {
+         low = mid + 1;
+      }
+   }
+   index = low;
+
+   return rval;
+}
+
+template<typename T>
+static void _deletePathNodes(vector<T*>& nodes)
+{
+   for(typename vector<T*>::iterator i = nodes.begin(); i != nodes.end(); ++i)
+   {
+      _deletePathNodes((*i)->children);
+      delete *i;
+   }
+}
+
+template<typename T>
+static void _deleteSuffixNodes(vector<pair<char, T*> >& nodes)
+{
+   for(typename vector<pair<char, T*> >::iterator i = nodes.begin();
+       i != nodes.end(); ++i)
+   {
+      _deleteSuffixNodes(i->second->children);
+      delete i->second;
+   }
+}
+
+HttpRequestRouter::HttpRequestRouter() :
+   mExactHosts(16),
+   mExactHostCount(0)
+{
+   mSuffixRoot.route = NULL;
+}
+
+HttpRequestRouter::~HttpRequestRouter()
+{
+   // clean up domain routes and tries
+   for(vector<DomainRoute*>::iterator i = mRoutes.begin();
+       i != mRoutes.end(); ++i)
+   {
+      _deletePathNodes((*i)->root.children);
+      delete *i;
+   }
+   _deleteSuffixNodes(mSuffixRoot.children);
+}
+
+int HttpRequestRouter::addDomain(const char* domain, PatternRef& regex)
+{
+   // create route with the next highest rank
+   DomainRoute* route = new DomainRoute;
+   route->rank = mRoutes.size();
+   route->root.firstLength = 0;
+   route->root.servicers[0] = route->root.servicers[1] = NULL;
+   mRoutes.push_back(route);
+
+   const char* wildcard = strchr(domain, '*');
+   if(wildcard == NULL)
+   {
+      // exact host
+      insertExactHost(domain, route);
+   }
+   else if(wildcard == domain && strchr(domain + 1, '*') == NULL)
+   {
+      // single leading wildcard, add reversed suffix to trie
+      SuffixNode* node = &mSuffixRoot;
+      for(const char* c = domain + strlen(domain) - 1; c > domain; --c)
+      {
+         // find or insert child in sorted order
+         vector<pair<char, SuffixNode*> >::iterator i =
+            node->children.begin();
+         for(; i != node->children.end() && i->first < *c; ++i);
+         if(i == node->children.end() || i->first != *c)
+         {
+            SuffixNode* child = new SuffixNode;
+            child->route = NULL;
+            i = node->children.insert(i, make_pair(*c, child));
+         }
+         node = i->second;
+      }
+
+      // domains are unique, keep the first route added
+      if(node->route == NULL)
+      {
+         node->route = route;
+      }
+   }
+   else
+   {
+      // other wildcard domains are matched by regex
+      PatternRoute pr;
+      pr.regex = regex;
+      pr.route = route;
+      mPatternRoutes.push_back(pr);
+   }
+
+   return route->rank;
+}
+
+void HttpRequestRouter::addServicer(
+   int domain, const char* path, HttpRequestServicer* s, bool secure)
+{
+   // skip leading slash, the root node is the "/" path
+   PathNode* node = &mRoutes[domain]->root;
+   const char* rest = (path[0] == '/') ? path + 1 : path;
+   while(rest[0] != 0)
+   {
+      int index;
+      int length = strlen(rest);
+      int firstLength = _segmentLength(rest);
+      if(!_findChild(node->children, rest, firstLength, index))
+      {
+         // no child shares the first segment, add the rest as a leaf
+         PathNode* child = new PathNode;
+         child->label = rest;
+         child->firstLength = firstLength;
+         child->servicers[0] = child->servicers[1] = NULL;
+         node->children.insert(node->children.begin() + index, child);
+         node = child;
+         rest += length;
+      }
+      else
+      {
+         // find the length of the common segments
+         PathNode* child = node->children[index];
+         int labelLength = child->label.length();
+         int common = firstLength;
+         while(common < labelLength && common < length &&
+            rest[common] == '/' && child->label[common] == '/')
+         {
+            int next = common + 1 + _segmentLength(rest + common + 1);
+            if(next <= labelLength &&
+               (next == labelLength || child->label[next] == '/') &&
+               memcmp(rest + common, child->label.data() + common,
+                  next - common) == 0)
+            {
+               common = next;
+            }
+            else
+            {
+               break;
+            }
+         }
+
+         if(common < labelLength)
+         {
+            // split the child at the end of the common segments
+            PathNode* mid = new PathNode;
+            mid->label = child->label.substr(0, common);
+            mid->firstLength = child->firstLength;
+            mid->servicers[0] = mid->servicers[1] = NULL;
+            mid->children.push_back(child);
+            child->label.erase(0, common + 1);
+            child->firstLength = _segmentLength(child->label.c_str());
+            node->children[index] = mid;
+            child = mid;
+         }
+
+         // continue with the remaining segments
+         node = child;
+         rest += (common < length) ? common + 1 : common;
+      }
+   }
+
+   node->servicers[secure ? 1 : 0] = s;
+}
+
+HttpRequestServicer* HttpRequestRouter::find(
+   const char* host, const char* path, bool secure)
+{
+   HttpRequestServicer* rval = NULL;
+   int rank = mRoutes.size();
+   int length = strlen(host);
+
+   // check for an exact host first
+   DomainRoute* route = findExactHost(host, length);
+   if(route != NULL)
+   {
+      rval = findPath(route, path, secure);
+      if(rval != NULL)
+      {
+         rank = route->rank;
+      }
+   }
+
+   // walk the wildcard suffix trie along the reversed host
+   SuffixNode* node = &mSuffixRoot;
+   for(int i = length; node != NULL;)
+   {
+      if(node->route != NULL && node->route->rank < rank)
+      {
+         HttpRequestServicer* s = findPath(node->route, path, secure);
+         if(s != NULL)
+         {
+            rval = s;
+            rank = node->route->rank;
+         }
+      }
+
+      // find the child for the next character
+      SuffixNode* next = NULL;
+      if(i > 0)
+      {
+         char c = host[--i];
+         for(vector<pair<char, SuffixNode*> >::iterator ci =
+             node->children.begin();
+             next == NULL && ci != node->children.end() && ci->first <= c;
+             ++ci)
+         {
+            if(ci->first == c)
+            {
+               next = ci->second;
+            }
+         }
+      }
+      node = next;
+   }
+
+   // try any regex domains with a higher priority, in priority order
+   for(vector<PatternRoute>::iterator i = mPatternRoutes.begin();
+       i != mPatternRoutes.end() && i->route->rank < rank; ++i)
+   {
+      if(i->regex->match(host))
+      {
+         HttpRequestServicer* s = findPath(i->route, path, secure);
+         if(s != NULL)
+         {
+            rval = s;
+            rank = i->route->rank;
+         }
+      }
+   }
+
+   return rval;
+}
+
+HttpRequestServicer* HttpRequestRouter::findPath(
+   DomainRoute* route, const char* path, bool secure)
+{
+   int idx = secure ? 1 : 0;
+   PathNode* node = &route->root;
+   HttpRequestServicer* rval = node->servicers[idx];
+
+   // descend the trie, keeping the servicer for the longest parent path
+   const char* rest = (path[0] == '/') ? path + 1 : path;
+   while(node != NULL && rest[0] != 0)
+   {
+      int index;
+      int firstLength = _segmentLength(rest);
+      PathNode* next = NULL;
+      if(_findChild(node->children, rest, firstLength, index))
+      {
+         // the whole label must match at a segment boundary
+         PathNode* child = node->children[index];
+         int labelLength = child->label.length();
+         if(strncmp(rest, child->label.data(), labelLength) == 0 &&
+            (rest[labelLength] == 0 || rest[labelLength] == '/'))
+         {
+            next = child;
+            rest += labelLength;
+            if(rest[0] == '/')
+            {
+               ++rest;
+            }
+            if(next->servicers[idx] != NULL)
+            {
+               rval = next->servicers[idx];
+            }
+         }
+      }
+      node = next;
+   }
+
+   return rval;
+}
+
+HttpRequestRouter::DomainRoute* HttpRequestRouter::findExactHost(
+   const char* host, int length)
+{
+   DomainRoute* rval = NULL;
+
+   if(mExactHostCount > 0)
+   {
+      unsigned int hash = hashHost(host, length);
+      ExactHostBucket& bucket =
+         mExactHosts[hash & (mExactHosts.size() - 1)];
+      for(ExactHostBucket::iterator i = bucket.begin();
+          rval == NULL && i != bucket.end(); ++i)
+      {
+         if(i->hash == hash && (int)i->host.length() == length &&
+            memcmp(i->host.data(), host, length) == 0)
+         {
+            rval = i->route;
+         }
+      }
+   }
+
+   return rval;
+}
+
+void HttpRequestRouter::insertExactHost(const char* host, DomainRoute* route)
+{
+   int length = strlen(host);
+   if(findExactHost(host, length) == NULL)
+   {
+      // grow the table to keep the load factor at or below 1
+      if(mExactHostCount == mExactHosts.size())
+      {
+         vector<ExactHostBucket> buckets(mExactHosts.size() * 2);
+         for(vector<ExactHostBucket>::iterator bi = mExactHosts.begin();
+             bi != mExactHosts.end(); ++bi)
+         {
+            for(ExactHostBucket::iterator i = bi->begin(); i != bi->end(); ++i)
+            {
+               buckets[i->hash & (buckets.size() - 1)].push_back(*i);
+            }
+         }
+         mExactHosts.swap(buckets);
+      }
+
+      ExactHost eh;
+      eh.host = host;
+      eh.hash = hashHost(host, length);
+      eh.route = route;
+      mExactHosts[eh.hash & (mExactHosts.size() - 1)].push_back(eh);
+      ++mExactHostCount;
+   }
+}
+
+unsigned int HttpRequestRouter::hashHost(const char* host, int length)
+{
+   // FNV-1a
+   unsigned int rval = 2166136261U;
+   for(int i = 0; i < length; ++i)
+   {
+      rval ^= (unsigned char)host[i];
+      rval *= 16777619U;
+   }
+   return rval;
+}
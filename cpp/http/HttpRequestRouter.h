@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_http_HttpRequestRouter_H
+#define monarch_http_HttpRequestRouter_H
+
+#include "monarch/http/HttpRequestServicer.h"
+#include "monarch/util/Pattern.h"
+
+#include <string>
+#include <vector>
+
+namespace monarch
+{
+namespace http
+{
+
+/**
+ * An HttpRequestRouter is a precompiled routing table that maps a host and
+ * a path to an HttpRequestServicer. It is built once from a set of domains
+ * and servicer paths and is never modified afterwards, so any number of
+ * threads may use it for lookups at the same time without locking.
+ *
+ * Domains are compiled into three structures:
+ *
+ * 1. Domains without wildcards are stored in a hash table of exact hosts.
+ * 2. Domains with a single leading wildcard (ie: '*.mywebsite.com' or '*')
+ *    are stored in a trie keyed on the reversed domain suffix, so that all
+ *    matching wildcard domains are found in one pass over the host.
+ * 3. Any other wildcard domains (ie: '*.mywebsite.*') are matched using
+ *    their regex.
+ *
+ * The servicer paths for each domain are stored in a radix trie of path
+ * segments so that the servicer for the longest matching parent path is
+ * found in one pass over the request path.
+ *
+ * Domains are given a priority by the order they are added. If more than
+ * one domain matches a host, the servicer from the highest priority domain
+ * that has a servicer for the path is used.
+ *
+ * @author Dave Longley
+ */
+class HttpRequestRouter
+{
+protected:
+   /**
+    * A PathNode is a node in a path radix trie. Its label is one or more
+    * path segments (separated by slashes, without a leading slash). The
+    * children of a node have unique first segments and are sorted by them.
+    */
+   struct PathNode
+   {
+      std::string label;
+      int firstLength;
+      HttpRequestServicer* servicers[2];
+      std::vector<PathNode*> children;
+   };
+
+   /**
+    * A DomainRoute contains the priority of a domain and the root of its
+    * path radix trie.
+    */
+   struct DomainRoute
+   {
+      int rank;
+      PathNode root;
+   };
+
+   /**
+    * An ExactHost is an entry in the exact host hash table.
+    */
+   struct ExactHost
+   {
+      std::string host;
+      unsigned int hash;
+      DomainRoute* route;
+   };
+
+   /**
+    * A SuffixNode is a node in the reversed domain suffix trie. Its route
+    * is set if a wildcard domain ends at the node.
+    */
+   struct SuffixNode
+   {
+      DomainRoute* route;
+      std::vector<std::pair<char, SuffixNode*> > children;
+   };
+
+   /**
+    * A PatternRoute is a domain that is matched by its regex.
+    */
+   struct PatternRoute
+   {
+      monarch::util::PatternRef regex;
+      DomainRoute* route;
+   };
+
+   /**
+    * All domain routes, in priority order.
+    */
+   std::vector<DomainRoute*> mRoutes;
+
+   /**
+    * The exact host hash table buckets, the number of buckets is always a
+    * power of 2.
+    */
+   typedef std::vector<ExactHost> ExactHostBucket;
+   std::vector<ExactHostBucket> mExactHosts;
+
+   /**
+    * The number of exact hosts.
+    */
+   unsigned int mExactHostCount;
+
+   /**
+    * The root of the reversed domain suffix trie.
+    */
+   SuffixNode mSuffixRoot;
+
+   /**
+    * The domains matched by regex, in priority order.
+    */
+   std::vector<PatternRoute> mPatternRoutes;
+
+public:
+   /**
+    * Creates a new, empty HttpRequestRouter.
+    */
+   HttpRequestRouter();
+
+   /**
+    * Destructs this HttpRequestRouter.
+    */
+   virtual ~HttpRequestRouter();
+
+   /**
+    * Adds a domain to this router. Domains must be added in priority order,
+    * highest priority first. This method must not be called once the router
+    * is in use for lookups.
+    *
+    * @param domain the domain, which may contain wildcards (*).
+    * @param regex the compiled regex for the domain.
+    *
+    * @return the ID of the domain to add servicers to.
+    */
+   virtual int addDomain(
+      const char* domain, monarch::util::PatternRef& regex);
+
+   /**
+    * Adds an HttpRequestServicer for a path to a domain. This method must
+    * not be called once the router is in use for lookups.
+    *
+    * @param domain the ID of the domain returned from addDomain().
+    * @param path the normalized path for the servicer.
+    * @param s the servicer.
+    * @param secure true if the servicer is for secure connections, false if
+    *           it is for non-secure connections.
+    */
+   virtual void addServicer(
+      int domain, const char* path, HttpRequestServicer* s, bool secure);
+
+   /**
+    * Finds the HttpRequestServicer for the given host and path. The
+    * servicer at the longest matching parent path of the highest priority
+    * domain that matches the host is returned.
+    *
+    * @param host the host, without a port.
+    * @param path the normalized path, without a query.
+    * @param secure true to find a secure servicer, false for a non-secure
+    *           one.
+    *
+    * @return the HttpRequestServicer, or NULL if none was found.
+    */
+   virtual HttpRequestServicer* find(
+      const char* host, const char* path, bool secure);
+
+protected:
+   /**
+    * Finds the servicer in a domain for the longest matching parent path.
+    *
+    * @param route the domain route to search.
+    * @param path the normalized path.
+    * @param secure true to find a secure servicer, false for a non-secure
+    *           one.
+    *
+    * @return the HttpRequestServicer, or NULL if none was found.
+    */
+   virtual HttpRequestServicer* findPath(
+      DomainRoute* route, const char* path, bool secure);
+
+   /**
+    * Finds the domain route for an exact host.
+    *
+    * @param host the host.
+    * @param length the length of the host.
+    *
+    * @return the domain route, or NULL if none was found.
+    */
+   virtual DomainRoute* findExactHost(const char* host, int length);
+
+   /**
+    * Inserts a domain route into the exact host hash table, growing it as
+    * necessary.
+    *
+    * @param host the host.
+    * @param route the domain route.
+    */
+   virtual void insertExactHost(const char* host, DomainRoute* route);
+
+   /**
+    * Hashes a host.
+    *
+    * @param host the host.
+    * @param length the length of the host.
+    *
+    * @return the hash.
+    */
+   static unsigned int hashHost(const char* host, int length);
+};
+
+} // end namespace http
+} // end namespace monarch
+#endif
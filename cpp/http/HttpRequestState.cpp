@@ -1,14 +1,19 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/http/HttpRequestState.h"
 
+#include "monarch/rt/System.h"
+
 using namespace std;
 using namespace monarch::http;
 using namespace monarch::rt;
 using namespace monarch::util;
 
-HttpRequestState::HttpRequestState()
+HttpRequestState::HttpRequestState() :
+   mHeaderStartTime(0),
+   mServiceStartTime(0),
+   mResponseStartTime(0)
 {
 }
 
@@ -21,6 +26,8 @@ void HttpRequestState::beginRequest()
    mDetails = new DynamicObject();
    mDetails->setType(Map);
    mTimer.start();
+   mServiceStartTime = System::getMonotonicMicroseconds();
+   mResponseStartTime = 0;
 }
 
 Timer* HttpRequestState::getTimer()
@@ -32,3 +39,31 @@ DynamicObject& HttpRequestState::getDetails()
 {
    return mDetails;
 }
+
+void HttpRequestState::setHeaderStartTime(uint64_t time)
+{
+   mHeaderStartTime = time;
+}
+
+void HttpRequestState::responseStarted()
+{
+   if(mResponseStartTime == 0)
+   {
+      mResponseStartTime = System::getMonotonicMicroseconds();
+   }
+}
+
+uint64_t HttpRequestState::getHeaderStartTime()
+{
+   return mHeaderStartTime;
+}
+
+uint64_t HttpRequestState::getServiceStartTime()
+{
+   return mServiceStartTime;
+}
+
+uint64_t HttpRequestState::getResponseStartTime()
+{
+   return mResponseStartTime;
+}
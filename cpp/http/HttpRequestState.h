@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_http_HttpRequestState_h
 #define monarch_http_HttpRequestState_h
@@ -19,6 +19,11 @@ namespace http
  * provides a timer for each request. beginRequest() should be called when
  * starting to handle a request to clear state and start the timer.
  *
+ * It also records, in microseconds, when the request header started to
+ * arrive, when the request began to be serviced and when the response
+ * header was sent, so that the time spent in each phase of a request can be
+ * measured.
+ *
  * @author David I. Lehn
  */
 class HttpRequestState
@@ -34,6 +39,23 @@ protected:
     */
    monarch::rt::DynamicObject mDetails;
 
+   /**
+    * When the request header started to arrive, in monotonic microseconds,
+    * 0 if unknown.
+    */
+   uint64_t mHeaderStartTime;
+
+   /**
+    * When the request began to be serviced, in monotonic microseconds.
+    */
+   uint64_t mServiceStartTime;
+
+   /**
+    * When the response header was sent, in monotonic microseconds, 0 if it
+    * has not been sent.
+    */
+   uint64_t mResponseStartTime;
+
 public:
    /**
     * Creates a new HttpRequestState.
@@ -64,6 +86,41 @@ public:
     * @return a DynamicObject with connection state details.
     */
    virtual monarch::rt::DynamicObject& getDetails();
+
+   /**
+    * Sets when the header of the next request started to arrive.
+    *
+    * @param time the time from System::getMonotonicMicroseconds(), 0 if
+    *           unknown.
+    */
+   virtual void setHeaderStartTime(uint64_t time);
+
+   /**
+    * Marks the time the response header was sent, unless it was already
+    * marked for the current request.
+    */
+   virtual void responseStarted();
+
+   /**
+    * Gets when the request header started to arrive.
+    *
+    * @return the monotonic time in microseconds, 0 if unknown.
+    */
+   virtual uint64_t getHeaderStartTime();
+
+   /**
+    * Gets when the request began to be serviced.
+    *
+    * @return the monotonic time in microseconds.
+    */
+   virtual uint64_t getServiceStartTime();
+
+   /**
+    * Gets when the response header was sent.
+    *
+    * @return the monotonic time in microseconds, 0 if it has not been sent.
+    */
+   virtual uint64_t getResponseStartTime();
 };
 
 } // end namespace http
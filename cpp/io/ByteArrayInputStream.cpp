@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/io/ByteArrayInputStream.h"
 
@@ -23,6 +23,15 @@ ByteArrayInputStream::ByteArrayInputStream(ByteBuffer* b, bool cleanup) :
 {
 }
 
+ByteArrayInputStream::ByteArrayInputStream(ByteBufferRef& b) :
+   mBytes(b->data()),
+   mLength(b->length()),
+   mBuffer(NULL),
+   mCleanupBuffer(false),
+   mShared(b)
+{
+}
+
 ByteArrayInputStream::~ByteArrayInputStream()
 {
    if(mCleanupBuffer)
@@ -66,6 +75,7 @@ void ByteArrayInputStream::setByteArray(const char* b, int length)
 {
    mBytes = b;
    mLength = length;
+   mShared.setNull();
    if(mCleanupBuffer)
    {
       delete mBuffer;
@@ -78,6 +88,7 @@ void ByteArrayInputStream::setByteBuffer(ByteBuffer* b, bool cleanup)
 {
    mBytes = NULL;
    mLength = 0;
+   mShared.setNull();
    if(mCleanupBuffer)
    {
       delete mBuffer;
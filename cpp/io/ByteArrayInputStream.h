@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_io_ByteArrayInputStream_H
 #define monarch_io_ByteArrayInputStream_H
@@ -16,6 +16,10 @@ namespace io
  * A ByteArrayInputStream is used to read bytes from a byte array or,
  * alternatively, from a ByteBuffer.
  *
+ * A shared ByteBuffer can also be read without being modified, so that any
+ * number of streams can read the same immutable data at once. The stream
+ * keeps a reference to the buffer until it is destructed.
+ *
  * @author Dave Longley
  */
 class ByteArrayInputStream : public monarch::io::InputStream
@@ -41,6 +45,11 @@ protected:
     */
    bool mCleanupBuffer;
 
+   /**
+    * A reference to the shared ByteBuffer being read, if any.
+    */
+   ByteBufferRef mShared;
+
 public:
    /**
     * Creates a new ByteArrayInputStream.
@@ -58,6 +67,14 @@ public:
     */
    ByteArrayInputStream(ByteBuffer* b, bool cleanup = false);
 
+   /**
+    * Creates a new ByteArrayInputStream that reads the bytes of a shared
+    * ByteBuffer without modifying it.
+    *
+    * @param b the shared ByteBuffer to read from.
+    */
+   ByteArrayInputStream(ByteBufferRef& b);
+
    /**
     * Destructs this ByteArrayInputStream.
     */
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/io/ByteBuffer.h"
 
@@ -95,6 +95,21 @@ void ByteBuffer::allocateSpace(int length, bool resize)
    }
 }
 
+void ByteBuffer::reserve(int length)
+{
+   // grow the buffer by at least double
+   int overflow = length - freeSpace();
+   if(overflow > 0)
+   {
+      int capacity = mCapacity * 2;
+      int needed = mCapacity + overflow;
+      resize((capacity > needed) ? capacity : needed);
+   }
+
+   // move the data to the front if the space is before it
+   allocateSpace(length, false);
+}
+
 void ByteBuffer::resize(int capacity)
 {
    if(capacity != mCapacity)
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_io_ByteBuffer_H
 #define monarch_io_ByteBuffer_H
@@ -126,6 +126,16 @@ public:
     */
    virtual void allocateSpace(int length, bool resize);
 
+   /**
+    * Ensures there is room to write the passed number of bytes at end(),
+    * like allocateSpace() with resize set to true. When the buffer must
+    * grow, its capacity is at least doubled so that appending to it one
+    * piece at a time takes linear time overall.
+    *
+    * @param length the number of bytes that need to be written to this buffer.
+    */
+   virtual void reserve(int length);
+
    /**
     * Resizes the ByteBuffer to the given capacity. Any existing data that
     * cannot fit in the new capacity will be truncated. Keep in mind that, the
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/mail/MailTemplateParser.h"
 
@@ -97,6 +97,22 @@ static bool parseLine(
 
 bool MailTemplateParser::parse(
    Mail* mail, DynamicObject& vars, bool strict, InputStream* is)
+{
+   // add template input stream to passed input stream
+   TemplateInputStream tis(vars, strict, is, false);
+   return parseTemplate(mail, &tis);
+}
+
+bool MailTemplateParser::parseFile(
+   Mail* mail, DynamicObject& vars, bool strict, const char* filename,
+   TemplateCache* cache)
+{
+   TemplateInputStream tis(vars, strict, NULL, false);
+   tis.setCache(cache);
+   return tis.setTemplateFile(filename) && parseTemplate(mail, &tis);
+}
+
+bool MailTemplateParser::parseTemplate(Mail* mail, InputStream* tis)
 {
    bool rval = true;
 
@@ -106,9 +122,6 @@ bool MailTemplateParser::parse(
    // clear mail
    mail->clear();
 
-   // add template input stream to passed input stream
-   TemplateInputStream tis(vars, strict, is, false);
-
    // SMTP RFC requires lines be no longer than 998 bytes (+2 for CRLF = 1000)
    // so read in a maximum of 1000 bytes at a time
    bool bodyEncoded = mail->shouldTransferEncodeBody();
@@ -122,7 +135,7 @@ bool MailTemplateParser::parse(
    bool cr = false;
 
    // read as much as 1000 bytes at a time, then check the read buffer
-   while(rval && (numBytes = tis.read(b + length, 1000 - length)) > 0)
+   while(rval && (numBytes = tis->read(b + length, 1000 - length)) > 0)
    {
       // increment length (number of valid bytes in 'b')
       length += numBytes;
@@ -1,10 +1,11 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_mail_MailTemplateParser_H
 #define monarch_mail_MailTemplateParser_H
 
 #include "monarch/mail/Mail.h"
+#include "monarch/data/TemplateCache.h"
 #include "monarch/io/InputStream.h"
 
 namespace monarch
@@ -65,6 +66,35 @@ public:
    virtual bool parse(
       Mail* mail, monarch::rt::DynamicObject& vars, bool strict,
       monarch::io::InputStream* is);
+
+   /**
+    * Parses a template file and writes it out to the passed Mail. With a
+    * cache, the template is only parsed once and later mails from it only
+    * have their variables evaluated.
+    *
+    * @param mail the Mail to populate.
+    * @param vars the key-value variables in the template.
+    * @param strict true to raise an exception if the passed variables do not
+    *               have a variable that is found in the template, false if not.
+    * @param filename the filename of the template.
+    * @param cache the TemplateCache to use, NULL for none.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool parseFile(
+      Mail* mail, monarch::rt::DynamicObject& vars, bool strict,
+      const char* filename, monarch::data::TemplateCache* cache = NULL);
+
+protected:
+   /**
+    * Reads the output of a template and writes it out to the passed Mail.
+    *
+    * @param mail the Mail to populate.
+    * @param tis the TemplateInputStream to read the output from.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool parseTemplate(Mail* mail, monarch::io::InputStream* tis);
 };
 
 } // end namespace mail
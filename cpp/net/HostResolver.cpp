@@ -0,0 +1,566 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/net/HostResolver.h"
+
+#include "monarch/io/FileInputStream.h"
+#include "monarch/net/WindowsSupport.h"
+#include "monarch/rt/System.h"
+#include "monarch/rt/ThreadPool.h"
+
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace monarch::io;
+using namespace monarch::net;
+using namespace monarch::rt;
+
+#define DEFAULT_POSITIVE_TTL   60000
+#define DEFAULT_NEGATIVE_TTL   5000
+#define DEFAULT_TIMEOUT        30000
+#define DEFAULT_MAX_ENTRIES    1024
+
+HostResolver* HostResolver::sDefault = NULL;
+
+/**
+ * Gets the key for a host, which is the communication domain followed by
+ * the lower-cased host.
+ *
+ * @param host the host.
+ * @param domain the communication domain.
+ *
+ * @return the key.
+ */
+static string _getHostKey(
+   const char* host, SocketAddress::CommunicationDomain domain)
+{
+   string key = (domain == SocketAddress::IPv6) ? "6:" : "4:";
+   for(const char* c = host; *c != 0; ++c)
+   {
+      key.push_back(tolower(*c));
+   }
+   return key;
+}
+
+/**
+ * Checks whether a host is already a numeric address for the given
+ * communication domain.
+ *
+ * @param host the host.
+ * @param domain the communication domain.
+ *
+ * @return true if the host is a numeric address, false if not.
+ */
+static bool _isNumericAddress(
+   const char* host, SocketAddress::CommunicationDomain domain)
+{
+   unsigned char buf[sizeof(struct in6_addr)];
+   return inet_pton(
+      (domain == SocketAddress::IPv6) ? AF_INET6 : AF_INET, host, buf) == 1;
+}
+
+void HostResolver::Lookup::run()
+{
+   resolver->runLookup(this);
+}
+
+HostResolver::HostResolver(unsigned int threads) :
+   mDispatcher(new ThreadPool(threads), true),
+   mPositiveTtl(DEFAULT_POSITIVE_TTL),
+   mNegativeTtl(DEFAULT_NEGATIVE_TTL),
+   mTimeout(DEFAULT_TIMEOUT),
+   mMaxEntries(DEFAULT_MAX_ENTRIES),
+   mHits(0),
+   mNegativeHits(0),
+   mLookupCount(0),
+   mCoalesced(0),
+   mTimeouts(0),
+   mFailures(0)
+{
+   mDispatcher.startDispatching();
+}
+
+HostResolver::~HostResolver()
+{
+   // stop dispatching and wait for running lookups to finish
+   mDispatcher.stopDispatching();
+   mDispatcher.clearQueuedJobs();
+   mDispatcher.terminateAllRunningJobs();
+
+   // free lookups that never ran
+   for(LookupMap::iterator i = mLookups.begin(); i != mLookups.end(); ++i)
+   {
+      delete i->second;
+   }
+}
+
+void HostResolver::setPositiveTtl(uint32_t ttl)
+{
+   mPositiveTtl = ttl;
+}
+
+uint32_t HostResolver::getPositiveTtl()
+{
+   return mPositiveTtl;
+}
+
+void HostResolver::setNegativeTtl(uint32_t ttl)
+{
+   mNegativeTtl = ttl;
+}
+
+uint32_t HostResolver::getNegativeTtl()
+{
+   return mNegativeTtl;
+}
+
+void HostResolver::setTimeout(uint32_t timeout)
+{
+   mTimeout = timeout;
+}
+
+uint32_t HostResolver::getTimeout()
+{
+   return mTimeout;
+}
+
+void HostResolver::setMaxEntries(uint32_t max)
+{
+   mMaxEntries = max;
+}
+
+bool HostResolver::addHost(const char* host, const char* address)
+{
+   bool rval = true;
+
+   SocketAddress::CommunicationDomain domain;
+   if(_isNumericAddress(address, SocketAddress::IPv4))
+   {
+      domain = SocketAddress::IPv4;
+   }
+   else if(_isNumericAddress(address, SocketAddress::IPv6))
+   {
+      domain = SocketAddress::IPv6;
+   }
+   else
+   {
+      ExceptionRef e = new Exception(
+         "Could not add host. Invalid address.",
+         "monarch.net.HostResolver.InvalidAddress");
+      e->getDetails()["host"] = host;
+      e->getDetails()["address"] = address;
+      Exception::set(e);
+      rval = false;
+   }
+
+   if(rval)
+   {
+      CacheEntry entry;
+      entry.address = address;
+      entry.expires = 0;
+      mLock.lock();
+      mHosts[_getHostKey(host, domain)] = entry;
+      mLock.unlock();
+   }
+
+   return rval;
+}
+
+bool HostResolver::loadHostsFile(File& file)
+{
+   bool rval = true;
+
+   FileInputStream fis(file);
+   string line;
+   int ret;
+   while(rval && (ret = fis.readLine(line)) > 0)
+   {
+      // strip comment
+      string::size_type end = line.find('#');
+      if(end != string::npos)
+      {
+         line.erase(end);
+      }
+
+      // split into address and hosts
+      vector<string> fields;
+      const char* ws = " \t\r";
+      string::size_type start = line.find_first_not_of(ws);
+      while(start != string::npos)
+      {
+         end = line.find_first_of(ws, start);
+         fields.push_back(line.substr(start, end - start));
+         start = (end == string::npos) ?
+            end : line.find_first_not_of(ws, end);
+      }
+      for(unsigned int i = 1; rval && i < fields.size(); ++i)
+      {
+         rval = addHost(fields[i].c_str(), fields[0].c_str());
+      }
+   }
+   fis.close();
+
+   if(!rval || ret < 0)
+   {
+      ExceptionRef e = new Exception(
+         "Could not load hosts file.",
+         "monarch.net.HostResolver.InvalidHostsFile");
+      e->getDetails()["path"] = file->getAbsolutePath();
+      Exception::push(e);
+      rval = false;
+   }
+
+   return rval;
+}
+
+bool HostResolver::resolve(
+   const char* host, SocketAddress::CommunicationDomain domain,
+   string& address)
+{
+   bool rval = false;
+
+   // numeric addresses need no lookup
+   if(_isNumericAddress(host, domain))
+   {
+      address = host;
+      rval = true;
+   }
+   else
+   {
+      string key = _getHostKey(host, domain);
+      bool found = false;
+      bool timedOut = false;
+
+      mLock.lock();
+      {
+         CacheEntry entry;
+         if(getCachedAddress(key, entry))
+         {
+            found = true;
+            address = entry.address;
+         }
+         else
+         {
+            // join or start lookup
+            if(mLookups.find(key) != mLookups.end())
+            {
+               ++mCoalesced;
+            }
+            Lookup* lookup = startLookup(key, host, domain);
+            ++lookup->references;
+
+            // wait for lookup to complete
+            uint64_t end = System::getCurrentMilliseconds() + mTimeout;
+            bool interrupted = false;
+            while(!lookup->done && !timedOut && !interrupted)
+            {
+               uint64_t now = System::getCurrentMilliseconds();
+               if(mTimeout != 0 && now >= end)
+               {
+                  timedOut = true;
+               }
+               else
+               {
+                  interrupted = !mLock.wait(
+                     (mTimeout == 0) ? 0 : (uint32_t)(end - now));
+               }
+            }
+
+            if(lookup->done)
+            {
+               found = true;
+               address = lookup->address;
+            }
+            else if(timedOut)
+            {
+               ++mTimeouts;
+            }
+            releaseLookup(lookup);
+         }
+      }
+      mLock.unlock();
+
+      if(found && address.length() > 0)
+      {
+         rval = true;
+      }
+      else if(found)
+      {
+         ExceptionRef e = new Exception(
+            "Unknown host.",
+            "monarch.net.UnknownHost");
+         e->getDetails()["host"] = host;
+         Exception::set(e);
+      }
+      else if(timedOut)
+      {
+         ExceptionRef e = new Exception(
+            "Timed out resolving host.",
+            "monarch.net.HostResolver.Timeout");
+         e->getDetails()["host"] = host;
+         e->getDetails()["timeout"] = mTimeout;
+         Exception::set(e);
+      }
+   }
+
+   return rval;
+}
+
+void HostResolver::prefetch(
+   const char* host, SocketAddress::CommunicationDomain domain)
+{
+   if(!_isNumericAddress(host, domain))
+   {
+      string key = _getHostKey(host, domain);
+      mLock.lock();
+      {
+         CacheEntry entry;
+         if(mHosts.find(key) == mHosts.end() &&
+            !getCachedAddress(key, entry))
+         {
+            startLookup(key, host, domain);
+         }
+      }
+      mLock.unlock();
+   }
+}
+
+void HostResolver::clear()
+{
+   mLock.lock();
+   mCache.clear();
+   mLock.unlock();
+}
+
+DynamicObject HostResolver::getStats()
+{
+   DynamicObject rval;
+
+   mLock.lock();
+   {
+      rval["size"] = (uint32_t)mCache.size();
+      rval["hosts"] = (uint32_t)mHosts.size();
+      rval["pending"] = (uint32_t)mLookups.size();
+      rval["hits"] = mHits;
+      rval["negativeHits"] = mNegativeHits;
+      rval["lookups"] = mLookupCount;
+      rval["coalesced"] = mCoalesced;
+      rval["timeouts"] = mTimeouts;
+      rval["failures"] = mFailures;
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void HostResolver::setDefault(HostResolver* resolver)
+{
+   sDefault = resolver;
+}
+
+HostResolver* HostResolver::getDefault()
+{
+   return sDefault;
+}
+
+bool HostResolver::lookup(
+   const char* host, SocketAddress::CommunicationDomain domain,
+   string& address)
+{
+   bool rval = false;
+
+   // create hints address structure
+   struct addrinfo hints;
+   memset(&hints, '\0', sizeof(hints));
+   hints.ai_family = (domain == SocketAddress::IPv6) ? AF_INET6 : AF_INET;
+
+   // create pointer for storing allocated resolved address
+   struct addrinfo* res = NULL;
+
+   // get address information
+   if(getaddrinfo(host, NULL, &hints, &res) != 0)
+   {
+      ExceptionRef e = new Exception(
+         "Unknown host.",
+         "monarch.net.UnknownHost");
+      e->getDetails()["host"] = host;
+      Exception::set(e);
+   }
+   else
+   {
+      // get the address of the first result
+      char dst[INET6_ADDRSTRLEN];
+      memset(&dst, '\0', INET6_ADDRSTRLEN);
+      if(domain == SocketAddress::IPv6)
+      {
+         struct sockaddr_in6 addr;
+         memcpy(&addr, res->ai_addr, res->ai_addrlen);
+         inet_ntop(AF_INET6, &addr.sin6_addr, dst, INET6_ADDRSTRLEN);
+      }
+      else
+      {
+         struct sockaddr_in addr;
+         memcpy(&addr, res->ai_addr, res->ai_addrlen);
+         inet_ntop(AF_INET, &addr.sin_addr, dst, INET_ADDRSTRLEN);
+      }
+      address = dst;
+      rval = true;
+   }
+
+   if(res != NULL)
+   {
+      // free res if it got allocated
+      freeaddrinfo(res);
+   }
+
+   return rval;
+}
+
+bool HostResolver::getCachedAddress(const string& key, CacheEntry& entry)
+{
+   bool rval = false;
+
+   // check added hosts first
+   CacheMap::iterator i = mHosts.find(key);
+   if(i != mHosts.end())
+   {
+      entry = i->second;
+      ++mHits;
+      rval = true;
+   }
+   else
+   {
+      i = mCache.find(key);
+      if(i != mCache.end())
+      {
+         if(i->second.expires <= System::getCurrentMilliseconds())
+         {
+            // expired
+            mCache.erase(i);
+         }
+         else
+         {
+            entry = i->second;
+            if(entry.address.length() > 0)
+            {
+               ++mHits;
+            }
+            else
+            {
+               ++mNegativeHits;
+            }
+            rval = true;
+         }
+      }
+   }
+
+   return rval;
+}
+
+HostResolver::Lookup* HostResolver::startLookup(
+   const string& key, const char* host,
+   SocketAddress::CommunicationDomain domain)
+{
+   Lookup* rval;
+
+   LookupMap::iterator i = mLookups.find(key);
+   if(i != mLookups.end())
+   {
+      rval = i->second;
+   }
+   else
+   {
+      // the job holds a reference until it completes
+      rval = new Lookup;
+      rval->resolver = this;
+      rval->key = key;
+      rval->host = host;
+      rval->domain = domain;
+      rval->done = false;
+      rval->references = 1;
+      mLookups[key] = rval;
+      ++mLookupCount;
+      mDispatcher.queueJob(*rval);
+   }
+
+   return rval;
+}
+
+void HostResolver::runLookup(Lookup* lookup)
+{
+   // look up host without holding the lock
+   string address;
+   if(!HostResolver::lookup(lookup->host.c_str(), lookup->domain, address))
+   {
+      Exception::clear();
+   }
+
+   mLock.lock();
+   {
+      lookup->address = address;
+      lookup->done = true;
+      if(address.length() == 0)
+      {
+         ++mFailures;
+      }
+      cacheAddress(lookup->key, address);
+      mLookups.erase(lookup->key);
+      mLock.notifyAll();
+      releaseLookup(lookup);
+   }
+   mLock.unlock();
+}
+
+void HostResolver::releaseLookup(Lookup* lookup)
+{
+   if(--lookup->references == 0)
+   {
+      delete lookup;
+   }
+}
+
+void HostResolver::cacheAddress(const string& key, const string& address)
+{
+   uint64_t now = System::getCurrentMilliseconds();
+
+   // make room if the cache is full
+   if(mCache.size() >= mMaxEntries && mCache.find(key) == mCache.end())
+   {
+      // drop expired entries
+      for(CacheMap::iterator i = mCache.begin(); i != mCache.end();)
+      {
+         if(i->second.expires <= now)
+         {
+            mCache.erase(i++);
+         }
+         else
+         {
+            ++i;
+         }
+      }
+
+      // drop the entry that expires soonest
+      if(mCache.size() >= mMaxEntries && !mCache.empty())
+      {
+         CacheMap::iterator soonest = mCache.begin();
+         for(CacheMap::iterator i = mCache.begin(); i != mCache.end(); ++i)
+         {
+            if(i->second.expires < soonest->second.expires)
+            {
+               soonest = i;
+            }
+         }
+         mCache.erase(soonest);
+      }
+   }
+
+   if(mMaxEntries > 0)
+   {
+      CacheEntry& entry = mCache[key];
+      entry.address = address;
+      entry.expires = now +
+         ((address.length() > 0) ? mPositiveTtl : mNegativeTtl);
+   }
+}
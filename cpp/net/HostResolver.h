@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_net_HostResolver_H
+#define monarch_net_HostResolver_H
+
+#include "monarch/io/File.h"
+#include "monarch/net/SocketAddress.h"
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/JobDispatcher.h"
+
+#include <map>
+#include <string>
+
+namespace monarch
+{
+namespace net
+{
+
+/**
+ * A HostResolver resolves host names to addresses using a small pool of
+ * resolver threads and caches the results.
+ *
+ * Successful lookups are cached for the positive time to live and failed
+ * lookups for the negative time to live. If several threads need the same
+ * host at the same time, only one lookup is performed and all of them wait
+ * for its result. A caller only waits up to the resolver's timeout. If that
+ * expires, the lookup continues in the background and its result is cached
+ * for later callers.
+ *
+ * Hosts may also be added from a hosts-style file or one at a time. These
+ * hosts never expire and are used before any lookup is performed, so that,
+ * for instance, tests can run without a network.
+ *
+ * InternetAddress and Internet6Address use the default HostResolver, if one
+ * has been set, when resolving a host. Otherwise they look up the host
+ * directly on the calling thread.
+ *
+ * @author Dave Longley
+ */
+class HostResolver
+{
+protected:
+   /**
+    * A cached address for a host and the time it expires. The address is
+    * empty if the host is unknown.
+    */
+   struct CacheEntry
+   {
+      std::string address;
+      uint64_t expires;
+   };
+
+   /**
+    * A map of host keys (the communication domain and the lower-cased host)
+    * to cache entries.
+    */
+   typedef std::map<std::string, CacheEntry> CacheMap;
+
+   /**
+    * A lookup of a host that is queued or running, with the number of
+    * references to it from threads waiting on it and from its job.
+    */
+   struct Lookup : public monarch::rt::Runnable
+   {
+      HostResolver* resolver;
+      std::string key;
+      std::string host;
+      SocketAddress::CommunicationDomain domain;
+      bool done;
+      std::string address;
+      int references;
+
+      virtual ~Lookup() {}
+      virtual void run();
+   };
+
+   /**
+    * A map of host keys to pending lookups.
+    */
+   typedef std::map<std::string, Lookup*> LookupMap;
+
+   /**
+    * The cached addresses.
+    */
+   CacheMap mCache;
+
+   /**
+    * The hosts that were added, which never expire.
+    */
+   CacheMap mHosts;
+
+   /**
+    * The pending lookups.
+    */
+   LookupMap mLookups;
+
+   /**
+    * The dispatcher that runs lookups on the resolver threads.
+    */
+   monarch::rt::JobDispatcher mDispatcher;
+
+   /**
+    * The time to cache a resolved address, in milliseconds.
+    */
+   uint32_t mPositiveTtl;
+
+   /**
+    * The time to cache an unknown host, in milliseconds.
+    */
+   uint32_t mNegativeTtl;
+
+   /**
+    * The maximum time to wait for a lookup, in milliseconds, 0 to wait
+    * indefinitely.
+    */
+   uint32_t mTimeout;
+
+   /**
+    * The maximum number of cached addresses.
+    */
+   uint32_t mMaxEntries;
+
+   /**
+    * Counters for the stats of this resolver.
+    */
+   uint64_t mHits;
+   uint64_t mNegativeHits;
+   uint64_t mLookupCount;
+   uint64_t mCoalesced;
+   uint64_t mTimeouts;
+   uint64_t mFailures;
+
+   /**
+    * A lock for the cache and the pending lookups.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+   /**
+    * The default HostResolver.
+    */
+   static HostResolver* sDefault;
+
+public:
+   /**
+    * Creates a new HostResolver.
+    *
+    * @param threads the number of resolver threads.
+    */
+   HostResolver(unsigned int threads = 4);
+
+   /**
+    * Destructs this HostResolver. No threads may be waiting on it.
+    */
+   virtual ~HostResolver();
+
+   /**
+    * Sets the time to cache a resolved address. The time to live of the
+    * underlying DNS records is not available from the system resolver, so
+    * this should not be longer than the shortest expected record TTL.
+    *
+    * @param ttl the time to live in milliseconds.
+    */
+   virtual void setPositiveTtl(uint32_t ttl);
+
+   /**
+    * Gets the time to cache a resolved address.
+    *
+    * @return the time to live in milliseconds.
+    */
+   virtual uint32_t getPositiveTtl();
+
+   /**
+    * Sets the time to cache an unknown host.
+    *
+    * @param ttl the time to live in milliseconds.
+    */
+   virtual void setNegativeTtl(uint32_t ttl);
+
+   /**
+    * Gets the time to cache an unknown host.
+    *
+    * @return the time to live in milliseconds.
+    */
+   virtual uint32_t getNegativeTtl();
+
+   /**
+    * Sets the maximum time to wait for a lookup.
+    *
+    * @param timeout the timeout in milliseconds, 0 to wait indefinitely.
+    */
+   virtual void setTimeout(uint32_t timeout);
+
+   /**
+    * Gets the maximum time to wait for a lookup.
+    *
+    * @return the timeout in milliseconds, 0 to wait indefinitely.
+    */
+   virtual uint32_t getTimeout();
+
+   /**
+    * Sets the maximum number of cached addresses. When the cache is full,
+    * expired addresses are dropped, then those that expire soonest.
+    *
+    * @param max the maximum number of cached addresses.
+    */
+   virtual void setMaxEntries(uint32_t max);
+
+   /**
+    * Adds a host that never expires.
+    *
+    * @param host the host.
+    * @param address the IPv4 or IPv6 address for the host.
+    *
+    * @return true if successful, false if the address was invalid (an
+    *         exception will be set).
+    */
+   virtual bool addHost(const char* host, const char* address);
+
+   /**
+    * Adds the hosts in a hosts-style file. Each line has an address followed
+    * by one or more hosts, separated by whitespace. Anything after a '#' is
+    * a comment.
+    *
+    * @param file the hosts file.
+    *
+    * @return true if successful, false if the file could not be read or an
+    *         address was invalid (an exception will be set).
+    */
+   virtual bool loadHostsFile(monarch::io::File& file);
+
+   /**
+    * Resolves a host to an address, waiting up to the timeout for a lookup
+    * to complete if the host is not cached.
+    *
+    * @param host the host.
+    * @param domain the communication domain of the address.
+    * @param address set to the address.
+    *
+    * @return true if successful, false if the host is unknown, the timeout
+    *         expired or the thread was interrupted (an exception will be
+    *         set).
+    */
+   virtual bool resolve(
+      const char* host, SocketAddress::CommunicationDomain domain,
+      std::string& address);
+
+   /**
+    * Starts a lookup of a host in the background, if it is not cached or
+    * already being looked up, without waiting for it.
+    *
+    * @param host the host.
+    * @param domain the communication domain of the address.
+    */
+   virtual void prefetch(
+      const char* host, SocketAddress::CommunicationDomain domain);
+
+   /**
+    * Clears all cached addresses. Added hosts are kept.
+    */
+   virtual void clear();
+
+   /**
+    * Gets the stats for this resolver:
+    *
+    * size: the number of cached addresses.
+    * hosts: the number of added hosts.
+    * pending: the number of pending lookups.
+    * hits: the number of resolves answered with a cached address or host.
+    * negativeHits: the number of resolves answered with a cached unknown
+    *    host.
+    * lookups: the number of lookups performed.
+    * coalesced: the number of resolves that waited on another's lookup.
+    * timeouts: the number of resolves that timed out.
+    * failures: the number of lookups that found no address.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
+   /**
+    * Sets the default HostResolver used by InternetAddress and
+    * Internet6Address. This should be done once, before addresses are
+    * resolved, and the resolver must not be destructed while it is in use.
+    *
+    * @param resolver the default HostResolver, NULL for none.
+    */
+   static void setDefault(HostResolver* resolver);
+
+   /**
+    * Gets the default HostResolver.
+    *
+    * @return the default HostResolver, NULL if there is none.
+    */
+   static HostResolver* getDefault();
+
+   /**
+    * Looks up a host using the system resolver on the calling thread,
+    * without any caching.
+    *
+    * @param host the host.
+    * @param domain the communication domain of the address.
+    * @param address set to the address.
+    *
+    * @return true if successful, false if the host is unknown (an exception
+    *         will be set).
+    */
+   static bool lookup(
+      const char* host, SocketAddress::CommunicationDomain domain,
+      std::string& address);
+
+protected:
+   /**
+    * Gets the cached address for a host, if it has not expired. The lock
+    * must be held.
+    *
+    * @param key the host key.
+    * @param entry set to the cache entry.
+    *
+    * @return true if found, false if not.
+    */
+   virtual bool getCachedAddress(const std::string& key, CacheEntry& entry);
+
+   /**
+    * Gets the pending lookup for a host, starting a new one if necessary.
+    * The lock must be held.
+    *
+    * @param key the host key.
+    * @param host the host.
+    * @param domain the communication domain of the address.
+    *
+    * @return the lookup.
+    */
+   virtual Lookup* startLookup(
+      const std::string& key, const char* host,
+      SocketAddress::CommunicationDomain domain);
+
+   /**
+    * Runs a lookup on a resolver thread and caches its result.
+    *
+    * @param lookup the lookup.
+    */
+   virtual void runLookup(Lookup* lookup);
+
+   /**
+    * Releases a reference to a lookup, freeing it if there are no more. The
+    * lock must be held.
+    *
+    * @param lookup the lookup.
+    */
+   virtual void releaseLookup(Lookup* lookup);
+
+   /**
+    * Caches an address, making room if the cache is full. The lock must be
+    * held.
+    *
+    * @param key the host key.
+    * @param address the address, empty if the host is unknown.
+    */
+   virtual void cacheAddress(
+      const std::string& key, const std::string& address);
+};
+
+} // end namespace net
+} // end namespace monarch
+#endif
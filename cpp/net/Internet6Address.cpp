@@ -1,8 +1,9 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/net/Internet6Address.h"
 
+#include "monarch/net/HostResolver.h"
 #include "monarch/net/WindowsSupport.h"
 #include "monarch/rt/DynamicObject.h"
 #include "monarch/rt/Exception.h"
@@ -85,50 +86,24 @@ bool Internet6Address::fromSockAddr(const sockaddr* addr, unsigned int size)
 
 bool Internet6Address::setHost(const char* host)
 {
-   bool rval = false;
-
-   // create hints address structure
-   struct addrinfo hints;
-   memset(&hints, '\0', sizeof(hints));
-   hints.ai_family = AF_INET6;
-
-   // create pointer for storing allocated resolved address
-   struct addrinfo* res = NULL;
-
-   // get address information
-   if(getaddrinfo(host, NULL, &hints, &res) != 0)
+   bool rval;
+
+   // resolve using the default resolver, if any
+   std::string address;
+   HostResolver* resolver = HostResolver::getDefault();
+   rval = (resolver != NULL) ?
+      resolver->resolve(host, SocketAddress::IPv6, address) :
+      HostResolver::lookup(host, SocketAddress::IPv6, address);
+   if(rval)
    {
-      ExceptionRef e = new Exception(
-         "Unknown host.",
-         "monarch.net.UnknownHost");
-      e->getDetails()["host"] = host;
-      Exception::set(e);
-   }
-   else
-   {
-      // copy the first result
-      struct sockaddr_in6 addr;
-      memcpy(&addr, res->ai_addr, res->ai_addrlen);
-
-      // get the address
-      char dst[INET6_ADDRSTRLEN];
-      memset(&dst, '\0', INET6_ADDRSTRLEN);
-      inet_ntop(AF_INET6, &addr.sin6_addr, dst, INET6_ADDRSTRLEN);
       free(mAddress);
-      mAddress = strdup(dst);
-      rval = true;
+      mAddress = strdup(address.c_str());
 
       // save the host
       free(mHost);
       mHost = strdup(host);
    }
 
-   if(res != NULL)
-   {
-      // free res if it got allocated
-      freeaddrinfo(res);
-   }
-
    return rval;
 }
 
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/net/IpPrefixTrie.h"
+
+#include "monarch/net/WindowsSupport.h"
+#include "monarch/rt/Exception.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace std;
+using namespace monarch::net;
+using namespace monarch::rt;
+
+#define IPV4_ROOT   0
+#define IPV6_ROOT   1
+
+/**
+ * Checks whether an IPv6 address is an IPv4-mapped address (::ffff:0:0/96).
+ */
+static bool _isIpv4Mapped(const unsigned char* address)
+{
+   static const unsigned char prefix[12] =
+      {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+   return memcmp(address, prefix, 12) == 0;
+}
+
+IpPrefixTrie::IpPrefixTrie() :
+   mRangeCount(0)
+{
+   // create the IPv4 and IPv6 roots
+   Node root;
+   root.child[0] = root.child[1] = 0;
+   root.terminal = false;
+   mNodes.push_back(root);
+   mNodes.push_back(root);
+}
+
+IpPrefixTrie::~IpPrefixTrie()
+{
+}
+
+bool IpPrefixTrie::add(const char* cidr)
+{
+   bool rval;
+
+   SocketAddress::CommunicationDomain domain;
+   unsigned char address[16];
+   int bits;
+   rval = parseRange(cidr, domain, address, bits);
+   if(rval)
+   {
+      add(domain, address, bits);
+   }
+   else
+   {
+      ExceptionRef e = new Exception(
+         "Invalid IP address range.",
+         "monarch.net.InvalidIpRange");
+      e->getDetails()["range"] = cidr;
+      Exception::set(e);
+   }
+
+   return rval;
+}
+
+void IpPrefixTrie::add(
+   SocketAddress::CommunicationDomain domain,
+   const unsigned char* address, int bits)
+{
+   if(domain == SocketAddress::IPv6 && bits >= 96 && _isIpv4Mapped(address))
+   {
+      // IPv4-mapped addresses are matched against the IPv4 ranges
+      domain = SocketAddress::IPv4;
+      address += 12;
+      bits -= 96;
+   }
+
+   uint32_t node = (domain == SocketAddress::IPv6) ? IPV6_ROOT : IPV4_ROOT;
+   int max = (domain == SocketAddress::IPv6) ? 128 : 32;
+   bits = (bits < 0) ? 0 : (bits > max ? max : bits);
+
+   // walk the prefix, stopping early if it is covered by a shorter range
+   for(int i = 0; i < bits && !mNodes[node].terminal; ++i)
+   {
+      int bit = (address[i >> 3] >> (7 - (i & 7))) & 1;
+      if(mNodes[node].child[bit] == 0)
+      {
+         Node child;
+         child.child[0] = child.child[1] = 0;
+         child.terminal = false;
+         mNodes.push_back(child);
+         mNodes[node].child[bit] = mNodes.size() - 1;
+      }
+      node = mNodes[node].child[bit];
+   }
+
+   // mark the end of the range, anything below it is now covered
+   mNodes[node].terminal = true;
+   mNodes[node].child[0] = mNodes[node].child[1] = 0;
+   ++mRangeCount;
+}
+
+bool IpPrefixTrie::contains(
+   SocketAddress::CommunicationDomain domain,
+   const unsigned char* address)
+{
+   bool rval = false;
+
+   int bits = 32;
+   uint32_t node = IPV4_ROOT;
+   if(domain == SocketAddress::IPv6)
+   {
+      if(_isIpv4Mapped(address))
+      {
+         // match against the IPv4 ranges
+         address += 12;
+      }
+      else
+      {
+         bits = 128;
+         node = IPV6_ROOT;
+      }
+   }
+
+   const Node* nodes = &mNodes[0];
+   rval = nodes[node].terminal;
+   for(int i = 0; !rval && i < bits; ++i)
+   {
+      int bit = (address[i >> 3] >> (7 - (i & 7))) & 1;
+      node = nodes[node].child[bit];
+      if(node == 0)
+      {
+         break;
+      }
+      rval = nodes[node].terminal;
+   }
+
+   return rval;
+}
+
+bool IpPrefixTrie::contains(const char* address)
+{
+   bool rval = false;
+
+   unsigned char addr[16];
+   if(inet_pton(AF_INET, address, addr) == 1)
+   {
+      rval = contains(SocketAddress::IPv4, addr);
+   }
+   else if(inet_pton(AF_INET6, address, addr) == 1)
+   {
+      rval = contains(SocketAddress::IPv6, addr);
+   }
+
+   return rval;
+}
+
+bool IpPrefixTrie::contains(SocketAddress* address)
+{
+   bool rval = false;
+
+   // get the numeric address
+   struct sockaddr_in6 sa;
+   unsigned int size = sizeof(sa);
+   if(address->toSockAddr((sockaddr*)&sa, size))
+   {
+      if(((sockaddr*)&sa)->sa_family == AF_INET6)
+      {
+         rval = contains(
+            SocketAddress::IPv6, (const unsigned char*)&sa.sin6_addr);
+      }
+      else
+      {
+         rval = contains(
+            SocketAddress::IPv4,
+            (const unsigned char*)&((sockaddr_in*)&sa)->sin_addr);
+      }
+   }
+
+   return rval;
+}
+
+uint32_t IpPrefixTrie::getRangeCount()
+{
+   return mRangeCount;
+}
+
+bool IpPrefixTrie::isEmpty()
+{
+   return mRangeCount == 0;
+}
+
+bool IpPrefixTrie::isRange(const char* cidr)
+{
+   SocketAddress::CommunicationDomain domain;
+   unsigned char address[16];
+   int bits;
+   return parseRange(cidr, domain, address, bits);
+}
+
+bool IpPrefixTrie::parseRange(
+   const char* cidr, SocketAddress::CommunicationDomain& domain,
+   unsigned char* address, int& bits)
+{
+   bool rval;
+
+   // split off the prefix length
+   string addr = cidr;
+   const char* prefix = NULL;
+   string::size_type slash = addr.find('/');
+   if(slash != string::npos)
+   {
+      prefix = cidr + slash + 1;
+      addr.erase(slash);
+   }
+
+   if(inet_pton(AF_INET, addr.c_str(), address) == 1)
+   {
+      domain = SocketAddress::IPv4;
+      bits = 32;
+      rval = true;
+   }
+   else if(inet_pton(AF_INET6, addr.c_str(), address) == 1)
+   {
+      domain = SocketAddress::IPv6;
+      bits = 128;
+      rval = true;
+   }
+   else
+   {
+      rval = false;
+   }
+
+   if(rval && prefix != NULL)
+   {
+      char* end;
+      long length = strtol(prefix, &end, 10);
+      rval = (*prefix != 0 && *end == 0 && length >= 0 && length <= bits);
+      bits = (int)length;
+   }
+
+   return rval;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_net_IpPrefixTrie_H
+#define monarch_net_IpPrefixTrie_H
+
+#include "monarch/net/SocketAddress.h"
+
+#include <vector>
+
+namespace monarch
+{
+namespace net
+{
+
+/**
+ * An IpPrefixTrie is a set of IPv4 and IPv6 address ranges in CIDR notation,
+ * such as "10.0.0.0/8" or "fc00::/7", stored in a binary trie so that an
+ * address can be matched against any number of ranges in at most 32 or 128
+ * steps.
+ *
+ * IPv4 and IPv6 ranges are kept in separate tries. IPv4-mapped IPv6
+ * addresses, such as "::ffff:10.0.0.1", are matched against the IPv4 ranges.
+ *
+ * An IpPrefixTrie is not thread-safe while ranges are being added, but any
+ * number of threads may match addresses against it once it is built.
+ *
+ * @author Dave Longley
+ */
+class IpPrefixTrie
+{
+protected:
+   /**
+    * A node in the trie. A child index of 0 means there is no child, as the
+    * roots are never children. A terminal node ends a range, so every
+    * address below it matches.
+    */
+   struct Node
+   {
+      uint32_t child[2];
+      bool terminal;
+   };
+
+   /**
+    * The nodes of both tries. The first node is the IPv4 root and the
+    * second the IPv6 root.
+    */
+   std::vector<Node> mNodes;
+
+   /**
+    * The number of ranges added.
+    */
+   uint32_t mRangeCount;
+
+public:
+   /**
+    * Creates a new, empty IpPrefixTrie.
+    */
+   IpPrefixTrie();
+
+   /**
+    * Destructs this IpPrefixTrie.
+    */
+   virtual ~IpPrefixTrie();
+
+   /**
+    * Adds a range in CIDR notation. An address without a prefix length is
+    * added as a range with only that address.
+    *
+    * @param cidr the range, ie: "192.168.0.0/16", "2001:db8::/32", "::1".
+    *
+    * @return true if successful, false if the range was invalid (an
+    *         exception will be set).
+    */
+   virtual bool add(const char* cidr);
+
+   /**
+    * Adds a range given as a numeric address and prefix length.
+    *
+    * @param domain the communication domain of the address.
+    * @param address the address in network byte order, 4 bytes for IPv4,
+    *           16 for IPv6.
+    * @param bits the prefix length.
+    */
+   virtual void add(
+      SocketAddress::CommunicationDomain domain,
+      const unsigned char* address, int bits);
+
+   /**
+    * Checks whether an address is in any range.
+    *
+    * @param domain the communication domain of the address.
+    * @param address the address in network byte order, 4 bytes for IPv4,
+    *           16 for IPv6.
+    *
+    * @return true if the address is in a range, false if not.
+    */
+   virtual bool contains(
+      SocketAddress::CommunicationDomain domain,
+      const unsigned char* address);
+
+   /**
+    * Checks whether a textual address is in any range.
+    *
+    * @param address the IPv4 or IPv6 address.
+    *
+    * @return true if the address is in a range, false if not or if the
+    *         address is invalid.
+    */
+   virtual bool contains(const char* address);
+
+   /**
+    * Checks whether a socket address is in any range.
+    *
+    * @param address the socket address.
+    *
+    * @return true if the address is in a range, false if not.
+    */
+   virtual bool contains(SocketAddress* address);
+
+   /**
+    * Gets the number of ranges that were added.
+    *
+    * @return the number of ranges.
+    */
+   virtual uint32_t getRangeCount();
+
+   /**
+    * Returns true if no ranges were added.
+    *
+    * @return true if empty, false if not.
+    */
+   virtual bool isEmpty();
+
+   /**
+    * Checks whether a string is a valid IPv4 or IPv6 address or range in
+    * CIDR notation.
+    *
+    * @param cidr the string to check.
+    *
+    * @return true if it is a valid range, false if not.
+    */
+   static bool isRange(const char* cidr);
+
+protected:
+   /**
+    * Parses a range in CIDR notation.
+    *
+    * @param cidr the range.
+    * @param domain set to the communication domain of the range.
+    * @param address set to the address of the range, at least 16 bytes.
+    * @param bits set to the prefix length.
+    *
+    * @return true if successful, false if the range was invalid.
+    */
+   static bool parseRange(
+      const char* cidr, SocketAddress::CommunicationDomain& domain,
+      unsigned char* address, int& bits);
+};
+
+} // end namespace net
+} // end namespace monarch
+#endif
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_CONSTANT_MACROS
 
@@ -479,6 +479,30 @@ int SocketTools::select(
    return rval;
 }
 
+int SocketTools::peek(int fd)
+{
+   // poll first so that receiving will not block
+   int rval = poll(true, fd, -1);
+   if(rval == 0)
+   {
+      // no data available
+      rval = -1;
+      errno = EAGAIN;
+   }
+   else if(rval > 0)
+   {
+      // check for EOF, peek so as not to disturb real data
+      char buf;
+      int flags = MSG_PEEK;
+#ifdef MSG_DONTWAIT
+      flags |= MSG_DONTWAIT;
+#endif
+      rval = SOCKET_MACRO_recv(fd, &buf, 1, flags);
+   }
+
+   return rval;
+}
+
 std::string SocketTools::getHostname()
 {
    char tmp[HOST_NAME_MAX + 1];
@@ -110,6 +110,19 @@ public:
       int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
       int64_t timeout, const sigset_t* sigmask = NULL);
 
+   /**
+    * Checks a connected socket for incoming data without blocking and
+    * without removing any data from the socket's receive queue. This is a
+    * cheap way to check whether the peer has closed an idle connection.
+    *
+    * @param fd the file descriptor of the socket.
+    *
+    * @return 1 if data is available to read, 0 if the peer has closed the
+    *         connection, -1 if no data is available (errno is EAGAIN) or
+    *         if an error occurred (errno is set appropriately).
+    */
+   static int peek(int fd);
+
    /**
     * Gets the hostname for the local machine.
     *
@@ -5,19 +5,70 @@
 
 #include "monarch/logging/Logging.h"
 #include "monarch/net/SocketDefinitions.h"
+#include "monarch/rt/Atomic.h"
 #include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/System.h"
 
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <pthread.h>
 
+using namespace std;
 using namespace monarch::crypto;
 using namespace monarch::io;
 using namespace monarch::net;
 using namespace monarch::rt;
 
+// the lifetime of a session ticket key for server contexts (1 hour)
+#define DEFAULT_TICKET_KEY_LIFETIME   3600000
+
+// the SSL ex data index for the SslContext that created the SSL, allocated
+// once so it cannot collide with any other user of OpenSSL
+static int sExDataIndex = -1;
+static pthread_once_t sExDataIndexInit = PTHREAD_ONCE_INIT;
+
+/**
+ * Allocates the SSL ex data index for SslContexts.
+ */
+static void _initExDataIndex()
+{
+   sExDataIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+}
+
+/**
+ * Gets the SSL ex data index for SslContexts.
+ *
+ * @return the index.
+ */
+static int _getExDataIndex()
+{
+   pthread_once(&sExDataIndexInit, &_initExDataIndex);
+   return sExDataIndex;
+}
+
+/**
+ * Session ticket key callback. Called whenever a server issues or receives
+ * an RFC 5077 session ticket.
+ */
+static int _ticketKeyCallback(
+   SSL* s, unsigned char* name, unsigned char* iv,
+   EVP_CIPHER_CTX* ctx, HMAC_CTX* hctx, int enc)
+{
+   SslContext* sc = static_cast<SslContext*>(
+      SSL_get_ex_data(s, _getExDataIndex()));
+   return sc->handleSessionTicket(s, name, iv, ctx, hctx, enc);
+}
+
 SslContext::SslContext(const char* protocol, bool client) :
    mVirtualHost(NULL),
    mPrivateKey(NULL),
-   mCertificate(NULL)
+   mCertificate(NULL),
+   mTransportMode(BioPairTransport),
+   mTicketKeyLifetime(0),
+   mTicketsIssued(0),
+   mTicketsAccepted(0),
+   mTicketsRenewed(0),
+   mTicketsRejected(0)
 {
    if(protocol == NULL || strcmp(protocol, "ALL") == 0)
    {
@@ -86,6 +137,12 @@ SslContext::SslContext(const char* protocol, bool client) :
    // ciphers -- EVEN IF -- the cipher name shows up in the list
    // of ciphers
    SSL_CTX_set_cipher_list(mContext, "DEFAULT");
+
+   // issue session tickets with rotating keys as a server
+   if(!client)
+   {
+      setSessionTicketKeyLifetime(DEFAULT_TICKET_KEY_LIFETIME);
+   }
 }
 
 SslContext::~SslContext()
@@ -115,6 +172,9 @@ SSL* SslContext::createSSL(TcpSocket* socket, bool client)
    SSL* ssl = SSL_new(mContext);
    mContextLock.unlock();
 
+   // associate this context with the SSL instance for session tickets
+   SSL_set_ex_data(ssl, _getExDataIndex(), this);
+
    // set connect state on SSL
    if(client)
    {
@@ -139,6 +199,16 @@ const char* SslContext::getVirtualHost()
    return mVirtualHost;
 }
 
+void SslContext::setTransportMode(TransportMode mode)
+{
+   mTransportMode = mode;
+}
+
+SslContext::TransportMode SslContext::getTransportMode()
+{
+   return mTransportMode;
+}
+
 bool SslContext::setCertificate(File& certFile)
 {
    bool rval = true;
@@ -359,12 +429,240 @@ int SslContext::handleSni(SSL* s)
    return rval;
 }
 
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+static int _alpnCallback(
+   SSL* s, const unsigned char** out, unsigned char* outlen,
+   const unsigned char* in, unsigned int inlen, void* arg)
+{
+   SslContext* sc = static_cast<SslContext*>(arg);
+   return sc->handleAlpn(s, out, outlen, in, inlen);
+}
+#endif
+
+bool SslContext::setAlpnProtocols(const char* protocols)
+{
+   bool rval = true;
+
+   // build wire format protocol list
+   string wire;
+   const char* start = protocols;
+   const char* end;
+   do
+   {
+      end = strchr(start, ',');
+      size_t len = (end == NULL) ? strlen(start) : (size_t)(end - start);
+      if(len == 0 || len > 255)
+      {
+         ExceptionRef e = new Exception(
+            "Could not set ALPN protocols. Invalid protocol name.",
+            SSL_EXCEPTION_TYPE ".InvalidAlpnProtocol");
+         e->getDetails()["protocols"] = protocols;
+         Exception::set(e);
+         rval = false;
+      }
+      else
+      {
+         wire.push_back((char)len);
+         wire.append(start, len);
+         start = end + 1;
+      }
+   }
+   while(rval && end != NULL);
+
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+   if(rval)
+   {
+      mContextLock.lock();
+      mAlpnProtocols = wire;
+
+      // advertise protocols as a client (returns 0 on success)
+      rval = (SSL_CTX_set_alpn_protos(
+         mContext, (const unsigned char*)mAlpnProtocols.c_str(),
+         mAlpnProtocols.length()) == 0);
+
+      // select protocols as a server
+      SSL_CTX_set_alpn_select_cb(mContext, _alpnCallback, this);
+      mContextLock.unlock();
+
+      if(!rval)
+      {
+         ExceptionRef e = new Exception(
+            "Could not set ALPN protocols.",
+            SSL_EXCEPTION_TYPE ".AlpnError");
+         e->getDetails()["protocols"] = protocols;
+         e->getDetails()["error"] = getSslErrorStrings();
+         Exception::set(e);
+      }
+   }
+#else
+   if(rval)
+   {
+      ExceptionRef e = new Exception(
+         "Could not set ALPN protocols. ALPN is not supported by the "
+         "installed version of OpenSSL.",
+         SSL_EXCEPTION_TYPE ".AlpnNotSupported");
+      Exception::set(e);
+      rval = false;
+   }
+#endif
+
+   return rval;
+}
+
+int SslContext::handleAlpn(
+   SSL* s, const unsigned char** out, unsigned char* outlen,
+   const unsigned char* in, unsigned int inlen)
+{
+   int rval = SSL_TLSEXT_ERR_NOACK;
+
+   // choose the most preferred server protocol that the client supports
+   unsigned char* selected = NULL;
+   if(SSL_select_next_proto(
+      &selected, outlen,
+      (const unsigned char*)mAlpnProtocols.c_str(), mAlpnProtocols.length(),
+      in, inlen) == OPENSSL_NPN_NEGOTIATED)
+   {
+      *out = selected;
+      rval = SSL_TLSEXT_ERR_OK;
+
+      MO_CAT_DEBUG(MO_NET_CAT,
+         "Selected ALPN protocol '%.*s'", (int)*outlen, (const char*)*out);
+   }
+
+   return rval;
+}
+
 void SslContext::setPeerAuthentication(bool on)
 {
    SSL_CTX_set_verify(
       mContext, (on) ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, NULL);
 }
 
+void SslContext::setSessionTicketKeyLifetime(uint32_t lifetime)
+{
+   mTicketKeyLock.lockExclusive();
+   mTicketKeyLifetime = lifetime;
+   if(lifetime == 0)
+   {
+      SSL_CTX_set_options(mContext, SSL_OP_NO_TICKET);
+      mTicketKeys.clear();
+   }
+   else
+   {
+      SSL_CTX_clear_options(mContext, SSL_OP_NO_TICKET);
+      SSL_CTX_set_tlsext_ticket_key_cb(mContext, _ticketKeyCallback);
+   }
+   mTicketKeyLock.unlockExclusive();
+}
+
+uint32_t SslContext::getSessionTicketKeyLifetime()
+{
+   return mTicketKeyLifetime;
+}
+
+bool SslContext::rotateSessionTicketKeys()
+{
+   mTicketKeyLock.lockExclusive();
+   bool rval = addSessionTicketKey(System::getCurrentMilliseconds());
+   mTicketKeyLock.unlockExclusive();
+   return rval;
+}
+
+int SslContext::handleSessionTicket(
+   SSL* s, unsigned char* name, unsigned char* iv,
+   EVP_CIPHER_CTX* ctx, HMAC_CTX* hctx, int enc)
+{
+   int rval = -1;
+
+   uint64_t now = System::getCurrentMilliseconds();
+   mTicketKeyLock.lockShared();
+   if(enc == 1)
+   {
+      // rotate keys if there is no current key or it has reached its lifetime
+      if(mTicketKeys.empty() ||
+         mTicketKeys.front().created + mTicketKeyLifetime <= now)
+      {
+         mTicketKeyLock.unlockShared();
+         mTicketKeyLock.lockExclusive();
+         if(mTicketKeys.empty() ||
+            mTicketKeys.front().created + mTicketKeyLifetime <= now)
+         {
+            addSessionTicketKey(now);
+         }
+         mTicketKeyLock.unlockExclusive();
+         mTicketKeyLock.lockShared();
+      }
+
+      // protect new ticket with the current key and a random IV
+      if(!mTicketKeys.empty() &&
+         RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_128_cbc())) == 1)
+      {
+         SessionTicketKey& key = mTicketKeys.front();
+         memcpy(name, key.name, 16);
+         EVP_EncryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, key.aesKey, iv);
+         HMAC_Init_ex(hctx, key.hmacKey, 16, EVP_sha256(), NULL);
+         Atomic::incrementAndFetch(&mTicketsIssued);
+         rval = 1;
+      }
+   }
+   else
+   {
+      // find the key that protected the ticket, keys are accepted for
+      // one lifetime after they are replaced
+      rval = 0;
+      for(SessionTicketKeyList::iterator i = mTicketKeys.begin();
+          rval == 0 && i != mTicketKeys.end(); ++i)
+      {
+         if(memcmp(name, i->name, 16) == 0 &&
+            i->created + 2 * (uint64_t)mTicketKeyLifetime > now)
+         {
+            HMAC_Init_ex(hctx, i->hmacKey, 16, EVP_sha256(), NULL);
+            EVP_DecryptInit_ex(ctx, EVP_aes_128_cbc(), NULL, i->aesKey, iv);
+            Atomic::incrementAndFetch(&mTicketsAccepted);
+
+            // renew tickets that were not protected by a current key
+            if(i == mTicketKeys.begin() &&
+               i->created + mTicketKeyLifetime > now)
+            {
+               rval = 1;
+            }
+            else
+            {
+               Atomic::incrementAndFetch(&mTicketsRenewed);
+               rval = 2;
+            }
+         }
+      }
+
+      if(rval == 0)
+      {
+         Atomic::incrementAndFetch(&mTicketsRejected);
+      }
+   }
+   mTicketKeyLock.unlockShared();
+
+   return rval;
+}
+
+DynamicObject SslContext::getSessionStats()
+{
+   DynamicObject rval;
+   rval["accepted"] = (uint64_t)SSL_CTX_sess_accept_good(mContext);
+   rval["connected"] = (uint64_t)SSL_CTX_sess_connect_good(mContext);
+   rval["resumed"] = (uint64_t)SSL_CTX_sess_hits(mContext);
+   rval["misses"] = (uint64_t)SSL_CTX_sess_misses(mContext);
+   rval["timeouts"] = (uint64_t)SSL_CTX_sess_timeouts(mContext);
+   rval["cacheFull"] = (uint64_t)SSL_CTX_sess_cache_full(mContext);
+   rval["ticketsIssued"] = Atomic::load(&mTicketsIssued);
+   rval["ticketsAccepted"] = Atomic::load(&mTicketsAccepted);
+   rval["ticketsRenewed"] = Atomic::load(&mTicketsRenewed);
+   rval["ticketsRejected"] = Atomic::load(&mTicketsRejected);
+   mTicketKeyLock.lockShared();
+   rval["ticketKeys"] = (uint32_t)mTicketKeys.size();
+   mTicketKeyLock.unlockShared();
+   return rval;
+}
+
 bool SslContext::setVerifyCAs(File* caFile, File* caDir)
 {
    bool rval = true;
@@ -406,3 +704,33 @@ DynamicObject SslContext::getSslErrorStrings()
 
    return rval;
 }
+
+bool SslContext::addSessionTicketKey(uint64_t now)
+{
+   bool rval = true;
+
+   SessionTicketKey key;
+   if(RAND_bytes(key.name, 16) != 1 ||
+      RAND_bytes(key.aesKey, 16) != 1 ||
+      RAND_bytes(key.hmacKey, 16) != 1)
+   {
+      ExceptionRef e = new Exception(
+         "Could not generate session ticket key.",
+         SSL_EXCEPTION_TYPE ".SessionTicketKeyError");
+      e->getDetails()["error"] = getSslErrorStrings();
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      // keep the previous key so its tickets are still accepted
+      key.created = now;
+      mTicketKeys.insert(mTicketKeys.begin(), key);
+      if(mTicketKeys.size() > 2)
+      {
+         mTicketKeys.resize(2);
+      }
+   }
+
+   return rval;
+}
@@ -1,9 +1,10 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_net_SslContext_H
 #define monarch_net_SslContext_H
 
+#include <openssl/hmac.h>
 #include <openssl/ssl.h>
 
 #include "monarch/crypto/PrivateKey.h"
@@ -14,6 +15,8 @@
 #include "monarch/rt/SharedLock.h"
 #include "monarch/util/StringTools.h"
 
+#include <vector>
+
 namespace monarch
 {
 namespace net
@@ -22,10 +25,33 @@ namespace net
 /**
  * An SslContext uses on SSL context to produce SslSockets.
  *
+ * A server context issues RFC 5077 session tickets so that clients can
+ * resume sessions without the server keeping any session state. The keys
+ * that protect tickets are generated by the context and rotated when they
+ * reach the session ticket key lifetime. After a rotation, tickets that were
+ * protected by the previous key are still accepted (and replaced with new
+ * ones) for another lifetime.
+ *
  * @author Dave Longley
  */
 class SslContext
 {
+public:
+   /**
+    * The ways SslSockets created in a context can move encrypted data
+    * between SSL and their wrapped sockets.
+    *
+    * BioPairTransport: SSL reads and writes a memory BIO pair and the
+    *    encrypted data is copied between the pair and the socket's streams.
+    * DirectTransport: SSL reads and writes the socket directly through a
+    *    socket BIO, one record at a time.
+    */
+   enum TransportMode
+   {
+      BioPairTransport,
+      DirectTransport
+   };
+
 protected:
    /**
     * The SSL context object.
@@ -66,6 +92,53 @@ protected:
       VirtualHostMap;
    VirtualHostMap mVirtualHosts;
 
+   /**
+    * The supported ALPN protocols in wire format (each protocol name is
+    * prefixed by its length), in order of preference.
+    */
+   std::string mAlpnProtocols;
+
+   /**
+    * The transport mode for SslSockets created in this context.
+    */
+   TransportMode mTransportMode;
+
+   /**
+    * A key for protecting session tickets and the time it was created.
+    */
+   struct SessionTicketKey
+   {
+      unsigned char name[16];
+      unsigned char aesKey[16];
+      unsigned char hmacKey[16];
+      uint64_t created;
+   };
+
+   /**
+    * The session ticket keys, newest first.
+    */
+   typedef std::vector<SessionTicketKey> SessionTicketKeyList;
+   SessionTicketKeyList mTicketKeys;
+
+   /**
+    * The lifetime of a session ticket key in milliseconds, 0 if session
+    * tickets are disabled.
+    */
+   uint32_t mTicketKeyLifetime;
+
+   /**
+    * A shared lock for reading/writing session ticket keys.
+    */
+   monarch::rt::SharedLock mTicketKeyLock;
+
+   /**
+    * Counters for session tickets.
+    */
+   volatile uint32_t mTicketsIssued;
+   volatile uint32_t mTicketsAccepted;
+   volatile uint32_t mTicketsRenewed;
+   volatile uint32_t mTicketsRejected;
+
 public:
    /**
     * Creates a new SslContext. Peer authentication will default to
@@ -109,6 +182,22 @@ public:
     */
    virtual const char* getVirtualHost();
 
+   /**
+    * Sets the transport mode for SslSockets that are created in this
+    * context from now on. The default is BioPairTransport.
+    *
+    * @param mode the transport mode to use.
+    */
+   virtual void setTransportMode(TransportMode mode);
+
+   /**
+    * Gets the transport mode for SslSockets that are created in this
+    * context.
+    *
+    * @return the transport mode.
+    */
+   virtual TransportMode getTransportMode();
+
    /**
     * Sets the default PEM-formatted certificate for this SSL context to use.
     *
@@ -199,6 +288,43 @@ public:
     */
    virtual int handleSni(SSL* s);
 
+   /**
+    * Sets the application protocols this context supports for Application
+    * Layer Protocol Negotiation (ALPN). The protocols must be given as a
+    * comma-delimited list in order of preference, for example:
+    *
+    * "h2,http/1.1"
+    *
+    * A client context will advertise the protocols to the server and a
+    * server context will select its most preferred protocol that is also
+    * supported by the client. If the client supports none of them then no
+    * protocol will be selected. Contexts used as virtual hosts should be
+    * given the same protocols as their default context.
+    *
+    * @param protocols the comma-delimited list of protocols.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool setAlpnProtocols(const char* protocols);
+
+   /**
+    * Called internally when an Application Layer Protocol Negotiation (ALPN)
+    * TLS extension is received from a client. This method will choose the
+    * protocol to use.
+    *
+    * @param s the SSL for the connection.
+    * @param out set to the selected protocol.
+    * @param outlen set to the length of the selected protocol.
+    * @param in the protocols offered by the client in wire format.
+    * @param inlen the length of the offered protocols.
+    *
+    * @return SSL_TLSEXT_ERR_OK if a protocol was selected,
+    *         SSL_TLSEXT_ERR_NOACK if no protocol was selected.
+    */
+   virtual int handleAlpn(
+      SSL* s, const unsigned char** out, unsigned char* outlen,
+      const unsigned char* in, unsigned int inlen);
+
    /**
     * Sets the peer authentication mode for this SSL context. If peer
     * authentication is turned on, then any server connections created
@@ -214,6 +340,75 @@ public:
     */
    virtual void setPeerAuthentication(bool on);
 
+   /**
+    * Sets the lifetime of the keys that protect session tickets issued by
+    * this context. Server contexts default to one hour. Setting a lifetime
+    * of 0 disables session tickets.
+    *
+    * @param lifetime the key lifetime in milliseconds, 0 to disable session
+    *           tickets.
+    */
+   virtual void setSessionTicketKeyLifetime(uint32_t lifetime);
+
+   /**
+    * Gets the lifetime of the keys that protect session tickets issued by
+    * this context.
+    *
+    * @return the key lifetime in milliseconds, 0 if session tickets are
+    *         disabled.
+    */
+   virtual uint32_t getSessionTicketKeyLifetime();
+
+   /**
+    * Generates a new session ticket key. New tickets are protected by it
+    * and tickets protected by the previous key are still accepted. This is
+    * done automatically when the current key reaches its lifetime.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool rotateSessionTicketKeys();
+
+   /**
+    * Called internally when a session ticket is issued or received. This
+    * method will initialize the cipher and HMAC contexts with the current
+    * key to protect a new ticket or with the key named in a received ticket.
+    *
+    * @param s the SSL for the connection.
+    * @param name the key name to set or the name from the received ticket.
+    * @param iv the IV to set or the IV from the received ticket.
+    * @param ctx the cipher context to initialize.
+    * @param hctx the HMAC context to initialize.
+    * @param enc 1 to issue a ticket, 0 to receive one.
+    *
+    * @return 1 on success, 2 if a received ticket should be renewed, 0 if
+    *         a received ticket's key is unknown or expired, -1 on error.
+    */
+   virtual int handleSessionTicket(
+      SSL* s, unsigned char* name, unsigned char* iv,
+      EVP_CIPHER_CTX* ctx, HMAC_CTX* hctx, int enc);
+
+   /**
+    * Gets the session stats for this context:
+    *
+    * accepted: the number of completed server handshakes.
+    * connected: the number of completed client handshakes.
+    * resumed: the number of server handshakes that resumed a session from
+    *    the session cache or a session ticket.
+    * misses: the number of sessions proposed by clients that were not found
+    *    in the session cache.
+    * timeouts: the number of sessions proposed by clients that had expired.
+    * cacheFull: the number of sessions dropped because the cache was full.
+    * ticketsIssued: the number of session tickets issued.
+    * ticketsAccepted: the number of session tickets that were decrypted.
+    * ticketsRenewed: the number of accepted tickets protected by a previous
+    *    key that were replaced.
+    * ticketsRejected: the number of tickets with an unknown or expired key.
+    * ticketKeys: the number of session ticket keys.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getSessionStats();
+
    /**
     * Sets the main verification CA (Vertificate Authority) file and backup
     * CA directory. The main CA file should contain a list of PEM-formatted
@@ -239,6 +434,17 @@ public:
     * @return an Array of error strings.  May be empty.
     */
    static monarch::rt::DynamicObject getSslErrorStrings();
+
+protected:
+   /**
+    * Generates a new session ticket key and drops all but the previous key.
+    * The session ticket keys must be locked exclusively.
+    *
+    * @param now the current time in milliseconds.
+    *
+    * @return true if successful, false if an Exception occurred.
+    */
+   virtual bool addSessionTicketKey(uint64_t now);
 };
 
 // type definition for reference counted SslContext
@@ -1,14 +1,24 @@
 /*
- * Copyright (c) 2008-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2008-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/net/SslSessionCache.h"
 
+#include "monarch/rt/System.h"
+
 using namespace std;
 using namespace monarch::net;
+using namespace monarch::rt;
 using namespace monarch::util;
 
-SslSessionCache::SslSessionCache(unsigned int capacity) :
-   mCapacity(capacity)
+SslSessionCache::SslSessionCache(unsigned int capacity, uint32_t ttl) :
+   mCapacity(capacity),
+   mTimeToLive(ttl),
+   mHits(0),
+   mMisses(0),
+   mEvictions(0),
+   mExpirations(0),
+   mResumed(0),
+   mFullHandshakes(0)
 {
 }
 
@@ -36,31 +46,52 @@ static string _getSessionKey(const char* host, const char* vHost)
 void SslSessionCache::storeSession(
    const char* host, SslSession& session, const char* vHost)
 {
-   // lock to write to cache
-   mLock.lockExclusive();
+   // only established sessions can be resumed
+   if(!session.isNull() && session->session != NULL)
    {
-      // find existing session
-      string key = _getSessionKey(host, vHost);
-      SessionMap::iterator i = mSessions.find(key.c_str());
-      if(i != mSessions.end())
+      // expire when the session times out or the time to live elapses
+      uint64_t now = System::getCurrentMilliseconds();
+      uint64_t expires =
+         ((uint64_t)SSL_SESSION_get_time(session->session) +
+         SSL_SESSION_get_timeout(session->session)) * 1000;
+      if(mTimeToLive > 0 && now + mTimeToLive < expires)
       {
-         // update existing entry
-         i->second = session;
+         expires = now + mTimeToLive;
       }
-      else if(mSessions.size() >= mCapacity)
-      {
-         // free up space in the map
-         i = mSessions.begin();
-         free((char*)i->first);
-         mSessions.erase(i);
-      }
-      else
+
+      // lock to write to cache
+      mLock.lock();
       {
-         // insert new entry
-         mSessions.insert(std::make_pair(strdup(key.c_str()), session));
+         // find existing session
+         string key = _getSessionKey(host, vHost);
+         SessionMap::iterator i = mSessions.find(key.c_str());
+         if(i != mSessions.end())
+         {
+            // update existing entry, make it the most recently used
+            i->second.session = session;
+            i->second.expires = expires;
+            mLru.splice(mLru.begin(), mLru, i->second.lru);
+         }
+         else if(mCapacity > 0)
+         {
+            // evict least recently used entries to free up space
+            while(mSessions.size() >= mCapacity)
+            {
+               removeEntry(mSessions.find(mLru.back()));
+               ++mEvictions;
+            }
+
+            // insert new entry
+            Entry entry;
+            entry.session = session;
+            entry.expires = expires;
+            const char* k = strdup(key.c_str());
+            entry.lru = mLru.insert(mLru.begin(), k);
+            mSessions.insert(std::make_pair(k, entry));
+         }
       }
+      mLock.unlock();
    }
-   mLock.unlockExclusive();
 }
 
 inline void SslSessionCache::storeSession(
@@ -73,17 +104,37 @@ SslSession SslSessionCache::getSession(const char* host, const char* vHost)
 {
    SslSession rval(NULL);
 
-   // lock to read from cache
-   mLock.lockShared();
+   // lock to read from cache (the LRU order is updated)
+   mLock.lock();
    {
       string key = _getSessionKey(host, vHost);
       SessionMap::iterator i = mSessions.find(key.c_str());
       if(i != mSessions.end())
       {
-         rval = i->second;
+         if(i->second.expires <= System::getCurrentMilliseconds())
+         {
+            // session expired
+            removeEntry(i);
+            ++mExpirations;
+         }
+         else
+         {
+            // make entry the most recently used
+            rval = i->second.session;
+            mLru.splice(mLru.begin(), mLru, i->second.lru);
+         }
+      }
+
+      if(rval.isNull())
+      {
+         ++mMisses;
+      }
+      else
+      {
+         ++mHits;
       }
    }
-   mLock.unlockShared();
+   mLock.unlock();
 
    return rval;
 }
@@ -92,3 +143,45 @@ inline SslSession SslSessionCache::getSession(Url* url, const char* vHost)
 {
    return getSession(url->getAuthority().c_str(), vHost);
 }
+
+void SslSessionCache::recordHandshake(bool resumed)
+{
+   mLock.lock();
+   if(resumed)
+   {
+      ++mResumed;
+   }
+   else
+   {
+      ++mFullHandshakes;
+   }
+   mLock.unlock();
+}
+
+DynamicObject SslSessionCache::getStats()
+{
+   DynamicObject rval;
+
+   mLock.lock();
+   {
+      rval["capacity"] = mCapacity;
+      rval["size"] = (uint32_t)mSessions.size();
+      rval["hits"] = mHits;
+      rval["misses"] = mMisses;
+      rval["evictions"] = mEvictions;
+      rval["expirations"] = mExpirations;
+      rval["resumed"] = mResumed;
+      rval["fullHandshakes"] = mFullHandshakes;
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void SslSessionCache::removeEntry(SessionMap::iterator i)
+{
+   const char* key = i->first;
+   mLru.erase(i->second.lru);
+   mSessions.erase(i);
+   free((char*)key);
+}
@@ -1,14 +1,16 @@
 /*
- * Copyright (c) 2008-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2008-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_net_SslSessionCache_H
 #define monarch_net_SslSessionCache_H
 
 #include "monarch/net/SslSession.h"
-#include "monarch/rt/SharedLock.h"
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/ExclusiveLock.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/util/Url.h"
 
+#include <list>
 #include <map>
 
 namespace monarch
@@ -19,36 +21,82 @@ namespace net
 /**
  * An SslSessionCache is a thread-safe cache for SslSessions.
  *
+ * When the cache is full, the least recently used session is evicted to make
+ * room for a new one. Sessions expire when their own SSL session timeout
+ * elapses or, if a time to live is set, when they have been in the cache for
+ * longer than it, whichever comes first.
+ *
+ * The cache counts hits and misses. Clients that use it may also record
+ * whether each handshake resumed a session so that the resumption rate can
+ * be observed via getStats().
+ *
  * @author Dave Longley
  */
 class SslSessionCache
 {
 protected:
+   /**
+    * A list of session keys, most recently used first.
+    */
+   typedef std::list<const char*> KeyList;
+
+   /**
+    * A cached session, the time it expires and its position in the LRU list.
+    */
+   struct Entry
+   {
+      SslSession session;
+      uint64_t expires;
+      KeyList::iterator lru;
+   };
+
    /**
     * A mapping of session keys to re-usable SSL sessions.
     */
    typedef std::map<
-      const char*, monarch::net::SslSession, monarch::util::StringComparator>
-      SessionMap;
+      const char*, Entry, monarch::util::StringComparator> SessionMap;
    SessionMap mSessions;
 
+   /**
+    * The session keys in least recently used order.
+    */
+   KeyList mLru;
+
    /**
     * Stores the capacity of this cache.
     */
    unsigned int mCapacity;
 
+   /**
+    * The maximum time a session may be cached, in milliseconds, 0 to use
+    * only the session's own timeout.
+    */
+   uint32_t mTimeToLive;
+
+   /**
+    * Counters for the stats of this cache.
+    */
+   uint64_t mHits;
+   uint64_t mMisses;
+   uint64_t mEvictions;
+   uint64_t mExpirations;
+   uint64_t mResumed;
+   uint64_t mFullHandshakes;
+
    /**
     * A lock for modifying the session map.
     */
-   monarch::rt::SharedLock mLock;
+   monarch::rt::ExclusiveLock mLock;
 
 public:
    /**
     * Creates a new SslSessionCache with the specified capacity.
     *
     * @param capacity the maximum number of sessions to cache.
+    * @param ttl the maximum time a session may be cached, in milliseconds,
+    *           0 to use only the session's own timeout.
     */
-   SslSessionCache(unsigned int capacity = 50);
+   SslSessionCache(unsigned int capacity = 50, uint32_t ttl = 0);
 
    /**
     * Destructs this SslSessionCache.
@@ -56,7 +104,9 @@ public:
    virtual ~SslSessionCache();
 
    /**
-    * Stores an SSL session in this cache.
+    * Stores an SSL session in this cache. If the cache is full, the least
+    * recently used session is evicted. Sessions that have not been
+    * established by a handshake are ignored.
     *
     * @param host the host (including port) for the session.
     * @param session the session to store.
@@ -76,7 +126,8 @@ public:
       monarch::util::Url* url, SslSession& session, const char* vHost = NULL);
 
    /**
-    * Gets a stored SSL session from the cache, if one exists.
+    * Gets a stored SSL session from the cache, if one exists and has not
+    * expired.
     *
     * @param host the host for the session.
     * @param vHost an associated virtual host, if applicable.
@@ -86,7 +137,8 @@ public:
    virtual SslSession getSession(const char* host, const char* vHost = NULL);
 
    /**
-    * Gets a stored SSL session from the cache, if one exists.
+    * Gets a stored SSL session from the cache, if one exists and has not
+    * expired.
     *
     * @param url the url for the session.
     * @param vHost an associated virtual host, if applicable.
@@ -95,6 +147,39 @@ public:
     */
    virtual SslSession getSession(
       monarch::util::Url* url, const char* vHost = NULL);
+
+   /**
+    * Records whether a handshake performed with a session from this cache
+    * (or without one, after a miss) resumed a session.
+    *
+    * @param resumed true if the session was resumed, false if a full
+    *           handshake was performed.
+    */
+   virtual void recordHandshake(bool resumed);
+
+   /**
+    * Gets the stats for this cache:
+    *
+    * capacity: the maximum number of sessions.
+    * size: the number of cached sessions.
+    * hits: the number of lookups that found a session.
+    * misses: the number of lookups that did not find a session.
+    * evictions: the number of sessions evicted to make room.
+    * expirations: the number of sessions dropped because they expired.
+    * resumed: the number of recorded handshakes that resumed a session.
+    * fullHandshakes: the number of recorded full handshakes.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
+protected:
+   /**
+    * Removes an entry from this cache. The cache must be locked.
+    *
+    * @param i the entry to remove.
+    */
+   virtual void removeEntry(SessionMap::iterator i);
 };
 
 // type definition for a reference counted SslSessionCache
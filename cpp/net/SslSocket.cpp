@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/net/SslSocket.h"
 
@@ -20,6 +20,7 @@ using namespace monarch::net;
 using namespace monarch::rt;
 
 #define TRANSPORT_BUFFER   1024
+#define DIRECT_BIO_TYPE    (100|BIO_TYPE_SOURCE_SINK)
 
 // FIXME: SSL implementation needs to be abstracted away from SslSocket so
 // that it can be used by non-sockets and so the code is cleaner
@@ -94,9 +95,99 @@ static int _verifyCallback(int preverifyOk, X509_STORE_CTX *ctx)
    return preverifyOk;
 }
 
+/**
+ * Writes data from SSL to the socket of a direct transport BIO. This method
+ * blocks until all of the data has been written, the socket's send timeout
+ * expires or the thread is interrupted. The BIO's num is set to -1 if the
+ * socket failed and 0 if not.
+ *
+ * @param bio the direct transport BIO.
+ * @param b the data to write.
+ * @param length the number of bytes to write.
+ *
+ * @return the number of bytes written or -1 if an exception occurred.
+ */
+static int _directBioWrite(BIO* bio, const char* b, int length)
+{
+   Socket* socket = static_cast<Socket*>(bio->ptr);
+   BIO_clear_retry_flags(bio);
+   bio->num = socket->send(b, length) ? 0 : -1;
+   return (bio->num == 0) ? length : -1;
+}
+
+/**
+ * Reads data for SSL from the socket of a direct transport BIO. This method
+ * blocks until some data is read, the socket closes, the socket's receive
+ * timeout expires or the thread is interrupted. The BIO's num is set to -1
+ * if the socket failed and 0 if not.
+ *
+ * @param bio the direct transport BIO.
+ * @param b the buffer to read into.
+ * @param length the size of the buffer.
+ *
+ * @return the number of bytes read, 0 if the socket closed or -1 if an
+ *         exception occurred.
+ */
+static int _directBioRead(BIO* bio, char* b, int length)
+{
+   Socket* socket = static_cast<Socket*>(bio->ptr);
+   BIO_clear_retry_flags(bio);
+   int rval = socket->receive(b, length);
+   bio->num = (rval < 0) ? -1 : 0;
+   return rval;
+}
+
+static int _directBioPuts(BIO* bio, const char* str)
+{
+   return _directBioWrite(bio, str, strlen(str));
+}
+
+static long _directBioCtrl(BIO* bio, int cmd, long num, void* ptr)
+{
+   // writes are never buffered, so flushing always succeeds and nothing
+   // else is supported
+   return (cmd == BIO_CTRL_FLUSH) ? 1 : 0;
+}
+
+static int _directBioCreate(BIO* bio)
+{
+   bio->init = 1;
+   bio->num = 0;
+   bio->ptr = NULL;
+   bio->flags = 0;
+   return 1;
+}
+
+static int _directBioDestroy(BIO* bio)
+{
+   // the socket belongs to the SslSocket, not to the BIO
+   bio->ptr = NULL;
+   bio->init = 0;
+   return 1;
+}
+
+/**
+ * The BIO method for a direct transport. SSL reads and writes whole records
+ * through it straight from and to the wrapped socket.
+ */
+static BIO_METHOD sDirectBioMethod =
+{
+   DIRECT_BIO_TYPE,
+   "monarch socket",
+   _directBioWrite,
+   _directBioRead,
+   _directBioPuts,
+   NULL,
+   _directBioCtrl,
+   _directBioCreate,
+   _directBioDestroy,
+   NULL
+};
+
 SslSocket::SslSocket(
    SslContext* context, TcpSocket* socket, bool client, bool cleanup) :
    SocketWrapper(socket, cleanup),
+   mTransportMode(context->getTransportMode()),
    mVirtualHost(NULL)
 {
    // create ssl object
@@ -105,8 +196,21 @@ SslSocket::SslSocket(
    // associate this socket with the SSL instance
    SSL_set_ex_data(mSSL, 0, this);
 
-   // allocate bio pair using default sizes (large enough for SSL records)
-   BIO_new_bio_pair(&mSSLBio, 0, &mSocketBio, 0);
+   if(mTransportMode == SslContext::DirectTransport)
+   {
+      // SSL uses the socket directly, read ahead so that a record and the
+      // start of the next are received at once instead of a header and
+      // then a body
+      mSSLBio = BIO_new(&sDirectBioMethod);
+      mSSLBio->ptr = socket;
+      mSocketBio = NULL;
+      SSL_set_read_ahead(mSSL, 1);
+   }
+   else
+   {
+      // allocate bio pair using default sizes (large enough for SSL records)
+      BIO_new_bio_pair(&mSSLBio, 0, &mSocketBio, 0);
+   }
 
    // assign SSL BIO to SSL
    SSL_set_bio(mSSL, mSSLBio, mSSLBio);
@@ -122,7 +226,10 @@ SslSocket::~SslSocket()
    SSL_free(mSSL);
 
    // free Socket BIO
-   BIO_free(mSocketBio);
+   if(mSocketBio != NULL)
+   {
+      BIO_free(mSocketBio);
+   }
 
    // destruct input and output streams
    delete mInputStream;
@@ -154,6 +261,11 @@ SslSession SslSocket::getSession()
    return rval;
 }
 
+bool SslSocket::isSessionReused()
+{
+   return SSL_session_reused(mSSL) == 1;
+}
+
 void SslSocket::addVerifyCommonName(const char* commonName)
 {
    // add common name to list
@@ -357,6 +469,20 @@ bool SslSocket::performHandshake()
             }
             break;
          }
+         case SSL_ERROR_SYSCALL:
+         {
+            // a direct transport reports socket failures as system errors
+            if((ret = checkDirectTransport(ret)) != 1)
+            {
+               ExceptionRef e = new Exception(
+                  "Could not perform SSL handshake. Socket closed.",
+                  SOCKET_EXCEPTION_TYPE ".SslHandshakeError");
+               (ret < 0) ? Exception::push(e) : Exception::set(e);
+               rval = false;
+               break;
+            }
+            // not caused by the transport, fall through
+         }
          default:
          {
             // an error occurred
@@ -374,6 +500,29 @@ bool SslSocket::performHandshake()
    return rval;
 }
 
+bool SslSocket::getAlpnProtocol(string& protocol)
+{
+   bool rval = false;
+
+#ifdef TLSEXT_TYPE_application_layer_protocol_negotiation
+   const unsigned char* data = NULL;
+   unsigned int length = 0;
+   SSL_get0_alpn_selected(mSSL, &data, &length);
+   if(data != NULL && length > 0)
+   {
+      protocol.assign((const char*)data, length);
+      rval = true;
+   }
+#endif
+
+   return rval;
+}
+
+SslContext::TransportMode SslSocket::getTransportMode()
+{
+   return mTransportMode;
+}
+
 void SslSocket::close()
 {
    if(isConnected())
@@ -434,6 +583,18 @@ bool SslSocket::send(const char* b, int length)
                   rval = false;
                }
                break;
+            case SSL_ERROR_SYSCALL:
+               // a direct transport reports socket failures as system errors
+               if((ret = checkDirectTransport(ret)) != 1)
+               {
+                  ExceptionRef e = new Exception(
+                     "Could not write to socket. Socket closed.",
+                     SOCKET_EXCEPTION_TYPE ".Closed");
+                  (ret < 0) ? Exception::push(e) : Exception::set(e);
+                  rval = false;
+                  break;
+               }
+               // not caused by the transport, fall through
             default:
             {
                // an error occurred
@@ -448,8 +609,12 @@ bool SslSocket::send(const char* b, int length)
          }
       }
 
-      // flush all data to the socket
-      rval = rval && (_tcpTransport(mSocket, mSocketBio) != -1);
+      // flush all data to the socket (a direct transport has already
+      // written it)
+      if(mTransportMode == SslContext::BioPairTransport)
+      {
+         rval = rval && (_tcpTransport(mSocket, mSocketBio) != -1);
+      }
    }
 
    return rval;
@@ -504,6 +669,25 @@ int SslSocket::receive(char* b, int length)
                // transport data over underlying socket
                rval = _tcpTransport(mSocket, mSocketBio);
                break;
+            case SSL_ERROR_SYSCALL:
+               // a direct transport reports socket failures as system errors
+               ret = checkDirectTransport(ret);
+               if(ret == 0)
+               {
+                  // the connection was shutdown without an SSL shutdown
+                  closed = true;
+                  break;
+               }
+               else if(ret == -1)
+               {
+                  ExceptionRef e = new Exception(
+                     "Could not read from socket.",
+                     SOCKET_EXCEPTION_TYPE ".ReadError");
+                  Exception::push(e);
+                  rval = -1;
+                  break;
+               }
+               // not caused by the transport, fall through
             default:
             {
                // an error occurred
@@ -537,3 +721,24 @@ OutputStream* SslSocket::getOutputStream()
 {
    return mOutputStream;
 }
+
+int SslSocket::checkDirectTransport(int ret)
+{
+   int rval = 1;
+
+   if(mTransportMode == SslContext::DirectTransport)
+   {
+      if(mSSLBio->num == -1)
+      {
+         // socket failed, its exception is set
+         rval = -1;
+      }
+      else if(ret == 0)
+      {
+         // socket closed
+         rval = 0;
+      }
+   }
+
+   return rval;
+}
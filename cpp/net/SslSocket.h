@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2010 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_net_SslSocket_H
 #define monarch_net_SslSocket_H
@@ -10,6 +10,7 @@
 #include "monarch/net/SslSession.h"
 
 #include <openssl/ssl.h>
+#include <string>
 #include <vector>
 
 namespace monarch
@@ -21,6 +22,11 @@ namespace net
  * An SslSocket is a Socket that uses the TCP/IP protocol and the Secure
  * Sockets Layer (SSL v2/v3) and Transport Layer Security (TLS v1).
  *
+ * The encrypted data is moved between SSL and the wrapped TcpSocket using
+ * the transport mode of the SslContext the socket is created in. In either
+ * mode, all reads and writes go through the wrapped socket, so its send and
+ * receive timeouts apply and blocked calls can be interrupted.
+ *
  * @author Dave Longley
  */
 class SslSocket : public SocketWrapper
@@ -31,18 +37,29 @@ protected:
     */
    SSL* mSSL;
 
+   /**
+    * The transport mode for this socket.
+    */
+   SslContext::TransportMode mTransportMode;
+
    /**
     * A BIO (Basic Input/Output) for SSL data.
     *
+    * With a BIO pair transport:
+    *
     * A read on this BIO will read data that has been pulled from the Socket.
     *
     * A write on this BIO will provide SSL data for the Socket BIO to
     * send out to the Socket.
+    *
+    * With a direct transport, reads and writes on this BIO receive from and
+    * send to the Socket.
     */
    BIO* mSSLBio;
 
    /**
-    * A BIO (Basic Input/Output) for socket data.
+    * A BIO (Basic Input/Output) for socket data, NULL with a direct
+    * transport.
     *
     * A read on this BIO will read SSL data written by the SSL layer. That
     * data can then be sent out to the Socket.
@@ -117,6 +134,15 @@ public:
     */
    virtual SslSession getSession();
 
+   /**
+    * Returns true if the handshake resumed a previous session, either one
+    * that was set via setSession() or, for a server, one found in its session
+    * cache or in a session ticket.
+    *
+    * @return true if a session was resumed, false if not.
+    */
+   virtual bool isSessionReused();
+
    /**
     * Adds an X.509 subject common name to check against when verifying the
     * peer's X.509 certificate. If any added common name matches, then the
@@ -167,6 +193,23 @@ public:
     */
    virtual bool performHandshake();
 
+   /**
+    * Gets the application protocol that was selected via Application Layer
+    * Protocol Negotiation (ALPN) during the handshake, if any.
+    *
+    * @param protocol set to the selected protocol (ie: "h2").
+    *
+    * @return true if a protocol was selected, false if not.
+    */
+   virtual bool getAlpnProtocol(std::string& protocol);
+
+   /**
+    * Gets the transport mode this socket was created with.
+    *
+    * @return the transport mode.
+    */
+   virtual SslContext::TransportMode getTransportMode();
+
    /**
     * Writes raw data to this Socket. This method will block until all of
     * the data has been written.
@@ -213,6 +256,20 @@ public:
     * @return the OutputStream for writing to this Socket.
     */
    virtual monarch::io::OutputStream* getOutputStream();
+
+protected:
+   /**
+    * Checks whether SSL failed because of the transport when using a direct
+    * transport. An SSL_ERROR_SYSCALL is reported either when the socket
+    * failed, in which case an exception is already set, or when the socket
+    * closed without an SSL shutdown.
+    *
+    * @param ret the return value from the SSL call.
+    *
+    * @return 0 if the socket closed, -1 if the socket failed, 1 if the error
+    *         was not caused by the transport.
+    */
+   virtual int checkDirectTransport(int ret);
 };
 
 } // end namespace net
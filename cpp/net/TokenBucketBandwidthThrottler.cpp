@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#define __STDC_LIMIT_MACROS
+
+#include "monarch/net/TokenBucketBandwidthThrottler.h"
+
+#include "monarch/rt/Atomic.h"
+#include "monarch/rt/System.h"
+
+using namespace std;
+using namespace monarch::net;
+using namespace monarch::rt;
+
+TokenBucketBandwidthThrottler::TokenBucketBandwidthThrottler(
+   int rateLimit, int threadCacheSize) :
+   mRateLimit(0),
+   mBurstSize(0),
+   mCredit(0),
+   mRefillTime(System::getCurrentMilliseconds()),
+   mParent(NULL),
+   mWaiterCount(0),
+   mNextTicket(0),
+   mThreadCacheSize(threadCacheSize),
+   mThreadCache(NULL)
+{
+   if(mThreadCacheSize > 0)
+   {
+      mThreadCache = new ThreadLocal(&cleanupThreadCache);
+   }
+
+   // set the rate limit and start with a full bucket
+   setRateLimit(rateLimit);
+   mCredit = getCapacity();
+}
+
+TokenBucketBandwidthThrottler::~TokenBucketBandwidthThrottler()
+{
+   if(mThreadCacheSize > 0)
+   {
+      // deleting the thread local prevents any further cleanup by exiting
+      // threads
+      delete mThreadCache;
+      for(ThreadCacheList::iterator i = mThreadCaches.begin();
+          i != mThreadCaches.end(); ++i)
+      {
+         delete *i;
+      }
+   }
+}
+
+void TokenBucketBandwidthThrottler::setParent(BandwidthThrottler* parent)
+{
+   mParent = parent;
+}
+
+void TokenBucketBandwidthThrottler::setParent(BandwidthThrottlerRef& parent)
+{
+   // save reference
+   mParentRef = parent;
+   setParent(parent.isNull() ? NULL : &(*parent));
+}
+
+BandwidthThrottler* TokenBucketBandwidthThrottler::getParent()
+{
+   return mParent;
+}
+
+void TokenBucketBandwidthThrottler::setBurstSize(int size)
+{
+   mBurstSize = (size < 0) ? 0 : size;
+   setRateLimit(mRateLimit);
+}
+
+int TokenBucketBandwidthThrottler::getBurstSize()
+{
+   return (int)(getCapacity() / 1000);
+}
+
+bool TokenBucketBandwidthThrottler::requestBytes(int count, int& permitted)
+{
+   bool rval = requestOwnBytes(count, permitted);
+   if(rval && mParent != NULL && permitted > 0)
+   {
+      // the parent must permit the bytes as well
+      int parentPermitted = 0;
+      rval = mParent->requestBytes(permitted, parentPermitted);
+      if(!rval)
+      {
+         parentPermitted = 0;
+      }
+      if(parentPermitted < permitted)
+      {
+         // return what the parent did not permit
+         returnBytes(permitted - parentPermitted);
+         notifyWaiters();
+         permitted = parentPermitted;
+      }
+   }
+
+   return rval;
+}
+
+void TokenBucketBandwidthThrottler::addAvailableBytes(int bytes)
+{
+   if(bytes > 0)
+   {
+      returnBytes(bytes);
+      notifyWaiters();
+      if(mParent != NULL)
+      {
+         mParent->addAvailableBytes(bytes);
+      }
+   }
+}
+
+int TokenBucketBandwidthThrottler::getAvailableBytes()
+{
+   int rval = INT32_MAX;
+
+   if(mRateLimit > 0)
+   {
+      refill();
+      rval = (int)(mCredit / 1000);
+   }
+   if(mParent != NULL)
+   {
+      int available = mParent->getAvailableBytes();
+      rval = (available < rval) ? available : rval;
+   }
+
+   return rval;
+}
+
+void TokenBucketBandwidthThrottler::setRateLimit(int rateLimit)
+{
+   // bring the bucket up to date at the old rate
+   refill();
+   mRateLimit = (rateLimit < 0) ? 0 : rateLimit;
+
+   // drop any credit over the new capacity
+   int64_t capacity = getCapacity();
+   int64_t credit;
+   do
+   {
+      credit = mCredit;
+   }
+   while(credit > capacity &&
+         !Atomic::compareAndSwap(&mCredit, credit, capacity));
+
+   // wake waiters so they use the new rate
+   mLock.lock();
+   mLock.notifyAll();
+   mLock.unlock();
+}
+
+int TokenBucketBandwidthThrottler::getRateLimit()
+{
+   return mRateLimit;
+}
+
+bool TokenBucketBandwidthThrottler::requestOwnBytes(int count, int& permitted)
+{
+   bool rval = true;
+
+   permitted = 0;
+   if(mRateLimit <= 0 || count <= 0)
+   {
+      // no rate limit, return the count
+      permitted = count;
+   }
+   else if(mThreadCacheSize > 0)
+   {
+      // take bytes in batches for this thread, unless others are waiting
+      ThreadCache* cache = getThreadCache();
+      if(cache->bytes < count && mWaiterCount == 0)
+      {
+         int64_t want = (int64_t)count + mThreadCacheSize - cache->bytes;
+         refill();
+         cache->bytes += takeBytes(
+            (want > INT32_MAX) ? INT32_MAX : (int)want);
+      }
+      if(cache->bytes > 0)
+      {
+         permitted = (cache->bytes < count) ? cache->bytes : count;
+         cache->bytes -= permitted;
+      }
+   }
+   else if(mWaiterCount == 0)
+   {
+      // take bytes without waiting
+      refill();
+      permitted = takeBytes(count);
+   }
+
+   if(permitted == 0)
+   {
+      // wait in line for bytes
+      rval = waitForBytes(count, permitted);
+   }
+
+   return rval;
+}
+
+void TokenBucketBandwidthThrottler::refill()
+{
+   int32_t rate = mRateLimit;
+   uint64_t last = mRefillTime;
+   uint64_t now = System::getCurrentMilliseconds();
+
+   // only the thread that advances the refill time adds the credit
+   if(now > last && Atomic::compareAndSwap(&mRefillTime, last, now) &&
+      rate > 0)
+   {
+      int64_t capacity = getCapacity();
+      uint64_t elapsed = now - last;
+      int64_t add = (elapsed > (uint64_t)(capacity / rate)) ?
+         capacity : (int64_t)elapsed * rate;
+
+      int64_t credit;
+      int64_t newCredit;
+      do
+      {
+         credit = mCredit;
+         newCredit = (credit + add > capacity) ? capacity : credit + add;
+      }
+      while(credit < newCredit &&
+            !Atomic::compareAndSwap(&mCredit, credit, newCredit));
+   }
+}
+
+int TokenBucketBandwidthThrottler::takeBytes(int count)
+{
+   int rval = 0;
+
+   bool taken = false;
+   while(!taken)
+   {
+      int64_t credit = mCredit;
+      int64_t available = credit / 1000;
+      if(available <= 0)
+      {
+         rval = 0;
+         taken = true;
+      }
+      else
+      {
+         rval = (available < count) ? (int)available : count;
+         taken = Atomic::compareAndSwap(
+            &mCredit, credit, credit - (int64_t)rval * 1000);
+      }
+   }
+
+   return rval;
+}
+
+void TokenBucketBandwidthThrottler::returnBytes(int bytes)
+{
+   if(mRateLimit > 0)
+   {
+      int64_t capacity = getCapacity();
+      int64_t credit;
+      int64_t newCredit;
+      do
+      {
+         credit = mCredit;
+         newCredit = credit + (int64_t)bytes * 1000;
+         newCredit = (newCredit > capacity) ? capacity : newCredit;
+      }
+      while(credit < newCredit &&
+            !Atomic::compareAndSwap(&mCredit, credit, newCredit));
+   }
+}
+
+int64_t TokenBucketBandwidthThrottler::getCapacity()
+{
+   int64_t burst = mBurstSize;
+   if(burst == 0)
+   {
+      // allow a tenth of a second worth of bytes at once
+      burst = mRateLimit / 10;
+      burst = (burst < 1) ? 1 : burst;
+   }
+   return burst * 1000;
+}
+
+void TokenBucketBandwidthThrottler::notifyWaiters()
+{
+   if(mWaiterCount > 0)
+   {
+      mLock.lock();
+      mLock.notifyAll();
+      mLock.unlock();
+   }
+}
+
+TokenBucketBandwidthThrottler::ThreadCache*
+   TokenBucketBandwidthThrottler::getThreadCache()
+{
+   ThreadCache* rval = static_cast<ThreadCache*>(mThreadCache->get());
+   if(rval == NULL)
+   {
+      rval = new ThreadCache;
+      rval->throttler = this;
+      rval->bytes = 0;
+      mLock.lock();
+      mThreadCaches.push_back(rval);
+      mLock.unlock();
+      mThreadCache->set(rval);
+   }
+   return rval;
+}
+
+bool TokenBucketBandwidthThrottler::waitForBytes(int count, int& permitted)
+{
+   bool rval = true;
+
+   permitted = 0;
+   mLock.lock();
+   {
+      // get in line
+      uint64_t ticket = mNextTicket++;
+      mWaiters.push_back(ticket);
+      Atomic::incrementAndFetch(&mWaiterCount);
+
+      bool done = false;
+      while(rval && !done)
+      {
+         int32_t rate = mRateLimit;
+         if(rate <= 0)
+         {
+            // no rate limit, return the count
+            permitted = count;
+            done = true;
+         }
+         else if(mWaiters.front() == ticket)
+         {
+            // first in line, take bytes or sleep until one is available
+            refill();
+            permitted = takeBytes(count);
+            if(permitted > 0)
+            {
+               done = true;
+            }
+            else
+            {
+               int64_t missing = 1000 - mCredit;
+               uint32_t timeout = (uint32_t)((missing + rate - 1) / rate);
+               rval = mLock.wait((timeout < 1) ? 1 : timeout);
+            }
+         }
+         else
+         {
+            // wait for the threads ahead to be served
+            rval = mLock.wait();
+         }
+      }
+
+      // leave the line and let the next thread check
+      mWaiters.remove(ticket);
+      Atomic::decrementAndFetch(&mWaiterCount);
+      mLock.notifyAll();
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void TokenBucketBandwidthThrottler::cleanupThreadCache(void* cache)
+{
+   ThreadCache* tc = static_cast<ThreadCache*>(cache);
+   TokenBucketBandwidthThrottler* self = tc->throttler;
+   self->returnBytes(tc->bytes);
+   self->mLock.lock();
+   self->mThreadCaches.remove(tc);
+   self->mLock.unlock();
+   delete tc;
+}
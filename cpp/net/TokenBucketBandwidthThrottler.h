@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_net_TokenBucketBandwidthThrottler_H
+#define monarch_net_TokenBucketBandwidthThrottler_H
+
+#include "monarch/net/BandwidthThrottler.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/ThreadLocal.h"
+
+#include <list>
+
+namespace monarch
+{
+namespace net
+{
+
+/**
+ * A TokenBucketBandwidthThrottler throttles bandwidth using a token bucket
+ * that is shared without a lock.
+ *
+ * The bucket holds up to a burst size of bytes and is refilled at the rate
+ * limit as time passes. Requests take bytes from the bucket using atomic
+ * operations, so threads only contend on a lock when the bucket is empty and
+ * they must wait. Waiting threads are queued and served in the order they
+ * arrived, the first of them sleeps until enough time has passed for a byte
+ * to become available.
+ *
+ * A throttler may have a parent throttler, allowing, for instance, a
+ * per-connection throttler to share a per-service throttler that in turn
+ * shares a global one. Bytes are taken from this throttler first and then
+ * from its parent, any bytes the parent does not permit are returned.
+ *
+ * A throttler that is shared by many threads may also cache bytes per thread.
+ * Each thread then takes bytes from the bucket in batches and only touches
+ * the shared bucket once per batch. Cached bytes are already counted against
+ * the rate limit, so the rate is never exceeded, but bytes cached by one
+ * thread cannot be used by another until it returns them.
+ *
+ * @author Dave Longley
+ */
+class TokenBucketBandwidthThrottler : public BandwidthThrottler
+{
+protected:
+   /**
+    * The bytes cached by a thread.
+    */
+   struct ThreadCache
+   {
+      TokenBucketBandwidthThrottler* throttler;
+      int bytes;
+   };
+
+   /**
+    * A list of thread caches.
+    */
+   typedef std::list<ThreadCache*> ThreadCacheList;
+
+   /**
+    * The rate limit in bytes/second, 0 for no limit.
+    */
+   volatile int32_t mRateLimit;
+
+   /**
+    * The maximum number of bytes in the bucket, 0 to use a tenth of the
+    * rate limit.
+    */
+   volatile int32_t mBurstSize;
+
+   /**
+    * The number of bytes in the bucket times 1000, so that refilling it for
+    * any number of milliseconds never loses a fraction of a byte.
+    */
+   volatile int64_t mCredit;
+
+   /**
+    * The time (in milliseconds) at which the bucket was last refilled.
+    */
+   volatile uint64_t mRefillTime;
+
+   /**
+    * The parent throttler, NULL for none.
+    */
+   BandwidthThrottler* mParent;
+
+   /**
+    * A reference to the parent throttler, if one was given.
+    */
+   BandwidthThrottlerRef mParentRef;
+
+   /**
+    * The number of threads waiting for bytes.
+    */
+   volatile uint32_t mWaiterCount;
+
+   /**
+    * The tickets of the waiting threads in the order they arrived.
+    */
+   std::list<uint64_t> mWaiters;
+
+   /**
+    * The next waiter ticket.
+    */
+   uint64_t mNextTicket;
+
+   /**
+    * The maximum number of bytes a thread may cache, 0 for no caching.
+    */
+   int mThreadCacheSize;
+
+   /**
+    * The cache of each thread, NULL if there is no caching.
+    */
+   monarch::rt::ThreadLocal* mThreadCache;
+
+   /**
+    * All thread caches, so they can be freed.
+    */
+   ThreadCacheList mThreadCaches;
+
+   /**
+    * A lock for waiting threads and thread caches.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+public:
+   /**
+    * Creates a new TokenBucketBandwidthThrottler.
+    *
+    * @param rateLimit the bytes/second rate limit to use. A value of 0
+    *                  indicates no rate limit.
+    * @param threadCacheSize the maximum number of bytes each thread may
+    *           cache, 0 for no caching.
+    */
+   TokenBucketBandwidthThrottler(int rateLimit, int threadCacheSize = 0);
+
+   /**
+    * Destructs this TokenBucketBandwidthThrottler. No threads may be using
+    * it.
+    */
+   virtual ~TokenBucketBandwidthThrottler();
+
+   /**
+    * Sets the parent of this throttler. Bytes permitted by this throttler
+    * must also be permitted by its parent. This must be set before the
+    * throttler is used.
+    *
+    * @param parent the parent throttler, NULL for none.
+    */
+   virtual void setParent(BandwidthThrottler* parent);
+   virtual void setParent(BandwidthThrottlerRef& parent);
+
+   /**
+    * Gets the parent of this throttler.
+    *
+    * @return the parent throttler, NULL for none.
+    */
+   virtual BandwidthThrottler* getParent();
+
+   /**
+    * Sets the maximum number of bytes that may be granted at once after the
+    * throttler has been idle.
+    *
+    * @param size the burst size in bytes, 0 to use a tenth of the rate
+    *           limit.
+    */
+   virtual void setBurstSize(int size);
+
+   /**
+    * Gets the maximum number of bytes that may be granted at once after the
+    * throttler has been idle.
+    *
+    * @return the burst size in bytes.
+    */
+   virtual int getBurstSize();
+
+   /**
+    * Requests the passed number of bytes from this throttler. This method
+    * will block until at least one byte can be sent without violating
+    * the rate limit or if the current thread has been interrupted.
+    *
+    * @param count the number of bytes requested.
+    * @param permitted set to the number of bytes permitted to send.
+    *
+    * @return false if the thread this throttler is waiting on gets
+    *         interrupted (with an Exception set), true otherwise.
+    */
+   virtual bool requestBytes(int count, int& permitted);
+
+   /**
+    * Adds available bytes. This method should be called when not all of the
+    * permitted bytes could be obtained and they should be made available
+    * again.
+    *
+    * @param bytes the number of bytes that should be made available.
+    */
+   virtual void addAvailableBytes(int bytes);
+
+   /**
+    * Gets the number of bytes that are currently available.
+    *
+    * @return the number of bytes that are currently available.
+    */
+   virtual int getAvailableBytes();
+
+   /**
+    * Sets the rate limit in bytes/second. A value of 0 indicates no rate limit.
+    *
+    * @param rateLimit the bytes/second rate limit to use.
+    */
+   virtual void setRateLimit(int rateLimit);
+
+   /**
+    * Gets the rate limit in bytes/second. A value of 0 indicates no rate limit.
+    *
+    * @return the rate limit in bytes/second.
+    */
+   virtual int getRateLimit();
+
+protected:
+   /**
+    * Requests bytes from this throttler only, waiting if none are available.
+    *
+    * @param count the number of bytes requested.
+    * @param permitted set to the number of bytes permitted.
+    *
+    * @return false if interrupted (with an Exception set), true otherwise.
+    */
+   virtual bool requestOwnBytes(int count, int& permitted);
+
+   /**
+    * Refills the bucket for the time that has passed since it was last
+    * refilled.
+    */
+   virtual void refill();
+
+   /**
+    * Takes up to the passed number of bytes from the bucket without waiting.
+    *
+    * @param count the maximum number of bytes to take.
+    *
+    * @return the number of bytes taken.
+    */
+   virtual int takeBytes(int count);
+
+   /**
+    * Returns bytes to the bucket, up to its burst size.
+    *
+    * @param bytes the number of bytes to return.
+    */
+   virtual void returnBytes(int bytes);
+
+   /**
+    * Gets the maximum credit the bucket may hold.
+    *
+    * @return the maximum credit.
+    */
+   virtual int64_t getCapacity();
+
+   /**
+    * Wakes up any waiting threads so they can check for available bytes.
+    */
+   virtual void notifyWaiters();
+
+   /**
+    * Gets the current thread's cache, creating it if necessary.
+    *
+    * @return the current thread's cache.
+    */
+   virtual ThreadCache* getThreadCache();
+
+   /**
+    * Waits in line until bytes are available, the rate limit is removed or
+    * the thread is interrupted.
+    *
+    * @param count the number of bytes requested.
+    * @param permitted set to the number of bytes permitted.
+    *
+    * @return false if interrupted (with an Exception set), true otherwise.
+    */
+   virtual bool waitForBytes(int count, int& permitted);
+
+   /**
+    * Returns the bytes in a thread's cache to the bucket and frees the cache
+    * when its thread exits.
+    *
+    * @param cache the thread's cache.
+    */
+   static void cleanupThreadCache(void* cache);
+};
+
+} // end namespace net
+} // end namespace monarch
+#endif
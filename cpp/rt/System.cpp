@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_CONSTANT_MACROS
 
@@ -11,6 +11,7 @@
 #ifdef WIN32
 #include <windows.h>
 #elif MACOS
+#include <mach/mach_time.h>
 #include <sys/param.h>
 #include <sys/sysctl.h>
 #else
@@ -35,6 +36,36 @@ uint64_t System::getCurrentMilliseconds()
    return rval;
 }
 
+uint64_t System::getCurrentMicroseconds()
+{
+   // get the current time of day
+   struct timeval now;
+   gettimeofday(&now, NULL);
+   return now.tv_sec * UINT64_C(1000000) + now.tv_usec;
+}
+
+uint64_t System::getMonotonicMicroseconds()
+{
+#ifdef WIN32
+   LARGE_INTEGER frequency;
+   LARGE_INTEGER now;
+   QueryPerformanceFrequency(&frequency);
+   QueryPerformanceCounter(&now);
+   return
+      (now.QuadPart / frequency.QuadPart) * UINT64_C(1000000) +
+      (now.QuadPart % frequency.QuadPart) * UINT64_C(1000000) /
+      frequency.QuadPart;
+#elif MACOS
+   mach_timebase_info_data_t timebase;
+   mach_timebase_info(&timebase);
+   return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+#else
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return now.tv_sec * UINT64_C(1000000) + now.tv_nsec / 1000;
+#endif
+}
+
 uint32_t System::getCpuCoreCount()
 {
 #ifdef WIN32
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2009 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_rt_System_H
 #define monarch_rt_System_H
@@ -29,6 +29,22 @@ public:
     */
    static uint64_t getCurrentMilliseconds();
 
+   /**
+    * Gets the current time in microseconds.
+    *
+    * @return the current time in microseconds.
+    */
+   static uint64_t getCurrentMicroseconds();
+
+   /**
+    * Gets the time in microseconds since an arbitrary, fixed point. Unlike
+    * the current time, it never goes backwards when the system clock is
+    * set, so it is the one to use for measuring elapsed time.
+    *
+    * @return the monotonic time in microseconds.
+    */
+   static uint64_t getMonotonicMicroseconds();
+
    /**
     * Gets the number of cores/cpus.
     *
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/rt/ThreadLocal.h"
+
+#include <cstddef>
+
+using namespace monarch::rt;
+
+ThreadLocal::ThreadLocal(CleanupFunction cleanup)
+{
+   pthread_key_create(&mKey, cleanup);
+}
+
+ThreadLocal::~ThreadLocal()
+{
+   // deleting the key prevents any further cleanup by exiting threads
+   pthread_key_delete(mKey);
+}
+
+void* ThreadLocal::get()
+{
+   return pthread_getspecific(mKey);
+}
+
+void ThreadLocal::set(void* value)
+{
+   pthread_setspecific(mKey, value);
+}
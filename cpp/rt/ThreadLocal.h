@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_rt_ThreadLocal_H
+#define monarch_rt_ThreadLocal_H
+
+#include <pthread.h>
+
+namespace monarch
+{
+namespace rt
+{
+
+/**
+ * A ThreadLocal holds a separate pointer for each thread. A thread sees only
+ * the value it set, NULL until it sets one.
+ *
+ * If a cleanup function is given, it is called with a thread's value when
+ * that thread exits, unless the value is NULL. Once the ThreadLocal is
+ * destructed, values of threads that exit later are no longer cleaned up,
+ * so their owner must free them.
+ *
+ * @author Dave Longley
+ */
+class ThreadLocal
+{
+public:
+   /**
+    * A function that frees the value of an exiting thread.
+    */
+   typedef void (*CleanupFunction)(void* value);
+
+protected:
+   /**
+    * The key for the value of each thread.
+    */
+   pthread_key_t mKey;
+
+public:
+   /**
+    * Creates a new ThreadLocal.
+    *
+    * @param cleanup the function to call with the value of each thread
+    *           when it exits, NULL for none.
+    */
+   ThreadLocal(CleanupFunction cleanup = NULL);
+
+   /**
+    * Destructs this ThreadLocal.
+    */
+   virtual ~ThreadLocal();
+
+   /**
+    * Gets the value of the current thread.
+    *
+    * @return the value, NULL if the current thread has not set one.
+    */
+   virtual void* get();
+
+   /**
+    * Sets the value of the current thread.
+    *
+    * @param value the value to set, NULL to clear it.
+    */
+   virtual void set(void* value);
+
+private:
+   /**
+    * Copying is not permitted, a key belongs to one ThreadLocal.
+    */
+   ThreadLocal(const ThreadLocal&);
+   ThreadLocal& operator=(const ThreadLocal&);
+};
+
+} // end namespace rt
+} // end namespace monarch
+#endif
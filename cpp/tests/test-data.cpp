@@ -1,7 +1,8 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_CONSTANT_MACROS
+#define __STDC_LIMIT_MACROS
 
 #include "monarch/test/Test.h"
 #include "monarch/test/TestModule.h"
@@ -21,7 +22,13 @@
 #include "monarch/data/DynamicObjectInputStream.h"
 #include "monarch/data/DynamicObjectOutputStream.h"
 #include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/json/JsonPathExtractor.h"
 #include "monarch/data/json/JsonReader.h"
+#include "monarch/data/json/JsonStreamWriter.h"
+#include "monarch/data/mapped/MappedDocument.h"
+#include "monarch/data/mapped/MappedDocumentWriter.h"
+#include "monarch/data/msgpack/MessagePackReader.h"
+#include "monarch/data/msgpack/MessagePackWriter.h"
 #include "monarch/data/riff/RiffChunkHeader.h"
 #include "monarch/data/riff/RiffListHeader.h"
 #include "monarch/data/riff/RiffFormHeader.h"
@@ -34,7 +41,9 @@ using namespace monarch::test;
 using namespace monarch::data;
 //using namespace monarch::data::avi;
 using namespace monarch::data::json;
+using namespace monarch::data::mapped;
 //using namespace monarch::data::mpeg;
+using namespace monarch::data::msgpack;
 using namespace monarch::data::riff;
 using namespace monarch::data::xml;
 using namespace monarch::io;
@@ -195,6 +204,253 @@ static void runJsonInvalidTest(TestRunner& tr)
    tr.ungroup();
 }
 
+static void runJsonReaderRunsTest(TestRunner& tr)
+{
+   tr.group("JsonReader runs");
+
+   tr.test("strings across reads");
+   {
+      // long strings with escapes cross the reader's buffer boundaries
+      string text;
+      for(int i = 0; text.length() < 20000; ++i)
+      {
+         text.append("abcdefghij \xc3\xa4\xc3\xb6 ");
+         text.append((i % 7 == 0) ? "\"\\/\b\f\n\r\t" : "");
+      }
+      DynamicObject in;
+      in["text"] = text.c_str();
+      in["more"] = text.c_str();
+      string json = JsonWriter::writeToString(in, true);
+
+      DynamicObject out;
+      assertNoException(
+         JsonReader::readFromString(out, json.c_str(), json.length()));
+      assertDynoCmp(in, out);
+   }
+   tr.passIfNoException();
+
+   tr.test("numbers across reads");
+   {
+      string json = "[";
+      json.append(4090, ' ');
+      json.append("1234567890123, -98765, 1.25e+10 ,0]");
+
+      DynamicObject out;
+      assertNoException(
+         JsonReader::readFromString(out, json.c_str(), json.length()));
+      assert(out->length() == 4);
+      assert(out[0]->getType() == UInt64);
+      assert(out[0]->getUInt64() == 1234567890123ULL);
+      assert(out[1]->getType() == Int64);
+      assert(out[1]->getInt64() == -98765);
+      assert(out[2]->getType() == Double);
+      assert(out[2]->getDouble() == 1.25e+10);
+      assert(out[3]->getUInt64() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("whitespace and digits");
+   {
+      // runs of every length, some longer than a vector, with newlines
+      string json = "[";
+      for(int i = 0; i < 40; ++i)
+      {
+         char num[10];
+         snprintf(num, 10, "%d.", i);
+         json.append(i == 0 ? "" : ",");
+         json.append("\n");
+         json.append(i, ' ');
+         json.append("\t\r");
+         json.append(num);
+         json.append(i, '0');
+         json.append("5");
+      }
+
+      DynamicObject out;
+      string valid = json + "\n]";
+      assertNoException(
+         JsonReader::readFromString(out, valid.c_str(), valid.length()));
+      assert(out->length() == 40);
+      size_t start = 0;
+      for(int i = 0; i < 40; ++i)
+      {
+         // the same text parsed by itself
+         start = json.find_first_of("0123456789", start);
+         size_t end = json.find(',', start);
+         string num = json.substr(start, end - start);
+         assert(out[i]->getDouble() == strtod(num.c_str(), NULL));
+         start = end;
+      }
+
+      // the newlines in every run are counted
+      string bad = json + ",\n" + string(70, ' ') + "tru]";
+      assertException(
+         JsonReader::readFromString(out, bad.c_str(), bad.length()));
+      assert(Exception::get()->getDetails()["line"]->getInt32() == 42);
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.test("error position");
+   {
+      const char* json = "{\n  \"a\": \"x\",\n  \"b\": tru }";
+      DynamicObject out;
+      assertException(JsonReader::readFromString(out, json, strlen(json)));
+      ExceptionRef e = Exception::get();
+      assertStrCmp(e->getType(), "monarch.data.json.JsonReader.ParseError");
+      assert(e->getDetails()["line"]->getInt32() == 3);
+      assert(e->getDetails()["position"]->getInt32() ==
+         (int)(strstr(json, "tru") - json) + 4);
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+class RecordingJsonHandler : public JsonHandler
+{
+public:
+   string events;
+   int stopAt;
+   RecordingJsonHandler() : stopAt(-1) {}
+   virtual ~RecordingJsonHandler() {}
+   bool add(const char* event)
+   {
+      bool rval = (stopAt-- != 0);
+      events.append(event);
+      if(!rval)
+      {
+         ExceptionRef e = new Exception("Stopped.", "tests.Stopped");
+         Exception::set(e);
+      }
+      return rval;
+   }
+   virtual bool startObject() { return add("{"); }
+   virtual bool endObject() { return add("}"); }
+   virtual bool startArray() { return add("["); }
+   virtual bool endArray() { return add("]"); }
+   virtual bool key(const char* key)
+   {
+      events.append(key);
+      return add(":");
+   }
+   virtual bool value(DynamicObject& value)
+   {
+      events.append(value.isNull() ? "null" : value->getString());
+      return add(",");
+   }
+};
+
+static void runJsonHandlerTest(TestRunner& tr)
+{
+   tr.group("JsonHandler");
+
+   const char* json =
+      "{\"a\":[1,true,null,\"s\"],\"b\":{\"c\":-2.5,\"d\":[]}}";
+
+   tr.test("events");
+   {
+      RecordingJsonHandler h;
+      JsonReader jr;
+      ByteArrayInputStream is(json, strlen(json));
+      assertNoException(jr.start(&h) && jr.read(&is) && jr.finish());
+      assertStrCmp(h.events.c_str(),
+         "{a:[1,true,null,s,]b:{c:-2.500000e+00,d:[]}}");
+
+      // values only
+      JsonReader vr(false);
+      RecordingJsonHandler vh;
+      ByteArrayInputStream vis("42", 2);
+      assertNoException(vr.start(&vh) && vr.read(&vis) && vr.finish());
+      assertStrCmp(vh.events.c_str(), "42,");
+   }
+   tr.passIfNoException();
+
+   tr.test("stop");
+   {
+      RecordingJsonHandler h;
+      h.stopAt = 3;
+      JsonReader jr;
+      ByteArrayInputStream is(json, strlen(json));
+      assertException(jr.start(&h) && jr.read(&is));
+      ExceptionRef e = Exception::get();
+      assertStrCmp(e->getType(), "monarch.data.json.JsonReader.ParseError");
+      assertStrCmp(e->getCause()->getType(), "tests.Stopped");
+      assertStrCmp(h.events.c_str(), "{a:[1,");
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.test("extract");
+   {
+      DynamicObject paths;
+      paths->append() = "a[1]";
+      paths->append() = "b";
+      paths->append() = "b.c";
+      paths->append() = "a[*]";
+      paths->append() = "missing.x";
+      ByteArrayInputStream is(json, strlen(json));
+      DynamicObject values;
+      assertNoException(JsonPathExtractor::extract(&is, paths, values));
+
+      DynamicObject expect;
+      expect["a[1]"] = true;
+      expect["b"]["c"] = -2.5;
+      expect["b"]["d"]->setType(Array);
+      expect["a[*]"]->append() = 1;
+      expect["a[*]"]->append() = DynamicObject(NULL);
+      expect["a[*]"]->append() = "s";
+      assert(values->length() == 3);
+      assertStrCmp(
+         JsonWriter::writeToString(values, true).c_str(),
+         JsonWriter::writeToString(expect, true).c_str());
+   }
+   tr.passIfNoException();
+
+   tr.test("extract lines");
+   {
+      // reuse one extractor for many small documents
+      JsonPathExtractor e;
+      assertNoException(e.addPath("level"));
+      assertNoException(e.addPath("*.user"));
+      const char* lines[] = {
+         "{\"level\":\"info\",\"ctx\":{\"user\":\"a\"},\"msg\":\"x\"}",
+         "{\"msg\":\"y\",\"level\":\"error\"}",
+         NULL
+      };
+      string levels;
+      for(int i = 0; lines[i] != NULL; ++i)
+      {
+         e.reset();
+         JsonReader jr;
+         ByteArrayInputStream is(lines[i], strlen(lines[i]));
+         assertNoException(jr.start(&e) && jr.read(&is) && jr.finish());
+         levels.append(e.getValues()["level"]->getString());
+         levels.append(e.getValues()->hasMember("*.user") ?
+            e.getValues()["*.user"][0]->getString() : "-");
+      }
+      assertStrCmp(levels.c_str(), "infoaerror-");
+   }
+   tr.passIfNoException();
+
+   tr.test("invalid paths");
+   {
+      JsonPathExtractor e;
+      assertNoException(e.addPath(""));
+      assertNoException(e.addPath("[0][*].a.*"));
+      assertException(e.addPath("a..b"));
+      Exception::clear();
+      assertException(e.addPath("a[x]"));
+      Exception::clear();
+      assertException(e.addPath("a[]"));
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runJsonDJDTest(TestRunner& tr)
 {
    tr.group("JSON (Dyno->JSON->Dyno)");
@@ -511,6 +767,161 @@ static void runJsonIOStreamTest(TestRunner& tr)
    tr.ungroup();
 }
 
+/**
+ * Counts the writes made to an output stream.
+ */
+class CountingOutputStream : public ByteArrayOutputStream
+{
+public:
+   int writes;
+   CountingOutputStream(ByteBuffer* b) :
+      ByteArrayOutputStream(b, true),
+      writes(0)
+   {
+   }
+   virtual ~CountingOutputStream() {}
+   virtual bool write(const char* b, int length)
+   {
+      ++writes;
+      return ByteArrayOutputStream::write(b, length);
+   }
+};
+
+static void runJsonStreamWriterTest(TestRunner& tr)
+{
+   tr.group("JsonStreamWriter");
+
+   DynamicObject rows;
+   rows->setType(Array);
+   for(int i = 0; i < 3; ++i)
+   {
+      DynamicObject& row = rows->append();
+      row["id"] = i;
+      row["name"] = "row \"quoted\"";
+      row["tags"]->append("a");
+   }
+   DynamicObject expect;
+   expect["count"] = 3;
+   expect["rows"] = rows;
+   expect["empty"]->setType(Array);
+
+   tr.test("compact");
+   {
+      ByteBuffer b(1024);
+      ByteArrayOutputStream baos(&b, true);
+      JsonStreamWriter writer(&baos);
+      DynamicObject count;
+      count = 3;
+      assertNoException(
+         writer.beginObject() &&
+         writer.writeMember("count", count) &&
+         writer.writeName("empty") &&
+         writer.beginArray() &&
+         writer.endArray() &&
+         writer.writeName("rows") &&
+         writer.beginArray());
+      for(int i = 0; i < 3; ++i)
+      {
+         assertNoException(writer.writeValue(rows[i]));
+      }
+      assertNoException(
+         writer.endArray() &&
+         writer.endObject() &&
+         writer.finish());
+
+      string json(b.data(), b.length());
+      assertStrCmp(
+         json.c_str(), JsonWriter::writeToString(expect, true).c_str());
+   }
+   tr.passIfNoException();
+
+   tr.test("indented");
+   {
+      ByteBuffer b(1024);
+      ByteArrayOutputStream baos(&b, true);
+      JsonStreamWriter writer(&baos);
+      writer.setCompact(false);
+      DynamicObject count;
+      count = 3;
+      DynamicObject empty;
+      empty->setType(Array);
+      assertNoException(
+         writer.beginObject() &&
+         writer.writeMember("count", count) &&
+         writer.writeMember("empty", empty) &&
+         writer.writeName("rows") &&
+         writer.beginArray());
+      for(int i = 0; i < 3; ++i)
+      {
+         assertNoException(writer.writeValue(rows[i]));
+      }
+      assertNoException(
+         writer.endArray() &&
+         writer.endObject() &&
+         writer.finish());
+
+      string json(b.data(), b.length());
+      assertStrCmp(
+         json.c_str(), JsonWriter::writeToString(expect, false).c_str());
+   }
+   tr.passIfNoException();
+
+   tr.test("buffered writes");
+   {
+      // many rows reach the output stream in a few large writes
+      ByteBuffer b(1024);
+      CountingOutputStream cos(&b);
+      JsonStreamWriter writer(&cos, 16384);
+      assertNoException(writer.beginArray());
+      for(int i = 0; i < 10000; ++i)
+      {
+         assertNoException(writer.writeValue(rows[i % 3]));
+      }
+      assertNoException(writer.endArray() && writer.finish());
+      assert(cos.writes <= (b.length() / 16384) + 1);
+
+      DynamicObject out;
+      assertNoException(
+         JsonReader::readFromString(out, b.data(), b.length()));
+      assert(out->length() == 10000);
+      assert(out[9999] == rows[0]);
+   }
+   tr.passIfNoException();
+
+   tr.test("invalid");
+   {
+      ByteBuffer b(1024);
+      ByteArrayOutputStream baos(&b, true);
+      JsonStreamWriter writer(&baos);
+      DynamicObject value;
+      value = "value";
+
+      // top-level value must be an object or array
+      assertException(writer.writeValue(value));
+      Exception::clear();
+
+      // values in objects need names, members only go in objects
+      assertNoException(writer.beginObject());
+      assertException(writer.writeValue(value));
+      Exception::clear();
+      assertException(writer.endArray());
+      Exception::clear();
+      assertNoException(writer.writeName("list") && writer.beginArray());
+      assertException(writer.writeName("name"));
+      Exception::clear();
+
+      // unterminated
+      assertException(writer.finish());
+      Exception::clear();
+      assertNoException(
+         writer.endArray() && writer.endObject() && writer.finish());
+      assertStrCmp(string(b.data(), b.length()).c_str(), "{\"list\":[]}");
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runXmlReaderTest(TestRunner& tr)
 {
    tr.test("XmlReader");
@@ -1542,6 +1953,500 @@ static DynamicObject makeJsonTestDyno2()
    return d;
 }
 
+/**
+ * Writes JSON with a JsonWriter in buffered or unbuffered mode.
+ */
+static string writeJson(
+   DynamicObject& dyno, bool buffered, bool compact, int* writes = NULL)
+{
+   ByteBuffer b;
+   CountingOutputStream os(&b);
+   JsonWriter jw;
+   jw.setBuffered(buffered);
+   jw.setCompact(compact);
+   jw.setIndentation(1, 2);
+   assertNoException(jw.write(dyno, &os));
+   if(writes != NULL)
+   {
+      *writes = os.writes;
+   }
+   return string(b.data(), b.length());
+}
+
+static void runJsonWriterBufferedTest(TestRunner& tr)
+{
+   tr.group("JsonWriter buffered");
+
+   DynamicObject d = makeJsonTestDyno2();
+   d["escapes"] = "\"\\/\b\f\n\r\t\x01\x1f \xc3\xa4 end";
+   d["empty"] = "";
+   d["emptyMap"]->setType(Map);
+   d["emptyArray"]->setType(Array);
+   d["numbers"]->append() = 0;
+   d["numbers"]->append() = 9;
+   d["numbers"]->append() = -10;
+   d["numbers"]->append() = (int32_t)INT32_MIN;
+   d["numbers"]->append() = (uint32_t)UINT32_MAX;
+   d["numbers"]->append() = (int64_t)INT64_MIN;
+   d["numbers"]->append() = (int64_t)INT64_MAX;
+   d["numbers"]->append() = (uint64_t)UINT64_MAX;
+   d["numbers"]->append() = 0.0;
+   d["numbers"]->append() = -1.5e-300;
+   d["numbers"]->append() = 12345.678;
+   d["deep"][0][0]["a"][0]["b"] = true;
+
+   tr.test("compact");
+   {
+      int writes;
+      string expect = writeJson(d, false, true);
+      string json = writeJson(d, true, true, &writes);
+      assertStrCmp(json.c_str(), expect.c_str());
+      assert(writes == 1);
+
+      DynamicObject out;
+      assertNoException(
+         JsonReader::readFromString(out, json.c_str(), json.length()));
+      assertStrCmp(out["escapes"]->getString(), d["escapes"]->getString());
+   }
+   tr.passIfNoException();
+
+   tr.test("indented");
+   {
+      string expect = writeJson(d, false, false);
+      string json = writeJson(d, true, false);
+      assertStrCmp(json.c_str(), expect.c_str());
+   }
+   tr.passIfNoException();
+
+   tr.test("reuse");
+   {
+      DynamicObject small;
+      small["a"] = 1;
+      ByteBuffer b;
+      ByteArrayOutputStream os(&b, true);
+      JsonWriter jw;
+      jw.setBuffered(true);
+      assertNoException(jw.write(d, &os));
+      b.clear();
+      assertNoException(jw.write(small, &os));
+      assertStrCmp(string(b.data(), b.length()).c_str(), "{\"a\":1}");
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Converts a string of hex digits to bytes.
+ */
+static string hexToBytes(const char* hex)
+{
+   string rval;
+   for(; hex[0] != '\0' && hex[1] != '\0'; hex += 2)
+   {
+      char byte[3] = { hex[0], hex[1], '\0' };
+      rval.push_back((char)strtoul(byte, NULL, 16));
+   }
+   return rval;
+}
+
+/**
+ * Asserts that a value is written as some MessagePack bytes and read back
+ * with the same type and value.
+ */
+static void assertMessagePack(DynamicObject dyno, const char* hex)
+{
+   string expect = hexToBytes(hex);
+   string data = MessagePackWriter::writeToString(dyno);
+   assert(data == expect);
+
+   DynamicObject out;
+   assertNoException(
+      MessagePackReader::readFromString(out, data.c_str(), data.length()));
+   assert(dyno.isNull() == out.isNull());
+   if(!dyno.isNull())
+   {
+      assert(dyno->getType() == out->getType());
+      assert(*dyno == *out);
+   }
+}
+
+/**
+ * Makes a DynamicObject with a value.
+ */
+template<typename T>
+static DynamicObject makeDyno(T value)
+{
+   DynamicObject rval;
+   rval = value;
+   return rval;
+}
+
+static void runMessagePackTest(TestRunner& tr)
+{
+   tr.group("MessagePack");
+
+   tr.test("scalars");
+   {
+      assertMessagePack(DynamicObject(NULL), "c0");
+      assertMessagePack(makeDyno(true), "c3");
+      assertMessagePack(makeDyno(false), "c2");
+      assertMessagePack(makeDyno((int32_t)0), "00");
+      assertMessagePack(makeDyno((int32_t)127), "7f");
+      assertMessagePack(makeDyno((int32_t)-32), "e0");
+      assertMessagePack(makeDyno((int32_t)-33), "d0df");
+      assertMessagePack(makeDyno((int32_t)128), "d10080");
+      assertMessagePack(makeDyno((int32_t)-32769), "d2ffff7fff");
+      assertMessagePack(makeDyno((uint32_t)1), "cc01");
+      assertMessagePack(makeDyno((uint32_t)256), "cd0100");
+      assertMessagePack(makeDyno((uint32_t)UINT32_MAX), "ceffffffff");
+      assertMessagePack(makeDyno((int64_t)-1), "d3ffffffffffffffff");
+      assertMessagePack(makeDyno((uint64_t)UINT64_MAX), "cfffffffffffffffff");
+      assertMessagePack(makeDyno(1.5), "cb3ff8000000000000");
+      assertMessagePack(makeDyno(""), "a0");
+      assertMessagePack(makeDyno("abc"), "a3616263");
+   }
+   tr.passIfNoException();
+
+   tr.test("containers");
+   {
+      DynamicObject d;
+      d["a"] = 1;
+      d["b"]->append() = "x";
+      d["b"]->append() = true;
+      d["c"]->setType(Map);
+      assertMessagePack(d, "83a16101a16292a178c3a16380");
+
+      // 32 character string and 16 element array use longer lengths
+      DynamicObject a;
+      a->setType(Array);
+      for(int i = 0; i < 16; ++i)
+      {
+         a->append() = "0123456789abcdef0123456789abcdef";
+      }
+      string data = MessagePackWriter::writeToString(a);
+      assert(data.compare(0, 5, hexToBytes("dc0010d920")) == 0);
+      DynamicObject out;
+      assertNoException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+      assertNamedDynoCmp("expect", a, "result", out);
+   }
+   tr.passIfNoException();
+
+   tr.test("round trip");
+   {
+      DynamicObject d = makeJsonTestDyno2();
+      d["types"]["int32"] = (int32_t)-70000;
+      d["types"]["uint32"] = (uint32_t)70000;
+      d["types"]["int64"] = (int64_t)INT64_MIN;
+      d["types"]["uint64"] = (uint64_t)UINT64_MAX;
+      d["types"]["double"] = 0.1;
+      d["deep"][0][0]["a"][0]["b"]->setType(Array);
+
+      ByteBuffer b;
+      ByteArrayOutputStream os(&b, true);
+      MessagePackWriter writer;
+      assertNoException(writer.write(d, &os));
+
+      DynamicObject out;
+      assertNoException(
+         MessagePackReader::readFromString(out, b.data(), b.length()));
+      assertNamedDynoCmp("expect", d, "result", out);
+      assert(out["types"]["int32"]->getType() == Int32);
+      assert(out["types"]["uint32"]->getType() == UInt32);
+      assert(out["types"]["int64"]->getType() == Int64);
+      assert(out["types"]["uint64"]->getType() == UInt64);
+      assert(out["types"]["double"]->getDouble() == 0.1);
+
+      // smaller than compact JSON
+      string json = JsonWriter::writeToString(d, true);
+      assert(b.length() < (int)json.length());
+   }
+   tr.passIfNoException();
+
+   tr.test("incremental");
+   {
+      DynamicObject d = makeJsonTestDyno2();
+      string data = MessagePackWriter::writeToString(d);
+
+      // write a byte at a time
+      DynamicObject out;
+      DynamicObjectOutputStream doos(out, new MessagePackReader(), true);
+      for(size_t i = 0; i < data.length(); ++i)
+      {
+         assertNoException(doos.write(data.c_str() + i, 1));
+      }
+      doos.close();
+      assertNoExceptionSet();
+      assertNamedDynoCmp("expect", d, "result", out);
+   }
+   tr.passIfNoException();
+
+   tr.test("binary");
+   {
+      // bin 8 and bin 16 with NULs in an array
+      DynamicObject out;
+      string data = hexToBytes("92c40461006200c5000300ff00");
+      assertNoException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+
+      DynamicObject expect;
+      expect[0]["length"] = (uint32_t)4;
+      expect[0]["base64"] = "YQBiAA==";
+      expect[1]["length"] = (uint32_t)3;
+      expect[1]["base64"] = "AP8A";
+      assertNamedDynoCmp("expect", expect, "result", out);
+   }
+   tr.passIfNoException();
+
+   tr.test("errors");
+   {
+      DynamicObject out;
+      string data = hexToBytes("c1");
+      assertException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+      assertExceptionSet();
+      assertStrCmp(Exception::get()->getType(),
+         "monarch.data.msgpack.MessagePackReader.InvalidType");
+      Exception::clear();
+
+      data = hexToBytes("810102");
+      assertException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+      assertStrCmp(Exception::get()->getType(),
+         "monarch.data.msgpack.MessagePackReader.InvalidKey");
+      Exception::clear();
+
+      data = hexToBytes("0102");
+      assertException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+      assertStrCmp(Exception::get()->getType(),
+         "monarch.data.msgpack.MessagePackReader.ExtraData");
+      Exception::clear();
+
+      data = hexToBytes("92a3616263a4");
+      assertException(
+         MessagePackReader::readFromString(out, data.c_str(), data.length()));
+      assertStrCmp(Exception::get()->getType(),
+         "monarch.data.msgpack.MessagePackReader.ParseError");
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runMappedDocumentTest(TestRunner& tr)
+{
+   tr.group("MappedDocument");
+
+   tr.test("round trip");
+   {
+      DynamicObject d = makeJsonTestDyno2();
+      d["types"]["null"].setNull();
+      d["types"]["true"] = true;
+      d["types"]["int32"] = (int32_t)-70000;
+      d["types"]["uint32"] = (uint32_t)70000;
+      d["types"]["int64"] = (int64_t)INT64_MIN;
+      d["types"]["uint64"] = (uint64_t)UINT64_MAX;
+      d["types"]["double"] = 0.1;
+      d["empty"]->setType(Map);
+
+      ByteBuffer b;
+      ByteArrayOutputStream os(&b, true);
+      MappedDocumentWriter writer;
+      assertNoException(writer.write(d, &os));
+
+      MappedDocument doc;
+      assertNoException(doc.open(b.data(), b.length()));
+      assert(doc.getSize() == (uint32_t)b.length());
+      MappedValue root = doc.getRoot();
+      assert(root.getType() == Map);
+      assert(root.length() == d->length());
+
+      MappedValue types = root["types"];
+      assert(types["null"].isNull());
+      assert(types["true"].getBoolean());
+      assert(types["int32"].getType() == Int32);
+      assert(types["int32"].getInt32() == -70000);
+      assert(types["uint32"].getType() == UInt32);
+      assert(types["uint32"].getUInt32() == 70000);
+      assert(types["int64"].getInt64() == INT64_MIN);
+      assert(types["uint64"].getUInt64() == UINT64_MAX);
+      assert(types["double"].getDouble() == 0.1);
+      assert(root["empty"].getType() == Map);
+      assert(root["empty"].length() == 0);
+
+      DynamicObject out = root.toDynamicObject();
+      assertNamedDynoCmp("expect", d, "result", out);
+   }
+   tr.passIfNoException();
+
+   tr.test("lookup");
+   {
+      DynamicObject d;
+      for(int i = 0; i < 100; ++i)
+      {
+         char name[10];
+         snprintf(name, 10, "m%d", i);
+         d[name] = i;
+      }
+      d["list"][2] = "third";
+      d["list"][0].setNull();
+      string data = MappedDocumentWriter::writeToString(d);
+
+      MappedDocument doc;
+      assertNoException(doc.open(data.c_str(), data.length()));
+      MappedValue root = doc.getRoot();
+      for(int i = 0; i < 100; ++i)
+      {
+         char name[10];
+         snprintf(name, 10, "m%d", i);
+         assert(root.hasMember(name));
+         assert(root[name].getInt32() == i);
+      }
+
+      // members are in name order
+      assertStrCmp(root.getName(0), "list");
+      assertStrCmp(root.getName(1), "m0");
+      assert(root[1].getInt32() == 0);
+      assert(root.getName(101) == NULL);
+
+      // missing values are null
+      assert(!root.hasMember("m100"));
+      assert(root["m100"].isNull());
+      assert(root["m1"]["x"].isNull());
+      assert(root["list"][0].isNull());
+      assertStrCmp(root["list"][2].getString(), "third");
+      assert(root["list"][3].isNull());
+      assert(root["list"][-1].isNull());
+      assertStrCmp(root["missing"].getString(), "");
+   }
+   tr.passIfNoException();
+
+   tr.test("shared values");
+   {
+      // repeated keys and values are stored once
+      DynamicObject one;
+      one->setType(Array);
+      DynamicObject many;
+      many->setType(Array);
+      for(int i = 0; i < 100; ++i)
+      {
+         DynamicObject item;
+         item["type"] = "http://example.com/vocab#Thing";
+         item["count"] = 1;
+         item["index"] = i;
+         many->append(item);
+         if(i == 0)
+         {
+            one->append(item);
+         }
+      }
+      string first = MappedDocumentWriter::writeToString(one);
+      string all = MappedDocumentWriter::writeToString(many);
+
+      // each new item only adds a map with 3 members, an array entry and
+      // its index, except index 1 which is the same as its count
+      assert(all.length() == first.length() + 99 * (32 + 4) + 98 * 8);
+
+      MappedDocument doc;
+      assertNoException(doc.open(all.c_str(), all.length()));
+      MappedValue root = doc.getRoot();
+      assert(root[0]["type"].getString() == root[99]["type"].getString());
+      assert(root[99]["index"].getInt32() == 99);
+   }
+   tr.passIfNoException();
+
+   tr.test("file");
+   {
+      DynamicObject d = makeJsonTestDyno2();
+      File file = File::createTempFile("mapped-document");
+      FileOutputStream fos(file);
+      MappedDocumentWriter writer;
+      assertNoException(writer.write(d, &fos));
+      fos.close();
+
+      MappedDocumentRef doc = new MappedDocument();
+      assertNoException(doc->open(file));
+      DynamicObject out = doc->getRoot().toDynamicObject();
+      assertNamedDynoCmp("expect", d, "result", out);
+      doc->close();
+      assert(doc->getRoot().isNull());
+      file->remove();
+   }
+   tr.passIfNoException();
+
+   tr.test("errors");
+   {
+      MappedDocument doc;
+      assertException(doc.open("MOMD", 4));
+      assertStrCmp(Exception::get()->getType(),
+         "monarch.data.mapped.MappedDocument.InvalidDocument");
+      Exception::clear();
+
+      DynamicObject d;
+      d["a"]["b"] = "c";
+      string data = MappedDocumentWriter::writeToString(d);
+      assertException(doc.open(data.c_str(), data.length() - 4));
+      Exception::clear();
+      assert(doc.getRoot().isNull());
+
+      // damaged offsets give null values, not reads outside the document
+      string bad = data;
+      bad[8] = (char)0xfc;
+      assertNoException(doc.open(bad.c_str(), bad.length()));
+      assert(doc.getRoot().isNull());
+      bad = data;
+      size_t map = MappedDocument::getUInt32(
+         (const unsigned char*)data.c_str(), 1);
+      bad[map + 4] = (char)0xff;
+      assertNoException(doc.open(bad.c_str(), bad.length()));
+      assert(doc.getRoot().getType() == Map);
+      assert(doc.getRoot().length() == 0);
+      assert(doc.getRoot()["a"].isNull());
+
+      // children that point at their container or its parent are null
+      d->clear();
+      d["list"][0] = 1;
+      d["map"]["x"] = 2;
+      data = MappedDocumentWriter::writeToString(d);
+      const unsigned char* ud = (const unsigned char*)data.c_str();
+      uint32_t root = MappedDocument::getUInt32(ud, 1);
+      uint32_t list = MappedDocument::getUInt32(ud + root, 2);
+      map = MappedDocument::getUInt32(ud + root, 4);
+      bad = data;
+      for(int i = 0; i < 4; ++i)
+      {
+         // the list element points at the root, the map value at the map
+         bad[list + 8 + i] = (char)(root >> (i * 8));
+         bad[map + 12 + i] = (char)(map >> (i * 8));
+      }
+      assertNoException(doc.open(bad.c_str(), bad.length()));
+      MappedValue r = doc.getRoot();
+      assert(r["list"].length() == 1);
+      assert(r["list"][0].isNull());
+      assert(r["map"].hasMember("x") == false);
+      assert(r["map"][0].isNull());
+      DynamicObject out = r.toDynamicObject();
+      DynamicObject expect;
+      expect["list"][0].setNull();
+      expect["map"]["x"].setNull();
+      assertNamedDynoCmp("expect", expect, "result", out);
+
+      // a key that points at its map is missing
+      for(int i = 0; i < 4; ++i)
+      {
+         bad[map + 8 + i] = (char)(map >> (i * 8));
+      }
+      assertNoException(doc.open(bad.c_str(), bad.length()));
+      assert(doc.getRoot()["map"].getName(0) == NULL);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runCharacterSetMutatorTest(TestRunner& tr)
 {
    tr.group("CharacterSetMutator");
@@ -1605,6 +2510,230 @@ static void runJsonReaderSpeedTest(TestRunner& tr)
    }
    tr.passIfNoException();
 
+   tr.test("large document");
+   {
+      // build a document of several MB with typical request data
+      string bio(200, 'x');
+      bio.append("\n\"quoted\" \xc3\xa4 \\ end");
+      DynamicObject in;
+      in->setType(Array);
+      for(int i = 0; i < 16384; ++i)
+      {
+         DynamicObject& item = in->append();
+         item["id"] = i;
+         item["name"]->format("user %d", i);
+         item["score"] = i * 0.25;
+         item["active"] = (i % 2 == 0);
+         item["bio"] = bio.c_str();
+         item["tags"]->append() = "alpha";
+         item["tags"]->append() = "beta";
+      }
+      string json = JsonWriter::writeToString(in);
+
+      Timer t;
+      t.start();
+      int runs = 10;
+      for(int i = 0; i < runs; ++i)
+      {
+         DynamicObject out;
+         assertNoException(
+            JsonReader::readFromString(out, json.c_str(), json.length()));
+         assert(out->length() == in->length());
+      }
+      double secs = t.getElapsedSeconds();
+      printf("%0.2f MB in %0.2f secs, %0.2f MB/s... ",
+         json.length() / 1048576.0, secs / runs,
+         json.length() * runs / 1048576.0 / secs);
+   }
+   tr.passIfNoException();
+
+   tr.test("long strings");
+   {
+      // build a document of several MB that is mostly string data
+      string text;
+      for(int i = 0; text.length() < 16384; ++i)
+      {
+         text.append("lorem ipsum dolor sit amet, ");
+         text.append((i % 16 == 0) ? "\"quoted\"\n" : "");
+      }
+      DynamicObject in;
+      in->setType(Array);
+      for(int i = 0; i < 256; ++i)
+      {
+         in->append() = text.c_str();
+      }
+      string json = JsonWriter::writeToString(in);
+
+      Timer t;
+      t.start();
+      int runs = 10;
+      for(int i = 0; i < runs; ++i)
+      {
+         DynamicObject out;
+         assertNoException(
+            JsonReader::readFromString(out, json.c_str(), json.length()));
+         assertStrCmp(out[255]->getString(), text.c_str());
+      }
+      double secs = t.getElapsedSeconds();
+      printf("%0.2f MB in %0.2f secs, %0.2f MB/s... ",
+         json.length() / 1048576.0, secs / runs,
+         json.length() * runs / 1048576.0 / secs);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Times writing a DynamicObject as JSON in unbuffered and buffered mode.
+ */
+static void timeJsonWriter(DynamicObject& dyno, int runs)
+{
+   for(int mode = 0; mode < 2; ++mode)
+   {
+      ByteBuffer b;
+      ByteArrayOutputStream os(&b, true);
+      JsonWriter jw;
+      jw.setBuffered(mode == 1);
+      Timer t;
+      t.start();
+      for(int i = 0; i < runs; ++i)
+      {
+         b.clear();
+         assertNoException(jw.write(dyno, &os));
+      }
+      double secs = t.getElapsedSeconds();
+      printf("%s %0.2f MB in %0.4f secs, %0.2f MB/s... ",
+         (mode == 1) ? "buffered" : "unbuffered",
+         b.length() / 1048576.0, secs / runs,
+         b.length() * runs / 1048576.0 / secs);
+   }
+}
+
+static void runJsonWriterSpeedTest(TestRunner& tr)
+{
+   tr.group("JsonWriter speed");
+
+   tr.test("wide document");
+   {
+      // many small objects with typical data
+      string bio(200, 'x');
+      bio.append("\n\"quoted\" \xc3\xa4 \\ end");
+      DynamicObject in;
+      in->setType(Array);
+      for(int i = 0; i < 16384; ++i)
+      {
+         DynamicObject& item = in->append();
+         item["id"] = i;
+         item["name"]->format("user %d", i);
+         item["score"] = i * 0.25;
+         item["active"] = (i % 2 == 0);
+         item["bio"] = bio.c_str();
+         item["tags"]->append() = "alpha";
+         item["tags"]->append() = "beta";
+      }
+      timeJsonWriter(in, 10);
+   }
+   tr.passIfNoException();
+
+   tr.test("deep document");
+   {
+      // nested arrays and objects
+      DynamicObject in;
+      DynamicObject* next = &in;
+      for(int i = 0; i < 1000; ++i)
+      {
+         (*next)["level"] = i;
+         (*next)["values"]->append() = i * 1000;
+         (*next)["values"]->append() = "value";
+         next = &(*next)["child"];
+      }
+      (*next)->setType(Map);
+      timeJsonWriter(in, 100);
+   }
+   tr.passIfNoException();
+
+   tr.test("long strings");
+   {
+      string text;
+      for(int i = 0; text.length() < 16384; ++i)
+      {
+         text.append("lorem ipsum dolor sit amet, ");
+         text.append((i % 16 == 0) ? "\"quoted\"\n" : "");
+      }
+      DynamicObject in;
+      in->setType(Array);
+      for(int i = 0; i < 256; ++i)
+      {
+         in->append() = text.c_str();
+      }
+      timeJsonWriter(in, 10);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runMessagePackSpeedTest(TestRunner& tr)
+{
+   tr.group("MessagePack speed");
+
+   tr.test("JSON vs MessagePack");
+   {
+      // many small objects with typical data
+      DynamicObject in;
+      in->setType(Array);
+      for(int i = 0; i < 16384; ++i)
+      {
+         DynamicObject& item = in->append();
+         item["id"] = (uint64_t)i * 1000003;
+         item["name"]->format("user %d", i);
+         item["score"] = i * 0.25;
+         item["active"] = (i % 2 == 0);
+         item["bio"] = "Lorem ipsum dolor sit amet, consectetur adipisicing.";
+         item["tags"]->append() = "alpha";
+         item["tags"]->append() = "beta";
+      }
+
+      int runs = 10;
+      string json = JsonWriter::writeToString(in, true);
+      string data = MessagePackWriter::writeToString(in);
+      printf("JSON %d bytes, MessagePack %d bytes... ",
+         (int)json.length(), (int)data.length());
+
+      Timer t;
+      t.start();
+      for(int i = 0; i < runs; ++i)
+      {
+         json = JsonWriter::writeToString(in, true);
+      }
+      printf("JSON write %0.4f secs, ", t.getElapsedSeconds() / runs);
+      t.start();
+      for(int i = 0; i < runs; ++i)
+      {
+         data = MessagePackWriter::writeToString(in);
+      }
+      printf("MessagePack write %0.4f secs... ", t.getElapsedSeconds() / runs);
+
+      t.start();
+      for(int i = 0; i < runs; ++i)
+      {
+         DynamicObject out;
+         assertNoException(
+            JsonReader::readFromString(out, json.c_str(), json.length()));
+      }
+      printf("JSON read %0.4f secs, ", t.getElapsedSeconds() / runs);
+      t.start();
+      for(int i = 0; i < runs; ++i)
+      {
+         DynamicObject out;
+         assertNoException(MessagePackReader::readFromString(
+            out, data.c_str(), data.length()));
+      }
+      printf("MessagePack read %0.4f secs... ", t.getElapsedSeconds() / runs);
+   }
+   tr.passIfNoException();
+
    tr.ungroup();
 }
 
@@ -1614,11 +2743,17 @@ static bool run(TestRunner& tr)
    {
       runJsonValidTest(tr);
       runJsonInvalidTest(tr);
+      runJsonReaderRunsTest(tr);
+      runJsonHandlerTest(tr);
       runJsonDJDTest(tr);
       runJsonInvalidDJTest(tr);
       runJsonVerifyDJDTest(tr);
       runJsonValueVerifyJDTest(tr);
       runJsonIOStreamTest(tr);
+      runJsonStreamWriterTest(tr);
+      runJsonWriterBufferedTest(tr);
+      runMessagePackTest(tr);
+      runMappedDocumentTest(tr);
 
       runXmlReaderTest(tr);
       runXmlWriterTest(tr);
@@ -1642,6 +2777,14 @@ static bool run(TestRunner& tr)
    {
       runJsonReaderSpeedTest(tr);
    }
+   if(tr.isTestEnabled("json-writer-speed"))
+   {
+      runJsonWriterSpeedTest(tr);
+   }
+   if(tr.isTestEnabled("msgpack-speed"))
+   {
+      runMessagePackSpeedTest(tr);
+   }
    return true;
 }
 
@@ -1,18 +1,27 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_FORMAT_MACROS
 
+#include "monarch/data/json/JsonWriter.h"
 #include "monarch/io/ByteArrayInputStream.h"
+#include "monarch/io/ByteArrayOutputStream.h"
 #include "monarch/io/File.h"
 #include "monarch/io/FileInputStream.h"
 #include "monarch/io/FileOutputStream.h"
 #include "monarch/io/FileList.h"
+#include "monarch/http/HttpAsyncClient.h"
 #include "monarch/http/CookieJar.h"
+#include "monarch/http/HpackDecoder.h"
+#include "monarch/http/HpackEncoder.h"
+#include "monarch/http/HpackHuffmanCodec.h"
+#include "monarch/http/Http2Frame.h"
 #include "monarch/http/HttpHeader.h"
 #include "monarch/http/HttpRequest.h"
 #include "monarch/http/HttpResponse.h"
+#include "monarch/http/HttpConnectionPool.h"
 #include "monarch/http/HttpConnectionServicer.h"
+#include "monarch/http/HttpRequestRouter.h"
 #include "monarch/http/HttpRequestServicer.h"
 #include "monarch/http/HttpClient.h"
 #include "monarch/modest/Kernel.h"
@@ -22,10 +31,14 @@
 #include "monarch/net/SslSocketDataPresenter.h"
 #include "monarch/net/TcpSocket.h"
 #include "monarch/rt/System.h"
+#include "monarch/rt/Thread.h"
 #include "monarch/rt/DynamicObject.h"
 #include "monarch/rt/DynamicObjectIterator.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/RunnableDelegate.h"
 #include "monarch/test/Test.h"
 #include "monarch/test/TestModule.h"
+#include "monarch/util/Convert.h"
 #include "monarch/util/Date.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/util/Url.h"
@@ -487,6 +500,105 @@ static void runCookieTest(TestRunner& tr)
    tr.ungroup();
 }
 
+static void runHpackTest(TestRunner& tr)
+{
+   tr.group("HPACK");
+
+   tr.test("Huffman");
+   {
+      // RFC 7541 C.4.1
+      string encoded;
+      HpackHuffmanCodec::encode("www.example.com", 15, encoded);
+      assertStrCmp(
+         Convert::bytesToHex(encoded.data(), encoded.length()).c_str(),
+         "f1e3c2e5f23a6ba0ab90f4ff");
+
+      string decoded;
+      assert(HpackHuffmanCodec::decode(
+         encoded.data(), encoded.length(), decoded));
+      assertStrCmp(decoded.c_str(), "www.example.com");
+   }
+   tr.passIfNoException();
+
+   tr.test("decode");
+   {
+      // RFC 7541 C.4.1 and C.4.2
+      HpackDecoder decoder;
+      const char* hex[] = {
+         "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+         "828684be5886a8eb10649cbf"
+      };
+      char block[64];
+      unsigned int length;
+      HpackHeaderList fields;
+
+      Convert::hexToBytes(hex[0], strlen(hex[0]), block, length);
+      assert(decoder.decode(block, length, fields));
+      assert(fields.size() == 4);
+      assertStrCmp(fields[0].name.c_str(), ":method");
+      assertStrCmp(fields[0].value.c_str(), "GET");
+      assertStrCmp(fields[3].name.c_str(), ":authority");
+      assertStrCmp(fields[3].value.c_str(), "www.example.com");
+      assert(decoder.getTable().getSize() == 57);
+
+      fields.clear();
+      Convert::hexToBytes(hex[1], strlen(hex[1]), block, length);
+      assert(decoder.decode(block, length, fields));
+      assert(fields.size() == 5);
+      assertStrCmp(fields[3].value.c_str(), "www.example.com");
+      assertStrCmp(fields[4].name.c_str(), "cache-control");
+      assertStrCmp(fields[4].value.c_str(), "no-cache");
+      assert(decoder.getTable().getSize() == 110);
+   }
+   tr.passIfNoException();
+
+   tr.test("encode");
+   {
+      HpackEncoder encoder;
+      HpackHeaderList fields;
+      HpackHeaderField field;
+      field.name = ":method";
+      field.value = "GET";
+      fields.push_back(field);
+      field.name = ":scheme";
+      field.value = "http";
+      fields.push_back(field);
+      field.name = ":path";
+      field.value = "/";
+      fields.push_back(field);
+      field.name = ":authority";
+      field.value = "www.example.com";
+      fields.push_back(field);
+
+      // RFC 7541 C.4.1
+      string block;
+      encoder.encode(fields, block);
+      assertStrCmp(
+         Convert::bytesToHex(block.data(), block.length()).c_str(),
+         "828684418cf1e3c2e5f23a6ba0ab90f4ff");
+
+      // round trip with a decoder
+      HpackDecoder decoder;
+      HpackHeaderList decoded;
+      assert(decoder.decode(block.data(), block.length(), decoded));
+      assert(decoded.size() == 4);
+      assertStrCmp(decoded[2].value.c_str(), "/");
+   }
+   tr.passIfNoException();
+
+   tr.test("invalid padding");
+   {
+      // Huffman string padded with a zero bit is invalid
+      HpackDecoder decoder;
+      HpackHeaderList fields;
+      const char block[] = {0x40, (char)0x81, (char)0xfe, 0x00};
+      assert(!decoder.decode(block, 4, fields));
+   }
+   tr.passIfException();
+
+   tr.ungroup();
+}
+
 class TestHttpRequestServicer : public HttpRequestServicer
 {
 public:
@@ -517,6 +629,88 @@ public:
    }
 };
 
+static void runHttpRequestRouterTest(TestRunner& tr)
+{
+   tr.group("HttpRequestRouter");
+
+   TestHttpRequestServicer root("/");
+   TestHttpRequestServicer api("/api");
+   TestHttpRequestServicer apiUsers("/api/v1/users");
+   TestHttpRequestServicer apiGroups("/api/v1/groups");
+   TestHttpRequestServicer apiV2("/api/v2");
+   TestHttpRequestServicer wwwStatic("/static");
+   TestHttpRequestServicer sub("/sub");
+   TestHttpRequestServicer pattern("/pattern");
+   TestHttpRequestServicer secure("/secure");
+
+   // add domains in priority order
+   HttpRequestRouter router;
+   PatternRef regex;
+   regex = Pattern::compile("^www\\.example\\.com$", true, false);
+   int www = router.addDomain("www.example.com", regex);
+   regex = Pattern::compile("^.*\\.www\\.example\\.com$", true, false);
+   int subWww = router.addDomain("*.www.example.com", regex);
+   regex = Pattern::compile("^.*\\.example\\.com$", true, false);
+   int subExample = router.addDomain("*.example.com", regex);
+   regex = Pattern::compile("^example\\..*$", true, false);
+   int examplePattern = router.addDomain("example.*", regex);
+   regex = Pattern::compile("^.*$", true, false);
+   int all = router.addDomain("*", regex);
+
+   router.addServicer(www, wwwStatic.getPath(), &wwwStatic, false);
+   router.addServicer(subWww, sub.getPath(), &sub, false);
+   router.addServicer(subExample, apiV2.getPath(), &apiV2, false);
+   router.addServicer(examplePattern, pattern.getPath(), &pattern, false);
+   router.addServicer(all, apiUsers.getPath(), &apiUsers, false);
+   router.addServicer(all, api.getPath(), &api, false);
+   router.addServicer(all, apiGroups.getPath(), &apiGroups, false);
+   router.addServicer(all, root.getPath(), &root, false);
+   router.addServicer(all, secure.getPath(), &secure, true);
+
+   tr.test("paths");
+   {
+      assert(router.find("localhost", "/", false) == &root);
+      assert(router.find("localhost", "/foo/bar", false) == &root);
+      assert(router.find("localhost", "/api", false) == &api);
+      assert(router.find("localhost", "/api/v1", false) == &api);
+      assert(router.find("localhost", "/api/v1/users", false) == &apiUsers);
+      assert(router.find("localhost", "/api/v1/users/1", false) == &apiUsers);
+      assert(router.find("localhost", "/api/v1/groups/a", false) ==
+         &apiGroups);
+      assert(router.find("localhost", "/api/v1/user", false) == &api);
+      assert(router.find("localhost", "/api/v1/usersx", false) == &api);
+      assert(router.find("localhost", "/apix", false) == &root);
+      assert(router.find("localhost", "/secure/a", false) == &root);
+   }
+   tr.passIfNoException();
+
+   tr.test("secure");
+   {
+      assert(router.find("localhost", "/secure/a", true) == &secure);
+      assert(router.find("localhost", "/", true) == NULL);
+   }
+   tr.passIfNoException();
+
+   tr.test("domains");
+   {
+      assert(router.find("www.example.com", "/static/a.js", false) ==
+         &wwwStatic);
+      assert(router.find("www.example.com", "/api", false) == &api);
+      assert(router.find("a.www.example.com", "/sub", false) == &sub);
+      assert(router.find("a.www.example.com", "/api/v2/x", false) == &apiV2);
+      assert(router.find("b.example.com", "/api/v2", false) == &apiV2);
+      assert(router.find("b.example.com", "/api/v1", false) == &api);
+      assert(router.find(".example.com", "/api/v2", false) == &apiV2);
+      assert(router.find("example.com", "/api/v2", false) == &api);
+      assert(router.find("example.org", "/pattern", false) == &pattern);
+      assert(router.find("WWW.example.com", "/static", false) == &root);
+      assert(router.find("", "/api", false) == &api);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runHttpServerTest(TestRunner& tr)
 {
    tr.test("Http Server");
@@ -991,6 +1185,750 @@ static void runPingTest(TestRunner& tr)
    tr.passIfNoException();
 }
 
+class EchoHttpRequestServicer : public HttpRequestServicer
+{
+public:
+   EchoHttpRequestServicer(const char* path) : HttpRequestServicer(path)
+   {
+   }
+
+   virtual ~EchoHttpRequestServicer()
+   {
+   }
+
+   virtual void serviceRequest(
+      HttpRequest* request, HttpResponse* response)
+   {
+      // echo the request body, or the path if there is no body
+      ByteBuffer body;
+      ByteArrayOutputStream baos(&body, true);
+      if(request->getHeader()->hasContent())
+      {
+         request->receiveBody(&baos);
+      }
+      else
+      {
+         const char* path = request->getHeader()->getPath();
+         baos.write(path, strlen(path));
+      }
+
+      // send 200 OK
+      ByteArrayInputStream bais(body.data(), body.length());
+      response->getHeader()->setStatus(200, "OK");
+      response->getHeader()->setField("Content-Type", "text/plain");
+      response->getHeader()->setField("Transfer-Encoding", "chunked");
+      response->sendHeader() && response->sendBody(&bais);
+   }
+};
+
+/**
+ * Writes an HTTP/2 HEADERS frame for a request.
+ */
+static bool _writeHttp2Request(
+   HpackEncoder& encoder, OutputStream* os, uint32_t streamId,
+   const char* method, const char* path, bool endStream)
+{
+   HpackHeaderList fields;
+   HpackHeaderField field;
+   field.name = ":method";
+   field.value = method;
+   fields.push_back(field);
+   field.name = ":scheme";
+   field.value = "http";
+   fields.push_back(field);
+   field.name = ":path";
+   field.value = path;
+   fields.push_back(field);
+   field.name = ":authority";
+   field.value = "localhost";
+   fields.push_back(field);
+
+   string block;
+   encoder.encode(fields, block);
+   Http2Frame frame(
+      Http2Frame::Headers,
+      Http2Frame::FlagEndHeaders | (endStream ? Http2Frame::FlagEndStream : 0),
+      streamId);
+   frame.getPayload()->put(block.data(), block.length(), true);
+   return frame.write(os);
+}
+
+static void runHttp2Test(TestRunner& tr)
+{
+   tr.group("HTTP/2");
+
+   // start a kernel
+   Kernel k;
+   k.getEngine()->start();
+
+   // create server with HTTP/2 enabled
+   Server server;
+   InternetAddress address("0.0.0.0", 19124);
+   HttpConnectionServicer hcs;
+   hcs.setHttp2Enabled(true);
+   server.addConnectionService(&address, &hcs);
+   EchoHttpRequestServicer echo("/echo");
+   hcs.addRequestServicer(&echo, false);
+   assert(server.start(&k));
+
+   tr.test("multiplexed streams");
+   {
+      // connect with prior knowledge
+      InternetAddress serverAddress("127.0.0.1", 19124);
+      TcpSocket* socket = new TcpSocket();
+      assertNoException(socket->connect(&serverAddress));
+      Connection c(socket, true);
+      c.setReadTimeout(10000);
+      ConnectionOutputStream* os = c.getOutputStream();
+      ConnectionInputStream* is = c.getInputStream();
+
+      // send preface and empty settings
+      Http2Frame settings(Http2Frame::Settings);
+      assert(os->write(
+         Http2Frame::sConnectionPreface,
+         Http2Frame::sConnectionPrefaceLength));
+      assert(settings.write(os));
+
+      // open three streams before reading any response, interleaving the
+      // request body for stream 3 with the other requests
+      HpackEncoder encoder;
+      const char* post = "posted body";
+      Http2Frame data(Http2Frame::Data, 0, 3);
+      data.getPayload()->put(post, 6, true);
+      assert(_writeHttp2Request(encoder, os, 1, "GET", "/echo/one", true));
+      assert(_writeHttp2Request(encoder, os, 3, "POST", "/echo", false));
+      assert(data.write(os));
+      assert(_writeHttp2Request(encoder, os, 5, "GET", "/missing", true));
+      data.getPayload()->clear();
+      data.getPayload()->put(post + 6, strlen(post) - 6, true);
+      data.setFlags(Http2Frame::FlagEndStream);
+      assert(data.write(os));
+      assert(os->flush());
+
+      // read frames until all streams have ended
+      HpackDecoder decoder;
+      map<uint32_t, string> status;
+      map<uint32_t, string> body;
+      int ended = 0;
+      bool gotSettings = false;
+      Http2Frame frame;
+      while(ended < 3 && frame.read(is, Http2Frame::sDefaultMaxFrameSize) > 0)
+      {
+         uint32_t id = frame.getStreamId();
+         ByteBuffer* payload = frame.getPayload();
+         if(frame.getType() == Http2Frame::Settings &&
+            !frame.hasFlag(Http2Frame::FlagAck))
+         {
+            gotSettings = true;
+            Http2Frame ack(Http2Frame::Settings, Http2Frame::FlagAck);
+            assert(ack.write(os) && os->flush());
+         }
+         else if(frame.getType() == Http2Frame::Headers)
+         {
+            HpackHeaderList fields;
+            assert(decoder.decode(
+               payload->data(), payload->length(), fields));
+            for(HpackHeaderList::iterator i = fields.begin();
+                i != fields.end(); ++i)
+            {
+               if(i->name == ":status")
+               {
+                  status[id] = i->value;
+               }
+               // connection-specific fields must not be sent
+               assert(i->name != "transfer-encoding");
+               assert(i->name != "connection");
+            }
+         }
+         else if(frame.getType() == Http2Frame::Data)
+         {
+            body[id].append(payload->data(), payload->length());
+         }
+         else if(frame.getType() == Http2Frame::RstStream)
+         {
+            assert(Http2Frame::getUInt32(payload->data()) ==
+               Http2Frame::NoError);
+         }
+
+         if(id != 0 && frame.hasFlag(Http2Frame::FlagEndStream) &&
+            (frame.getType() == Http2Frame::Headers ||
+             frame.getType() == Http2Frame::Data))
+         {
+            ++ended;
+         }
+      }
+      assertNoExceptionSet();
+      assert(gotSettings);
+      assert(ended == 3);
+      assertStrCmp(status[1].c_str(), "200");
+      assertStrCmp(body[1].c_str(), "/echo/one");
+      assertStrCmp(status[3].c_str(), "200");
+      assertStrCmp(body[3].c_str(), post);
+      assertStrCmp(status[5].c_str(), "404");
+
+      c.close();
+   }
+   tr.passIfNoException();
+
+   tr.test("HTTP/1.1 still serviced");
+   {
+      HttpClient client;
+      Url url("http://localhost:19124/echo/http1");
+      HttpResponse* response = client.get(&url);
+      assert(response != NULL);
+      assert(response->getHeader()->getStatusCode() == 200);
+      ByteBuffer body;
+      ByteArrayOutputStream baos(&body, true);
+      assert(client.receiveContent(&baos));
+      body.putByte(0, 1, true);
+      assertStrCmp(body.data(), "/echo/http1");
+      client.disconnect();
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
+/**
+ * Sends a GET request over a connection and receives the response.
+ */
+static bool _pooledGet(HttpConnection* conn, const char* path, bool close)
+{
+   HttpRequest* request = conn->createRequest();
+   HttpResponse* response = request->createResponse();
+   HttpRequestHeader* reqHeader = request->getHeader();
+   reqHeader->setMethod("GET");
+   reqHeader->setPath(path);
+   reqHeader->setVersion("HTTP/1.1");
+   reqHeader->setField("Host", "localhost");
+   reqHeader->setField("Connection", close ? "close" : "keep-alive");
+
+   ByteBuffer body;
+   ByteArrayOutputStream baos(&body, true);
+   bool rval =
+      request->sendHeader() &&
+      response->receiveHeader() &&
+      response->receiveBody(&baos);
+   rval = rval &&
+      response->getHeader()->getStatusCode() == 200 &&
+      body.length() == (int)strlen(path) &&
+      strncmp(body.data(), path, body.length()) == 0;
+
+   delete response;
+   delete request;
+
+   return rval;
+}
+
+/**
+ * Checks a connection in to a pool after a short delay.
+ */
+class DelayedCheckin : public Runnable
+{
+public:
+   HttpConnectionPool* mPool;
+   Url* mUrl;
+   HttpConnectionRef mConnection;
+   DelayedCheckin(HttpConnectionPool* pool, Url* url, HttpConnectionRef& conn) :
+      mPool(pool),
+      mUrl(url),
+      mConnection(conn)
+   {
+   }
+
+   virtual ~DelayedCheckin()
+   {
+   }
+
+   virtual void run()
+   {
+      Thread::sleep(50);
+      mPool->checkinConnection(mUrl, mConnection, true);
+   }
+};
+
+static void runHttpConnectionPoolTest(TestRunner& tr)
+{
+   tr.group("HttpConnectionPool");
+
+   // start a kernel
+   Kernel k;
+   k.getEngine()->start();
+
+   // create server
+   Server server;
+   InternetAddress address("0.0.0.0", 19125);
+   HttpConnectionServicer hcs;
+   server.addConnectionService(&address, &hcs);
+   EchoHttpRequestServicer echo("/echo");
+   hcs.addRequestServicer(&echo, false);
+   assert(server.start(&k));
+
+   Url url("http://127.0.0.1:19125/echo");
+
+   tr.test("checkout and reuse");
+   {
+      HttpConnectionPool pool;
+
+      // nothing idle, permission to create a connection
+      HttpConnectionRef conn(NULL);
+      assertNoException(pool.checkoutConnection(&url, conn));
+      assert(conn.isNull());
+      assert(pool.getActiveConnectionCount(&url) == 1);
+      conn = HttpClient::createConnection(&url);
+      assert(!conn.isNull());
+      assert(_pooledGet(&(*conn), "/echo/1", false));
+      HttpConnection* first = &(*conn);
+      pool.checkinConnection(&url, conn, true);
+      assert(pool.getActiveConnectionCount(&url) == 0);
+      assert(pool.getIdleConnectionCount(&url) == 1);
+
+      // idle connection is reused
+      conn.setNull();
+      assertNoException(pool.checkoutConnection(&url, conn));
+      assert(&(*conn) == first);
+      assert(_pooledGet(&(*conn), "/echo/2", false));
+      pool.checkinConnection(&url, conn, true);
+   }
+   tr.passIfNoException();
+
+   tr.test("liveness check");
+   {
+      HttpConnectionPool pool;
+
+      // have the server close the connection after responding
+      HttpConnectionRef conn = HttpClient::createConnection(&url);
+      assert(!conn.isNull());
+      assert(_pooledGet(&(*conn), "/echo/close", true));
+      Thread::sleep(50);
+      pool.addConnection(&url, conn);
+      assert(pool.getIdleConnectionCount(&url) == 1);
+
+      // closed connection is detected and dropped
+      conn.setNull();
+      assertNoException(pool.checkoutConnection(&url, conn));
+      assert(conn.isNull());
+      assert(pool.getIdleConnectionCount(&url) == 0);
+      pool.checkinConnection(&url, conn, false);
+   }
+   tr.passIfNoException();
+
+   tr.test("max idle and idle timeout");
+   {
+      HttpConnectionPool pool;
+      pool.setMaxIdleConnections(2);
+      for(int i = 0; i < 3; ++i)
+      {
+         HttpConnectionRef conn = HttpClient::createConnection(&url);
+         assert(!conn.isNull());
+         pool.addConnection(&url, conn);
+      }
+      assert(pool.getIdleConnectionCount(&url) == 2);
+
+      // reaper closes expired connections
+      pool.setIdleTimeout(10);
+      pool.startReaper(20);
+      for(int i = 0; i < 50 && pool.getIdleConnectionCount(&url) > 0; ++i)
+      {
+         Thread::sleep(10);
+      }
+      assert(pool.getIdleConnectionCount(&url) == 0);
+      pool.stopReaper();
+   }
+   tr.passIfNoException();
+
+   tr.test("reuse rules");
+   {
+      // only a length or a last transfer coding of chunked ends a body
+      HttpResponseHeader header;
+      header.setVersion("HTTP/1.1");
+      assert(!HttpConnectionPool::isBodyDelimited(&header));
+      header.setField("Transfer-Encoding", "chunked");
+      assert(HttpConnectionPool::isBodyDelimited(&header));
+      header.setField("Transfer-Encoding", "gzip, Chunked");
+      assert(HttpConnectionPool::isBodyDelimited(&header));
+      header.setField("Transfer-Encoding", "gzip");
+      assert(!HttpConnectionPool::isBodyDelimited(&header));
+      header.setField("Transfer-Encoding", "chunked, gzip");
+      assert(!HttpConnectionPool::isBodyDelimited(&header));
+      header.setField("Content-Length", 10);
+      assert(HttpConnectionPool::isBodyDelimited(&header));
+
+      assert(HttpConnectionPool::isKeepAlive(&header));
+      header.setField("Connection", "close");
+      assert(!HttpConnectionPool::isKeepAlive(&header));
+      header.removeField("Connection");
+      header.setVersion("HTTP/1.0");
+      assert(!HttpConnectionPool::isKeepAlive(&header));
+
+      assert(HttpConnectionPool::isRetryable("GET", false));
+      assert(!HttpConnectionPool::isRetryable("PUT", true));
+      assert(!HttpConnectionPool::isRetryable("POST", false));
+   }
+   tr.passIfNoException();
+
+   tr.test("max connections");
+   {
+      HttpConnectionPool pool;
+      pool.setMaxConnections(1);
+      pool.setWaitTimeout(20);
+
+      HttpConnectionRef conn(NULL);
+      assertNoException(pool.checkoutConnection(&url, conn));
+      conn = HttpClient::createConnection(&url);
+      assert(!conn.isNull());
+
+      // second checkout times out
+      HttpConnectionRef conn2(NULL);
+      assertException(pool.checkoutConnection(&url, conn2));
+      assertStrCmp(
+         Exception::get()->getType(),
+         "monarch.http.HttpConnectionPool.Timeout");
+      Exception::clear();
+
+      // a shorter timeout from the caller, such as a deadline, wins
+      pool.setWaitTimeout(5000);
+      uint64_t start = System::getCurrentMilliseconds();
+      assertException(pool.checkoutConnection(&url, conn2, NULL, 20));
+      assert(System::getCurrentMilliseconds() - start < 2000);
+      assert(Exception::get()->getDetails()["timeout"]->getUInt32() == 20);
+      Exception::clear();
+
+      // second checkout gets the connection once it is checked in
+      pool.setWaitTimeout(5000);
+      DelayedCheckin checkin(&pool, &url, conn);
+      Thread t(&checkin);
+      t.start();
+      assertNoException(pool.checkoutConnection(&url, conn2));
+      assert(&(*conn2) == &(*conn));
+      t.join();
+      pool.checkinConnection(&url, conn2, false);
+      assert(pool.getActiveConnectionCount(&url) == 0);
+      assert(pool.getIdleConnectionCount(&url) == 0);
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
+/**
+ * Responds to requests after a delay.
+ */
+class SlowHttpRequestServicer : public HttpRequestServicer
+{
+public:
+   SlowHttpRequestServicer(const char* path) : HttpRequestServicer(path)
+   {
+   }
+
+   virtual ~SlowHttpRequestServicer()
+   {
+   }
+
+   virtual void serviceRequest(
+      HttpRequest* request, HttpResponse* response)
+   {
+      Thread::sleep(500);
+      response->getHeader()->setStatus(204, "No Content");
+      response->sendHeader();
+   }
+};
+
+/**
+ * Counts the requests that have finished.
+ */
+class RequestCounter : public Runnable
+{
+public:
+   ExclusiveLock mLock;
+   int mCount;
+   RequestCounter() :
+      mCount(0)
+   {
+   }
+
+   virtual ~RequestCounter()
+   {
+   }
+
+   virtual void run()
+   {
+      mLock.lock();
+      ++mCount;
+      mLock.unlock();
+   }
+
+   int getCount()
+   {
+      int rval;
+      mLock.lock();
+      rval = mCount;
+      mLock.unlock();
+      return rval;
+   }
+};
+
+static void runHttpAsyncClientTest(TestRunner& tr)
+{
+   tr.group("HttpAsyncClient");
+
+   // start a kernel
+   Kernel k;
+   k.getEngine()->start();
+
+   // create server
+   Server server;
+   InternetAddress address("0.0.0.0", 19126);
+   HttpConnectionServicer hcs;
+   server.addConnectionService(&address, &hcs);
+   EchoHttpRequestServicer echo("/echo");
+   SlowHttpRequestServicer slow("/slow");
+   hcs.addRequestServicer(&echo, false);
+   hcs.addRequestServicer(&slow, false);
+   assert(server.start(&k));
+
+   tr.test("fan out");
+   {
+      HttpAsyncClient client(4);
+      RequestCounter* counter = new RequestCounter;
+      RunnableRef callback = counter;
+
+      // fan out more requests than there are client threads
+      HttpAsyncRequestList requests;
+      for(int i = 0; i < 20; ++i)
+      {
+         Url url;
+         url.format("http://127.0.0.1:19126/echo/%d", i);
+         HttpAsyncRequestRef request = new HttpAsyncRequest("GET", &url);
+         request->setCallback(callback);
+         client.submit(request);
+         requests.push_back(request);
+      }
+      assertNoException(client.waitAll(requests, 10000));
+
+      int i = 0;
+      for(HttpAsyncRequestList::iterator ri = requests.begin();
+          ri != requests.end(); ++ri, ++i)
+      {
+         char expect[20];
+         snprintf(expect, 20, "/echo/%d", i);
+         assert((*ri)->getState() == HttpAsyncRequest::Completed);
+         assert((*ri)->getStatusCode() == 200);
+         assertStrCmp((*ri)->getResponseBody().c_str(), expect);
+      }
+
+      // callbacks run just after requests finish
+      for(int n = 0; n < 100 && counter->getCount() < 20; ++n)
+      {
+         Thread::sleep(10);
+      }
+      assert(counter->getCount() == 20);
+
+      // connections were reused
+      assert(client.getConnectionPool()->getIdleConnectionCount(
+         requests[0]->getUrl()) > 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("post");
+   {
+      HttpAsyncClient client(2);
+      Url url("http://127.0.0.1:19126/echo");
+      HttpAsyncRequestRef request = client.post(&url, NULL, "data", 4);
+      assert(request->wait());
+      assert(request->getState() == HttpAsyncRequest::Completed);
+      assertStrCmp(request->getResponseBody().c_str(), "data");
+   }
+   tr.passIfNoException();
+
+   tr.test("per-request timeout");
+   {
+      HttpAsyncClient client(2);
+      Url url("http://127.0.0.1:19126/slow");
+      HttpAsyncRequestRef request = client.get(&url, NULL, 100);
+      assert(request->wait());
+      assert(request->getState() == HttpAsyncRequest::TimedOut);
+      assertStrCmp(
+         request->getException()->getType(), "monarch.http.RequestTimeout");
+   }
+   tr.passIfNoException();
+
+   tr.test("overall deadline");
+   {
+      HttpAsyncClient client(2);
+      Url fast("http://127.0.0.1:19126/echo/fast");
+      Url slowUrl("http://127.0.0.1:19126/slow");
+      HttpAsyncRequestList requests;
+      requests.push_back(client.get(&fast));
+      requests.push_back(client.get(&slowUrl));
+      uint64_t start = System::getCurrentMilliseconds();
+      assertException(client.waitAll(requests, 100));
+      assertStrCmp(
+         Exception::get()->getType(), "monarch.http.RequestTimeout");
+      Exception::clear();
+      assert(System::getCurrentMilliseconds() - start < 400);
+      assert(requests[0]->getState() == HttpAsyncRequest::Completed);
+      assert(requests[1]->getState() == HttpAsyncRequest::TimedOut);
+   }
+   tr.passIfNoException();
+
+   tr.test("cancel and failure");
+   {
+      HttpAsyncClient client(1);
+      Url slowUrl("http://127.0.0.1:19126/slow");
+      HttpAsyncRequestRef request = client.get(&slowUrl);
+      assert(request->cancel());
+      assert(request->isFinished());
+      assert(request->getState() == HttpAsyncRequest::Cancelled);
+      assert(!request->cancel());
+
+      // nothing is listening on this port
+      Url bad("http://127.0.0.1:19127/");
+      request = client.get(&bad);
+      assert(request->wait());
+      assert(request->getState() == HttpAsyncRequest::Failed);
+      assertStrCmp(
+         request->getException()->getType(), "monarch.http.RequestFailed");
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
+/**
+ * Records a request latency for a route, for connection monitor tests.
+ *
+ * @param monitor the HttpConnectionMonitor.
+ */
+static void _recordThreadLatency(void* monitor)
+{
+   static_cast<HttpConnectionMonitor*>(monitor)->recordLatency(
+      "/thread", HttpConnectionMonitor::RequestTime, 1000);
+}
+
+static void runHttpConnectionMonitorTest(TestRunner& tr)
+{
+   tr.group("HttpConnectionMonitor");
+
+   // start a kernel
+   Kernel k;
+   k.getEngine()->start();
+
+   // create server with a connection monitor
+   Server server;
+   InternetAddress address("0.0.0.0", 19128);
+   HttpConnectionServicer hcs;
+   HttpConnectionMonitorRef monitor = new HttpConnectionMonitor;
+   hcs.setConnectionMonitor(monitor);
+   server.addConnectionService(&address, &hcs);
+   EchoHttpRequestServicer echo("/echo");
+   hcs.addRequestServicer(&echo, false);
+   assert(server.start(&k));
+
+   tr.test("latency stats");
+   {
+      HttpAsyncClient client(4);
+      HttpAsyncRequestList requests;
+      for(int i = 0; i < 10; ++i)
+      {
+         Url url;
+         url.format("http://127.0.0.1:19128/echo/%d", i);
+         requests.push_back(client.get(&url));
+      }
+      Url missing("http://127.0.0.1:19128/missing");
+      requests.push_back(client.get(&missing));
+      assertNoException(client.waitAll(requests, 10000));
+
+      // requests are recorded just after their responses are sent
+      DynamicObject stats = monitor->getStats();
+      for(int n = 0; n < 100 &&
+          stats["latency"]["request"]["count"]->getUInt64() < 11; ++n)
+      {
+         Thread::sleep(10);
+         stats = monitor->getStats();
+      }
+
+      DynamicObject& all = stats["latency"];
+      assert(all["request"]["count"]->getUInt64() == 11);
+      assert(all["header"]["count"]->getUInt64() == 11);
+      assert(all["handler"]["count"]->getUInt64() == 11);
+      assert(all["send"]["count"]->getUInt64() == 11);
+      assert(all["request"]["p50"]->getUInt64() <=
+         all["request"]["p99"]->getUInt64());
+      assert(all["request"]["p999"]->getUInt64() <=
+         all["request"]["max"]->getUInt64());
+
+      // only requests with a servicer have a route
+      assert(stats["routes"]->length() == 1);
+      assert(stats["routes"]->hasMember("/echo"));
+      DynamicObject& route = stats["routes"]["/echo"];
+      assert(route["request"]["count"]->getUInt64() == 10);
+      assert(route["handler"]["min"]->getUInt64() <=
+         route["request"]["max"]->getUInt64());
+   }
+   tr.passIfNoException();
+
+   tr.test("exited threads");
+   {
+      // the histograms of exited threads are kept but their entries are not
+      HttpConnectionMonitor m;
+      RunnableRef r = new RunnableDelegate<void>(_recordThreadLatency, &m);
+      for(int round = 1; round <= 5; ++round)
+      {
+         Thread* threads[4];
+         for(int i = 0; i < 4; ++i)
+         {
+            threads[i] = new Thread(r);
+            threads[i]->start();
+         }
+         for(int i = 0; i < 4; ++i)
+         {
+            threads[i]->join();
+            delete threads[i];
+         }
+
+         DynamicObject stats = m.getStats();
+         assert(stats["latencyThreads"]->getUInt32() == 0);
+         assert(stats["routes"]["/thread"]["request"]["count"]->getUInt64() ==
+            (uint64_t)round * 4);
+      }
+   }
+   tr.passIfNoException();
+
+   tr.test("snapshot");
+   {
+      string snapshot;
+      monitor->getLatencySnapshot(snapshot);
+      assert(snapshot.compare(0, 4, "MOLH") == 0);
+
+      DynamicObject routes;
+      assertNoException(HttpConnectionMonitor::readLatencySnapshot(
+         snapshot.c_str(), snapshot.length(), routes));
+      assert(routes->length() == 2);
+      assert(routes[""]["request"]["count"]->getUInt64() == 1);
+      assertDynoCmp(routes["/echo"], monitor->getStats()["routes"]["/echo"]);
+
+      assertException(HttpConnectionMonitor::readLatencySnapshot(
+         snapshot.c_str(), snapshot.length() - 1, routes));
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
 static bool run(TestRunner& tr)
 {
    if(tr.isDefaultEnabled())
@@ -998,6 +1936,8 @@ static bool run(TestRunner& tr)
       runHttpHeaderTest(tr);
       runHttpNormalizePath(tr);
       runCookieTest(tr);
+      runHpackTest(tr);
+      runHttpRequestRouterTest(tr);
    }
    if(tr.isTestEnabled("http-server"))
    {
@@ -1023,6 +1963,22 @@ static bool run(TestRunner& tr)
    {
       runPingTest(tr);
    }
+   if(tr.isTestEnabled("http2"))
+   {
+      runHttp2Test(tr);
+   }
+   if(tr.isTestEnabled("http-connection-pool"))
+   {
+      runHttpConnectionPoolTest(tr);
+   }
+   if(tr.isTestEnabled("http-async-client"))
+   {
+      runHttpAsyncClientTest(tr);
+   }
+   if(tr.isTestEnabled("http-connection-monitor"))
+   {
+      runHttpConnectionMonitorTest(tr);
+   }
    return true;
 }
 
@@ -296,6 +296,21 @@ static void runByteBufferTest(TestRunner& tr)
    b.getByte(aByte);
    assert(aByte == 'T');
 
+   // reserve doubles the capacity and moves data in front of the offset
+   ByteBuffer r(4);
+   r.put("abcd", 4, false);
+   r.reserve(1);
+   assert(r.capacity() == 8);
+   r.clear(3);
+   r.reserve(7);
+   assert(r.capacity() == 8);
+   assert(r.data() == r.bytes());
+   memcpy(r.end(), "efghijk", 7);
+   r.extend(7);
+   assertStrCmp(string(r.data(), r.length()).c_str(), "defghijk");
+   r.reserve(9);
+   assert(r.capacity() == 17);
+
    tr.passIfNoException();
 }
 
@@ -8,10 +8,12 @@
 #define __STDC_CONSTANT_MACROS
 
 #include <cstdio>
+#include <cstring>
 
 #include "monarch/test/Test.h"
 #include "monarch/test/TestModule.h"
 #include "monarch/data/json/JsonLd.h"
+#include "monarch/data/json/JsonLdContextCache.h"
 #include "monarch/data/json/JsonReader.h"
 #include "monarch/data/json/JsonWriter.h"
 #include "monarch/logging/Logging.h"
@@ -19,6 +21,7 @@
 #include "monarch/io/FileInputStream.h"
 #include "monarch/io/FileList.h"
 #include "monarch/util/StringTools.h"
+#include "monarch/util/Timer.h"
 #include "monarch/validation/Validation.h"
 
 using namespace std;
@@ -611,6 +614,441 @@ static void runJsonLdTests(TestRunner& tr)
    tr.ungroup();
 }
 
+/**
+ * Creates a blank node with a property, for normalization tests.
+ *
+ * @param id the blank node's @id, NULL for none.
+ * @param property the property.
+ * @param value the string value of the property.
+ *
+ * @return the blank node.
+ */
+static DynamicObject _createNode(
+   const char* id, const char* property, const char* value)
+{
+   DynamicObject rval;
+   if(id != NULL)
+   {
+      rval["@id"] = id;
+   }
+   rval[property] = value;
+   return rval;
+}
+
+/**
+ * Creates a ring of blank nodes that each link to the next one, for
+ * normalization tests. The nodes are identical apart from their labels.
+ *
+ * @param ids the labels of the nodes in ring order.
+ * @param count the number of nodes.
+ *
+ * @return the nodes.
+ */
+static DynamicObject _createRing(const char** ids, int count)
+{
+   DynamicObject rval(Array);
+   for(int i = 0; i < count; ++i)
+   {
+      DynamicObject node;
+      node["@id"] = ids[i];
+      node["http://example.com/next"]["@id"] = ids[(i + 1) % count];
+      rval->append(node);
+   }
+   return rval;
+}
+
+static void runJsonLdNormalizeTests(TestRunner& tr)
+{
+   tr.group("JSON-LD normalize");
+
+   DynamicObject options;
+   options["format"] = "application/nquads";
+
+   tr.test("relabeled and reordered input");
+   {
+      // two people with addresses, with different labels and order
+      const char* name = "http://xmlns.com/foaf/0.1/name";
+      const char* knows = "http://xmlns.com/foaf/0.1/knows";
+      const char* city = "http://example.com/city";
+      DynamicObject inputs[2];
+      const char* labels[2][2] = {{"_:x", "_:y"}, {"_:q", "_:p"}};
+      for(int n = 0; n < 2; ++n)
+      {
+         // the second input lists the people in reverse order
+         inputs[n] = DynamicObject(Array);
+         for(int i = 0; i < 2; ++i)
+         {
+            int p = (n == 0) ? i : 1 - i;
+            DynamicObject person = _createNode(
+               labels[n][p], name, (p == 0) ? "Alice" : "Bob");
+            person[knows]["@id"] = labels[n][1 - p];
+            person["http://example.com/address"][city] = "Springfield";
+            inputs[n]->append(person);
+         }
+      }
+
+      DynamicObject out1;
+      DynamicObject out2;
+      assertNoException(JsonLd::normalize(inputs[0], options, out1));
+      assertNoException(JsonLd::normalize(inputs[1], options, out2));
+      assertNamedDynoCmp("first", out1, "second", out2);
+      assert(strstr(out1->getString(), "_:c14n3 ") != NULL);
+      assert(strstr(out1->getString(), "_:x") == NULL);
+   }
+   tr.passIfNoException();
+
+   tr.test("symmetric graph");
+   {
+      // rings that only differ by labels and the order of their nodes
+      const char* ids1[] = {"_:a", "_:b", "_:c", "_:d", "_:e", "_:f"};
+      const char* ids2[] = {"_:f", "_:d", "_:b", "_:e", "_:c", "_:a"};
+      DynamicObject out1;
+      DynamicObject out2;
+      assertNoException(JsonLd::normalize(_createRing(ids1, 6), options, out1));
+      assertNoException(JsonLd::normalize(_createRing(ids2, 6), options, out2));
+      assertNamedDynoCmp("first", out1, "second", out2);
+
+      // nodes are named by following the ring backwards
+      DynamicObject expect;
+      expect =
+         "_:c14n0 <http://example.com/next> _:c14n5 .\n"
+         "_:c14n1 <http://example.com/next> _:c14n0 .\n"
+         "_:c14n2 <http://example.com/next> _:c14n1 .\n"
+         "_:c14n3 <http://example.com/next> _:c14n2 .\n"
+         "_:c14n4 <http://example.com/next> _:c14n3 .\n"
+         "_:c14n5 <http://example.com/next> _:c14n4 .\n";
+      assertNamedDynoCmp("expect", expect, "output", out1);
+   }
+   tr.passIfNoException();
+
+   tr.test("statements output");
+   {
+      const char* ids[] = {"_:a", "_:b"};
+      DynamicObject opts;
+      DynamicObject output;
+      assertNoException(JsonLd::normalize(_createRing(ids, 2), opts, output));
+      assert(output->getType() == Array);
+      assert(output->length() == 2);
+      assertStrCmp(
+         output[0]["subject"]["nominalValue"]->getString(), "_:c14n0");
+      assertStrCmp(
+         output[0]["object"]["nominalValue"]->getString(), "_:c14n1");
+   }
+   tr.passIfNoException();
+
+   tr.test("permutation limit");
+   {
+      const char* ids[] = {"_:a", "_:b", "_:c", "_:d"};
+      DynamicObject opts = options.clone();
+      opts["maxPermutations"] = 2;
+      DynamicObject output;
+      assertException(JsonLd::normalize(_createRing(ids, 4), opts, output));
+      ExceptionRef e = Exception::get();
+      assertStrCmp(
+         e->getType(), "monarch.data.json.JsonLd.NormalizeLimitExceeded");
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runJsonLdNormalizeSpeedTest(TestRunner& tr)
+{
+   tr.group("JSON-LD normalize speed");
+
+   const char* value = "http://example.com/value";
+   const char* link = "http://example.com/link";
+   const char* kinds[] = {
+      "distinct", "similar children", "identical pairs", "identical trees"};
+   for(int kind = 0; kind < 4; ++kind)
+   {
+      for(int count = 10; count <= 10000; count *= 10)
+      {
+         tr.test(StringTools::format("%s, %d blank nodes",
+            kinds[kind], count).c_str());
+         {
+            DynamicObject input(Array);
+            if(kind == 0)
+            {
+               // a list of records with distinct values
+               for(int i = 0; i < count; ++i)
+               {
+                  DynamicObject node = _createNode(
+                     StringTools::format("_:r%d", i).c_str(), value,
+                     StringTools::format("%d", i).c_str());
+                  node[link]["@id"]->format("_:r%d", (i + 1) % count);
+                  input->append(node);
+               }
+            }
+            else if(kind == 1)
+            {
+               // parents with distinct values, each with 9 identical children
+               for(int i = 0; i < count / 10; ++i)
+               {
+                  DynamicObject node = _createNode(
+                     NULL, value, StringTools::format("%d", i).c_str());
+                  for(int c = 0; c < 9; ++c)
+                  {
+                     // labeled so that expansion keeps identical children
+                     DynamicObject child = _createNode(
+                        StringTools::format("_:c%d_%d", i, c).c_str(),
+                        value, "child");
+                     node[link]->append(child);
+                  }
+                  input->append(node);
+               }
+            }
+            else if(kind == 2)
+            {
+               // identical pairs of linked nodes
+               for(int i = 0; i < count / 2; ++i)
+               {
+                  DynamicObject node = _createNode(NULL, value, "a");
+                  node[link] = _createNode(NULL, value, "b");
+                  input->append(node);
+               }
+            }
+            else
+            {
+               // identical parents, each with 4 identical children
+               for(int i = 0; i < count / 5; ++i)
+               {
+                  DynamicObject node = _createNode(NULL, value, "parent");
+                  for(int c = 0; c < 4; ++c)
+                  {
+                     DynamicObject child = _createNode(
+                        StringTools::format("_:c%d_%d", i, c).c_str(),
+                        value, "child");
+                     node[link]->append(child);
+                  }
+                  input->append(node);
+               }
+            }
+
+            DynamicObject options;
+            options["format"] = "application/nquads";
+            DynamicObject output;
+            Timer t;
+            t.start();
+            assertNoException(JsonLd::normalize(input, options, output));
+            printf("%0.3f secs... ", t.getElapsedSeconds());
+         }
+         tr.passIfNoException();
+      }
+   }
+
+   tr.ungroup();
+}
+
+/**
+ * Reads a JSON-LD test object from a JSON string.
+ *
+ * @param json the JSON string.
+ *
+ * @return the object.
+ */
+static DynamicObject _readJson(const char* json)
+{
+   DynamicObject rval;
+   JsonReader::readFromString(rval, json, strlen(json));
+   return rval;
+}
+
+/**
+ * Creates a context like the ones used for typical documents, for context
+ * tests.
+ *
+ * @return the context.
+ */
+static DynamicObject _createTypicalContext()
+{
+   return _readJson(
+      "{\"@context\": {"
+      "\"id\": \"@id\","
+      "\"type\": \"@type\","
+      "\"dc\": \"http://purl.org/dc/terms/\","
+      "\"foaf\": \"http://xmlns.com/foaf/0.1/\","
+      "\"schema\": \"http://schema.org/\","
+      "\"xsd\": \"http://www.w3.org/2001/XMLSchema#\","
+      "\"Person\": \"foaf:Person\","
+      "\"name\": \"foaf:name\","
+      "\"nick\": {\"@id\": \"foaf:nick\", \"@container\": \"@set\"},"
+      "\"homepage\": {\"@id\": \"foaf:homepage\", \"@type\": \"@id\"},"
+      "\"knows\": {\"@id\": \"foaf:knows\", \"@type\": \"@id\"},"
+      "\"created\": {\"@id\": \"dc:created\", \"@type\": \"xsd:dateTime\"},"
+      "\"description\": {\"@id\": \"dc:description\", \"@language\": \"en\"},"
+      "\"email\": \"schema:email\","
+      "\"address\": \"schema:address\","
+      "\"street\": \"schema:streetAddress\","
+      "\"city\": \"schema:addressLocality\","
+      "\"postalCode\": \"schema:postalCode\","
+      "\"tags\": {\"@id\": \"schema:keywords\", \"@container\": \"@list\"},"
+      "\"age\": {\"@id\": \"foaf:age\", \"@type\": \"xsd:integer\"}"
+      "}}");
+}
+
+/**
+ * Creates a typical document that uses the typical context, for context
+ * tests.
+ *
+ * @param ctx the context to embed in the document.
+ *
+ * @return the document.
+ */
+static DynamicObject _createTypicalDocument(DynamicObject& ctx)
+{
+   DynamicObject rval = _readJson(
+      "{"
+      "\"id\": \"http://example.com/people/alice\","
+      "\"type\": \"Person\","
+      "\"name\": \"Alice\","
+      "\"nick\": [\"al\", \"ally\"],"
+      "\"homepage\": \"http://example.com/\","
+      "\"knows\": [\"http://example.com/people/bob\","
+      "   \"http://example.com/people/carol\"],"
+      "\"created\": \"2012-03-04T05:06:07Z\","
+      "\"description\": \"A person.\","
+      "\"email\": \"alice@example.com\","
+      "\"address\": {"
+      "   \"street\": \"1 Main Street\","
+      "   \"city\": \"Springfield\","
+      "   \"postalCode\": \"12345\"},"
+      "\"tags\": [\"a\", \"b\", \"c\"],"
+      "\"age\": 30,"
+      "\"foaf:mbox\": \"mailto:alice@example.com\","
+      "\"http://example.com/other\": \"other\""
+      "}");
+   rval["@context"] = ctx["@context"];
+   return rval;
+}
+
+static void runJsonLdContextCacheTests(TestRunner& tr)
+{
+   tr.group("JSON-LD context cache");
+
+   tr.test("compact");
+   {
+      // the typical document is already compacted with its context
+      DynamicObject ctx = _createTypicalContext();
+      DynamicObject expect = _createTypicalDocument(ctx);
+      DynamicObject options;
+      DynamicObject output;
+      assertNoException(JsonLd::compact(
+         _createTypicalDocument(ctx), ctx, options, output));
+      assertNamedDynoCmp("expect", expect, "output", output);
+
+      // the embedded and the compaction contexts are cached
+      JsonLdContextCache cache;
+      for(int i = 0; i < 2; ++i)
+      {
+         DynamicObject opts;
+         assertNoException(JsonLd::compact(
+            _createTypicalDocument(ctx), ctx, opts, output, &cache));
+         assertNamedDynoCmp("expect", expect, "output", output);
+      }
+      DynamicObject stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 2);
+      assert(stats["misses"]->getUInt64() == 2);
+      assert(stats["hits"]->getUInt64() == 2);
+   }
+   tr.passIfNoException();
+
+   tr.test("changed context");
+   {
+      JsonLdContextCache cache;
+      DynamicObject ctx = _createTypicalContext();
+      DynamicObject options;
+      DynamicObject output;
+      assertNoException(JsonLd::compact(
+         _createTypicalDocument(ctx), ctx, options, output, &cache));
+
+      // a changed context is processed again
+      DynamicObject changed = ctx.clone();
+      changed["@context"]["fullName"] = "foaf:name";
+      changed["@context"]->removeMember("name");
+      DynamicObject expect;
+      assertNoException(JsonLd::compact(
+         _createTypicalDocument(ctx), changed, options, expect));
+      assertNoException(JsonLd::compact(
+         _createTypicalDocument(ctx), changed, options, output, &cache));
+      assertNamedDynoCmp("expect", expect, "output", output);
+      assertStrCmp(output["fullName"]->getString(), "Alice");
+      DynamicObject stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 3);
+      assert(stats["misses"]->getUInt64() == 3);
+      assert(stats["hits"]->getUInt64() == 1);
+
+      // processed contexts are shared but not changed by their users
+      DynamicObject initialCtx;
+      DynamicObject activeCtx;
+      assertNoException(JsonLd::processContext(
+         DynamicObject(NULL), DynamicObject(NULL), options, initialCtx));
+      assertNoException(JsonLd::processContext(
+         initialCtx, changed, options, activeCtx, &cache));
+      assert(cache.getStats()["hits"]->getUInt64() == 2);
+      DynamicObject before = activeCtx.clone();
+      assertNoException(JsonLd::compact(
+         _createTypicalDocument(ctx), changed, options, output, &cache));
+      assertNamedDynoCmp("before", before, "after", activeCtx);
+   }
+   tr.passIfNoException();
+
+   tr.test("eviction");
+   {
+      JsonLdContextCache cache(1);
+      DynamicObject ctx = _createTypicalContext();
+      DynamicObject expect = _createTypicalDocument(ctx);
+      DynamicObject options;
+      DynamicObject output;
+      for(int i = 0; i < 2; ++i)
+      {
+         assertNoException(JsonLd::compact(
+            _createTypicalDocument(ctx), ctx, options, output, &cache));
+         assertNamedDynoCmp("expect", expect, "output", output);
+      }
+      DynamicObject stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 1);
+      assert(stats["evictions"]->getUInt64() == 3);
+      assert(stats["hits"]->getUInt64() == 0);
+
+      cache.clear();
+      stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runJsonLdContextSpeedTest(TestRunner& tr)
+{
+   tr.group("JSON-LD context speed");
+
+   DynamicObject ctx = _createTypicalContext();
+   JsonLdContextCache cache;
+   for(int cached = 0; cached < 2; ++cached)
+   {
+      tr.test(cached ? "10000 compactions, cached" : "10000 compactions");
+      {
+         Timer t;
+         t.start();
+         for(int i = 0; i < 10000; ++i)
+         {
+            DynamicObject options;
+            DynamicObject output;
+            assertNoException(JsonLd::compact(
+               _createTypicalDocument(ctx), ctx, options, output,
+               cached ? &cache : NULL));
+         }
+         printf("%0.3f secs... ", t.getElapsedSeconds());
+      }
+      tr.passIfNoException();
+   }
+
+   tr.ungroup();
+}
+
 static bool run(TestRunner& tr)
 {
    if(tr.isDefaultEnabled() || tr.isTestEnabled("json-ld"))
@@ -619,6 +1057,16 @@ static bool run(TestRunner& tr)
       runJsonLdTestSuite(tr);
 #endif
       runJsonLdTests(tr);
+      runJsonLdNormalizeTests(tr);
+      runJsonLdContextCacheTests(tr);
+   }
+   if(tr.isTestEnabled("json-ld-normalize-speed"))
+   {
+      runJsonLdNormalizeSpeedTest(tr);
+   }
+   if(tr.isTestEnabled("json-ld-context-speed"))
+   {
+      runJsonLdContextSpeedTest(tr);
    }
    return true;
 }
@@ -1,8 +1,11 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/TemplateCache.h"
 #include "monarch/io/ByteArrayInputStream.h"
+#include "monarch/io/File.h"
+#include "monarch/io/FileOutputStream.h"
 #include "monarch/mail/SmtpClient.h"
 #include "monarch/mail/MailTemplateParser.h"
 #include "monarch/mail/MailSpool.h"
@@ -12,6 +15,7 @@
 #include "monarch/util/Url.h"
 
 using namespace std;
+using namespace monarch::data;
 using namespace monarch::io;
 using namespace monarch::net;
 using namespace monarch::test;
@@ -279,6 +283,56 @@ static void runMailTemplateParser(TestRunner& tr)
    tr.passIfNoException();
 }
 
+static void runMailTemplateFileTest(TestRunner& tr)
+{
+   tr.test("MailTemplateParser (cached file)");
+
+   // write mail template
+   File file = File::createTempFile("mail");
+   const char* tpl =
+      "Subject: Hello {name}\r\n"
+      "To: {address}\r\n"
+      "\r\n"
+      "Dear {name},\n"
+      "{:each from=items as=item}* {item}\n{:end}";
+   FileOutputStream fos(file);
+   fos.write(tpl, strlen(tpl));
+   fos.close();
+   assertNoExceptionSet();
+
+   // the template is parsed once and used for both mails
+   TemplateCache cache;
+   monarch::mail::MailTemplateParser parser;
+   for(int i = 0; i < 2; ++i)
+   {
+      DynamicObject vars;
+      vars["name"] = (i == 0) ? "Alice" : "Bob";
+      vars["address"] = (i == 0) ? "alice@example.com" : "bob@example.com";
+      vars["items"]->append() = "first";
+      if(i == 1)
+      {
+         vars["items"]->append() = "second";
+      }
+
+      monarch::mail::Mail mail;
+      assertNoException(
+         parser.parseFile(
+            &mail, vars, true, file->getAbsolutePath(), &cache));
+      monarch::mail::Message msg = mail.getMessage();
+      string subject = StringTools::format(
+         "Hello %s", vars["name"]->getString());
+      assertStrCmp(msg["headers"]["Subject"]->getString(), subject.c_str());
+      string body = StringTools::format(
+         "Dear %s,\r\n* first\r\n%s", vars["name"]->getString(),
+         (i == 0) ? "" : "* second\r\n");
+      assertStrCmp(msg["body"]->getString(), body.c_str());
+   }
+
+   file->remove();
+
+   tr.passIfNoException();
+}
+
 static void _runMailboxTest(
    TestRunner& tr, const char* address, const char* domain, const char* smtp)
 {
@@ -512,6 +566,7 @@ static bool run(TestRunner& tr)
    if(tr.isDefaultEnabled())
    {
       runMailTemplateParser(tr);
+      runMailTemplateFileTest(tr);
       runMailboxTest(tr);
       mailSpoolTest(tr);
    }
@@ -1,6 +1,7 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
+#include "monarch/crypto/AsymmetricKeyFactory.h"
 #include "monarch/data/json/JsonWriter.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/io/File.h"
@@ -11,14 +12,20 @@
 #include "monarch/net/TcpSocket.h"
 #include "monarch/net/UdpSocket.h"
 #include "monarch/net/DatagramSocket.h"
+#include "monarch/net/HostResolver.h"
 #include "monarch/net/Internet6Address.h"
+#include "monarch/net/IpPrefixTrie.h"
+#include "monarch/net/SslSessionCache.h"
 #include "monarch/net/SslSocket.h"
 #include "monarch/net/Server.h"
 #include "monarch/net/NullSocketDataPresenter.h"
 #include "monarch/net/SslSocketDataPresenter.h"
 #include "monarch/net/SocketDataPresenterList.h"
 #include "monarch/net/SocketTools.h"
+#include "monarch/net/DefaultBandwidthThrottler.h"
+#include "monarch/net/TokenBucketBandwidthThrottler.h"
 #include "monarch/rt/System.h"
+#include "monarch/rt/Thread.h"
 #include "monarch/rt/DynamicObject.h"
 #include "monarch/rt/DynamicObjectIterator.h"
 #include "monarch/test/Test.h"
@@ -27,6 +34,7 @@
 #include "monarch/util/StringTools.h"
 
 using namespace std;
+using namespace monarch::crypto;
 using namespace monarch::data;
 using namespace monarch::data::json;
 using namespace monarch::test;
@@ -119,6 +127,179 @@ static void runAddressResolveTest(TestRunner& tr)
    tr.passIfNoException();
 }
 
+static void runHostResolverTest(TestRunner& tr)
+{
+   tr.group("HostResolver");
+
+   tr.test("hosts file");
+   {
+      File file = File::createTempFile("hosts");
+      FileOutputStream fos(file);
+      const char* hosts =
+         "# test hosts\n"
+         "10.0.0.1   alpha.test  Beta.test # two names\n"
+         "\n"
+         "fc00::1    alpha.test\n";
+      fos.write(hosts, strlen(hosts));
+      fos.close();
+      assertNoExceptionSet();
+
+      HostResolver resolver(1);
+      resolver.loadHostsFile(file);
+      assertNoExceptionSet();
+      file->remove();
+
+      string address;
+      assert(resolver.resolve("alpha.test", SocketAddress::IPv4, address));
+      assertStrCmp(address.c_str(), "10.0.0.1");
+      assert(resolver.resolve("BETA.test", SocketAddress::IPv4, address));
+      assertStrCmp(address.c_str(), "10.0.0.1");
+      assert(resolver.resolve("alpha.test", SocketAddress::IPv6, address));
+      assertStrCmp(address.c_str(), "fc00::1");
+
+      // numeric addresses are not looked up
+      assert(resolver.resolve("10.1.2.3", SocketAddress::IPv4, address));
+      assertStrCmp(address.c_str(), "10.1.2.3");
+
+      // invalid addresses are rejected
+      assert(!resolver.addHost("gamma.test", "not-an-address"));
+      assertExceptionSet();
+      Exception::clear();
+
+      DynamicObject stats = resolver.getStats();
+      assert(stats["hosts"]->getUInt32() == 3);
+      assert(stats["hits"]->getUInt64() == 3);
+      assert(stats["lookups"]->getUInt64() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("negative cache");
+   {
+      HostResolver resolver(2);
+      resolver.setNegativeTtl(60000);
+
+      // the .invalid domain never resolves
+      string address;
+      assert(!resolver.resolve(
+         "unknown.invalid", SocketAddress::IPv4, address));
+      assertExceptionSet();
+      Exception::clear();
+      assert(!resolver.resolve(
+         "UNKNOWN.invalid", SocketAddress::IPv4, address));
+      assertExceptionSet();
+      Exception::clear();
+
+      DynamicObject stats = resolver.getStats();
+      assert(stats["size"]->getUInt32() == 1);
+      assert(stats["lookups"]->getUInt64() == 1);
+      assert(stats["failures"]->getUInt64() == 1);
+      assert(stats["negativeHits"]->getUInt64() == 1);
+
+      // cleared entries are looked up again
+      resolver.clear();
+      resolver.prefetch("unknown.invalid", SocketAddress::IPv4);
+      assert(!resolver.resolve(
+         "unknown.invalid", SocketAddress::IPv4, address));
+      assertExceptionSet();
+      Exception::clear();
+      stats = resolver.getStats();
+      assert(stats["lookups"]->getUInt64() == 2);
+      assert(stats["pending"]->getUInt32() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("default resolver");
+   {
+      HostResolver resolver(1);
+      resolver.addHost("alpha.test", "10.0.0.1");
+      HostResolver::setDefault(&resolver);
+
+      InternetAddress addr("alpha.test", 80);
+      assertNoExceptionSet();
+      assertStrCmp(addr.getAddress(), "10.0.0.1");
+      assertStrCmp(addr.getHost(), "alpha.test");
+
+      HostResolver::setDefault(NULL);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runIpPrefixTrieTest(TestRunner& tr)
+{
+   tr.group("IpPrefixTrie");
+
+   tr.test("IPv4");
+   {
+      IpPrefixTrie trie;
+      assert(trie.isEmpty());
+      assert(trie.add("10.0.0.0/8"));
+      assert(trie.add("192.168.1.0/24"));
+      assert(trie.add("172.16.5.4"));
+      assert(trie.getRangeCount() == 3);
+
+      assert(trie.contains("10.0.0.1"));
+      assert(trie.contains("10.255.255.255"));
+      assert(!trie.contains("11.0.0.0"));
+      assert(trie.contains("192.168.1.200"));
+      assert(!trie.contains("192.168.2.1"));
+      assert(trie.contains("172.16.5.4"));
+      assert(!trie.contains("172.16.5.5"));
+      assert(!trie.contains("not an address"));
+
+      // mapped addresses match IPv4 ranges
+      assert(trie.contains("::ffff:10.1.2.3"));
+      assert(!trie.contains("::10.1.2.3"));
+
+      InternetAddress addr("192.168.1.9", 80);
+      assert(trie.contains(&addr));
+
+      // everything
+      assert(trie.add("0.0.0.0/0"));
+      assert(trie.contains("11.0.0.0"));
+      assert(!trie.contains("2001:db8::1"));
+   }
+   tr.passIfNoException();
+
+   tr.test("IPv6");
+   {
+      IpPrefixTrie trie;
+      assert(trie.add("2001:db8::/32"));
+      assert(trie.add("::1"));
+      assert(trie.add("::ffff:10.0.0.0/104"));
+
+      assert(trie.contains("2001:db8:1::5"));
+      assert(!trie.contains("2001:db9::5"));
+      assert(trie.contains("::1"));
+      assert(!trie.contains("::2"));
+      assert(trie.contains("10.9.9.9"));
+
+      Internet6Address addr("2001:db8::42", 80);
+      assert(trie.contains(&addr));
+   }
+   tr.passIfNoException();
+
+   tr.test("invalid");
+   {
+      IpPrefixTrie trie;
+      const char* invalid[] =
+         {"", "10.0.0.0/", "10.0.0.0/33", "10.0.0/8", "::/129", "a.b.c.d",
+          "10.0.0.0/8x", NULL};
+      for(int i = 0; invalid[i] != NULL; ++i)
+      {
+         assert(!IpPrefixTrie::isRange(invalid[i]));
+         assert(!trie.add(invalid[i]));
+         assertExceptionSet();
+         Exception::clear();
+      }
+      assert(trie.isEmpty());
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runSocketTest(TestRunner& tr)
 {
    tr.group("Socket");
@@ -1215,15 +1396,595 @@ static void runServerDatagramTest(TestRunner& tr)
    tr.passIfNoException();
 }
 
+/**
+ * Creates a private key and a self-signed certificate for localhost.
+ *
+ * @param privateKey set to the private key.
+ * @param cert set to the certificate.
+ */
+static void _createTestCertificate(
+   PrivateKeyRef& privateKey, X509CertificateRef& cert)
+{
+   AsymmetricKeyFactory factory;
+   PublicKeyRef publicKey;
+   factory.createKeyPair("RSA", privateKey, publicKey);
+   assertNoExceptionSet();
+
+   DynamicObject subject;
+   subject[0]["type"] = "CN";
+   subject[0]["value"] = "localhost";
+   Date yesterday;
+   yesterday.addSeconds(-1 * 24 * 60 * 60);
+   Date tomorrow;
+   tomorrow.addSeconds(24 * 60 * 60);
+   BigInteger serial(1);
+   cert = factory.createCertificate(
+      0x2, privateKey, publicKey, subject, subject,
+      &yesterday, &tomorrow, serial, NULL, NULL);
+   assertNoExceptionSet();
+}
+
+/**
+ * Creates an SslSession that is valid for the given number of seconds.
+ */
+static SslSession _createTestSession(long timeout)
+{
+   SslSession rval(new SslSessionImpl(SSL_SESSION_new()));
+   SSL_SESSION_set_time(rval->session, time(NULL));
+   SSL_SESSION_set_timeout(rval->session, timeout);
+   return rval;
+}
+
+static void runSslSessionCacheTest(TestRunner& tr)
+{
+   tr.group("SslSessionCache");
+
+   tr.test("LRU eviction");
+   {
+      SslSessionCache cache(2);
+      SslSession a = _createTestSession(300);
+      SslSession b = _createTestSession(300);
+      SslSession c = _createTestSession(300);
+      cache.storeSession("a:443", a);
+      cache.storeSession("b:443", b);
+
+      // use a so that b is the least recently used
+      assert(!cache.getSession("a:443").isNull());
+      cache.storeSession("c:443", c);
+      assert(!cache.getSession("a:443").isNull());
+      assert(cache.getSession("b:443").isNull());
+      assert(!cache.getSession("c:443").isNull());
+
+      // sessions without an SSL session are not stored
+      SslSession empty(new SslSessionImpl());
+      cache.storeSession("d:443", empty);
+      assert(cache.getSession("d:443").isNull());
+
+      DynamicObject stats = cache.getStats();
+      assert(stats["size"]->getUInt32() == 2);
+      assert(stats["hits"]->getUInt64() == 3);
+      assert(stats["misses"]->getUInt64() == 2);
+      assert(stats["evictions"]->getUInt64() == 1);
+   }
+   tr.passIfNoException();
+
+   tr.test("expiration");
+   {
+      // time to live
+      SslSessionCache cache(2, 10);
+      SslSession a = _createTestSession(300);
+      cache.storeSession("a:443", a, "vhost");
+      assert(!cache.getSession("a:443", "vhost").isNull());
+      assert(cache.getSession("a:443").isNull());
+      Thread::sleep(20);
+      assert(cache.getSession("a:443", "vhost").isNull());
+
+      // session timeout
+      SslSession b = _createTestSession(0);
+      cache.storeSession("b:443", b);
+      assert(cache.getSession("b:443").isNull());
+
+      DynamicObject stats = cache.getStats();
+      assert(stats["size"]->getUInt32() == 0);
+      assert(stats["expirations"]->getUInt64() == 2);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Accepts SSL connections and answers a single byte on each.
+ */
+class SslResumptionServer : public Runnable
+{
+public:
+   SslContext* context;
+   TcpSocket* socket;
+   int connections;
+
+   SslResumptionServer(
+      SslContext* context, TcpSocket* socket, int connections) :
+      context(context),
+      socket(socket),
+      connections(connections)
+   {
+   }
+
+   virtual ~SslResumptionServer()
+   {
+   }
+
+   virtual void run()
+   {
+      TcpSocket* worker;
+      for(int i = 0; i < connections &&
+          (worker = (TcpSocket*)socket->accept(10)) != NULL; ++i)
+      {
+         SslSocket ssl(context, worker, false, true);
+         ssl.setReceiveTimeout(10000);
+         char b;
+         if(ssl.receive(&b, 1) == 1)
+         {
+            ssl.send(&b, 1);
+
+            // wait for the client to close
+            ssl.receive(&b, 1);
+         }
+         ssl.close();
+      }
+   }
+};
+
+/**
+ * Connects to an SSL server using a session from a cache, exchanges a byte
+ * and caches the session.
+ *
+ * @return true if the session was resumed.
+ */
+static bool _connectWithSessionCache(
+   SslContext& context, InternetAddress* address, SslSessionCache& cache)
+{
+   bool rval = false;
+
+   SslSession session = cache.getSession(address->toString(false).c_str());
+   TcpSocket* socket = new TcpSocket();
+   socket->connect(address);
+   SslSocket ssl(&context, socket, true, true);
+   ssl.setReceiveTimeout(10000);
+   ssl.setSession(session.isNull() ? NULL : &session);
+
+   // session tickets may arrive after the handshake, so exchange data
+   char b = 'x';
+   if(ssl.performHandshake() && ssl.send(&b, 1) && ssl.receive(&b, 1) == 1)
+   {
+      rval = ssl.isSessionReused();
+      cache.recordHandshake(rval);
+      session = ssl.getSession();
+      cache.storeSession(address->toString(false).c_str(), session);
+   }
+   ssl.close();
+
+   return rval;
+}
+
+static void runSslSessionResumptionTest(TestRunner& tr)
+{
+   tr.group("SSL session resumption");
+
+   PrivateKeyRef privateKey;
+   X509CertificateRef cert;
+   _createTestCertificate(privateKey, cert);
+
+   SslContext serverContext(NULL, false);
+   serverContext.setCertificate(cert);
+   serverContext.setPrivateKey(privateKey);
+   SslContext clientContext(NULL, true);
+   clientContext.setPeerAuthentication(false);
+   SslSessionCache cache;
+
+   InternetAddress address("127.0.0.1", 19127);
+   TcpSocket server;
+   server.bind(&address);
+   server.listen();
+   assertNoExceptionSet();
+
+   SslResumptionServer srs(&serverContext, &server, 4);
+   Thread t(&srs);
+   t.start();
+
+   tr.test("resume with session ticket");
+   {
+      assert(!_connectWithSessionCache(clientContext, &address, cache));
+      assert(_connectWithSessionCache(clientContext, &address, cache));
+      assert(_connectWithSessionCache(clientContext, &address, cache));
+   }
+   tr.passIfNoException();
+
+   tr.test("rotated ticket keys");
+   {
+      // tickets protected by keys older than the previous key are rejected
+      serverContext.rotateSessionTicketKeys();
+      serverContext.rotateSessionTicketKeys();
+      assert(!_connectWithSessionCache(clientContext, &address, cache));
+   }
+   tr.passIfNoException();
+
+   t.join();
+   server.close();
+
+   tr.test("stats");
+   {
+      DynamicObject stats = cache.getStats();
+      assert(stats["resumed"]->getUInt64() == 2);
+      assert(stats["fullHandshakes"]->getUInt64() == 2);
+
+      stats = serverContext.getSessionStats();
+      assert(stats["accepted"]->getUInt64() == 4);
+      assert(stats["resumed"]->getUInt64() == 2);
+      assert(stats["ticketsAccepted"]->getUInt32() == 2);
+      assert(stats["ticketsRejected"]->getUInt32() == 1);
+      assert(stats["ticketKeys"]->getUInt32() == 2);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Accepts one SSL connection, reads the expected number of bytes from it and
+ * acknowledges them with a single byte.
+ */
+class SslThroughputServer : public Runnable
+{
+public:
+   SslContext* context;
+   TcpSocket* socket;
+   uint64_t expected;
+   uint64_t bytes;
+   uint64_t time;
+
+   SslThroughputServer(
+      SslContext* context, TcpSocket* socket, uint64_t expected) :
+      context(context),
+      socket(socket),
+      expected(expected),
+      bytes(0),
+      time(0)
+   {
+   }
+
+   virtual ~SslThroughputServer()
+   {
+   }
+
+   virtual void run()
+   {
+      TcpSocket* worker = (TcpSocket*)socket->accept(10);
+      if(worker != NULL)
+      {
+         SslSocket ssl(context, worker, false, true);
+         ssl.setReceiveTimeout(10000);
+         if(ssl.performHandshake())
+         {
+            // time from the end of the handshake until all data is read
+            char b[16384];
+            int numBytes;
+            uint64_t start = System::getCurrentMilliseconds();
+            while(bytes < expected && (numBytes = ssl.receive(b, 16384)) > 0)
+            {
+               bytes += numBytes;
+            }
+            time = System::getCurrentMilliseconds() - start;
+            ssl.send("k", 1);
+         }
+         ssl.close();
+      }
+   }
+};
+
+static void runSslThroughputTest(TestRunner& tr)
+{
+   tr.group("SSL throughput");
+
+   // create a self-signed certificate for the server
+   PrivateKeyRef privateKey;
+   X509CertificateRef cert;
+   _createTestCertificate(privateKey, cert);
+
+   // 64 MiB in 16 KiB writes
+   const int size = 16384;
+   const int count = 4096;
+   char* data = (char*)malloc(size);
+   memset(data, 'x', size);
+
+   const char* names[] = {"BIO pair", "direct"};
+   SslContext::TransportMode modes[] =
+      {SslContext::BioPairTransport, SslContext::DirectTransport};
+   for(int m = 0; m < 2; ++m)
+   {
+      tr.test(names[m]);
+      {
+         SslContext serverContext(NULL, false);
+         serverContext.setCertificate(cert);
+         serverContext.setPrivateKey(privateKey);
+         serverContext.setTransportMode(modes[m]);
+         SslContext clientContext(NULL, true);
+         clientContext.setPeerAuthentication(false);
+         clientContext.setTransportMode(modes[m]);
+         assertNoExceptionSet();
+
+         InternetAddress address("127.0.0.1", 19126);
+         TcpSocket server;
+         server.bind(&address);
+         server.listen();
+         assertNoExceptionSet();
+
+         SslThroughputServer sts(
+            &serverContext, &server, (uint64_t)size * count);
+         Thread t(&sts);
+         t.start();
+
+         TcpSocket* client = new TcpSocket();
+         client->connect(&address);
+         assertNoExceptionSet();
+         SslSocket ssl(&clientContext, client, true, true);
+         ssl.setSendTimeout(10000);
+         for(int i = 0; i < count && ssl.send(data, size); ++i);
+         assertNoExceptionSet();
+
+         // wait for the acknowledgement before closing
+         char ack;
+         assert(ssl.receive(&ack, 1) == 1);
+         ssl.close();
+
+         t.join();
+         server.close();
+         assert(sts.bytes == (uint64_t)size * count);
+
+         double mb = sts.bytes / (1024.0 * 1024.0);
+         printf("%.0f MiB in %" PRIu64 " ms (%.1f MiB/s) ... ",
+            mb, sts.time, (sts.time > 0) ? mb * 1000.0 / sts.time : 0.0);
+      }
+      tr.passIfNoException();
+   }
+
+   free(data);
+
+   tr.ungroup();
+}
+
+static void runTokenBucketThrottlerTest(TestRunner& tr)
+{
+   tr.group("TokenBucketBandwidthThrottler");
+
+   tr.test("burst");
+   {
+      // a full bucket permits up to the burst size at once
+      TokenBucketBandwidthThrottler bt(10000);
+      assert(bt.getBurstSize() == 1000);
+      int permitted;
+      assert(bt.requestBytes(5000, permitted));
+      assert(permitted == 1000);
+      assert(bt.getAvailableBytes() < 100);
+
+      // returned bytes can be requested again
+      bt.addAvailableBytes(500);
+      assert(bt.getAvailableBytes() >= 500);
+      assert(bt.requestBytes(500, permitted));
+      assert(permitted == 500);
+
+      // no rate limit
+      bt.setRateLimit(0);
+      assert(bt.requestBytes(5000, permitted));
+      assert(permitted == 5000);
+   }
+   tr.passIfNoException();
+
+   tr.test("rate");
+   {
+      TokenBucketBandwidthThrottler bt(1000);
+      bt.setBurstSize(100);
+
+      // after the burst, 400 bytes take about 400 ms
+      int permitted;
+      int total = 0;
+      uint64_t start = System::getCurrentMilliseconds();
+      while(total < 500)
+      {
+         assert(bt.requestBytes(500 - total, permitted));
+         assert(permitted > 0 && permitted <= 100);
+         total += permitted;
+      }
+      uint64_t elapsed = System::getCurrentMilliseconds() - start;
+      assert(elapsed >= 350);
+   }
+   tr.passIfNoException();
+
+   tr.test("hierarchy");
+   {
+      TokenBucketBandwidthThrottler* global =
+         new TokenBucketBandwidthThrottler(1000);
+      BandwidthThrottlerRef globalRef = global;
+      global->setBurstSize(100);
+      TokenBucketBandwidthThrottler service(100000);
+      service.setParent(globalRef);
+      TokenBucketBandwidthThrottler connection(50000);
+      connection.setParent(&service);
+
+      // the global burst limits what a connection is permitted, the rest
+      // is returned to the connection and service
+      int permitted;
+      assert(connection.requestBytes(2000, permitted));
+      assert(permitted == 100);
+      assert(connection.getAvailableBytes() < 100);
+      assert(global->getAvailableBytes() < 100);
+      assert(service.getBurstSize() == 10000);
+
+      // returned bytes go back up the hierarchy
+      connection.addAvailableBytes(50);
+      assert(global->getAvailableBytes() >= 50);
+      assert(connection.getAvailableBytes() >= 50);
+   }
+   tr.passIfNoException();
+
+   tr.test("thread cache");
+   {
+      TokenBucketBandwidthThrottler bt(100000, 4000);
+
+      // the first request takes a batch for the thread
+      int permitted;
+      assert(bt.requestBytes(1000, permitted));
+      assert(permitted == 1000);
+      assert(bt.getAvailableBytes() < 6000);
+      assert(bt.requestBytes(3000, permitted));
+      assert(permitted == 3000);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Requests bytes from a throttler in fixed-size chunks until a time limit.
+ */
+class ThrottlerBenchmark : public Runnable
+{
+public:
+   BandwidthThrottler* throttler;
+   int chunk;
+   uint64_t end;
+   uint64_t bytes;
+   uint64_t requests;
+
+   ThrottlerBenchmark() : bytes(0), requests(0) {};
+   virtual ~ThrottlerBenchmark() {};
+
+   virtual void run()
+   {
+      int permitted;
+      while(System::getCurrentMilliseconds() < end &&
+            throttler->requestBytes(chunk, permitted))
+      {
+         bytes += permitted;
+         ++requests;
+      }
+   }
+};
+
+/**
+ * Runs a throttler with the given number of threads for the given time.
+ */
+static void _runThrottlerBenchmark(
+   BandwidthThrottler* bt, int threads, int chunk, uint32_t time,
+   uint64_t& bytes, uint64_t& requests)
+{
+   ThrottlerBenchmark* runs = new ThrottlerBenchmark[threads];
+   Thread** t = new Thread*[threads];
+   uint64_t end = System::getCurrentMilliseconds() + time;
+   for(int i = 0; i < threads; ++i)
+   {
+      runs[i].throttler = bt;
+      runs[i].chunk = chunk;
+      runs[i].end = end;
+      t[i] = new Thread(&runs[i]);
+      t[i]->start();
+   }
+   bytes = requests = 0;
+   for(int i = 0; i < threads; ++i)
+   {
+      t[i]->join();
+      delete t[i];
+      bytes += runs[i].bytes;
+      requests += runs[i].requests;
+   }
+   delete [] t;
+   delete [] runs;
+}
+
+static void runThrottlerBenchmark(TestRunner& tr)
+{
+   tr.group("BandwidthThrottler benchmark");
+
+   const char* names[] =
+      {"default", "token bucket", "token bucket with thread cache"};
+   int threadCounts[] = {1, 4, 16, 64};
+   const uint32_t time = 1000;
+
+   for(int n = 0; n < 3; ++n)
+   {
+      for(int c = 0; c < 4; ++c)
+      {
+         int threads = threadCounts[c];
+         char name[100];
+         snprintf(name, 100, "%s, %d threads", names[n], threads);
+         tr.test(name);
+         {
+            // accuracy at 8 MiB/s with full-size segments, overhead with
+            // small requests that never reach the limit
+            int rates[] = {8 * 1024 * 1024, INT32_MAX};
+            int chunks[] = {1460, 64};
+            for(int r = 0; r < 2; ++r)
+            {
+               BandwidthThrottler* bt;
+               switch(n)
+               {
+                  case 0:
+                     bt = new DefaultBandwidthThrottler(rates[r]);
+                     break;
+                  case 1:
+                     bt = new TokenBucketBandwidthThrottler(rates[r]);
+                     break;
+                  default:
+                     bt = new TokenBucketBandwidthThrottler(
+                        rates[r], 16 * 1460);
+                     break;
+               }
+
+               uint64_t bytes;
+               uint64_t requests;
+               _runThrottlerBenchmark(
+                  bt, threads, chunks[r], time, bytes, requests);
+               delete bt;
+               assertNoExceptionSet();
+
+               if(r == 0)
+               {
+                  // the token buckets start full, do not count the burst
+                  if(n > 0)
+                  {
+                     bytes -= rates[r] / 10;
+                  }
+                  printf("\n   rate: %.1f%% of limit",
+                     bytes * 1000.0 / time * 100.0 / rates[r]);
+               }
+               else
+               {
+                  printf(", %.0f requests/s ... ",
+                     requests * 1000.0 / time);
+               }
+            }
+         }
+         tr.passIfNoException();
+      }
+   }
+
+   tr.ungroup();
+}
+
 static bool run(TestRunner& tr)
 {
    if(tr.isDefaultEnabled())
    {
       runAddressResolveTest(tr);
+      runHostResolverTest(tr);
+      runIpPrefixTrieTest(tr);
       runSocketTest(tr);
       runServerDynamicServiceTest(tr);
       runUdpClientServerTest(tr);
       runDatagramTest(tr);
+      runSslSessionCacheTest(tr);
+      runTokenBucketThrottlerTest(tr);
    }
    if(tr.isTestEnabled("local-hostname"))
    {
@@ -1253,6 +2014,18 @@ static bool run(TestRunner& tr)
    {
       runServerSslConnectionTest(tr);
    }
+   if(tr.isTestEnabled("ssl-session-resumption"))
+   {
+      runSslSessionResumptionTest(tr);
+   }
+   if(tr.isTestEnabled("ssl-throughput"))
+   {
+      runSslThroughputTest(tr);
+   }
+   if(tr.isTestEnabled("throttler-benchmark"))
+   {
+      runThrottlerBenchmark(tr);
+   }
    if(tr.isTestEnabled("server-datagram"))
    {
       runServerDatagramTest(tr);
@@ -1,26 +1,35 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_CONSTANT_MACROS
 
 #include <cstdio>
+#include <utime.h>
 
 #include "monarch/test/Test.h"
 #include "monarch/test/TestModule.h"
+#include "monarch/compress/deflate/Deflater.h"
+#include "monarch/compress/gzip/Gzipper.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/io/ByteArrayOutputStream.h"
 #include "monarch/io/File.h"
 #include "monarch/io/FileOutputStream.h"
+#include "monarch/io/MutatorInputStream.h"
 #include "monarch/data/TemplateInputStream.h"
 #include "monarch/data/json/JsonWriter.h"
 #include "monarch/logging/Logging.h"
+#include "monarch/util/StringTools.h"
+#include "monarch/util/Timer.h"
 
 using namespace std;
 using namespace monarch::test;
+using namespace monarch::compress::deflate;
+using namespace monarch::compress::gzip;
 using namespace monarch::data;
 using namespace monarch::data::json;
 using namespace monarch::io;
 using namespace monarch::rt;
+using namespace monarch::util;
 
 namespace mo_test_template
 {
@@ -1261,12 +1270,566 @@ static void runTemplateInputStreamTest(TestRunner& tr)
    tr.ungroup();
 }
 
+/**
+ * Writes a string to a file.
+ *
+ * @param file the file to write to.
+ * @param str the string to write.
+ */
+static void writeFile(File& file, const char* str)
+{
+   FileOutputStream fos(file);
+   fos.write(str, strlen(str));
+   fos.close();
+   assertNoExceptionSet();
+}
+
+/**
+ * Reads an encoded stream, decodes it and checks the result.
+ *
+ * @param is the stream to read, it will be deleted.
+ * @param algorithm the algorithm to decode with.
+ * @param expect the expected decoded string.
+ */
+static void assertDecodedCmp(
+   InputStream* is, MutationAlgorithm* algorithm, const char* expect)
+{
+   assert(is != NULL);
+   MutatorInputStream mis(is, true, algorithm, false);
+   ByteBuffer b(1024);
+   ByteArrayOutputStream baos(&b, true);
+   char buf[512];
+   int num;
+   while((num = mis.read(buf, 512)) > 0)
+   {
+      baos.write(buf, num);
+   }
+   assertNoExceptionSet();
+   string str(b.data(), b.length());
+   assertStrCmp(str.c_str(), expect);
+}
+
+/**
+ * Reads a stream to its end.
+ *
+ * @param is the stream to read, it will be deleted.
+ *
+ * @return the bytes read.
+ */
+static string readAll(InputStream* is)
+{
+   string rval;
+   assert(is != NULL);
+   char buf[512];
+   int num;
+   while((num = is->read(buf, 512)) > 0)
+   {
+      rval.append(buf, num);
+   }
+   assert(num == 0);
+   delete is;
+   return rval;
+}
+
+/**
+ * Renders a template file.
+ *
+ * @param filename the template file.
+ * @param vars the vars to use during template processing.
+ * @param cache the cache to use, NULL for none.
+ *
+ * @return the output.
+ */
+static string renderFile(
+   const char* filename, DynamicObject vars, TemplateCache* cache)
+{
+   TemplateInputStream tis(vars, true, NULL, false);
+   tis.setCache(cache);
+   assertNoException(tis.setTemplateFile(filename));
+   ByteBuffer output(2048);
+   ByteArrayOutputStream baos(&output, true);
+   assertNoException(tis.parse(&baos));
+   return string(output.data(), output.length());
+}
+
+static void runTemplateCacheTest(TestRunner& tr)
+{
+   tr.group("TemplateCache");
+
+   const char* content =
+      "The quick brown fox jumps over the lazy dog. "
+      "The quick brown fox jumps over the lazy dog.";
+
+   tr.test("encode and cache");
+   {
+      TemplateCache cache;
+      File file = File::createTempFile("test");
+      writeFile(file, content);
+
+      // gzip the file and cache the result
+      off_t length = 0;
+      InputStream* is = cache.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Gzip, &length);
+      assert(length > 0);
+      Gzipper gzipper;
+      gzipper.startDecompressing();
+      assertDecodedCmp(is, &gzipper, content);
+
+      // deflate the file
+      is = cache.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Deflate, &length);
+      Deflater deflater;
+      deflater.startInflating(false);
+      assertDecodedCmp(is, &deflater, content);
+
+      // cached variants are used once the file is gone
+      file->remove();
+      off_t cached = 0;
+      is = cache.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Deflate, &cached);
+      assert(cached == length);
+      deflater.startInflating(false);
+      assertDecodedCmp(is, &deflater, content);
+   }
+   tr.passIfNoException();
+
+   tr.test("gzip sibling");
+   {
+      TemplateCache cache;
+      File file = File::createTempFile("test");
+      writeFile(file, content);
+
+      // gzip different content into a sibling file
+      const char* other = "Precompressed content.";
+      string gzName = file->getAbsolutePath();
+      gzName.append(".gz");
+      File gzFile(gzName.c_str());
+      {
+         Gzipper gzipper;
+         gzipper.startCompressing();
+         ByteArrayInputStream bais(other, strlen(other));
+         MutatorInputStream mis(&bais, false, &gzipper, false);
+         FileOutputStream fos(gzFile);
+         char buf[512];
+         int num;
+         while((num = mis.read(buf, 512)) > 0)
+         {
+            fos.write(buf, num);
+         }
+         fos.close();
+      }
+      assertNoExceptionSet();
+
+      // the sibling is used as-is
+      off_t length = 0;
+      InputStream* is = cache.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Gzip, &length);
+      assert(length == gzFile->getLength());
+      Gzipper gzipper;
+      gzipper.startDecompressing();
+      assertDecodedCmp(is, &gzipper, other);
+
+      // a sibling older than the file is ignored
+      TemplateCache cache2;
+      struct utimbuf times;
+      times.actime = times.modtime =
+         file->getModifiedDate().getSeconds() - 60;
+      utime(gzName.c_str(), &times);
+      is = cache2.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Gzip);
+      gzipper.startDecompressing();
+      assertDecodedCmp(is, &gzipper, content);
+
+      gzFile->remove();
+      file->remove();
+   }
+   tr.passIfNoException();
+
+   tr.test("capacity");
+   {
+      // nothing is cached or encoded in an empty cache
+      TemplateCache cache(0);
+      File file = File::createTempFile("test");
+      writeFile(file, content);
+
+      off_t length = 0;
+      InputStream* is = cache.createEncodedStream(
+         file->getAbsolutePath(), TemplateCache::Gzip, &length);
+      assert(is == NULL);
+      is = cache.createStream(file->getAbsolutePath(), &length);
+      assert(is != NULL);
+      assert(length == (off_t)strlen(content));
+      delete is;
+
+      file->remove();
+      is = cache.createStream(file->getAbsolutePath(), &length);
+      assert(is == NULL);
+   }
+   tr.passIfNoException();
+
+   tr.test("eviction and invalidation");
+   {
+      // room for two files, checked every time they are used
+      int length = strlen(content);
+      TemplateCache cache(length * 2, 0);
+      File a = File::createTempFile("a");
+      File b = File::createTempFile("b");
+      File c = File::createTempFile("c");
+      writeFile(a, content);
+      writeFile(b, content);
+      writeFile(c, content);
+
+      // a is used last, so b is evicted to make room for c
+      readAll(cache.createStream(a->getAbsolutePath()));
+      readAll(cache.createStream(b->getAbsolutePath()));
+      readAll(cache.createStream(a->getAbsolutePath()));
+      InputStream* is = cache.createStream(b->getAbsolutePath());
+      readAll(cache.createStream(c->getAbsolutePath()));
+      DynamicObject stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 2);
+      assert(stats["used"]->getInt32() == length * 2);
+      assert(stats["hits"]->getUInt64() == 2);
+      assert(stats["misses"]->getUInt64() == 3);
+      assert(stats["evictions"]->getUInt64() == 1);
+
+      // an evicted file can still be read by its streams
+      assertStrCmp(readAll(is).c_str(), content);
+      readAll(cache.createStream(c->getAbsolutePath()));
+      stats = cache.getStats();
+      assert(stats["hits"]->getUInt64() == 3);
+
+      // cached data is shared
+      ByteBufferRef data1;
+      ByteBufferRef data2;
+      assert(cache.getData(a->getAbsolutePath(), data1));
+      assert(cache.getData(a->getAbsolutePath(), data2));
+      assert(data1 == data2);
+
+      // a changed file is read again, old data stays valid
+      writeFile(a, "Changed.");
+      struct utimbuf times;
+      times.actime = times.modtime = a->getModifiedDate().getSeconds() + 60;
+      utime(a->getAbsolutePath(), &times);
+      assertStrCmp(
+         readAll(cache.createStream(a->getAbsolutePath())).c_str(),
+         "Changed.");
+      assertStrCmp(
+         string(data1->data(), data1->length()).c_str(), content);
+      stats = cache.getStats();
+      assert(stats["invalidations"]->getUInt64() == 1);
+
+      // files can be invalidated and the cache cleared
+      cache.invalidate(a->getAbsolutePath());
+      stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 1);
+      cache.clear();
+      stats = cache.getStats();
+      assert(stats["entries"]->getUInt32() == 0);
+      assert(stats["used"]->getInt32() == 0);
+
+      // a file too large for the cache is read from disk
+      TemplateCache small(length - 1);
+      off_t len = 0;
+      assertStrCmp(
+         readAll(small.createStream(b->getAbsolutePath(), &len)).c_str(),
+         content);
+      assert(len == length);
+      assert(small.getStats()["entries"]->getUInt32() == 0);
+
+      a->remove();
+      b->remove();
+      c->remove();
+   }
+   tr.passIfNoException();
+
+   tr.test("parsed templates");
+   {
+      TemplateCache cache;
+      File inc = File::createTempFile("include");
+      writeFile(inc, "[{:set count=count+1}{count}]");
+      File file = File::createTempFile("test");
+      writeFile(file,
+         "Hello {name}!\n"
+         "{:each from=items as=item}{item.id}:{item.name|capitalize} {:end}"
+         "{:include file=inc}{:include file=inc}");
+
+      DynamicObject vars;
+      vars["name"] = "world";
+      vars["items"][0]["id"] = 1;
+      vars["items"][0]["name"] = "one";
+      vars["inc"] = inc->getAbsolutePath();
+      vars["count"] = 0;
+      string first = renderFile(file->getAbsolutePath(), vars, &cache);
+      assertStrCmp(first.c_str(), "Hello world!\n1:One [1][2]");
+
+      // other variables with the cached syntax trees
+      DynamicObject vars2 = vars.clone();
+      vars2["name"] = "again";
+      vars2["items"][1]["id"] = 2;
+      vars2["items"][1]["name"] = "two";
+      vars2["count"] = 5;
+      string second = renderFile(file->getAbsolutePath(), vars2, &cache);
+      assertStrCmp(second.c_str(), "Hello again!\n1:One 2:Two [6][7]");
+      DynamicObject stats = cache.getStats();
+      assert(stats["parsedHits"]->getUInt64() == 4);
+      assert(stats["parsedMisses"]->getUInt64() == 2);
+
+      // several streams can use the same template at once
+      TemplateInputStream tis1(vars, true, NULL, false);
+      tis1.setCache(&cache);
+      TemplateInputStream tis2(vars2, true, NULL, false);
+      tis2.setCache(&cache);
+      assertNoException(tis1.setTemplateFile(file->getAbsolutePath()));
+      assertNoException(tis2.setTemplateFile(file->getAbsolutePath()));
+      char b[100];
+      int num = tis2.read(b, 100);
+      assert(num > 0);
+      assertStrCmp(string(b, num).c_str(), "Hello again!\n1:One 2:Two [6][7]");
+      num = tis1.read(b, 100);
+      assert(num > 0);
+      assertStrCmp(string(b, num).c_str(), "Hello world!\n1:One [1][2]");
+      tis1.close();
+      tis2.close();
+
+      // a modified template is parsed again
+      writeFile(file, "Bye {name}.");
+      struct utimbuf times;
+      times.actime = times.modtime =
+         file->getModifiedDate().getSeconds() + 60;
+      utime(file->getAbsolutePath(), &times);
+      string third = renderFile(file->getAbsolutePath(), vars, &cache);
+      assertStrCmp(third.c_str(), "Bye world.");
+
+      // errors in a cached template are still reported
+      DynamicObject none;
+      TemplateInputStream tis(none, true, NULL, false);
+      tis.setCache(&cache);
+      assertNoException(tis.setTemplateFile(file->getAbsolutePath()));
+      assert(tis.read(b, 100) == -1);
+      assertExceptionSet();
+      Exception::clear();
+
+      inc->remove();
+      file->remove();
+      assertException(tis.setTemplateFile(file->getAbsolutePath()));
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+/**
+ * Records the writes and flushes made to an output stream.
+ */
+class FlushCountingOutputStream : public ByteArrayOutputStream
+{
+public:
+   int writes;
+   int flushes;
+   int largest;
+   FlushCountingOutputStream(ByteBuffer* b) :
+      ByteArrayOutputStream(b, true),
+      writes(0),
+      flushes(0),
+      largest(0)
+   {
+   }
+   virtual ~FlushCountingOutputStream() {}
+   virtual bool write(const char* b, int length)
+   {
+      ++writes;
+      largest = max(largest, length);
+      return ByteArrayOutputStream::write(b, length);
+   }
+   virtual bool flush()
+   {
+      ++flushes;
+      return ByteArrayOutputStream::flush();
+   }
+};
+
+static void runTemplateRenderTest(TestRunner& tr)
+{
+   tr.group("Template rendering");
+
+   tr.test("chunked flushes");
+   {
+      TemplateCache cache;
+      File inc = File::createTempFile("include");
+      writeFile(inc, "<{name}>");
+      File file = File::createTempFile("test");
+      string literal(300, 'x');
+      string tpl = literal;
+      tpl.append(
+         "{name}{:include file=inc}"
+         "{:include file=inc as=captured}[{captured}]{:ldelim}{:rdelim}"
+         "{:each from=items as=item}({item}){:end}");
+      writeFile(file, tpl.c_str());
+
+      DynamicObject vars;
+      vars["name"] = "page";
+      vars["inc"] = inc->getAbsolutePath();
+      string expect = literal;
+      expect.append("page<page>[<page>]{}");
+      for(int i = 0; i < 20; ++i)
+      {
+         vars["items"][i] = i;
+         expect.append(StringTools::format("(%d)", i));
+      }
+
+      // render twice, the second time from the cached syntax trees
+      for(int i = 0; i < 2; ++i)
+      {
+         ByteBuffer output(64);
+         FlushCountingOutputStream os(&output);
+         TemplateInputStream tis(vars, true, NULL, false);
+         tis.setCache(&cache);
+         assertNoException(tis.setTemplateFile(file->getAbsolutePath()));
+         assertNoException(tis.render(&os, 32));
+         assertStrCmp(
+            string(output.data(), output.length()).c_str(), expect.c_str());
+
+         // output is flushed as it is written, the long literal at once
+         assert(os.writes > 3);
+         assert(os.flushes == os.writes);
+         assert(os.largest == (int)literal.length());
+      }
+
+      inc->remove();
+      file->remove();
+   }
+   tr.passIfNoException();
+
+   tr.test("render after read");
+   {
+      DynamicObject vars;
+      vars["name"] = "world";
+      const char* tpl = "Hello {name}! Goodbye {name}.";
+      ByteArrayInputStream bais(tpl, strlen(tpl));
+      TemplateInputStream tis(vars, true, &bais, false);
+      char b[6];
+      assert(tis.read(b, 6) == 6);
+
+      // the rest of the output is rendered
+      ByteBuffer output(64);
+      ByteArrayOutputStream baos(&output, true);
+      assertNoException(tis.render(&baos));
+      string str(b, 6);
+      str.append(output.data(), output.length());
+      assertStrCmp(str.c_str(), "Hello world! Goodbye world.");
+      assert(tis.read(b, 6) == 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("errors");
+   {
+      // output before an error may have been written
+      DynamicObject vars;
+      const char* tpl = "Hello {name}!";
+      ByteArrayInputStream bais(tpl, strlen(tpl));
+      TemplateInputStream tis(vars, true, &bais, false);
+      ByteBuffer output(64);
+      ByteArrayOutputStream baos(&output, true);
+      assertException(tis.render(&baos, 1));
+      Exception::clear();
+      assertStrCmp(string(output.data(), output.length()).c_str(), "Hello ");
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runTemplateSpeedTest(TestRunner& tr)
+{
+   tr.group("Template speed");
+
+   tr.test("render a page");
+   {
+      // a typical page: text, loops, pipes and an include
+      File inc = File::createTempFile("include");
+      writeFile(inc, "<p>{title|escape}: {count} items</p>\n");
+      File file = File::createTempFile("page");
+      string page;
+      for(int i = 0; i < 50; ++i)
+      {
+         page.append(
+            "<h1>{title|escape}</h1>\n"
+            "<p>Some text about {title} that is {:if count > 2}long"
+            "{:else}short{:end}.</p>\n"
+            "<ul>{:each from=items as=item}"
+            "<li>{item.id}: {item.name|escape}</li>\n{:end}</ul>\n"
+            "{:include file=inc}");
+      }
+      writeFile(file, page.c_str());
+
+      DynamicObject vars;
+      vars["title"] = "A <page>";
+      vars["count"] = 3;
+      vars["inc"] = inc->getAbsolutePath();
+      for(int i = 0; i < 10; ++i)
+      {
+         vars["items"][i]["id"] = i;
+         vars["items"][i]["name"]->format("item %d", i);
+      }
+
+      // parse uncached and cached, then read cached in pieces
+      const char* modes[] = {"uncached", "cached", "cached read"};
+      int runs = 50;
+      for(int mode = 0; mode < 3; ++mode)
+      {
+         TemplateCache cache;
+         Timer t;
+         t.start();
+         string output;
+         for(int i = 0; i < runs; ++i)
+         {
+            if(mode < 2)
+            {
+               output = renderFile(
+                  file->getAbsolutePath(), vars, (mode == 1) ? &cache : NULL);
+            }
+            else
+            {
+               TemplateInputStream* tis =
+                  new TemplateInputStream(vars, true, NULL, false);
+               tis->setCache(&cache);
+               assertNoException(
+                  tis->setTemplateFile(file->getAbsolutePath()));
+               output = readAll(tis);
+            }
+         }
+         double secs = t.getElapsedSeconds();
+         printf("%s %d bytes in %0.5f secs... ",
+            modes[mode], (int)output.length(), secs / runs);
+      }
+
+      inc->remove();
+      file->remove();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static bool run(TestRunner& tr)
 {
    if(tr.isDefaultEnabled() || tr.isTestEnabled("template-input-stream"))
    {
       runTemplateInputStreamTest(tr);
    }
+   if(tr.isDefaultEnabled() || tr.isTestEnabled("template-cache"))
+   {
+      runTemplateCacheTest(tr);
+   }
+   if(tr.isDefaultEnabled() || tr.isTestEnabled("template-render"))
+   {
+      runTemplateRenderTest(tr);
+   }
+   if(tr.isTestEnabled("template-speed"))
+   {
+      runTemplateSpeedTest(tr);
+   }
    return true;
 }
 
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_FORMAT_MACROS
 
@@ -11,6 +11,7 @@
 #include "monarch/util/Convert.h"
 #include "monarch/util/Crc16.h"
 #include "monarch/util/Date.h"
+#include "monarch/util/Histogram.h"
 #include "monarch/util/PathFormatter.h"
 #include "monarch/util/Pattern.h"
 #include "monarch/util/Random.h"
@@ -1270,6 +1271,94 @@ static void runUniqueListTest(TestRunner& tr)
    tr.passIfNoException();
 }
 
+static void runHistogramTest(TestRunner& tr)
+{
+   tr.group("Histogram");
+
+   tr.test("buckets");
+   {
+      // small values are exact, larger ones keep 1/16 precision
+      assert(Histogram::getBucketIndex(0) == 0);
+      assert(Histogram::getBucketIndex(31) == 31);
+      assert(Histogram::getBucketValue(31) == 31);
+      for(uint64_t v = 1; v < 1000000; v = v * 3 + 1)
+      {
+         uint64_t top = Histogram::getBucketValue(
+            Histogram::getBucketIndex(v));
+         assert(top >= v && top - v <= v / 16);
+      }
+      assert(Histogram::getBucketIndex(UINT64_C(1) << 35) <
+         Histogram::BucketCount);
+   }
+   tr.passIfNoException();
+
+   tr.test("percentiles");
+   {
+      Histogram h;
+      assert(h.getCount() == 0);
+      assert(h.getMin() == 0);
+      assert(h.getValueAtPercentile(50) == 0);
+
+      for(uint64_t v = 1; v <= 1000; ++v)
+      {
+         h.record(v);
+      }
+      assert(h.getCount() == 1000);
+      assert(h.getMin() == 1);
+      assert(h.getMax() == 1000);
+      assert(h.getMean() == 500.5);
+      uint64_t p50 = h.getValueAtPercentile(50);
+      uint64_t p99 = h.getValueAtPercentile(99);
+      assert(p50 >= 500 && p50 <= 500 + 500 / 16);
+      assert(p99 >= 990 && p99 <= 1000);
+      assert(h.getValueAtPercentile(100) == 1000);
+   }
+   tr.passIfNoException();
+
+   tr.test("merge");
+   {
+      Histogram h1;
+      Histogram h2;
+      h1.record(10);
+      h2.record(5);
+      h2.record(20);
+      h1.merge(h2);
+      assert(h1.getCount() == 3);
+      assert(h1.getMin() == 5);
+      assert(h1.getMax() == 20);
+      assert(h1.getValueAtPercentile(50) == 10);
+   }
+   tr.passIfNoException();
+
+   tr.test("serialize");
+   {
+      Histogram h1;
+      for(uint64_t v = 1; v < 100000; v *= 2)
+      {
+         h1.record(v);
+      }
+      string data;
+      h1.serialize(data);
+
+      Histogram h2;
+      assert(h2.deserialize(data.c_str(), data.length()) ==
+         (int)data.length());
+      assert(h2.getCount() == h1.getCount());
+      assert(h2.getMin() == h1.getMin());
+      assert(h2.getMax() == h1.getMax());
+      assert(h2.getMean() == h1.getMean());
+      assert(h2.getValueAtPercentile(90) == h1.getValueAtPercentile(90));
+
+      // truncated data is rejected
+      Histogram h3;
+      assert(h3.deserialize(data.c_str(), data.length() - 1) == 0);
+      assert(h3.getCount() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runPathFormatterTest(TestRunner& tr)
 {
    tr.test("PathFormatter");
@@ -1997,6 +2086,7 @@ static bool run(TestRunner& tr)
       runConvertTest(tr);
       runStringTokenizerTest(tr);
       runUniqueListTest(tr);
+      runHistogramTest(tr);
       runRegexTest(tr);
       runStringToolsTest(tr);
       runDateTest(tr);
@@ -1,9 +1,11 @@
 /*
- * Copyright (c) 2007-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2007-2012 Digital Bazaar, Inc. All rights reserved.
  */
 
 #include "monarch/test/Test.h"
 #include "monarch/test/TestModule.h"
+#include "monarch/data/json/JsonReader.h"
+#include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/rt/DynamicObject.h"
 #include "monarch/validation/Validation.h"
 
@@ -11,6 +13,8 @@
 
 using namespace std;
 using namespace monarch::test;
+using namespace monarch::data::json;
+using namespace monarch::io;
 using namespace monarch::rt;
 namespace v = monarch::validation;
 
@@ -1885,6 +1889,67 @@ static void runAnyExceptionsTest(TestRunner& tr)
    tr.ungroup();
 }
 
+static void runJsonStreamValidatorTest(TestRunner& tr)
+{
+   tr.group("JsonStreamValidator");
+
+   // a large array of items
+   string json = "{\"count\":10000,\"items\":[";
+   for(int i = 0; i < 10000; ++i)
+   {
+      char item[100];
+      snprintf(item, 100, "%s{\"id\":%d,\"name\":\"item %d\"}",
+         (i > 0) ? "," : "", i, i);
+      json.append(item);
+   }
+   json.append("]}");
+
+   v::ValidatorRef itemValidator = new v::Map(
+      "id", new v::Type(UInt64),
+      "name", new v::Type(String),
+      NULL);
+   v::ValidatorRef countValidator = new v::Type(UInt64);
+
+   tr.test("valid");
+   {
+      v::JsonStreamValidator sv;
+      assertNoException(sv.addValidator("items[*]", itemValidator));
+      assertNoException(sv.addValidator("count", countValidator, true));
+      JsonReader jr;
+      ByteArrayInputStream is(json.c_str(), json.length());
+      assertNoException(jr.start(&sv) && jr.read(&is) && jr.finish());
+      assert(sv.getValidCount() == 10001);
+
+      // only kept values remain
+      assert(sv.getValues()->length() == 1);
+      assert(sv.getValues()["count"]->getUInt32() == 10000);
+   }
+   tr.passIfNoException();
+
+   tr.test("invalid");
+   {
+      // break one item
+      size_t pos = json.find("\"id\":1234,");
+      string bad = json;
+      bad.replace(pos, 10, "\"id\":\"x\",");
+
+      v::JsonStreamValidator sv;
+      assertNoException(sv.addValidator("items[*]", itemValidator));
+      JsonReader jr;
+      ByteArrayInputStream is(bad.c_str(), bad.length());
+      assertException(jr.start(&sv) && jr.read(&is));
+      ExceptionRef e = Exception::get()->getCause();
+      if(_dump) dumpException(e);
+      assertStrCmp(e->getType(), "monarch.validation.ValidationError");
+      assert(e->getDetails()["errors"]->hasMember("items[1234].id"));
+      assert(sv.getValidCount() == 1234);
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 #undef _dump
 
 static bool run(TestRunner& tr)
@@ -1893,6 +1958,7 @@ static bool run(TestRunner& tr)
    {
       runValidatorTest(tr);
       runValidatorFactoryTest(tr);
+      runJsonStreamValidatorTest(tr);
    }
    if(tr.isTestEnabled("any-exception"))
    {
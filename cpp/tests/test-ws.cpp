@@ -1,11 +1,16 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_FORMAT_MACROS
 
+#include "monarch/data/json/JsonReader.h"
+#include "monarch/data/json/JsonStreamWriter.h"
 #include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/msgpack/MessagePackReader.h"
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/io/ByteArrayOutputStream.h"
+#include "monarch/io/File.h"
+#include "monarch/io/FileOutputStream.h"
 #include "monarch/modest/Kernel.h"
 #include "monarch/http/HttpHeader.h"
 #include "monarch/http/HttpRequest.h"
@@ -13,8 +18,11 @@
 #include "monarch/http/HttpConnectionServicer.h"
 #include "monarch/http/HttpRequestServicer.h"
 #include "monarch/http/HttpClient.h"
+#include "monarch/net/Internet6Address.h"
 #include "monarch/net/Server.h"
+#include "monarch/rt/RunnableDelegate.h"
 #include "monarch/rt/System.h"
+#include "monarch/rt/Thread.h"
 #include "monarch/rt/DynamicObject.h"
 #include "monarch/rt/DynamicObjectIterator.h"
 #include "monarch/test/Test.h"
@@ -22,14 +30,19 @@
 #include "monarch/util/Date.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/util/Url.h"
+#include "monarch/ws/IpAuthenticator.h"
 #include "monarch/ws/PathHandlerDelegate.h"
+#include "monarch/ws/ProxyPathHandler.h"
 #include "monarch/ws/RequestAuthenticatorDelegate.h"
+#include "monarch/ws/ResponseCache.h"
 #include "monarch/ws/RestfulHandler.h"
 #include "monarch/ws/WebServer.h"
 
 using namespace std;
 using namespace monarch::config;
+using namespace monarch::data;
 using namespace monarch::data::json;
+using namespace monarch::data::msgpack;
 using namespace monarch::http;
 using namespace monarch::io;
 using namespace monarch::modest;
@@ -252,6 +265,180 @@ static void _checkUrlText(
    assertNoExceptionSet();
 }
 
+/**
+ * Exposes RestfulHandler dispatch for testing.
+ */
+class TestRestfulHandler : public RestfulHandler
+{
+public:
+   PathHandler* find(ServiceChannel* ch)
+   {
+      HandlerInfo* info = findHandler(ch);
+      return (info == NULL) ? NULL : &(*info->handler);
+   }
+};
+
+/**
+ * Dispatches a request for a method and path to a handler.
+ */
+static PathHandler* _dispatch(
+   TestRestfulHandler& rh, const char* method, const char* path)
+{
+   HttpRequest request(NULL);
+   request.getHeader()->setMethod(method);
+   HttpResponse response(&request);
+   ServiceChannel ch(path);
+   ch.setBasePath("/api");
+   ch.setRequest(&request);
+   ch.setResponse(&response);
+   return rh.find(&ch);
+}
+
+static void runRestfulHandlerTest(TestRunner& tr)
+{
+   tr.group("RestfulHandler");
+
+   TestRestfulHandler rh;
+   PathHandlerRef getRoot = new PathHandler();
+   PathHandlerRef getOne = new PathHandler();
+   PathHandlerRef postOne = new PathHandler();
+   PathHandlerRef getAny = new PathHandler();
+   PathHandlerRef getAction = new PathHandler();
+   PathHandlerRef getActionFoo = new PathHandler();
+   PathHandlerRef getRegex = new PathHandler();
+   rh.addHandler(getRoot, Message::Get, 0);
+   rh.addHandler(getOne, Message::Get, 1);
+   rh.addHandler(postOne, Message::Post, 1);
+   rh.addHandler(getAny, Message::Get, -1);
+   DynamicObject query;
+   query["action"] = "";
+   rh.addHandler(getAction, Message::Get, 2, &query);
+   query["action"] = "foo";
+   query["format"] = "json";
+   rh.addHandler(getActionFoo, Message::Get, 2, &query);
+   rh.addRegexHandler("^/regex/([0-9]+)$", getRegex, Message::Put);
+
+   tr.test("param count");
+   {
+      assert(_dispatch(rh, "GET", "/api") == &(*getRoot));
+      assert(_dispatch(rh, "GET", "/api/a") == &(*getOne));
+      assert(_dispatch(rh, "POST", "/api/a?x=1") == &(*postOne));
+      assert(_dispatch(rh, "GET", "/api/a/b/c") == &(*getAny));
+   }
+   tr.passIfNoException();
+
+   tr.test("query");
+   {
+      assert(_dispatch(rh, "GET", "/api/a/b?action=bar") == &(*getAction));
+      assert(_dispatch(rh, "GET", "/api/a/b?action=foo&format=json") ==
+         &(*getActionFoo));
+      assert(_dispatch(rh, "GET", "/api/a/b?format=json") ==
+         &(*getActionFoo));
+      assert(_dispatch(rh, "GET", "/api/a/b") == &(*getAction));
+   }
+   tr.passIfNoException();
+
+   tr.test("regex");
+   {
+      assert(_dispatch(rh, "PUT", "/api/regex/12") == &(*getRegex));
+   }
+   tr.passIfNoException();
+
+   tr.test("method not allowed");
+   {
+      TestRestfulHandler one;
+      one.addHandler(getOne, Message::Get, 1);
+      one.addHandler(postOne, Message::Post, 1);
+      assert(_dispatch(one, "DELETE", "/api/a") == NULL);
+      ExceptionRef e = Exception::get();
+      assertStrCmp(e->getType(), "monarch.ws.MethodNotAllowed");
+      assert(e->getDetails()["validMethods"]->length() == 2);
+      assertStrCmp(e->getDetails()["validMethods"][0]->getString(), "GET");
+      assertStrCmp(e->getDetails()["validMethods"][1]->getString(), "POST");
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.test("not found");
+   {
+      TestRestfulHandler empty;
+      assert(_dispatch(empty, "GET", "/api") == NULL);
+      assertStrCmp(
+         Exception::get()->getType(), "monarch.ws.ResourceNotFound");
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+static void runRestfulHandlerPerfTest(TestRunner& tr)
+{
+   tr.group("RestfulHandler perf");
+
+   // register 500 handlers: 100 param counts, each with 4 methods and a
+   // query-specific GET handler
+   TestRestfulHandler rh;
+   Message::MethodType methods[] =
+      {Message::Get, Message::Post, Message::Put, Message::Delete};
+   vector<PathHandlerRef> handlers;
+   for(int count = 0; count < 100; ++count)
+   {
+      for(int m = 0; m < 4; ++m)
+      {
+         PathHandlerRef h = new PathHandler();
+         handlers.push_back(h);
+         rh.addHandler(h, methods[m], count);
+      }
+      DynamicObject query;
+      query["action"] = "list";
+      PathHandlerRef h = new PathHandler();
+      handlers.push_back(h);
+      rh.addHandler(h, Message::Get, count, &query);
+   }
+   assert(handlers.size() == 500);
+
+   // build request paths with varying param counts
+   const int paths = 100;
+   string path[paths];
+   for(int i = 0; i < paths; ++i)
+   {
+      path[i] = "/api";
+      for(int n = 0; n < i; ++n)
+      {
+         path[i].append("/seg");
+      }
+      if(i % 2 == 0)
+      {
+         path[i].append("?action=list&page=2");
+      }
+   }
+
+   tr.test("dispatch");
+   {
+      int iterations = 100000;
+      HttpRequest request(NULL);
+      HttpResponse response(&request);
+      const char* method[] = {"GET", "POST", "PUT", "DELETE"};
+      uint64_t start = System::getCurrentMilliseconds();
+      for(int i = 0; i < iterations; ++i)
+      {
+         request.getHeader()->setMethod(method[i % 4]);
+         ServiceChannel ch(path[i % paths].c_str());
+         ch.setBasePath("/api");
+         ch.setRequest(&request);
+         ch.setResponse(&response);
+         assert(rh.find(&ch) != NULL);
+      }
+      uint64_t dt = System::getCurrentMilliseconds() - start;
+      printf("%d dispatches in %" PRIu64 " ms (%.0f dispatches/s) ... ",
+         iterations, dt, iterations / (dt == 0 ? 0.001 : dt / 1000.0));
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
 static void runWebServerTest(TestRunner& tr)
 {
    const char* path = "/test";
@@ -355,12 +542,917 @@ static void runWebServerTest(TestRunner& tr)
    k.getEngine()->stop();
 }
 
+class TestUpstreamService;
+typedef PathHandlerDelegate<TestUpstreamService> UpstreamHandler;
+
+class TestUpstreamService : public WebService
+{
+public:
+   TestUpstreamService(const char* path) : WebService(path)
+   {
+   }
+
+   virtual ~TestUpstreamService()
+   {
+   }
+
+   virtual bool initialize()
+   {
+      // handle all paths, content is received by the handler
+      PathHandlerRef h = new UpstreamHandler(
+         this, &TestUpstreamService::handleRequest);
+      addHandler("/", h);
+      return true;
+   }
+
+   virtual void cleanup()
+   {
+   }
+
+   virtual void handleRequest(ServiceChannel* ch)
+   {
+      if(ch->getRequest()->getHeader()->hasContent())
+      {
+         handlePost(ch);
+      }
+      else
+      {
+         handleGet(ch);
+      }
+   }
+
+   virtual void handleGet(ServiceChannel* ch)
+   {
+      // send 200 OK with the request path, keep connection alive
+      string path = ch->getRequest()->getHeader()->getPath();
+      HttpResponseHeader* h = ch->getResponse()->getHeader();
+      h->setStatus(200, "OK");
+      h->setField("Content-Type", "text/plain");
+      h->setField("Content-Length", path.length());
+      setKeepAlive(ch);
+      ch->getResponse()->sendHeader();
+
+      ByteArrayInputStream bais(path.c_str(), path.length());
+      ch->getResponse()->sendBody(&bais);
+      ch->setSent();
+   }
+
+   virtual void handlePost(ServiceChannel* ch)
+   {
+      // echo the request body using chunked encoding
+      ByteBuffer b;
+      ByteArrayOutputStream baos(&b);
+      ch->getRequest()->receiveBody(&baos);
+
+      HttpResponseHeader* h = ch->getResponse()->getHeader();
+      h->setStatus(200, "OK");
+      h->setField("Content-Type", "text/plain");
+      h->setField("Transfer-Encoding", "chunked");
+      setKeepAlive(ch);
+      ch->getResponse()->sendHeader();
+
+      ByteArrayInputStream bais(&b);
+      ch->getResponse()->sendBody(&bais);
+      ch->setSent();
+   }
+};
+
+class TestProxyService : public WebService
+{
+public:
+   RestfulHandlerRef mHandler;
+   TestProxyService(const char* path, RestfulHandlerRef& handler) :
+      WebService(path),
+      mHandler(handler)
+   {
+   }
+
+   virtual ~TestProxyService()
+   {
+   }
+
+   virtual bool initialize()
+   {
+      PathHandlerRef h = mHandler;
+      addHandler("/", h);
+      return true;
+   }
+
+   virtual void cleanup()
+   {
+   }
+};
+
+/**
+ * Waits for a proxy to finish with its connections, since a proxied response
+ * may be received before the proxy has returned its connection to the pool.
+ */
+static DynamicObject _waitForProxy(ProxyPathHandler* proxy)
+{
+   DynamicObject stats = proxy->getStats();
+   for(int i = 0; i < 100 && stats[0]["active"]->getUInt32() != 0; ++i)
+   {
+      Thread::sleep(10);
+      stats = proxy->getStats();
+   }
+   return stats;
+}
+
+static void runProxyPathHandlerTest(TestRunner& tr)
+{
+   tr.group("ProxyPathHandler");
+
+   // create kernel
+   Kernel k;
+   k.getEngine()->getThreadPool()->setThreadStackSize(131072);
+   k.getEngine()->start();
+
+   // create server
+   Server server;
+   WebServer ws;
+   Config cfg;
+   cfg["host"] = "localhost";
+   cfg["port"] = 0;
+   cfg["security"] = "off";
+   WebServiceContainerRef wsc = new WebServiceContainer();
+   ws.setContainer(wsc);
+   ws.initialize(cfg);
+
+   // proxy "/proxy" to "/upstream" on the same server and "/down" to a
+   // server that isn't running
+   ProxyPathHandler* proxy = new ProxyPathHandler("/proxy");
+   ProxyPathHandler* down = new ProxyPathHandler("/down");
+   RestfulHandlerRef proxyRef = proxy;
+   RestfulHandlerRef downRef = down;
+   WebServiceRef upstream = new TestUpstreamService("/upstream");
+   WebServiceRef proxyService = new TestProxyService("/proxy", proxyRef);
+   WebServiceRef downService = new TestProxyService("/down", downRef);
+   wsc->addService(upstream, WebService::Both);
+   wsc->addService(proxyService, WebService::Both);
+   wsc->addService(downService, WebService::Both);
+   ws.enable(&server);
+   assertNoException(server.start(&k));
+
+   int port = ws.getHostAddress()->getPort();
+   string upstreamUrl = StringTools::format(
+      "http://localhost:%d/upstream", port);
+   proxy->addProxyRule("*", "*", upstreamUrl.c_str(), false);
+   down->addProxyRule("*", "*", "http://localhost:1/upstream", false);
+
+   tr.test("keep-alive reuse");
+   {
+      for(int i = 0; i < 5; ++i)
+      {
+         Url url;
+         url.format("http://localhost:%d/proxy/item/%d", port, i);
+         string expect = StringTools::format("/upstream/proxy/item/%d", i);
+         _checkUrlText(tr, &url, 200, expect.c_str(), expect.length());
+         _waitForProxy(proxy);
+      }
+
+      DynamicObject stats = proxy->getStats();
+      assert(stats->length() == 1);
+      assertStrCmp(stats[0]["type"]->getString(), "proxy");
+      assert(stats[0]["requests"]->getUInt64() == 5);
+      assert(stats[0]["connectionsCreated"]->getUInt64() == 1);
+      assert(stats[0]["connectionsReused"]->getUInt64() == 4);
+      assert(stats[0]["active"]->getUInt32() == 0);
+      assert(stats[0]["idle"]->getInt32() == 1);
+      assert(stats[0]["errors"]->getUInt64() == 0);
+   }
+   tr.passIfNoException();
+
+   tr.test("stream request body");
+   {
+      string data;
+      for(int i = 0; i < 4096; ++i)
+      {
+         data.append("0123456789abcdef");
+      }
+
+      Url url;
+      url.format("http://localhost:%d/proxy/echo", port);
+      HttpClient client;
+      assertNoException(client.connect(&url));
+      DynamicObject headers;
+      headers["Content-Type"] = "text/plain";
+      headers["Content-Length"] = (uint64_t)data.length();
+      HttpResponse* response = client.post(&url, &headers, data.c_str());
+      assert(response != NULL);
+      assert(response->getHeader()->getStatusCode() == 200);
+      string content;
+      assertNoException(client.receiveContent(content));
+      assert(content == data);
+      client.disconnect();
+
+      DynamicObject stats = _waitForProxy(proxy);
+      assert(stats[0]["connectionsCreated"]->getUInt64() == 1);
+      assert(stats[0]["connectionsReused"]->getUInt64() == 5);
+      assert(stats[0]["idle"]->getInt32() == 1);
+   }
+   tr.passIfNoException();
+
+   tr.test("expire idle connections");
+   {
+      proxy->getConnectionPool()->setMaxIdleConnections(0);
+      proxy->getConnectionPool()->setIdleTimeout(1);
+      Thread::sleep(10);
+
+      Url url;
+      url.format("http://localhost:%d/proxy/expired", port);
+      string expect = "/upstream/proxy/expired";
+      _checkUrlText(tr, &url, 200, expect.c_str(), expect.length());
+
+      DynamicObject stats = _waitForProxy(proxy);
+      assert(stats[0]["connectionsCreated"]->getUInt64() == 2);
+      assert(stats[0]["connectionsReused"]->getUInt64() == 5);
+   }
+   tr.passIfNoException();
+
+   tr.test("server down");
+   {
+      Url url;
+      url.format("http://localhost:%d/down/foo", port);
+      HttpClient client;
+      assertNoException(client.connect(&url));
+      HttpResponse* response = client.get(&url);
+      assert(response != NULL);
+      assert(response->getHeader()->getStatusCode() >= 500);
+      string content;
+      client.receiveContent(content);
+      client.disconnect();
+      Exception::clear();
+
+      DynamicObject stats = _waitForProxy(down);
+      assert(stats[0]["requests"]->getUInt64() == 1);
+      assert(
+         stats[0]["unavailable"]->getUInt64() +
+         stats[0]["errors"]->getUInt64() == 1);
+      assert(stats[0]["idle"]->getInt32() == 0);
+      assert(stats[0]["active"]->getUInt32() == 0);
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
+/**
+ * Checks addresses against an IpAuthenticator whose rules are being
+ * replaced by another thread.
+ */
+static void _checkIpAddresses(void* auth)
+{
+   InternetAddress allowed("10.1.0.1", 80);
+   InternetAddress denied("10.2.0.1", 80);
+   for(int i = 0; i < 5000; ++i)
+   {
+      assert(((IpAuthenticator*)auth)->isAllowed(&allowed));
+      assert(!((IpAuthenticator*)auth)->isAllowed(&denied));
+   }
+}
+
+static void runIpAuthenticatorTest(TestRunner& tr)
+{
+   tr.group("IpAuthenticator");
+
+   tr.test("ranges and regexes");
+   {
+      IpAuthenticator auth;
+      Config config;
+      config["allow"]->append() = "10.0.0.0/8";
+      config["allow"]->append() = "2001:db8::/32";
+      config["allow"]->append() = "^192\\.168\\.1\\.";
+      config["deny"]->append() = "10.1.0.0/16";
+      config["deny"]->append() = "192.168.1.66";
+      assert(auth.initializeFromConfig(config));
+
+      InternetAddress a("10.2.3.4", 80);
+      assert(auth.isAllowed(&a));
+      a.setAddress("10.1.3.4");
+      assert(!auth.isAllowed(&a));
+      a.setAddress("11.0.0.1");
+      assert(!auth.isAllowed(&a));
+      a.setAddress("192.168.1.7");
+      assert(auth.isAllowed(&a));
+      a.setAddress("192.168.1.66");
+      assert(!auth.isAllowed(&a));
+
+      Internet6Address a6("2001:db8::1", 80);
+      assert(auth.isAllowed(&a6));
+      a6.setAddress("2001:db9::1");
+      assert(!auth.isAllowed(&a6));
+
+      // IPv4-mapped addresses match IPv4 ranges
+      a6.setAddress("::ffff:10.2.3.4");
+      assert(auth.isAllowed(&a6));
+      a6.setAddress("::ffff:10.1.3.4");
+      assert(!auth.isAllowed(&a6));
+
+      // invalid ranges are rejected
+      assert(!auth.addDenyRange("10.0.0.0/33"));
+      assertExceptionSet();
+      Exception::clear();
+   }
+   tr.passIfNoException();
+
+   tr.test("reload");
+   {
+      IpAuthenticator auth;
+      InternetAddress a("10.2.3.4", 80);
+      assert(auth.isAllowed(&a));
+
+      assert(auth.addDenyRange("10.2.0.0/16"));
+      assert(!auth.isAllowed(&a));
+
+      // reloading replaces the rules
+      Config config;
+      config["deny"]->append() = "10.3.0.0/16";
+      assert(auth.initializeFromConfig(config));
+      assert(auth.isAllowed(&a));
+      a.setAddress("10.3.0.1");
+      assert(!auth.isAllowed(&a));
+
+      // private config
+      Config pub;
+      pub["public"] = false;
+      Config priv;
+      priv["allow"]->append() = "127.0.0.1";
+      assert(auth.initializeFromConfig(pub, &priv));
+      assert(!auth.isAllowed(&a));
+      a.setAddress("127.0.0.1");
+      assert(auth.isAllowed(&a));
+   }
+   tr.passIfNoException();
+
+   tr.test("concurrent reload");
+   {
+      IpAuthenticator auth;
+      Config config;
+      config["allow"]->append() = "10.1.0.0/16";
+      config["deny"]->append() = "10.2.0.0/16";
+      assert(auth.initializeFromConfig(config));
+
+      // replace the rules with equal ones while they are in use
+      RunnableRef r = new RunnableDelegate<void>(_checkIpAddresses, &auth);
+      Thread* threads[4];
+      for(int i = 0; i < 4; ++i)
+      {
+         threads[i] = new Thread(r);
+         threads[i]->start();
+      }
+      for(int i = 0; i < 500; ++i)
+      {
+         assert(auth.initializeFromConfig(config));
+      }
+      for(int i = 0; i < 4; ++i)
+      {
+         threads[i]->join();
+         delete threads[i];
+      }
+   }
+   tr.passIfNoException();
+
+   tr.ungroup();
+}
+
+class TestCachedService;
+typedef PathHandlerDelegate<TestCachedService> CachedHandler;
+
+class TestCachedService : public WebService
+{
+public:
+   ResponseCacheRef mCache;
+   int mCount;
+   TemplateCache mFiles;
+   string mFilename;
+   TestCachedService(const char* path, ResponseCacheRef& cache) :
+      WebService(path),
+      mCache(cache),
+      mCount(0)
+   {
+   }
+
+   virtual ~TestCachedService()
+   {
+   }
+
+   virtual bool initialize()
+   {
+      PathHandlerRef h = new CachedHandler(
+         this, &TestCachedService::handleRequest);
+      h->setResponseCache(mCache);
+      addHandler("/item", h);
+      h = new CachedHandler(this, &TestCachedService::handleFile);
+      addHandler("/file", h);
+      return true;
+   }
+
+   virtual void cleanup()
+   {
+   }
+
+   virtual void handleRequest(ServiceChannel* ch)
+   {
+      if(ch->getRequestMethod() == Message::Post)
+      {
+         // pretend to modify the item
+         DynamicObject content;
+         ch->receiveContent(content);
+         ch->sendNoContent();
+      }
+      else
+      {
+         // count the times the content was generated
+         DynamicObject item;
+         item["count"] = ++mCount;
+         item["path"] = ch->getPath();
+         item["text"] = string(200, 'x').c_str();
+         ch->sendContent(item);
+      }
+   }
+
+   virtual void handleFile(ServiceChannel* ch)
+   {
+      if(!ch->sendFile(mFilename.c_str(), &mFiles))
+      {
+         ExceptionRef e = Exception::get();
+         ch->sendException(e, true);
+      }
+   }
+};
+
+/**
+ * Sends a request to a cached service and receives its response.
+ */
+static void _cachedRequest(
+   int port, const char* method, const char* path, DynamicObject* headers,
+   int code, HttpResponseHeader& header, string& body)
+{
+   Url url;
+   url.format("http://localhost:%d%s", port, path);
+   HttpClient client;
+   assertNoException(client.connect(&url));
+   HttpResponse* response = (strcmp(method, "GET") == 0) ?
+      client.get(&url, headers) : client.post(&url, headers, "{}");
+   assert(response != NULL);
+   header.clearFields();
+   response->getHeader()->writeTo(&header);
+   if(header.getStatusCode() != code)
+   {
+      printf("Expecting response status code: %d, got %d\n",
+         code, header.getStatusCode());
+   }
+   assert(header.getStatusCode() == code);
+
+   // only receive content from responses that have it
+   body.clear();
+   if(code == 200)
+   {
+      assertNoException(client.receiveContent(body));
+   }
+   client.disconnect();
+}
+
+static void runResponseCacheTest(TestRunner& tr)
+{
+   tr.group("ResponseCache");
+
+   // create kernel
+   Kernel k;
+   k.getEngine()->getThreadPool()->setThreadStackSize(131072);
+   k.getEngine()->start();
+
+   // create server
+   Server server;
+   WebServer ws;
+   Config cfg;
+   cfg["host"] = "localhost";
+   cfg["port"] = 0;
+   cfg["security"] = "off";
+   WebServiceContainerRef wsc = new WebServiceContainer();
+   ws.setContainer(wsc);
+   ws.initialize(cfg);
+   ResponseCacheRef cache = new ResponseCache();
+   TestCachedService* service = new TestCachedService("/cached", cache);
+   WebServiceRef serviceRef = service;
+   wsc->addService(serviceRef, WebService::Both);
+   ws.enable(&server);
+   assertNoException(server.start(&k));
+
+   int port = ws.getHostAddress()->getPort();
+
+   HttpResponseHeader header;
+   string body;
+   string etag;
+   tr.test("hit");
+   {
+      _cachedRequest(port, "GET", "/cached/item", NULL, 200, header, body);
+      assert(service->mCount == 1);
+      assert(header.getField("ETag", etag));
+      assert(header.hasField("Last-Modified"));
+      string first = body;
+
+      // second request is answered from the cache
+      _cachedRequest(port, "GET", "/cached/item", NULL, 200, header, body);
+      assert(service->mCount == 1);
+      assertStrCmp(body.c_str(), first.c_str());
+      assertStrCmp(header.getFieldValue("ETag").c_str(), etag.c_str());
+
+      // a different query is cached separately
+      _cachedRequest(port, "GET", "/cached/item?a=1", NULL, 200, header, body);
+      assert(service->mCount == 2);
+
+      DynamicObject stats = cache->getStats();
+      assert(stats["hits"]->getUInt64() == 1);
+      assert(stats["misses"]->getUInt64() == 2);
+      assert(stats["entries"]->getUInt32() == 2);
+   }
+   tr.passIfNoException();
+
+   tr.test("conditional");
+   {
+      DynamicObject headers;
+      headers["If-None-Match"] = etag.c_str();
+      _cachedRequest(
+         port, "GET", "/cached/item", &headers, 304, header, body);
+      assertStrCmp(header.getFieldValue("ETag").c_str(), etag.c_str());
+
+      headers->clear();
+      headers["If-None-Match"] = "\"other\"";
+      _cachedRequest(
+         port, "GET", "/cached/item", &headers, 200, header, body);
+
+      headers->clear();
+      headers["If-Modified-Since"] =
+         header.getFieldValue("Last-Modified").c_str();
+      _cachedRequest(
+         port, "GET", "/cached/item", &headers, 304, header, body);
+      assert(service->mCount == 2);
+      assert(cache->getStats()["notModified"]->getUInt64() == 2);
+
+      // every HTTP-date format is understood, only in GMT
+      const char* dates[] = {
+         "Sun, 06 Nov 2044 08:49:37 GMT",
+         "Sunday, 06-Nov-44 08:49:37 GMT",
+         "Sun Nov  6 08:49:37 2044",
+         "Sat, 06 Nov 1999 08:49:37 GMT",
+         "Sun, 06 Nov 2044 08:49:37 EST",
+         "not a date"};
+      int codes[] = {304, 304, 304, 200, 200, 200};
+      for(int i = 0; i < 6; ++i)
+      {
+         headers->clear();
+         headers["If-Modified-Since"] = dates[i];
+         _cachedRequest(
+            port, "GET", "/cached/item", &headers, codes[i], header, body);
+      }
+      assert(service->mCount == 2);
+      assert(cache->getStats()["notModified"]->getUInt64() == 5);
+   }
+   tr.passIfNoException();
+
+   tr.test("gzip variant");
+   {
+      DynamicObject headers;
+      headers["Accept-Encoding"] = "gzip";
+      _cachedRequest(
+         port, "GET", "/cached/item", &headers, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Encoding").c_str(), "gzip");
+      assert(header.getFieldValue("Content-Length") ==
+         StringTools::format("%d", (int)body.length()));
+      assert(body.length() < 200);
+      assert(service->mCount == 2);
+   }
+   tr.passIfNoException();
+
+   tr.test("invalidation");
+   {
+      // a post to the path invalidates it
+      _cachedRequest(port, "POST", "/cached/item", NULL, 204, header, body);
+      _cachedRequest(port, "GET", "/cached/item", NULL, 200, header, body);
+      assert(service->mCount == 3);
+
+      // responses for other queries on the path were also invalidated
+      _cachedRequest(port, "GET", "/cached/item?a=1", NULL, 200, header, body);
+      assert(service->mCount == 4);
+      assert(cache->invalidatePrefix("/cached") == 2);
+      _cachedRequest(port, "GET", "/cached/item?a=1", NULL, 200, header, body);
+      assert(service->mCount == 5);
+   }
+   tr.passIfNoException();
+
+   tr.test("ttl and size");
+   {
+      cache->clear();
+      cache->setTimeToLive(50);
+      _cachedRequest(port, "GET", "/cached/item", NULL, 200, header, body);
+      assert(service->mCount == 6);
+      Thread::sleep(100);
+      _cachedRequest(port, "GET", "/cached/item", NULL, 200, header, body);
+      assert(service->mCount == 7);
+      assert(cache->getStats()["expirations"]->getUInt64() == 1);
+
+      // only one response fits
+      cache->setTimeToLive(0);
+      cache->setMaxSize(body.length() + body.length() / 2);
+      _cachedRequest(port, "GET", "/cached/item?b=1", NULL, 200, header, body);
+      DynamicObject stats = cache->getStats();
+      assert(stats["entries"]->getUInt32() == 1);
+      assert(stats["evictions"]->getUInt64() == 1);
+      assert(stats["size"]->getUInt32() <= stats["maxSize"]->getUInt32());
+   }
+   tr.passIfNoException();
+
+   tr.test("file variants");
+   {
+      File file = File::createTempFile("test");
+      FileOutputStream fos(file);
+      string text(1000, 'x');
+      fos.write(text.c_str(), text.length());
+      fos.close();
+      service->mFilename = file->getAbsolutePath();
+
+      // identity
+      _cachedRequest(port, "GET", "/cached/file", NULL, 200, header, body);
+      assert(!header.hasField("Content-Encoding"));
+      assert(!header.hasField("Transfer-Encoding"));
+      assertStrCmp(header.getFieldValue("Content-Length").c_str(), "1000");
+      assert(body == text);
+
+      // gzip is sent with its length, not chunked
+      DynamicObject headers;
+      headers["Accept-Encoding"] = "gzip";
+      _cachedRequest(
+         port, "GET", "/cached/file", &headers, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Encoding").c_str(), "gzip");
+      assert(!header.hasField("Transfer-Encoding"));
+      assert(header.getFieldValue("Content-Length") ==
+         StringTools::format("%d", (int)body.length()));
+      assert(body.length() < text.length());
+
+      // the variants are cached
+      file->remove();
+      _cachedRequest(
+         port, "GET", "/cached/file", &headers, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Encoding").c_str(), "gzip");
+
+      // a missing file is not found
+      service->mFilename.append(".missing");
+      _cachedRequest(port, "GET", "/cached/file", NULL, 404, header, body);
+   }
+   tr.passIfNoException();
+
+   tr.test("MessagePack content");
+   {
+      DynamicObject headers;
+      headers["Accept"] = "application/x-msgpack, application/json";
+      _cachedRequest(
+         port, "GET", "/cached/item?c=1", &headers, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Type").c_str(),
+         "application/x-msgpack");
+      DynamicObject item;
+      assertNoException(
+         MessagePackReader::readFromString(item, body.c_str(), body.length()));
+      assert(item["count"]->getType() == Int32);
+      assertStrCmp(item["path"]->getString(), "/cached/item?c=1");
+
+      // other clients still get JSON
+      _cachedRequest(port, "GET", "/cached/item?c=1", NULL, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Type").c_str(), "application/json");
+      assert(body[0] == '{');
+
+      // q-values are honored
+      const char* accept[][2] = {
+         {"application/x-msgpack;q=0.5, application/json",
+          "application/json"},
+         {"application/x-msgpack; q=0, */*", "application/json"},
+         {"application/json;q=0.8, application/x-msgpack;q=0.9",
+          "application/x-msgpack"},
+         {"application/json; q=0.5, application/x-msgpack",
+          "application/x-msgpack"},
+         // the most specific matching range gives the quality
+         {"application/json;q=0.5, */*;q=1", "application/x-msgpack"},
+         {"application/json;q=0.5, application/*;q=0.2, */*",
+          "application/json"},
+         {"application/*;q=0.5, application/json;q=0.2",
+          "application/x-msgpack"},
+         {"*/*", "application/json"},
+         {"application/*", "application/json"}};
+      for(int i = 0; i < 9; ++i)
+      {
+         headers["Accept"] = accept[i][0];
+         _cachedRequest(
+            port, "GET", "/cached/item?c=1", &headers, 200, header, body);
+         assertStrCmp(
+            header.getFieldValue("Content-Type").c_str(), accept[i][1]);
+      }
+   }
+   tr.passIfNoException();
+
+   tr.test("credentials");
+   {
+      // requests with credentials skip the cache, in both directions
+      cache->clear();
+      DynamicObject headers;
+      headers["Cookie"] = "session=1";
+      int count = service->mCount;
+      _cachedRequest(
+         port, "GET", "/cached/item?d=1", &headers, 200, header, body);
+      _cachedRequest(
+         port, "GET", "/cached/item?d=1", &headers, 200, header, body);
+      assert(service->mCount == count + 2);
+      assert(cache->getStats()["entries"]->getUInt32() == 0);
+
+      _cachedRequest(port, "GET", "/cached/item?d=1", NULL, 200, header, body);
+      headers->clear();
+      headers["Authorization"] = "Basic dXNlcjpwYXNz";
+      _cachedRequest(
+         port, "GET", "/cached/item?d=1", &headers, 200, header, body);
+      assert(service->mCount == count + 4);
+
+      // unless the caller says their responses are public
+      cache->setCacheCredentialedRequests(true);
+      _cachedRequest(
+         port, "GET", "/cached/item?d=1", &headers, 200, header, body);
+      assert(service->mCount == count + 4);
+      cache->setCacheCredentialedRequests(false);
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
+class TestStreamingService;
+typedef PathHandlerDelegate<TestStreamingService> StreamingHandler;
+
+class TestStreamingService : public WebService
+{
+public:
+   TestStreamingService(const char* path) :
+      WebService(path)
+   {
+   }
+
+   virtual ~TestStreamingService()
+   {
+   }
+
+   virtual bool initialize()
+   {
+      PathHandlerRef h = new StreamingHandler(
+         this, &TestStreamingService::handleRequest);
+      addHandler("/rows", h);
+      return true;
+   }
+
+   virtual void cleanup()
+   {
+   }
+
+   virtual void handleRequest(ServiceChannel* ch)
+   {
+      // stream as many rows as requested
+      DynamicObject vars;
+      ch->getQuery(vars);
+      int count = vars["count"]->getInt32();
+
+      ch->getResponse()->getHeader()->setField(
+         "Content-Type", "application/json");
+      OutputStreamRef os;
+      if(ch->sendContentHeader(os))
+      {
+         JsonStreamWriter writer(&(*os));
+         DynamicObject total;
+         total = count;
+         bool success =
+            writer.beginObject() &&
+            writer.writeMember("total", total) &&
+            writer.writeName("rows") &&
+            writer.beginArray();
+         DynamicObject row;
+         for(int i = 0; success && i < count; ++i)
+         {
+            row["id"] = i;
+            row["name"] = "row";
+            success = writer.writeValue(row);
+         }
+         success = success &&
+            writer.endArray() && writer.endObject() && writer.finish();
+         os->close();
+      }
+   }
+};
+
+static void runStreamingContentTest(TestRunner& tr)
+{
+   tr.group("Streaming content");
+
+   // create kernel
+   Kernel k;
+   k.getEngine()->getThreadPool()->setThreadStackSize(131072);
+   k.getEngine()->start();
+
+   // create server
+   Server server;
+   WebServer ws;
+   Config cfg;
+   cfg["host"] = "localhost";
+   cfg["port"] = 0;
+   cfg["security"] = "off";
+   WebServiceContainerRef wsc = new WebServiceContainer();
+   ws.setContainer(wsc);
+   ws.initialize(cfg);
+   WebServiceRef serviceRef = new TestStreamingService("/stream");
+   wsc->addService(serviceRef, WebService::Both);
+   ws.enable(&server);
+   assertNoException(server.start(&k));
+
+   int port = ws.getHostAddress()->getPort();
+
+   HttpResponseHeader header;
+   string body;
+   tr.test("rows");
+   {
+      _cachedRequest(
+         port, "GET", "/stream/rows?count=20000", NULL, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Transfer-Encoding").c_str(), "chunked");
+      assert(!header.hasField("Content-Length"));
+
+      DynamicObject out;
+      assertNoException(
+         JsonReader::readFromString(out, body.c_str(), body.length()));
+      assert(out["total"]->getInt32() == 20000);
+      assert(out["rows"]->length() == 20000);
+      assert(out["rows"][19999]["id"]->getInt32() == 19999);
+   }
+   tr.passIfNoException();
+
+   tr.test("empty");
+   {
+      _cachedRequest(
+         port, "GET", "/stream/rows?count=0", NULL, 200, header, body);
+      assertStrCmp(body.c_str(), "{\"total\":0,\"rows\":[]}");
+   }
+   tr.passIfNoException();
+
+   tr.test("gzip");
+   {
+      DynamicObject headers;
+      headers["Accept-Encoding"] = "gzip";
+      _cachedRequest(
+         port, "GET", "/stream/rows?count=1000", &headers, 200, header, body);
+      assertStrCmp(
+         header.getFieldValue("Content-Encoding").c_str(), "gzip");
+      assertStrCmp(
+         header.getFieldValue("Transfer-Encoding").c_str(), "chunked");
+   }
+   tr.passIfNoException();
+
+   server.stop();
+   k.getEngine()->stop();
+
+   tr.ungroup();
+}
+
 static bool run(TestRunner& tr)
 {
+   if(tr.isDefaultEnabled())
+   {
+      runRestfulHandlerTest(tr);
+      runIpAuthenticatorTest(tr);
+   }
+   if(tr.isTestEnabled("ws-restful-perf"))
+   {
+      runRestfulHandlerPerfTest(tr);
+   }
    if(tr.isTestEnabled("ws-server"))
    {
       runWebServerTest(tr);
    }
+   if(tr.isTestEnabled("ws-proxy"))
+   {
+      runProxyPathHandlerTest(tr);
+   }
+   if(tr.isTestEnabled("ws-response-cache"))
+   {
+      runResponseCacheTest(tr);
+   }
+   if(tr.isTestEnabled("ws-streaming"))
+   {
+      runStreamingContentTest(tr);
+   }
    return true;
 }
 
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#define __STDC_LIMIT_MACROS
+#define __STDC_CONSTANT_MACROS
+
+#include "monarch/util/Histogram.h"
+
+#include "monarch/rt/Atomic.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace monarch::rt;
+using namespace monarch::util;
+
+// values below 2^SUB_BUCKET_BITS have their own buckets, larger powers of
+// two are split into SUB_BUCKET_HALF buckets
+#define SUB_BUCKET_BITS   5
+#define SUB_BUCKET_HALF   16
+#define MAX_VALUE         ((UINT64_C(1) << 36) - 1)
+
+Histogram::Histogram()
+{
+   clear();
+}
+
+Histogram::~Histogram()
+{
+}
+
+void Histogram::record(uint64_t value)
+{
+   if(value > MAX_VALUE)
+   {
+      value = MAX_VALUE;
+   }
+
+   Atomic::incrementAndFetch(&mBuckets[getBucketIndex(value)]);
+   Atomic::addAndFetch(&mSum, value);
+
+   // update min and max
+   uint64_t old = mMin;
+   while(value < old && !Atomic::compareAndSwap(&mMin, old, value))
+   {
+      old = mMin;
+   }
+   old = mMax;
+   while(value > old && !Atomic::compareAndSwap(&mMax, old, value))
+   {
+      old = mMax;
+   }
+
+   // count last so a reader never sees more values than bucket counts
+   Atomic::incrementAndFetch(&mCount);
+}
+
+void Histogram::merge(Histogram& h)
+{
+   for(int i = 0; i < BucketCount; ++i)
+   {
+      mBuckets[i] += Atomic::load(&h.mBuckets[i]);
+   }
+   mCount += Atomic::load(&h.mCount);
+   mSum += Atomic::load(&h.mSum);
+   uint64_t min = Atomic::load(&h.mMin);
+   uint64_t max = Atomic::load(&h.mMax);
+   mMin = (min < mMin) ? min : mMin;
+   mMax = (max > mMax) ? max : mMax;
+}
+
+void Histogram::clear()
+{
+   memset(mBuckets, 0, sizeof(mBuckets));
+   mCount = 0;
+   mSum = 0;
+   mMin = UINT64_MAX;
+   mMax = 0;
+}
+
+uint64_t Histogram::getCount()
+{
+   return Atomic::load(&mCount);
+}
+
+uint64_t Histogram::getMin()
+{
+   uint64_t min = Atomic::load(&mMin);
+   return (min == UINT64_MAX) ? 0 : min;
+}
+
+uint64_t Histogram::getMax()
+{
+   return Atomic::load(&mMax);
+}
+
+double Histogram::getMean()
+{
+   uint64_t count = getCount();
+   return (count == 0) ? 0 : (double)Atomic::load(&mSum) / count;
+}
+
+uint64_t Histogram::getValueAtPercentile(double percentile)
+{
+   uint64_t rval = 0;
+
+   // find the bucket that holds the value with the percentile's rank
+   uint64_t count = getCount();
+   if(count > 0)
+   {
+      uint64_t rank = (uint64_t)ceil(percentile / 100.0 * count);
+      rank = (rank < 1) ? 1 : rank;
+      uint64_t total = 0;
+      for(int i = 0; total < rank && i < BucketCount; ++i)
+      {
+         total += Atomic::load(&mBuckets[i]);
+         rval = getBucketValue(i);
+      }
+
+      // no bucket value is larger than the real maximum
+      uint64_t max = getMax();
+      rval = (rval > max) ? max : rval;
+   }
+
+   return rval;
+}
+
+/**
+ * Appends a variable-length integer to a string, 7 bits per byte, least
+ * significant first.
+ *
+ * @param out the string to append to.
+ * @param value the value to append.
+ */
+static void _writeVarint(string& out, uint64_t value)
+{
+   while(value >= 0x80)
+   {
+      out.push_back((char)((value & 0x7F) | 0x80));
+      value >>= 7;
+   }
+   out.push_back((char)value);
+}
+
+/**
+ * Reads a variable-length integer.
+ *
+ * @param data the data to read from, updated to point after the integer.
+ * @param end the end of the data.
+ * @param value set to the value read.
+ *
+ * @return true if successful, false if the data ended too early.
+ */
+static bool _readVarint(const char*& data, const char* end, uint64_t& value)
+{
+   bool rval = false;
+
+   value = 0;
+   int shift = 0;
+   while(!rval && data < end && shift < 64)
+   {
+      unsigned char b = *(data++);
+      value |= (uint64_t)(b & 0x7F) << shift;
+      shift += 7;
+      rval = (b & 0x80) == 0;
+   }
+
+   return rval;
+}
+
+void Histogram::serialize(string& out)
+{
+   // count the buckets with values
+   uint64_t buckets[BucketCount];
+   int used = 0;
+   for(int i = 0; i < BucketCount; ++i)
+   {
+      buckets[i] = Atomic::load(&mBuckets[i]);
+      if(buckets[i] > 0)
+      {
+         ++used;
+      }
+   }
+
+   // write totals, then index deltas and counts of used buckets
+   _writeVarint(out, Atomic::load(&mSum));
+   _writeVarint(out, getMin());
+   _writeVarint(out, getMax());
+   _writeVarint(out, used);
+   int last = 0;
+   for(int i = 0; i < BucketCount; ++i)
+   {
+      if(buckets[i] > 0)
+      {
+         _writeVarint(out, i - last);
+         _writeVarint(out, buckets[i]);
+         last = i;
+      }
+   }
+}
+
+int Histogram::deserialize(const char* data, int length)
+{
+   int rval = 0;
+
+   const char* start = data;
+   const char* end = data + length;
+   uint64_t sum;
+   uint64_t min;
+   uint64_t max;
+   uint64_t used;
+   if(_readVarint(data, end, sum) &&
+      _readVarint(data, end, min) &&
+      _readVarint(data, end, max) &&
+      _readVarint(data, end, used) && used <= BucketCount)
+   {
+      // read buckets into a copy so invalid data changes nothing
+      Histogram h;
+      bool valid = true;
+      uint64_t index = 0;
+      for(uint64_t n = 0; valid && n < used; ++n)
+      {
+         uint64_t delta;
+         uint64_t count;
+         valid =
+            _readVarint(data, end, delta) &&
+            _readVarint(data, end, count) &&
+            (index += delta) < (uint64_t)BucketCount;
+         if(valid)
+         {
+            h.mBuckets[index] = count;
+            h.mCount += count;
+         }
+      }
+
+      if(valid)
+      {
+         h.mSum = sum;
+         h.mMin = (h.mCount == 0) ? UINT64_MAX : min;
+         h.mMax = max;
+         merge(h);
+         rval = data - start;
+      }
+   }
+
+   return rval;
+}
+
+int Histogram::getBucketIndex(uint64_t value)
+{
+   int rval;
+
+   if(value < (UINT64_C(1) << SUB_BUCKET_BITS))
+   {
+      rval = (int)value;
+   }
+   else
+   {
+      // find the most significant bit, then keep the bits below it that
+      // select one of the sub-buckets for its power of two
+#ifdef __GNUC__
+      int msb = 63 - __builtin_clzll(value);
+#else
+      int msb = 0;
+      for(uint64_t v = value; v > 1; v >>= 1)
+      {
+         ++msb;
+      }
+#endif
+      int shift = msb - (SUB_BUCKET_BITS - 1);
+      rval = shift * SUB_BUCKET_HALF + (int)(value >> shift);
+   }
+
+   return rval;
+}
+
+uint64_t Histogram::getBucketValue(int index)
+{
+   uint64_t rval;
+
+   if(index < (1 << SUB_BUCKET_BITS))
+   {
+      rval = index;
+   }
+   else
+   {
+      int shift = index / SUB_BUCKET_HALF - 1;
+      uint64_t low = (uint64_t)(index - shift * SUB_BUCKET_HALF) << shift;
+      rval = low + (UINT64_C(1) << shift) - 1;
+   }
+
+   return rval;
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_util_Histogram_H
+#define monarch_util_Histogram_H
+
+#include <inttypes.h>
+#include <string>
+
+namespace monarch
+{
+namespace util
+{
+
+/**
+ * A Histogram records the distribution of non-negative integer values, such
+ * as latencies in microseconds, so that percentiles can be read from it.
+ *
+ * Values are counted in log-linear buckets (like an HDR histogram): values
+ * below 32 each have their own bucket and every larger power of two is split
+ * into 16 buckets of equal width, so any recorded value is reported with a
+ * relative error of at most 1/16. Values of 2^36 and larger are counted as
+ * 2^36 - 1.
+ *
+ * Recording a value is lock-free and may be done from multiple threads at
+ * once, but is cheapest when each thread records into its own Histogram and
+ * the Histograms are merged when they are read.
+ *
+ * @author Dave Longley
+ */
+class Histogram
+{
+public:
+   /**
+    * The number of buckets in a Histogram.
+    */
+   static const int BucketCount = 528;
+
+protected:
+   /**
+    * The count of values in each bucket.
+    */
+   uint64_t mBuckets[BucketCount];
+
+   /**
+    * The number of values recorded.
+    */
+   uint64_t mCount;
+
+   /**
+    * The sum of the values recorded.
+    */
+   uint64_t mSum;
+
+   /**
+    * The smallest value recorded.
+    */
+   uint64_t mMin;
+
+   /**
+    * The largest value recorded.
+    */
+   uint64_t mMax;
+
+public:
+   /**
+    * Creates a new, empty Histogram.
+    */
+   Histogram();
+
+   /**
+    * Destructs this Histogram.
+    */
+   virtual ~Histogram();
+
+   /**
+    * Records a value.
+    *
+    * @param value the value to record.
+    */
+   virtual void record(uint64_t value);
+
+   /**
+    * Adds the values recorded in another Histogram to this one. This
+    * Histogram must not be recorded into at the same time.
+    *
+    * @param h the Histogram to add.
+    */
+   virtual void merge(Histogram& h);
+
+   /**
+    * Removes all recorded values.
+    */
+   virtual void clear();
+
+   /**
+    * Gets the number of values recorded.
+    *
+    * @return the number of values.
+    */
+   virtual uint64_t getCount();
+
+   /**
+    * Gets the smallest value recorded.
+    *
+    * @return the smallest value, 0 if none have been recorded.
+    */
+   virtual uint64_t getMin();
+
+   /**
+    * Gets the largest value recorded.
+    *
+    * @return the largest value, 0 if none have been recorded.
+    */
+   virtual uint64_t getMax();
+
+   /**
+    * Gets the mean of the values recorded.
+    *
+    * @return the mean, 0 if none have been recorded.
+    */
+   virtual double getMean();
+
+   /**
+    * Gets the value at a percentile: the largest value that the given
+    * percentage of the recorded values are less than or equal to (within the
+    * precision of the histogram).
+    *
+    * @param percentile the percentile, from 0 to 100, ie: 99.9.
+    *
+    * @return the value, 0 if none have been recorded.
+    */
+   virtual uint64_t getValueAtPercentile(double percentile);
+
+   /**
+    * Appends a compact binary form of this Histogram to a string. Only the
+    * buckets that have values are written, as variable-length integers.
+    *
+    * @param out the string to append to.
+    */
+   virtual void serialize(std::string& out);
+
+   /**
+    * Adds the values in a Histogram that was serialized with serialize() to
+    * this one.
+    *
+    * @param data the serialized histogram.
+    * @param length the number of bytes available.
+    *
+    * @return the number of bytes read, 0 if the data is invalid.
+    */
+   virtual int deserialize(const char* data, int length);
+
+   /**
+    * Gets the bucket for a value.
+    *
+    * @param value the value.
+    *
+    * @return the bucket index.
+    */
+   static int getBucketIndex(uint64_t value);
+
+   /**
+    * Gets the largest value that is counted in a bucket.
+    *
+    * @param index the bucket index.
+    *
+    * @return the largest value in the bucket.
+    */
+   static uint64_t getBucketValue(int index);
+};
+
+} // end namespace util
+} // end namespace monarch
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#include "monarch/validation/JsonStreamValidator.h"
+
+#include "monarch/validation/ValidatorContext.h"
+
+using namespace std;
+using namespace monarch::data::json;
+using namespace monarch::rt;
+using namespace monarch::validation;
+
+JsonStreamValidator::JsonStreamValidator() :
+   mValidCount(0)
+{
+}
+
+JsonStreamValidator::~JsonStreamValidator()
+{
+}
+
+bool JsonStreamValidator::addValidator(
+   const char* path, ValidatorRef& validator, bool keep)
+{
+   bool rval = addPath(path);
+   if(rval)
+   {
+      PathValidator& pv = mValidators[path];
+      pv.validator = validator;
+      pv.keep = keep;
+   }
+   return rval;
+}
+
+uint64_t JsonStreamValidator::getValidCount()
+{
+   return mValidCount;
+}
+
+void JsonStreamValidator::reset()
+{
+   JsonPathExtractor::reset();
+   mValidCount = 0;
+}
+
+bool JsonStreamValidator::valueExtracted(const char* path, DynamicObject& value)
+{
+   bool rval;
+
+   ValidatorMap::iterator i = mValidators.find(path);
+   if(i == mValidators.end())
+   {
+      // only extracted
+      rval = JsonPathExtractor::valueExtracted(path, value);
+   }
+   else
+   {
+      // validate with the value's path in the document
+      ValidatorContext context;
+      string current = getCurrentPath();
+      if(current.length() > 0)
+      {
+         context.pushPath(current.c_str());
+      }
+      rval = i->second.validator->isValid(value, &context);
+      if(rval)
+      {
+         ++mValidCount;
+         rval = valueValidated(path, value);
+      }
+   }
+
+   return rval;
+}
+
+bool JsonStreamValidator::valueValidated(const char* path, DynamicObject& value)
+{
+   bool rval = true;
+
+   if(mValidators[path].keep)
+   {
+      rval = JsonPathExtractor::valueExtracted(path, value);
+   }
+
+   return rval;
+}
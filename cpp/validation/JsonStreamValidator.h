@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_validation_JsonStreamValidator_H
+#define monarch_validation_JsonStreamValidator_H
+
+#include "monarch/data/json/JsonPathExtractor.h"
+#include "monarch/validation/Validator.h"
+
+#include <map>
+#include <string>
+
+namespace monarch
+{
+namespace validation
+{
+
+/**
+ * A JsonStreamValidator validates parts of a JSON document while it is
+ * parsed. Each value at a path with a Validator (see
+ * JsonPathExtractor for paths) is built and validated as soon as it has been
+ * parsed, and then dropped unless it is to be kept. Validating each item of
+ * a large array this way, ie: with the path "items[*]", checks the whole
+ * array while holding only one item in memory at a time.
+ *
+ * Errors use the full path of the invalid value in the document, ie:
+ * "items[1234].id". When a value is invalid, parsing stops and the
+ * JsonReader's parse error has the validation error as its cause.
+ *
+ * Subclasses may override valueValidated() to store or forward each valid
+ * value.
+ *
+ * @author Dave Longley
+ */
+class JsonStreamValidator : public monarch::data::json::JsonPathExtractor
+{
+protected:
+   /**
+    * A Validator for a path.
+    */
+   struct PathValidator
+   {
+      /**
+       * The Validator.
+       */
+      ValidatorRef validator;
+
+      /**
+       * True to keep valid values in the extracted values.
+       */
+      bool keep;
+   };
+
+   /**
+    * A map of path to Validator.
+    */
+   typedef std::map<std::string, PathValidator> ValidatorMap;
+
+   /**
+    * The Validators for each path.
+    */
+   ValidatorMap mValidators;
+
+   /**
+    * The number of values that were validated.
+    */
+   uint64_t mValidCount;
+
+public:
+   /**
+    * Creates a new JsonStreamValidator.
+    */
+   JsonStreamValidator();
+
+   /**
+    * Destructs this JsonStreamValidator.
+    */
+   virtual ~JsonStreamValidator();
+
+   /**
+    * Adds a Validator for the values at a path.
+    *
+    * @param path the path, ie: "items[*]".
+    * @param validator the Validator to use.
+    * @param keep true to keep valid values in the extracted values, false to
+    *           drop them.
+    *
+    * @return true if successful, false if the path is invalid.
+    */
+   virtual bool addValidator(
+      const char* path, ValidatorRef& validator, bool keep = false);
+
+   /**
+    * Gets the number of values that were validated.
+    *
+    * @return the number of valid values.
+    */
+   virtual uint64_t getValidCount();
+
+   /**
+    * {@inheritDoc}
+    */
+   virtual void reset();
+
+protected:
+   /**
+    * {@inheritDoc}
+    */
+   virtual bool valueExtracted(
+      const char* path, monarch::rt::DynamicObject& value);
+
+   /**
+    * Called when a value has been validated. By default, keeps the value if
+    * its Validator was added to keep values.
+    *
+    * @param path the path that was added and matched the value.
+    * @param value the valid value.
+    *
+    * @return true to continue, false with an exception set to stop parsing.
+    */
+   virtual bool valueValidated(
+      const char* path, monarch::rt::DynamicObject& value);
+};
+
+} // end namespace validation
+} // end namespace monarch
+#endif
@@ -16,6 +16,7 @@
 #include "monarch/validation/Equals.h"
 #include "monarch/validation/In.h"
 #include "monarch/validation/Int.h"
+#include "monarch/validation/JsonStreamValidator.h"
 #include "monarch/validation/Map.h"
 #include "monarch/validation/Max.h"
 #include "monarch/validation/Member.h"
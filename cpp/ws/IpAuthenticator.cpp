@@ -1,24 +1,66 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/validation/Validation.h"
 #include "monarch/ws/IpAuthenticator.h"
 
+#include "monarch/rt/Atomic.h"
+
 using namespace std;
 using namespace monarch::config;
+using namespace monarch::net;
 using namespace monarch::rt;
 using namespace monarch::util;
 using namespace monarch::ws;
 namespace v = monarch::validation;
 
-// FIXME: add CIDR support
-
-IpAuthenticator::IpAuthenticator()
+IpAuthenticator::IpAuthenticator() :
+   mRules(new Rules)
 {
 }
 
 IpAuthenticator::~IpAuthenticator()
 {
+   delete mRules;
+   for(vector<Rules*>::iterator i = mRetiredRules.begin();
+       i != mRetiredRules.end(); ++i)
+   {
+      delete *i;
+   }
+}
+
+/**
+ * Adds a range or a regex to a set of ranges or patterns.
+ *
+ * @param ranges the ranges to add to.
+ * @param patterns the patterns to add to.
+ * @param rule the range or regex.
+ * @param range true if the rule must be a range, false to add it as a range
+ *           only if it is one and as a regex otherwise.
+ *
+ * @return true if successful, false if an exception occurred.
+ */
+static bool _addRule(
+   IpPrefixTrie& ranges, vector<PatternRef>& patterns,
+   const char* rule, bool range)
+{
+   bool rval;
+
+   if(range || IpPrefixTrie::isRange(rule))
+   {
+      rval = ranges.add(rule);
+   }
+   else
+   {
+      PatternRef pattern = Pattern::compile(rule);
+      rval = !pattern.isNull();
+      if(rval)
+      {
+         patterns.push_back(pattern);
+      }
+   }
+
+   return rval;
 }
 
 bool IpAuthenticator::initializeFromConfig(
@@ -26,6 +68,126 @@ bool IpAuthenticator::initializeFromConfig(
 {
    bool rval;
 
+   Rules* rules = new Rules;
+   rval = addRulesFromConfig(rules, config, privateConfig);
+   if(rval)
+   {
+      mLock.lock();
+      setRules(rules);
+      mLock.unlock();
+   }
+   else
+   {
+      delete rules;
+   }
+
+   return rval;
+}
+
+RequestAuthenticator::Result
+   IpAuthenticator::checkAuthentication(ServiceChannel* ch)
+{
+   // default to client did not attempt to use an authentication mechanism
+   RequestAuthenticator::Result rval = Success;
+
+   if(!isAllowed(ch->getConnection()->getRemoteAddress()))
+   {
+      rval = Deny;
+
+      ExceptionRef e = new Exception(
+         "This IP is not authorized to access this resource.",
+         "monarch.ws.InvalidIpAddress");
+      e->getDetails()["httpStatusCode"] = 403;
+      e->getDetails()["public"] = true;
+      Exception::push(e);
+
+      // client failed to pass authenticator
+      ch->setAuthenticationException("ip", e);
+   }
+
+   return rval;
+}
+
+bool IpAuthenticator::isAllowed(SocketAddress* address)
+{
+   bool rval = true;
+
+   // protect the current rules from being freed while in use, ensuring that
+   // they weren't swapped out before they were protected
+   HazardPtr* ptr = mHazardPtrs.acquire();
+   Rules* rules;
+   do
+   {
+      rules = mRules;
+      ptr->value = rules;
+   }
+   while(rules != Atomic::load(&mRules));
+
+   // check deny ranges and patterns
+   if(!rules->denyRanges.isEmpty() && rules->denyRanges.contains(address))
+   {
+      rval = false;
+   }
+   if(rval && !rules->denyPatterns.empty())
+   {
+      const char* remoteAddress = address->getAddress();
+      for(PatternRefList::iterator i = rules->denyPatterns.begin();
+          rval && i != rules->denyPatterns.end(); ++i)
+      {
+         rval = !(*i)->match(remoteAddress);
+      }
+   }
+
+   // check allow ranges and patterns if not yet denied and any are set
+   if(rval &&
+      (!rules->allowRanges.isEmpty() || !rules->allowPatterns.empty()))
+   {
+      bool allow = rules->allowRanges.contains(address);
+      if(!allow && !rules->allowPatterns.empty())
+      {
+         const char* remoteAddress = address->getAddress();
+         for(PatternRefList::iterator i = rules->allowPatterns.begin();
+             !allow && i != rules->allowPatterns.end(); ++i)
+         {
+            allow = (*i)->match(remoteAddress);
+         }
+      }
+
+      // deny if not found
+      rval = allow;
+   }
+
+   ptr->value = NULL;
+   mHazardPtrs.release(ptr);
+
+   return rval;
+}
+
+bool IpAuthenticator::addAllowRange(const char* range)
+{
+   return addRule(range, true, true);
+}
+
+bool IpAuthenticator::addDenyRange(const char* range)
+{
+   return addRule(range, false, true);
+}
+
+bool IpAuthenticator::addAllowRegex(const char* regex)
+{
+   return addRule(regex, true, false);
+}
+
+bool IpAuthenticator::addDenyRegex(const char* regex)
+{
+   return addRule(regex, false, false);
+}
+
+bool IpAuthenticator::addRulesFromConfig(
+   Rules* rules, Config& config, Config* privateConfig)
+{
+   bool rval;
+
    v::ValidatorRef v = new v::Map(
       "public", new v::Optional(new v::Type(Boolean)),
       "allow", new v::Optional(new v::Each(new v::Type(String))),
@@ -49,7 +211,7 @@ bool IpAuthenticator::initializeFromConfig(
          }
          else
          {
-            rval = initializeFromConfig(*privateConfig);
+            rval = addRulesFromConfig(rules, *privateConfig, NULL);
          }
       }
       else
@@ -59,7 +221,9 @@ bool IpAuthenticator::initializeFromConfig(
             DynamicObjectIterator i = config["allow"].getIterator();
             while(rval && i->hasNext())
             {
-               rval = addAllowRegex(i->next()->getString());
+               rval = _addRule(
+                  rules->allowRanges, rules->allowPatterns,
+                  i->next()->getString(), false);
             }
          }
          if(config->hasMember("deny"))
@@ -67,7 +231,9 @@ bool IpAuthenticator::initializeFromConfig(
             DynamicObjectIterator i = config["deny"].getIterator();
             while(rval && i->hasNext())
             {
-               rval = addDenyRegex(i->next()->getString());
+               rval = _addRule(
+                  rules->denyRanges, rules->denyPatterns,
+                  i->next()->getString(), false);
             }
          }
       }
@@ -76,87 +242,65 @@ bool IpAuthenticator::initializeFromConfig(
    return rval;
 }
 
-RequestAuthenticator::Result
-   IpAuthenticator::checkAuthentication(ServiceChannel* ch)
+bool IpAuthenticator::addRule(const char* rule, bool allow, bool range)
 {
-   // default to client did not attempt to use an authentication mechanism
-   RequestAuthenticator::Result rval = Success;
-
-   const char* remoteAddress =
-      ch->getConnection()->getRemoteAddress()->getAddress();
-
-   // FIXME: issues with IPv4 vs IPv6 patterns?
+   bool rval;
 
-   // check deny patterns
-   if(mDenyPatterns.size() != 0)
+   mLock.lock();
    {
-      for(
-         PatternRefList::iterator i = mDenyPatterns.begin();
-         rval == Success && i != mDenyPatterns.end();
-         i++)
+      // copy the current rules, add the rule to the copy
+      Rules* rules = new Rules(*mRules);
+      if(range)
+      {
+         rval = _addRule(
+            allow ? rules->allowRanges : rules->denyRanges,
+            allow ? rules->allowPatterns : rules->denyPatterns,
+            rule, true);
+      }
+      else
       {
-         if((*i)->match(remoteAddress))
+         PatternRef pattern = Pattern::compile(rule);
+         rval = !pattern.isNull();
+         if(rval)
          {
-            rval = Deny;
+            (allow ? rules->allowPatterns : rules->denyPatterns).push_back(
+               pattern);
          }
       }
-   }
-
-   // check allow patterns if not yet denied and allow patterns are set
-   if(rval != Deny && mAllowPatterns.size() != 0)
-   {
-      bool allow = false;
 
-      for(
-         PatternRefList::iterator i = mAllowPatterns.begin();
-         !allow && i != mAllowPatterns.end();
-         i++)
+      if(rval)
       {
-         allow = (*i)->match(remoteAddress);
+         setRules(rules);
+      }
+      else
+      {
+         delete rules;
       }
-
-      // deny if not found
-      rval = allow ? Success : Deny;
-   }
-
-   if(rval == Deny)
-   {
-      ExceptionRef e = new Exception(
-         "This IP is not authorized to access this resource.",
-         "monarch.ws.InvalidIpAddress");
-      e->getDetails()["httpStatusCode"] = 403;
-      e->getDetails()["public"] = true;
-      Exception::push(e);
-
-      // client failed to pass authenticator
-      ch->setAuthenticationException("ip", e);
    }
+   mLock.unlock();
 
    return rval;
 }
 
-static bool _addRegex(
-   std::vector<monarch::util::PatternRef>& patterns, const char* regex)
+void IpAuthenticator::setRules(Rules* rules)
 {
-   bool rval;
+   // swap in the new rules and retire the old ones
+   Rules* old = mRules;
+   Atomic::store(&mRules, rules);
+   mRetiredRules.push_back(old);
 
-   PatternRef pattern = Pattern::compile(regex);
-   rval = !pattern.isNull();
-
-   if(rval)
+   // free any retired rules that are no longer in use
+   for(vector<Rules*>::iterator i = mRetiredRules.begin();
+       i != mRetiredRules.end();)
    {
-      patterns.push_back(pattern);
+      if(mHazardPtrs.isProtected(*i))
+      {
+         ++i;
+      }
+      else
+      {
+         delete *i;
+         i = mRetiredRules.erase(i);
+      }
    }
-
-   return rval;
-}
-
-bool IpAuthenticator::addAllowRegex(const char* regex)
-{
-   return _addRegex(mAllowPatterns, regex);
-}
-
-bool IpAuthenticator::addDenyRegex(const char* regex)
-{
-   return _addRegex(mDenyPatterns, regex);
 }
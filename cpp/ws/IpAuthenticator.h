@@ -1,10 +1,13 @@
 /*
- * Copyright (c) 2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2011-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_ws_IpAuthenticator_h
 #define monarch_ws_IpAuthenticator_h
 
 #include "monarch/config/ConfigManager.h"
+#include "monarch/net/IpPrefixTrie.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/rt/HazardPtrList.h"
 #include "monarch/util/Pattern.h"
 #include "monarch/ws/RequestAuthenticator.h"
 
@@ -17,9 +20,21 @@ namespace ws
 
 /**
  * An IpAuthenticator determines if the IP that makes a request is acceptable.
- * If patterns are set with addAllowRegex, then the IP must match one of the
- * patterns otherwise the request will be denied. If the IP matches any of the
- * patterns set with addDenyRegex the request will be denied.
+ * If allowed ranges or patterns are set, then the IP must be in one of the
+ * ranges or match one of the patterns, otherwise the request will be denied.
+ * If the IP is in any denied range or matches any denied pattern, the
+ * request will be denied.
+ *
+ * Ranges are IPv4 or IPv6 addresses or CIDR ranges, such as "10.0.0.0/8",
+ * and are matched against the numeric remote address using a prefix trie, so
+ * large lists cost no more than small ones. Regexes are matched against the
+ * textual remote address and should only be used for rules that cannot be
+ * expressed as ranges.
+ *
+ * The rules may be replaced at any time, for instance when the config is
+ * reloaded. Requests being checked keep using the old rules until they are
+ * done, they never wait for the new rules to be installed, and installing
+ * new rules never waits for the requests still using the old ones.
  *
  * @author David I. Lehn
  */
@@ -32,14 +47,50 @@ protected:
    typedef std::vector<monarch::util::PatternRef> PatternRefList;
 
    /**
-    * List of IP patterns that are allowed.
+    * A set of rules, which is never modified once it is in use.
+    */
+   struct Rules
+   {
+      /**
+       * IP ranges that are allowed.
+       */
+      monarch::net::IpPrefixTrie allowRanges;
+
+      /**
+       * IP ranges that are denied.
+       */
+      monarch::net::IpPrefixTrie denyRanges;
+
+      /**
+       * List of IP patterns that are allowed.
+       */
+      PatternRefList allowPatterns;
+
+      /**
+       * List of IP patterns that are denied.
+       */
+      PatternRefList denyPatterns;
+   };
+
+   /**
+    * The current rules.
+    */
+   Rules* volatile mRules;
+
+   /**
+    * Hazard pointers that protect rules in use from being freed.
     */
-   PatternRefList mAllowPatterns;
+   monarch::rt::HazardPtrList mHazardPtrs;
 
    /**
-    * List of IP patterns that are denied.
+    * Replaced rules that may still be in use.
     */
-   PatternRefList mDenyPatterns;
+   std::vector<Rules*> mRetiredRules;
+
+   /**
+    * A lock for replacing the rules.
+    */
+   monarch::rt::ExclusiveLock mLock;
 
 public:
    /**
@@ -53,14 +104,19 @@ public:
    virtual ~IpAuthenticator();
 
    /**
-    * Initialize this authenticator from a configuration.
+    * Initialize this authenticator from a configuration, replacing any
+    * current rules. This may be called again to reload the rules while
+    * requests are being checked.
     *
     * {
     *    "public": true|false (optional, default: true),
-    *    "allow": list of IP regexes to pass to addAllowRegex() (optional),
-    *    "deny": list of IP regexes to pass to addDenyRegex() (optional),
+    *    "allow": list of IP ranges or regexes to allow (optional),
+    *    "deny": list of IP ranges or regexes to deny (optional),
     * }
     *
+    * Each entry that is a valid IP address or CIDR range is added as a range,
+    * any other entry is added as a regex.
+    *
     * If "public" is false then the allow and deny parameters of privateConfig
     * are used for initialization.
     *
@@ -68,7 +124,8 @@ public:
     * @param privateIps config to use if primary config "public" value is set
     *        to false.
     *
-    * @return true if regex was added, false if an exception occurred.
+    * @return true if the rules were replaced, false if an exception
+    *         occurred.
     */
    virtual bool initializeFromConfig(
       monarch::config::Config& config,
@@ -80,6 +137,34 @@ public:
    virtual monarch::ws::RequestAuthenticator::Result
       checkAuthentication(monarch::ws::ServiceChannel* ch);
 
+   /**
+    * Checks whether an address is allowed by the current rules.
+    *
+    * @param address the address to check.
+    *
+    * @return true if the address is allowed, false if not.
+    */
+   virtual bool isAllowed(monarch::net::SocketAddress* address);
+
+   /**
+    * Add an IP address or CIDR range that request IPs must be in.
+    *
+    * @param range IP range to allow.
+    *
+    * @return true if range was added, false if an exception occurred.
+    */
+   virtual bool addAllowRange(const char* range);
+
+   /**
+    * Add an IP address or CIDR range that request IPs are not allowed to be
+    * in.
+    *
+    * @param range IP range to deny.
+    *
+    * @return true if range was added, false if an exception occurred.
+    */
+   virtual bool addDenyRange(const char* range);
+
    /**
     * Add a regex that request IPs must match.
     *
@@ -97,6 +182,40 @@ public:
     * @return true if regex was added, false if an exception occurred.
     */
    virtual bool addDenyRegex(const char* regex);
+
+protected:
+   /**
+    * Adds the allow and deny entries from a configuration to a set of rules.
+    *
+    * @param rules the rules to add to.
+    * @param config config to use.
+    * @param privateConfig config to use if "public" is false.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool addRulesFromConfig(
+      Rules* rules, monarch::config::Config& config,
+      monarch::config::Config* privateConfig);
+
+   /**
+    * Adds a rule to a copy of the current rules and installs the copy.
+    *
+    * @param rule the range or regex.
+    * @param allow true to allow, false to deny.
+    * @param range true for a range, false for a regex.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool addRule(const char* rule, bool allow, bool range);
+
+   /**
+    * Installs new rules and frees any replaced rules that are no longer in
+    * use. Rules that are still in use are freed by a later call or when
+    * this authenticator is destructed. The lock must be held.
+    *
+    * @param rules the new rules.
+    */
+   virtual void setRules(Rules* rules);
 };
 
 } // end namespace ws
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_FORMAT_MACROS
 
@@ -9,6 +9,8 @@
 #include "monarch/data/DynamicObjectOutputStream.h"
 #include "monarch/data/json/JsonReader.h"
 #include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/msgpack/MessagePackReader.h"
+#include "monarch/data/msgpack/MessagePackWriter.h"
 #include "monarch/data/xml/XmlReader.h"
 #include "monarch/data/xml/XmlWriter.h"
 #include "monarch/compress/gzip/Gzipper.h"
@@ -24,6 +26,7 @@ using namespace monarch::compress::deflate;
 using namespace monarch::compress::gzip;
 using namespace monarch::data;
 using namespace monarch::data::json;
+using namespace monarch::data::msgpack;
 using namespace monarch::data::xml;
 using namespace monarch::http;
 using namespace monarch::io;
@@ -36,6 +39,7 @@ using namespace monarch::ws;
 #define CONTENT_TYPE_JSONLD "application/ld+json"
 #define CONTENT_TYPE_XML    "text/xml"
 #define CONTENT_TYPE_FORM   "application/x-www-form-urlencoded"
+#define CONTENT_TYPE_MSGPACK "application/x-msgpack"
 
 Message::Message() :
    mContentSource(NULL),
@@ -333,6 +337,10 @@ Message::ContentType Message::getContentType(HttpHeader* header)
       {
          rval = Form;
       }
+      else if(strstr(contentType.c_str(), CONTENT_TYPE_MSGPACK) != NULL)
+      {
+         rval = MessagePack;
+      }
    }
 
    return rval;
@@ -647,6 +655,10 @@ bool Message::sendHeaderAndObject(
             {
                writer = new JsonWriter();
             }
+            else if(type == MessagePack)
+            {
+               writer = new MessagePackWriter();
+            }
             else
             {
                writer = new XmlWriter();
@@ -782,6 +794,10 @@ bool Message::receiveContentObject(
          {
             reader = new JsonReader();
          }
+         else if(type == MessagePack)
+         {
+            reader = new MessagePackReader();
+         }
          else
          {
             reader = new XmlReader();
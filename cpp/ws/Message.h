@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_ws_Message_H
 #define monarch_ws_Message_H
@@ -48,7 +48,7 @@ public:
     */
    enum ContentType
    {
-      Unknown, Json, JsonLd, Xml, Form
+      Unknown, Json, JsonLd, Xml, Form, MessagePack
    };
 
 protected:
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/ws/PathHandler.h"
 
@@ -9,7 +9,8 @@ using namespace monarch::ws;
 PathHandler::PathHandler(bool secureOnly) :
    mSecureOnly(secureOnly),
    mExceptionHandler(this),
-   mExceptionHandlerRef(NULL)
+   mExceptionHandlerRef(NULL),
+   mResponseCache(NULL)
 {
 }
 
@@ -107,6 +108,36 @@ void PathHandler::handleRequest(ServiceChannel* ch)
    ch->sendNoContent();
 }
 
+void PathHandler::handleRequestWithCache(ServiceChannel* ch)
+{
+   if(mResponseCache.isNull())
+   {
+      handleRequest(ch);
+   }
+   else if(!mResponseCache->respond(ch))
+   {
+      // a request that may change the resource invalidates it before the
+      // client is answered and again once it has been handled, in case a
+      // concurrent request cached the resource before it changed
+      Message::MethodType method = ch->getRequestMethod();
+      bool invalidate = (method != Message::Get && method != Message::Head);
+      if(invalidate)
+      {
+         mResponseCache->invalidate(ch->getPath());
+      }
+
+      // store the response if possible
+      ch->setResponseCache(&(*mResponseCache));
+      handleRequest(ch);
+      ch->setResponseCache(NULL);
+
+      if(invalidate)
+      {
+         mResponseCache->invalidate(ch->getPath());
+      }
+   }
+}
+
 void PathHandler::operator()(ServiceChannel* ch)
 {
    // enforce secure connection if appropriate
@@ -119,7 +150,7 @@ void PathHandler::operator()(ServiceChannel* ch)
    // try to handle request
    else if(canHandleRequest(ch))
    {
-      handleRequest(ch);
+      handleRequestWithCache(ch);
    }
    // exception, could not handle request
    else
@@ -165,6 +196,16 @@ void PathHandler::setExceptionHandlerRef(ChannelExceptionHandlerRef h)
    mExceptionHandler = &(*mExceptionHandlerRef);
 }
 
+void PathHandler::setResponseCache(ResponseCacheRef cache)
+{
+   mResponseCache = cache;
+}
+
+ResponseCacheRef& PathHandler::getResponseCache()
+{
+   return mResponseCache;
+}
+
 void PathHandler::handleChannelException(
    ServiceChannel* ch, ExceptionRef& e)
 {
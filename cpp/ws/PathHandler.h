@@ -1,11 +1,12 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_ws_PathHandler_H
 #define monarch_ws_PathHandler_H
 
 #include "monarch/ws/ChannelExceptionHandler.h"
 #include "monarch/ws/RequestAuthenticator.h"
+#include "monarch/ws/ResponseCache.h"
 
 #include <vector>
 
@@ -41,6 +42,11 @@ protected:
    ChannelExceptionHandler* mExceptionHandler;
    ChannelExceptionHandlerRef mExceptionHandlerRef;
 
+   /**
+    * The cache for the responses sent by this handler, NULL for none.
+    */
+   ResponseCacheRef mResponseCache;
+
 public:
    /**
     * Creates a new PathHandler.
@@ -97,6 +103,23 @@ public:
     */
    virtual void handleRequest(ServiceChannel* ch);
 
+   /**
+    * Handles the client's request using this handler's response cache, if
+    * it has one. A cached response is sent if there is one, otherwise
+    * handleRequest() is called and any response it sends that may be cached
+    * is stored. A request that is not a GET or HEAD invalidates the cached
+    * responses for its path once it has been handled.
+    *
+    * Cached responses are shared by every client, so a cache must only be
+    * used for resources that do not depend on who requests them, or it must
+    * vary on the credentials that select the response (see ResponseCache).
+    * Requests with an Authorization or Cookie header that is not varied on
+    * skip the cache unless it was told that they may use it.
+    *
+    * @param ch the communication channel with the client.
+    */
+   virtual void handleRequestWithCache(ServiceChannel* ch);
+
    /**
     * Handle's the client's request by receiving its content, if any, and
     * sending an appropriate response.
@@ -145,6 +168,21 @@ public:
     */
    virtual void setExceptionHandlerRef(ChannelExceptionHandlerRef h);
 
+   /**
+    * Sets the cache for the responses sent by this handler. A cache may be
+    * shared by many handlers.
+    *
+    * @param cache the cache to use, NULL for none.
+    */
+   virtual void setResponseCache(ResponseCacheRef cache);
+
+   /**
+    * Gets the cache for the responses sent by this handler.
+    *
+    * @return the cache, NULL for none.
+    */
+   virtual ResponseCacheRef& getResponseCache();
+
    /**
     * {@inheritDoc}
     */
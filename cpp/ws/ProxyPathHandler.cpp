@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #define __STDC_FORMAT_MACROS
 
@@ -9,6 +9,7 @@
 #include "monarch/io/ByteArrayInputStream.h"
 #include "monarch/logging/Logging.h"
 #include "monarch/net/SocketTools.h"
+#include "monarch/rt/Atomic.h"
 #include "monarch/util/StringTokenizer.h"
 #include "monarch/util/StringTools.h"
 #include "monarch/ws/PathHandlerDelegate.h"
@@ -26,9 +27,24 @@ using namespace monarch::ws;
 // Note: Current implementation doesn't lock on proxy map. It is assumed it
 // will be set up before use and not changed thereafter.
 
+// the default maximum number of idle connections kept per proxied server
+#define DEFAULT_MAX_IDLE_CONNECTIONS   16
+
+// the default time an idle proxied server connection is kept (in ms)
+#define DEFAULT_IDLE_TIMEOUT           15000
+
+// the default interval for closing expired idle connections (in ms)
+#define DEFAULT_REAPER_INTERVAL        5000
+
+// the size of the buffer used to stream message bodies
+#define BODY_BUFFER_SIZE               16384
+
 ProxyPathHandler::ProxyPathHandler(const char* path) :
    mPath(strdup(path))
 {
+   mConnectionPool.setMaxIdleConnections(DEFAULT_MAX_IDLE_CONNECTIONS);
+   mConnectionPool.setIdleTimeout(DEFAULT_IDLE_TIMEOUT);
+   mConnectionPool.startReaper(DEFAULT_REAPER_INTERVAL);
 }
 
 ProxyPathHandler::~ProxyPathHandler()
@@ -41,6 +57,7 @@ ProxyPathHandler::~ProxyPathHandler()
       for(PathToRule::iterator ri = rules.begin(); ri != rules.end(); ++ri)
       {
          free((char*)ri->first);
+         delete ri->second.metrics;
       }
       free(pd->domain);
       delete pd;
@@ -147,8 +164,45 @@ bool ProxyPathHandler::addRedirectRule(
    return addRule(Rule::Redirect, domain, path, url, false, permanent);
 }
 
+HttpConnectionPool* ProxyPathHandler::getConnectionPool()
+{
+   return &mConnectionPool;
+}
+
+DynamicObject ProxyPathHandler::getStats()
+{
+   DynamicObject rval;
+   rval->setType(Array);
+
+   for(ProxyDomainList::iterator i = mDomains.begin(); i != mDomains.end(); ++i)
+   {
+      PathToRule& rules = (*i)->rules;
+      for(PathToRule::iterator ri = rules.begin(); ri != rules.end(); ++ri)
+      {
+         Rule& rule = ri->second;
+         RuleMetrics* m = rule.metrics;
+         DynamicObject& stats = rval->append();
+         stats["domain"] = (*i)->domain;
+         stats["path"] = rule.path;
+         stats["type"] = ruleTypeToString(rule.type);
+         stats["url"] = rule.url->toString().c_str();
+         stats["requests"] = Atomic::load(&m->requests);
+         stats["active"] = Atomic::load(&m->active);
+         stats["idle"] = (rule.type == Rule::Proxy) ?
+            mConnectionPool.getIdleConnectionCount(&(*rule.url)) : 0;
+         stats["connectionsCreated"] = Atomic::load(&m->connectionsCreated);
+         stats["connectionsReused"] = Atomic::load(&m->connectionsReused);
+         stats["unavailable"] = Atomic::load(&m->unavailable);
+         stats["errors"] = Atomic::load(&m->errors);
+      }
+   }
+
+   return rval;
+}
+
 /**
- * Proxies HTTP traffic coming from the "in" connection to the "out" connection.
+ * Streams a message body from the "in" connection to the "out" connection.
+ * The body is written out as it is read, using a single fixed-size buffer.
  *
  * @param header the related HTTP header.
  * @param in the incoming HTTP connection.
@@ -156,23 +210,147 @@ bool ProxyPathHandler::addRedirectRule(
  *
  * @return true if successful, false if an exception occurred.
  */
-static bool _proxyHttp(
+static bool _proxyBody(
    HttpHeader* header, HttpConnection* in, HttpConnection* out)
 {
-   bool rval;
+   bool rval = true;
+
+   // any trailer read from the input stream is written by the output stream
+   HttpTrailer trailer;
+   InputStream* is = in->getBodyInputStream(header, &trailer);
+   OutputStream* os = out->getBodyOutputStream(header, &trailer);
 
-   // send header
-   rval = out->sendHeader(header);
+   char b[BODY_BUFFER_SIZE];
+   int numBytes;
+   while(rval && (numBytes = is->read(b, BODY_BUFFER_SIZE)) > 0)
+   {
+      rval = os->write(b, numBytes);
+   }
+
+   // finish the body (sends any final chunk and trailer)
+   rval = rval && (numBytes == 0) && os->finish();
+
+   is->close();
+   os->close();
+   delete is;
+   delete os;
+
+   return rval;
+}
+
+/**
+ * Returns true if the response to a request may have a message body.
+ *
+ * @param req the request header.
+ * @param res the response header.
+ *
+ * @return true if the response may have a body, false if not.
+ */
+static bool _responseHasBody(HttpRequestHeader* req, HttpResponseHeader* res)
+{
+   int code = res->getStatusCode();
+   return
+      strcmp(req->getMethod(), "HEAD") != 0 &&
+      code >= 200 && code != 204 && code != 304 &&
+      res->hasContent();
+}
+
+/**
+ * Sends a "503 Service Unavailable" response.
+ *
+ * @param ch the communication channel with the client.
+ */
+static void _sendServiceUnavailable(ServiceChannel* ch)
+{
+   HttpResponseHeader* header = ch->getResponse()->getHeader();
+   header->setStatus(503, "Service Unavailable");
+   string content =
+      "<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML 2.0//EN\">\n"
+      "<html><head>\n"
+      "<title>503 Service Unavailable</title>\n"
+      "</head><body>\n"
+      "<h1>Service Unavailable</h1>\n"
+      "<p>The service was not available.</p>\n"
+      "</body></html>";
+   ByteBuffer b(content.length());
+   b.put(content.c_str(), content.length(), false);
+   ByteArrayInputStream bais(&b);
+   ch->sendContent(&bais);
+}
+
+/**
+ * Proxies a client's request over the given connection and proxies the
+ * server's response back to the client.
+ *
+ * @param ch the communication channel with the client.
+ * @param conn the connection to the server.
+ * @param reusable set to true if the connection can be reused afterwards.
+ *
+ * @return true if the server's response header was received, false if
+ *         an exception occurred before then.
+ */
+static bool _proxyHttp(ServiceChannel* ch, HttpConnection* conn, bool& reusable)
+{
+   bool rval;
+   reusable = false;
+
+   HttpRequest* req = ch->getRequest();
+   HttpRequestHeader* reqHeader = req->getHeader();
+   HttpResponseHeader* resHeader = ch->getResponse()->getHeader();
+
+   // ask the server to keep the connection alive regardless of what the
+   // client asked for, the field is hop-by-hop
+   string clientConnection = reqHeader->getFieldValue("Connection");
+   reqHeader->setField("Connection", "keep-alive");
+   rval = conn->sendHeader(reqHeader);
+   if(clientConnection.length() > 0)
+   {
+      reqHeader->setField("Connection", clientConnection);
+   }
+   else
+   {
+      reqHeader->removeField("Connection");
+   }
 
-   // see if there is content to proxy
-   if(rval && header->hasContent())
+   // stream request body, then receive server's header (by writing it into
+   // the client's response header)
+   bool success =
+      rval &&
+      (!reqHeader->hasContent() ||
+       _proxyBody(reqHeader, req->getConnection(), conn)) &&
+      conn->receiveHeader(resHeader);
+   if(!success)
    {
-      // proxy content
-      HttpTrailer trailer;
-      InputStream* is = in->getBodyInputStream(header, &trailer);
-      rval = out->sendBody(header, is, &trailer);
-      is->close();
-      delete is;
+      rval = false;
+   }
+   else
+   {
+      bool body = _responseHasBody(reqHeader, resHeader);
+      bool delimited =
+         !body || HttpConnectionPool::isBodyDelimited(resHeader);
+
+      // replace the server's hop-by-hop fields with the client's
+      resHeader->removeField("Keep-Alive");
+      if(!delimited)
+      {
+         resHeader->setField("Connection", "close");
+      }
+      else if(clientConnection.length() > 0)
+      {
+         resHeader->setField("Connection", clientConnection);
+      }
+      else
+      {
+         resHeader->removeField("Connection");
+      }
+
+      // proxy the server's response, consider result sent
+      success = req->getConnection()->sendHeader(resHeader) &&
+         (!body || _proxyBody(resHeader, conn, req->getConnection()));
+      ch->setSent();
+
+      reusable =
+         success && HttpConnectionPool::isReusable(conn, resHeader, body);
    }
 
    return rval;
@@ -197,6 +375,8 @@ void ProxyPathHandler::operator()(ServiceChannel* ch)
    }
    else
    {
+      Atomic::incrementAndFetch(&rule->metrics->requests);
+
       // get URL to proxy or redirect to
       UrlRef url = rule->url;
 
@@ -307,57 +487,96 @@ void ProxyPathHandler::operator()(ServiceChannel* ch)
             urlHost.c_str(), path.c_str(),
             hrh->toString().c_str());
 
-         // get a connection
-         HttpConnection* conn = HttpClient::createConnection(&(*url));
-         if(conn == NULL)
+         proxy(ch, rule);
+      }
+   }
+}
+
+void ProxyPathHandler::proxy(ServiceChannel* ch, Rule* rule)
+{
+   Url* url = &(*rule->url);
+   RuleMetrics* m = rule->metrics;
+
+   HttpRequestHeader* reqHeader = ch->getRequest()->getHeader();
+   bool retry = HttpConnectionPool::isRetryable(
+      reqHeader->getMethod(), reqHeader->hasContent());
+   bool done = false;
+   while(!done)
+   {
+      // check out an idle connection or permission to make a new one
+      HttpConnectionRef conn(NULL);
+      bool reused = false;
+      if(mConnectionPool.checkoutConnection(url, conn))
+      {
+         Atomic::incrementAndFetch(&m->active);
+         if(!conn.isNull())
          {
-            // send service unavailable
-            HttpResponseHeader* header = ch->getResponse()->getHeader();
-            header->setStatus(503, "Service Unavailable");
-            string content =
-               "<!DOCTYPE HTML PUBLIC \"-//IETF//DTD HTML 2.0//EN\">\n"
-               "<html><head>\n"
-               "<title>503 Service Unavailable</title>\n"
-               "</head><body>\n"
-               "<h1>Service Unavailable</h1>\n"
-               "<p>The service was not available.</p>\n"
-               "</body></html>";
-            ByteBuffer b(content.length());
-            b.put(content.c_str(), content.length(), false);
-            ByteArrayInputStream bais(&b);
-            ch->sendContent(&bais);
+            reused = true;
+            Atomic::incrementAndFetch(&m->connectionsReused);
          }
          else
          {
-            // proxy the client's request and receive server's header (by
-            // writing it into the client's response header)
-            HttpResponse* res = ch->getResponse();
-            if(_proxyHttp(req->getHeader(), req->getConnection(), conn) &&
-               conn->receiveHeader(res->getHeader()))
+            HttpConnection* hc = HttpClient::createConnection(url);
+            if(hc != NULL)
             {
-               // proxy the server's response, consider result sent
-               _proxyHttp(res->getHeader(), conn, req->getConnection());
-               ch->setSent();
+               conn = hc;
+               Atomic::incrementAndFetch(&m->connectionsCreated);
+            }
+            else
+            {
+               mConnectionPool.checkinConnection(url, conn, false);
+               Atomic::decrementAndFetch(&m->active);
             }
-
-            // close connection
-            conn->close();
-
-            // clean up
-            delete conn;
          }
+      }
 
-         if(!ch->hasSent())
+      if(conn.isNull())
+      {
+         // send service unavailable
+         MO_CAT_WARNING(MO_WS_CAT,
+            "ProxyPathHandler could not get a connection to %s.",
+            url->toString().c_str());
+         Atomic::incrementAndFetch(&m->unavailable);
+         _sendServiceUnavailable(ch);
+         done = true;
+      }
+      else
+      {
+         bool reusable;
+         if(_proxyHttp(ch, &(*conn), reusable) || !reused || !retry)
          {
-            // send exception (client's fault if code < 500)
-            ExceptionRef e = Exception::get();
-            bool clientsFault =
-               e->getDetails()->hasMember("httpStatusCode") &&
-               e->getDetails()["httpStatusCode"]->getInt32() < 500;
-            ch->sendException(e, clientsFault);
+            done = true;
          }
+         else
+         {
+            // the idle connection failed, so any others to the same server
+            // are unlikely to be usable either
+            MO_CAT_DEBUG(MO_WS_CAT,
+               "ProxyPathHandler reused connection to %s failed, retrying.",
+               url->toString().c_str());
+            mConnectionPool.removeConnections(url);
+            Exception::clear();
+         }
+
+         // return connection to the pool
+         mConnectionPool.checkinConnection(url, conn, reusable);
+         Atomic::decrementAndFetch(&m->active);
       }
    }
+
+   if(!ch->hasSent())
+   {
+      // evict idle connections to a server that failed
+      Atomic::incrementAndFetch(&m->errors);
+      mConnectionPool.removeConnections(url);
+
+      // send exception (client's fault if code < 500)
+      ExceptionRef e = Exception::get();
+      bool clientsFault =
+         e->getDetails()->hasMember("httpStatusCode") &&
+         e->getDetails()["httpStatusCode"]->getInt32() < 500;
+      ch->sendException(e, clientsFault);
+   }
 }
 
 bool ProxyPathHandler::addRule(
@@ -447,6 +666,7 @@ bool ProxyPathHandler::addRule(
                "" : ri->second.url->getPath().c_str());
 
          free((char*)ri->first);
+         delete ri->second.metrics;
          rules.erase(ri);
       }
 
@@ -463,6 +683,8 @@ bool ProxyPathHandler::addRule(
          rule.rewriteHost = rewriteHost;
       }
       rule.path = strdup(absPath.c_str());
+      rule.metrics = new RuleMetrics;
+      memset(rule.metrics, 0, sizeof(RuleMetrics));
       rules[rule.path] = rule;
       MO_CAT_INFO(MO_WS_CAT,
          "ProxyPathHandler added %s rule: %s%s/* => %s%s/*",
@@ -1,10 +1,11 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_ws_ProxyPathHandler_H
 #define monarch_ws_ProxyPathHandler_H
 
 #include "monarch/ws/RestfulHandler.h"
+#include "monarch/http/HttpConnectionPool.h"
 #include "monarch/util/Pattern.h"
 
 namespace monarch
@@ -28,6 +29,13 @@ namespace ws
  * Else delegate to RestfulHandler.
  *    Done.
  *
+ * Connections to the servers that requests are proxied to are kept alive and
+ * pooled so that they can be reused by later requests. The number of idle
+ * and total connections per server, how long they may remain idle, and how
+ * long a request waits for a connection when the maximum are in use can be
+ * set on the handler's connection pool. Message bodies are streamed between
+ * the client and the server as they are received.
+ *
  * @author Dave Longley
  */
 class ProxyPathHandler : public monarch::ws::RestfulHandler
@@ -38,6 +46,44 @@ protected:
     */
    char* mPath;
 
+   /**
+    * Metrics for a proxy rule. These are updated atomically.
+    */
+   struct RuleMetrics
+   {
+      /**
+       * The number of connections currently in use by the rule.
+       */
+      volatile uint32_t active;
+
+      /**
+       * The number of requests proxied or redirected by the rule.
+       */
+      volatile uint64_t requests;
+
+      /**
+       * The number of new connections that were made to the server.
+       */
+      volatile uint64_t connectionsCreated;
+
+      /**
+       * The number of idle connections that were reused.
+       */
+      volatile uint64_t connectionsReused;
+
+      /**
+       * The number of requests that were rejected because the server could
+       * not be reached or no connection became available in time.
+       */
+      volatile uint64_t unavailable;
+
+      /**
+       * The number of requests that failed before a response was received
+       * from the server.
+       */
+      volatile uint64_t errors;
+   };
+
    /**
     * Data for a proxy or redirect rule.
     */
@@ -58,6 +104,7 @@ protected:
          bool permanent;
       };
       const char* path;
+      RuleMetrics* metrics;
    };
 
    /**
@@ -90,6 +137,11 @@ protected:
    typedef std::vector<ProxyDomain*> ProxyDomainList;
    ProxyDomainList mDomains;
 
+   /**
+    * The pool of idle connections to proxied servers.
+    */
+   monarch::http::HttpConnectionPool mConnectionPool;
+
 public:
    /**
     * Creates a new ProxyPathHandler.
@@ -178,6 +230,39 @@ public:
    virtual bool addRedirectRule(
       const char* domain, const char* path, const char* url, bool permanent);
 
+   /**
+    * Gets the pool of connections to proxied servers. It can be used to set
+    * the maximum number of idle and total connections per server, the idle
+    * timeout, and the time to wait for a connection. A request that can't
+    * get a connection in time receives a "503 Service Unavailable" response.
+    *
+    * @return the connection pool.
+    */
+   virtual monarch::http::HttpConnectionPool* getConnectionPool();
+
+   /**
+    * Gets the metrics for each rule in this handler. An array is returned
+    * with an entry for each rule:
+    *
+    * {
+    *    "domain": the incoming domain,
+    *    "path": the incoming absolute path or "*",
+    *    "type": "proxy" or "redirect",
+    *    "url": the URL to proxy or redirect to,
+    *    "requests": the number of requests handled by the rule,
+    *    "active": the number of connections currently in use,
+    *    "idle": the number of idle connections to the proxied server,
+    *    "connectionsCreated": the number of new connections made,
+    *    "connectionsReused": the number of idle connections reused,
+    *    "unavailable": the number of requests rejected with a 503,
+    *    "errors": the number of requests that failed before the server
+    *       responded
+    * }
+    *
+    * @return the rule metrics.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
    /**
     * Proxies incoming HTTP traffic to another server or redirects a user-agent
     * to another url.
@@ -219,6 +304,18 @@ protected:
     */
    virtual Rule* findRule(ServiceChannel* ch, std::string& host);
 
+   /**
+    * Proxies the request in the given channel to the server for a proxy rule
+    * and proxies the server's response back to the client. A connection is
+    * checked out of the pool, an idle one is used if available, otherwise a
+    * new connection is made. If the server keeps the connection alive, it is
+    * checked back in for reuse once the response has been proxied.
+    *
+    * @param ch the communication channel with the client.
+    * @param rule the proxy rule.
+    */
+   virtual void proxy(ServiceChannel* ch, Rule* rule);
+
    /**
     * Gets the string representation for the given rule type.
     *
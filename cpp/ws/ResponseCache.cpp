@@ -0,0 +1,668 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#define __STDC_FORMAT_MACROS
+
+#include "monarch/ws/ResponseCache.h"
+
+#include "monarch/compress/ContentEncoder.h"
+#include "monarch/data/json/JsonWriter.h"
+#include "monarch/data/msgpack/MessagePackWriter.h"
+#include "monarch/data/xml/XmlWriter.h"
+#include "monarch/io/ByteArrayInputStream.h"
+#include "monarch/io/ByteArrayOutputStream.h"
+#include "monarch/io/ByteBuffer.h"
+#include "monarch/rt/System.h"
+#include "monarch/util/Date.h"
+
+#include <cstdio>
+#include <cstring>
+#include <inttypes.h>
+
+using namespace std;
+using namespace monarch::compress;
+using namespace monarch::data;
+using namespace monarch::data::json;
+using namespace monarch::data::msgpack;
+using namespace monarch::data::xml;
+using namespace monarch::http;
+using namespace monarch::io;
+using namespace monarch::rt;
+using namespace monarch::util;
+using namespace monarch::ws;
+
+ResponseCache::ResponseCache(uint32_t maxSize, uint32_t ttl) :
+   mCacheCredentialed(false),
+   mMaxSize(maxSize),
+   mSize(0),
+   mTimeToLive(ttl),
+   mHits(0),
+   mMisses(0),
+   mNotModified(0),
+   mStores(0),
+   mEvictions(0),
+   mExpirations(0),
+   mInvalidations(0)
+{
+   mVary.push_back("Accept");
+}
+
+ResponseCache::~ResponseCache()
+{
+   // clean up cache keys
+   for(EntryMap::iterator i = mEntries.begin(); i != mEntries.end(); ++i)
+   {
+      free((char*)i->first);
+   }
+}
+
+void ResponseCache::setMaxSize(uint32_t size)
+{
+   mLock.lock();
+   {
+      mMaxSize = size;
+      while(mSize > mMaxSize)
+      {
+         removeEntry(mEntries.find(mLru.back()));
+         ++mEvictions;
+      }
+   }
+   mLock.unlock();
+}
+
+uint32_t ResponseCache::getMaxSize()
+{
+   return mMaxSize;
+}
+
+void ResponseCache::setTimeToLive(uint32_t ttl)
+{
+   mTimeToLive = ttl;
+}
+
+uint32_t ResponseCache::getTimeToLive()
+{
+   return mTimeToLive;
+}
+
+void ResponseCache::addVaryHeader(const char* field)
+{
+   mVary.push_back(field);
+}
+
+void ResponseCache::setCacheCredentialedRequests(bool on)
+{
+   mCacheCredentialed = on;
+}
+
+bool ResponseCache::isCacheable(ServiceChannel* ch)
+{
+   bool rval = false;
+
+   Message::MethodType method = ch->getRequestMethod();
+   if((method == Message::Get || method == Message::Head) && !isPrivate(ch))
+   {
+      HttpResponseHeader* header = ch->getResponse()->getHeader();
+      int code = header->getStatusCode();
+      string cc;
+      rval =
+         (code == 0 || code == 200) &&
+         !header->hasField("Set-Cookie") &&
+         !(header->getField("Cache-Control", cc) &&
+           (strstr(cc.c_str(), "no-store") != NULL ||
+            strstr(cc.c_str(), "private") != NULL));
+   }
+
+   return rval;
+}
+
+bool ResponseCache::respond(ServiceChannel* ch)
+{
+   bool rval = false;
+
+   Message::MethodType method = ch->getRequestMethod();
+   if((method == Message::Get || method == Message::Head) && !isPrivate(ch))
+   {
+      // a client may insist on a fresh response
+      string cc;
+      bool noCache =
+         ch->getRequest()->getHeader()->getField("Cache-Control", cc) &&
+         strstr(cc.c_str(), "no-cache") != NULL;
+
+      string key;
+      createKey(ch, key);
+      EntryRef entry(NULL);
+      mLock.lock();
+      {
+         EntryMap::iterator i = noCache ?
+            mEntries.end() : mEntries.find(key.c_str());
+         if(i != mEntries.end())
+         {
+            uint64_t expires = i->second->expires;
+            if(expires != 0 && System::getCurrentMilliseconds() >= expires)
+            {
+               removeEntry(i);
+               ++mExpirations;
+            }
+            else
+            {
+               // mark entry as most recently used
+               entry = i->second;
+               mLru.splice(mLru.begin(), mLru, entry->lru);
+            }
+         }
+
+         if(entry.isNull())
+         {
+            ++mMisses;
+         }
+         else
+         {
+            ++mHits;
+         }
+      }
+      mLock.unlock();
+
+      if(!entry.isNull())
+      {
+         send(ch, entry);
+         rval = true;
+      }
+   }
+
+   return rval;
+}
+
+/**
+ * Creates an ETag for a body from its FNV-1a hash and its length.
+ *
+ * @param body the body.
+ * @param etag set to the ETag.
+ */
+static void _createETag(const string& body, string& etag)
+{
+   uint64_t hash = 14695981039346656037ULL;
+   const unsigned char* data = (const unsigned char*)body.data();
+   for(size_t i = 0; i < body.length(); ++i)
+   {
+      hash ^= data[i];
+      hash *= 1099511628211ULL;
+   }
+
+   char tmp[40];
+   snprintf(tmp, 40, "\"%" PRIx64 "-%" PRIx64 "\"",
+      (uint64_t)body.length(), hash);
+   etag = tmp;
+}
+
+bool ResponseCache::storeAndSend(ServiceChannel* ch, DynamicObject& dyno)
+{
+   bool rval = true;
+
+   // serialize the content like a Message would
+   EntryRef entry = new Entry;
+   HttpResponseHeader* header = ch->getResponse()->getHeader();
+   Message::ContentType type = Message::getContentType(header);
+   if(type == Message::Unknown)
+   {
+      ExceptionRef e = new Exception(
+         "Unknown Content-Type for Message using DynamicObject.",
+         "monarch.ws.UnknownContentType");
+      e->getDetails()["contentType"] =
+         header->getFieldValue("Content-Type").c_str();
+      Exception::set(e);
+      rval = false;
+   }
+   else if(type == Message::Form)
+   {
+      entry->body[Identity] = Url::formEncode(dyno);
+   }
+   else
+   {
+      DynamicObjectWriter* writer;
+      if(type == Message::Json || type == Message::JsonLd)
+      {
+         writer = new JsonWriter();
+      }
+      else if(type == Message::MessagePack)
+      {
+         writer = new MessagePackWriter();
+      }
+      else
+      {
+         writer = new XmlWriter();
+      }
+      writer->setCompact(true);
+
+      ByteBuffer b(1024);
+      ByteArrayOutputStream baos(&b, true);
+      rval = writer->write(dyno, &baos);
+      if(rval)
+      {
+         entry->body[Identity].assign(b.data(), b.length());
+      }
+      delete writer;
+   }
+
+   if(rval)
+   {
+      Date now;
+      TimeZone gmt = TimeZone::getTimeZone("GMT");
+      entry->contentType = header->getFieldValue("Content-Type");
+      _createETag(entry->body[Identity], entry->etag);
+      entry->modified = now.getSeconds();
+      now.format(entry->lastModified, HttpHeader::sDateFormat, &gmt);
+      entry->expires = (mTimeToLive == 0) ?
+         0 : System::getCurrentMilliseconds() + mTimeToLive;
+      entry->encoded[Identity] = true;
+      entry->encoded[Gzip] = false;
+      entry->encoded[Deflate] = false;
+      entry->size = entry->body[Identity].length();
+      entry->cached = false;
+
+      string key;
+      createKey(ch, key);
+      mLock.lock();
+      {
+         // an unchanged response keeps its modification date
+         EntryMap::iterator i = mEntries.find(key.c_str());
+         if(i != mEntries.end() && i->second->etag == entry->etag)
+         {
+            entry->modified = i->second->modified;
+            entry->lastModified = i->second->lastModified;
+         }
+         storeEntry(key.c_str(), entry);
+      }
+      mLock.unlock();
+
+      rval = send(ch, entry);
+   }
+
+   return rval;
+}
+
+int ResponseCache::invalidate(const char* path)
+{
+   int rval;
+
+   mLock.lock();
+   {
+      rval = invalidatePaths(path, false);
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+int ResponseCache::invalidatePrefix(const char* prefix)
+{
+   int rval;
+
+   mLock.lock();
+   {
+      rval = invalidatePaths(prefix, true);
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+void ResponseCache::clear()
+{
+   mLock.lock();
+   {
+      mInvalidations += mEntries.size();
+      while(!mEntries.empty())
+      {
+         removeEntry(mEntries.begin());
+      }
+   }
+   mLock.unlock();
+}
+
+DynamicObject ResponseCache::getStats()
+{
+   DynamicObject rval;
+
+   mLock.lock();
+   {
+      rval["maxSize"] = mMaxSize;
+      rval["size"] = mSize;
+      rval["entries"] = (uint32_t)mEntries.size();
+      rval["hits"] = mHits;
+      rval["misses"] = mMisses;
+      rval["notModified"] = mNotModified;
+      rval["stores"] = mStores;
+      rval["evictions"] = mEvictions;
+      rval["expirations"] = mExpirations;
+      rval["invalidations"] = mInvalidations;
+   }
+   mLock.unlock();
+
+   return rval;
+}
+
+bool ResponseCache::isPrivate(ServiceChannel* ch)
+{
+   bool rval = false;
+
+   if(!mCacheCredentialed)
+   {
+      // credentials that are varied on are part of the key
+      HttpRequestHeader* header = ch->getRequest()->getHeader();
+      const char* fields[] = {"Authorization", "Cookie"};
+      for(int f = 0; !rval && f < 2; ++f)
+      {
+         rval = header->hasField(fields[f]);
+         for(vector<string>::iterator i = mVary.begin();
+             rval && i != mVary.end(); ++i)
+         {
+            rval = (strcasecmp(i->c_str(), fields[f]) != 0);
+         }
+      }
+   }
+
+   return rval;
+}
+
+void ResponseCache::createKey(ServiceChannel* ch, string& key)
+{
+   // normalized path and query followed by the values of the headers
+   // varied on
+   HttpRequestHeader* header = ch->getRequest()->getHeader();
+   key.append(ch->getPath());
+   for(vector<string>::iterator i = mVary.begin(); i != mVary.end(); ++i)
+   {
+      key.push_back('\n');
+      key.append(*i);
+      key.push_back(':');
+      key.append(header->getFieldValue(i->c_str()));
+   }
+}
+
+/**
+ * Compresses a body.
+ *
+ * @param in the body to compress.
+ * @param gzip true to gzip, false to deflate.
+ * @param out set to the compressed body.
+ *
+ * @return true if successful, false if an exception occurred.
+ */
+static bool _compress(const string& in, bool gzip, string& out)
+{
+   ByteBuffer b(in.length() / 2 + 64);
+   bool rval = ContentEncoder::encode(in.data(), in.length(), gzip, &b);
+   if(rval)
+   {
+      out.assign(b.data(), b.length());
+   }
+   return rval;
+}
+
+const string& ResponseCache::getBody(EntryRef& entry, Encoding& encoding)
+{
+   bool encoded;
+   mLock.lock();
+   {
+      encoded = entry->encoded[encoding];
+   }
+   mLock.unlock();
+
+   if(!encoded)
+   {
+      // the identity body never changes so it is safe to compress unlocked
+      string body;
+      if(!_compress(entry->body[Identity], encoding == Gzip, body))
+      {
+         Exception::clear();
+         encoding = Identity;
+      }
+      else
+      {
+         mLock.lock();
+         {
+            if(!entry->encoded[encoding])
+            {
+               entry->body[encoding].swap(body);
+               entry->encoded[encoding] = true;
+
+               // account for the new variant if the entry is still cached,
+               // evicting others if necessary
+               if(entry->cached)
+               {
+                  uint32_t size = entry->body[encoding].length();
+                  entry->size += size;
+                  mSize += size;
+                  const char* key = *entry->lru;
+                  while(mSize > mMaxSize && mLru.back() != key)
+                  {
+                     removeEntry(mEntries.find(mLru.back()));
+                     ++mEvictions;
+                  }
+               }
+            }
+         }
+         mLock.unlock();
+      }
+   }
+
+   return entry->body[encoding];
+}
+
+/**
+ * Returns true if an If-None-Match header value matches an ETag.
+ *
+ * @param value the If-None-Match header value.
+ * @param etag the ETag.
+ *
+ * @return true if the value matches, false if not.
+ */
+static bool _matchETag(const string& value, const string& etag)
+{
+   bool rval = false;
+
+   string::size_type start = 0;
+   while(!rval && start < value.length())
+   {
+      // get next comma-separated tag, trimmed, ignoring the weak marker
+      string::size_type end = value.find(',', start);
+      if(end == string::npos)
+      {
+         end = value.length();
+      }
+      string tag = value.substr(start, end - start);
+      StringTools::trim(tag);
+      if(tag.compare(0, 2, "W/") == 0)
+      {
+         tag.erase(0, 2);
+      }
+      rval = (tag == "*" || tag == etag);
+      start = end + 1;
+   }
+
+   return rval;
+}
+
+bool ResponseCache::send(ServiceChannel* ch, EntryRef& entry)
+{
+   bool rval;
+
+   HttpRequestHeader* reqHeader = ch->getRequest()->getHeader();
+   HttpResponseHeader* resHeader = ch->getResponse()->getHeader();
+   resHeader->setField("ETag", entry->etag);
+   resHeader->setField("Last-Modified", entry->lastModified);
+   string vary = "Accept-Encoding";
+   for(vector<string>::iterator i = mVary.begin(); i != mVary.end(); ++i)
+   {
+      vary.append(", ");
+      vary.append(*i);
+   }
+   resHeader->setField("Vary", vary);
+
+   // check conditions, an entity tag takes precedence over a date
+   bool notModified = false;
+   string value;
+   if(reqHeader->getField("If-None-Match", value))
+   {
+      notModified = _matchETag(value, entry->etag);
+   }
+   else if(reqHeader->getField("If-Modified-Since", value))
+   {
+      // an invalid date is ignored
+      Date date;
+      if(HttpHeader::parseDate(value.c_str(), date))
+      {
+         notModified = (entry->modified <= date.getSeconds());
+      }
+      else
+      {
+         Exception::clear();
+      }
+   }
+
+   // send the body as a stream, not as an object
+   Message* out = ch->getOutput();
+   DynamicObject none(NULL);
+   out->setDynamicObject(none);
+   if(notModified)
+   {
+      mLock.lock();
+      ++mNotModified;
+      mLock.unlock();
+
+      resHeader->setStatus(304, "Not Modified");
+      resHeader->removeField("Content-Type");
+      resHeader->removeField("Content-Encoding");
+      resHeader->removeField("Transfer-Encoding");
+      out->setContentSource(NULL);
+      rval = out->sendResponse(ch->getResponse());
+   }
+   else
+   {
+      if(resHeader->getStatusCode() == 0)
+      {
+         resHeader->setStatus(200, "OK");
+      }
+      resHeader->setField("Content-Type", entry->contentType);
+
+      // select a cached variant for the content-encoding
+      if(ch->isAutoContentEncode() && !resHeader->hasField("Content-Encoding"))
+      {
+         ch->selectContentEncoding();
+      }
+      Encoding encoding = Identity;
+      if(resHeader->getField("Content-Encoding", value))
+      {
+         if(strstr(value.c_str(), "gzip") != NULL)
+         {
+            encoding = Gzip;
+         }
+         else if(strstr(value.c_str(), "deflate") != NULL)
+         {
+            encoding = Deflate;
+         }
+      }
+      const string& body = getBody(entry, encoding);
+      if(encoding == Identity)
+      {
+         resHeader->removeField("Content-Encoding");
+      }
+
+      // send with a content-length, the body is already encoded
+      resHeader->removeField("Transfer-Encoding");
+      resHeader->setField("Content-Length", (int64_t)body.length());
+      if(ch->getRequestMethod() == Message::Head)
+      {
+         out->setContentSource(NULL);
+         rval = out->sendResponse(ch->getResponse());
+      }
+      else
+      {
+         ByteArrayInputStream bais(body.data(), body.length());
+         out->setContentSource(&bais);
+         rval = out->sendResponse(ch->getResponse());
+         out->setContentSource(NULL);
+      }
+   }
+
+   if(rval)
+   {
+      ch->setSent();
+   }
+
+   return rval;
+}
+
+void ResponseCache::storeEntry(const char* key, EntryRef& entry)
+{
+   // replace any existing entry
+   EntryMap::iterator i = mEntries.find(key);
+   if(i != mEntries.end())
+   {
+      removeEntry(i);
+   }
+
+   // bodies larger than the whole cache are not cached
+   if(entry->size <= mMaxSize)
+   {
+      // evict least recently used entries to make room
+      while(mSize + entry->size > mMaxSize)
+      {
+         removeEntry(mEntries.find(mLru.back()));
+         ++mEvictions;
+      }
+
+      const char* k = strdup(key);
+      mLru.push_front(k);
+      entry->lru = mLru.begin();
+      entry->cached = true;
+      mEntries[k] = entry;
+      mSize += entry->size;
+      ++mStores;
+   }
+}
+
+void ResponseCache::removeEntry(EntryMap::iterator i)
+{
+   const char* key = i->first;
+   EntryRef& entry = i->second;
+   mSize -= entry->size;
+   entry->cached = false;
+   mLru.erase(entry->lru);
+   mEntries.erase(i);
+   free((char*)key);
+}
+
+int ResponseCache::invalidatePaths(const char* path, bool prefix)
+{
+   int rval = 0;
+
+   // ignore any query in a path that is not a prefix
+   size_t length = prefix ? strlen(path) : strcspn(path, "?");
+   EntryMap::iterator i = mEntries.begin();
+   while(i != mEntries.end())
+   {
+      // the path of a key ends at its query or its first varied header
+      const char* key = i->first;
+      size_t keyLength = strcspn(key, "?\n");
+      bool match =
+         strncmp(key, path, length) == 0 &&
+         (prefix ? keyLength >= length : keyLength == length);
+      if(match)
+      {
+         EntryMap::iterator next = i;
+         ++next;
+         removeEntry(i);
+         i = next;
+         ++rval;
+      }
+      else
+      {
+         ++i;
+      }
+   }
+   mInvalidations += rval;
+
+   return rval;
+}
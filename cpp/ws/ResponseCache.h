@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2012 Digital Bazaar, Inc. All rights reserved.
+ */
+#ifndef monarch_ws_ResponseCache_H
+#define monarch_ws_ResponseCache_H
+
+#include "monarch/rt/DynamicObject.h"
+#include "monarch/rt/ExclusiveLock.h"
+#include "monarch/util/StringTools.h"
+#include "monarch/ws/ServiceChannel.h"
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace monarch
+{
+namespace ws
+{
+
+/**
+ * A ResponseCache is a thread-safe, in-memory cache of the responses sent by
+ * one or more PathHandlers. It is attached to a handler with
+ * PathHandler::setResponseCache().
+ *
+ * When a handler with a cache sends a DynamicObject in response to a GET or
+ * HEAD request, the serialized body is stored in the cache, keyed by the
+ * request path (including its query) and the values of the request headers
+ * that the response varies on. Later requests for the same key are answered
+ * from the cache without calling the handler. Compressed (gzip and deflate)
+ * variants of a body are created the first time they are requested and are
+ * then cached alongside it.
+ *
+ * Every cached response has an ETag, derived from its body, and a
+ * Last-Modified date. Requests with a matching If-None-Match or an
+ * If-Modified-Since that is not older than the response are answered with
+ * 304 Not Modified.
+ *
+ * Cached responses expire after a time to live. When the total size of the
+ * cached bodies would exceed the maximum size, the least recently used
+ * responses are evicted. Responses can also be invalidated by path, by path
+ * prefix or all at once, and any request to a handler with a cache that is
+ * not a GET or HEAD invalidates the cached responses for its path.
+ *
+ * The cache key does not identify who made the request, so a cache must only
+ * be used for public resources or resources that are the same for every
+ * client, unless the credentials that select the response are varied on
+ * (for example with addVaryHeader("Authorization") or
+ * addVaryHeader("Cookie")). A request with an Authorization or Cookie header
+ * that is not varied on is neither cached nor answered from the cache,
+ * unless setCacheCredentialedRequests() says that it may be.
+ *
+ * @author Dave Longley
+ */
+class ResponseCache
+{
+public:
+   /**
+    * The content-encodings of a cached body.
+    */
+   enum Encoding
+   {
+      Identity = 0, Gzip, Deflate, EncodingCount
+   };
+
+protected:
+   /**
+    * A list of cache keys, most recently used first.
+    */
+   typedef std::list<const char*> KeyList;
+
+   /**
+    * A cached response. Once it is in the cache, only its missing encoded
+    * variants are ever set, and only while the cache is locked.
+    */
+   struct Entry
+   {
+      std::string contentType;
+      std::string etag;
+      std::string lastModified;
+      time_t modified;
+      uint64_t expires;
+      std::string body[EncodingCount];
+      bool encoded[EncodingCount];
+      uint32_t size;
+      bool cached;
+      KeyList::iterator lru;
+   };
+   typedef monarch::rt::Collectable<Entry> EntryRef;
+
+   /**
+    * A mapping of cache keys to cached responses.
+    */
+   typedef std::map<
+      const char*, EntryRef, monarch::util::StringComparator> EntryMap;
+   EntryMap mEntries;
+
+   /**
+    * The cache keys in least recently used order.
+    */
+   KeyList mLru;
+
+   /**
+    * The request headers that responses vary on.
+    */
+   std::vector<std::string> mVary;
+
+   /**
+    * True if responses to requests with credentials that are not varied on
+    * may be cached.
+    */
+   bool mCacheCredentialed;
+
+   /**
+    * The maximum total size of the cached bodies, in bytes.
+    */
+   uint32_t mMaxSize;
+
+   /**
+    * The total size of the cached bodies, in bytes.
+    */
+   uint32_t mSize;
+
+   /**
+    * The time a response may be cached, in milliseconds, 0 for no limit.
+    */
+   uint32_t mTimeToLive;
+
+   /**
+    * Counters for the stats of this cache.
+    */
+   uint64_t mHits;
+   uint64_t mMisses;
+   uint64_t mNotModified;
+   uint64_t mStores;
+   uint64_t mEvictions;
+   uint64_t mExpirations;
+   uint64_t mInvalidations;
+
+   /**
+    * A lock for modifying the cache.
+    */
+   monarch::rt::ExclusiveLock mLock;
+
+public:
+   /**
+    * Creates a new ResponseCache. Responses vary on the Accept header by
+    * default, because it selects the type of the content that is sent.
+    *
+    * @param maxSize the maximum total size of the cached bodies, in bytes.
+    * @param ttl the time a response may be cached, in milliseconds, 0 for no
+    *           limit.
+    */
+   ResponseCache(
+      uint32_t maxSize = 16 * 1024 * 1024, uint32_t ttl = 60000);
+
+   /**
+    * Destructs this ResponseCache.
+    */
+   virtual ~ResponseCache();
+
+   /**
+    * Sets the maximum total size of the cached bodies. Responses are evicted
+    * if the cache is now too large.
+    *
+    * @param size the maximum size in bytes.
+    */
+   virtual void setMaxSize(uint32_t size);
+
+   /**
+    * Gets the maximum total size of the cached bodies.
+    *
+    * @return the maximum size in bytes.
+    */
+   virtual uint32_t getMaxSize();
+
+   /**
+    * Sets the time a response may be cached. Applies to responses cached
+    * after it is set.
+    *
+    * @param ttl the time to live in milliseconds, 0 for no limit.
+    */
+   virtual void setTimeToLive(uint32_t ttl);
+
+   /**
+    * Gets the time a response may be cached.
+    *
+    * @return the time to live in milliseconds, 0 for no limit.
+    */
+   virtual uint32_t getTimeToLive();
+
+   /**
+    * Adds a request header that responses vary on. Requests that differ in
+    * the value of the header are cached separately. This should be called
+    * before the cache is used.
+    *
+    * @param field the name of the header field.
+    */
+   virtual void addVaryHeader(const char* field);
+
+   /**
+    * Sets whether responses to requests with an Authorization or Cookie
+    * header that is not varied on may be cached and answered from the cache.
+    * This is off by default and must only be turned on if the responses do
+    * not depend on who made the request, otherwise one client's response
+    * would be sent to others.
+    *
+    * @param on true to cache them, false not to.
+    */
+   virtual void setCacheCredentialedRequests(bool on);
+
+   /**
+    * Returns true if the response to the request on the given channel may be
+    * cached. Only successful responses to GET and HEAD requests may be
+    * cached and not if the response sets a cookie, its Cache-Control forbids
+    * storing it or the request has credentials (see isPrivate()).
+    *
+    * @param ch the channel with the request and response.
+    *
+    * @return true if the response may be cached, false if not.
+    */
+   virtual bool isCacheable(ServiceChannel* ch);
+
+   /**
+    * Sends the cached response to the request on the given channel, if there
+    * is one. A request with "Cache-Control: no-cache" or with credentials
+    * (see isPrivate()) is never answered from the cache.
+    *
+    * @param ch the channel with the request.
+    *
+    * @return true if a cached response was sent (or an exception occurred
+    *         while sending it), false if there was none.
+    */
+   virtual bool respond(ServiceChannel* ch);
+
+   /**
+    * Serializes a DynamicObject according to the response Content-Type,
+    * caches it as the response to the request on the given channel and
+    * sends it. The caller must check isCacheable() first.
+    *
+    * @param ch the channel with the request and response.
+    * @param dyno the content to send.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool storeAndSend(
+      ServiceChannel* ch, monarch::rt::DynamicObject& dyno);
+
+   /**
+    * Invalidates the cached responses for a path, regardless of their query
+    * or the headers they vary on.
+    *
+    * @param path the path, any query is ignored.
+    *
+    * @return the number of responses invalidated.
+    */
+   virtual int invalidate(const char* path);
+
+   /**
+    * Invalidates the cached responses for all paths that start with a
+    * prefix.
+    *
+    * @param prefix the path prefix.
+    *
+    * @return the number of responses invalidated.
+    */
+   virtual int invalidatePrefix(const char* prefix);
+
+   /**
+    * Invalidates all cached responses.
+    */
+   virtual void clear();
+
+   /**
+    * Gets the stats for this cache:
+    *
+    * maxSize: the maximum total size of the cached bodies.
+    * size: the total size of the cached bodies.
+    * entries: the number of cached responses.
+    * hits: the number of requests answered from the cache.
+    * misses: the number of requests that were not.
+    * notModified: the number of hits answered with 304 Not Modified.
+    * stores: the number of responses stored.
+    * evictions: the number of responses evicted to make room.
+    * expirations: the number of responses dropped because they expired.
+    * invalidations: the number of responses invalidated.
+    *
+    * @return the stats.
+    */
+   virtual monarch::rt::DynamicObject getStats();
+
+protected:
+   /**
+    * Returns true if the request on the given channel has an Authorization
+    * or Cookie header that the cache key does not include, unless requests
+    * with credentials may be cached.
+    *
+    * @param ch the channel with the request.
+    *
+    * @return true if the response may depend on who made the request.
+    */
+   virtual bool isPrivate(ServiceChannel* ch);
+
+   /**
+    * Creates the cache key for the request on the given channel.
+    *
+    * @param ch the channel with the request.
+    * @param key set to the key.
+    */
+   virtual void createKey(ServiceChannel* ch, std::string& key);
+
+   /**
+    * Gets the cached body for an encoding, creating it from the identity
+    * body if necessary.
+    *
+    * @param entry the cached response.
+    * @param encoding the encoding, set to Identity if the body could not be
+    *           encoded.
+    *
+    * @return the body.
+    */
+   virtual const std::string& getBody(EntryRef& entry, Encoding& encoding);
+
+   /**
+    * Sends a cached response, or 304 Not Modified if the request's
+    * conditions allow it.
+    *
+    * @param ch the channel with the request.
+    * @param entry the cached response.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool send(ServiceChannel* ch, EntryRef& entry);
+
+   /**
+    * Stores a response, evicting others if the cache is too large. The cache
+    * must be locked.
+    *
+    * @param key the cache key.
+    * @param entry the response.
+    */
+   virtual void storeEntry(const char* key, EntryRef& entry);
+
+   /**
+    * Removes a response from this cache. The cache must be locked.
+    *
+    * @param i the response to remove.
+    */
+   virtual void removeEntry(EntryMap::iterator i);
+
+   /**
+    * Invalidates the cached responses whose paths match. The cache must be
+    * locked.
+    *
+    * @param path the path or path prefix.
+    * @param prefix true to match paths that start with the path, false to
+    *           match paths equal to it.
+    *
+    * @return the number of responses invalidated.
+    */
+   virtual int invalidatePaths(const char* path, bool prefix);
+};
+
+// type definition for a reference counted ResponseCache
+typedef monarch::rt::Collectable<ResponseCache> ResponseCacheRef;
+
+} // end namespace ws
+} // end namespace monarch
+#endif
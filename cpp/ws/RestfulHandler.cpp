@@ -1,9 +1,12 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/ws/RestfulHandler.h"
 
 #include "monarch/rt/DynamicObjectIterator.h"
+#include "monarch/util/Url.h"
+
+#include <algorithm>
 
 using namespace std;
 using namespace monarch::http;
@@ -22,6 +25,13 @@ RestfulHandler::~RestfulHandler()
    {
       free(*i);
    }
+
+   // free compiled routes
+   for(vector<MethodRoutes*>::iterator i = mPathRoutes.begin();
+       i != mPathRoutes.end(); ++i)
+   {
+      delete *i;
+   }
 }
 
 void RestfulHandler::operator()(ServiceChannel* ch)
@@ -77,6 +87,7 @@ void RestfulHandler::addHandler(
    initializeHandlerInfo(
       mPathHandlers[paramCount][mt][_createQueryVarKey(queryVars)],
       handler, NULL, queryValidator, contentValidator, flags);
+   compilePathRoutes(paramCount, mt);
 }
 
 void RestfulHandler::addHandler(
@@ -94,6 +105,7 @@ void RestfulHandler::addHandler(
    initializeHandlerInfo(
       mPathHandlers[paramCount][mt][_createQueryVarKey(queryVars)],
       handler, resourceValidator, queryValidator, contentValidator, flags);
+   compilePathRoutes(paramCount, mt);
 }
 
 bool RestfulHandler::addRegexHandler(
@@ -143,6 +155,7 @@ bool RestfulHandler::addRegexHandler(
       initializeHandlerInfo(
          rinfo->methods[mt][_createQueryVarKey(queryVars)],
          handler, NULL, queryValidator, contentValidator, flags);
+      compileQueryRoutes(rinfo->methods[mt], rinfo->routes.methods[mt]);
    }
 
    return rval;
@@ -202,6 +215,118 @@ static Message::MethodType _getMethodType(ServiceChannel* ch, string& method)
    return mt;
 }
 
+bool RestfulHandler::sortQueryVars(const QueryVar& a, const QueryVar& b)
+{
+   return a.name < b.name;
+}
+
+void RestfulHandler::compileQueryRoutes(
+   HandlerInfoMap& him, QueryRouteList& routes)
+{
+   // compile routes in the same order as the map
+   routes.clear();
+   for(HandlerInfoMap::iterator himi = him.begin(); himi != him.end(); ++himi)
+   {
+      DynamicObject& qVar = const_cast<DynamicObject&>(himi->first);
+
+      QueryRoute route;
+      route.any = qVar.isNull();
+      route.info = &himi->second;
+      if(!route.any)
+      {
+         // store each variable's values as sorted strings
+         DynamicObjectIterator i = qVar.getIterator();
+         while(i->hasNext())
+         {
+            DynamicObject& values = i->next();
+            route.vars.push_back(QueryVar());
+            QueryVar& var = route.vars.back();
+            var.name = i->getName();
+            DynamicObjectIterator vi = values.getIterator();
+            while(vi->hasNext())
+            {
+               DynamicObject& value = vi->next();
+               if(!value.isNull() &&
+                  value->getType() != Map && value->getType() != Array)
+               {
+                  var.values.push_back(value->getString());
+               }
+            }
+            sort(var.values.begin(), var.values.end());
+         }
+         sort(route.vars.begin(), route.vars.end(), sortQueryVars);
+      }
+      routes.push_back(route);
+   }
+}
+
+void RestfulHandler::compilePathRoutes(int paramCount, Message::MethodType mt)
+{
+   // only arbitrary (-1) or real parameter counts can match
+   if(paramCount >= -1)
+   {
+      unsigned int idx = paramCount + 1;
+      if(idx >= mPathRoutes.size())
+      {
+         mPathRoutes.resize(idx + 1, NULL);
+      }
+      if(mPathRoutes[idx] == NULL)
+      {
+         mPathRoutes[idx] = new MethodRoutes;
+      }
+      compileQueryRoutes(
+         mPathHandlers[paramCount][mt], mPathRoutes[idx]->methods[mt]);
+   }
+}
+
+RestfulHandler::MethodRoutes* RestfulHandler::getPathRoutes(int paramCount)
+{
+   unsigned int idx = paramCount + 1;
+   return (idx < mPathRoutes.size()) ? mPathRoutes[idx] : NULL;
+}
+
+int RestfulHandler::countPathParams(ServiceChannel* ch)
+{
+   int rval = 0;
+
+   // parameters start after the base path, ignore any query
+   const char* path = ch->getPath();
+   const char* end = path + strcspn(path, "?");
+   const char* basePath = ch->getBasePath();
+   const char* start = strstr(path, basePath);
+   if(start != NULL)
+   {
+      start += strlen(basePath);
+      if(start < end)
+      {
+         // count segments
+         for(rval = 1; start < end; ++start)
+         {
+            if(*start == '/')
+            {
+               ++rval;
+            }
+         }
+      }
+   }
+
+   return rval;
+}
+
+DynamicObject RestfulHandler::getValidMethods(MethodRoutes* mr)
+{
+   DynamicObject rval;
+   rval->setType(Array);
+   for(int mt = 0; mt <= Message::Connect; ++mt)
+   {
+      if(!mr->methods[mt].empty())
+      {
+         rval->append(Message::methodToString((Message::MethodType)mt));
+      }
+   }
+   return rval;
+}
+
 RestfulHandler::HandlerInfo* RestfulHandler::findHandler(ServiceChannel* ch)
 {
    HandlerInfo* rval = NULL;
@@ -210,61 +335,43 @@ RestfulHandler::HandlerInfo* RestfulHandler::findHandler(ServiceChannel* ch)
    // all, but if one is found, but there is no method for it, send a 405
    bool send404 = true;
 
-   // get path params, query vars, and method type from channel
-   DynamicObject paramDyno;
-   ch->getPathParams(paramDyno);
-   int paramCount = paramDyno->length();
-   DynamicObject queryVars;
-   ch->getQuery(queryVars, true);
+   // get path param count and method type from channel
+   int paramCount = countPathParams(ch);
    string method;
    Message::MethodType mt = _getMethodType(ch, method);
    DynamicObject validMethods(NULL);
 
    // try to find path handler using param count
-   HandlerMap::iterator hmi = mPathHandlers.find(paramCount);
-   if(hmi == mPathHandlers.end())
+   MethodRoutes* mr = getPathRoutes(paramCount);
+   bool arbitrary = (mr == NULL);
+   if(arbitrary)
    {
       // no handler found for specific param count, so check arbitrary count
-      hmi = mPathHandlers.find(-1);
+      mr = getPathRoutes(-1);
    }
 
    // potential handler found, check method types
-   MethodMap::iterator mmi;
-   if(hmi != mPathHandlers.end())
+   if(mr != NULL)
    {
       // path match found, so if methods don't match, return a 405 not a 404
       send404 = false;
 
-      // find the map of valid methods for the given handler
-      MethodMap* mm = &(hmi->second);
-      mmi = mm->find(mt);
-
       // if there's no match for a valid method using the given param count,
       // try looking for one using the arbitrary param count
-      if(mmi == mm->end() && hmi->first != -1)
+      if(mr->methods[mt].empty() && !arbitrary && getPathRoutes(-1) != NULL)
       {
-         hmi = mPathHandlers.find(-1);
-         if(hmi != mPathHandlers.end())
-         {
-            mm = &(hmi->second);
-            mmi = mm->find(mt);
-         }
+         mr = getPathRoutes(-1);
       }
 
       // see if there is a match for the given request method
-      if(mmi != mm->end())
+      if(!mr->methods[mt].empty())
       {
-         rval = findHandler(mmi->second, queryVars);
+         rval = findHandler(mr->methods[mt], ch->getPath());
       }
       else
       {
          // add valid method types
-         validMethods = DynamicObject();
-         validMethods->setType(Array);
-         for(mmi = mm->begin(); mmi != mm->end(); ++mmi)
-         {
-            validMethods->append(Message::methodToString(mmi->first));
-         }
+         validMethods = getValidMethods(mr);
       }
    }
 
@@ -295,12 +402,11 @@ RestfulHandler::HandlerInfo* RestfulHandler::findHandler(ServiceChannel* ch)
             send404 = false;
 
             // look for a handler with a matching method
-            MethodMap& mm = rmi->second.methods;
-            mmi = mm.find(mt);
-            if(mmi != mm.end())
+            QueryRouteList& routes = rmi->second.routes.methods[mt];
+            if(!routes.empty())
             {
                // handler found, set channel handler info
-               rval = findHandler(mmi->second, queryVars);
+               rval = findHandler(routes, ch->getPath());
                DynamicObject info(Map);
                info["type"] = "monarch.ws.RestfulHandler";
                info["matches"] = matches;
@@ -309,12 +415,7 @@ RestfulHandler::HandlerInfo* RestfulHandler::findHandler(ServiceChannel* ch)
             else if(validMethods.isNull())
             {
                // add valid method types
-               validMethods = DynamicObject();
-               validMethods->setType(Array);
-               for(mmi = mm.begin(); mmi != mm.end(); ++mmi)
-               {
-                  validMethods->append(Message::methodToString(mmi->first));
-               }
+               validMethods = getValidMethods(&rmi->second.routes);
             }
          }
       }
@@ -358,72 +459,120 @@ RestfulHandler::HandlerInfo* RestfulHandler::findHandler(ServiceChannel* ch)
    return rval;
 }
 
+void RestfulHandler::parseQuery(const char* path, vector<QueryVar>& vars)
+{
+   const char* query = strchr(path, '?');
+   while(query != NULL)
+   {
+      // get the next name=value pair
+      const char* tok = query + 1;
+      query = strchr(tok, '&');
+      int length = (query != NULL) ? query - tok : strlen(tok);
+      const char* eq = (const char*)memchr(tok, '=', length);
+      int nameLength = (eq != NULL) ? eq - tok : length;
+      if(nameLength > 0)
+      {
+         // find or add var
+         string name = Url::decode(tok, nameLength);
+         vector<QueryVar>::iterator i = vars.begin();
+         for(; i != vars.end() && i->name != name; ++i);
+         if(i == vars.end())
+         {
+            vars.push_back(QueryVar());
+            i = vars.end() - 1;
+            i->name = name;
+         }
+
+         // add value
+         if(eq != NULL)
+         {
+            i->values.push_back(Url::decode(eq + 1, length - nameLength - 1));
+         }
+         else
+         {
+            i->values.push_back(string());
+         }
+      }
+   }
+}
+
 RestfulHandler::HandlerInfo* RestfulHandler::findHandler(
-   HandlerInfoMap& him, DynamicObject& queryVars)
+   QueryRouteList& routes, const char* path)
 {
    HandlerInfo* rval = NULL;
 
-   // find the queryVar with the most specific matches
-   int maxKeyMatches = 0;
-   int maxValMatches = 0;
-   bool allKeysMatch = false;
-   for(HandlerInfoMap::iterator himi = him.begin(); himi != him.end(); ++himi)
+   // a single route is always used regardless of the query
+   if(routes.size() == 1)
    {
-      DynamicObject& qVar = const_cast<DynamicObject&>(himi->first);
-
-      // catch-all queryVar
-      if(qVar.isNull())
+      rval = routes[0].info;
+   }
+   else
+   {
+      vector<QueryVar> queryVars;
+      parseQuery(path, queryVars);
+
+      // find the route with the most specific matches
+      int maxKeyMatches = 0;
+      int maxValMatches = 0;
+      bool allKeysMatch = false;
+      for(QueryRouteList::iterator ri = routes.begin();
+          ri != routes.end(); ++ri)
       {
-         if(rval == NULL)
+         // catch-all route
+         if(ri->any)
          {
-            rval = &himi->second;
+            if(rval == NULL)
+            {
+               rval = ri->info;
+            }
          }
-      }
-      // more specific queryVar
-      else
-      {
-         // count matches
-         int keyMatches = 0;
-         int valMatches = 0;
-         DynamicObjectIterator ki = queryVars.getIterator();
-         while(ki->hasNext())
+         // more specific route
+         else
          {
-            DynamicObject& values = ki->next();
-            if(qVar->hasMember(ki->getName()))
+            // count matches
+            int keyMatches = 0;
+            int valMatches = 0;
+            for(vector<QueryVar>::iterator qi = queryVars.begin();
+                qi != queryVars.end(); ++qi)
             {
-               ++keyMatches;
-               DynamicObject& qVarVals = qVar[ki->getName()];
-               DynamicObjectIterator vi = values.getIterator();
-               while(vi->hasNext())
+               vector<QueryVar>::iterator vi = lower_bound(
+                  ri->vars.begin(), ri->vars.end(), *qi, sortQueryVars);
+               if(vi != ri->vars.end() && vi->name == qi->name)
                {
-                  DynamicObject& value = vi->next();
-                  if(!qVarVals.isNull() && qVarVals->indexOf(value) != -1)
+                  ++keyMatches;
+                  for(vector<string>::iterator i = qi->values.begin();
+                      i != qi->values.end(); ++i)
                   {
-                     ++valMatches;
+                     if(binary_search(vi->values.begin(), vi->values.end(), *i))
+                     {
+                        ++valMatches;
+                     }
                   }
                }
             }
-         }
 
-         // determine if all the keys match exactly
-         bool hasSameKeys = (keyMatches == queryVars->length() &&
-            keyMatches == qVar->length());
-
-         // pick current handler if:
-         // 1. no handler picked yet, OR
-         // 2. # of key matches is greater than previous pick or # of key
-         //    matches are equal and either:
-         // 1. previous pick's keys do not all match but current's do, OR
-         // 2. key matches are the same, but current has more value matches
-         if(rval == NULL || keyMatches > maxKeyMatches ||
-            (keyMatches == maxKeyMatches && (
-               (!allKeysMatch && hasSameKeys) ||
-               (allKeysMatch == hasSameKeys && valMatches > maxValMatches))))
-         {
-            maxKeyMatches = keyMatches;
-            maxValMatches = valMatches;
-            allKeysMatch = hasSameKeys;
-            rval = &himi->second;
+            // determine if all the keys match exactly
+            bool hasSameKeys =
+               (keyMatches == (int)queryVars.size() &&
+                keyMatches == (int)ri->vars.size());
+
+            // pick current handler if:
+            // 1. no handler picked yet, OR
+            // 2. # of key matches is greater than previous pick or # of key
+            //    matches are equal and either:
+            // 1. previous pick's keys do not all match but current's do, OR
+            // 2. key matches are the same, but current has more value matches
+            if(rval == NULL || keyMatches > maxKeyMatches ||
+               (keyMatches == maxKeyMatches && (
+                  (!allKeysMatch && hasSameKeys) ||
+                  (allKeysMatch == hasSameKeys &&
+                   valMatches > maxValMatches))))
+            {
+               maxKeyMatches = keyMatches;
+               maxValMatches = valMatches;
+               allKeysMatch = hasSameKeys;
+               rval = ri->info;
+            }
          }
       }
    }
@@ -464,7 +613,7 @@ void RestfulHandler::handleChannel(ServiceChannel* ch, HandlerInfo* info)
 
       if(pass)
       {
-         info->handler->handleRequest(ch);
+         info->handler->handleRequestWithCache(ch);
       }
    }
 
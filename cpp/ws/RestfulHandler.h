@@ -10,6 +10,8 @@
 #include "monarch/ws/PathHandler.h"
 
 #include <map>
+#include <string>
+#include <vector>
 
 namespace monarch
 {
@@ -29,6 +31,13 @@ namespace ws
  * Handlers can also have Validators for both the query parameters and for the
  * input content.
  *
+ * Handlers are compiled into a dispatch table as they are added. A request is
+ * dispatched by counting its path parameters, indexing its method type, and
+ * matching its query variable names against those required by the handlers,
+ * without building any intermediate DynamicObjects. The query is only parsed
+ * if more than one handler is registered for the same parameter count and
+ * method type.
+ *
  * The order of processing is important to consider. Under some circumstances
  * it may be more appropriate to do more direct handling of requests. This
  * class is intended to simplify a more general case.
@@ -84,6 +93,40 @@ protected:
     */
    typedef std::map<Message::MethodType, HandlerInfoMap> MethodMap;
 
+   /**
+    * A compiled query variable: its name and its sorted, string values.
+    */
+   struct QueryVar
+   {
+      std::string name;
+      std::vector<std::string> values;
+   };
+
+   /**
+    * A compiled handler route for a set of query variables. If "any" is
+    * true, the route matches any query variables.
+    */
+   struct QueryRoute
+   {
+      bool any;
+      std::vector<QueryVar> vars;
+      HandlerInfo* info;
+   };
+
+   /**
+    * A list of query routes in the same order as their HandlerInfoMap.
+    */
+   typedef std::vector<QueryRoute> QueryRouteList;
+
+   /**
+    * Compiled query routes indexed by method type. An empty list means there
+    * is no handler for the method type.
+    */
+   struct MethodRoutes
+   {
+      QueryRouteList methods[Message::Connect + 1];
+   };
+
    /**
     * Info for regex handlers.
     */
@@ -91,6 +134,7 @@ protected:
    {
       monarch::util::PatternRef pattern;
       MethodMap methods;
+      MethodRoutes routes;
    };
 
    /**
@@ -125,6 +169,12 @@ protected:
     */
    RegexList mRegexList;
 
+   /**
+    * Compiled path handler routes indexed by parameter count + 1 (so that
+    * arbitrary parameter count routes are at index 0), NULL for none.
+    */
+   std::vector<MethodRoutes*> mPathRoutes;
+
 public:
    /**
     * Creates a new RestfulHandler.
@@ -247,6 +297,33 @@ protected:
       monarch::validation::ValidatorRef* contentValidator,
       uint32_t flags);
 
+   /**
+    * Compiles the query routes for the given HandlerInfoMap.
+    *
+    * @param him the HandlerInfoMap to compile.
+    * @param routes the list to populate with query routes.
+    */
+   virtual void compileQueryRoutes(
+      HandlerInfoMap& him, QueryRouteList& routes);
+
+   /**
+    * Compiles the path handler routes for the given parameter count and
+    * method type.
+    *
+    * @param paramCount the parameter count, -1 for arbitrary.
+    * @param mt the method type.
+    */
+   virtual void compilePathRoutes(int paramCount, Message::MethodType mt);
+
+   /**
+    * Gets the compiled path handler routes for the given parameter count.
+    *
+    * @param paramCount the parameter count, -1 for arbitrary.
+    *
+    * @return the MethodRoutes or NULL if there are none.
+    */
+   virtual MethodRoutes* getPathRoutes(int paramCount);
+
    /**
     * Finds the handler for the given ServiceChannel.
     *
@@ -257,16 +334,55 @@ protected:
    virtual HandlerInfo* findHandler(ServiceChannel* ch);
 
    /**
-    * Finds the handler for the given query parameters in the given
-    * HandlerInfoMap.
+    * Finds the handler for the query in the given path in the given query
+    * routes. The handler whose query variable names best match the query
+    * is chosen, using the number of matching values to break ties.
     *
-    * @param him the HandlerInfoMap to look in.
-    * @param queryVars the query variables to match against.
+    * @param routes the QueryRouteList to look in.
+    * @param path the request path, including any query.
     *
     * @return the HandlerInfo, NULL if none could be found.
     */
-   virtual HandlerInfo* findHandler(
-      HandlerInfoMap& him, monarch::rt::DynamicObject& queryVars);
+   virtual HandlerInfo* findHandler(QueryRouteList& routes, const char* path);
+
+   /**
+    * Counts the path parameters in the channel's path. This is the number of
+    * path segments after the base path, as would be returned from
+    * ServiceChannel::getPathParams().
+    *
+    * @param ch the ServiceChannel.
+    *
+    * @return the number of path parameters.
+    */
+   static int countPathParams(ServiceChannel* ch);
+
+   /**
+    * Parses the query in a path into variables with arrays of values,
+    * grouped by name in the order they appear, like Url::formDecode() does.
+    *
+    * @param path the path with the query.
+    * @param vars the variables to populate.
+    */
+   static void parseQuery(const char* path, std::vector<QueryVar>& vars);
+
+   /**
+    * Gets the valid methods for the given method routes.
+    *
+    * @param mr the method routes.
+    *
+    * @return an array of valid method names.
+    */
+   static monarch::rt::DynamicObject getValidMethods(MethodRoutes* mr);
+
+   /**
+    * Sorts compiled query variables by name.
+    *
+    * @param a the first variable.
+    * @param b the second variable.
+    *
+    * @return true if a's name is less than b's.
+    */
+   static bool sortQueryVars(const QueryVar& a, const QueryVar& b);
 
    /**
     * Handles the passed ServiceChannel using the already-found handler.
@@ -1,15 +1,20 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #include "monarch/ws/ServiceChannel.h"
 
 #include "monarch/logging/Logging.h"
 #include "monarch/data/json/JsonWriter.h"
+#include "monarch/io/NullOutputStream.h"
+#include "monarch/util/StringTools.h"
+#include "monarch/ws/ResponseCache.h"
 
 #include <cctype>
+#include <cstdlib>
 #include <algorithm>
 
 using namespace std;
+using namespace monarch::data;
 using namespace monarch::data::json;
 using namespace monarch::http;
 using namespace monarch::io;
@@ -23,6 +28,7 @@ using namespace monarch::ws;
 #define CONTENT_TYPE_JSONLD "application/ld+json"
 #define CONTENT_TYPE_XML    "text/xml"
 #define CONTENT_TYPE_FORM   "application/x-www-form-urlencoded"
+#define CONTENT_TYPE_MSGPACK "application/x-msgpack"
 
 ServiceChannel::ServiceChannel(const char* path) :
    mPath(strdup(path)),
@@ -40,7 +46,8 @@ ServiceChannel::ServiceChannel(const char* path) :
    mAuthMethod(NULL),
    mContentReceived(false),
    mHasSent(NULL),
-   mAutoContentEncode(true)
+   mAutoContentEncode(true),
+   mResponseCache(NULL)
 {
 }
 
@@ -252,6 +259,21 @@ void ServiceChannel::setAutoContentEncode(bool on)
    mAutoContentEncode = on;
 }
 
+bool ServiceChannel::isAutoContentEncode()
+{
+   return mAutoContentEncode;
+}
+
+void ServiceChannel::setResponseCache(ResponseCache* cache)
+{
+   mResponseCache = cache;
+}
+
+ResponseCache* ServiceChannel::getResponseCache()
+{
+   return mResponseCache;
+}
+
 bool ServiceChannel::receiveContent(OutputStream* os, bool close)
 {
    // set content sink, receive content
@@ -361,6 +383,78 @@ bool ServiceChannel::sendContent(InputStream* is)
    return rval;
 }
 
+/**
+ * Gets the quality a client gives a media type in an Accept header. As in
+ * RFC 7231, the most specific media range that matches the type gives its
+ * quality: the type itself, then its top-level type with any subtype, then
+ * any type.
+ *
+ * @param accept the value of the Accept header.
+ * @param type the media type.
+ * @param specificity set to how specific the matching range is, if not
+ *           NULL: 3 for the type itself, 2 for any subtype, 1 for any type,
+ *           0 if none matches.
+ *
+ * @return the quality from 0 to 1000, -1 if no range matches the type.
+ */
+static int _getAcceptQuality(
+   const char* accept, const char* type, int* specificity = NULL)
+{
+   int rval = -1;
+   int best = 0;
+
+   // the length of the type up to and including its '/'
+   const char* slash = strchr(type, '/');
+   size_t prefix = (slash == NULL) ? 0 : slash - type + 1;
+
+   // each entry is a media range followed by parameters
+   DynamicObject entries = StringTools::split(accept, ",");
+   for(int i = 0; best < 3 && i < entries->length(); ++i)
+   {
+      DynamicObject params = StringTools::split(entries[i]->getString(), ";");
+      string range = params[0]->getString();
+      StringTools::trim(range, " \t");
+
+      int match = 0;
+      if(strcasecmp(range.c_str(), type) == 0)
+      {
+         match = 3;
+      }
+      else if(prefix > 0 && range.length() == prefix + 1 &&
+         range[prefix] == '*' && strncasecmp(range.c_str(), type, prefix) == 0)
+      {
+         match = 2;
+      }
+      else if(range == CONTENT_TYPE_ANY)
+      {
+         match = 1;
+      }
+
+      if(match > best)
+      {
+         best = match;
+         rval = 1000;
+         for(int p = 1; p < params->length(); ++p)
+         {
+            string param = params[p]->getString();
+            StringTools::trim(param, " \t");
+            if(strncasecmp(param.c_str(), "q=", 2) == 0)
+            {
+               double q = strtod(param.c_str() + 2, NULL);
+               rval = (q <= 0) ? 0 : (q >= 1) ? 1000 : (int)(q * 1000 + 0.5);
+            }
+         }
+      }
+   }
+
+   if(specificity != NULL)
+   {
+      *specificity = best;
+   }
+
+   return rval;
+}
+
 static void _setDynoContentType(HttpRequest* request, HttpResponse* response)
 {
    // use accept content-type if not already set
@@ -369,8 +463,18 @@ static void _setDynoContentType(HttpRequest* request, HttpResponse* response)
    {
       ct = request->getHeader()->getFieldValue("Accept");
 
-      // prefer JSON
-      if(ct.length() == 0 ||
+      // use MessagePack if it is preferred to JSON, or as preferred and
+      // named by the client, so wildcards alone still get JSON
+      int specificity;
+      int msgpack = _getAcceptQuality(
+         ct.c_str(), CONTENT_TYPE_MSGPACK, &specificity);
+      int json = _getAcceptQuality(ct.c_str(), CONTENT_TYPE_JSON);
+      if(msgpack > 0 &&
+         (msgpack > json || (msgpack == json && specificity == 3)))
+      {
+         ct = CONTENT_TYPE_MSGPACK;
+      }
+      else if(ct.length() == 0 ||
          strstr(ct.c_str(), CONTENT_TYPE_ANY) != NULL ||
          strstr(ct.c_str(), CONTENT_TYPE_JSON) != NULL)
       {
@@ -414,18 +518,92 @@ bool ServiceChannel::sendContent(DynamicObject& dyno)
       // set dyno content-type if not already set
       _setDynoContentType(mRequest, mResponse);
 
-      // set content object
-      mOutput->setDynamicObject(dyno);
+      // cache serialized content and send it from the cache
+      if(mResponseCache != NULL && mResponseCache->isCacheable(this))
+      {
+         rval = mResponseCache->storeAndSend(this, dyno);
+      }
+      else
+      {
+         // set content object
+         mOutput->setDynamicObject(dyno);
 
-      // auto-select content-encoding if specified and not set
-      if(mAutoContentEncode &&
-         !mResponse->getHeader()->hasField("Content-Encoding"))
+         // auto-select content-encoding if specified and not set
+         if(mAutoContentEncode &&
+            !mResponse->getHeader()->hasField("Content-Encoding"))
+         {
+            selectContentEncoding();
+         }
+
+         // send
+         rval = mOutput->sendResponse(mResponse);
+         if(rval)
+         {
+            setSent();
+         }
+      }
+   }
+
+   return rval;
+}
+
+bool ServiceChannel::sendContentHeader(OutputStreamRef& os)
+{
+   bool rval = true;
+
+   os.setNull();
+   if(hasSent())
+   {
+      ExceptionRef e = new Exception(
+         "Could not send content header, a response was already sent.",
+         "monarch.ws.ResponseAlreadySent");
+      Exception::set(e);
+      rval = false;
+   }
+   else
+   {
+      // set response code if not set
+      HttpResponseHeader* header = mResponse->getHeader();
+      if(header->getStatusCode() == 0)
+      {
+         // send 200 OK
+         header->setStatus(200, "OK");
+      }
+
+      // select content encoding if auto-mode and not set
+      if(mAutoContentEncode && !header->hasField("Content-Encoding"))
       {
          selectContentEncoding();
       }
 
-      // send
-      rval = mOutput->sendResponse(mResponse);
+      DynamicObject dyno(NULL);
+      mOutput->setDynamicObject(dyno);
+      mOutput->setContentSource(NULL);
+      if(getRequestMethod() == Message::Head)
+      {
+         // send only the header
+         rval = mOutput->sendResponse(mResponse);
+         os = new NullOutputStream();
+      }
+      else
+      {
+         // stream the content in chunks if its length is unknown
+         if(!header->hasField("Content-Length"))
+         {
+            if(strcmp(header->getVersion(), "HTTP/1.0") == 0)
+            {
+               // content ends when the connection is closed
+               header->removeField("Content-Encoding");
+               header->setField("Connection", "close");
+            }
+            else
+            {
+               header->setField("Transfer-Encoding", "chunked");
+            }
+         }
+         rval = mOutput->sendResponseHeader(mResponse, os);
+      }
+
       if(rval)
       {
          setSent();
@@ -435,6 +613,111 @@ bool ServiceChannel::sendContent(DynamicObject& dyno)
    return rval;
 }
 
+bool ServiceChannel::sendFile(const char* filename, TemplateCache* cache)
+{
+   bool rval = true;
+
+   if(!hasSent())
+   {
+      // an empty cache reads everything from disk
+      TemplateCache none(0);
+      if(cache == NULL)
+      {
+         cache = &none;
+      }
+
+      // select content encoding if auto-mode and not set
+      HttpResponseHeader* header = mResponse->getHeader();
+      if(mAutoContentEncode && !header->hasField("Content-Encoding"))
+      {
+         selectContentEncoding();
+      }
+      TemplateCache::Encoding encoding = TemplateCache::Identity;
+      string contentEncoding;
+      if(header->getField("Content-Encoding", contentEncoding))
+      {
+         if(strstr(contentEncoding.c_str(), "gzip") != NULL)
+         {
+            encoding = TemplateCache::Gzip;
+         }
+         else if(strstr(contentEncoding.c_str(), "deflate") != NULL)
+         {
+            encoding = TemplateCache::Deflate;
+         }
+      }
+
+      // get the already encoded file if possible
+      off_t length = 0;
+      InputStream* is = NULL;
+      if(encoding != TemplateCache::Identity)
+      {
+         is = cache->createEncodedStream(filename, encoding, &length);
+         if(is == NULL)
+         {
+            Exception::clear();
+            is = cache->createStream(filename, &length);
+            if(strcmp(mRequest->getHeader()->getVersion(), "HTTP/1.0") == 0)
+            {
+               // no chunked encoding to compress on the fly with
+               header->removeField("Content-Encoding");
+            }
+            else
+            {
+               // compress on the fly with chunked encoding instead
+               header->removeField("Content-Length");
+               length = -1;
+            }
+         }
+      }
+      else
+      {
+         is = cache->createStream(filename, &length);
+      }
+
+      if(is == NULL)
+      {
+         ExceptionRef e = new Exception(
+            "File not found.",
+            "monarch.ws.FileNotFound");
+         e->getDetails()["path"] = getPath();
+         e->getDetails()["httpStatusCode"] = 404;
+         Exception::push(e);
+         rval = false;
+      }
+      else
+      {
+         // set response code if not set
+         if(header->getStatusCode() == 0)
+         {
+            // send 200 OK
+            header->setStatus(200, "OK");
+         }
+
+         // send the encoded file as-is with its length
+         if(length != -1)
+         {
+            header->removeField("Transfer-Encoding");
+            header->setField("Content-Length", (int64_t)length);
+         }
+
+         // send
+         DynamicObject dyno(NULL);
+         mOutput->setDynamicObject(dyno);
+         mOutput->setContentSource((getRequestMethod() == Message::Head) ?
+            NULL : is);
+         rval = mOutput->sendResponse(mResponse);
+         mOutput->setContentSource(NULL);
+         if(rval)
+         {
+            setSent();
+         }
+         delete is;
+      }
+   }
+
+   return rval;
+}
+
 bool ServiceChannel::sendException(ExceptionRef& e, bool client)
 {
    bool rval = true;
@@ -1,9 +1,10 @@
 /*
- * Copyright (c) 2010-2011 Digital Bazaar, Inc. All rights reserved.
+ * Copyright (c) 2010-2012 Digital Bazaar, Inc. All rights reserved.
  */
 #ifndef monarch_ws_ServiceChannel_H
 #define monarch_ws_ServiceChannel_H
 
+#include "monarch/data/TemplateCache.h"
 #include "monarch/ws/Message.h"
 
 namespace monarch
@@ -11,6 +12,8 @@ namespace monarch
 namespace ws
 {
 
+class ResponseCache;
+
 /**
  * A ServiceChannel is the channel used by a WebService to communicate with
  * a client. It contains a Message for receiving data from the client,
@@ -128,6 +131,11 @@ protected:
     */
    bool mAutoContentEncode;
 
+   /**
+    * The cache to store sent content in, NULL for none.
+    */
+   ResponseCache* mResponseCache;
+
 public:
    /**
     * Creates a new ServiceChannel for the passed path.
@@ -285,6 +293,30 @@ public:
     */
    virtual void setAutoContentEncode(bool on);
 
+   /**
+    * Returns true if content-encoding will be automatically selected when
+    * sending content.
+    *
+    * @return true if content-encoding is auto-selected, false if not.
+    */
+   virtual bool isAutoContentEncode();
+
+   /**
+    * Sets the cache to store content in when it is sent as a DynamicObject
+    * and the response may be cached. This is set by a PathHandler that has a
+    * ResponseCache.
+    *
+    * @param cache the cache to use, NULL for none.
+    */
+   virtual void setResponseCache(ResponseCache* cache);
+
+   /**
+    * Gets the cache that content is stored in when it is sent.
+    *
+    * @return the cache, NULL for none.
+    */
+   virtual ResponseCache* getResponseCache();
+
    /**
     * Receives the client's content and writes it to the passed output stream.
     *
@@ -336,6 +368,43 @@ public:
     */
    virtual bool sendContent(monarch::rt::DynamicObject& dyno);
 
+   /**
+    * Sends the response header and gets a stream to write the content to as
+    * it is produced, for instance with a JsonStreamWriter. Unless a
+    * Content-Length has been set, the content is sent with chunked encoding
+    * (or, for HTTP/1.0, until the connection is closed), so it need not be
+    * held in memory. The stream must be closed once all of the content has
+    * been written. If the http response code is set to zero, this method
+    * will automatically set it.
+    *
+    * For a HEAD request, the stream discards everything written to it.
+    *
+    * @param os set to the stream to write the content to.
+    *
+    * @return true if successful, false if an exception occurred.
+    */
+   virtual bool sendContentHeader(monarch::io::OutputStreamRef& os);
+
+   /**
+    * Sends the response header and the contents of a file to the client. If
+    * the content is to be gzipped or deflated (either because the
+    * Content-Encoding is already set or because it is auto-selected), the
+    * encoded file is read from the cache, or from a ".gz" sibling of the
+    * file, and sent as-is with a Content-Length. Only if no encoded variant
+    * is available is the file compressed on the fly with chunked encoding.
+    * If the http response code is set to zero, this method will
+    * automatically set it.
+    *
+    * @param filename the name of the file to send.
+    * @param cache the cache to read the file and its encodings from, NULL to
+    *           read them from disk every time.
+    *
+    * @return true if successful, false if an exception occurred (if the file
+    *         does not exist the exception has an httpStatusCode of 404).
+    */
+   virtual bool sendFile(
+      const char* filename, monarch::data::TemplateCache* cache = NULL);
+
    /**
     * Sends the response header and an exception as a DynamicObject to the
     * client using the content-type specified in the response header or an